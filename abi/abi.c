@@ -32,13 +32,13 @@
 #ifdef __SSE__
 # include <xmmintrin.h>
 #endif /* __SSE__ */
+#ifdef __AVX__
+# include <immintrin.h>
+#endif /* __AVX__ */
 
 #include "libitm.h"
 #include "utils.h"
 
-/* FIXME STACK_CHECK: DTMC and GCC can use ITM_W to write on stack variable */
-/* TODO STACK_CHECK: to finish and test */
-
 #include "stm.h"
 #include "atomic.h"
 #include "mod_cb.h"
@@ -108,11 +108,6 @@ static union {
 
 typedef struct {
   int thread_id;
-#ifdef STACK_CHECK
-/* TODO STACK_CHECK could be moved to stm.c and we could calculate a mask to detect if the address is in the stack */
-  void *stack_addr_low;
-  void *stack_addr_high;
-#endif /* STACK_CHECK */
 } thread_abi_t;
 
 /* Statistics */
@@ -179,17 +174,22 @@ asm ( "movl %%fs:0x18, %0\n"
 return (void*)pTib->StackBase; 
 #endif
 */
-static INLINE int on_stack(void *a)
+/*
+ * Is the address in the part of the stack that was not in use when the
+ * (innermost closed nested) transaction started, i.e., below its saved
+ * stack pointer?  Such locations are discarded upon rollback and need no
+ * barrier.  The bounds are cached in
+ * the transaction descriptor to use a single comparison.
+ */
+static INLINE int on_stack(const volatile void *a)
 {
-#ifdef TLS
-  thread_abi_t *t = thread_abi;
-#else /* ! TLS */
-  thread_abi_t *t = pthread_getspecific(thread_abi);
-#endif /* ! TLS */
-  if ((t->stack_addr_low <= (uintptr_t)a) && ((uintptr_t)a < t->stack_addr_high)) { 
-    return 1;
-  } 
-  return 0;
+  stm_tx_t *tx = tls_get_tx();
+  if (likely((stm_word_t)a - tx->stack_low >= tx->stack_size))
+    return 0;
+#ifdef TM_STATISTICS
+  tx->stat_stack_filtered++;
+#endif /* TM_STATISTICS */
+  return 1;
 }
 #endif /* STACK_CHECK */
 
@@ -229,7 +229,12 @@ abi_init_thread(void)
     //t->thread_id = (int)ATOMIC_FETCH_INC_FULL(&global_abi.thread_counter);
     tx = stm_init_thread();
 #ifdef STACK_CHECK
-    get_stack_attr(&t->stack_addr_low, &t->stack_addr_high);
+    {
+      stm_word_t high;
+      /* Stack filtering is disabled if the bounds are unknown */
+      if (get_stack_attr(&tx->stack_low, &high) != 0)
+        tx->stack_low = 0;
+    }
 #endif /* STACK_CHECK */
   }
   return tx;
@@ -438,6 +443,17 @@ void _ITM_CALL_CONVENTION _ITM_dropReferences(TX_ARGS const void *__start,
   fprintf(stderr, "%s: not yet implemented\n", __func__);
 }
 
+/*
+ * TinySTM extension: hint that the transaction is about to read a
+ * memory location (prefetches the data and its lock).
+ */
+void _ITM_CALL_CONVENTION _ITM_prefetch(TX_ARGS const void *__addr)
+{
+  TX_GET_ABI;
+  if (tx != NULL)
+    int_stm_prefetch(tx, __addr);
+}
+
 void _ITM_CALL_CONVENTION _ITM_userError(const char *errString, int exitCode)
 {
   fprintf(stderr, "%s", errString);
@@ -533,6 +549,11 @@ uint32_t _ITM_CALL_CONVENTION GTM_begin_transaction(TX_ARGS uint32_t attr, jmp_b
     if (attr & pr_readOnly)
       _a.read_only = 1;
 #endif /* TM_GCC */
+#ifdef CLOSED_NESTING
+    /* Nested transactions that may abort are closed nested */
+    if (!(attr & pr_hasNoAbort))
+      _a.closed_nesting = 1;
+#endif /* CLOSED_NESTING */
 
     ret = a_runInstrumentedCode | a_saveLiveVariables;
   }
@@ -544,10 +565,17 @@ uint32_t _ITM_CALL_CONVENTION GTM_begin_transaction(TX_ARGS uint32_t attr, jmp_b
 #endif /* TM_DTMC */
 
   env = int_stm_start(tx, _a);
-  /* Save thread context only when outermost transaction */
+  /* Save thread context only when outermost (or closed nested) transaction */
   /* TODO check that the memcpy is fast. */
-  if (likely(env != NULL))
+  if (likely(env != NULL)) {
     memcpy(env, buf, sizeof(jmp_buf)); /* TODO limit size to real size */
+#ifdef STACK_CHECK
+    /* The stack below the pointer saved by _ITM_beginTransaction (first
+     * word of buf, see arch.S) is not live when the transaction restarts */
+    if (likely(tx->stack_low != 0))
+      tx->stack_size = *(stm_word_t *)buf - tx->stack_low;
+#endif /* STACK_CHECK */
+  }
 
   return ret;
 }
@@ -691,117 +719,190 @@ void _ITM_CALL_CONVENTION _ITM_commitTransactionEH(void *exc_ptr)
 
 /**** LOAD STORE LOG FUNCTIONS ****/
 
+/* Accesses to the stack of the transaction itself (below its saved stack
+ * pointer) are done directly (see on_stack()) */
+#ifdef STACK_CHECK
+# define TM_ON_STACK(addr)              unlikely(on_stack(addr))
+#else /* !STACK_CHECK */
+# define TM_ON_STACK(addr)              0
+#endif /* !STACK_CHECK */
+
 #define TM_LOAD(F, T, WF, WT) \
   T _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
   { \
-    return (WT)WF((volatile WT *)addr); \
+    if (TM_ON_STACK(addr)) return *addr; \
+    return (WT)WF(tls_get_tx(), (volatile WT *)addr); \
   }
 
 #define TM_LOAD_GENERIC(F, T) \
   T _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
   { \
     union { T d; uint8_t s[sizeof(T)]; } c; \
+    if (TM_ON_STACK(addr)) return *addr; \
     stm_load_bytes((volatile uint8_t *)addr, c.s, sizeof(T)); \
     return c.d; \
   }
 
-/* TODO if WRITE_BACK/ALL?, write to stack must be saved and written directly
- * TODO must use stm_log is addresses are under the beginTransaction
-  if (on_stack(addr)) { stm_log_u64(addr); *addr = val; } 
-not enough because if we abort and restore -> stack can be corrupted
-*/
-#ifdef STACK_CHECK
+/* Specialized barriers access the word that contains the data (values
+ * that span two words use the generic barrier) */
+#define TM_WORD_OFFSET(addr) \
+  ((uintptr_t)(addr) & (sizeof(stm_word_t) - 1))
+
+#define TM_LOAD_SPEC(F, T, WF, WT, K) \
+  T _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
+  { \
+    union { stm_word_t w; uint8_t b[sizeof(stm_word_t)]; } c; \
+    T v; \
+    if (TM_ON_STACK(addr)) return *addr; \
+    if (unlikely(TM_WORD_OFFSET(addr) + sizeof(T) > sizeof(stm_word_t))) \
+      return (WT)WF(tls_get_tx(), (volatile WT *)addr); \
+    c.w = K(tls_get_tx(), (volatile stm_word_t *)((uintptr_t)addr - TM_WORD_OFFSET(addr))); \
+    memcpy(&v, &c.b[TM_WORD_OFFSET(addr)], sizeof(T)); \
+    return v; \
+  }
+
+/* Stack locations that were live when the transaction started (above its
+ * saved stack pointer) use barriers to be restored upon rollback */
 #define TM_STORE(F, T, WF, WT) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr, T val) \
   { \
-    if (on_stack(addr)) *((T*)addr) = val; \
-    else WF((volatile WT *)addr, (WT)val); \
+    if (TM_ON_STACK(addr)) { *((T *)addr) = val; return; } \
+    WF(tls_get_tx(), (volatile WT *)addr, (WT)val); \
   }
-#else /* !STACK_CHECK */
-#define TM_STORE(F, T, WF, WT) \
+
+#define TM_STORE_SPEC(F, T, WF, WT, K) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr, T val) \
   { \
-    WF((volatile WT *)addr, (WT)val); \
+    union { stm_word_t w; uint8_t b[sizeof(stm_word_t)]; } c, m; \
+    if (TM_ON_STACK(addr)) { *((T *)addr) = val; return; } \
+    if (unlikely(TM_WORD_OFFSET(addr) + sizeof(T) > sizeof(stm_word_t))) { \
+      WF(tls_get_tx(), (volatile WT *)addr, (WT)val); \
+      return; \
+    } \
+    c.w = m.w = 0; \
+    memcpy(&c.b[TM_WORD_OFFSET(addr)], &val, sizeof(T)); \
+    memset(&m.b[TM_WORD_OFFSET(addr)], 0xFF, sizeof(T)); \
+    K(tls_get_tx(), (volatile stm_word_t *)((uintptr_t)addr - TM_WORD_OFFSET(addr)), c.w, m.w); \
   }
-#endif /* !STACK_CHECK */
 
 #define TM_STORE_GENERIC(F, T) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr, T val) \
   { \
     union { T d; uint8_t s[sizeof(T)]; } c; \
+    if (TM_ON_STACK(addr)) { *((T *)addr) = val; return; } \
     c.d = val; \
     stm_store_bytes((volatile uint8_t *)addr, c.s, sizeof(T)); \
   }
 
+/* Vectors are accessed word by word, with a single lock check for the
+ * words covered by the same lock (unaligned vectors fall back to bytes) */
+#define TM_VECTOR_ALIGNED(T, addr) \
+  (sizeof(T) % sizeof(stm_word_t) == 0 && ((uintptr_t)(addr) & (sizeof(stm_word_t) - 1)) == 0)
+
+#define TM_LOAD_VECTOR(F, T) \
+  T _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
+  { \
+    union { T d; stm_word_t w[sizeof(T) / sizeof(stm_word_t)]; uint8_t s[sizeof(T)]; } c; \
+    if (TM_ON_STACK(addr)) return *addr; \
+    if (likely(TM_VECTOR_ALIGNED(T, addr))) \
+      int_stm_load_range(tls_get_tx(), (volatile stm_word_t *)addr, c.w, sizeof(T) / sizeof(stm_word_t)); \
+    else \
+      stm_load_bytes((volatile uint8_t *)addr, c.s, sizeof(T)); \
+    return c.d; \
+  }
+
+#define TM_STORE_VECTOR(F, T) \
+  void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr, T val) \
+  { \
+    union { T d; stm_word_t w[sizeof(T) / sizeof(stm_word_t)]; uint8_t s[sizeof(T)]; } c; \
+    if (TM_ON_STACK(addr)) { *((T *)addr) = val; return; } \
+    c.d = val; \
+    if (likely(TM_VECTOR_ALIGNED(T, addr))) \
+      int_stm_store_range(tls_get_tx(), (volatile stm_word_t *)addr, c.w, sizeof(T) / sizeof(stm_word_t)); \
+    else \
+      stm_store_bytes((volatile uint8_t *)addr, c.s, sizeof(T)); \
+  }
+
 #define TM_LOG(F, T, WF, WT) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
   { \
+    if (TM_ON_STACK(addr)) return; \
     WF((WT *)addr); \
   }
 
 #define TM_LOG_GENERIC(F, T) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const T *addr) \
   { \
+    if (TM_ON_STACK(addr)) return; \
     stm_log_bytes((uint8_t *)addr, sizeof(T));    \
   }
 
 #define TM_STORE_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
+    if (TM_ON_STACK(dst)) { memcpy(dst, src, size); return; } \
     stm_store_bytes((volatile uint8_t *)dst, (uint8_t *)src, size); \
   }
 
 #define TM_LOAD_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
+    if (TM_ON_STACK(src)) { memcpy(dst, src, size); return; } \
     stm_load_bytes((volatile uint8_t *)src, (uint8_t *)dst, size); \
   }
 
 #define TM_LOG_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS const void *addr, size_t size) \
   { \
+    if (TM_ON_STACK(addr)) return; \
     stm_log_bytes((uint8_t *)addr, size); \
   }
 
-#ifdef STACK_CHECK
-#define TM_SET_BYTES(F) \
-  void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, int val, size_t count) \
-  { \
-    if (on_stack(dst)) memset(dst, val, count); \
-    else stm_set_bytes((volatile uint8_t *)dst, val, count); \
-  }
-#else /* !STACK_CHECK */
 #define TM_SET_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, int val, size_t count) \
   { \
+    if (TM_ON_STACK(dst)) { memset(dst, val, count); return; } \
     stm_set_bytes((volatile uint8_t *)dst, val, count); \
   }
-#endif /* !STACK_CHECK */
 
 #ifdef STACK_CHECK
 #define TM_COPY_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
-    uint8_t *buf = (uint8_t *)alloca(size); \
-    if (on_stack(src)) memcpy(buf, src, size); \
-    stm_load_bytes((volatile uint8_t *)src, buf, size); \
-    if (on_stack(dst)) memcpy(dst, buf, size); \
-    else stm_store_bytes((volatile uint8_t *)dst, buf, size); \
+    uint8_t *buf; \
+    int s = on_stack(src), d = on_stack(dst); \
+    if (likely(!s && !d)) { \
+      stm_move_bytes((volatile uint8_t *)dst, (volatile uint8_t *)src, size); \
+      return; \
+    } \
+    if (s && d) { \
+      memmove(dst, src, size); \
+      return; \
+    } \
+    buf = (uint8_t *)alloca(size); \
+    if (s) \
+      memcpy(buf, src, size); \
+    else \
+      stm_load_bytes((volatile uint8_t *)src, buf, size); \
+    if (d) \
+      memcpy(dst, buf, size); \
+    else \
+      stm_store_bytes((volatile uint8_t *)dst, buf, size); \
   }
 #else /* !STACK_CHECK */
 #define TM_COPY_BYTES(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
-    uint8_t *buf = (uint8_t *)alloca(size); \
-    stm_load_bytes((volatile uint8_t *)src, buf, size); \
-    stm_store_bytes((volatile uint8_t *)dst, buf, size); \
+    stm_move_bytes((volatile uint8_t *)dst, (volatile uint8_t *)src, size); \
   }
 #endif /* !STACK_CHECK */
 
 #define TM_COPY_BYTES_RN_WT(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
-    uint8_t *buf = (uint8_t *)alloca(size); \
+    uint8_t *buf; \
+    if (TM_ON_STACK(dst)) { memmove(dst, src, size); return; } \
+    buf = (uint8_t *)alloca(size); \
     memcpy(buf, src, size); \
     stm_store_bytes((volatile uint8_t *)dst, buf, size); \
   }
@@ -809,16 +910,18 @@ not enough because if we abort and restore -> stack can be corrupted
 #define TM_COPY_BYTES_RT_WN(F) \
   void _ITM_CALL_CONVENTION F(TX_ARGS void *dst, const void *src, size_t size) \
   { \
-    uint8_t *buf = (uint8_t *)alloca(size); \
+    uint8_t *buf; \
+    if (TM_ON_STACK(src)) { memmove(dst, src, size); return; } \
+    buf = (uint8_t *)alloca(size); \
     stm_load_bytes((volatile uint8_t *)src, buf, size); \
     memcpy(dst, buf, size); \
   }
 
 #define TM_LOAD_ALL(E, T, WF, WT) \
   TM_LOAD(_ITM_R##E, T, WF, WT) \
-  TM_LOAD(_ITM_RaR##E, T, WF, WT) \
-  TM_LOAD(_ITM_RaW##E, T, WF, WT) \
-  TM_LOAD(_ITM_RfW##E, T, WF, WT)
+  TM_LOAD_SPEC(_ITM_RaR##E, T, WF, WT, int_stm_RaR) \
+  TM_LOAD_SPEC(_ITM_RaW##E, T, WF, WT, int_stm_RaW) \
+  TM_LOAD_SPEC(_ITM_RfW##E, T, WF, WT, int_stm_RfW)
 
 #define TM_LOAD_GENERIC_ALL(E, T) \
   TM_LOAD_GENERIC(_ITM_R##E, T) \
@@ -826,45 +929,67 @@ not enough because if we abort and restore -> stack can be corrupted
   TM_LOAD_GENERIC(_ITM_RaW##E, T) \
   TM_LOAD_GENERIC(_ITM_RfW##E, T)
 
+#define TM_LOAD_VECTOR_ALL(E, T) \
+  TM_LOAD_VECTOR(_ITM_R##E, T) \
+  TM_LOAD_VECTOR(_ITM_RaR##E, T) \
+  TM_LOAD_VECTOR(_ITM_RaW##E, T) \
+  TM_LOAD_VECTOR(_ITM_RfW##E, T)
+
 #define TM_STORE_ALL(E, T, WF, WT) \
   TM_STORE(_ITM_W##E, T, WF, WT) \
-  TM_STORE(_ITM_WaR##E, T, WF, WT) \
-  TM_STORE(_ITM_WaW##E, T, WF, WT)
+  TM_STORE_SPEC(_ITM_WaR##E, T, WF, WT, int_stm_WaR) \
+  TM_STORE_SPEC(_ITM_WaW##E, T, WF, WT, int_stm_WaW)
 
 #define TM_STORE_GENERIC_ALL(E, T) \
   TM_STORE_GENERIC(_ITM_W##E, T) \
   TM_STORE_GENERIC(_ITM_WaR##E, T) \
   TM_STORE_GENERIC(_ITM_WaW##E, T)
 
+#define TM_STORE_VECTOR_ALL(E, T) \
+  TM_STORE_VECTOR(_ITM_W##E, T) \
+  TM_STORE_VECTOR(_ITM_WaR##E, T) \
+  TM_STORE_VECTOR(_ITM_WaW##E, T)
 
 /* TODO U1 U2 should not use the inline stm_load to increase locality */
 TM_LOAD_ALL(U1, uint8_t, int_stm_load_u8, uint8_t)
 TM_LOAD_ALL(U2, uint16_t, int_stm_load_u16, uint16_t)
 TM_LOAD_ALL(U4, uint32_t, int_stm_load_u32, uint32_t)
 TM_LOAD_ALL(U8, uint64_t, int_stm_load_u64, uint64_t)
-TM_LOAD_ALL(F, float, stm_load_float, float)
-TM_LOAD_ALL(D, double, stm_load_double, double)
+TM_LOAD_ALL(F, float, stm_load_float_tx, float)
+TM_LOAD_ALL(D, double, stm_load_double_tx, double)
 #ifdef __SSE__
-TM_LOAD_GENERIC_ALL(M64, __m64)
-TM_LOAD_GENERIC_ALL(M128, __m128)
+TM_LOAD_VECTOR_ALL(M64, __m64)
+TM_LOAD_VECTOR_ALL(M128, __m128)
 #endif /* __SSE__ */
-TM_LOAD_GENERIC_ALL(CF, float _Complex)
-TM_LOAD_GENERIC_ALL(CD, double _Complex)
-TM_LOAD_GENERIC_ALL(CE, long double _Complex)
+#ifdef __AVX__
+TM_LOAD_VECTOR_ALL(M256, __m256)
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+TM_LOAD_VECTOR_ALL(M512, __m512)
+#endif /* __AVX512F__ */
+TM_LOAD_VECTOR_ALL(CF, float _Complex)
+TM_LOAD_VECTOR_ALL(CD, double _Complex)
+TM_LOAD_VECTOR_ALL(CE, long double _Complex)
 
 TM_STORE_ALL(U1, uint8_t, int_stm_store_u8, uint8_t)
 TM_STORE_ALL(U2, uint16_t, int_stm_store_u16, uint16_t)
 TM_STORE_ALL(U4, uint32_t, int_stm_store_u32, uint32_t)
 TM_STORE_ALL(U8, uint64_t, int_stm_store_u64, uint64_t)
-TM_STORE_ALL(F, float, stm_store_float, float)
-TM_STORE_ALL(D, double, stm_store_double, double)
+TM_STORE_ALL(F, float, stm_store_float_tx, float)
+TM_STORE_ALL(D, double, stm_store_double_tx, double)
 #ifdef __SSE__
-TM_STORE_GENERIC_ALL(M64, __m64)
-TM_STORE_GENERIC_ALL(M128, __m128)
+TM_STORE_VECTOR_ALL(M64, __m64)
+TM_STORE_VECTOR_ALL(M128, __m128)
 #endif /* __SSE__ */
-TM_STORE_GENERIC_ALL(CF, float _Complex)
-TM_STORE_GENERIC_ALL(CD, double _Complex)
-TM_STORE_GENERIC_ALL(CE, long double _Complex)
+#ifdef __AVX__
+TM_STORE_VECTOR_ALL(M256, __m256)
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+TM_STORE_VECTOR_ALL(M512, __m512)
+#endif /* __AVX512F__ */
+TM_STORE_VECTOR_ALL(CF, float _Complex)
+TM_STORE_VECTOR_ALL(CD, double _Complex)
+TM_STORE_VECTOR_ALL(CE, long double _Complex)
 
 TM_STORE_BYTES(_ITM_memcpyRnWt)
 TM_STORE_BYTES(_ITM_memcpyRnWtaR)
@@ -895,6 +1020,12 @@ TM_LOG_GENERIC(_ITM_LE, long double)
 TM_LOG_GENERIC(_ITM_LM64, __m64)
 TM_LOG_GENERIC(_ITM_LM128, __m128)
 #endif /* __SSE__ */
+#ifdef __AVX__
+TM_LOG_GENERIC(_ITM_LM256, __m256)
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+TM_LOG_GENERIC(_ITM_LM512, __m512)
+#endif /* __AVX512F__ */
 TM_LOG_GENERIC(_ITM_LCF, float _Complex)
 TM_LOG_GENERIC(_ITM_LCD, double _Complex)
 TM_LOG_GENERIC(_ITM_LCE, long double _Complex)
@@ -35,6 +35,9 @@ extern "C" {
 #ifdef __SSE__
 # include <xmmintrin.h>
 #endif
+#ifdef __AVX__
+# include <immintrin.h>
+#endif
 
 /* ################################################################### *
  * DEFINES
@@ -155,6 +158,10 @@ extern _ITM_TRANSACTION_PURE
 void _ITM_CALL_CONVENTION _ITM_dropReferences( 
                              const void *__start, size_t __size);
 
+/* TinySTM extension */
+extern _ITM_TRANSACTION_PURE
+void _ITM_CALL_CONVENTION _ITM_prefetch(const void *__addr);
+
 extern _ITM_TRANSACTION_PURE
 void _ITM_CALL_CONVENTION _ITM_userError(const char *errString, int exitCode);
 
@@ -254,6 +261,20 @@ extern __m128 _ITM_CALL_CONVENTION _ITM_RaWM128( const __m128 *);
 extern __m128 _ITM_CALL_CONVENTION _ITM_RfWM128( const __m128 *);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern __m256 _ITM_CALL_CONVENTION _ITM_RM256( const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaRM256( const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaWM256( const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RfWM256( const __m256 *);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern __m512 _ITM_CALL_CONVENTION _ITM_RM512( const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaRM512( const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaWM512( const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RfWM512( const __m512 *);
+#endif /* __AVX512F__ */
+
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RCF( const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaRCF( const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaWCF( const float _Complex *);
@@ -306,6 +327,18 @@ extern void _ITM_CALL_CONVENTION _ITM_WaRM128( const __m128 *, __m128);
 extern void _ITM_CALL_CONVENTION _ITM_WaWM128( const __m128 *, __m128);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_WM256( const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM256( const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM256( const __m256 *, __m256);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_WM512( const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM512( const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM512( const __m512 *, __m512);
+#endif /* __AVX512F__ */
+
 extern void _ITM_CALL_CONVENTION _ITM_WCF( const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaRCF( const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaWCF( const float _Complex *, float _Complex);
@@ -330,6 +363,12 @@ extern void _ITM_CALL_CONVENTION _ITM_LD( const double *);
 extern void _ITM_CALL_CONVENTION _ITM_LE( const long double *);
 extern void _ITM_CALL_CONVENTION _ITM_LM64( const __m64 *);
 extern void _ITM_CALL_CONVENTION _ITM_LM128( const __m128 *);
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_LM256( const __m256 *);
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_LM512( const __m512 *);
+#endif /* __AVX512F__ */
 extern void _ITM_CALL_CONVENTION _ITM_LCF( const float _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCD( const double _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCE( const long double _Complex *);
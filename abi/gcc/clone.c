@@ -41,41 +41,146 @@ struct clone_table
 
 static struct clone_table *all_tables;
 
-static void *
-find_clone (void *ptr)
+static int
+clone_entry_compare (const void *a, const void *b)
 {
-  struct clone_table *table;
+  const struct clone_entry *aa = (const struct clone_entry *)a;
+  const struct clone_entry *bb = (const struct clone_entry *)b;
 
-  for (table = all_tables; table ; table = table->next)
-    {
-      struct clone_entry *t = table->table;
-      size_t lo = 0, hi = table->size, i;
+  if (aa->orig < bb->orig)
+    return -1;
+  else if (aa->orig > bb->orig)
+    return 1;
+  else
+    return 0;
+}
+
+/* Lookups go through a per-thread direct-mapped cache, then through a
+   single sorted table that merges all registered tables.  Both are
+   rebuilt lazily when the generation changes, i.e., when a table is
+   registered or deregistered.  */
+#define CLONE_CACHE_SIZE 128
+#define CLONE_CACHE_IDX(ptr) (((uintptr_t)(ptr) >> 4) & (CLONE_CACHE_SIZE - 1))
+
+struct clone_merged
+{
+  unsigned long gen;
+  size_t size;
+  struct clone_merged *retired;
+  struct clone_entry table[];
+};
+
+static volatile unsigned long clone_gen = 1;
+static struct clone_merged *volatile clone_merged;
+static pthread_mutex_t clone_lock = PTHREAD_MUTEX_INITIALIZER;
 
-      /* Quick test for whether PTR is present in this table.  */
-      if (ptr < t[0].orig || ptr > t[hi - 1].orig)
-	continue;
+static __thread struct clone_entry clone_cache[CLONE_CACHE_SIZE];
+static __thread unsigned long clone_cache_gen;
 
-      /* Otherwise binary search.  */
-      while (lo < hi)
+static struct clone_merged *
+merge_clones (void)
+{
+  struct clone_table *table;
+  struct clone_merged *m;
+  unsigned long gen;
+  size_t size;
+
+  pthread_mutex_lock (&clone_lock);
+  /* Read generation before the tables (registration adds, then changes it) */
+  gen = ATOMIC_LOAD_ACQ (&clone_gen);
+  m = clone_merged;
+  if (m == NULL || m->gen != gen)
+    {
+      size = 0;
+      for (table = all_tables; table ; table = table->next)
+	size += table->size;
+      m = (struct clone_merged *) malloc (sizeof (struct clone_merged)
+					  + size * sizeof (struct clone_entry));
+      if (m == NULL)
+	{
+	  /* Lookups search the registered tables instead */
+	  pthread_mutex_unlock (&clone_lock);
+	  return NULL;
+	}
+      m->gen = gen;
+      m->size = 0;
+      for (table = all_tables; table ; table = table->next)
 	{
-	  i = (lo + hi) / 2;
-	  if (ptr < t[i].orig)
-	    hi = i;
-	  else if (ptr > t[i].orig)
-	    lo = i + 1;
-	  else
-	    {
-	      return t[i].clone;
-	    }
+	  memcpy (&m->table[m->size], table->table,
+		  table->size * sizeof (struct clone_entry));
+	  m->size += table->size;
 	}
+      qsort (m->table, m->size, sizeof (struct clone_entry), clone_entry_compare);
+      /* Other threads may still search the previous table: free it when
+	 a table is deregistered (no transaction must be active then).  */
+      m->retired = clone_merged;
+      ATOMIC_STORE (&clone_merged, m);
+    }
+  pthread_mutex_unlock (&clone_lock);
 
-      /* Given the quick test above, if we don't find the entry in
-	 this table then it doesn't exist.  */
-      break;
+  return m;
+}
+
+static void *
+search_clone (struct clone_entry *table, size_t size, void *ptr)
+{
+  size_t lo, hi, i;
+
+  lo = 0;
+  hi = size;
+  while (lo < hi)
+    {
+      i = (lo + hi) / 2;
+      if (ptr < table[i].orig)
+	hi = i;
+      else if (ptr > table[i].orig)
+	lo = i + 1;
+      else
+	return table[i].clone;
     }
   return NULL;
 }
 
+static void *
+find_clone (void *ptr)
+{
+  struct clone_entry *c = &clone_cache[CLONE_CACHE_IDX (ptr)];
+  struct clone_table *table;
+  struct clone_merged *m;
+  unsigned long gen;
+
+  gen = ATOMIC_LOAD_ACQ (&clone_gen);
+  if (likely (clone_cache_gen == gen))
+    {
+      if (likely (c->orig == ptr))
+	return c->clone;
+    }
+  else
+    {
+      memset (clone_cache, 0, sizeof (clone_cache));
+      clone_cache_gen = gen;
+    }
+
+  m = (struct clone_merged *) ATOMIC_LOAD_ACQ (&clone_merged);
+  if (m == NULL || m->gen != gen)
+    m = merge_clones ();
+
+  /* Binary search.  Misses are cached too (NULL clone).  */
+  c->orig = ptr;
+  if (likely (m != NULL))
+    c->clone = search_clone (m->table, m->size, ptr);
+  else
+    {
+      /* Out of memory for the merged table: search each table */
+      c->clone = NULL;
+      pthread_mutex_lock (&clone_lock);
+      for (table = all_tables; table && c->clone == NULL; table = table->next)
+	c->clone = search_clone (table->table, table->size, ptr);
+      pthread_mutex_unlock (&clone_lock);
+    }
+  return c->clone;
+}
+
 
 void * _ITM_CALL_CONVENTION
 _ITM_getTMCloneOrIrrevocable (void *ptr)
@@ -105,20 +210,6 @@ _ITM_getTMCloneSafe (void *ptr)
   return ret;
 }
 
-static int
-clone_entry_compare (const void *a, const void *b)
-{
-  const struct clone_entry *aa = (const struct clone_entry *)a;
-  const struct clone_entry *bb = (const struct clone_entry *)b;
-
-  if (aa->orig < bb->orig)
-    return -1;
-  else if (aa->orig > bb->orig)
-    return 1;
-  else
-    return 0;
-}
-
 void
 _ITM_registerTMCloneTable (void *xent, size_t size)
 {
@@ -139,6 +230,9 @@ _ITM_registerTMCloneTable (void *xent, size_t size)
       old = __sync_val_compare_and_swap (&all_tables, old, table);
     }
   while (old != table);
+
+  /* Invalidate caches and merged table */
+  ATOMIC_FETCH_INC_FULL (&clone_gen);
 }
 
 void
@@ -157,5 +251,20 @@ _ITM_deregisterTMCloneTable (void *xent)
   *pprev = tab->next;
 
   free (tab);
+
+  ATOMIC_FETCH_INC_FULL (&clone_gen);
+  /* Keep only the merged table (outdated) that lookups may still use */
+  pthread_mutex_lock (&clone_lock);
+  if (clone_merged != NULL)
+    {
+      struct clone_merged *m, *next;
+      for (m = clone_merged->retired; m ; m = next)
+	{
+	  next = m->retired;
+	  free (m);
+	}
+      clone_merged->retired = NULL;
+    }
+  pthread_mutex_unlock (&clone_lock);
 }
 
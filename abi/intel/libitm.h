@@ -35,6 +35,9 @@ extern "C" {
 #ifdef __SSE__
 # include <xmmintrin.h>
 #endif
+#ifdef __AVX__
+# include <immintrin.h>
+#endif
 
 /* ################################################################### *
  * DEFINES
@@ -155,6 +158,10 @@ extern _ITM_TRANSACTION_PURE
 void _ITM_CALL_CONVENTION _ITM_dropReferences(_ITM_transaction *, 
                              const void *__start, size_t __size);
 
+/* TinySTM extension */
+extern _ITM_TRANSACTION_PURE
+void _ITM_CALL_CONVENTION _ITM_prefetch(_ITM_transaction *, const void *__addr);
+
 extern _ITM_TRANSACTION_PURE
 void _ITM_CALL_CONVENTION _ITM_userError(const char *errString, int exitCode);
 
@@ -251,6 +258,20 @@ extern __m128 _ITM_CALL_CONVENTION _ITM_RaWM128(_ITM_transaction *, const __m128
 extern __m128 _ITM_CALL_CONVENTION _ITM_RfWM128(_ITM_transaction *, const __m128 *);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern __m256 _ITM_CALL_CONVENTION _ITM_RM256(_ITM_transaction *, const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaRM256(_ITM_transaction *, const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaWM256(_ITM_transaction *, const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RfWM256(_ITM_transaction *, const __m256 *);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern __m512 _ITM_CALL_CONVENTION _ITM_RM512(_ITM_transaction *, const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaRM512(_ITM_transaction *, const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaWM512(_ITM_transaction *, const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RfWM512(_ITM_transaction *, const __m512 *);
+#endif /* __AVX512F__ */
+
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RCF(_ITM_transaction *, const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaRCF(_ITM_transaction *, const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaWCF(_ITM_transaction *, const float _Complex *);
@@ -303,6 +324,18 @@ extern void _ITM_CALL_CONVENTION _ITM_WaRM128(_ITM_transaction *, const __m128 *
 extern void _ITM_CALL_CONVENTION _ITM_WaWM128(_ITM_transaction *, const __m128 *, __m128);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_WM256(_ITM_transaction *, const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM256(_ITM_transaction *, const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM256(_ITM_transaction *, const __m256 *, __m256);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_WM512(_ITM_transaction *, const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM512(_ITM_transaction *, const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM512(_ITM_transaction *, const __m512 *, __m512);
+#endif /* __AVX512F__ */
+
 extern void _ITM_CALL_CONVENTION _ITM_WCF(_ITM_transaction *, const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaRCF(_ITM_transaction *, const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaWCF(_ITM_transaction *, const float _Complex *, float _Complex);
@@ -327,6 +360,12 @@ extern void _ITM_CALL_CONVENTION _ITM_LD(_ITM_transaction *, const double *);
 extern void _ITM_CALL_CONVENTION _ITM_LE(_ITM_transaction *, const long double *);
 extern void _ITM_CALL_CONVENTION _ITM_LM64(_ITM_transaction *, const __m64 *);
 extern void _ITM_CALL_CONVENTION _ITM_LM128(_ITM_transaction *, const __m128 *);
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_LM256(_ITM_transaction *, const __m256 *);
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_LM512(_ITM_transaction *, const __m512 *);
+#endif /* __AVX512F__ */
 extern void _ITM_CALL_CONVENTION _ITM_LCF(_ITM_transaction *, const float _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCD(_ITM_transaction *, const double _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCE(_ITM_transaction *, const long double _Complex *);
@@ -42,6 +42,20 @@ extern __m128 _ITM_CALL_CONVENTION _ITM_RaWM128(TX_ARGS const __m128 *);
 extern __m128 _ITM_CALL_CONVENTION _ITM_RfWM128(TX_ARGS const __m128 *);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern __m256 _ITM_CALL_CONVENTION _ITM_RM256(TX_ARGS const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaRM256(TX_ARGS const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RaWM256(TX_ARGS const __m256 *);
+extern __m256 _ITM_CALL_CONVENTION _ITM_RfWM256(TX_ARGS const __m256 *);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern __m512 _ITM_CALL_CONVENTION _ITM_RM512(TX_ARGS const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaRM512(TX_ARGS const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RaWM512(TX_ARGS const __m512 *);
+extern __m512 _ITM_CALL_CONVENTION _ITM_RfWM512(TX_ARGS const __m512 *);
+#endif /* __AVX512F__ */
+
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RCF(TX_ARGS const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaRCF(TX_ARGS const float _Complex *);
 extern float _Complex _ITM_CALL_CONVENTION _ITM_RaWCF(TX_ARGS const float _Complex *);
@@ -94,6 +108,18 @@ extern void _ITM_CALL_CONVENTION _ITM_WaRM128(TX_ARGS const __m128 *, __m128);
 extern void _ITM_CALL_CONVENTION _ITM_WaWM128(TX_ARGS const __m128 *, __m128);
 #endif /* __SSE__ */
 
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_WM256(TX_ARGS const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM256(TX_ARGS const __m256 *, __m256);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM256(TX_ARGS const __m256 *, __m256);
+#endif /* __AVX__ */
+
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_WM512(TX_ARGS const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaRM512(TX_ARGS const __m512 *, __m512);
+extern void _ITM_CALL_CONVENTION _ITM_WaWM512(TX_ARGS const __m512 *, __m512);
+#endif /* __AVX512F__ */
+
 extern void _ITM_CALL_CONVENTION _ITM_WCF(TX_ARGS const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaRCF(TX_ARGS const float _Complex *, float _Complex);
 extern void _ITM_CALL_CONVENTION _ITM_WaWCF(TX_ARGS const float _Complex *, float _Complex);
@@ -118,6 +144,12 @@ extern void _ITM_CALL_CONVENTION _ITM_LD(TX_ARGS const double *);
 extern void _ITM_CALL_CONVENTION _ITM_LE(TX_ARGS const long double *);
 extern void _ITM_CALL_CONVENTION _ITM_LM64(TX_ARGS const __m64 *);
 extern void _ITM_CALL_CONVENTION _ITM_LM128(TX_ARGS const __m128 *);
+#ifdef __AVX__
+extern void _ITM_CALL_CONVENTION _ITM_LM256(TX_ARGS const __m256 *);
+#endif /* __AVX__ */
+#ifdef __AVX512F__
+extern void _ITM_CALL_CONVENTION _ITM_LM512(TX_ARGS const __m512 *);
+#endif /* __AVX512F__ */
 extern void _ITM_CALL_CONVENTION _ITM_LCF(TX_ARGS const float _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCD(TX_ARGS const double _Complex *);
 extern void _ITM_CALL_CONVENTION _ITM_LCE(TX_ARGS const long double _Complex *);
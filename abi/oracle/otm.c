@@ -87,38 +87,38 @@ WrHandle* STM_AcquireReadWritePermission(stm_tx_t *tx, stm_word_t *addr, int val
 uint8_t STM_TranRead8(stm_tx_t *tx, RdHandle *theRdHandle, uint8_t *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
-  return stm_load_u8(/*tx,*/ addr);
+  return stm_load_u8_tx(tx, addr);
 }
 
 uint16_t STM_TranRead16(stm_tx_t *tx, RdHandle *theRdHandle, uint16_t *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
-  return stm_load_u16(/*tx,*/ addr);
+  return stm_load_u16_tx(tx, addr);
 }
 
 uint32_t STM_TranRead32(stm_tx_t *tx, RdHandle *theRdHandle, uint32_t *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
   /* TODO can it be more efficient with #ifdef _LP64 and stm_load(). */
-  return stm_load_u32(/*tx,*/ addr);
+  return stm_load_u32_tx(tx, addr);
 }
 
 double STM_TranReadFloat32(stm_tx_t *tx, RdHandle *theRdHandle, float *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
-  return stm_load_float(/*tx,*/ addr);
+  return stm_load_float_tx(tx, addr);
 }
 
 uint64_t STM_TranRead64(stm_tx_t *tx, RdHandle *theRdHandle, uint64_t *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
-  return stm_load_u64(/*tx,*/ addr);
+  return stm_load_u64_tx(tx, addr);
 }
 
 double STM_TranReadFloat64(stm_tx_t *tx, RdHandle *theRdHandle, double *addr, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,valid=%d)\n", __FUNCTION__, tx, theRdHandle, addr, valid);
-  return stm_load_double(/*tx,*/ addr);
+  return stm_load_double_tx(tx, addr);
 }
 
 
@@ -127,41 +127,41 @@ double STM_TranReadFloat64(stm_tx_t *tx, RdHandle *theRdHandle, double *addr, in
 int STM_TranWrite8(stm_tx_t *tx, WrHandle* theWrHandle, uint8_t *addr,  uint8_t val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%u,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_u8(/*tx,*/ addr, val);
+  stm_store_u8_tx(tx, addr, val);
   return 1;
 }
 int STM_TranWrite16(stm_tx_t *tx, WrHandle* theWrHandle, uint16_t *addr, uint16_t val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%u,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_u16(/*tx,*/ addr, val);
+  stm_store_u16_tx(tx, addr, val);
   return 1;
 }
 
 int STM_TranWrite32(stm_tx_t *tx, WrHandle *theWrHandle, uint32_t *addr, uint32_t val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%u,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_u32(/*tx,*/ addr, val);
+  stm_store_u32_tx(tx, addr, val);
   return 1;
 }
 
 int STM_TranWrite64(stm_tx_t *tx, WrHandle *theWrHandle, uint64_t *addr, uint64_t val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%lu,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_u64(/*tx,*/ addr, val);
+  stm_store_u64_tx(tx, addr, val);
   return 1;
 }
 
 int STM_TranWriteFloat32(stm_tx_t *tx, WrHandle *theWrHandle, float *addr, float val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%f,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_float(/*tx,*/ addr, val);
+  stm_store_float_tx(tx, addr, val);
   return 1;
 }
 
 int STM_TranWriteFloat64(stm_tx_t *tx, WrHandle *theWrHandle, double *addr, double val, int valid)
 {
   PRINT_DEBUG("==> %s(tx=0x%p,handle=0x%p,addr=0x%p,val=%f,valid=%d)\n", __FUNCTION__, tx, theWrHandle, addr, val, valid);
-  stm_store_double(/*tx,*/ addr, val);
+  stm_store_double_tx(tx, addr, val);
   return 1;
 }
 
@@ -204,8 +204,8 @@ void STM_TranMemCpy(stm_tx_t *tx, void* src, void* dst, size_t sz, uint32_t alig
 {
   /* TODO what to do with alignment? */
   uint8_t *buf = (uint8_t *)alloca(sz);
-  stm_load_bytes(/*tx,*/ (volatile uint8_t *)src, buf, sz);
-  stm_store_bytes(/*tx,*/ (volatile uint8_t *)dst, buf, sz);
+  stm_load_bytes_tx(tx, (volatile uint8_t *)src, buf, sz);
+  stm_store_bytes_tx(tx, (volatile uint8_t *)dst, buf, sz);
 }
 
 int STM_CurrentlyUsingDecoratedPath(stm_tx_t* tx)
@@ -0,0 +1,209 @@
+/*
+ * File:
+ *   barriers.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Check and cost (in cycles) of the specialized ABI barriers (RaR, RaW,
+ *   RfW, WaR, WaW) compared to the generic ones, using explicit calls.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libitm.h"
+
+/* Aborted transactions restart from here */
+extern uint32_t _ITM_beginTransaction(uint32_t __properties, ...) __attribute__((returns_twice));
+
+#define MEASURE_NB                      1000
+/* Other words written before the measured barrier (one per stripe) */
+#define NB_WRITES                       16
+#define STRIDE                          16
+
+#define BEGIN                           _ITM_beginTransaction(pr_instrumentedCode | pr_hasNoAbort)
+#define COMMIT                          _ITM_commitTransaction()
+
+#define CHECK(c)                        do { if (!(c)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); exit(1); } } while (0)
+
+__attribute__((aligned(64)))
+static uint64_t data[(NB_WRITES + 2) * STRIDE];
+
+static volatile uint64_t sink;
+
+static inline uint64_t
+rdtsc(void)
+{
+  uint32_t a, d;
+  asm volatile( "rdtsc\n\t" : "=a" (a), "=d" (d));
+  return (((uint64_t)d) << 32) | (((uint64_t)a) & 0xffffffff);
+}
+
+static int compar(const void *a, const void *b)
+{
+  uint64_t x = *((uint64_t *)a), y = *((uint64_t *)b);
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void stats(uint64_t *m, size_t size, uint64_t cost, uint64_t *min, double *avg, uint64_t *median)
+{
+  size_t i;
+  for (i = 0; i < size; i++)
+    m[i] = (m[i] > cost ? m[i] - cost : 0);
+  qsort(m, size, sizeof(uint64_t), compar);
+  *median = m[(size/2)-1];
+  *min = m[0];
+  *avg = 0.0;
+  for (i = 0; i < size; i++)
+    *avg += m[i];
+  *avg = *avg / size;
+}
+
+/* Measure BARRIER after PREPARE in a transaction that has written NB_WRITES other words */
+#define MEASURE(NAME, PREPARE, BARRIER) \
+  do { \
+    uint64_t start, min, med; \
+    double avg; \
+    int i, j; \
+    for (i = 0; i < MEASURE_NB; i++) { \
+      BEGIN; \
+      for (j = 1; j <= NB_WRITES; j++) \
+        _ITM_WU8(&data[j * STRIDE], j); \
+      PREPARE; \
+      start = rdtsc(); \
+      BARRIER; \
+      m[i] = rdtsc() - start; \
+      COMMIT; \
+    } \
+    stats(m, MEASURE_NB, m_rdtsc, &min, &avg, &med); \
+    printf("%-24s %12lu %12.2f %12lu\n", NAME, (unsigned long)min, avg, (unsigned long)med); \
+  } while (0)
+
+static void bench(void)
+{
+  static uint64_t m[MEASURE_NB];
+  uint64_t *x = &data[0], m_rdtsc, start;
+  int i;
+
+  m_rdtsc = ~0UL;
+  for (i = 0; i < MEASURE_NB; i++) {
+    start = rdtsc();
+    start = rdtsc() - start;
+    if (start < m_rdtsc)
+      m_rdtsc = start;
+  }
+
+  printf("%-24s %12s %12s %12s\n", "", "min", "avg", "med");
+  MEASURE("R", , sink = _ITM_RU8(x));
+  MEASURE("R (after R)", sink = _ITM_RU8(x), sink = _ITM_RU8(x));
+  MEASURE("RaR", sink = _ITM_RU8(x), sink = _ITM_RaRU8(x));
+  MEASURE("R (after W)", _ITM_WU8(x, 1), sink = _ITM_RU8(x));
+  MEASURE("RaW", _ITM_WU8(x, 1), sink = _ITM_RaWU8(x));
+  MEASURE("RfW", , sink = _ITM_RfWU8(x));
+  MEASURE("W (after R)", sink = _ITM_RU8(x), _ITM_WU8(x, 1));
+  MEASURE("WaR", sink = _ITM_RU8(x), _ITM_WaRU8(x, 1));
+  MEASURE("W (after W)", _ITM_WU8(x, 1), _ITM_WU8(x, 2));
+  MEASURE("WaW", _ITM_WU8(x, 1), _ITM_WaWU8(x, 2));
+  MEASURE("W (after RfW)", sink = _ITM_RfWU8(x), _ITM_WU8(x, 2));
+  MEASURE("WaW (after RfW)", sink = _ITM_RfWU8(x), _ITM_WaWU8(x, 2));
+  MEASURE("R U4 (after W U4)", _ITM_WU4((uint32_t *)x + 1, 1), sink = _ITM_RU4((uint32_t *)x + 1));
+  MEASURE("RaW U4", _ITM_WU4((uint32_t *)x + 1, 1), sink = _ITM_RaWU4((uint32_t *)x + 1));
+}
+
+/* Locals of functions called in transactions are not live upon rollback */
+static __attribute__((noinline)) uint64_t local(uint64_t v)
+{
+  volatile uint64_t l[2];
+
+  _ITM_WU8((uint64_t *)&l[0], v);
+  _ITM_WaWU8((uint64_t *)&l[1], v + 1);
+  return _ITM_RU8((uint64_t *)&l[0]) + _ITM_RaWU8((uint64_t *)&l[1]);
+}
+
+static void check(void)
+{
+  static volatile int attempts;
+  volatile uint64_t live;
+  uint64_t *a = &data[0], *b = &data[STRIDE];
+  uint8_t *c = (uint8_t *)&data[2 * STRIDE];
+
+  *a = 1;
+  *b = 2;
+  *c = 3;
+
+  /* Same stripe, different words, partial words */
+  BEGIN;
+  CHECK(_ITM_RU8(a) == 1);
+  CHECK(_ITM_RaRU8(a) == 1);
+  _ITM_WaRU8(a, 4);
+  CHECK(_ITM_RaWU8(a) == 4);
+  _ITM_WaWU8(a, 5);
+  CHECK(_ITM_RfWU8(a + 1) == 0);
+  _ITM_WaWU8(a + 1, 6);
+  CHECK(_ITM_RaWU8(a) == 5 && _ITM_RaWU8(a + 1) == 6);
+  CHECK(_ITM_RfWU1(c + 1) == 0);
+  _ITM_WaWU1(c + 1, 7);
+  CHECK(_ITM_RaWU1(c + 1) == 7 && _ITM_RaRU1(c) == 3);
+  CHECK(_ITM_RaWU2((uint16_t *)c) == (uint16_t)(3 | (7 << 8)));
+  COMMIT;
+  CHECK(a[0] == 5 && a[1] == 6 && c[0] == 3 && c[1] == 7);
+
+  /* Rollback restores data written after RfW */
+  attempts = 0;
+  BEGIN;
+  if (attempts++ == 0) {
+    CHECK(_ITM_RfWU8(b) == 2);
+    _ITM_WaWU8(b, 8);
+    CHECK(_ITM_RaWU8(b) == 8);
+    _ITM_WaWU4((uint32_t *)b, 9);
+    _ITM_abortTransaction(userRetry, NULL);
+  }
+  CHECK(_ITM_RU8(b) == 2);
+  COMMIT;
+  CHECK(*b == 2 && attempts == 2);
+
+  /* Rollback restores stack locations that were live at start */
+  live = 1;
+  attempts = 0;
+  BEGIN;
+  CHECK(local(3) == 7);
+  if (attempts++ == 0) {
+    _ITM_WU8((uint64_t *)&live, 2);
+    CHECK(_ITM_RU8((uint64_t *)&live) == 2);
+    _ITM_abortTransaction(userRetry, NULL);
+  }
+  CHECK(_ITM_RU8((uint64_t *)&live) == 1);
+  COMMIT;
+  CHECK(live == 1 && attempts == 2);
+
+  printf("Check                    : OK\n");
+}
+
+int main(int argc, char **argv)
+{
+  _ITM_initializeThread();
+
+  check();
+  if (argc < 2 || argv[1][0] != 'c')
+    bench();
+
+  _ITM_finalizeThread();
+  return 0;
+}
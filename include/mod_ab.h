@@ -28,7 +28,11 @@
  *   Module for gathering statistics about transactions.  This module
  *   maintains aggregate statistics about all threads for every atomic
  *   block in the application (distinguished using the identifier part
- *   of the transaction attributes).
+ *   of the transaction attributes).  In addition to sampled length
+ *   statistics, every committed transaction is recorded in per-thread
+ *   log-bucketed histograms (first attempt latency, end-to-end latency
+ *   including retries, and number of retries) that can be merged at any
+ *   time without locking.
  * @author
  *   Pascal Felber <pascal.felber@unine.ch>
  *   Patrick Marlier <patrick.marlier@unine.ch>
@@ -39,6 +43,8 @@
 #ifndef _MOD_AB_H_
 # define _MOD_AB_H_
 
+# include <stdio.h>
+
 # include "stm.h"
 
 # ifdef __cplusplus
@@ -91,6 +97,70 @@ typedef struct stm_ab_stats {
   unsigned int reservoir_size;
 } stm_ab_stats_t;
 
+/**
+ * Number of bits of sub-bucket precision of histograms.  Each power of
+ * 2 is split in 2^STM_AB_HIST_SUB_BITS buckets, hence the relative
+ * error of recorded values is below 2^-STM_AB_HIST_SUB_BITS.
+ */
+# define STM_AB_HIST_SUB_BITS           5
+/**
+ * Number of bits of the largest value tracked precisely by histograms
+ * (larger values are counted in the last bucket).
+ */
+# define STM_AB_HIST_MAX_BITS           48
+/**
+ * Number of buckets of histograms.
+ */
+# define STM_AB_HIST_SIZE               ((STM_AB_HIST_MAX_BITS - STM_AB_HIST_SUB_BITS + 1) << STM_AB_HIST_SUB_BITS)
+
+/**
+ * Histograms associated with an atomic block.
+ */
+enum {
+  /**
+   * Length of the first attempt (committed or aborted).
+   */
+  STM_AB_HIST_FIRST = 0,
+  /**
+   * Length from the start of the first attempt to the commit.
+   */
+  STM_AB_HIST_TOTAL = 1,
+  /**
+   * Number of retries before the commit.
+   */
+  STM_AB_HIST_RETRIES = 2,
+  /**
+   * Number of histograms.
+   */
+  STM_AB_HIST_NB = 3
+};
+
+/**
+ * Log-bucketed histogram.  Lengths are expressed in clock ticks.
+ */
+typedef struct stm_ab_hist {
+  /**
+   * Number of samples.
+   */
+  unsigned long count;
+  /**
+   * Sum of the samples.
+   */
+  unsigned long sum;
+  /**
+   * Minimum value among all samples.
+   */
+  unsigned long min;
+  /**
+   * Maximum value among all samples.
+   */
+  unsigned long max;
+  /**
+   * Number of samples per bucket.
+   */
+  unsigned long buckets[STM_AB_HIST_SIZE];
+} stm_ab_hist_t;
+
 /**
  * Get statistics about an atomic block.
  *
@@ -105,6 +175,57 @@ typedef struct stm_ab_stats {
  */
 int stm_get_ab_stats(int id, stm_ab_stats_t *stats);
 
+/**
+ * Get a histogram of an atomic block, merged over all threads
+ * (including exited ones).  This function does not lock and can be
+ * called at any time by any thread; histograms of running threads are
+ * read while being updated.
+ *
+ * @param id
+ *   Identifier of the atomic block (as specified in transaction
+ *   attributes).
+ * @param type
+ *   Histogram to get (STM_AB_HIST_FIRST, STM_AB_HIST_TOTAL or
+ *   STM_AB_HIST_RETRIES).
+ * @param hist
+ *   Pointer to the variable that should hold the histogram.
+ * @return
+ *   1 if the histogram has samples, 0 otherwise.
+ */
+int stm_get_ab_hist(int id, int type, stm_ab_hist_t *hist);
+
+/**
+ * Merge a histogram into another one.
+ *
+ * @param dst
+ *   Histogram to update.
+ * @param src
+ *   Histogram to add.
+ */
+void stm_ab_hist_merge(stm_ab_hist_t *dst, const stm_ab_hist_t *src);
+
+/**
+ * Get the value at a given percentile of a histogram.  The returned
+ * value is the highest value of the bucket holding the percentile
+ * (within the relative error of the histogram).
+ *
+ * @param hist
+ *   Histogram.
+ * @param percentile
+ *   Percentile (between 0 and 100, e.g., 99.9).
+ * @return
+ *   Value at percentile, or 0 if the histogram has no sample.
+ */
+unsigned long stm_ab_hist_percentile(const stm_ab_hist_t *hist, double percentile);
+
+/**
+ * Print the histograms of all atomic blocks.
+ *
+ * @param f
+ *   Stream to print to.
+ */
+void stm_ab_hist_dump(FILE *f);
+
 /**
  * Initialize the module.  This function must be called once, from the
  * main thread, after initializing the STM library and before
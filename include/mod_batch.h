@@ -0,0 +1,154 @@
+/*
+ * File:
+ *   mod_batch.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for batching small independent operations.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Module for batching small independent operations (group commit).
+ *   Operations submitted by a thread are buffered and executed
+ *   together in a single transaction, hence with the cost of only one
+ *   transaction start and commit (and one clock increment).  When a
+ *   batch aborts, it is retried with half as many operations and the
+ *   remaining ones are executed in subsequent transactions; the batch
+ *   size then grows again by one operation per commit up to the
+ *   maximum.
+ *
+ *   Operations are functions that access shared memory using the STM
+ *   API (transactions they start are part of the batch) and must be
+ *   independent: an operation may be executed several times (upon
+ *   abort) and its effects only become visible to other threads, all
+ *   at once, when its batch commits.  Operations must not abort
+ *   explicitly without retry.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _MOD_BATCH_H_
+# define _MOD_BATCH_H_
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Default maximum number of operations per batch.
+ */
+# define STM_BATCH_MAX_SIZE             64
+
+/**
+ * Number of buckets of the batch size histogram.
+ */
+# define STM_BATCH_HIST_SIZE            16
+
+/**
+ * Operation of a batch.
+ */
+typedef void (*stm_batch_fn_t)(void *arg);
+
+/**
+ * Statistics of all threads (including exited ones).  Bucket i of the
+ * histogram counts committed batches with 2^(i-1) to 2^i - 1
+ * operations (the last bucket also counts larger batches).
+ */
+typedef struct stm_batch_stats {
+  unsigned long ops;                    /**< Number of committed operations */
+  unsigned long batches;                /**< Number of committed batches */
+  unsigned long aborts;                 /**< Number of aborted batches */
+  unsigned long splits;                 /**< Number of batch size reductions */
+  unsigned long size_hist[STM_BATCH_HIST_SIZE]; /**< Sizes of committed batches */
+} stm_batch_stats_t;
+
+/**
+ * Start buffering the operations of the current thread.  Operations
+ * submitted outside of stm_batch_begin() and stm_batch_flush() are
+ * executed immediately, each in its own transaction.
+ */
+void stm_batch_begin(void);
+
+/**
+ * Submit an operation for the current thread.  The operation is
+ * executed when the buffer is full (its argument must remain valid
+ * until then), when stm_batch_flush() is called, or immediately if
+ * batching has not been started or if a transaction is active (the
+ * operation is then part of that transaction).
+ *
+ * @param f
+ *   Function executing the operation.
+ * @param arg
+ *   Argument of the function.
+ * @return
+ *   Number of buffered operations after the call (0 if they have all
+ *   been executed).
+ */
+unsigned int stm_batch_op(stm_batch_fn_t f, void *arg);
+
+/**
+ * Get the number of buffered operations of the current thread.  This
+ * is also the index of the next submitted operation in its batch, and
+ * can be used to recycle arguments once a batch has committed.
+ *
+ * @return
+ *   Number of buffered operations.
+ */
+unsigned int stm_batch_pending(void);
+
+/**
+ * Execute all buffered operations of the current thread and stop
+ * buffering.  This function must be called outside of transactions,
+ * and before the thread exits (buffered operations are otherwise
+ * discarded).
+ */
+void stm_batch_flush(void);
+
+/**
+ * Sum the statistics of all threads.  This function can be called at
+ * any time by any thread and does not lock, hence the result is not
+ * atomic.
+ *
+ * @param stats
+ *   Pointer to the structure that should hold the statistics.
+ */
+void stm_batch_stats(stm_batch_stats_t *stats);
+
+/**
+ * Initialize the module.  This function must be called once, from the
+ * main thread, after initializing the STM library and before
+ * performing any transactional operation.
+ *
+ * @param max_size
+ *   Maximum number of operations per batch (0 for the default,
+ *   STM_BATCH_MAX_SIZE).
+ */
+void mod_batch_init(unsigned int max_size);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _MOD_BATCH_H_ */
@@ -57,6 +57,27 @@ extern "C" {
  */
 int stm_on_commit(void (*on_commit)(void *arg), void *arg);
 
+/**
+ * Register an application-specific action executed asynchronously
+ * after the current transaction commits.  Upon commit, the action is
+ * handed over to one of the executor threads started by
+ * mod_cb_init_async() instead of being called by the committing
+ * thread.  Actions of a given thread are executed in the order of
+ * their registration and of the commits of their transactions; there
+ * is no ordering between actions of different threads.  If the
+ * transaction aborts, the action is never executed.  Actions are
+ * executed outside of any transaction.
+ *
+ * @param on_commit
+ *   Function called after successful transaction commit.
+ * @param arg
+ *   Parameter to be passed to the function.
+ * @return
+ *   1 if the action has been successfully registered, 0 otherwise
+ *   (executors have not been started).
+ */
+int stm_on_commit_async(void (*on_commit)(void *arg), void *arg);
+
 /**
  * Register an application-specific callback triggered when the current
  * transaction aborts.  The callback is automatically unregistered once
@@ -80,6 +101,26 @@ int stm_on_abort(void (*on_abort)(void *arg), void *arg);
  */
 void mod_cb_init(void);
 
+/**
+ * Initialize the module and start a pool of executor threads for
+ * asynchronous commit actions.  This function must be called once,
+ * from the main thread, after initializing the STM library and before
+ * performing any transactional operation.  Executors are stopped upon
+ * program exit, once all submitted actions have been executed.
+ *
+ * @param nb_executors
+ *   Number of executor threads (at least one).
+ */
+void mod_cb_init_async(unsigned int nb_executors);
+
+/**
+ * Wait until all asynchronous actions of transactions that have
+ * committed before the call have been executed.  This function can be
+ * called by any thread outside of a transaction, e.g., before shutting
+ * down the application.
+ */
+void mod_cb_drain(void);
+
 # ifdef __cplusplus
 }
 # endif
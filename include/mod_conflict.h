@@ -0,0 +1,84 @@
+/*
+ * File:
+ *   mod_conflict.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for profiling conflict hot spots.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Module for profiling conflict hot spots.  This module samples
+ *   aborts and records the lock and address that caused them, the
+ *   atomic block of the aborted transaction and, if known, the atomic
+ *   block of the conflicting transaction.  Samples are kept in
+ *   per-thread buffers and aggregated into a report of the hottest
+ *   stripes and conflicting atomic block pairs.  The conflicting
+ *   atomic block is only known when the library is compiled with
+ *   CONFLICT_TRACKING.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _MOD_CONFLICT_H_
+# define _MOD_CONFLICT_H_
+
+# include <stdio.h>
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Print the top entries of the conflict profile: the stripes (locks)
+ * that caused most aborts and the pairs of atomic blocks that conflict
+ * most.  Samples still in the buffers of other running threads are not
+ * included.
+ *
+ * @param f
+ *   Stream to print to.
+ * @param k
+ *   Number of entries to print in each list.
+ */
+void stm_conflict_report(FILE *f, int k);
+
+/**
+ * Initialize the module.  This function must be called once, from the
+ * main thread, after initializing the STM library and before
+ * performing any transactional operation.
+ *
+ * @param freq
+ *   Inverse sampling frequency of aborts (1 to keep all samples).
+ * @param k
+ *   Number of entries of the report printed on stderr upon program
+ *   exit (0 for no report).
+ */
+void mod_conflict_init(int freq, int k);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _MOD_CONFLICT_H_ */
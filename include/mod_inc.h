@@ -0,0 +1,115 @@
+/*
+ * File:
+ *   mod_inc.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for commutative transactional increments.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Module for commutative transactional increments (e.g., of global
+ *   counters or statistics).  Increments are recorded in a
+ *   per-transaction log without accessing the counter, and increments
+ *   of the same counter are merged.  They are applied by regular
+ *   transactional accesses just before the transaction commits, hence
+ *   the counter is only read and written for the duration of the
+ *   commit and transactions that increment it conflict much less than
+ *   with a read-modify-write at the place of the increment.  Increments
+ *   are discarded upon abort (including of closed nested transactions).
+ *
+ *   Updates of a counter within the transactions that increment it
+ *   must all go through this module: plain transactional loads do not
+ *   see pending increments (use stm_inc_load()) and plain stores do not
+ *   replace them.  As they write upon commit, increments must not be
+ *   used in transactions started in read-only mode.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _MOD_INC_H_
+# define _MOD_INC_H_
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Increment word-sized counter in the current transaction (modulo the
+ * word size).
+ *
+ * @param addr
+ *   Address of the counter.
+ * @param delta
+ *   Value to add (can be negative cast to a word).
+ */
+void stm_inc(stm_word_t *addr, stm_word_t delta);
+
+/**
+ * Add value to double counter in the current transaction.
+ *
+ * @param addr
+ *   Address of the counter.
+ * @param delta
+ *   Value to add.
+ */
+void stm_add_double(double *addr, double delta);
+
+/**
+ * Read word-sized counter in the current transaction, including the
+ * increments of the transaction.  The read is a regular transactional
+ * load, hence the transaction conflicts with other updates of the
+ * counter from then on.
+ *
+ * @param addr
+ *   Address of the counter.
+ * @return
+ *   Value of the counter.
+ */
+stm_word_t stm_inc_load(stm_word_t *addr);
+
+/**
+ * Read double counter in the current transaction, including the
+ * increments of the transaction (see stm_inc_load()).
+ *
+ * @param addr
+ *   Address of the counter.
+ * @return
+ *   Value of the counter.
+ */
+double stm_inc_load_double(double *addr);
+
+/**
+ * Initialize the module.  This function must be called once, from the
+ * main thread, after initializing the STM library and before performing
+ * any transactional operation.
+ */
+void mod_inc_init(void);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _MOD_INC_H_ */
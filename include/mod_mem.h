@@ -76,6 +76,47 @@ void *stm_calloc(size_t nm, size_t size);
 void *stm_calloc_tx(struct stm_tx *tx, size_t nm, size_t size);
 //@}
 
+//@{
+/**
+ * Allocate memory from inside a transaction that does not share its
+ * stripes (memory words covered by the same lock) with any other
+ * block.  The block is aligned on a stripe boundary and padded to a
+ * multiple of the stripe size, which avoids false conflicts between
+ * transactions accessing unrelated small blocks.  Allocated memory is
+ * implicitly freed upon abort.  Padding is reported by
+ * stm_get_parameter() ("stripe_allocs", "stripe_bytes" and
+ * "stripe_waste").  Only the stripe size of the default lock array is
+ * considered, as of the allocation (with AUTO_TUNE, blocks allocated
+ * before the stripe size grows may share stripes).
+ *
+ * @param size
+ *   Number of bytes to allocate.
+ * @return
+ *   Pointer to the allocated memory block.
+ */
+void *stm_malloc_aligned(size_t size);
+void *stm_malloc_aligned_tx(struct stm_tx *tx, size_t size);
+//@}
+
+//@{
+/**
+ * Allocate an object from inside a transaction.  The object is preceded
+ * by a word holding its lock, which protects its fields if the library
+ * has been compiled with OBJECT_LOCKS, and is aligned like memory
+ * returned by malloc().  Fields must then be accessed
+ * using stm_load_obj(), stm_store_obj() and stm_store2_obj() and the
+ * object must be freed using stm_free_obj().  Allocated memory is
+ * implicitly freed upon abort.
+ *
+ * @param size
+ *   Number of bytes to allocate (excluding the lock).
+ * @return
+ *   Pointer to the object.
+ */
+void *stm_malloc_obj(size_t size);
+void *stm_malloc_obj_tx(struct stm_tx *tx, size_t size);
+//@}
+
 //@{
 /**
  * Free memory from inside a transaction.  Freed memory is only returned
@@ -112,6 +153,23 @@ void stm_free2(void *addr, size_t idx, size_t size);
 void stm_free2_tx(struct stm_tx *tx, void *addr, size_t idx, size_t size);
 //@}
 
+//@{
+/**
+ * Free an object allocated by stm_malloc_obj() from inside a
+ * transaction.  As with stm_free(), the object is only returned to the
+ * system upon commit and its fields can optionally be overwritten to
+ * prevent inconsistent reads (with OBJECT_LOCKS, acquiring the lock of
+ * the object suffices).
+ *
+ * @param obj
+ *   Address of the object.
+ * @param size
+ *   Number of bytes to overwrite.
+ */
+void stm_free_obj(void *obj, size_t size);
+void stm_free_obj_tx(struct stm_tx *tx, void *obj, size_t size);
+//@}
+
 /**
  * Initialize the module.  This function must be called once, from the
  * main thread, after initializing the STM library and before
@@ -123,6 +181,31 @@ void stm_free2_tx(struct stm_tx *tx, void *addr, size_t idx, size_t size);
  */
 void mod_mem_init(int gc);
 
+/**
+ * Initialize the module with per-thread arenas.  Small blocks are then
+ * allocated from arenas of the threads and blocks allocated by an
+ * aborted transaction are reclaimed by rewinding the arena.  Memory
+ * allocated using stm_malloc() or stm_calloc() must then be freed
+ * using stm_free() inside transactions or mod_mem_free() outside of
+ * transactions, and never passed to the system allocator.  If the
+ * library has not been compiled with MEM_ARENA, this function behaves
+ * as mod_mem_init().
+ *
+ * @param gc
+ *   True (non-zero) to enable epoch-based garbage collector when
+ *   freeing memory in transactions.
+ */
+void mod_mem_init_arena(int gc);
+
+/**
+ * Free memory allocated by stm_malloc() or stm_calloc() outside of a
+ * transaction.  The memory must not be accessed anymore by any thread.
+ *
+ * @param addr
+ *   Address of the memory block.
+ */
+void mod_mem_free(void *addr);
+
 # ifdef __cplusplus
 }
 # endif
@@ -27,6 +27,12 @@
  * @file
  *   Module to force transactions to commit in order. The first transaction that
  *   starts will be the first one to commit. This module requires CM_MODULAR.
+ *   In strict mode, transactions wait for their turn on a global counter and
+ *   younger transactions immediately restart upon conflict with older ones.
+ *   In pipelined mode, transactions wait for their turn on a per-ticket slot
+ *   only at commit time, younger transactions delay their restart until the
+ *   conflicting lock is released, and read-only transactions validate against
+ *   their predecessors before committing.
  * @author
  *   Pascal Felber <pascal.felber@unine.ch>
  *   Patrick Marlier <patrick.marlier@unine.ch>
@@ -37,17 +43,49 @@
 #ifndef _MOD_PRINT_H_
 # define _MOD_PRINT_H_
 
+# include "stm.h"
+
 # ifdef __cplusplus
 extern "C" {
 # endif
 
+enum {
+  /**
+   * Strict ordering (single commit counter).
+   */
+  MOD_ORDER_STRICT = 0,
+  /**
+   * Pipelined ordering (per-ticket commit slots).
+   */
+  MOD_ORDER_PIPELINED = 1
+};
+
 /**
- * Initialize the module.  This function must be called once, from the
- * main thread, after initializing the STM library and before
- * performing any transactional operation.
+ * Initialize the module in strict mode.  This function must be called
+ * once, from the main thread, after initializing the STM library and
+ * before performing any transactional operation.
  */
 void mod_order_init(void);
 
+/**
+ * Initialize the module with the given ordering mode (MOD_ORDER_STRICT
+ * or MOD_ORDER_PIPELINED).  This function must be called once, from
+ * the main thread, after initializing the STM library and before
+ * performing any transactional operation.  In both modes, the order
+ * of commits is the order in which outermost transactions start.
+ */
+void mod_order_init_mode(int mode);
+
+/**
+ * Get the ticket of the current transaction, which is taken when the
+ * outermost transaction starts and kept upon retry.  Transactions
+ * commit in increasing order of their tickets.
+ *
+ * @return
+ *   Ticket of the current transaction.
+ */
+stm_word_t mod_order_ticket(void);
+
 # ifdef __cplusplus
 }
 # endif
@@ -26,8 +26,8 @@
 /**
  * @file
  *   Module for gathering statistics about transactions.  This module
- *   maintains both aggregate statistics about all threads (aggregates
- *   are updated upon thread cleanup) and per-thread statistics.  The
+ *   maintains per-thread statistics that can be aggregated at any
+ *   time, without locking, by any thread.  The
  *   built-in statistics of the core STM library are more efficient and
  *   detailed but this module is useful in case the library is compiled
  *   without support for statistics.
@@ -47,6 +47,48 @@
 extern "C" {
 # endif
 
+/**
+ * Number of buckets of the read and write set size histograms.
+ */
+# define STM_STATS_HIST_SIZE            16
+
+/**
+ * Number of abort reasons, indexed by (reason >> 8) & 0x0F for
+ * STM_ABORT_* values.
+ */
+# define STM_STATS_NB_REASONS           16
+
+/**
+ * Snapshot of the statistics of all threads (including exited ones).
+ * Bucket 0 of histograms counts empty sets and bucket i (i > 0) counts
+ * sets with 2^(i-1) to 2^i - 1 entries (the last bucket also counts
+ * larger sets).
+ */
+typedef struct stm_stats_snapshot {
+  unsigned long nb_threads;             /**< Number of running threads */
+  unsigned long commits;                /**< Number of commits */
+  unsigned long aborts;                 /**< Number of aborts */
+  unsigned long retries;                /**< Number of aborts of transactions that eventually committed */
+  unsigned long retries_min;            /**< Minimum number of retries of a committed transaction */
+  unsigned long retries_max;            /**< Maximum number of retries of a committed transaction */
+  unsigned long extensions;             /**< Number of snapshot extensions */
+  unsigned long aborts_reason[STM_STATS_NB_REASONS]; /**< Number of aborts wrt. reason */
+  unsigned long read_set_hist[STM_STATS_HIST_SIZE]; /**< Read set sizes of committed transactions */
+  unsigned long write_set_hist[STM_STATS_HIST_SIZE]; /**< Write set sizes of committed transactions */
+  unsigned long rw_set_bytes;           /**< Memory allocated for read and write sets of running threads (upon their last commit) */
+} stm_stats_snapshot_t;
+
+/**
+ * Sum the statistics of all threads.  This function can be called at
+ * any time by any thread (even non-transactional ones) and does not
+ * lock.  Counters of running threads are read while being updated,
+ * hence the snapshot is not atomic.
+ *
+ * @param snap
+ *   Pointer to the structure that should hold the statistics.
+ */
+void stm_stats_snapshot(stm_stats_snapshot_t *snap);
+
 /**
  * Get various statistics about the transactions of all threads.  See
  * the source code (mod_stats.c) for a list of supported statistics.
@@ -0,0 +1,220 @@
+/*
+ * File:
+ *   mod_trace.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for tracing transactional events.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Module for tracing transactional events.  Each thread writes
+ *   fixed-size binary records in a private ring buffer.  A background
+ *   thread copies the records to a memory-mapped file, which can be
+ *   converted to the Chrome trace format (also read by Perfetto) using
+ *   tools/trace2json.  Records are dropped (and counted) when a ring
+ *   buffer or the file is full: tracing never blocks transactions.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _MOD_TRACE_H_
+# define _MOD_TRACE_H_
+
+# include <stdint.h>
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Magic number of trace files ("STMTRACE").
+ */
+# define STM_TRACE_MAGIC                0x45434152544d5453ULL
+/**
+ * Version of the trace file format.
+ */
+# define STM_TRACE_VERSION              2
+/**
+ * Flag of records whose duration starts at the start of the attempt.
+ * Otherwise, it starts at the end of the previous attempt of the thread
+ * (or its initialization) and includes the time spent outside of
+ * transactions.
+ */
+# define STM_TRACE_FLAG_START           0x01
+
+/**
+ * Traced events.
+ */
+enum {
+  /**
+   * Thread initialization.
+   */
+  STM_TRACE_THREAD_INIT = 1,
+  /**
+   * Thread deletion.
+   */
+  STM_TRACE_THREAD_EXIT = 2,
+  /**
+   * Transaction commit (end of the attempt).
+   */
+  STM_TRACE_COMMIT = 3,
+  /**
+   * Transaction abort (end of the attempt, the reason is set).
+   */
+  STM_TRACE_ABORT = 4,
+  /**
+   * Snapshot extension.
+   */
+  STM_TRACE_EXTEND = 5,
+  /**
+   * Transaction becomes irrevocable.
+   */
+  STM_TRACE_IRREVOCABLE = 6
+};
+
+/**
+ * Trace record (32 bytes).  Transaction starts are not recorded: the
+ * start of an attempt is given by the duration of the commit or abort
+ * record that ends it.  To save a clock read per transaction, starts
+ * are only timestamped if the STM_TRACE_START environment variable is
+ * set to 1.  Otherwise, the duration is only exact for attempts that
+ * follow an abort (flag STM_TRACE_FLAG_START).
+ */
+typedef struct stm_trace_record {
+  /**
+   * Time stamp (clock ticks).
+   */
+  uint64_t ts;
+  /**
+   * Clock ticks since the start of the attempt (commits and aborts,
+   * saturated to 2^32 - 1), or since the end of the previous attempt
+   * without STM_TRACE_FLAG_START.
+   */
+  uint32_t duration;
+  /**
+   * Thread index (starting from 0).
+   */
+  uint16_t thread;
+  /**
+   * Event (STM_TRACE_* value).
+   */
+  uint8_t event;
+  /**
+   * Flags (STM_TRACE_FLAG_* values).
+   */
+  uint8_t flags;
+  /**
+   * Identifier of the atomic block.
+   */
+  uint16_t id;
+  /**
+   * Number of snapshot extensions of the attempt (saturated to
+   * 2^16 - 1).
+   */
+  uint16_t extensions;
+  /**
+   * Abort reason (STM_ABORT_* value, aborts only).
+   */
+  uint32_t reason;
+  /**
+   * Number of entries of the read set.
+   */
+  uint32_t rs;
+  /**
+   * Number of entries of the write set.
+   */
+  uint32_t ws;
+} stm_trace_record_t;
+
+/**
+ * Header of trace files (64 bytes), followed by records.  Time stamps
+ * of records can be converted to nanoseconds using the two reference
+ * points taken when the trace was opened and closed.
+ */
+typedef struct stm_trace_header {
+  /**
+   * Magic number (STM_TRACE_MAGIC).
+   */
+  uint64_t magic;
+  /**
+   * Version of the file format (STM_TRACE_VERSION).
+   */
+  uint32_t version;
+  /**
+   * Size of records.
+   */
+  uint32_t record_size;
+  /**
+   * Number of records in the file.
+   */
+  uint64_t nb_records;
+  /**
+   * Number of dropped records.
+   */
+  uint64_t nb_dropped;
+  /**
+   * Clock ticks when the trace was opened.
+   */
+  uint64_t ts_start;
+  /**
+   * Real time (ns) when the trace was opened.
+   */
+  uint64_t ns_start;
+  /**
+   * Clock ticks when the trace was closed.
+   */
+  uint64_t ts_end;
+  /**
+   * Real time (ns) when the trace was closed.
+   */
+  uint64_t ns_end;
+} stm_trace_header_t;
+
+/**
+ * Stop tracing, flush all records and close the trace file.  This
+ * function is called automatically upon program exit.
+ */
+void stm_trace_close(void);
+
+/**
+ * Initialize the module.  This function must be called once, from the
+ * main thread, after initializing the STM library and before
+ * performing any transactional operation.
+ *
+ * @param path
+ *   Path of the trace file (if NULL, the value of the STM_TRACE_FILE
+ *   environment variable, or "stm.trace").
+ * @param size
+ *   Maximum size of the trace file in bytes (0 for the default size,
+ *   or the value of the STM_TRACE_SIZE environment variable).
+ */
+void mod_trace_init(const char *path, size_t size);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _MOD_TRACE_H_ */
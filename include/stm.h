@@ -127,6 +127,12 @@ struct stm_tx *stm_current_tx(void) _CALLCONV;
  */
 typedef uintptr_t stm_word_t;
 
+/**
+ * Number of priorities of transactions (attribute priority), i.e., of
+ * elements of the statistics arrays indexed by priority.
+ */
+# define STM_PRIO_LEVELS                8
+
 /**
  * Transaction attributes specified by the application.
  */
@@ -156,6 +162,9 @@ typedef union stm_tx_attr {
    * after having repeatedly aborted with invisible reads), this flag is
    * updated accordingly.  If no attributes are specified when starting
    * a transaction, the default behavior is to use invisible reads.
+   * Visible reads acquire read locks, unless the library has been
+   * compiled with SHARED_VISIBLE_READS: readers then share locations
+   * and update transactions wait for them before committing.
    */
   unsigned int visible_reads : 1;
   /**
@@ -169,6 +178,39 @@ typedef union stm_tx_attr {
    * mechanism. (Working only with UNIT_TX)
    */
   unsigned int no_extend : 1;
+  /**
+   * Indicates that a nested transaction is closed: upon conflict, only
+   * the nested transaction is rolled back and it restarts at the point
+   * where sigsetjmp() has been called after starting it (as long as
+   * its parent is still consistent).  The attribute is ignored for
+   * top-level transactions.  (Working only with CLOSED_NESTING)
+   */
+  unsigned int closed_nesting : 1;
+  /**
+   * Indicates that the transaction is elastic: until its first write,
+   * it only keeps its last reads in its read set (at least as many as
+   * the "elastic_window" parameter) and concurrent updates to locations
+   * read before do not make it abort.  This is typically used to
+   * traverse search structures, as long as the locations that the
+   * transaction writes to depend only on its last reads.  Elastic
+   * transactions ignore the read-only hint.  (Working only with
+   * ELASTIC_TX)
+   */
+  unsigned int elastic : 1;
+  /**
+   * Priority of the transaction, from 0 (default and lowest) to
+   * STM_PRIO_LEVELS - 1.
+   * With the "priority" policy of the MODULAR contention manager, the
+   * transaction with the higher priority wins conflicts, and the
+   * priority of a transaction is raised by one level every PRIO_AGING
+   * consecutive aborts so that low priorities cannot starve.  With
+   * IRREVOCABLE_FALLBACK, each abort counts 1 + priority times toward
+   * the limit of retries before becoming irrevocable.  Statistics
+   * "nb_commits_prio", "nb_aborts_prio" (arrays of STM_PRIO_LEVELS
+   * unsigned int) and "cycles_prio" (array of STM_PRIO_LEVELS uint64_t)
+   * are indexed by priority and kept with TM_STATISTICS.
+   */
+  unsigned int priority : 3;
   /**
    * Indicates that the transaction is irrevocable.
    * 1 is simple irrevocable and 3 is serial irrevocable.
@@ -258,12 +300,74 @@ enum {
    * Abort due to reaching the write set size limit.
    */
   STM_ABORT_EXTEND_WS = (1 << 6) | (0x0C << 8),
+  /**
+   * Abort due to a call to stm_retry().
+   */
+  STM_ABORT_RETRY = (1 << 6) | (0x0D << 8),
+  /**
+   * Abort upon writing in read-only mode learned for the atomic block
+   * (the transaction restarts in update mode).
+   */
+  STM_ABORT_RO_WRITE = (1 << 6) | (0x0E << 8),
   /**
    * Abort due to other reasons (internal to the protocol).
    */
   STM_ABORT_OTHER = (1 << 6) | (0x0F << 8)
 };
 
+/**
+ * Events notified to callbacks registered with stm_register_event().
+ */
+enum {
+  /**
+   * The snapshot of the transaction has been extended.
+   */
+  STM_EVENT_EXTEND = 1,
+  /**
+   * The transaction has become irrevocable.
+   */
+  STM_EVENT_IRREVOCABLE = 2
+};
+
+/**
+ * Information about the current (or last) attempt of a transaction,
+ * typically read by modules from their commit and abort callbacks.
+ */
+typedef struct stm_tx_info {
+  /**
+   * Reason of the last abort (see STM_ABORT_* values), 0 if the
+   * transaction has not aborted yet.
+   */
+  unsigned int abort_reason;
+  /**
+   * Number of entries of the read set.
+   */
+  unsigned int read_set_nb_entries;
+  /**
+   * Number of entries of the write set.
+   */
+  unsigned int write_set_nb_entries;
+  /**
+   * Number of successful snapshot extensions.
+   */
+  unsigned int nb_extensions;
+  /**
+   * Memory currently allocated for the read and write sets of the
+   * thread (bytes).
+   */
+  unsigned long rw_set_bytes;
+  /**
+   * Address whose access caused the abort, NULL if unknown.  Only
+   * valid in abort callbacks.
+   */
+  void *conflict_addr;
+  /**
+   * Index of the lock (in the global lock array) that caused the
+   * abort, -1 if unknown.  Only valid in abort callbacks.
+   */
+  long conflict_lock;
+} stm_tx_info_t;
+
 /* ################################################################### *
  * FUNCTIONS
  * ################################################################### */
@@ -297,6 +401,33 @@ void stm_exit_thread(void) _CALLCONV;
 void stm_exit_thread_tx(struct stm_tx *tx) _CALLCONV;
 //@}
 
+/**
+ * Detach the transaction descriptor from the current thread, which
+ * must not execute a transaction, so that it can be attached to
+ * another thread using stm_attach_thread() (e.g., to run user-level
+ * tasks on a pool of threads).  The current thread must not call other
+ * functions of the library (other than stm_init_thread() or
+ * stm_attach_thread()) until it has a descriptor again.  A detached
+ * descriptor remains registered: upon clock rollover, other threads
+ * wait for it to be attached and used again.
+ *
+ * @return
+ *   Descriptor of the thread, or NULL if the thread has no descriptor.
+ */
+struct stm_tx *stm_detach_thread(void) _CALLCONV;
+
+/**
+ * Attach a descriptor previously obtained from stm_detach_thread() to
+ * the current thread.  A descriptor can only be attached to one thread
+ * at a time.
+ *
+ * @param tx
+ *   Descriptor to attach.
+ * @return
+ *   1 upon success, 0 if the current thread already has a descriptor.
+ */
+int stm_attach_thread(struct stm_tx *tx) _CALLCONV;
+
 //@{
 /**
  * Start a transaction.
@@ -311,12 +442,44 @@ void stm_exit_thread_tx(struct stm_tx *tx) _CALLCONV;
  *   immediately after starting the transaction.  If the transaction is
  *   nested, the function returns NULL and one should not call
  *   sigsetjmp() as an abort will restart the top-level transaction
- *   (flat nesting).
+ *   (flat nesting), unless the transaction is closed nested (see the
+ *   closed_nesting attribute).
  */
 sigjmp_buf *stm_start(stm_tx_attr_t attr) _CALLCONV;
 sigjmp_buf *stm_start_tx(struct stm_tx *tx, stm_tx_attr_t attr) _CALLCONV;
 //@}
 
+/**
+ * Start a transaction and save the context of the caller with a
+ * lightweight checkpoint, which replaces calling sigsetjmp() after
+ * stm_start().  Upon abort, execution continues at the return of this
+ * function.  Like sigsetjmp(env, 0), the signal mask is neither saved
+ * nor restored.  Other transactions of the thread can still use
+ * stm_start() and sigsetjmp().  (Working only with CTX_CHECKPOINT, on
+ * x86_64 and AArch64)
+ *
+ * @param attr
+ *   Specifies optional attributes associated to the transaction (see
+ *   stm_start()).
+ * @return
+ *   0 when the transaction starts, the abort reason (as returned by
+ *   sigsetjmp()) when it restarts.
+ */
+int stm_start_ckpt(stm_tx_attr_t attr) _CALLCONV __attribute__((returns_twice));
+
+/**
+ * Start a transaction and save the context of the caller, which
+ * evaluates to 0 upon start and to the abort reason upon restart.
+ * Applications compiled with CTX_CHECKPOINT (as the library) use
+ * stm_start_ckpt(), other ones stm_start() and sigsetjmp().
+ */
+# ifdef CTX_CHECKPOINT
+#  define STM_START(attr)               stm_start_ckpt(attr)
+# else /* ! CTX_CHECKPOINT */
+#  define STM_START(attr) \
+  ({ sigjmp_buf *_stm_e = stm_start(attr); _stm_e == NULL ? 0 : sigsetjmp(*_stm_e, 0); })
+# endif /* ! CTX_CHECKPOINT */
+
 //@{
 /**
  * Try to commit a transaction.  If successful, the function returns 1.
@@ -345,6 +508,96 @@ void stm_abort(int abort_reason) _CALLCONV;
 void stm_abort_tx(struct stm_tx *tx, int abort_reason) _CALLCONV;
 //@}
 
+//@{
+/**
+ * Abort the current transaction and restart it once another
+ * transaction has updated some memory location that it has read
+ * (e.g., to wait until a shared queue is not empty).  With the
+ * BLOCKING_RETRY compile flag, the calling thread sleeps until then;
+ * otherwise, it yields the processor before restarting.  The
+ * transaction restarts immediately if it has not read anything (e.g.,
+ * when declared read-only, as such transactions keep no read set).
+ * Irrevocable transactions cannot retry.  Execution continues at the
+ * point where sigsetjmp() has been called after starting the
+ * outermost transaction.
+ */
+void stm_retry(void) _CALLCONV;
+void stm_retry_tx(struct stm_tx *tx) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Record a savepoint in the current transaction.  The caller must call
+ * sigsetjmp() on the returned buffer, as after starting a transaction,
+ * and execution may later continue from there: after a call to
+ * stm_rollback_to() with the savepoint, or upon conflict if the data
+ * read before the savepoint is still consistent.  Only the changes made
+ * since the savepoint are then undone, so that an expensive prefix does
+ * not have to be executed again.  The savepoint is dropped when the
+ * enclosing transaction (top-level or closed nested) commits.  For
+ * explicit aborts, savepoints are ignored.  (Working only with
+ * CLOSED_NESTING)
+ *
+ * @return
+ *   Environment for sigsetjmp(), or NULL if the savepoint cannot be
+ *   recorded (too many savepoints and closed nested transactions,
+ *   irrevocable or hardware transactions, or not supported).
+ */
+sigjmp_buf *stm_savepoint(void) _CALLCONV;
+sigjmp_buf *stm_savepoint_tx(struct stm_tx *tx) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Undo the changes made by the current transaction since a savepoint
+ * and continue execution from there.  If the data read before the
+ * savepoint has changed in the meantime, execution continues from an
+ * older savepoint or, if none allows it, the whole transaction aborts
+ * and restarts.  Irrevocable transactions cannot roll back.
+ *
+ * @param savepoint
+ *   Savepoint returned by stm_savepoint() (the transaction restarts
+ *   from the beginning if NULL).
+ */
+void stm_rollback_to(sigjmp_buf *savepoint) _CALLCONV;
+void stm_rollback_to_tx(struct stm_tx *tx, sigjmp_buf *savepoint) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Validate the read set of a transaction against all transactions
+ * that have committed so far and extend its snapshot accordingly.
+ * Upon success, the transaction is guaranteed to observe the effects
+ * of these transactions.  Otherwise, the transaction aborts and
+ * execution continues at the point where sigsetjmp() has been called.
+ * This function is typically used by modules that impose an order on
+ * transactions (read-only transactions do not validate upon commit).
+ * Transactions declared read-only in their attributes keep no read
+ * set and abort if any transaction has committed after their snapshot
+ * was taken.  It has no effect on irrevocable transactions and on
+ * multi-version read-only transactions.
+ */
+void stm_validate(void) _CALLCONV;
+void stm_validate_tx(struct stm_tx *tx) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Release a location read by the current transaction (early release):
+ * the reads of the stripe that holds the location are removed from the
+ * read set and are neither validated upon snapshot extension nor upon
+ * commit.  The programmer must make sure that the transaction does not
+ * depend on the values read there anymore.  Writes are not affected.
+ * Inside a closed nested transaction, only the reads of the nested
+ * transaction are released.  (Working only with ELASTIC_TX)
+ *
+ * @param addr
+ *   Address of the memory location.
+ */
+void stm_release(volatile stm_word_t *addr) _CALLCONV;
+void stm_release_tx(struct stm_tx *tx, volatile stm_word_t *addr) _CALLCONV;
+//@}
+
 //@{
 /**
  * Transactional load.  Read the specified memory location in the
@@ -398,6 +651,130 @@ void stm_store2(volatile stm_word_t *addr, stm_word_t value, stm_word_t mask) _C
 void stm_store2_tx(struct stm_tx *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask) _CALLCONV;
 //@}
 
+//@{
+/**
+ * Transactional load of consecutive words.  The words covered by the
+ * same lock are checked once and only add one entry to the read set
+ * (unless the lock is owned or changes while reading).  Upon conflict,
+ * the transaction may abort while reading the memory locations.
+ *
+ * @param addr
+ *   Address of the first memory location.
+ * @param buf
+ *   Buffer for storing the words read.
+ * @param nb
+ *   Number of words to read.
+ */
+void stm_load_range(volatile stm_word_t *addr, stm_word_t *buf, size_t nb) _CALLCONV;
+void stm_load_range_tx(struct stm_tx *tx, volatile stm_word_t *addr, stm_word_t *buf, size_t nb) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional load of words at independent addresses (e.g., fields
+ * of different objects).  Each word is read as with stm_load(), but
+ * the locks and data of the next words are prefetched beforehand so
+ * that cache misses overlap.  Upon conflict, the transaction may abort
+ * while reading the memory locations.
+ *
+ * @param addrs
+ *   Addresses of the memory locations.
+ * @param buf
+ *   Buffer for storing the words read.
+ * @param nb
+ *   Number of words to read.
+ */
+void stm_load_n(volatile stm_word_t **addrs, stm_word_t *buf, size_t nb) _CALLCONV;
+void stm_load_n_tx(struct stm_tx *tx, volatile stm_word_t **addrs, stm_word_t *buf, size_t nb) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Hint that the current transaction is about to read a memory location
+ * (e.g., the next node of a traversal).  The lock covering the location
+ * and the location itself are prefetched into the cache.  This has no
+ * effect on the semantics of the transaction and the address does not
+ * even need to be valid.
+ *
+ * @param addr
+ *   Address of the memory location.
+ */
+void stm_prefetch(const volatile void *addr) _CALLCONV;
+void stm_prefetch_tx(struct stm_tx *tx, const volatile void *addr) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional store of consecutive words.  Upon conflict, the
+ * transaction may abort while writing to the memory locations.
+ *
+ * @param addr
+ *   Address of the first memory location.
+ * @param buf
+ *   Buffer with the words to write.
+ * @param nb
+ *   Number of words to write.
+ */
+void stm_store_range(volatile stm_word_t *addr, const stm_word_t *buf, size_t nb) _CALLCONV;
+void stm_store_range_tx(struct stm_tx *tx, volatile stm_word_t *addr, const stm_word_t *buf, size_t nb) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional load of a field of an object allocated with
+ * stm_malloc_obj().  If the library has been compiled with
+ * OBJECT_LOCKS, the field is protected by the lock stored in the header
+ * of the object (the word preceding it) instead of a lock of the global
+ * array, hence accesses to the fields of an object share the cache line
+ * of the lock and never conflict with unrelated data.  Otherwise, the
+ * function behaves as stm_load().  Fields of such objects must only be
+ * accessed using stm_load_obj(), stm_store_obj() and stm_store2_obj().
+ *
+ * @param obj
+ *   Address of the object.
+ * @param addr
+ *   Address of the field.
+ * @return
+ *   Value read from the specified address.
+ */
+stm_word_t stm_load_obj(void *obj, volatile stm_word_t *addr) _CALLCONV;
+stm_word_t stm_load_obj_tx(struct stm_tx *tx, void *obj, volatile stm_word_t *addr) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional store to a field of an object allocated with
+ * stm_malloc_obj() (see stm_load_obj()).
+ *
+ * @param obj
+ *   Address of the object.
+ * @param addr
+ *   Address of the field.
+ * @param value
+ *   Value to be written.
+ */
+void stm_store_obj(void *obj, volatile stm_word_t *addr, stm_word_t value) _CALLCONV;
+void stm_store_obj_tx(struct stm_tx *tx, void *obj, volatile stm_word_t *addr, stm_word_t value) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional store of part of a field of an object allocated with
+ * stm_malloc_obj() (see stm_load_obj() and stm_store2()).
+ *
+ * @param obj
+ *   Address of the object.
+ * @param addr
+ *   Address of the field.
+ * @param value
+ *   Value to be written.
+ * @param mask
+ *   Mask specifying the bits to be written.
+ */
+void stm_store2_obj(void *obj, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask) _CALLCONV;
+void stm_store2_obj_tx(struct stm_tx *tx, void *obj, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask) _CALLCONV;
+//@}
+
 //@{
 /**
  * Check if the current transaction is still active.
@@ -474,6 +851,19 @@ stm_tx_attr_t stm_get_attributes(void) _CALLCONV;
 stm_tx_attr_t stm_get_attributes_tx(struct stm_tx *tx) _CALLCONV;
 //@}
 
+//@{
+/**
+ * Get information about the current attempt of the current transaction
+ * without string lookups (suitable for commit and abort callbacks,
+ * which are called before the read and write sets are reset).
+ *
+ * @param info
+ *   Pointer to the structure that should hold the information.
+ */
+void stm_get_tx_info(stm_tx_info_t *info) _CALLCONV;
+void stm_get_tx_info_tx(struct stm_tx *tx, stm_tx_info_t *info) _CALLCONV;
+//@}
+
 //@{
 /**
  * Get various statistics about the current thread/transaction.  See the
@@ -521,7 +911,8 @@ int stm_set_parameter(const char *name, void *val) _CALLCONV;
 /**
  * Create a key to associate application-specific data to the current
  * thread/transaction.  This mechanism can be combined with callbacks to
- * write modules.
+ * write modules.  The number of keys is not limited, but accesses to
+ * the first ones are faster.
  *
  * @return
  *   The new key.
@@ -558,7 +949,10 @@ void stm_set_specific_tx(struct stm_tx *tx, int key, void *data) _CALLCONV;
 
 /**
  * Register application-specific callbacks that are triggered each time
- * particular events occur.
+ * particular events occur.  Callbacks can be registered while
+ * transactions run, in which case a transaction might only call some of
+ * the callbacks of the module.  Callbacks are called in the order in
+ * which modules have been registered.
  *
  * @param on_thread_init
  *   Function called upon initialization of a transactional thread.
@@ -575,7 +969,8 @@ void stm_set_specific_tx(struct stm_tx *tx, int key, void *data) _CALLCONV;
  * @param arg
  *   Parameter to be passed to the callback functions.
  * @return
- *   1 if the callbacks have been successfully registered, 0 otherwise.
+ *   Identifier of the module (strictly positive) if the callbacks have
+ *   been successfully registered, 0 otherwise.
  */
 int stm_register(void (*on_thread_init)(void *arg),
                  void (*on_thread_exit)(void *arg),
@@ -585,6 +980,26 @@ int stm_register(void (*on_thread_init)(void *arg),
                  void (*on_abort)(void *arg),
                  void *arg) _CALLCONV;
 
+//@{
+/**
+ * Enable or disable for the current thread the start, pre-commit,
+ * commit and abort callbacks of a module registered with
+ * stm_register() (thread callbacks are always called).  Other threads
+ * are not affected.  Modules are enabled when threads are initialized.
+ * Only the first modules, as many as the bits of a word, can be
+ * disabled.  The function must be called outside of a transaction.
+ *
+ * @param module
+ *   Identifier of the module returned by stm_register().
+ * @param enabled
+ *   1 to enable the callbacks of the module, 0 to disable them.
+ * @return
+ *   1 upon success, 0 otherwise.
+ */
+int stm_enable_module(int module, int enabled) _CALLCONV;
+int stm_enable_module_tx(struct stm_tx *tx, int module, int enabled) _CALLCONV;
+//@}
+
 /**
  * Transaction-safe load.  Read the specified memory location outside of
  * the context of any transaction and return its value.  The operation
@@ -651,6 +1066,45 @@ int stm_unit_store(volatile stm_word_t *addr, stm_word_t value, stm_word_t *time
  */
 int stm_unit_store2(volatile stm_word_t *addr, stm_word_t value, stm_word_t mask, stm_word_t *timestamp) _CALLCONV;
 
+/**
+ * Number of memory locations updated by stm_unit_cas() without
+ * allocating memory.
+ */
+# define STM_UNIT_CAS_MAX               16
+
+/**
+ * Transaction-safe multi-word compare-and-swap.  Atomically check that
+ * the specified memory locations hold the expected values and, if so,
+ * replace them by the desired values, outside of the context of any
+ * transaction.  The operation behaves as if executed in the context of
+ * a dedicated transaction (i.e., it executes atomically and in
+ * isolation) that never aborts, but may get delayed.  The locks
+ * covering the memory locations are acquired in address order and the
+ * clock is incremented once for all locations.  Addresses must be
+ * distinct.
+ *
+ * @param n
+ *   Number of memory locations (beyond STM_UNIT_CAS_MAX, the locks
+ *   are tracked in memory allocated for the call).
+ * @param addrs
+ *   Addresses of the memory locations.
+ * @param expected
+ *   Values expected at the memory locations.
+ * @param desired
+ *   Values to be written to the memory locations.
+ * @param timestamp If non-null and the timestamp in the referenced
+ *   variable is smaller than that of some memory location, no data is
+ *   actually written and the variable is updated to hold the more
+ *   recent timestamp.  If some memory location does not hold the
+ *   expected value, no data is written and the variable is updated to
+ *   hold the most recent timestamp of the memory locations.  Otherwise,
+ *   the memory locations are written and the variable is updated to
+ *   hold the new timestamp.
+ * @return
+ *   1 if values have been written, 0 otherwise.
+ */
+int stm_unit_cas(size_t n, volatile stm_word_t **addrs, const stm_word_t *expected, const stm_word_t *desired, stm_word_t *timestamp) _CALLCONV;
+
 //@{
 /**
  * Enable or disable snapshot extensions for the current transaction,
@@ -697,6 +1151,137 @@ int stm_set_irrevocable(int serial) _CALLCONV;
 int stm_set_irrevocable_tx(struct stm_tx *tx, int serial) _CALLCONV;
 //@}
 
+/**
+ * Set the policy that makes transactions irrevocable after they have
+ * repeatedly aborted, so that long transactions cannot starve.  A
+ * transaction that has aborted too many consecutive times, or whose
+ * aborted attempts have lasted too long, restarts in irrevocable mode
+ * (see stm_set_irrevocable()).  The policy applies to the atomic
+ * blocks with the given identifier (modulo 64) or, if the identifier
+ * is negative, to all atomic blocks without a policy of their own.
+ * (Working only with IRREVOCABLE_FALLBACK)
+ *
+ * @param id
+ *   Identifier of the atomic blocks (see stm_tx_attr_t), or -1 for the
+ *   default policy.
+ * @param retries
+ *   Number of consecutive aborts after which the transaction becomes
+ *   irrevocable (0 means no limit).
+ * @param cycles
+ *   Number of cycles spent in aborted attempts after which the
+ *   transaction becomes irrevocable (0 means no limit).
+ * @param serial
+ *   True (non-zero) for serial-irrevocable mode, false for
+ *   parallel-irrevocable mode.
+ * @return
+ *   1 upon success, 0 otherwise.
+ */
+int stm_set_irrevocable_fallback(int id, unsigned int retries, unsigned long cycles, int serial) _CALLCONV;
+
+/**
+ * Register a memory region that uses its own lock table, with one lock
+ * for each block of 2^shift bytes (word granularity if shift is the
+ * log2 of the word size).  Accesses outside of registered regions use
+ * the global lock array.  Coarse stripes reduce the number of locks to
+ * acquire and validate for large data structures, while fine stripes
+ * avoid false conflicts on small hot objects.  The function waits for
+ * all transactions to complete and must be called outside of a
+ * transaction.  Regions must not overlap.
+ *
+ * @param base
+ *   First address of the region.
+ * @param size
+ *   Size of the region (in bytes).
+ * @param shift
+ *   Log2 of the number of bytes covered by a lock.
+ * @return
+ *   1 if the region has been registered, 0 otherwise.
+ */
+int stm_register_region(void *base, size_t size, unsigned int shift) _CALLCONV;
+
+/**
+ * Unregister a memory region previously registered using
+ * stm_register_region().  The function waits for all transactions to
+ * complete and must be called outside of a transaction.
+ *
+ * @param base
+ *   First address of the region.
+ * @return
+ *   1 if the region has been unregistered, 0 otherwise.
+ */
+int stm_unregister_region(void *base) _CALLCONV;
+
+/**
+ * Register a callback for an external module that exposes its own
+ * parameters through stm_get_parameter() (can be called while
+ * transactions run).  The callback is only invoked for names that
+ * are not known to the STM library.
+ *
+ * @param get
+ *   Function that stores the value of the parameter <i>name</i> in
+ *   <i>val</i> and returns 1, or returns 0 if the parameter is unknown.
+ * @param arg
+ *   Parameter to be passed to the callback function.
+ * @return
+ *   1 if the callback has been successfully registered, 0 otherwise.
+ */
+int stm_register_parameter(int (*get)(const char *name, void *val, void *arg),
+                           void *arg) _CALLCONV;
+
+/**
+ * Register a callback for an external module that is notified of
+ * infrequent events of the current transaction (see STM_EVENT_*
+ * values).  Events are notified on slow paths only and the callback is
+ * called by the thread executing the transaction (can be called while
+ * transactions run).
+ *
+ * @param on_event
+ *   Function called with the event and <i>arg</i>.
+ * @param arg
+ *   Parameter to be passed to the callback function.
+ * @return
+ *   1 if the callback has been successfully registered, 0 otherwise.
+ */
+int stm_register_event(void (*on_event)(int event, void *arg),
+                       void *arg) _CALLCONV;
+
+/**
+ * Register callbacks for an external module that keeps track of closed
+ * nested transactions (can be called while transactions run).
+ * The callbacks are only called for nested transactions started with
+ * the closed_nesting attribute.  Upon abort of a nested transaction,
+ * the module must undo the changes of the nested transaction only; if
+ * the nested transaction restarts, the start callback is called again.
+ * The regular commit and abort callbacks are still called for the
+ * top-level transaction.  (Working only with CLOSED_NESTING)
+ *
+ * @param on_start
+ *   Function called upon start of a closed nested transaction.
+ * @param on_commit
+ *   Function called upon commit of a closed nested transaction.
+ * @param on_abort
+ *   Function called upon abort of a closed nested transaction.
+ * @param arg
+ *   Parameter to be passed to the callback functions.
+ * @return
+ *   1 if the callbacks have been successfully registered, 0 otherwise.
+ */
+int stm_register_nested(void (*on_start)(void *arg),
+                        void (*on_commit)(void *arg),
+                        void (*on_abort)(void *arg),
+                        void *arg) _CALLCONV;
+
+/**
+ * Wait until all transactions that were executing upon call have
+ * completed (privatization fence).  Once a thread has made some data
+ * unreachable from shared variables in a transaction, it can access the
+ * data non-transactionally after the fence, as no transaction can still
+ * read or write it.  The fence does not block transactions that start
+ * after it, nor other fences.  It must be called outside of a
+ * transaction.  (Working only with PRIVATIZATION_FENCE)
+ */
+void stm_privatize_fence(void) _CALLCONV;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,320 @@
+/*
+ * File:
+ *   stm.hpp
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Typed C++ interface (header only).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Typed C++ interface (header only, requires C++17).  Accesses to a
+ *   stm::tvar<T> select at compile time, from the size and alignment of
+ *   T, the word barrier (stm_load()/stm_store()), a masked sub-word
+ *   barrier on the enclosing word (stm_store2()), or the range barriers
+ *   (stm_load_range()/stm_store_range()).  Accesses can be given the
+ *   transaction descriptor explicitly to avoid thread-local lookups.
+ *
+ *   Transactions are started with the no_retry attribute: upon
+ *   conflict, the barrier that detects it throws stm::aborted, hence
+ *   destructors of objects created in the transaction run normally,
+ *   and stm::atomically() catches the exception and restarts the
+ *   transaction.  A stm::transaction scope that is left without
+ *   commit (e.g., by another exception) aborts its transaction.  As
+ *   the library does not restart such transactions itself, they are not
+ *   subject to IRREVOCABLE_FALLBACK or ADAPTIVE_SCHEDULING.  Nested
+ *   scopes are flattened: aborting a nested scope aborts the whole
+ *   transaction.
+ *
+ *   The thread must have been initialized with stm_init_thread().
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _STM_HPP_
+# define _STM_HPP_
+
+# if __cplusplus < 201703L
+#  error stm.hpp requires C++17
+# endif
+
+# include <cstring>
+# include <exception>
+# include <type_traits>
+# include <utility>
+
+# include "stm.h"
+
+namespace stm {
+
+/**
+ * Exception thrown by accesses and commits when the transaction has
+ * aborted.
+ */
+class aborted : public std::exception {
+public:
+  const char *what() const noexcept override { return "transaction aborted"; }
+};
+
+/**
+ * Transaction scope.  The constructor starts a transaction (or a
+ * nested one), commit() commits it, and the destructor aborts it if it
+ * has not been committed.
+ */
+class transaction {
+public:
+  /**
+   * Start a transaction for the current thread.
+   *
+   * @param attr
+   *   Attributes of the transaction (no_retry is always set).
+   * @param tx
+   *   Descriptor of the current thread (looked up if NULL).
+   */
+  explicit transaction(stm_tx_attr_t attr = stm_tx_attr_t{}, struct stm_tx *tx = NULL)
+    : tx_(tx != NULL ? tx : stm_current_tx()), done_(false)
+  {
+    attr.no_retry = 1;
+    stm_start_tx(tx_, attr);
+  }
+
+  transaction(const transaction &) = delete;
+  transaction &operator=(const transaction &) = delete;
+
+  ~transaction()
+  {
+    if (!done_ && stm_active_tx(tx_))
+      stm_abort_tx(tx_, STM_ABORT_NO_RETRY);
+  }
+
+  /**
+   * Commit the transaction (or leave the nested one).
+   *
+   * @throw aborted if the transaction cannot commit.
+   */
+  void commit()
+  {
+    done_ = true;
+    /* May have aborted in an access not made through a tvar */
+    if (!stm_active_tx(tx_) || stm_commit_tx(tx_) == 0)
+      throw aborted();
+  }
+
+  /**
+   * Get the descriptor of the transaction.
+   */
+  struct stm_tx *tx() const noexcept { return tx_; }
+
+private:
+  struct stm_tx *tx_;
+  bool done_;
+};
+
+namespace detail {
+
+constexpr size_t word_size = sizeof(stm_word_t);
+
+/* Upper bound of the number of words covered by a T */
+template <typename T>
+constexpr size_t nb_words = (sizeof(T) + 2 * word_size - 2) / word_size;
+
+inline void check(struct stm_tx *tx)
+{
+  if (__builtin_expect(!stm_active_tx(tx), 0))
+    throw aborted();
+}
+
+template <typename T>
+T load(struct stm_tx *tx, const volatile T *addr)
+{
+  static_assert(std::is_trivially_copyable_v<T>, "transactional types must be trivially copyable");
+  T v;
+  stm_word_t a = (stm_word_t)addr;
+
+  if constexpr (sizeof(T) == word_size && alignof(T) >= word_size) {
+    /* Word barrier */
+    stm_word_t w = stm_load_tx(tx, (volatile stm_word_t *)a);
+    check(tx);
+    std::memcpy(&v, &w, sizeof(T));
+  } else if constexpr (sizeof(T) < word_size && alignof(T) >= sizeof(T)) {
+    /* Sub-word barrier: never spans two words */
+    stm_word_t off = a & (word_size - 1);
+    stm_word_t w = stm_load_tx(tx, (volatile stm_word_t *)(a - off));
+    check(tx);
+    std::memcpy(&v, (char *)&w + off, sizeof(T));
+  } else {
+    /* Range barrier */
+    stm_word_t buf[nb_words<T>];
+    stm_word_t off = a & (word_size - 1);
+    size_t nb = (off + sizeof(T) + word_size - 1) / word_size;
+    stm_load_range_tx(tx, (volatile stm_word_t *)(a - off), buf, nb);
+    check(tx);
+    std::memcpy(&v, (char *)buf + off, sizeof(T));
+  }
+  return v;
+}
+
+template <typename T>
+void store(struct stm_tx *tx, volatile T *addr, const T &v)
+{
+  static_assert(std::is_trivially_copyable_v<T>, "transactional types must be trivially copyable");
+  stm_word_t a = (stm_word_t)addr;
+
+  if constexpr (sizeof(T) == word_size && alignof(T) >= word_size) {
+    /* Word barrier */
+    stm_word_t w;
+    std::memcpy(&w, &v, sizeof(T));
+    stm_store_tx(tx, (volatile stm_word_t *)a, w);
+    check(tx);
+  } else if constexpr (sizeof(T) % word_size == 0 && alignof(T) >= word_size) {
+    /* Range barrier on whole words */
+    stm_word_t buf[sizeof(T) / word_size];
+    std::memcpy(buf, &v, sizeof(T));
+    stm_store_range_tx(tx, (volatile stm_word_t *)a, buf, sizeof(T) / word_size);
+    check(tx);
+  } else {
+    /* Masked barrier on each (partially) covered word */
+    stm_word_t buf[nb_words<T>], mask[nb_words<T>];
+    stm_word_t off = a & (word_size - 1);
+    size_t i, nb = (off + sizeof(T) + word_size - 1) / word_size;
+    std::memset(buf, 0, sizeof(buf));
+    std::memset(mask, 0, sizeof(mask));
+    std::memcpy((char *)buf + off, &v, sizeof(T));
+    std::memset((char *)mask + off, 0xFF, sizeof(T));
+    for (i = 0; i < nb; i++) {
+      stm_store2_tx(tx, (volatile stm_word_t *)(a - off) + i, buf[i], mask[i]);
+      check(tx);
+    }
+  }
+}
+
+} /* namespace detail */
+
+/**
+ * Transactional variable.  T must be trivially copyable: values are
+ * copied in and out of transactions.
+ */
+template <typename T>
+class tvar {
+public:
+  tvar() = default;
+  explicit tvar(const T &v) : value_(v) {}
+
+  tvar(const tvar &) = delete;
+  tvar &operator=(const tvar &) = delete;
+
+  /**
+   * Read the variable in the given transaction.
+   *
+   * @throw aborted upon conflict.
+   */
+  T load(const transaction &t) const { return detail::load(t.tx(), &value_); }
+
+  /**
+   * Read the variable in the current transaction of this thread.
+   *
+   * @throw aborted upon conflict.
+   */
+  T load() const { return detail::load(stm_current_tx(), &value_); }
+
+  /**
+   * Write the variable in the given transaction.
+   *
+   * @throw aborted upon conflict.
+   */
+  void store(const transaction &t, const T &v) { detail::store(t.tx(), &value_, v); }
+
+  /**
+   * Write the variable in the current transaction of this thread.
+   *
+   * @throw aborted upon conflict.
+   */
+  void store(const T &v) { detail::store(stm_current_tx(), &value_, v); }
+
+  /**
+   * Non-transactional access (e.g., for initialization or once all
+   * threads have completed).
+   */
+  T &unsafe() noexcept { return value_; }
+
+private:
+  T value_;
+};
+
+/**
+ * Execute a function in a transaction and retry it until it commits.
+ * The function takes either a reference to the stm::transaction (for
+ * passing it to accesses) or no argument.  Exceptions other than
+ * stm::aborted abort the transaction and are propagated.  When called
+ * in a transaction, the function is executed as part of it and
+ * stm::aborted is propagated to the enclosing stm::atomically().
+ *
+ * @param f
+ *   Function to execute.
+ * @param attr
+ *   Attributes of the transaction.
+ * @return
+ *   Value returned by the function upon commit.
+ */
+template <typename F>
+auto atomically(F &&f, stm_tx_attr_t attr = stm_tx_attr_t{})
+{
+  struct stm_tx *tx = stm_current_tx();
+  bool nested = stm_active_tx(tx);
+
+  for (;;) {
+    try {
+      transaction t(attr, tx);
+      if constexpr (std::is_invocable_v<F &, transaction &>) {
+        if constexpr (std::is_void_v<std::invoke_result_t<F &, transaction &>>) {
+          f(t);
+          t.commit();
+          return;
+        } else {
+          auto r = f(t);
+          t.commit();
+          return r;
+        }
+      } else {
+        if constexpr (std::is_void_v<std::invoke_result_t<F &>>) {
+          f();
+          t.commit();
+          return;
+        } else {
+          auto r = f();
+          t.commit();
+          return r;
+        }
+      }
+    } catch (const aborted &) {
+      if (nested)
+        throw;
+      /* Keep attributes changed by the library (e.g., read-only hint) */
+      attr = stm_get_attributes_tx(tx);
+    }
+  }
+}
+
+} /* namespace stm */
+
+#endif /* _STM_HPP_ */
@@ -0,0 +1,251 @@
+/*
+ * File:
+ *   stm_ds.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Library of transactional data structures.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Library of transactional data structures (libstm-ds).  Sets (sorted
+ *   linked list, skip list, red-black tree and hash set) store distinct
+ *   keys, queues and deques store words in insertion order, and
+ *   priority queues store keys (possibly duplicated) and return the
+ *   smallest first.  Keys and values are arbitrary words, compared as
+ *   unsigned integers.
+ *
+ *   Each operation executes as a transaction of the calling thread,
+ *   which must have been initialized with stm_init_thread() (and the
+ *   memory module with mod_mem_init() or mod_mem_init_arena()).  When
+ *   called from inside a transaction, operations are part of the
+ *   enclosing transaction (flat nesting), so that several of them can
+ *   be composed atomically.  Lookups start read-only transactions.
+ *
+ *   Nodes are allocated using stm_malloc_aligned() so that no two nodes
+ *   share a stripe (memory words covered by the same lock), and the
+ *   fields read by a traversal are placed at the beginning of the node
+ *   so that they fall into one stripe.  Structures are created and
+ *   destroyed outside of transactions, when no other thread accesses
+ *   them.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _STM_DS_H_
+# define _STM_DS_H_
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/**
+ * Sorted linked list.
+ */
+typedef struct ds_list ds_list_t;
+/**
+ * Skip list.
+ */
+typedef struct ds_skiplist ds_skiplist_t;
+/**
+ * Red-black tree.
+ */
+typedef struct ds_rbtree ds_rbtree_t;
+/**
+ * Hash set (array of sorted linked lists).
+ */
+typedef struct ds_hashset ds_hashset_t;
+/**
+ * FIFO queue.
+ */
+typedef struct ds_queue ds_queue_t;
+/**
+ * Double-ended queue.
+ */
+typedef struct ds_deque ds_deque_t;
+/**
+ * Priority queue (skip list with duplicates).
+ */
+typedef struct ds_pqueue ds_pqueue_t;
+
+//@{
+/**
+ * Create an empty structure (outside of transactions).  The hash set
+ * has nb_buckets buckets (rounded up to a power of 2), each padded to
+ * the stripe size of the lock array (at most a cache line) and thus
+ * best created after stm_init().
+ *
+ * @return
+ *   Handle of the structure.
+ */
+ds_list_t *ds_list_new(void);
+ds_skiplist_t *ds_skiplist_new(void);
+ds_rbtree_t *ds_rbtree_new(void);
+ds_hashset_t *ds_hashset_new(size_t nb_buckets);
+ds_queue_t *ds_queue_new(void);
+ds_deque_t *ds_deque_new(void);
+ds_pqueue_t *ds_pqueue_new(void);
+//@}
+
+//@{
+/**
+ * Free a structure and all its elements (outside of transactions).  No
+ * other thread may access the structure anymore.
+ */
+void ds_list_delete(ds_list_t *l);
+void ds_skiplist_delete(ds_skiplist_t *l);
+void ds_rbtree_delete(ds_rbtree_t *t);
+void ds_hashset_delete(ds_hashset_t *h);
+void ds_queue_delete(ds_queue_t *q);
+void ds_deque_delete(ds_deque_t *d);
+void ds_pqueue_delete(ds_pqueue_t *q);
+//@}
+
+//@{
+/**
+ * Count the elements of a structure (read-only transaction).
+ *
+ * @return
+ *   Number of elements.
+ */
+size_t ds_list_size(ds_list_t *l);
+size_t ds_skiplist_size(ds_skiplist_t *l);
+size_t ds_rbtree_size(ds_rbtree_t *t);
+size_t ds_hashset_size(ds_hashset_t *h);
+size_t ds_queue_size(ds_queue_t *q);
+size_t ds_deque_size(ds_deque_t *d);
+size_t ds_pqueue_size(ds_pqueue_t *q);
+//@}
+
+//@{
+/**
+ * Check whether a set contains a key (read-only transaction).
+ *
+ * @return
+ *   True (non-zero) if the key is in the set, false otherwise.
+ */
+int ds_list_contains(ds_list_t *l, stm_word_t key);
+int ds_skiplist_contains(ds_skiplist_t *l, stm_word_t key);
+int ds_rbtree_contains(ds_rbtree_t *t, stm_word_t key);
+int ds_hashset_contains(ds_hashset_t *h, stm_word_t key);
+//@}
+
+//@{
+/**
+ * Add a key to a set.
+ *
+ * @return
+ *   True (non-zero) if the key has been added, false if it was already
+ *   in the set.
+ */
+int ds_list_add(ds_list_t *l, stm_word_t key);
+int ds_skiplist_add(ds_skiplist_t *l, stm_word_t key);
+int ds_rbtree_add(ds_rbtree_t *t, stm_word_t key);
+int ds_hashset_add(ds_hashset_t *h, stm_word_t key);
+//@}
+
+//@{
+/**
+ * Remove a key from a set.
+ *
+ * @return
+ *   True (non-zero) if the key has been removed, false if it was not in
+ *   the set.
+ */
+int ds_list_remove(ds_list_t *l, stm_word_t key);
+int ds_skiplist_remove(ds_skiplist_t *l, stm_word_t key);
+int ds_rbtree_remove(ds_rbtree_t *t, stm_word_t key);
+int ds_hashset_remove(ds_hashset_t *h, stm_word_t key);
+//@}
+
+/**
+ * Append a value to the tail of a queue.
+ */
+void ds_queue_enqueue(ds_queue_t *q, stm_word_t val);
+
+//@{
+/**
+ * Remove (dequeue) or read (peek) the value at the head of a queue.
+ * Peeking uses a read-only transaction.
+ *
+ * @param val
+ *   Location where the value is stored (if not NULL).
+ * @return
+ *   True (non-zero) if the queue was not empty, false otherwise.
+ */
+int ds_queue_dequeue(ds_queue_t *q, stm_word_t *val);
+int ds_queue_peek(ds_queue_t *q, stm_word_t *val);
+//@}
+
+//@{
+/**
+ * Add a value at the front or back of a deque.
+ */
+void ds_deque_push_front(ds_deque_t *d, stm_word_t val);
+void ds_deque_push_back(ds_deque_t *d, stm_word_t val);
+//@}
+
+//@{
+/**
+ * Remove (pop) or read (peek) the value at the front or back of a
+ * deque.  Peeking uses a read-only transaction.
+ *
+ * @param val
+ *   Location where the value is stored (if not NULL).
+ * @return
+ *   True (non-zero) if the deque was not empty, false otherwise.
+ */
+int ds_deque_pop_front(ds_deque_t *d, stm_word_t *val);
+int ds_deque_pop_back(ds_deque_t *d, stm_word_t *val);
+int ds_deque_peek_front(ds_deque_t *d, stm_word_t *val);
+int ds_deque_peek_back(ds_deque_t *d, stm_word_t *val);
+//@}
+
+/**
+ * Insert a key in a priority queue.  Keys that are equal are removed
+ * in insertion order.
+ */
+void ds_pqueue_insert(ds_pqueue_t *q, stm_word_t key);
+
+//@{
+/**
+ * Remove or read (peek) the smallest key of a priority queue.  Peeking
+ * uses a read-only transaction.
+ *
+ * @param key
+ *   Location where the key is stored (if not NULL).
+ * @return
+ *   True (non-zero) if the priority queue was not empty, false
+ *   otherwise.
+ */
+int ds_pqueue_remove_min(ds_pqueue_t *q, stm_word_t *key);
+int ds_pqueue_peek_min(ds_pqueue_t *q, stm_word_t *key);
+//@}
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _STM_DS_H_ */
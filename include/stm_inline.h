@@ -0,0 +1,168 @@
+/*
+ * File:
+ *   stm_inline.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Inlinable fast path of STM barriers.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/**
+ * @file
+ *   Inlinable fast path of STM barriers.  This optional header defines
+ *   barriers that execute the common case of a transactional load
+ *   (unlocked data with a version in the validity range of the
+ *   transaction) inline in the application, and only call the library
+ *   for the other cases (conflicts, extension of the snapshot, growth
+ *   of the read set, contention management).  They operate on an
+ *   explicit transaction descriptor (see stm_current_tx()) and behave
+ *   exactly like their stm_xxx_tx() counterparts.
+ *
+ *   The fast path is used by update transactions with the WRITE_BACK_ETL
+ *   and WRITE_THROUGH designs (also as designs of DESIGN=MODULAR) while
+ *   they are not irrevocable, unless the library has been compiled with
+ *   options that modify the read path (e.g., CM_MODULAR, READ_SET_FILTER,
+ *   LOCK_REGIONS, TM_STATISTICS2).  In all other cases, the barriers
+ *   simply call the library, as they do when the library needs to run
+ *   periodic checks (e.g., when the GC asks the transaction to stop
+ *   holding back reclamation).  The header requires a compiler with GCC's
+ *   __atomic builtins.
+ * @author
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * @date
+ *   2007-2014
+ */
+
+#ifndef _STM_INLINE_H_
+# define _STM_INLINE_H_
+
+# include "stm.h"
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/* ################################################################### *
+ * TYPES
+ * ################################################################### */
+
+/**
+ * Number of low-order bits of a lock that do not store the version.
+ */
+# define STM_INLINE_LOCK_BITS           4
+/**
+ * Bit of a lock set while data is being written.
+ */
+# define STM_INLINE_WRITE_MASK          0x01
+
+/**
+ * Read set entry (same layout as in the library).
+ */
+struct stm_inline_entry {
+  stm_word_t version;                   /* Version read */
+  volatile stm_word_t *lock;            /* Pointer to lock */
+};
+
+/**
+ * Part of the transaction descriptor accessed by the fast path (same
+ * layout as in the library).  It is located at offset
+ * stm_inline_offset of the descriptor.
+ */
+struct stm_inline {
+  volatile stm_word_t *locks;           /* Array of locks (NULL if fast path disabled) */
+  stm_word_t shift;                     /* Shift of addresses to lock index */
+  stm_word_t mask;                      /* Mask of lock index */
+  const volatile stm_word_t *stop;      /* Set when the library must be called (e.g., GC pressure) */
+  stm_word_t end;                       /* End timestamp (validity range) */
+  struct stm_inline_entry *entries;     /* Read set entries */
+  unsigned int nb_entries;              /* Number of read set entries */
+  unsigned int size;                    /* Size of read set */
+};
+
+/**
+ * Offset of the fast path part in transaction descriptors (0 if the
+ * library does not support the fast path).
+ */
+extern const stm_word_t stm_inline_offset;
+
+/* ################################################################### *
+ * FUNCTIONS
+ * ################################################################### */
+
+/**
+ * Transactional load with inlined fast path.
+ *
+ * @param tx
+ *   Current transaction descriptor.
+ * @param addr
+ *   Address of the memory location.
+ * @return
+ *   Value read from the specified address.
+ */
+static inline stm_word_t stm_load_inline(struct stm_tx *tx, volatile stm_word_t *addr)
+{
+  struct stm_inline *f;
+  struct stm_inline_entry *r;
+  volatile stm_word_t *lock;
+  stm_word_t l, value;
+
+  if (__builtin_expect(stm_inline_offset != 0, 1)) {
+    f = (struct stm_inline *)((char *)tx + stm_inline_offset);
+    if (__builtin_expect(f->locks != NULL && f->nb_entries < f->size && *f->stop == 0, 1)) {
+      /* Read lock, value, lock */
+      lock = f->locks + (((stm_word_t)addr >> f->shift) & f->mask);
+      l = __atomic_load_n(lock, __ATOMIC_ACQUIRE);
+      if (__builtin_expect((l & STM_INLINE_WRITE_MASK) == 0 && (l >> STM_INLINE_LOCK_BITS) <= f->end, 1)) {
+        value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+        if (__builtin_expect(__atomic_load_n(lock, __ATOMIC_ACQUIRE) == l, 1)) {
+          /* Valid version: add to read set */
+          r = &f->entries[f->nb_entries++];
+          r->version = l >> STM_INLINE_LOCK_BITS;
+          r->lock = lock;
+          return value;
+        }
+      }
+    }
+  }
+  /* Slow path */
+  return stm_load_tx(tx, addr);
+}
+
+/**
+ * Transactional store (does not access thread-local storage).
+ *
+ * @param tx
+ *   Current transaction descriptor.
+ * @param addr
+ *   Address of the memory location.
+ * @param value
+ *   Value to be written.
+ */
+static inline void stm_store_inline(struct stm_tx *tx, volatile stm_word_t *addr, stm_word_t value)
+{
+  /* Stores acquire locks or maintain the write set: no fast path */
+  stm_store_tx(tx, addr, value);
+}
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* _STM_INLINE_H_ */
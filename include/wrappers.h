@@ -27,7 +27,9 @@
  * @file
  *   STM wrapper functions for different data types.  This library
  *   defines transactional loads/store functions for unsigned data types
- *   of various sizes and for basic C data types.
+ *   of various sizes and for basic C data types.  Each function has a
+ *   variant with an explicit transaction descriptor (suffix _tx) that
+ *   does not access thread-local storage.
  * @author
  *   Pascal Felber <pascal.felber@unine.ch>
  *   Patrick Marlier <patrick.marlier@unine.ch>
@@ -46,6 +48,7 @@
 extern "C" {
 # endif
 
+//@{
 /**
  * Transactional load of an unsigned 8-bit value.
  *
@@ -55,7 +58,10 @@ extern "C" {
  *   Value read from the specified address.
  */
 uint8_t stm_load_u8(volatile uint8_t *addr) _CALLCONV;
+uint8_t stm_load_u8_tx(struct stm_tx *tx, volatile uint8_t *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned 16-bit value.
  *
@@ -65,7 +71,10 @@ uint8_t stm_load_u8(volatile uint8_t *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 uint16_t stm_load_u16(volatile uint16_t *addr) _CALLCONV;
+uint16_t stm_load_u16_tx(struct stm_tx *tx, volatile uint16_t *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned 32-bit value.
  *
@@ -75,7 +84,10 @@ uint16_t stm_load_u16(volatile uint16_t *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 uint32_t stm_load_u32(volatile uint32_t *addr) _CALLCONV;
+uint32_t stm_load_u32_tx(struct stm_tx *tx, volatile uint32_t *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned 64-bit value.
  *
@@ -85,7 +97,10 @@ uint32_t stm_load_u32(volatile uint32_t *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 uint64_t stm_load_u64(volatile uint64_t *addr) _CALLCONV;
+uint64_t stm_load_u64_tx(struct stm_tx *tx, volatile uint64_t *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of a char value.
  *
@@ -95,7 +110,10 @@ uint64_t stm_load_u64(volatile uint64_t *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 char stm_load_char(volatile char *addr) _CALLCONV;
+char stm_load_char_tx(struct stm_tx *tx, volatile char *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned char value.
  *
@@ -105,7 +123,10 @@ char stm_load_char(volatile char *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 unsigned char stm_load_uchar(volatile unsigned char *addr) _CALLCONV;
+unsigned char stm_load_uchar_tx(struct stm_tx *tx, volatile unsigned char *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of a short value.
  *
@@ -115,7 +136,10 @@ unsigned char stm_load_uchar(volatile unsigned char *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 short stm_load_short(volatile short *addr) _CALLCONV;
+short stm_load_short_tx(struct stm_tx *tx, volatile short *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned short value.
  *
@@ -125,7 +149,10 @@ short stm_load_short(volatile short *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 unsigned short stm_load_ushort(volatile unsigned short *addr) _CALLCONV;
+unsigned short stm_load_ushort_tx(struct stm_tx *tx, volatile unsigned short *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an int value.
  *
@@ -135,7 +162,10 @@ unsigned short stm_load_ushort(volatile unsigned short *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 int stm_load_int(volatile int *addr) _CALLCONV;
+int stm_load_int_tx(struct stm_tx *tx, volatile int *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned int value.
  *
@@ -145,7 +175,10 @@ int stm_load_int(volatile int *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 unsigned int stm_load_uint(volatile unsigned int *addr) _CALLCONV;
+unsigned int stm_load_uint_tx(struct stm_tx *tx, volatile unsigned int *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of a long value.
  *
@@ -155,7 +188,10 @@ unsigned int stm_load_uint(volatile unsigned int *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 long stm_load_long(volatile long *addr) _CALLCONV;
+/* stm_load_long_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional load of an unsigned long value.
  *
@@ -165,7 +201,10 @@ long stm_load_long(volatile long *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 unsigned long stm_load_ulong(volatile unsigned long *addr) _CALLCONV;
+/* stm_load_ulong_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional load of a float value.
  *
@@ -175,7 +214,10 @@ unsigned long stm_load_ulong(volatile unsigned long *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 float stm_load_float(volatile float *addr) _CALLCONV;
+float stm_load_float_tx(struct stm_tx *tx, volatile float *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of a double value.
  *
@@ -185,7 +227,10 @@ float stm_load_float(volatile float *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 double stm_load_double(volatile double *addr) _CALLCONV;
+double stm_load_double_tx(struct stm_tx *tx, volatile double *addr) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional load of a pointer value.
  *
@@ -195,7 +240,10 @@ double stm_load_double(volatile double *addr) _CALLCONV;
  *   Value read from the specified address.
  */
 void *stm_load_ptr(volatile void **addr) _CALLCONV;
+/* stm_load_ptr_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional load of a memory region.  The address of the region
  * does not need to be word aligned and its size may be longer than a
@@ -210,7 +258,10 @@ void *stm_load_ptr(volatile void **addr) _CALLCONV;
  *   Number of bytes to read.
  */
 void stm_load_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCONV;
+void stm_load_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned 8-bit value.
  *
@@ -220,7 +271,10 @@ void stm_load_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCONV
  *   Value to be written.
  */
 void stm_store_u8(volatile uint8_t *addr, uint8_t value) _CALLCONV;
+void stm_store_u8_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned 16-bit value.
  *
@@ -230,7 +284,10 @@ void stm_store_u8(volatile uint8_t *addr, uint8_t value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_u16(volatile uint16_t *addr, uint16_t value) _CALLCONV;
+void stm_store_u16_tx(struct stm_tx *tx, volatile uint16_t *addr, uint16_t value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned 32-bit value.
  *
@@ -240,7 +297,10 @@ void stm_store_u16(volatile uint16_t *addr, uint16_t value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_u32(volatile uint32_t *addr, uint32_t value) _CALLCONV;
+void stm_store_u32_tx(struct stm_tx *tx, volatile uint32_t *addr, uint32_t value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned 64-bit value.
  *
@@ -250,7 +310,10 @@ void stm_store_u32(volatile uint32_t *addr, uint32_t value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_u64(volatile uint64_t *addr, uint64_t value) _CALLCONV;
+void stm_store_u64_tx(struct stm_tx *tx, volatile uint64_t *addr, uint64_t value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of a char value.
  *
@@ -260,7 +323,10 @@ void stm_store_u64(volatile uint64_t *addr, uint64_t value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_char(volatile char *addr, char value) _CALLCONV;
+void stm_store_char_tx(struct stm_tx *tx, volatile char *addr, char value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned char value.
  *
@@ -270,7 +336,10 @@ void stm_store_char(volatile char *addr, char value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_uchar(volatile unsigned char *addr, unsigned char value) _CALLCONV;
+void stm_store_uchar_tx(struct stm_tx *tx, volatile unsigned char *addr, unsigned char value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of a short value.
  *
@@ -280,7 +349,10 @@ void stm_store_uchar(volatile unsigned char *addr, unsigned char value) _CALLCON
  *   Value to be written.
  */
 void stm_store_short(volatile short *addr, short value) _CALLCONV;
+void stm_store_short_tx(struct stm_tx *tx, volatile short *addr, short value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned short value.
  *
@@ -290,7 +362,10 @@ void stm_store_short(volatile short *addr, short value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_ushort(volatile unsigned short *addr, unsigned short value) _CALLCONV;
+void stm_store_ushort_tx(struct stm_tx *tx, volatile unsigned short *addr, unsigned short value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an int value.
  *
@@ -300,7 +375,10 @@ void stm_store_ushort(volatile unsigned short *addr, unsigned short value) _CALL
  *   Value to be written.
  */
 void stm_store_int(volatile int *addr, int value) _CALLCONV;
+void stm_store_int_tx(struct stm_tx *tx, volatile int *addr, int value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned int value.
  *
@@ -310,7 +388,10 @@ void stm_store_int(volatile int *addr, int value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_uint(volatile unsigned int *addr, unsigned int value) _CALLCONV;
+void stm_store_uint_tx(struct stm_tx *tx, volatile unsigned int *addr, unsigned int value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of a long value.
  *
@@ -320,7 +401,10 @@ void stm_store_uint(volatile unsigned int *addr, unsigned int value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_long(volatile long *addr, long value) _CALLCONV;
+/* stm_store_long_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional store of an unsigned long value.
  *
@@ -330,7 +414,10 @@ void stm_store_long(volatile long *addr, long value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_ulong(volatile unsigned long *addr, unsigned long value) _CALLCONV;
+/* stm_store_ulong_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional store of a float value.
  *
@@ -340,7 +427,10 @@ void stm_store_ulong(volatile unsigned long *addr, unsigned long value) _CALLCON
  *   Value to be written.
  */
 void stm_store_float(volatile float *addr, float value) _CALLCONV;
+void stm_store_float_tx(struct stm_tx *tx, volatile float *addr, float value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of a double value.
  *
@@ -350,7 +440,10 @@ void stm_store_float(volatile float *addr, float value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_double(volatile double *addr, double value) _CALLCONV;
+void stm_store_double_tx(struct stm_tx *tx, volatile double *addr, double value) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional store of a pointer value.
  *
@@ -360,7 +453,10 @@ void stm_store_double(volatile double *addr, double value) _CALLCONV;
  *   Value to be written.
  */
 void stm_store_ptr(volatile void **addr, void *value) _CALLCONV;
+/* stm_store_ptr_tx() is defined inline below */
+//@}
 
+//@{
 /**
  * Transactional store of a memory region.  The address of the region
  * does not need to be word aligned and its size may be longer than a
@@ -374,7 +470,10 @@ void stm_store_ptr(volatile void **addr, void *value) _CALLCONV;
  *   Number of bytes to write.
  */
 void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCONV;
+void stm_store_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCONV;
+//@}
 
+//@{
 /**
  * Transactional write of a byte to a memory region.  The address of the
  * region does not need to be word aligned and its size may be longer
@@ -389,6 +488,84 @@ void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size) _CALLCON
  *   Number of bytes to write.
  */
 void stm_set_bytes(volatile uint8_t *addr, uint8_t byte, size_t count) _CALLCONV;
+void stm_set_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t byte, size_t count) _CALLCONV;
+//@}
+
+//@{
+/**
+ * Transactional copy of a memory region to another (possibly
+ * overlapping) memory region.  The addresses of the regions do not need
+ * to be word aligned.  The bytes are copied through a small buffer
+ * using the range barriers, hence large regions do not require large
+ * temporary buffers.
+ *
+ * @param dst
+ *   Address of the destination memory region.
+ * @param src
+ *   Address of the source memory region.
+ * @param size
+ *   Number of bytes to copy.
+ */
+void stm_move_bytes(volatile uint8_t *dst, volatile uint8_t *src, size_t size) _CALLCONV;
+void stm_move_bytes_tx(struct stm_tx *tx, volatile uint8_t *dst, volatile uint8_t *src, size_t size) _CALLCONV;
+//@}
+
+/*
+ * Word-sized accessors with an explicit descriptor are defined inline:
+ * aligned accesses then directly call the word barriers.  Long integers
+ * and pointers have the size of words on all supported platforms.
+ */
+# ifdef __GNUC__
+#  define _STM_WRAPPERS_INLINE          static __inline__
+# else /* ! __GNUC__ */
+#  define _STM_WRAPPERS_INLINE          static
+# endif /* ! __GNUC__ */
+
+# define _STM_WORD_ALIGNED(addr)        (((uintptr_t)(addr) & (sizeof(stm_word_t) - 1)) == 0)
+
+_STM_WRAPPERS_INLINE long stm_load_long_tx(struct stm_tx *tx, volatile long *addr)
+{
+  union { stm_word_t w; long l; } val;
+  if (_STM_WORD_ALIGNED(addr))
+    val.w = stm_load_tx(tx, (volatile stm_word_t *)addr);
+  else
+    stm_load_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&val.l, sizeof(long));
+  return val.l;
+}
+
+_STM_WRAPPERS_INLINE unsigned long stm_load_ulong_tx(struct stm_tx *tx, volatile unsigned long *addr)
+{
+  return (unsigned long)stm_load_long_tx(tx, (volatile long *)addr);
+}
+
+_STM_WRAPPERS_INLINE void *stm_load_ptr_tx(struct stm_tx *tx, volatile void **addr)
+{
+  union { stm_word_t w; void *v; } val;
+  val.w = stm_load_tx(tx, (volatile stm_word_t *)addr);
+  return val.v;
+}
+
+_STM_WRAPPERS_INLINE void stm_store_long_tx(struct stm_tx *tx, volatile long *addr, long value)
+{
+  union { stm_word_t w; long l; } val;
+  val.l = value;
+  if (_STM_WORD_ALIGNED(addr))
+    stm_store_tx(tx, (volatile stm_word_t *)addr, val.w);
+  else
+    stm_store_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&val.l, sizeof(long));
+}
+
+_STM_WRAPPERS_INLINE void stm_store_ulong_tx(struct stm_tx *tx, volatile unsigned long *addr, unsigned long value)
+{
+  stm_store_long_tx(tx, (volatile long *)addr, (long)value);
+}
+
+_STM_WRAPPERS_INLINE void stm_store_ptr_tx(struct stm_tx *tx, volatile void **addr, void *value)
+{
+  union { stm_word_t w; void *v; } val;
+  val.v = value;
+  stm_store_tx(tx, (volatile stm_word_t *)addr, val.w);
+}
 
 # ifdef __cplusplus
 }
@@ -43,6 +43,7 @@ typedef volatile size_t atomic_t;
    C11 and C++11 also propose atomic operations.
 */
 #   define ATOMIC_CAS_FULL(a, e, v)      (__sync_bool_compare_and_swap(a, e, v))
+#   define ATOMIC_CAS_ACQ_REL(a, e, v)   (__sync_bool_compare_and_swap(a, e, v))
 #   define ATOMIC_FETCH_INC_FULL(a)      (__sync_fetch_and_add(a, 1))
 #   define ATOMIC_FETCH_DEC_FULL(a)      (__sync_fetch_and_add(a, -1))
 #   define ATOMIC_FETCH_ADD_FULL(a, v)   (__sync_fetch_and_add(a, v))
@@ -56,6 +57,7 @@ typedef volatile size_t atomic_t;
 #  else
 /* Use only for testing purposes (single thread benchmarks) */
 #   define ATOMIC_CAS_FULL(a, e, v)      (*(a) = (v), 1)
+#   define ATOMIC_CAS_ACQ_REL(a, e, v)   (*(a) = (v), 1)
 #   define ATOMIC_FETCH_INC_FULL(a)      ((*(a))++)
 #   define ATOMIC_FETCH_DEC_FULL(a)      ((*(a))--)
 #   define ATOMIC_FETCH_ADD_FULL(a, v)   ((*(a)) += (v))
@@ -68,13 +70,65 @@ typedef volatile size_t atomic_t;
 #   define ATOMIC_MB_FULL                /* Nothing */
 #  endif /* UNSAFE */
 
-# else /* ! ATOMIC_BUILTIN */
+# elif defined(ATOMIC_C11)
+/*
+ * C11 atomics: each operation states the ordering it needs, so that the
+ * compiler can choose the weakest instructions for the target and merge
+ * fences.  Words are accessed as _Atomic size_t, which has the same size
+ * and representation as size_t with GCC and clang.
+ */
+#  include <stdatomic.h>
+typedef size_t atomic_t;
+#  define ATOMIC_C11_PTR(a)             ((volatile _Atomic size_t *)(a))
+/*
+ * Full operations must also order the relaxed accesses that follow them
+ * (e.g., lock acquisitions before the irrevocability check upon commit),
+ * which seq_cst read-modify-writes only do where they are full barriers.
+ */
+#  if defined(__x86_64__) || defined(__i386__) || defined(__ARM_FEATURE_ATOMICS)
+#   define ATOMIC_C11_RMW_FENCE         ATOMIC_CB
+#  else
+#   define ATOMIC_C11_RMW_FENCE         atomic_thread_fence(memory_order_seq_cst)
+#  endif
+#  define ATOMIC_C11_CAS(a, e, v, s, f) \
+  ({ size_t _atomic_e = (size_t)(e); \
+     atomic_compare_exchange_strong_explicit(ATOMIC_C11_PTR(a), &_atomic_e, (size_t)(v), s, f); })
+#  define ATOMIC_C11_FULL(op) \
+  ({ __typeof__(op) _atomic_r = (op); ATOMIC_C11_RMW_FENCE; _atomic_r; })
+#  define ATOMIC_CB                     atomic_signal_fence(memory_order_seq_cst)
+#  define ATOMIC_CAS_FULL(a, e, v)      (ATOMIC_C11_FULL(ATOMIC_C11_CAS(a, e, v, memory_order_seq_cst, memory_order_seq_cst)))
+#  define ATOMIC_CAS_ACQ_REL(a, e, v)   (ATOMIC_C11_CAS(a, e, v, memory_order_acq_rel, memory_order_acquire))
+#  define ATOMIC_FETCH_INC_FULL(a)      (ATOMIC_C11_FULL(atomic_fetch_add_explicit(ATOMIC_C11_PTR(a), 1, memory_order_seq_cst)))
+#  define ATOMIC_FETCH_DEC_FULL(a)      (ATOMIC_C11_FULL(atomic_fetch_sub_explicit(ATOMIC_C11_PTR(a), 1, memory_order_seq_cst)))
+#  define ATOMIC_FETCH_ADD_FULL(a, v)   (ATOMIC_C11_FULL(atomic_fetch_add_explicit(ATOMIC_C11_PTR(a), (size_t)(v), memory_order_seq_cst)))
+#  ifdef SAFE
+#   define ATOMIC_LOAD_ACQ(a)           (atomic_load_explicit(ATOMIC_C11_PTR(a), memory_order_seq_cst))
+#   define ATOMIC_LOAD(a)               (atomic_load_explicit(ATOMIC_C11_PTR(a), memory_order_seq_cst))
+#   define ATOMIC_STORE_REL(a, v)       (atomic_store_explicit(ATOMIC_C11_PTR(a), (size_t)(v), memory_order_seq_cst))
+#   define ATOMIC_STORE(a, v)           (atomic_store_explicit(ATOMIC_C11_PTR(a), (size_t)(v), memory_order_seq_cst))
+#   define ATOMIC_MB_READ               atomic_thread_fence(memory_order_seq_cst)
+#   define ATOMIC_MB_WRITE              atomic_thread_fence(memory_order_seq_cst)
+#   define ATOMIC_MB_FULL               atomic_thread_fence(memory_order_seq_cst)
+#  else /* ! SAFE */
+#   define ATOMIC_LOAD_ACQ(a)           (atomic_load_explicit(ATOMIC_C11_PTR(a), memory_order_acquire))
+#   define ATOMIC_LOAD(a)               (atomic_load_explicit(ATOMIC_C11_PTR(a), memory_order_relaxed))
+#   define ATOMIC_STORE_REL(a, v)       (atomic_store_explicit(ATOMIC_C11_PTR(a), (size_t)(v), memory_order_release))
+#   define ATOMIC_STORE(a, v)           (atomic_store_explicit(ATOMIC_C11_PTR(a), (size_t)(v), memory_order_relaxed))
+/* Acquire and release fences also order loads and stores, respectively */
+#   define ATOMIC_MB_READ               atomic_thread_fence(memory_order_acquire)
+#   define ATOMIC_MB_WRITE              atomic_thread_fence(memory_order_release)
+#   define ATOMIC_MB_FULL               atomic_thread_fence(memory_order_seq_cst)
+#  endif /* ! SAFE */
+
+# else /* ! ATOMIC_BUILTIN && ! ATOMIC_C11 */
 /* NOTE: enable fence instructions for i386 and amd64 but the mfence instructions seems costly. */
 /* # define AO_USE_PENTIUM4_INSTRS */
 #  include <atomic_ops.h>
 typedef AO_t atomic_t;
 #  define ATOMIC_CB                     AO_compiler_barrier()
 #  define ATOMIC_CAS_FULL(a, e, v)      (AO_compare_and_swap_full((volatile AO_t *)(a), (AO_t)(e), (AO_t)(v)))
+/* libatomic_ops has no acquire-release variant */
+#  define ATOMIC_CAS_ACQ_REL(a, e, v)   (AO_compare_and_swap_full((volatile AO_t *)(a), (AO_t)(e), (AO_t)(v)))
 #  define ATOMIC_FETCH_INC_FULL(a)      (AO_fetch_and_add1_full((volatile AO_t *)(a)))
 #  define ATOMIC_FETCH_DEC_FULL(a)      (AO_fetch_and_sub1_full((volatile AO_t *)(a)))
 #  define ATOMIC_FETCH_ADD_FULL(a, v)   (AO_fetch_and_add_full((volatile AO_t *)(a), (AO_t)(v)))
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 1991-1994 by Xerox Corporation.  All rights reserved.
+ * Copyright (c) 1996-1999 by Silicon Graphics.  All rights reserved.
+ * Copyright (c) 1999-2003 by Hewlett-Packard Company. All rights reserved.
+ *
+ *
+ * THIS MATERIAL IS PROVIDED AS IS, WITH ABSOLUTELY NO WARRANTY EXPRESSED
+ * OR IMPLIED.  ANY USE IS AT YOUR OWN RISK.
+ *
+ * Permission is hereby granted to use or copy this program
+ * for any purpose,  provided the above notices are retained on all copies.
+ * Permission to modify the code and to distribute modified code is granted,
+ * provided the above notices are retained, and a notice that the code was
+ * modified is included with the above copyright notice.
+ *
+ * Modified for TinySTM: AArch64 support.
+ */
+
+/* ARMv8 is weakly ordered, but it has load-acquire (ldar), store-      */
+/* release (stlr) and one-way barriers (dmb ishld, dmb ishst), so that  */
+/* none of the acquire/release operations below needs a full barrier.   */
+/* Read-modify-write operations use the ARMv8.1 LSE instructions (cas,  */
+/* ldadd) when available, which do not retry under contention, and      */
+/* exclusive load/store loops (ldxr/stxr) otherwise.  LSE is used       */
+/* unconditionally if the compiler targets it (e.g., -march=armv8.1-a   */
+/* or -mcpu=neoverse-n1) and detected at load time on Linux otherwise.  */
+/* Define AO_AARCH64_NO_LSE to always use exclusive loops.              */
+/* Fully ordered operations follow the Linux kernel: the "al" forms of  */
+/* LSE instructions are full barriers, exclusive loops need a trailing  */
+/* "dmb ish".  A failed "casal" does not store, hence it is only an     */
+/* acquire: fully ordered compare-and-swap adds "dmb ish" upon failure. */
+
+#include "./aligned_atomic_load_store.h"
+
+#include "./test_and_set_t_is_ao_t.h"
+
+#if defined(AO_AARCH64_NO_LSE)
+# define AO_AARCH64_LSE 0
+#elif defined(__ARM_FEATURE_ATOMICS)
+# define AO_AARCH64_LSE 1
+#elif defined(__linux__)
+# include <sys/auxv.h>
+# ifndef HWCAP_ATOMICS
+#   define HWCAP_ATOMICS (1 << 8)
+# endif
+/* Exclusive loops are used until the constructor has run.              */
+static int AO_aarch64_lse;
+
+static void __attribute__((constructor))
+AO_aarch64_init_lse(void)
+{
+  AO_aarch64_lse = (getauxval(AT_HWCAP) & HWCAP_ATOMICS) != 0;
+}
+
+# define AO_AARCH64_LSE AO_aarch64_lse
+#else
+# define AO_AARCH64_LSE 0
+#endif
+
+/* Let the assembler accept LSE instructions without -march flags.      */
+#define AO_AARCH64_LSE_ASM ".arch_extension lse\n"
+
+AO_INLINE void
+AO_nop_full(void)
+{
+  __asm__ __volatile__("dmb ish" : : : "memory");
+}
+
+#define AO_HAVE_nop_full
+
+AO_INLINE void
+AO_nop_read(void)
+{
+  __asm__ __volatile__("dmb ishld" : : : "memory");
+}
+
+#define AO_HAVE_nop_read
+
+AO_INLINE void
+AO_nop_write(void)
+{
+  __asm__ __volatile__("dmb ishst" : : : "memory");
+}
+
+#define AO_HAVE_nop_write
+
+/* ldapr (ARMv8.3 RCpc) is not ordered after earlier stlr, which the    */
+/* acquire semantics do not require either.                             */
+AO_INLINE AO_t
+AO_load_acquire(const volatile AO_t *addr)
+{
+  AO_t result;
+
+#ifdef __ARM_FEATURE_RCPC
+  __asm__ __volatile__("ldapr %0, %1" : "=r" (result) : "Q" (*addr) : "memory");
+#else
+  __asm__ __volatile__("ldar %0, %1" : "=r" (result) : "Q" (*addr) : "memory");
+#endif
+  return result;
+}
+
+#define AO_HAVE_load_acquire
+
+AO_INLINE void
+AO_store_release(volatile AO_t *addr, AO_t value)
+{
+  __asm__ __volatile__("stlr %1, %0" : "=Q" (*addr) : "r" (value) : "memory");
+}
+
+#define AO_HAVE_store_release
+
+/* Compare-and-swap: LDX/STX are the exclusive load and store, possibly */
+/* with acquire (ldaxr) or release (stlxr) semantics, and BAR is either */
+/* empty or the trailing barrier of fully ordered operations (also      */
+/* needed after a failed LSE instruction).                              */
+#define AO_AARCH64_CAS(LSE, LDX, STX, BAR) \
+  AO_t tmp; \
+  unsigned int status; \
+  \
+  if (AO_AARCH64_LSE) { \
+    tmp = old; \
+    __asm__ __volatile__(AO_AARCH64_LSE_ASM \
+                         LSE " %0, %2, %1" \
+                         : "+r" (tmp), "+Q" (*addr) \
+                         : "r" (new_val) : "memory"); \
+    if (sizeof(BAR) > 1 && tmp != old) \
+      __asm__ __volatile__(BAR : : : "memory"); \
+  } else { \
+    __asm__ __volatile__("1: " LDX " %0, %2\n" \
+                         "cmp %0, %3\n" \
+                         "b.ne 2f\n" \
+                         STX " %w1, %4, %2\n" \
+                         "cbnz %w1, 1b\n" \
+                         "2: " BAR \
+                         : "=&r" (tmp), "=&r" (status), "+Q" (*addr) \
+                         : "r" (old), "r" (new_val) : "cc", "memory"); \
+  } \
+  return tmp == old
+
+/* Returns nonzero if the comparison succeeded. */
+AO_INLINE int
+AO_compare_and_swap(volatile AO_t *addr, AO_t old, AO_t new_val)
+{
+  AO_AARCH64_CAS("cas", "ldxr", "stxr", "");
+}
+
+#define AO_HAVE_compare_and_swap
+
+AO_INLINE int
+AO_compare_and_swap_acquire(volatile AO_t *addr, AO_t old, AO_t new_val)
+{
+  AO_AARCH64_CAS("casa", "ldaxr", "stxr", "");
+}
+
+#define AO_HAVE_compare_and_swap_acquire
+
+AO_INLINE int
+AO_compare_and_swap_release(volatile AO_t *addr, AO_t old, AO_t new_val)
+{
+  AO_AARCH64_CAS("casl", "ldxr", "stlxr", "");
+}
+
+#define AO_HAVE_compare_and_swap_release
+
+/* A failed compare-and-swap is also fully ordered, as on x86 (the      */
+/* exclusive loop branches to the barrier).                             */
+AO_INLINE int
+AO_compare_and_swap_full(volatile AO_t *addr, AO_t old, AO_t new_val)
+{
+  AO_AARCH64_CAS("casal", "ldxr", "stlxr", "dmb ish");
+}
+
+#define AO_HAVE_compare_and_swap_full
+
+/* Fetch-and-add, with the same parameters as AO_AARCH64_CAS.           */
+#define AO_AARCH64_FETCH_AND_ADD(LSE, LDX, STX, BAR) \
+  AO_t result, tmp; \
+  unsigned int status; \
+  \
+  if (AO_AARCH64_LSE) { \
+    __asm__ __volatile__(AO_AARCH64_LSE_ASM \
+                         LSE " %2, %0, %1" \
+                         : "=r" (result), "+Q" (*addr) \
+                         : "r" (incr) : "memory"); \
+  } else { \
+    __asm__ __volatile__("1: " LDX " %0, %3\n" \
+                         "add %1, %0, %4\n" \
+                         STX " %w2, %1, %3\n" \
+                         "cbnz %w2, 1b\n" \
+                         BAR \
+                         : "=&r" (result), "=&r" (tmp), "=&r" (status), \
+                           "+Q" (*addr) \
+                         : "r" (incr) : "memory"); \
+  } \
+  return result
+
+AO_INLINE AO_t
+AO_fetch_and_add(volatile AO_t *addr, AO_t incr)
+{
+  AO_AARCH64_FETCH_AND_ADD("ldadd", "ldxr", "stxr", "");
+}
+
+#define AO_HAVE_fetch_and_add
+
+AO_INLINE AO_t
+AO_fetch_and_add_acquire(volatile AO_t *addr, AO_t incr)
+{
+  AO_AARCH64_FETCH_AND_ADD("ldadda", "ldaxr", "stxr", "");
+}
+
+#define AO_HAVE_fetch_and_add_acquire
+
+AO_INLINE AO_t
+AO_fetch_and_add_release(volatile AO_t *addr, AO_t incr)
+{
+  AO_AARCH64_FETCH_AND_ADD("ldaddl", "ldxr", "stlxr", "");
+}
+
+#define AO_HAVE_fetch_and_add_release
+
+AO_INLINE AO_t
+AO_fetch_and_add_full(volatile AO_t *addr, AO_t incr)
+{
+  AO_AARCH64_FETCH_AND_ADD("ldaddal", "ldxr", "stlxr", "dmb ish");
+}
+
+#define AO_HAVE_fetch_and_add_full
+
+#undef AO_AARCH64_CAS
+#undef AO_AARCH64_FETCH_AND_ADD
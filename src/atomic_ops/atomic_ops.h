@@ -238,6 +238,9 @@
      || defined(__powerpc64__) || defined(__ppc64__)
 #   include "./powerpc.h"
 # endif /* __powerpc__ */
+# if defined(__aarch64__)
+#   include "./aarch64.h"
+# endif /* __aarch64__ */
 # if defined(__arm__) && !defined(AO_USE_PTHREAD_DEFS)
 #   include "atomic_ops/sysdeps/gcc/arm.h"
 #   define AO_CAN_EMUL_CAS
@@ -0,0 +1,92 @@
+/*
+ * File:
+ *   ds_internal.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Internal definitions of the library of transactional data structures.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _DS_INTERNAL_H_
+#define _DS_INTERNAL_H_
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stm.h"
+#include "mod_mem.h"
+#include "stm_ds.h"
+
+#include "utils.h"
+
+/*
+ * Operations run in a transaction of the calling thread and become part
+ * of the enclosing transaction if there is one (stm_start() then returns
+ * NULL and aborts restart the enclosing transaction).  Local variables
+ * must be (re)initialized after DS_START since it may be returned to
+ * upon abort.
+ */
+#define DS_START(tx, ro)                { stm_tx_attr_t _a = {{.read_only = ro}}; \
+                                          sigjmp_buf *_e; \
+                                          tx = stm_current_tx(); \
+                                          if ((_e = stm_start_tx(tx, _a)) != NULL) \
+                                            sigsetjmp(*_e, 0);
+#define DS_COMMIT(tx)                   stm_commit_tx(tx); }
+
+#define DS_LOAD(tx, addr)               stm_load_tx(tx, (volatile stm_word_t *)(addr))
+#define DS_LOAD_PTR(tx, addr)           ((void *)DS_LOAD(tx, addr))
+#define DS_STORE(tx, addr, val)         stm_store_tx(tx, (volatile stm_word_t *)(addr), (stm_word_t)(val))
+
+/* Nodes do not share stripes and are freed upon abort */
+#define DS_ALLOC(tx, size)              stm_malloc_aligned_tx(tx, size)
+#define DS_FREE(tx, addr, size)         stm_free_tx(tx, addr, size)
+
+/*
+ * Thread-local pseudo-random number (xorshift), used for levels of skip
+ * list nodes.
+ */
+static INLINE stm_word_t
+ds_random(struct stm_tx *tx)
+{
+  static __thread stm_word_t seed;
+  stm_word_t x;
+
+  if ((x = seed) == 0)
+    x = (stm_word_t)tx | 1;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return (seed = x);
+}
+
+/*
+ * Stripe size of the lock array (at least one word).
+ */
+static INLINE size_t
+ds_stripe(void)
+{
+  unsigned long stripe;
+
+  if (!stm_get_parameter("stripe_size", &stripe) || stripe < sizeof(stm_word_t))
+    stripe = sizeof(stm_word_t);
+  return (size_t)stripe;
+}
+
+#endif /* _DS_INTERNAL_H_ */
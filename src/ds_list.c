@@ -0,0 +1,303 @@
+/*
+ * File:
+ *   ds_list.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Transactional sorted linked list and hash set.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include "ds_internal.h"
+
+/* ################################################################### *
+ * SORTED LINKED LIST
+ * ################################################################### */
+
+/* Key and link are read together and fit in one stripe */
+typedef struct ds_lnode {
+  stm_word_t key;
+  struct ds_lnode *next;
+} ds_lnode_t;
+
+struct ds_list {
+  ds_lnode_t *head;
+};
+
+/*
+ * Find the first node with a key not smaller than the given one, as well
+ * as the link pointing to it.  The hash set uses the same functions on
+ * its buckets.
+ */
+static INLINE ds_lnode_t *
+ds_lnode_find(struct stm_tx *tx, ds_lnode_t **head, stm_word_t key, ds_lnode_t ***link, int *found)
+{
+  ds_lnode_t *node;
+  stm_word_t k;
+
+  *found = 0;
+  while ((node = (ds_lnode_t *)DS_LOAD_PTR(tx, head)) != NULL) {
+    if ((k = DS_LOAD(tx, &node->key)) >= key) {
+      *found = (k == key);
+      break;
+    }
+    head = &node->next;
+  }
+  *link = head;
+  return node;
+}
+
+static INLINE int
+ds_lnode_contains(struct stm_tx *tx, ds_lnode_t **head, stm_word_t key)
+{
+  ds_lnode_t **link;
+  int found;
+
+  ds_lnode_find(tx, head, key, &link, &found);
+  return found;
+}
+
+static INLINE int
+ds_lnode_add(struct stm_tx *tx, ds_lnode_t **head, stm_word_t key)
+{
+  ds_lnode_t **link, *next, *node;
+  int found;
+
+  next = ds_lnode_find(tx, head, key, &link, &found);
+  if (found)
+    return 0;
+  /* Node is private until linked */
+  node = (ds_lnode_t *)DS_ALLOC(tx, sizeof(ds_lnode_t));
+  node->key = key;
+  node->next = next;
+  DS_STORE(tx, link, node);
+  return 1;
+}
+
+static INLINE int
+ds_lnode_remove(struct stm_tx *tx, ds_lnode_t **head, stm_word_t key)
+{
+  ds_lnode_t **link, *node;
+  int found;
+
+  node = ds_lnode_find(tx, head, key, &link, &found);
+  if (!found)
+    return 0;
+  DS_STORE(tx, link, DS_LOAD(tx, &node->next));
+  DS_FREE(tx, node, sizeof(ds_lnode_t));
+  return 1;
+}
+
+static INLINE size_t
+ds_lnode_size(struct stm_tx *tx, ds_lnode_t **head)
+{
+  ds_lnode_t *node;
+  size_t size;
+
+  size = 0;
+  for (node = (ds_lnode_t *)DS_LOAD_PTR(tx, head); node != NULL; node = (ds_lnode_t *)DS_LOAD_PTR(tx, &node->next))
+    size++;
+  return size;
+}
+
+static INLINE void
+ds_lnode_free(ds_lnode_t *node)
+{
+  ds_lnode_t *next;
+
+  for (; node != NULL; node = next) {
+    next = node->next;
+    mod_mem_free(node);
+  }
+}
+
+ds_list_t *ds_list_new(void)
+{
+  ds_list_t *l;
+
+  /* Avoid sharing the stripe of the head with unrelated data */
+  l = (ds_list_t *)xmalloc_aligned(CACHELINE_SIZE);
+  l->head = NULL;
+  return l;
+}
+
+void ds_list_delete(ds_list_t *l)
+{
+  ds_lnode_free(l->head);
+  xfree(l);
+}
+
+size_t ds_list_size(ds_list_t *l)
+{
+  struct stm_tx *tx;
+  size_t size;
+
+  DS_START(tx, 1);
+  size = ds_lnode_size(tx, &l->head);
+  DS_COMMIT(tx);
+  return size;
+}
+
+int ds_list_contains(ds_list_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 1);
+  ret = ds_lnode_contains(tx, &l->head, key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_list_add(ds_list_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = ds_lnode_add(tx, &l->head, key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_list_remove(ds_list_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = ds_lnode_remove(tx, &l->head, key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+/* ################################################################### *
+ * HASH SET
+ * ################################################################### */
+
+struct ds_hashset {
+  ds_lnode_t **buckets;
+  stm_word_t mask;                      /* Number of buckets - 1 */
+  size_t stride;                        /* Words between bucket heads */
+};
+
+/* Bucket heads are padded to a stripe to avoid false conflicts */
+#define DS_BUCKET(h, key)               (&(h)->buckets[(ds_hash(key) & (h)->mask) * (h)->stride])
+
+static INLINE stm_word_t
+ds_hash(stm_word_t key)
+{
+  /* Thomas Wang's integer hash (64 bits) or Robert Jenkins' (32 bits) */
+  if (sizeof(stm_word_t) == 8) {
+    uint64_t k = (uint64_t)key;
+    k = (~k) + (k << 21);
+    k = k ^ (k >> 24);
+    k = (k + (k << 3)) + (k << 8);
+    k = k ^ (k >> 14);
+    k = (k + (k << 2)) + (k << 4);
+    k = k ^ (k >> 28);
+    k = k + (k << 31);
+    return (stm_word_t)k;
+  } else {
+    uint32_t k = (uint32_t)key;
+    k = (k + 0x7ed55d16) + (k << 12);
+    k = (k ^ 0xc761c23c) ^ (k >> 19);
+    k = (k + 0x165667b1) + (k << 5);
+    k = (k + 0xd3a2646c) ^ (k << 9);
+    k = (k + 0xfd7046c5) + (k << 3);
+    k = (k ^ 0xb55a4f09) ^ (k >> 16);
+    return (stm_word_t)k;
+  }
+}
+
+ds_hashset_t *ds_hashset_new(size_t nb_buckets)
+{
+  ds_hashset_t *h;
+  size_t n, stride;
+
+  for (n = 1; n < nb_buckets; n <<= 1)
+    ;
+  /* Larger stripes would waste too much memory */
+  stride = ds_stripe();
+  if (stride > CACHELINE_SIZE)
+    stride = CACHELINE_SIZE;
+  stride /= sizeof(ds_lnode_t *);
+  h = (ds_hashset_t *)xmalloc_aligned(sizeof(ds_hashset_t));
+  h->buckets = (ds_lnode_t **)xmalloc_aligned(n * stride * sizeof(ds_lnode_t *));
+  h->mask = n - 1;
+  h->stride = stride;
+  for (n = 0; n <= h->mask; n++)
+    h->buckets[n * stride] = NULL;
+  return h;
+}
+
+void ds_hashset_delete(ds_hashset_t *h)
+{
+  size_t i;
+
+  for (i = 0; i <= h->mask; i++)
+    ds_lnode_free(h->buckets[i * h->stride]);
+  xfree(h->buckets);
+  xfree(h);
+}
+
+size_t ds_hashset_size(ds_hashset_t *h)
+{
+  struct stm_tx *tx;
+  size_t i, size;
+
+  DS_START(tx, 1);
+  size = 0;
+  for (i = 0; i <= h->mask; i++)
+    size += ds_lnode_size(tx, &h->buckets[i * h->stride]);
+  DS_COMMIT(tx);
+  return size;
+}
+
+int ds_hashset_contains(ds_hashset_t *h, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 1);
+  ret = ds_lnode_contains(tx, DS_BUCKET(h, key), key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_hashset_add(ds_hashset_t *h, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = ds_lnode_add(tx, DS_BUCKET(h, key), key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_hashset_remove(ds_hashset_t *h, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = ds_lnode_remove(tx, DS_BUCKET(h, key), key);
+  DS_COMMIT(tx);
+  return ret;
+}
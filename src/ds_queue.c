@@ -0,0 +1,291 @@
+/*
+ * File:
+ *   ds_queue.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Transactional FIFO queue and double-ended queue.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include "ds_internal.h"
+
+/*
+ * Both ends are in different cache lines (hence stripes, unless locks
+ * cover more than a cache line) so that operations at one end do not
+ * conflict with operations at the other end, unless the structure has
+ * at most one element.  No element count is maintained for the same
+ * reason.
+ */
+
+typedef struct ds_end {
+  void *node;
+  char padding[CACHELINE_SIZE - sizeof(void *)];
+} ds_end_t;
+
+/* ################################################################### *
+ * FIFO QUEUE
+ * ################################################################### */
+
+typedef struct ds_qnode {
+  stm_word_t val;
+  struct ds_qnode *next;
+} ds_qnode_t;
+
+struct ds_queue {
+  ds_end_t head;
+  ds_end_t tail;
+};
+
+ds_queue_t *ds_queue_new(void)
+{
+  ds_queue_t *q;
+
+  q = (ds_queue_t *)xmalloc_aligned(sizeof(ds_queue_t));
+  q->head.node = q->tail.node = NULL;
+  return q;
+}
+
+void ds_queue_delete(ds_queue_t *q)
+{
+  ds_qnode_t *node, *next;
+
+  for (node = (ds_qnode_t *)q->head.node; node != NULL; node = next) {
+    next = node->next;
+    mod_mem_free(node);
+  }
+  xfree(q);
+}
+
+size_t ds_queue_size(ds_queue_t *q)
+{
+  struct stm_tx *tx;
+  ds_qnode_t *node;
+  size_t size;
+
+  DS_START(tx, 1);
+  size = 0;
+  for (node = (ds_qnode_t *)DS_LOAD_PTR(tx, &q->head.node); node != NULL; node = (ds_qnode_t *)DS_LOAD_PTR(tx, &node->next))
+    size++;
+  DS_COMMIT(tx);
+  return size;
+}
+
+void ds_queue_enqueue(ds_queue_t *q, stm_word_t val)
+{
+  struct stm_tx *tx;
+  ds_qnode_t *node, *tail;
+
+  DS_START(tx, 0);
+  /* Node is private until linked */
+  node = (ds_qnode_t *)DS_ALLOC(tx, sizeof(ds_qnode_t));
+  node->val = val;
+  node->next = NULL;
+  if ((tail = (ds_qnode_t *)DS_LOAD_PTR(tx, &q->tail.node)) == NULL)
+    DS_STORE(tx, &q->head.node, node);
+  else
+    DS_STORE(tx, &tail->next, node);
+  DS_STORE(tx, &q->tail.node, node);
+  DS_COMMIT(tx);
+}
+
+int ds_queue_dequeue(ds_queue_t *q, stm_word_t *val)
+{
+  struct stm_tx *tx;
+  ds_qnode_t *node, *next;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = 0;
+  if ((node = (ds_qnode_t *)DS_LOAD_PTR(tx, &q->head.node)) != NULL) {
+    if (val != NULL)
+      *val = DS_LOAD(tx, &node->val);
+    next = (ds_qnode_t *)DS_LOAD_PTR(tx, &node->next);
+    DS_STORE(tx, &q->head.node, next);
+    /* Tail is only accessed when the queue becomes empty */
+    if (next == NULL)
+      DS_STORE(tx, &q->tail.node, NULL);
+    DS_FREE(tx, node, sizeof(ds_qnode_t));
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_queue_peek(ds_queue_t *q, stm_word_t *val)
+{
+  struct stm_tx *tx;
+  ds_qnode_t *node;
+  int ret;
+
+  DS_START(tx, 1);
+  ret = 0;
+  if ((node = (ds_qnode_t *)DS_LOAD_PTR(tx, &q->head.node)) != NULL) {
+    if (val != NULL)
+      *val = DS_LOAD(tx, &node->val);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+/* ################################################################### *
+ * DOUBLE-ENDED QUEUE
+ * ################################################################### */
+
+/*
+ * Ends and links are indexed by side (0 for front, 1 for back): link[s]
+ * of a node points towards end s.
+ */
+
+typedef struct ds_dnode {
+  stm_word_t val;
+  struct ds_dnode *link[2];
+} ds_dnode_t;
+
+struct ds_deque {
+  ds_end_t end[2];
+};
+
+static void
+ds_deque_push(ds_deque_t *d, int s, stm_word_t val)
+{
+  struct stm_tx *tx;
+  ds_dnode_t *node, *e;
+
+  DS_START(tx, 0);
+  e = (ds_dnode_t *)DS_LOAD_PTR(tx, &d->end[s].node);
+  /* Node is private until linked */
+  node = (ds_dnode_t *)DS_ALLOC(tx, sizeof(ds_dnode_t));
+  node->val = val;
+  node->link[s] = NULL;
+  node->link[!s] = e;
+  if (e == NULL)
+    DS_STORE(tx, &d->end[!s].node, node);
+  else
+    DS_STORE(tx, &e->link[s], node);
+  DS_STORE(tx, &d->end[s].node, node);
+  DS_COMMIT(tx);
+}
+
+static int
+ds_deque_pop(ds_deque_t *d, int s, stm_word_t *val)
+{
+  struct stm_tx *tx;
+  ds_dnode_t *node, *next;
+  int ret;
+
+  DS_START(tx, 0);
+  ret = 0;
+  if ((node = (ds_dnode_t *)DS_LOAD_PTR(tx, &d->end[s].node)) != NULL) {
+    if (val != NULL)
+      *val = DS_LOAD(tx, &node->val);
+    next = (ds_dnode_t *)DS_LOAD_PTR(tx, &node->link[!s]);
+    DS_STORE(tx, &d->end[s].node, next);
+    if (next == NULL)
+      DS_STORE(tx, &d->end[!s].node, NULL);
+    else
+      DS_STORE(tx, &next->link[s], NULL);
+    DS_FREE(tx, node, sizeof(ds_dnode_t));
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+static int
+ds_deque_peek(ds_deque_t *d, int s, stm_word_t *val)
+{
+  struct stm_tx *tx;
+  ds_dnode_t *node;
+  int ret;
+
+  DS_START(tx, 1);
+  ret = 0;
+  if ((node = (ds_dnode_t *)DS_LOAD_PTR(tx, &d->end[s].node)) != NULL) {
+    if (val != NULL)
+      *val = DS_LOAD(tx, &node->val);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+ds_deque_t *ds_deque_new(void)
+{
+  ds_deque_t *d;
+
+  d = (ds_deque_t *)xmalloc_aligned(sizeof(ds_deque_t));
+  d->end[0].node = d->end[1].node = NULL;
+  return d;
+}
+
+void ds_deque_delete(ds_deque_t *d)
+{
+  ds_dnode_t *node, *next;
+
+  for (node = (ds_dnode_t *)d->end[0].node; node != NULL; node = next) {
+    next = node->link[1];
+    mod_mem_free(node);
+  }
+  xfree(d);
+}
+
+size_t ds_deque_size(ds_deque_t *d)
+{
+  struct stm_tx *tx;
+  ds_dnode_t *node;
+  size_t size;
+
+  DS_START(tx, 1);
+  size = 0;
+  for (node = (ds_dnode_t *)DS_LOAD_PTR(tx, &d->end[0].node); node != NULL; node = (ds_dnode_t *)DS_LOAD_PTR(tx, &node->link[1]))
+    size++;
+  DS_COMMIT(tx);
+  return size;
+}
+
+void ds_deque_push_front(ds_deque_t *d, stm_word_t val)
+{
+  ds_deque_push(d, 0, val);
+}
+
+void ds_deque_push_back(ds_deque_t *d, stm_word_t val)
+{
+  ds_deque_push(d, 1, val);
+}
+
+int ds_deque_pop_front(ds_deque_t *d, stm_word_t *val)
+{
+  return ds_deque_pop(d, 0, val);
+}
+
+int ds_deque_pop_back(ds_deque_t *d, stm_word_t *val)
+{
+  return ds_deque_pop(d, 1, val);
+}
+
+int ds_deque_peek_front(ds_deque_t *d, stm_word_t *val)
+{
+  return ds_deque_peek(d, 0, val);
+}
+
+int ds_deque_peek_back(ds_deque_t *d, stm_word_t *val)
+{
+  return ds_deque_peek(d, 1, val);
+}
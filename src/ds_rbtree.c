@@ -0,0 +1,297 @@
+/*
+ * File:
+ *   ds_rbtree.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Transactional red-black tree.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include "ds_internal.h"
+
+/*
+ * Leaves are NULL pointers rather than a shared sentinel node, which
+ * would be written by every rebalancing and cause conflicts between
+ * unrelated updates.  Children are indexed by direction (0 for left, 1
+ * for right) so that symmetric cases share the same code.
+ */
+
+#define RED                             0
+#define BLACK                           1
+
+/* Key and children are read by lookups and fit in one stripe */
+typedef struct ds_rbnode {
+  stm_word_t key;
+  struct ds_rbnode *child[2];
+  struct ds_rbnode *parent;
+  stm_word_t color;
+} ds_rbnode_t;
+
+struct ds_rbtree {
+  ds_rbnode_t *root;
+};
+
+#define KEY(n)                          (DS_LOAD(tx, &(n)->key))
+#define CHILD(n, d)                     ((ds_rbnode_t *)DS_LOAD_PTR(tx, &(n)->child[d]))
+#define PARENT(n)                       ((ds_rbnode_t *)DS_LOAD_PTR(tx, &(n)->parent))
+#define COLOR(n)                        ((n) == NULL ? BLACK : DS_LOAD(tx, &(n)->color))
+#define SET_KEY(n, k)                   DS_STORE(tx, &(n)->key, k)
+#define SET_CHILD(n, d, c)              DS_STORE(tx, &(n)->child[d], c)
+#define SET_PARENT(n, p)                DS_STORE(tx, &(n)->parent, p)
+#define SET_COLOR(n, c)                 DS_STORE(tx, &(n)->color, c)
+#define ROOT(t)                         ((ds_rbnode_t *)DS_LOAD_PTR(tx, &(t)->root))
+#define SET_ROOT(t, n)                  DS_STORE(tx, &(t)->root, n)
+
+/* Direction of node n from its parent p */
+#define DIR(p, n)                       (CHILD(p, 1) == (n))
+
+/*
+ * Find the node with the key or, if absent, the node under which it
+ * would be inserted (NULL if the tree is empty).
+ */
+static INLINE ds_rbnode_t *
+ds_rbnode_find(struct stm_tx *tx, ds_rbtree_t *t, stm_word_t key, int *found)
+{
+  ds_rbnode_t *node, *next;
+  stm_word_t k;
+
+  *found = 0;
+  node = NULL;
+  next = ROOT(t);
+  while (next != NULL) {
+    node = next;
+    if ((k = KEY(node)) == key) {
+      *found = 1;
+      break;
+    }
+    next = CHILD(node, k < key);
+  }
+  return node;
+}
+
+/*
+ * Rotate subtree rooted at x in direction d (0 for left rotation).
+ */
+static INLINE void
+ds_rbnode_rotate(struct stm_tx *tx, ds_rbtree_t *t, ds_rbnode_t *x, int d)
+{
+  ds_rbnode_t *y, *c, *p;
+
+  y = CHILD(x, !d);
+  c = CHILD(y, d);
+  SET_CHILD(x, !d, c);
+  if (c != NULL)
+    SET_PARENT(c, x);
+  p = PARENT(x);
+  SET_PARENT(y, p);
+  if (p == NULL)
+    SET_ROOT(t, y);
+  else
+    SET_CHILD(p, DIR(p, x), y);
+  SET_CHILD(y, d, x);
+  SET_PARENT(x, y);
+}
+
+static INLINE void
+ds_rbnode_insert_fixup(struct stm_tx *tx, ds_rbtree_t *t, ds_rbnode_t *z)
+{
+  ds_rbnode_t *p, *g, *u;
+  int d;
+
+  while ((p = PARENT(z)) != NULL && COLOR(p) == RED) {
+    /* Parent is red hence not the root */
+    g = PARENT(p);
+    d = DIR(g, p);
+    u = CHILD(g, !d);
+    if (COLOR(u) == RED) {
+      SET_COLOR(p, BLACK);
+      SET_COLOR(u, BLACK);
+      SET_COLOR(g, RED);
+      z = g;
+    } else {
+      if (DIR(p, z) != d) {
+        z = p;
+        ds_rbnode_rotate(tx, t, z, d);
+        p = PARENT(z);
+      }
+      SET_COLOR(p, BLACK);
+      SET_COLOR(g, RED);
+      ds_rbnode_rotate(tx, t, g, !d);
+    }
+  }
+  SET_COLOR(ROOT(t), BLACK);
+}
+
+/*
+ * Restore properties after removing a black node, x (possibly NULL)
+ * being its replacement under parent xp.
+ */
+static INLINE void
+ds_rbnode_remove_fixup(struct stm_tx *tx, ds_rbtree_t *t, ds_rbnode_t *x, ds_rbnode_t *xp)
+{
+  ds_rbnode_t *w;
+  int d;
+
+  while (xp != NULL && COLOR(x) == BLACK) {
+    d = (CHILD(xp, 0) == x ? 0 : 1);
+    /* Sibling exists since x is one black node short */
+    w = CHILD(xp, !d);
+    if (COLOR(w) == RED) {
+      SET_COLOR(w, BLACK);
+      SET_COLOR(xp, RED);
+      ds_rbnode_rotate(tx, t, xp, d);
+      w = CHILD(xp, !d);
+    }
+    if (COLOR(CHILD(w, 0)) == BLACK && COLOR(CHILD(w, 1)) == BLACK) {
+      SET_COLOR(w, RED);
+      x = xp;
+      xp = PARENT(x);
+    } else {
+      if (COLOR(CHILD(w, !d)) == BLACK) {
+        SET_COLOR(CHILD(w, d), BLACK);
+        SET_COLOR(w, RED);
+        ds_rbnode_rotate(tx, t, w, !d);
+        w = CHILD(xp, !d);
+      }
+      SET_COLOR(w, COLOR(xp));
+      SET_COLOR(xp, BLACK);
+      if (CHILD(w, !d) != NULL)
+        SET_COLOR(CHILD(w, !d), BLACK);
+      ds_rbnode_rotate(tx, t, xp, d);
+      x = ROOT(t);
+      xp = NULL;
+    }
+  }
+  if (x != NULL)
+    SET_COLOR(x, BLACK);
+}
+
+static void
+ds_rbnode_free(ds_rbnode_t *node)
+{
+  if (node == NULL)
+    return;
+  ds_rbnode_free(node->child[0]);
+  ds_rbnode_free(node->child[1]);
+  mod_mem_free(node);
+}
+
+static size_t
+ds_rbnode_size(struct stm_tx *tx, ds_rbnode_t *node)
+{
+  if (node == NULL)
+    return 0;
+  return 1 + ds_rbnode_size(tx, CHILD(node, 0)) + ds_rbnode_size(tx, CHILD(node, 1));
+}
+
+ds_rbtree_t *ds_rbtree_new(void)
+{
+  ds_rbtree_t *t;
+
+  t = (ds_rbtree_t *)xmalloc_aligned(CACHELINE_SIZE);
+  t->root = NULL;
+  return t;
+}
+
+void ds_rbtree_delete(ds_rbtree_t *t)
+{
+  ds_rbnode_free(t->root);
+  xfree(t);
+}
+
+size_t ds_rbtree_size(ds_rbtree_t *t)
+{
+  struct stm_tx *tx;
+  size_t size;
+
+  DS_START(tx, 1);
+  size = ds_rbnode_size(tx, ROOT(t));
+  DS_COMMIT(tx);
+  return size;
+}
+
+int ds_rbtree_contains(ds_rbtree_t *t, stm_word_t key)
+{
+  struct stm_tx *tx;
+  int found;
+
+  DS_START(tx, 1);
+  ds_rbnode_find(tx, t, key, &found);
+  DS_COMMIT(tx);
+  return found;
+}
+
+int ds_rbtree_add(ds_rbtree_t *t, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_rbnode_t *p, *z;
+  int found;
+
+  DS_START(tx, 0);
+  p = ds_rbnode_find(tx, t, key, &found);
+  if (!found) {
+    /* Node is private until linked */
+    z = (ds_rbnode_t *)DS_ALLOC(tx, sizeof(ds_rbnode_t));
+    z->key = key;
+    z->child[0] = z->child[1] = NULL;
+    z->parent = p;
+    z->color = RED;
+    if (p == NULL)
+      SET_ROOT(t, z);
+    else
+      SET_CHILD(p, KEY(p) < key, z);
+    ds_rbnode_insert_fixup(tx, t, z);
+  }
+  DS_COMMIT(tx);
+  return !found;
+}
+
+int ds_rbtree_remove(ds_rbtree_t *t, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_rbnode_t *x, *y, *z, *p, *c;
+  int found;
+
+  DS_START(tx, 0);
+  z = ds_rbnode_find(tx, t, key, &found);
+  if (found) {
+    /* Unlink z or, if it has two children, its successor y after moving its key to z */
+    y = z;
+    if (CHILD(z, 0) != NULL && (c = CHILD(z, 1)) != NULL) {
+      do {
+        y = c;
+      } while ((c = CHILD(y, 0)) != NULL);
+    }
+    x = CHILD(y, CHILD(y, 0) == NULL);
+    p = PARENT(y);
+    if (x != NULL)
+      SET_PARENT(x, p);
+    if (p == NULL)
+      SET_ROOT(t, x);
+    else
+      SET_CHILD(p, DIR(p, y), x);
+    if (y != z)
+      SET_KEY(z, KEY(y));
+    if (COLOR(y) == BLACK)
+      ds_rbnode_remove_fixup(tx, t, x, p);
+    DS_FREE(tx, y, sizeof(ds_rbnode_t));
+  }
+  DS_COMMIT(tx);
+  return found;
+}
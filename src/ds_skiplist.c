@@ -0,0 +1,312 @@
+/*
+ * File:
+ *   ds_skiplist.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Transactional skip list and priority queue.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <stddef.h>
+
+#include "ds_internal.h"
+
+#define DS_MAX_LEVEL                    32
+
+/* Key, level and lowest links are read together and fit in one stripe */
+typedef struct ds_snode {
+  stm_word_t key;
+  stm_word_t level;                     /* Highest level of links */
+  struct ds_snode *next[];
+} ds_snode_t;
+
+#define DS_SNODE_SIZE(l)                (offsetof(ds_snode_t, next) + ((l) + 1) * sizeof(ds_snode_t *))
+
+struct ds_skiplist {
+  ds_snode_t *head;                     /* Sentinel (immutable) */
+  stm_word_t level;                     /* Highest level in use */
+};
+
+/* The priority queue is a skip list that accepts duplicates */
+struct ds_pqueue {
+  struct ds_skiplist sl;
+};
+
+static INLINE stm_word_t
+ds_snode_level(struct stm_tx *tx)
+{
+  stm_word_t r, l;
+
+  /* One level up with probability 1/2 */
+  r = ds_random(tx);
+  for (l = 0; l < DS_MAX_LEVEL - 1 && (r & 1) != 0; l++)
+    r >>= 1;
+  return l;
+}
+
+/*
+ * Find the predecessors of a key at all levels in use and return the
+ * next node at the lowest level.  With dup, predecessors are the last
+ * nodes with a key not greater than (instead of smaller than) the key.
+ */
+static INLINE ds_snode_t *
+ds_snode_find(struct stm_tx *tx, struct ds_skiplist *l, stm_word_t key, int dup, ds_snode_t **preds, stm_word_t *level)
+{
+  ds_snode_t *node, *next;
+  stm_word_t k;
+  long i;
+
+  node = l->head;
+  *level = DS_LOAD(tx, &l->level);
+  next = NULL;
+  for (i = (long)*level; i >= 0; i--) {
+    while ((next = (ds_snode_t *)DS_LOAD_PTR(tx, &node->next[i])) != NULL) {
+      k = DS_LOAD(tx, &next->key);
+      if (k > key || (k == key && !dup))
+        break;
+      node = next;
+    }
+    if (preds != NULL)
+      preds[i] = node;
+  }
+  return next;
+}
+
+static INLINE void
+ds_snode_insert(struct stm_tx *tx, struct ds_skiplist *l, stm_word_t key, ds_snode_t **preds, stm_word_t level)
+{
+  ds_snode_t *node;
+  stm_word_t i, nl;
+
+  nl = ds_snode_level(tx);
+  if (nl > level) {
+    for (i = level + 1; i <= nl; i++)
+      preds[i] = l->head;
+    DS_STORE(tx, &l->level, nl);
+  }
+  /* Node is private until linked */
+  node = (ds_snode_t *)DS_ALLOC(tx, DS_SNODE_SIZE(nl));
+  node->key = key;
+  node->level = nl;
+  for (i = 0; i <= nl; i++) {
+    node->next[i] = (ds_snode_t *)DS_LOAD_PTR(tx, &preds[i]->next[i]);
+    DS_STORE(tx, &preds[i]->next[i], node);
+  }
+}
+
+static INLINE void
+ds_snode_unlink(struct stm_tx *tx, ds_snode_t *node, ds_snode_t **preds)
+{
+  stm_word_t i, nl;
+
+  nl = DS_LOAD(tx, &node->level);
+  for (i = 0; i <= nl; i++)
+    DS_STORE(tx, &preds[i]->next[i], DS_LOAD(tx, &node->next[i]));
+  DS_FREE(tx, node, DS_SNODE_SIZE(nl));
+}
+
+static void
+ds_skiplist_init(struct ds_skiplist *l)
+{
+  int i;
+
+  l->head = (ds_snode_t *)xmalloc_aligned(DS_SNODE_SIZE(DS_MAX_LEVEL - 1));
+  l->head->key = 0;
+  l->head->level = DS_MAX_LEVEL - 1;
+  for (i = 0; i < DS_MAX_LEVEL; i++)
+    l->head->next[i] = NULL;
+  l->level = 0;
+}
+
+static void
+ds_skiplist_fini(struct ds_skiplist *l)
+{
+  ds_snode_t *node, *next;
+
+  for (node = l->head->next[0]; node != NULL; node = next) {
+    next = node->next[0];
+    mod_mem_free(node);
+  }
+  xfree(l->head);
+}
+
+static size_t
+ds_skiplist_count(struct ds_skiplist *l)
+{
+  struct stm_tx *tx;
+  ds_snode_t *node;
+  size_t size;
+
+  DS_START(tx, 1);
+  size = 0;
+  for (node = (ds_snode_t *)DS_LOAD_PTR(tx, &l->head->next[0]); node != NULL; node = (ds_snode_t *)DS_LOAD_PTR(tx, &node->next[0]))
+    size++;
+  DS_COMMIT(tx);
+  return size;
+}
+
+/* ################################################################### *
+ * SKIP LIST
+ * ################################################################### */
+
+ds_skiplist_t *ds_skiplist_new(void)
+{
+  ds_skiplist_t *l;
+
+  l = (ds_skiplist_t *)xmalloc_aligned(CACHELINE_SIZE);
+  ds_skiplist_init(l);
+  return l;
+}
+
+void ds_skiplist_delete(ds_skiplist_t *l)
+{
+  ds_skiplist_fini(l);
+  xfree(l);
+}
+
+size_t ds_skiplist_size(ds_skiplist_t *l)
+{
+  return ds_skiplist_count(l);
+}
+
+int ds_skiplist_contains(ds_skiplist_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *node;
+  stm_word_t level;
+  int ret;
+
+  DS_START(tx, 1);
+  node = ds_snode_find(tx, l, key, 0, NULL, &level);
+  ret = (node != NULL && DS_LOAD(tx, &node->key) == key);
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_skiplist_add(ds_skiplist_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *preds[DS_MAX_LEVEL], *node;
+  stm_word_t level;
+  int ret;
+
+  DS_START(tx, 0);
+  node = ds_snode_find(tx, l, key, 0, preds, &level);
+  ret = 0;
+  if (node == NULL || DS_LOAD(tx, &node->key) != key) {
+    ds_snode_insert(tx, l, key, preds, level);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_skiplist_remove(ds_skiplist_t *l, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *preds[DS_MAX_LEVEL], *node;
+  stm_word_t level;
+  int ret;
+
+  DS_START(tx, 0);
+  node = ds_snode_find(tx, l, key, 0, preds, &level);
+  ret = 0;
+  if (node != NULL && DS_LOAD(tx, &node->key) == key) {
+    /* Keys are unique: the node follows its predecessors at all its levels */
+    ds_snode_unlink(tx, node, preds);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+/* ################################################################### *
+ * PRIORITY QUEUE
+ * ################################################################### */
+
+ds_pqueue_t *ds_pqueue_new(void)
+{
+  ds_pqueue_t *q;
+
+  q = (ds_pqueue_t *)xmalloc_aligned(CACHELINE_SIZE);
+  ds_skiplist_init(&q->sl);
+  return q;
+}
+
+void ds_pqueue_delete(ds_pqueue_t *q)
+{
+  ds_skiplist_fini(&q->sl);
+  xfree(q);
+}
+
+size_t ds_pqueue_size(ds_pqueue_t *q)
+{
+  return ds_skiplist_count(&q->sl);
+}
+
+void ds_pqueue_insert(ds_pqueue_t *q, stm_word_t key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *preds[DS_MAX_LEVEL];
+  stm_word_t level;
+
+  DS_START(tx, 0);
+  /* Insert after equal keys */
+  ds_snode_find(tx, &q->sl, key, 1, preds, &level);
+  ds_snode_insert(tx, &q->sl, key, preds, level);
+  DS_COMMIT(tx);
+}
+
+int ds_pqueue_remove_min(ds_pqueue_t *q, stm_word_t *key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *preds[DS_MAX_LEVEL], *node;
+  int i, ret;
+
+  DS_START(tx, 0);
+  ret = 0;
+  if ((node = (ds_snode_t *)DS_LOAD_PTR(tx, &q->sl.head->next[0])) != NULL) {
+    if (key != NULL)
+      *key = DS_LOAD(tx, &node->key);
+    /* First node only has the sentinel as predecessor */
+    for (i = 0; i < DS_MAX_LEVEL; i++)
+      preds[i] = q->sl.head;
+    ds_snode_unlink(tx, node, preds);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
+
+int ds_pqueue_peek_min(ds_pqueue_t *q, stm_word_t *key)
+{
+  struct stm_tx *tx;
+  ds_snode_t *node;
+  int ret;
+
+  DS_START(tx, 1);
+  ret = 0;
+  if ((node = (ds_snode_t *)DS_LOAD_PTR(tx, &q->sl.head->next[0])) != NULL) {
+    if (key != NULL)
+      *key = DS_LOAD(tx, &node->key);
+    ret = 1;
+  }
+  DS_COMMIT(tx);
+  return ret;
+}
@@ -28,6 +28,9 @@
 #include <stdint.h>
 
 #include <pthread.h>
+#ifdef __GLIBC__
+# include <malloc.h>
+#endif /* __GLIBC__ */
 
 #include "tls.h"
 #include "gc.h"
@@ -35,8 +38,6 @@
 #include "atomic.h"
 #include "stm.h"
 
-/* TODO: could be made much more efficient by allocating large chunks. */
-
 /* ################################################################### *
  * DEFINES
  * ################################################################### */
@@ -44,12 +45,24 @@
 #define MAX_GC_THREADS                  1024
 #define EPOCH_MAX                       (~(gc_word_t)0)
 
+#ifndef GC_BATCH_SIZE
+# define GC_BATCH_SIZE                  256
+#endif /* ! GC_BATCH_SIZE */
+
 #ifndef NO_PERIODIC_CLEANUP
 # ifndef CLEANUP_FREQUENCY
 #  define CLEANUP_FREQUENCY             1
 # endif /* ! CLEANUP_FREQUENCY */
 #endif /* ! NO_PERIODIC_CLEANUP */
 
+#ifndef GC_BACKLOG_THREAD
+# define GC_BACKLOG_THREAD              (1 << 20)
+#endif /* ! GC_BACKLOG_THREAD */
+
+#ifndef GC_BACKLOG_GLOBAL
+# define GC_BACKLOG_GLOBAL              (1 << 24)
+#endif /* ! GC_BACKLOG_GLOBAL */
+
 #ifdef DEBUG
 /* Note: stdio is thread-safe */
 # define IO_FLUSH                       fflush(NULL)
@@ -70,26 +83,43 @@ enum {                                  /* Descriptor status */
   GC_FREE_FULL = 3
 };
 
-typedef struct gc_block {               /* Block of allocated memory */
-  void *addr;                           /* Address of memory */
-  struct gc_block *next;                /* Next block */
-} gc_block_t;
-
-typedef struct gc_region {              /* A list of allocated memory blocks */
-  struct gc_block *blocks;              /* Memory blocks */
-  gc_word_t ts;                         /* Deallocation timestamp */
-  struct gc_region *next;               /* Next region */
-} gc_region_t;
+/*
+ * Freed addresses are appended to fixed-size batches that are stamped
+ * with the epoch of their last address (epochs are non-decreasing for
+ * a given thread).  A batch can be reclaimed once all active threads
+ * have a larger epoch.  Reclamation is attempted whenever CLEANUP_FREQUENCY
+ * batches have been filled, and reclaimed batches are recycled.  All
+ * blocks of a batch are released using the same function.
+ *
+ * A thread that does not advance its epoch (e.g., stalled in a long
+ * transaction) prevents all reclamation.  When the blocks pending
+ * reclamation of a thread, or of all threads, exceed their limit after
+ * a cleanup, the pressure flag of every thread holding back the oldest
+ * batch is set: the client is expected to advance the epoch of these
+ * threads (or restart their transaction) and to clear the flag.  Once
+ * the backlog is back under its limit, free memory is returned to the
+ * system.
+ */
+typedef struct gc_batch {               /* Batch of freed memory blocks */
+  gc_word_t ts;                         /* Deallocation timestamp (of last block) */
+  unsigned int nb;                      /* Number of blocks */
+  void (*release)(void *);              /* Function releasing the blocks */
+  struct gc_batch *next;                /* Next (newer) batch */
+  void *addr[GC_BATCH_SIZE];            /* Addresses of blocks */
+} gc_batch_t;
 
 typedef struct gc_thread {              /* Descriptor of an active thread */
   union {                               /* For padding... */
     struct {
       gc_word_t used;                   /* Is this entry used? */
-      gc_word_t ts;                     /* Start timestamp */
-      gc_region_t *head;                /* First memory region(s) assigned to thread */
-      gc_region_t *tail;                /* Last memory region(s) assigned to thread */
+      gc_batch_t *head;                 /* Oldest batch of thread */
+      gc_batch_t *tail;                 /* Batch being filled */
+      gc_batch_t *spare;                /* Reclaimed batch kept for reuse */
+      gc_word_t pending;                /* Number of blocks not yet reclaimed */
+      volatile gc_word_t pressure;      /* Set when thread holds back reclamation */
+      int trim;                         /* Return memory once backlog is reclaimed? */
 #ifndef NO_PERIODIC_CLEANUP
-      unsigned int frees;               /* How many blocks have been freed? */
+      unsigned int batches;             /* How many batches have been filled? */
 #endif /* ! NO_PERIODIC_CLEANUP */
     };
     char padding[CACHELINE_SIZE];       /* Padding (should be at least a cache line) */
@@ -98,9 +128,17 @@ typedef struct gc_thread {              /* Descriptor of an active thread */
 
 static struct {                         /* Descriptors of active threads */
   volatile gc_thread_t *slots;          /* Array of thread slots */
+  volatile gc_word_t *ts;               /* Start timestamps of threads (dense array, EPOCH_MAX if none) */
+  volatile gc_word_t nb_slots;          /* Number of thread slots ever used */
   volatile gc_word_t nb_active;         /* Number of used thread slots */
 } gc_threads;
 
+static struct {                         /* Bounds of blocks pending reclamation (0 if none) */
+  gc_word_t thread;                     /* Per thread */
+  gc_word_t global;                     /* For all threads */
+  volatile gc_word_t nb_pressure;       /* Number of times pressure was applied to a thread */
+} gc_backlog = { GC_BACKLOG_THREAD, GC_BACKLOG_GLOBAL, 0 };
+
 static gc_word_t (*gc_current_epoch)(void); /* Read the value of the current epoch */
 
 /* ################################################################### *
@@ -120,30 +158,17 @@ static inline int gc_get_idx(void)
  */
 static inline gc_word_t gc_compute_min(gc_word_t now)
 {
-  int i;
-  gc_word_t min, ts;
-  stm_word_t used;
+  gc_word_t i, nb, min, ts;
 
   PRINT_DEBUG("==> gc_compute_min(%d)\n", gc_get_idx());
 
   min = now;
-  for (i = 0; i < MAX_GC_THREADS; ) {
-    used = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used);
-    if (used == GC_BUSY) {
-      /* Used entry */
-      ts = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].ts);
-      if (ts == EPOCH_MAX) {
-        /* Wait until thread has set a safe lower bound */
-        continue;
-      }
-      if (ts < min)
-        min = ts;
-    } else if (used == GC_NULL) {
-      /* No more threads */
-      break;
-    }
-    /* Move to next entry only if entry is not used or it has a safe lower bound */
-    i++;
+  nb = ATOMIC_LOAD_ACQ(&gc_threads.nb_slots);
+  for (i = 0; i < nb; i++) {
+    /* Free slots have no lower bound (EPOCH_MAX) */
+    ts = (gc_word_t)ATOMIC_LOAD(&gc_threads.ts[i]);
+    if (ts < min)
+      min = ts;
   }
 
   PRINT_DEBUG("==> gc_compute_min(%d,m=%lu)\n", gc_get_idx(), (unsigned long)min);
@@ -152,34 +177,88 @@ static inline gc_word_t gc_compute_min(gc_word_t now)
 }
 
 /*
- * Free block list.
+ * Free blocks of batch.
  */
-static inline void gc_clean_blocks(gc_block_t *mb)
+static inline void gc_clean_batch(gc_batch_t *b)
 {
-  gc_block_t *next_mb;
-
-  while (mb != NULL) {
-    PRINT_DEBUG("==> free(%d,a=%p)\n", gc_get_idx(), mb->addr);
-    xfree(mb->addr);
-    next_mb = mb->next;
-    xfree(mb);
-    mb = next_mb;
+  unsigned int i;
+
+  for (i = 0; i < b->nb; i++) {
+    PRINT_DEBUG("==> free(%d,a=%p)\n", gc_get_idx(), b->addr[i]);
+    b->release(b->addr[i]);
   }
+  b->nb = 0;
+}
+
+/*
+ * Return free memory of the allocator to the system.
+ */
+static inline void gc_trim(void)
+{
+#ifdef __GLIBC__
+  /* Unmaps (madvise) free pages of all malloc arenas */
+  malloc_trim(0);
+#endif /* __GLIBC__ */
 }
 
 /*
- * Free region list.
+ * Number of blocks pending reclamation for all threads.
  */
-static inline void gc_clean_regions(gc_region_t *mr)
+static inline gc_word_t gc_backlog_all(void)
 {
-  gc_region_t *next_mr;
+  gc_word_t i, nb, n;
+
+  n = 0;
+  nb = ATOMIC_LOAD_ACQ(&gc_threads.nb_slots);
+  for (i = 0; i < nb; i++)
+    n += (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].pending);
 
-  while (mr != NULL) {
-    gc_clean_blocks(mr->blocks);
-    next_mr = mr->next;
-    xfree(mr);
-    mr = next_mr;
+  return n;
+}
+
+/*
+ * Apply pressure to the threads that prevent the backlog of a thread
+ * from being reclaimed if it exceeds its limit.
+ */
+static inline void gc_check_backlog(int idx, gc_word_t min)
+{
+  gc_word_t i, nb, bound, ts;
+
+  if ((gc_backlog.thread == 0 || gc_threads.slots[idx].pending <= gc_backlog.thread) &&
+      (gc_backlog.global == 0 || gc_backlog_all() <= gc_backlog.global))
+    return;
+
+  /* Threads that have not passed the oldest batch (or the minimum) */
+  bound = (gc_threads.slots[idx].head != NULL ? gc_threads.slots[idx].head->ts : min);
+  nb = ATOMIC_LOAD_ACQ(&gc_threads.nb_slots);
+  for (i = 0; i < nb; i++) {
+    ts = (gc_word_t)ATOMIC_LOAD(&gc_threads.ts[i]);
+    if (i != (gc_word_t)idx && ts <= bound && ATOMIC_LOAD(&gc_threads.slots[i].pressure) == 0) {
+      PRINT_DEBUG("==> gc_check_backlog(%d,t=%lu)\n", idx, (unsigned long)i);
+      ATOMIC_STORE_REL(&gc_threads.slots[i].pressure, 1);
+      ATOMIC_FETCH_INC_FULL(&gc_backlog.nb_pressure);
+    }
+  }
+  gc_threads.slots[idx].trim = 1;
+}
+
+/*
+ * Free all batches of a thread.
+ */
+static inline void gc_clean_batches(int idx)
+{
+  gc_batch_t *b;
+
+  while ((b = gc_threads.slots[idx].head) != NULL) {
+    gc_clean_batch(b);
+    gc_threads.slots[idx].head = b->next;
+    xfree(b);
   }
+  gc_threads.slots[idx].tail = NULL;
+  ATOMIC_STORE(&gc_threads.slots[idx].pending, 0);
+  gc_threads.slots[idx].trim = 0;
+  xfree(gc_threads.slots[idx].spare);
+  gc_threads.slots[idx].spare = NULL;
 }
 
 /*
@@ -187,25 +266,28 @@ static inline void gc_clean_regions(gc_region_t *mr)
  */
 void gc_cleanup_thread(int idx, gc_word_t min)
 {
-  gc_region_t *mr;
+  gc_batch_t *b;
 
   PRINT_DEBUG("==> gc_cleanup_thread(%d,m=%lu)\n", idx, (unsigned long)min);
 
-  if (gc_threads.slots[idx].head == NULL) {
-    /* Nothing to clean up */
-    return;
-  }
-
-  while (min > gc_threads.slots[idx].head->ts) {
-    gc_clean_blocks(gc_threads.slots[idx].head->blocks);
-    mr = gc_threads.slots[idx].head->next;
-    xfree(gc_threads.slots[idx].head);
-    gc_threads.slots[idx].head = mr;
-    if(mr == NULL) {
-      /* All memory regions deleted */
+  while ((b = gc_threads.slots[idx].head) != NULL && min > b->ts) {
+    ATOMIC_STORE(&gc_threads.slots[idx].pending, gc_threads.slots[idx].pending - b->nb);
+    gc_clean_batch(b);
+    gc_threads.slots[idx].head = b->next;
+    if (b->next == NULL) {
+      /* All batches deleted */
       gc_threads.slots[idx].tail = NULL;
-      break;
     }
+    /* Keep one batch for next frees */
+    if (gc_threads.slots[idx].spare == NULL)
+      gc_threads.slots[idx].spare = b;
+    else
+      xfree(b);
+  }
+  if (gc_threads.slots[idx].trim && (gc_backlog.thread == 0 || gc_threads.slots[idx].pending <= gc_backlog.thread / 2)) {
+    /* Backlog built up under pressure has been reclaimed */
+    gc_threads.slots[idx].trim = 0;
+    gc_trim();
   }
 }
 
@@ -223,15 +305,22 @@ void gc_init(gc_word_t (*epoch)(void))
   PRINT_DEBUG("==> gc_init()\n");
 
   gc_current_epoch = epoch;
+  /* Backlog limits may have been set before */
+  gc_backlog.nb_pressure = 0;
   gc_threads.slots = (gc_thread_t *)xmalloc(MAX_GC_THREADS * sizeof(gc_thread_t));
+  gc_threads.ts = (gc_word_t *)xmalloc(MAX_GC_THREADS * sizeof(gc_word_t));
   for (i = 0; i < MAX_GC_THREADS; i++) {
     gc_threads.slots[i].used = GC_NULL;
-    gc_threads.slots[i].ts = EPOCH_MAX;
-    gc_threads.slots[i].head = gc_threads.slots[i].tail = NULL;
+    gc_threads.slots[i].head = gc_threads.slots[i].tail = gc_threads.slots[i].spare = NULL;
+    gc_threads.slots[i].pending = 0;
+    gc_threads.slots[i].pressure = 0;
+    gc_threads.slots[i].trim = 0;
 #ifndef NO_PERIODIC_CLEANUP
-    gc_threads.slots[i].frees = 0;
+    gc_threads.slots[i].batches = 0;
 #endif /* ! NO_PERIODIC_CLEANUP */
+    gc_threads.ts[i] = EPOCH_MAX;
   }
+  gc_threads.nb_slots = 0;
   gc_threads.nb_active = 0;
 }
 
@@ -251,8 +340,9 @@ void gc_exit(void)
   }
   /* Clean up memory */
   for (i = 0; i < MAX_GC_THREADS; i++)
-    gc_clean_regions(gc_threads.slots[i].head);
+    gc_clean_batches(i);
 
+  xfree((void *)gc_threads.ts);
   xfree((void *)gc_threads.slots);
 }
 
@@ -262,7 +352,7 @@ void gc_exit(void)
 void gc_init_thread(void)
 {
   int i, idx;
-  gc_word_t used;
+  gc_word_t used, nb;
 
   PRINT_DEBUG("==> gc_init_thread()\n");
 
@@ -276,10 +366,8 @@ void gc_init_thread(void)
   while (1) {
     used = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used);
     if (used != GC_BUSY) {
-      if (ATOMIC_CAS_FULL(&gc_threads.slots[i].used, used, GC_BUSY) != 0) {
+      if (ATOMIC_CAS_ACQ_REL(&gc_threads.slots[i].used, used, GC_BUSY) != 0) {
         idx = i;
-        /* Set safe lower bound */
-        ATOMIC_STORE(&gc_threads.slots[idx].ts, gc_current_epoch());
         break;
       }
       /* CAS failed: another thread must have acquired slot */
@@ -288,6 +376,16 @@ void gc_init_thread(void)
     if (++i >= MAX_GC_THREADS)
       i = 0;
   }
+  /* Make slot visible to gc_compute_min() */
+  while ((nb = ATOMIC_LOAD(&gc_threads.nb_slots)) <= (gc_word_t)idx) {
+    if (ATOMIC_CAS_FULL(&gc_threads.nb_slots, nb, idx + 1) != 0)
+      break;
+  }
+  /* Prevent reclamation until we have read the epoch, then set safe lower bound */
+  ATOMIC_STORE(&gc_threads.ts[idx], 0);
+  ATOMIC_MB_FULL;
+  ATOMIC_STORE(&gc_threads.ts[idx], gc_current_epoch());
+  ATOMIC_STORE(&gc_threads.slots[idx].pressure, 0);
   tls_set_gc(idx);
 
   PRINT_DEBUG("==> gc_init_thread(i=%d)\n", idx);
@@ -304,9 +402,9 @@ void gc_exit_thread(void)
   PRINT_DEBUG("==> gc_exit_thread(%d)\n", idx);
 
   /* No more lower bound for this thread */
-  ATOMIC_STORE(&gc_threads.slots[idx].ts, EPOCH_MAX);
+  ATOMIC_STORE_REL(&gc_threads.ts[idx], EPOCH_MAX);
   /* Release slot */
-  ATOMIC_STORE(&gc_threads.slots[idx].used, gc_threads.slots[idx].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
+  ATOMIC_STORE_REL(&gc_threads.slots[idx].used, gc_threads.slots[idx].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
   ATOMIC_FETCH_DEC_FULL(&gc_threads.nb_active);
   /* Leave memory for next thread to cleanup */
 }
@@ -328,7 +426,7 @@ void gc_set_epoch(gc_word_t epoch)
   }
 
   /* Do not need a barrier as we only compute lower bounds */
-  ATOMIC_STORE(&gc_threads.slots[idx].ts, epoch);
+  ATOMIC_STORE(&gc_threads.ts[idx], epoch);
 }
 
 /*
@@ -336,41 +434,49 @@ void gc_set_epoch(gc_word_t epoch)
  */
 void gc_free(void *addr, gc_word_t epoch)
 {
-  gc_region_t *mr;
-  gc_block_t *mb;
-  int idx = gc_get_idx();
+  gc_free_cb(addr, epoch, xfree);
+}
 
-  PRINT_DEBUG("==> gc_free(%d,%lu)\n", idx, (unsigned long)epoch);
+/*
+ * Free memory using a custom function (the thread must indicate the
+ * current timestamp).
+ */
+void gc_free_cb(void *addr, gc_word_t epoch, void (*release)(void *addr))
+{
+  gc_batch_t *b;
+  int idx = gc_get_idx();
 
-  /* Function must be called with non-decreasing epoch numbers for any given thread! */
-  if (gc_threads.slots[idx].head == NULL || gc_threads.slots[idx].tail->ts < epoch) {
-    /* Allocate a new region */
-    mr = (gc_region_t *)xmalloc(sizeof(gc_region_t));
-    mr->ts = epoch;
-    mr->blocks = NULL;
-    mr->next = NULL;
-    if (gc_threads.slots[idx].head == NULL) {
-      gc_threads.slots[idx].head = gc_threads.slots[idx].tail = mr;
-    } else {
-      gc_threads.slots[idx].tail->next = mr;
-      gc_threads.slots[idx].tail = mr;
-    }
-  } else {
-    /* Add to current region */
-    assert(gc_threads.slots[idx].tail->ts == epoch);
-    mr = gc_threads.slots[idx].tail;
+  PRINT_DEBUG("==> gc_free_cb(%d,%lu)\n", idx, (unsigned long)epoch);
+
+  b = gc_threads.slots[idx].tail;
+  if (b == NULL || b->nb == GC_BATCH_SIZE || b->release != release) {
+    /* Start new batch (reuse reclaimed one if any) */
+    if ((b = gc_threads.slots[idx].spare) != NULL)
+      gc_threads.slots[idx].spare = NULL;
+    else
+      b = (gc_batch_t *)xmalloc(sizeof(gc_batch_t));
+    b->nb = 0;
+    b->release = release;
+    b->next = NULL;
+    if (gc_threads.slots[idx].head == NULL)
+      gc_threads.slots[idx].head = b;
+    else
+      gc_threads.slots[idx].tail->next = b;
+    gc_threads.slots[idx].tail = b;
   }
 
-  /* Allocate block */
-  mb = (gc_block_t *)xmalloc(sizeof(gc_block_t));
-  mb->addr = addr;
-  mb->next = mr->blocks;
-  mr->blocks = mb;
+  /* Function must be called with non-decreasing epoch numbers for any given thread! */
+  assert(b->nb == 0 || b->ts <= epoch);
+  b->addr[b->nb++] = addr;
+  b->ts = epoch;
+  ATOMIC_STORE(&gc_threads.slots[idx].pending, gc_threads.slots[idx].pending + 1);
 
 #ifndef NO_PERIODIC_CLEANUP
-  gc_threads.slots[idx].frees++;
-  if (gc_threads.slots[idx].frees % CLEANUP_FREQUENCY == 0)
-    gc_cleanup();
+  if (b->nb == GC_BATCH_SIZE) {
+    /* Batch is full: try reclaiming older ones */
+    if (++gc_threads.slots[idx].batches % CLEANUP_FREQUENCY == 0)
+      gc_cleanup();
+  }
 #endif /* ! NO_PERIODIC_CLEANUP */
 }
 
@@ -393,6 +499,8 @@ void gc_cleanup(void)
   min = gc_compute_min(gc_current_epoch());
 
   gc_cleanup_thread(idx, min);
+
+  gc_check_backlog(idx, min);
 }
 
 /*
@@ -410,11 +518,11 @@ void gc_cleanup_all(void)
     if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_NULL)
       break;
     if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_FREE_FULL) {
-      if (ATOMIC_CAS_FULL(&gc_threads.slots[i].used, GC_FREE_FULL, GC_BUSY) != 0) {
+      if (ATOMIC_CAS_ACQ_REL(&gc_threads.slots[i].used, GC_FREE_FULL, GC_BUSY) != 0) {
         if (min == EPOCH_MAX)
           min = gc_compute_min(gc_current_epoch());
         gc_cleanup_thread(i, min);
-        ATOMIC_STORE(&gc_threads.slots[i].used, gc_threads.slots[i].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
+        ATOMIC_STORE_REL(&gc_threads.slots[i].used, gc_threads.slots[i].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
       }
     }
   }
@@ -433,11 +541,56 @@ void gc_reset(void)
   for (i = 0; i < MAX_GC_THREADS; i++) {
     if (gc_threads.slots[i].used == GC_NULL)
       break;
-    gc_clean_regions(gc_threads.slots[i].head);
-    gc_threads.slots[i].ts = EPOCH_MAX;
-    gc_threads.slots[i].head = gc_threads.slots[i].tail = NULL;
+    gc_clean_batches(i);
+    gc_threads.ts[i] = EPOCH_MAX;
 #ifndef NO_PERIODIC_CLEANUP
-    gc_threads.slots[i].frees = 0;
+    gc_threads.slots[i].batches = 0;
 #endif /* ! NO_PERIODIC_CLEANUP */
   }
 }
+
+/*
+ * Return the flag set when the current thread holds back reclamation
+ * (to be cleared by the thread once it has advanced its epoch).
+ */
+volatile gc_word_t *gc_pressure_flag(void)
+{
+  return &gc_threads.slots[gc_get_idx()].pressure;
+}
+
+/*
+ * Set the maximum numbers of blocks pending reclamation per thread and
+ * for all threads before applying pressure (0 for no limit).
+ */
+void gc_set_backlog(gc_word_t thread, gc_word_t global)
+{
+  gc_backlog.thread = thread;
+  gc_backlog.global = global;
+}
+
+/*
+ * Return the maximum numbers of blocks pending reclamation per thread
+ * and for all threads.
+ */
+void gc_get_backlog(gc_word_t *thread, gc_word_t *global)
+{
+  *thread = gc_backlog.thread;
+  *global = gc_backlog.global;
+}
+
+/*
+ * Return the number of blocks pending reclamation for the current
+ * thread (all threads if all is set).
+ */
+gc_word_t gc_backlog_depth(int all)
+{
+  return (all ? gc_backlog_all() : (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[gc_get_idx()].pending));
+}
+
+/*
+ * Return the number of times pressure has been applied to a thread.
+ */
+gc_word_t gc_nb_pressure(void)
+{
+  return (gc_word_t)ATOMIC_LOAD(&gc_backlog.nb_pressure);
+}
@@ -45,12 +45,24 @@ void gc_set_epoch(gc_word_t epoch);
 
 void gc_free(void *addr, gc_word_t epoch);
 
+void gc_free_cb(void *addr, gc_word_t epoch, void (*release)(void *addr));
+
 void gc_cleanup(void);
 
 void gc_cleanup_all(void);
 
 void gc_reset(void);
 
+volatile gc_word_t *gc_pressure_flag(void);
+
+void gc_set_backlog(gc_word_t thread, gc_word_t global);
+
+void gc_get_backlog(gc_word_t *thread, gc_word_t *global);
+
+gc_word_t gc_backlog_depth(int all);
+
+gc_word_t gc_nb_pressure(void);
+
 # ifdef __cplusplus
 }
 # endif
@@ -24,6 +24,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -42,7 +43,8 @@
  * TYPES
  * ################################################################### */
 
-#define NB_ATOMIC_BLOCKS                64
+#define NB_ATOMIC_BLOCKS                64      /* Initial size of atomic block table */
+#define NB_HIST_ENTRIES                 16      /* Initial size of per-thread histogram table */
 #define BUFFER_SIZE                     1024
 #define RESERVOIR_SIZE                  "RESERVOIR_SIZE"
 #define RESERVOIR_SIZE_DEFAULT          1000
@@ -64,6 +66,30 @@ typedef struct ab_stats {               /* Atomic block statistics */
   smart_counter_t stats;                /* Length statistics */
 } ab_stats_t;
 
+typedef struct ab_hist_entry {          /* Histograms of an atomic block */
+  int id;                               /* Atomic block identifier */
+  stm_ab_hist_t hist[STM_AB_HIST_NB];   /* Histograms */
+} ab_hist_entry_t;
+
+typedef struct ab_hist_table {          /* Per-thread table of histograms (open addressing) */
+  unsigned int size;                    /* Size of the table (power of 2) */
+  unsigned int nb;                      /* Number of entries */
+  struct ab_hist_table *prev;           /* Previous (smaller) table */
+  ab_hist_entry_t **entries;            /* Entries */
+} ab_hist_table_t;
+
+/*
+ * Histograms are only written by their owner thread and read without
+ * locking by other threads.  Tables grow by doubling; entries and old
+ * tables are only freed upon cleanup, so readers can always traverse
+ * the table they loaded.  Slots of exited threads are reused.
+ */
+typedef struct ab_hist_thread {         /* Per-thread histograms */
+  ab_hist_table_t *volatile table;      /* Current table */
+  volatile stm_word_t used;             /* Is slot used by a thread? */
+  struct ab_hist_thread *next;          /* Next slot */
+} ab_hist_thread_t;
+
 typedef struct samples_buffer {         /* Buffer to hold samples */
   struct {
     int id;                             /* Atomic block identifier */
@@ -72,6 +98,11 @@ typedef struct samples_buffer {         /* Buffer to hold samples */
   unsigned int nb;                      /* Number of samples */
   unsigned int total;                   /* Total number of valid samples seen by thread so far */
   uint64_t start;                       /* Start time of the current transaction */
+  uint64_t first;                       /* Start time of the first attempt */
+  unsigned long first_length;           /* Length of the first attempt (if aborted) */
+  unsigned long retries;                /* Number of retries of the current transaction */
+  ab_hist_thread_t *hist;               /* Histograms of the thread */
+  ab_hist_entry_t *last;                /* Histograms of the last atomic block */
   unsigned short seed[3];               /* Thread-local PNRG's seed */
 } samples_buffer_t;
 
@@ -85,7 +116,11 @@ static unsigned int seed;               /* Global PNRG's seed */
 
 static pthread_mutex_t ab_mutex;        /* Mutex to update global statistics */
 
-static ab_stats_t *ab_list[NB_ATOMIC_BLOCKS];
+static ab_stats_t **ab_list;            /* Atomic block table (chained) */
+static unsigned int ab_list_size;       /* Size of atomic block table */
+static unsigned int ab_list_nb;         /* Number of atomic blocks */
+
+static ab_hist_thread_t *volatile ab_hist_threads = NULL;
 
 /* ################################################################### *
  * FUNCTIONS
@@ -238,6 +273,152 @@ static inline uint64_t get_time(void) {
 #endif
 }
 
+/*
+ * Double the size of the atomic block table (ab_mutex must be held).
+ */
+static void ab_list_grow(void)
+{
+  unsigned int i, size, bucket;
+  ab_stats_t **list, *ab, *n;
+
+  size = ab_list_size * 2;
+  list = (ab_stats_t **)xcalloc(size, sizeof(ab_stats_t *));
+  for (i = 0; i < ab_list_size; i++) {
+    for (ab = ab_list[i]; ab != NULL; ab = n) {
+      n = ab->next;
+      bucket = abs(ab->id) % size;
+      ab->next = list[bucket];
+      list[bucket] = ab;
+    }
+  }
+  xfree(ab_list);
+  ab_list = list;
+  ab_list_size = size;
+}
+
+/*
+ * Get index of the histogram bucket of a value.  Values below
+ * 2^STM_AB_HIST_SUB_BITS have their own bucket; larger values are
+ * split in 2^STM_AB_HIST_SUB_BITS buckets per power of 2.
+ */
+static INLINE unsigned int hist_index(unsigned long v)
+{
+  unsigned int e;
+
+  if (v < (1UL << STM_AB_HIST_SUB_BITS))
+    return (unsigned int)v;
+#ifdef __GNUC__
+  e = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(v);
+#else /* ! __GNUC__ */
+  for (e = STM_AB_HIST_SUB_BITS; (v >> (e + 1)) != 0; e++)
+    ;
+#endif /* ! __GNUC__ */
+  if (e >= STM_AB_HIST_MAX_BITS)
+    return STM_AB_HIST_SIZE - 1;
+  return ((e - STM_AB_HIST_SUB_BITS + 1) << STM_AB_HIST_SUB_BITS)
+    + (unsigned int)((v >> (e - STM_AB_HIST_SUB_BITS)) & ((1UL << STM_AB_HIST_SUB_BITS) - 1));
+}
+
+/*
+ * Get highest value that falls in a histogram bucket.
+ */
+static unsigned long hist_value(unsigned int i)
+{
+  unsigned int s;
+
+  if (i < (1U << STM_AB_HIST_SUB_BITS))
+    return i;
+  s = (i >> STM_AB_HIST_SUB_BITS) - 1;
+  return ((((unsigned long)i & ((1UL << STM_AB_HIST_SUB_BITS) - 1)) + (1UL << STM_AB_HIST_SUB_BITS)) << s)
+    + ((1UL << s) - 1);
+}
+
+/*
+ * Initialize histogram.
+ */
+static void hist_init(stm_ab_hist_t *h)
+{
+  memset(h, 0, sizeof(*h));
+  h->min = ULONG_MAX;
+}
+
+/*
+ * Add value to histogram (owner thread only).
+ */
+static INLINE void hist_add(stm_ab_hist_t *h, unsigned long v)
+{
+  h->buckets[hist_index(v)]++;
+  h->sum += v;
+  if (v < h->min)
+    h->min = v;
+  if (v > h->max)
+    h->max = v;
+  /* Updated last: readers use it as a (lower) bound of samples */
+  h->count++;
+}
+
+/*
+ * Create histograms of an atomic block in thread table.
+ */
+static ab_hist_entry_t *hist_create(ab_hist_thread_t *t, int id)
+{
+  ab_hist_table_t *table, *old;
+  ab_hist_entry_t *e;
+  unsigned int i, j;
+
+  table = t->table;
+  if (2 * (table->nb + 1) > table->size) {
+    /* Grow table (old table is kept for concurrent readers) */
+    old = table;
+    table = (ab_hist_table_t *)xmalloc(sizeof(ab_hist_table_t));
+    table->size = old->size * 2;
+    table->nb = old->nb;
+    table->prev = old;
+    table->entries = (ab_hist_entry_t **)xcalloc(table->size, sizeof(ab_hist_entry_t *));
+    for (i = 0; i < old->size; i++) {
+      if (old->entries[i] == NULL)
+        continue;
+      j = ((unsigned int)old->entries[i]->id * 2654435761U) & (table->size - 1);
+      while (table->entries[j] != NULL)
+        j = (j + 1) & (table->size - 1);
+      table->entries[j] = old->entries[i];
+    }
+    ATOMIC_STORE_REL(&t->table, table);
+  }
+
+  e = (ab_hist_entry_t *)xmalloc(sizeof(ab_hist_entry_t));
+  e->id = id;
+  for (i = 0; i < STM_AB_HIST_NB; i++)
+    hist_init(&e->hist[i]);
+  j = ((unsigned int)id * 2654435761U) & (table->size - 1);
+  while (table->entries[j] != NULL)
+    j = (j + 1) & (table->size - 1);
+  table->nb++;
+  /* Publish entry after initialization */
+  ATOMIC_STORE_REL(&table->entries[j], e);
+
+  return e;
+}
+
+/*
+ * Find histograms of an atomic block in thread table (any thread).
+ */
+static ab_hist_entry_t *hist_find(ab_hist_thread_t *t, int id)
+{
+  ab_hist_table_t *table;
+  ab_hist_entry_t *e;
+  unsigned int j;
+
+  table = (ab_hist_table_t *)ATOMIC_LOAD_ACQ(&t->table);
+  j = ((unsigned int)id * 2654435761U) & (table->size - 1);
+  while ((e = (ab_hist_entry_t *)ATOMIC_LOAD_ACQ(&table->entries[j])) != NULL) {
+    if (e->id == id)
+      return e;
+    j = (j + 1) & (table->size - 1);
+  }
+  return NULL;
+}
+
 /*
  * Add samples to global stats.
  */
@@ -250,18 +431,23 @@ static void sc_add_samples(samples_buffer_t *samples)
   for (i = 0; i < samples->nb; i++) {
     id = samples->buffer[i].id;
     /* Find bucket */
-    bucket = abs(id) % NB_ATOMIC_BLOCKS;
+    bucket = abs(id) % ab_list_size;
     /* Search for entry in bucket */
     ab = ab_list[bucket];
     while (ab != NULL && ab->id != id)
       ab = ab->next;
     if (ab == NULL) {
       /* No entry yet: create one */
+      if (ab_list_nb >= ab_list_size) {
+        ab_list_grow();
+        bucket = abs(id) % ab_list_size;
+      }
       ab = (ab_stats_t *)xmalloc(sizeof(ab_stats_t));
       ab->id = id;
       ab->next = ab_list[bucket];
       sc_init(&ab->stats);
       ab_list[bucket] = ab;
+      ab_list_nb++;
     }
     sc_add_sample(&ab->stats, (double)samples->buffer[i].length, samples->seed);
   }
@@ -277,8 +463,11 @@ static void cleanup(void)
   int i;
   ab_stats_t *ab, *n;
 
+  ab_hist_thread_t *t, *tn;
+  ab_hist_table_t *table, *prev;
+
   pthread_mutex_lock(&ab_mutex);
-  for (i = 0; i < NB_ATOMIC_BLOCKS; i++) {
+  for (i = 0; i < ab_list_size; i++) {
     ab = ab_list[i];
     while (ab != NULL) {
       n = ab->next;
@@ -287,8 +476,27 @@ static void cleanup(void)
       ab = n;
     }
   }
+  xfree(ab_list);
+  ab_list = NULL;
+  ab_list_size = ab_list_nb = 0;
   pthread_mutex_unlock(&ab_mutex);
 
+  for (t = ab_hist_threads; t != NULL; t = tn) {
+    tn = t->next;
+    table = t->table;
+    for (i = 0; i < table->size; i++) {
+      if (table->entries[i] != NULL)
+        xfree(table->entries[i]);
+    }
+    for (; table != NULL; table = prev) {
+      prev = table->prev;
+      xfree(table->entries);
+      xfree(table);
+    }
+    xfree(t);
+  }
+  ab_hist_threads = NULL;
+
   pthread_mutex_destroy(&ab_mutex);
 }
 
@@ -298,10 +506,33 @@ static void cleanup(void)
 static void mod_ab_on_thread_init(void *arg)
 {
   samples_buffer_t *samples;
+  ab_hist_thread_t *t, *head;
+
+  /* Reuse histograms of exited thread if any */
+  for (t = (ab_hist_thread_t *)ATOMIC_LOAD_ACQ(&ab_hist_threads); t != NULL; t = t->next) {
+    if (ATOMIC_LOAD(&t->used) == 0 && ATOMIC_CAS_FULL(&t->used, 0, 1) != 0)
+      break;
+  }
+  if (t == NULL) {
+    t = (ab_hist_thread_t *)xmalloc(sizeof(ab_hist_thread_t));
+    t->table = (ab_hist_table_t *)xmalloc(sizeof(ab_hist_table_t));
+    t->table->size = NB_HIST_ENTRIES;
+    t->table->nb = 0;
+    t->table->prev = NULL;
+    t->table->entries = (ab_hist_entry_t **)xcalloc(NB_HIST_ENTRIES, sizeof(ab_hist_entry_t *));
+    t->used = 1;
+    do {
+      head = (ab_hist_thread_t *)ATOMIC_LOAD(&ab_hist_threads);
+      t->next = head;
+    } while (ATOMIC_CAS_FULL(&ab_hist_threads, head, t) == 0);
+  }
 
   samples = (samples_buffer_t *)xmalloc(sizeof(samples_buffer_t));
   samples->nb = 0;
   samples->total = 0;
+  samples->retries = 0;
+  samples->hist = t;
+  samples->last = NULL;
   /* Initialize thread-local seed in mutual exclution */
   pthread_mutex_lock(&ab_mutex);
   samples->seed[0] = (unsigned short)rand_r(&seed);
@@ -323,6 +554,9 @@ static void mod_ab_on_thread_exit(void *arg)
 
   sc_add_samples(samples);
 
+  /* Histograms remain visible to other threads */
+  ATOMIC_STORE_REL(&samples->hist->used, 0);
+
   xfree(samples);
 }
 
@@ -336,7 +570,8 @@ static void mod_ab_on_start(void *arg)
   samples = (samples_buffer_t *)stm_get_specific(mod_ab_key);
   assert(samples != NULL);
 
-  samples->start = get_time();
+  samples->start = samples->first = get_time();
+  samples->retries = 0;
 }
 
 /*
@@ -346,17 +581,31 @@ static void mod_ab_on_commit(void *arg)
 {
   samples_buffer_t *samples;
   stm_tx_attr_t attrs;
+  ab_hist_entry_t *e;
   unsigned long length;
+  uint64_t now;
 
   samples = (samples_buffer_t *)stm_get_specific(mod_ab_key);
   assert(samples != NULL);
 
   if (check_fn == NULL || check_fn()) {
-    length = get_time() - samples->start;
+    now = get_time();
+    length = now - samples->start;
+    attrs = stm_get_attributes();
+    /* Record in histograms of atomic block */
+    e = samples->last;
+    if (e == NULL || e->id != attrs.id) {
+      e = hist_find(samples->hist, attrs.id);
+      if (e == NULL)
+        e = hist_create(samples->hist, attrs.id);
+      samples->last = e;
+    }
+    hist_add(&e->hist[STM_AB_HIST_FIRST], samples->retries == 0 ? length : samples->first_length);
+    hist_add(&e->hist[STM_AB_HIST_TOTAL], (unsigned long)(now - samples->first));
+    hist_add(&e->hist[STM_AB_HIST_RETRIES], samples->retries);
     samples->total++;
     /* Should be keep this sample? */
     if ((samples->total % sampling_period) == 0) {
-      attrs = stm_get_attributes();
       samples->buffer[samples->nb].id = attrs.id;
       samples->buffer[samples->nb].length = length;
       /* Is buffer full? */
@@ -374,11 +623,15 @@ static void mod_ab_on_commit(void *arg)
 static void mod_ab_on_abort(void *arg)
 {
   samples_buffer_t *samples;
+  uint64_t now;
 
   samples = (samples_buffer_t *)stm_get_specific(mod_ab_key);
   assert(samples != NULL);
 
-  samples->start = get_time();
+  now = get_time();
+  if (samples->retries++ == 0)
+    samples->first_length = (unsigned long)(now - samples->start);
+  samples->start = now;
 }
 
 /*
@@ -392,7 +645,7 @@ int stm_get_ab_stats(int id, stm_ab_stats_t *stats)
   result = 0;
   pthread_mutex_lock(&ab_mutex);
   /* Find bucket */
-  bucket = abs(id) % NB_ATOMIC_BLOCKS;
+  bucket = abs(id) % ab_list_size;
   /* Search for entry in bucket */
   ab = ab_list[bucket];
   while (ab != NULL && ab->id != id)
@@ -416,12 +669,142 @@ int stm_get_ab_stats(int id, stm_ab_stats_t *stats)
   return result;
 }
 
+/*
+ * Merge histogram into another one (can be read while being updated).
+ */
+void stm_ab_hist_merge(stm_ab_hist_t *dst, const stm_ab_hist_t *src)
+{
+  unsigned long v;
+  unsigned int i;
+
+  /* Read count first (it is updated last) */
+  dst->count += ATOMIC_LOAD(&src->count);
+  for (i = 0; i < STM_AB_HIST_SIZE; i++)
+    dst->buckets[i] += ATOMIC_LOAD(&src->buckets[i]);
+  dst->sum += ATOMIC_LOAD(&src->sum);
+  if ((v = ATOMIC_LOAD(&src->min)) < dst->min)
+    dst->min = v;
+  if ((v = ATOMIC_LOAD(&src->max)) > dst->max)
+    dst->max = v;
+}
+
+/*
+ * Return value at percentile of histogram.
+ */
+unsigned long stm_ab_hist_percentile(const stm_ab_hist_t *hist, double percentile)
+{
+  unsigned long target, total, v;
+  unsigned int i;
+
+  for (i = 0, total = 0; i < STM_AB_HIST_SIZE; i++)
+    total += hist->buckets[i];
+  if (total == 0)
+    return 0;
+  if (percentile <= 0.0)
+    return hist->min;
+  target = (unsigned long)ceil(total * percentile / 100.0);
+  if (target == 0)
+    target = 1;
+  if (target > total)
+    target = total;
+  for (i = 0, total = 0; i < STM_AB_HIST_SIZE; i++) {
+    total += hist->buckets[i];
+    if (total >= target)
+      break;
+  }
+  v = hist_value(i);
+  if (v > hist->max)
+    v = hist->max;
+  if (v < hist->min)
+    v = hist->min;
+  return v;
+}
+
+/*
+ * Return merged histogram of atomic block (without locking).
+ */
+int stm_get_ab_hist(int id, int type, stm_ab_hist_t *hist)
+{
+  ab_hist_thread_t *t;
+  ab_hist_entry_t *e;
+
+  if (type < 0 || type >= STM_AB_HIST_NB)
+    return 0;
+
+  hist_init(hist);
+  for (t = (ab_hist_thread_t *)ATOMIC_LOAD_ACQ(&ab_hist_threads); t != NULL; t = t->next) {
+    if ((e = hist_find(t, id)) != NULL)
+      stm_ab_hist_merge(hist, &e->hist[type]);
+  }
+
+  return hist->count > 0;
+}
+
+/*
+ * Compare ints.
+ */
+static int compare_ints(const void *a, const void *b)
+{
+  const int *ia = (const int *)a;
+  const int *ib = (const int *)b;
+  return (*ia < *ib ? -1 : (*ia > *ib ? 1 : 0));
+}
+
+/*
+ * Print histograms of all atomic blocks.
+ */
+void stm_ab_hist_dump(FILE *f)
+{
+  static const char *names[STM_AB_HIST_NB] = { "first", "total", "retries" };
+  ab_hist_thread_t *t;
+  ab_hist_table_t *table;
+  ab_hist_entry_t *e;
+  stm_ab_hist_t *hist;
+  unsigned int i, nb, size;
+  int *ids, type;
+
+  /* Collect identifiers of atomic blocks */
+  nb = 0;
+  size = NB_ATOMIC_BLOCKS;
+  ids = (int *)xmalloc(size * sizeof(int));
+  for (t = (ab_hist_thread_t *)ATOMIC_LOAD_ACQ(&ab_hist_threads); t != NULL; t = t->next) {
+    table = (ab_hist_table_t *)ATOMIC_LOAD_ACQ(&t->table);
+    for (i = 0; i < table->size; i++) {
+      if ((e = (ab_hist_entry_t *)ATOMIC_LOAD_ACQ(&table->entries[i])) == NULL)
+        continue;
+      if (nb == size) {
+        size *= 2;
+        ids = (int *)xrealloc(ids, size * sizeof(int));
+      }
+      ids[nb++] = e->id;
+    }
+  }
+  qsort(ids, nb, sizeof(int), compare_ints);
+
+  hist = (stm_ab_hist_t *)xmalloc(sizeof(stm_ab_hist_t));
+  for (i = 0; i < nb; i++) {
+    if (i > 0 && ids[i] == ids[i - 1])
+      continue;
+    fprintf(f, "Atomic block  : %d\n", ids[i]);
+    for (type = 0; type < STM_AB_HIST_NB; type++) {
+      if (!stm_get_ab_hist(ids[i], type, hist))
+        continue;
+      fprintf(f, "  %-8s: #=%lu min=%lu mean=%.1f p50=%lu p90=%lu p99=%lu p99.9=%lu max=%lu\n",
+              names[type], hist->count, hist->min, (double)hist->sum / hist->count,
+              stm_ab_hist_percentile(hist, 50), stm_ab_hist_percentile(hist, 90),
+              stm_ab_hist_percentile(hist, 99), stm_ab_hist_percentile(hist, 99.9),
+              hist->max);
+    }
+  }
+  xfree(hist);
+  xfree(ids);
+}
+
 /*
  * Initialize module.
  */
 void mod_ab_init(int freq, int (*check)(void))
 {
-  int i;
   char *s;
 
   if (mod_ab_initialized)
@@ -451,8 +834,9 @@ void mod_ab_init(int freq, int (*check)(void))
     fprintf(stderr, "Error creating mutex\n");
     exit(1);
   }
-  for (i = 0; i < NB_ATOMIC_BLOCKS; i++)
-    ab_list[i] = NULL;
+  ab_list_size = NB_ATOMIC_BLOCKS;
+  ab_list_nb = 0;
+  ab_list = (ab_stats_t **)xcalloc(ab_list_size, sizeof(ab_stats_t *));
   atexit(cleanup);
   mod_ab_initialized = 1;
 }
@@ -0,0 +1,284 @@
+/*
+ * File:
+ *   mod_batch.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for batching small independent operations.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mod_batch.h"
+
+#include "atomic.h"
+#include "stm.h"
+#include "utils.h"
+
+/* ################################################################### *
+ * TYPES
+ * ################################################################### */
+
+typedef struct mod_batch_op {
+  stm_batch_fn_t f;
+  void *arg;
+} mod_batch_op_t;
+
+/*
+ * Buffers and statistics are kept in per-thread slots that are never
+ * freed, as in mod_stats: statistics of exited threads remain visible
+ * and slots are reused by the next threads.  The progress of a flush is
+ * kept in the slot rather than in local variables, which are not
+ * preserved by siglongjmp() upon abort.
+ */
+typedef struct mod_batch_data {
+  mod_batch_op_t *ops;                  /* Buffered operations */
+  unsigned int nb_ops;                  /* Number of buffered operations */
+  unsigned int done;                    /* Operations already committed */
+  unsigned int n;                       /* Operations of current batch */
+  unsigned int size;                    /* Current maximum batch size */
+  int active;                           /* Are operations buffered? */
+  stm_batch_stats_t stats;              /* Statistics (cumulative) */
+  volatile stm_word_t used;             /* Is slot used by a thread? */
+  struct mod_batch_data *next;          /* Next slot */
+} ALIGNED mod_batch_data_t;
+
+static int mod_batch_key;
+static int mod_batch_initialized = 0;
+static unsigned int mod_batch_max_size;
+
+static mod_batch_data_t *volatile mod_batch_slots = NULL;
+
+/* ################################################################### *
+ * STATIC
+ * ################################################################### */
+
+/*
+ * Index of log2 bucket of histogram (i for [2^(i-1), 2^i)).
+ */
+static INLINE unsigned int
+mod_batch_bucket(unsigned int n)
+{
+  unsigned int i;
+
+#ifdef __GNUC__
+  i = (n == 0 ? 0 : sizeof(unsigned int) * 8 - __builtin_clz(n));
+#else /* ! __GNUC__ */
+  for (i = 0; n > 0; i++)
+    n >>= 1;
+#endif /* ! __GNUC__ */
+  return (i < STM_BATCH_HIST_SIZE ? i : STM_BATCH_HIST_SIZE - 1);
+}
+
+static INLINE mod_batch_data_t *
+mod_batch_get(void)
+{
+  mod_batch_data_t *b;
+
+  if (!mod_batch_initialized) {
+    fprintf(stderr, "Module mod_batch not initialized\n");
+    exit(1);
+  }
+
+  b = (mod_batch_data_t *)stm_get_specific(mod_batch_key);
+  assert(b != NULL);
+  return b;
+}
+
+/*
+ * Execute buffered operations in as few transactions as possible.
+ * Cannot be inlined as it uses sigsetjmp().
+ */
+static void
+mod_batch_run(mod_batch_data_t *b)
+{
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  unsigned int i;
+
+  attr.attrs = 0;
+  while (b->done < b->nb_ops) {
+    b->n = b->nb_ops - b->done;
+    if (b->n > b->size)
+      b->n = b->size;
+    e = stm_start(attr);
+    if (e == NULL) {
+      /* Nested: all operations are part of the enclosing transaction */
+      for (i = b->done; i < b->nb_ops; i++)
+        b->ops[i].f(b->ops[i].arg);
+      stm_commit();
+      break;
+    }
+    if (sigsetjmp(*e, 0) != 0) {
+      /* Aborted: retry with half of the operations (binary backoff) */
+      b->stats.aborts++;
+      if (b->n > 1) {
+        b->n >>= 1;
+        b->size = b->n;
+        b->stats.splits++;
+      }
+    }
+    for (i = b->done; i < b->done + b->n; i++)
+      b->ops[i].f(b->ops[i].arg);
+    stm_commit();
+    b->done += b->n;
+    b->stats.ops += b->n;
+    b->stats.batches++;
+    b->stats.size_hist[mod_batch_bucket(b->n)]++;
+    /* Grow again slowly */
+    if (b->size < mod_batch_max_size)
+      b->size++;
+  }
+  b->nb_ops = b->done = 0;
+}
+
+/* ################################################################### *
+ * FUNCTIONS
+ * ################################################################### */
+
+void stm_batch_begin(void)
+{
+  mod_batch_get()->active = 1;
+}
+
+unsigned int stm_batch_op(stm_batch_fn_t f, void *arg)
+{
+  mod_batch_data_t *b;
+
+  b = mod_batch_get();
+  if (stm_active()) {
+    /* Part of the enclosing transaction */
+    f(arg);
+    return b->nb_ops;
+  }
+  b->ops[b->nb_ops].f = f;
+  b->ops[b->nb_ops].arg = arg;
+  if (++b->nb_ops == mod_batch_max_size || !b->active)
+    mod_batch_run(b);
+  return b->nb_ops;
+}
+
+unsigned int stm_batch_pending(void)
+{
+  return mod_batch_get()->nb_ops;
+}
+
+void stm_batch_flush(void)
+{
+  mod_batch_data_t *b;
+
+  b = mod_batch_get();
+  mod_batch_run(b);
+  b->active = 0;
+}
+
+/*
+ * Sum statistics of all threads (without locking).
+ */
+void stm_batch_stats(stm_batch_stats_t *stats)
+{
+  mod_batch_data_t *b;
+  int i;
+
+  if (!mod_batch_initialized) {
+    fprintf(stderr, "Module mod_batch not initialized\n");
+    exit(1);
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  for (b = (mod_batch_data_t *)ATOMIC_LOAD_ACQ(&mod_batch_slots); b != NULL; b = b->next) {
+    stats->ops += ATOMIC_LOAD(&b->stats.ops);
+    stats->batches += ATOMIC_LOAD(&b->stats.batches);
+    stats->aborts += ATOMIC_LOAD(&b->stats.aborts);
+    stats->splits += ATOMIC_LOAD(&b->stats.splits);
+    for (i = 0; i < STM_BATCH_HIST_SIZE; i++)
+      stats->size_hist[i] += ATOMIC_LOAD(&b->stats.size_hist[i]);
+  }
+}
+
+/*
+ * Called upon thread creation.
+ */
+static void mod_batch_on_thread_init(void *arg)
+{
+  mod_batch_data_t *b, *head;
+
+  /* Reuse slot of exited thread if any */
+  for (b = (mod_batch_data_t *)ATOMIC_LOAD_ACQ(&mod_batch_slots); b != NULL; b = b->next) {
+    if (ATOMIC_LOAD(&b->used) == 0 && ATOMIC_CAS_FULL(&b->used, 0, 1) != 0)
+      break;
+  }
+  if (b == NULL) {
+    b = (mod_batch_data_t *)xmalloc_aligned(sizeof(mod_batch_data_t));
+    memset(b, 0, sizeof(mod_batch_data_t));
+    b->ops = (mod_batch_op_t *)xmalloc(mod_batch_max_size * sizeof(mod_batch_op_t));
+    b->used = 1;
+    do {
+      head = (mod_batch_data_t *)ATOMIC_LOAD(&mod_batch_slots);
+      b->next = head;
+    } while (ATOMIC_CAS_FULL(&mod_batch_slots, head, b) == 0);
+  }
+  b->nb_ops = b->done = 0;
+  b->size = mod_batch_max_size;
+  b->active = 0;
+
+  stm_set_specific(mod_batch_key, b);
+}
+
+/*
+ * Called upon thread deletion.
+ */
+static void mod_batch_on_thread_exit(void *arg)
+{
+  mod_batch_data_t *b;
+
+  b = (mod_batch_data_t *)stm_get_specific(mod_batch_key);
+  assert(b != NULL);
+
+  /* Other modules used by operations may already be finalized */
+  if (b->nb_ops != 0) {
+    fprintf(stderr, "WARNING: %u batched operations discarded (missing stm_batch_flush())\n", b->nb_ops);
+    b->nb_ops = 0;
+  }
+  ATOMIC_STORE_REL(&b->used, 0);
+}
+
+/*
+ * Initialize module.
+ */
+void mod_batch_init(unsigned int max_size)
+{
+  if (mod_batch_initialized)
+    return;
+
+  mod_batch_max_size = (max_size == 0 ? STM_BATCH_MAX_SIZE : max_size);
+  if (!stm_register(mod_batch_on_thread_init, mod_batch_on_thread_exit, NULL, NULL, NULL, NULL, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+  mod_batch_key = stm_create_specific();
+  if (mod_batch_key < 0) {
+    fprintf(stderr, "Cannot create specific key\n");
+    exit(1);
+  }
+  mod_batch_initialized = 1;
+}
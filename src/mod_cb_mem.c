@@ -24,8 +24,15 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef MEM_ARENA
+# include <sys/mman.h>
+#endif /* MEM_ARENA */
 
 #include "mod_cb.h"
 #include "mod_mem.h"
@@ -34,18 +41,138 @@
 #include "stm.h"
 #include "utils.h"
 #include "gc.h"
+#include "atomic.h"
 
 
 /* ################################################################### *
  * TYPES
  * ################################################################### */
 #define DEFAULT_CB_SIZE                 16
+/* Header of objects, whose last word is the lock (keeps the alignment of malloc()) */
+#define OBJ_HEADER_SIZE                 sizeof(max_align_t)
+
+#ifdef MEM_ARENA
+# ifndef MEM_ARENA_LOG_SIZE
+#  if UINTPTR_MAX > 0xFFFFFFFFUL
+#   define MEM_ARENA_LOG_SIZE           32
+#  else /* UINTPTR_MAX <= 0xFFFFFFFFUL */
+#   define MEM_ARENA_LOG_SIZE           28
+#  endif /* UINTPTR_MAX <= 0xFFFFFFFFUL */
+# endif /* ! MEM_ARENA_LOG_SIZE */
+# ifndef MEM_ARENA_CHUNK_LOG_SIZE
+#  define MEM_ARENA_CHUNK_LOG_SIZE      16
+# endif /* ! MEM_ARENA_CHUNK_LOG_SIZE */
+# define MEM_ARENA_SIZE                 ((size_t)1 << MEM_ARENA_LOG_SIZE)
+# define MEM_ARENA_CHUNK_SIZE           ((size_t)1 << MEM_ARENA_CHUNK_LOG_SIZE)
+# define MEM_ARENA_NB_CHUNKS            ((size_t)1 << (MEM_ARENA_LOG_SIZE - MEM_ARENA_CHUNK_LOG_SIZE))
+/* Size classes are powers of 2 from 16 to 2048 bytes */
+# define MEM_ARENA_MIN_LOG_SIZE         4
+# define MEM_ARENA_CLASSES              8
+# define MEM_ARENA_MAX_SIZE             ((size_t)1 << (MEM_ARENA_MIN_LOG_SIZE + MEM_ARENA_CLASSES - 1))
+# define MEM_ARENA_STACK_SIZE           64
+
+/*
+ * Each thread carves blocks of a size class from chunks that it owns
+ * and keeps freed blocks on a stack.  Blocks do not have headers: the
+ * owner and size class are found in the descriptor of the chunk, given
+ * by the offset of the block in the reserved address range.  At the
+ * first allocation of a class in a transaction, blocks released by
+ * other threads (or by the GC) are moved to the stack and the state of
+ * the class is recorded as a watermark.  Within a transaction, blocks
+ * are only popped from the stack or carved from chunks, hence an abort
+ * simply restores the watermark.
+ */
+typedef struct mod_mem_chunk {          /* Descriptor of a chunk */
+  struct mod_mem_arena *owner;          /* Arena owning the chunk */
+  struct mod_mem_chunk *next;           /* Next chunk of same class */
+  unsigned int cls;                     /* Size class of blocks */
+} mod_mem_chunk_t;
+
+typedef struct mod_mem_mark {           /* Allocation state of a class */
+  unsigned int top;                     /* Number of blocks on the stack */
+  mod_mem_chunk_t *chunk;               /* Chunk being carved */
+  char *bump;                           /* Next free block of chunk */
+} mod_mem_mark_t;
+
+typedef struct mod_mem_class {          /* Size class of an arena */
+  mod_mem_mark_t cur;                   /* Current state */
+  mod_mem_mark_t mark;                  /* Watermark of current transaction */
+  unsigned long seq;                    /* Transaction of watermark */
+  mod_mem_chunk_t *first;               /* First chunk of class */
+  unsigned int size;                    /* Capacity of the stack */
+  void **free;                          /* Stack of free blocks */
+  volatile stm_word_t remote;           /* Blocks released by other threads */
+} mod_mem_class_t;
+
+typedef struct mod_mem_arena {          /* Arena of a thread */
+  mod_mem_class_t cls[MEM_ARENA_CLASSES];
+  unsigned long seq;                    /* Current transaction */
+  unsigned long pending;                /* Blocks allocated in current transaction */
+  unsigned long allocs;                 /* Blocks allocated by committed transactions */
+  unsigned long rewinds;                /* Blocks returned upon abort */
+  unsigned long frees;                  /* Blocks returned to the stacks */
+  unsigned long fallbacks;              /* Allocations served by the system */
+  struct mod_mem_arena *next;           /* Next arena */
+  struct mod_mem_arena *next_orphan;    /* Next arena without thread */
+} mod_mem_arena_t;
+
+static struct {
+  char *base;                           /* Reserved address range */
+  mod_mem_chunk_t *chunks;              /* Descriptors of chunks */
+  volatile stm_word_t nb_chunks;        /* Number of chunks handed out */
+  pthread_mutex_t lock;                 /* Protects lists of arenas */
+  mod_mem_arena_t *arenas;              /* All arenas */
+  mod_mem_arena_t *orphans;             /* Arenas of exited threads */
+} mod_arena;
+#endif /* MEM_ARENA */
 
 typedef struct mod_cb_entry {           /* Callback entry */
   void (*f)(void *);                    /* Function */
   void *arg;                            /* Argument to be passed to function */
 } mod_cb_entry_t;
 
+typedef struct mod_cb_action {          /* Asynchronous commit action */
+  void (*f)(void *);                    /* Function */
+  void *arg;                            /* Argument to be passed to function */
+  struct mod_cb_action *volatile next;  /* Next action in queue */
+} mod_cb_action_t;
+
+/*
+ * Each executor drains an intrusive MPSC queue (producers exchange the
+ * head, the executor pops from the tail, a stub node keeps the queue
+ * non-empty).  Each thread always submits to the same executor, hence
+ * the actions of a thread are executed in commit order.
+ */
+typedef struct mod_cb_executor {        /* Executor thread */
+  volatile stm_word_t head ALIGNED;     /* Last action (producers) */
+  volatile stm_word_t submitted;        /* Number of submitted actions (producers) */
+  volatile stm_word_t sleeping;         /* Is executor waiting for actions? */
+  mod_cb_action_t *tail ALIGNED;        /* Next action to execute (executor) */
+  volatile stm_word_t done;             /* Number of executed actions (executor) */
+  mod_cb_action_t stub;                 /* Stub node */
+  pthread_mutex_t mutex;                /* Mutex for sleeping */
+  pthread_cond_t cond;                  /* Condition for sleeping */
+  pthread_t thread;                     /* Thread */
+} ALIGNED mod_cb_executor_t;
+
+static struct {
+  mod_cb_executor_t *executors;         /* Executors (NULL if disabled) */
+  unsigned int nb;                      /* Number of executors */
+  volatile stm_word_t next;             /* Next executor to assign to a thread */
+  volatile stm_word_t stop;             /* Should executors stop? */
+} mod_async;
+
+#ifdef CLOSED_NESTING
+typedef struct mod_cb_nested {          /* Closed nested transaction */
+  unsigned short commit_nb;             /* Number of commit callbacks upon start */
+  unsigned short abort_nb;              /* Number of abort callbacks upon start */
+# ifdef MEM_ARENA
+  unsigned long pending;                /* Number of arena blocks allocated upon start */
+  mod_mem_mark_t arena[MEM_ARENA_CLASSES]; /* Arena watermarks upon start */
+# endif /* MEM_ARENA */
+} mod_cb_nested_t;
+#endif /* CLOSED_NESTING */
+
 typedef struct mod_cb_info {
   unsigned short commit_size;           /* Array size for commit callbacks */
   unsigned short commit_nb;             /* Number of commit callbacks */
@@ -53,8 +180,32 @@ typedef struct mod_cb_info {
   unsigned short abort_size;            /* Array size for abort callbacks */
   unsigned short abort_nb;              /* Number of abort callbacks */
   mod_cb_entry_t *abort;                /* Abort callback entries */
+#ifdef CLOSED_NESTING
+  unsigned short nested_size;           /* Array size for closed nested transactions */
+  unsigned short nested_nb;             /* Number of active closed nested transactions */
+  mod_cb_nested_t *nested;              /* Closed nested transactions */
+#endif /* CLOSED_NESTING */
+#ifdef MEM_ARENA
+  mod_mem_arena_t *arena;               /* Arena of thread (NULL if disabled) */
+#endif /* MEM_ARENA */
+  unsigned long stripe_nb;              /* Number of stripe-aligned blocks */
+  unsigned long stripe_size;            /* Bytes requested for stripe-aligned blocks */
+  unsigned long stripe_waste;           /* Padding bytes of stripe-aligned blocks */
+  mod_cb_executor_t *executor;          /* Executor of asynchronous actions */
+  mod_cb_action_t *async_first;         /* First action of committing transaction */
+  mod_cb_action_t *async_last;          /* Last action of committing transaction */
+  unsigned long async_nb;               /* Number of actions of committing transaction */
+  struct mod_cb_info *next;             /* Next thread */
 } mod_cb_info_t;
 
+static struct {                         /* Statistics of stripe-aligned blocks */
+  pthread_mutex_t lock;                 /* Protects list of threads */
+  mod_cb_info_t *threads;               /* Active threads */
+  unsigned long nb;                     /* Blocks of exited threads */
+  unsigned long size;                   /* Bytes requested by exited threads */
+  unsigned long waste;                  /* Padding bytes of exited threads */
+} mod_stripe = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 };
+
 /* TODO: to avoid false sharing, this should be in a dedicated cacheline.
  * Unfortunately this will cost one cache line for each module. Probably
  * mod_cb_mem could be included always in mainline stm since allocation is
@@ -127,6 +278,604 @@ int stm_on_commit(void (*on_commit)(void *arg), void *arg)
   return 1;
 }
 
+/* ################################################################### *
+ * ASYNCHRONOUS ACTIONS FUNCTIONS
+ * ################################################################### */
+
+/*
+ * Append a list of actions to the queue of an executor (any thread).
+ */
+static INLINE void
+mod_async_push(mod_cb_executor_t *e, mod_cb_action_t *first, mod_cb_action_t *last)
+{
+  stm_word_t prev;
+
+  last->next = NULL;
+  do {
+    prev = (stm_word_t)ATOMIC_LOAD(&e->head);
+  } while (ATOMIC_CAS_FULL(&e->head, prev, (stm_word_t)last) == 0);
+  /* Link to the queue (the executor waits for the link if it gets there) */
+  ATOMIC_STORE_REL(&((mod_cb_action_t *)prev)->next, first);
+}
+
+/*
+ * Remove the first action from the queue of an executor (executor
+ * only).  Returns NULL if the queue is empty or if a producer has not
+ * linked its actions yet.
+ */
+static mod_cb_action_t *
+mod_async_pop(mod_cb_executor_t *e)
+{
+  mod_cb_action_t *t, *n;
+
+  t = e->tail;
+  n = (mod_cb_action_t *)ATOMIC_LOAD_ACQ(&t->next);
+  if (t == &e->stub) {
+    if (n == NULL)
+      return NULL;
+    /* Skip stub */
+    e->tail = t = n;
+    n = (mod_cb_action_t *)ATOMIC_LOAD_ACQ(&t->next);
+  }
+  if (n != NULL) {
+    e->tail = n;
+    return t;
+  }
+  if (t != (mod_cb_action_t *)ATOMIC_LOAD(&e->head))
+    return NULL;
+  /* Last action: put stub back behind it */
+  mod_async_push(e, &e->stub, &e->stub);
+  n = (mod_cb_action_t *)ATOMIC_LOAD_ACQ(&t->next);
+  if (n != NULL) {
+    e->tail = n;
+    return t;
+  }
+  return NULL;
+}
+
+/*
+ * Executor thread.
+ */
+static void *
+mod_async_executor(void *arg)
+{
+  mod_cb_executor_t *e = (mod_cb_executor_t *)arg;
+  mod_cb_action_t *a;
+  unsigned int i;
+
+  for (i = 0; ; i++) {
+    if ((a = mod_async_pop(e)) != NULL) {
+      a->f(a->arg);
+      xfree(a);
+      ATOMIC_STORE_REL(&e->done, e->done + 1);
+      i = 0;
+      continue;
+    }
+    if (ATOMIC_LOAD(&mod_async.stop) && ATOMIC_LOAD(&e->done) == ATOMIC_LOAD(&e->submitted))
+      break;
+    if (i < 1024)
+      continue;
+    /* Nothing to do for a while: sleep until producers submit actions */
+    pthread_mutex_lock(&e->mutex);
+    ATOMIC_STORE(&e->sleeping, 1);
+    ATOMIC_MB_FULL;
+    if (ATOMIC_LOAD(&e->done) == ATOMIC_LOAD(&e->submitted) && !ATOMIC_LOAD(&mod_async.stop))
+      pthread_cond_wait(&e->cond, &e->mutex);
+    ATOMIC_STORE(&e->sleeping, 0);
+    pthread_mutex_unlock(&e->mutex);
+    i = 0;
+  }
+
+  return NULL;
+}
+
+/*
+ * Wake up executor if it is sleeping.
+ */
+static INLINE void
+mod_async_wake(mod_cb_executor_t *e)
+{
+  ATOMIC_MB_FULL;
+  if (ATOMIC_LOAD(&e->sleeping)) {
+    pthread_mutex_lock(&e->mutex);
+    pthread_cond_signal(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
+  }
+}
+
+/*
+ * Commit callback of an asynchronous action: add to batch of
+ * transaction (commit callbacks are called in reverse order).
+ */
+static void
+mod_async_on_commit(void *arg)
+{
+  mod_cb_info_t *icb;
+  mod_cb_action_t *a = (mod_cb_action_t *)arg;
+
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  a->next = icb->async_first;
+  icb->async_first = a;
+  if (icb->async_last == NULL)
+    icb->async_last = a;
+  icb->async_nb++;
+}
+
+/*
+ * Abort callback of an asynchronous action.
+ */
+static void
+mod_async_on_abort(void *arg)
+{
+  xfree(arg);
+}
+
+/*
+ * Submit the actions of a committed transaction.
+ */
+static INLINE void
+mod_async_submit(mod_cb_info_t *icb)
+{
+  mod_cb_executor_t *e = icb->executor;
+
+  /* Count before pushing to never have done > submitted */
+  ATOMIC_FETCH_ADD_FULL(&e->submitted, icb->async_nb);
+  mod_async_push(e, icb->async_first, icb->async_last);
+  icb->async_first = icb->async_last = NULL;
+  icb->async_nb = 0;
+  mod_async_wake(e);
+}
+
+/*
+ * Register asynchronous commit action for the CURRENT transaction.
+ */
+int stm_on_commit_async(void (*on_commit)(void *arg), void *arg)
+{
+  mod_cb_info_t *icb;
+  mod_cb_action_t *a;
+
+  assert(mod_cb.key >= 0);
+  if (mod_async.executors == NULL)
+    return 0;
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  assert(icb != NULL);
+
+  if (unlikely(icb->executor == NULL)) {
+    /* Assign executors to threads in round-robin order */
+    icb->executor = &mod_async.executors[ATOMIC_FETCH_INC_FULL(&mod_async.next) % mod_async.nb];
+  }
+  a = (mod_cb_action_t *)xmalloc(sizeof(mod_cb_action_t));
+  a->f = on_commit;
+  a->arg = arg;
+  /* Use regular callbacks to handle aborts of (nested) transactions */
+  mod_cb_add_on_commit(icb, mod_async_on_commit, a);
+  mod_cb_add_on_abort(icb, mod_async_on_abort, a);
+
+  return 1;
+}
+
+/*
+ * Wait until all submitted actions have been executed.
+ */
+void mod_cb_drain(void)
+{
+  unsigned int i;
+  stm_word_t n;
+
+  for (i = 0; i < mod_async.nb; i++) {
+    n = ATOMIC_LOAD(&mod_async.executors[i].submitted);
+    while (ATOMIC_LOAD_ACQ(&mod_async.executors[i].done) < n)
+      sched_yield();
+  }
+}
+
+/*
+ * Stop executors once all actions have been executed.
+ */
+static void
+mod_async_cleanup(void)
+{
+  unsigned int i;
+
+  ATOMIC_STORE(&mod_async.stop, 1);
+  for (i = 0; i < mod_async.nb; i++) {
+    pthread_mutex_lock(&mod_async.executors[i].mutex);
+    pthread_cond_signal(&mod_async.executors[i].cond);
+    pthread_mutex_unlock(&mod_async.executors[i].mutex);
+    pthread_join(mod_async.executors[i].thread, NULL);
+    pthread_mutex_destroy(&mod_async.executors[i].mutex);
+    pthread_cond_destroy(&mod_async.executors[i].cond);
+  }
+  xfree(mod_async.executors);
+  mod_async.executors = NULL;
+  mod_async.nb = 0;
+}
+
+/*
+ * Start executors.
+ */
+static void
+mod_async_init(unsigned int nb)
+{
+  mod_cb_executor_t *e;
+  unsigned int i;
+
+  if (nb == 0)
+    nb = 1;
+  mod_async.executors = (mod_cb_executor_t *)xmalloc_aligned(nb * sizeof(mod_cb_executor_t));
+  memset(mod_async.executors, 0, nb * sizeof(mod_cb_executor_t));
+  mod_async.nb = nb;
+  mod_async.next = 0;
+  mod_async.stop = 0;
+  for (i = 0; i < nb; i++) {
+    e = &mod_async.executors[i];
+    e->stub.next = NULL;
+    e->head = (stm_word_t)&e->stub;
+    e->tail = &e->stub;
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    if (pthread_create(&e->thread, NULL, mod_async_executor, e) != 0) {
+      fprintf(stderr, "Cannot create executor thread\n");
+      exit(1);
+    }
+  }
+  atexit(mod_async_cleanup);
+}
+
+#ifdef MEM_ARENA
+/* ################################################################### *
+ * ARENA FUNCTIONS
+ * ################################################################### */
+
+static INLINE int
+mod_arena_contains(void *addr)
+{
+  return mod_arena.base != NULL && (char *)addr >= mod_arena.base && (char *)addr < mod_arena.base + MEM_ARENA_SIZE;
+}
+
+static INLINE mod_mem_chunk_t *
+mod_arena_chunk(void *addr)
+{
+  return &mod_arena.chunks[(size_t)((char *)addr - mod_arena.base) >> MEM_ARENA_CHUNK_LOG_SIZE];
+}
+
+static INLINE char *
+mod_arena_chunk_addr(mod_mem_chunk_t *k)
+{
+  return mod_arena.base + ((size_t)(k - mod_arena.chunks) << MEM_ARENA_CHUNK_LOG_SIZE);
+}
+
+static INLINE unsigned int
+mod_arena_class(size_t size)
+{
+  unsigned int cls = 0;
+
+  if (size > 0) {
+    size = (size - 1) >> MEM_ARENA_MIN_LOG_SIZE;
+    while (size > 0) {
+      cls++;
+      size >>= 1;
+    }
+  }
+  return cls;
+}
+
+/*
+ * Get a new chunk from the reserved address range.
+ */
+static mod_mem_chunk_t *
+mod_arena_new_chunk(mod_mem_arena_t *a, unsigned int cls)
+{
+  stm_word_t i;
+  mod_mem_chunk_t *k;
+
+  if ((size_t)ATOMIC_LOAD(&mod_arena.nb_chunks) >= MEM_ARENA_NB_CHUNKS)
+    return NULL;
+  i = (stm_word_t)ATOMIC_FETCH_INC_FULL(&mod_arena.nb_chunks);
+  if ((size_t)i >= MEM_ARENA_NB_CHUNKS) {
+    /* Address range exhausted */
+    return NULL;
+  }
+  k = &mod_arena.chunks[i];
+  k->owner = a;
+  k->cls = cls;
+  k->next = NULL;
+
+  return k;
+}
+
+/*
+ * Push free block on the stack of its class (owner only, outside of
+ * transactions or before recording the watermark).
+ */
+static INLINE void
+mod_arena_push(mod_mem_arena_t *a, mod_mem_class_t *c, void *b)
+{
+  if (unlikely(c->cur.top >= c->size)) {
+    c->size *= 2;
+    c->free = xrealloc(c->free, sizeof(void *) * c->size);
+  }
+  c->free[c->cur.top++] = b;
+  a->frees++;
+}
+
+/*
+ * Record watermark upon first allocation of a class in a transaction.
+ */
+static void
+mod_arena_mark(mod_mem_arena_t *a, mod_mem_class_t *c)
+{
+  stm_word_t l;
+  void *b;
+
+  /* Take back blocks released by other threads or the GC */
+  if (ATOMIC_LOAD(&c->remote) != 0) {
+    do {
+      l = (stm_word_t)ATOMIC_LOAD(&c->remote);
+    } while (ATOMIC_CAS_FULL(&c->remote, l, 0) == 0);
+    while ((b = (void *)l) != NULL) {
+      l = *(stm_word_t *)b;
+      mod_arena_push(a, c, b);
+    }
+  }
+  c->mark = c->cur;
+  c->seq = a->seq;
+}
+
+/*
+ * Allocate block from arena (NULL if no chunk is available).
+ */
+static INLINE void *
+mod_arena_alloc(mod_mem_arena_t *a, size_t size)
+{
+  mod_mem_class_t *c;
+  mod_mem_chunk_t *k, *n;
+  unsigned int cls;
+  size_t bs;
+  void *b;
+
+  cls = mod_arena_class(size);
+  c = &a->cls[cls];
+  if (c->seq != a->seq)
+    mod_arena_mark(a, c);
+
+  if (c->cur.top > 0) {
+    /* Reuse free block */
+    b = c->free[--c->cur.top];
+  } else {
+    bs = (size_t)1 << (cls + MEM_ARENA_MIN_LOG_SIZE);
+    k = c->cur.chunk;
+    if (k == NULL || c->cur.bump + bs > mod_arena_chunk_addr(k) + MEM_ARENA_CHUNK_SIZE) {
+      /* Move to next chunk (still owned after a rewind) or get a new one */
+      n = (k == NULL ? c->first : k->next);
+      if (n == NULL) {
+        if ((n = mod_arena_new_chunk(a, cls)) == NULL)
+          return NULL;
+        if (k == NULL)
+          c->first = n;
+        else
+          k->next = n;
+      }
+      c->cur.chunk = n;
+      c->cur.bump = mod_arena_chunk_addr(n);
+    }
+    b = c->cur.bump;
+    c->cur.bump += bs;
+  }
+  a->pending++;
+
+  return b;
+}
+
+/*
+ * Return block to the arena owning it (may be called by any thread).
+ */
+static void
+mod_arena_release(void *addr)
+{
+  mod_mem_chunk_t *k;
+  mod_mem_class_t *c;
+  stm_word_t l;
+
+  k = mod_arena_chunk(addr);
+  c = &k->owner->cls[k->cls];
+  do {
+    l = (stm_word_t)ATOMIC_LOAD(&c->remote);
+    *(stm_word_t *)addr = l;
+  } while (ATOMIC_CAS_FULL(&c->remote, l, (stm_word_t)addr) == 0);
+}
+
+/*
+ * Called upon commit.
+ */
+static INLINE void
+mod_arena_commit(mod_mem_arena_t *a)
+{
+  a->allocs += a->pending;
+  a->pending = 0;
+  a->seq++;
+}
+
+/*
+ * Called upon abort: restore the watermarks.
+ */
+static INLINE void
+mod_arena_rewind(mod_mem_arena_t *a)
+{
+  unsigned int i;
+
+  for (i = 0; i < MEM_ARENA_CLASSES; i++) {
+    if (a->cls[i].seq == a->seq)
+      a->cls[i].cur = a->cls[i].mark;
+  }
+  a->rewinds += a->pending;
+  a->pending = 0;
+  a->seq++;
+}
+
+/*
+ * Get an arena for a new thread (preferably one of an exited thread).
+ */
+static mod_mem_arena_t *
+mod_arena_get(void)
+{
+  mod_mem_arena_t *a;
+  unsigned int i;
+
+  pthread_mutex_lock(&mod_arena.lock);
+  if ((a = mod_arena.orphans) != NULL) {
+    mod_arena.orphans = a->next_orphan;
+  } else {
+    a = (mod_mem_arena_t *)xmalloc(sizeof(mod_mem_arena_t));
+    for (i = 0; i < MEM_ARENA_CLASSES; i++) {
+      a->cls[i].cur.top = 0;
+      a->cls[i].cur.chunk = NULL;
+      a->cls[i].cur.bump = NULL;
+      a->cls[i].seq = ~0UL;
+      a->cls[i].first = NULL;
+      a->cls[i].size = MEM_ARENA_STACK_SIZE;
+      a->cls[i].free = xmalloc(sizeof(void *) * a->cls[i].size);
+      a->cls[i].remote = 0;
+    }
+    a->seq = 0;
+    a->pending = a->allocs = a->rewinds = a->frees = a->fallbacks = 0;
+    a->next = mod_arena.arenas;
+    mod_arena.arenas = a;
+  }
+  pthread_mutex_unlock(&mod_arena.lock);
+
+  return a;
+}
+
+/*
+ * Keep arena of exiting thread (its blocks may still be in use).
+ */
+static void
+mod_arena_put(mod_mem_arena_t *a)
+{
+  pthread_mutex_lock(&mod_arena.lock);
+  a->next_orphan = mod_arena.orphans;
+  mod_arena.orphans = a;
+  pthread_mutex_unlock(&mod_arena.lock);
+}
+
+/*
+ * Arena statistics.
+ */
+static int
+mod_arena_get_parameter(const char *name, void *val)
+{
+  mod_mem_arena_t *a;
+  unsigned long allocs, rewinds, frees, fallbacks, chunks;
+
+  allocs = rewinds = frees = fallbacks = 0;
+  pthread_mutex_lock(&mod_arena.lock);
+  for (a = mod_arena.arenas; a != NULL; a = a->next) {
+    allocs += a->allocs;
+    rewinds += a->rewinds;
+    frees += a->frees;
+    fallbacks += a->fallbacks;
+  }
+  pthread_mutex_unlock(&mod_arena.lock);
+  chunks = (unsigned long)ATOMIC_LOAD(&mod_arena.nb_chunks);
+  if (chunks > MEM_ARENA_NB_CHUNKS)
+    chunks = MEM_ARENA_NB_CHUNKS;
+
+  if (strcmp("arena_chunk_size", name) == 0) {
+    *(unsigned long *)val = MEM_ARENA_CHUNK_SIZE;
+    return 1;
+  }
+  if (strcmp("arena_chunks", name) == 0) {
+    *(unsigned long *)val = chunks;
+    return 1;
+  }
+  if (strcmp("arena_allocs", name) == 0) {
+    *(unsigned long *)val = allocs;
+    return 1;
+  }
+  if (strcmp("arena_rewinds", name) == 0) {
+    *(unsigned long *)val = rewinds;
+    return 1;
+  }
+  if (strcmp("arena_frees", name) == 0) {
+    *(unsigned long *)val = frees;
+    return 1;
+  }
+  if (strcmp("arena_fallbacks", name) == 0) {
+    *(unsigned long *)val = fallbacks;
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Reserve address range of arenas.
+ */
+static void
+mod_arena_init(void)
+{
+  char *p;
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+# ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE;
+# endif /* MAP_NORESERVE */
+  /* Add one chunk to align the range on chunk boundaries */
+  p = mmap(NULL, MEM_ARENA_SIZE + MEM_ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  mod_arena.base = (char *)(((uintptr_t)p + MEM_ARENA_CHUNK_SIZE - 1) & ~(uintptr_t)(MEM_ARENA_CHUNK_SIZE - 1));
+  mod_arena.chunks = (mod_mem_chunk_t *)xcalloc(MEM_ARENA_NB_CHUNKS, sizeof(mod_mem_chunk_t));
+  mod_arena.nb_chunks = 0;
+  pthread_mutex_init(&mod_arena.lock, NULL);
+  mod_arena.arenas = mod_arena.orphans = NULL;
+}
+#endif /* MEM_ARENA */
+
+/*
+ * Module statistics (accessed using stm_get_parameter()).
+ */
+static int
+mod_mem_get_parameter(const char *name, void *val, void *arg)
+{
+  mod_cb_info_t *icb;
+  unsigned long nb, size, waste;
+
+#ifdef MEM_ARENA
+  if (strncmp("arena_", name, 6) == 0)
+    return mod_arena.base != NULL && mod_arena_get_parameter(name, val);
+#endif /* MEM_ARENA */
+  if (strncmp("stripe_", name, 7) != 0)
+    return 0;
+
+  pthread_mutex_lock(&mod_stripe.lock);
+  nb = mod_stripe.nb;
+  size = mod_stripe.size;
+  waste = mod_stripe.waste;
+  for (icb = mod_stripe.threads; icb != NULL; icb = icb->next) {
+    nb += icb->stripe_nb;
+    size += icb->stripe_size;
+    waste += icb->stripe_waste;
+  }
+  pthread_mutex_unlock(&mod_stripe.lock);
+
+  if (strcmp("stripe_allocs", name) == 0) {
+    *(unsigned long *)val = nb;
+    return 1;
+  }
+  if (strcmp("stripe_bytes", name) == 0) {
+    *(unsigned long *)val = size;
+    return 1;
+  }
+  if (strcmp("stripe_waste", name) == 0) {
+    *(unsigned long *)val = waste;
+    return 1;
+  }
+  return 0;
+}
+
 /* ################################################################### *
  * MEMORY ALLOCATION FUNCTIONS
  * ################################################################### */
@@ -148,6 +897,15 @@ int_stm_malloc(struct stm_tx *tx, size_t size)
     size = (size + 7) & ~(size_t)0x07;
   }
 
+#ifdef MEM_ARENA
+  if (icb->arena != NULL) {
+    /* Memory will be reclaimed upon abort by rewinding the arena */
+    if (likely(size <= MEM_ARENA_MAX_SIZE) && (addr = mod_arena_alloc(icb->arena, size)) != NULL)
+      return addr;
+    icb->arena->fallbacks++;
+  }
+#endif /* MEM_ARENA */
+
   addr = xmalloc(size);
 
   mod_cb_add_on_abort(icb, free, addr);
@@ -187,6 +945,18 @@ void *int_stm_calloc(struct stm_tx *tx, size_t nm, size_t size)
     size = (size + 7) & ~(size_t)0x07;
   }
 
+#ifdef MEM_ARENA
+  if (icb->arena != NULL) {
+    /* Memory will be reclaimed upon abort by rewinding the arena */
+    if (likely(nm <= MEM_ARENA_MAX_SIZE && size <= MEM_ARENA_MAX_SIZE && nm * size <= MEM_ARENA_MAX_SIZE)
+        && (addr = mod_arena_alloc(icb->arena, nm * size)) != NULL) {
+      memset(addr, 0, nm * size);
+      return addr;
+    }
+    icb->arena->fallbacks++;
+  }
+#endif /* MEM_ARENA */
+
   addr = xcalloc(nm, size);
 
   mod_cb_add_on_abort(icb, free, addr);
@@ -208,6 +978,103 @@ void *stm_calloc_tx(struct stm_tx *tx, size_t nm, size_t size)
   return int_stm_calloc(tx, nm, size);
 }
 
+/*
+ * Number of bytes covered by a lock (read upon each allocation as the
+ * lock array may be tuned at runtime with AUTO_TUNE).
+ */
+static inline
+size_t mod_mem_stripe(void)
+{
+  unsigned long stripe;
+
+  if (!stm_get_parameter("stripe_size", &stripe) || stripe < sizeof(void *))
+    stripe = sizeof(void *);
+
+  return (size_t)stripe;
+}
+
+static inline
+void *int_stm_malloc_aligned(struct stm_tx *tx, size_t size)
+{
+  /* Memory will be freed upon abort */
+  mod_cb_info_t *icb;
+  void *addr;
+  size_t s, stripe;
+
+  assert(mod_cb.key >= 0);
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  assert(icb != NULL);
+
+  /* Pad to stripe boundary so that no other block shares the locks */
+  stripe = mod_mem_stripe();
+  s = (size + stripe - 1) & ~(stripe - 1);
+  if (s == 0)
+    s = stripe;
+
+#ifdef MEM_ARENA
+  if (icb->arena != NULL) {
+    /* Blocks of a size class are aligned on their (power of 2) size */
+    if (likely(s <= MEM_ARENA_MAX_SIZE) && (addr = mod_arena_alloc(icb->arena, s)) != NULL) {
+      icb->stripe_nb++;
+      icb->stripe_size += size;
+      icb->stripe_waste += ((size_t)1 << (mod_arena_class(s) + MEM_ARENA_MIN_LOG_SIZE)) - size;
+      return addr;
+    }
+    icb->arena->fallbacks++;
+  }
+#endif /* MEM_ARENA */
+
+  addr = xmemalign(stripe, s);
+
+  mod_cb_add_on_abort(icb, free, addr);
+
+  icb->stripe_nb++;
+  icb->stripe_size += size;
+  icb->stripe_waste += s - size;
+
+  return addr;
+}
+
+/*
+ * Called by the CURRENT thread to allocate stripe-aligned memory within a transaction.
+ */
+void *stm_malloc_aligned(size_t size)
+{
+  struct stm_tx *tx = stm_current_tx();
+  return int_stm_malloc_aligned(tx, size);
+}
+
+void *stm_malloc_aligned_tx(struct stm_tx *tx, size_t size)
+{
+  return int_stm_malloc_aligned(tx, size);
+}
+
+static inline
+void *int_stm_malloc_obj(struct stm_tx *tx, size_t size)
+{
+  char *obj;
+
+  /* The lock of the object precedes it (no version committed yet) */
+  obj = (char *)int_stm_malloc(tx, size + OBJ_HEADER_SIZE) + OBJ_HEADER_SIZE;
+  *((volatile stm_word_t *)obj - 1) = 0;
+
+  return (void *)obj;
+}
+
+/*
+ * Called by the CURRENT thread to allocate an object within a transaction.
+ */
+void *stm_malloc_obj(size_t size)
+{
+  struct stm_tx *tx = stm_current_tx();
+  return int_stm_malloc_obj(tx, size);
+}
+
+void *stm_malloc_obj_tx(struct stm_tx *tx, size_t size)
+{
+  return int_stm_malloc_obj(tx, size);
+}
+
 #ifdef EPOCH_GC
 static void
 epoch_free(void *addr)
@@ -222,6 +1089,29 @@ epoch_free(void *addr)
 }
 #endif /* EPOCH_GC */
 
+#ifdef MEM_ARENA
+static void
+arena_free(void *addr)
+{
+  mod_cb_info_t *icb;
+
+# ifdef EPOCH_GC
+  if (mod_cb.use_gc) {
+    /* Return to owner after the grace period */
+    gc_free_cb(addr, stm_get_clock(), mod_arena_release);
+    return;
+  }
+# endif /* EPOCH_GC */
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  if (icb->arena != NULL && mod_arena_chunk(addr)->owner == icb->arena) {
+    /* Called upon commit: no watermark to preserve */
+    mod_arena_push(icb->arena, &icb->arena->cls[mod_arena_chunk(addr)->cls], addr);
+  } else {
+    mod_arena_release(addr);
+  }
+}
+#endif /* MEM_ARENA */
+
 static inline
 void int_stm_free2(struct stm_tx *tx, void *addr, size_t idx, size_t size)
 {
@@ -250,6 +1140,12 @@ void int_stm_free2(struct stm_tx *tx, void *addr, size_t idx, size_t size)
     }
   }
   /* Schedule for removal */
+#ifdef MEM_ARENA
+  if (mod_arena_contains(addr)) {
+    mod_cb_add_on_commit(icb, arena_free, addr);
+    return;
+  }
+#endif /* MEM_ARENA */
 #ifdef EPOCH_GC
   mod_cb_add_on_commit(icb, epoch_free, addr);
 #else /* ! EPOCH_GC */
@@ -285,6 +1181,33 @@ void stm_free_tx(struct stm_tx *tx, void *addr, size_t size)
   int_stm_free2(tx, addr, 0, size);
 }
 
+static inline
+void int_stm_free_obj(struct stm_tx *tx, void *obj, size_t size)
+{
+#ifdef OBJECT_LOCKS
+  /* All fields are covered by the lock of the object */
+  if (size > 0)
+    stm_store2_obj_tx(tx, obj, (volatile stm_word_t *)obj, 0, 0);
+  int_stm_free2(tx, (char *)obj - OBJ_HEADER_SIZE, 0, 0);
+#else /* ! OBJECT_LOCKS */
+  int_stm_free2(tx, (char *)obj - OBJ_HEADER_SIZE, OBJ_HEADER_SIZE, size);
+#endif /* ! OBJECT_LOCKS */
+}
+
+/*
+ * Called by the CURRENT thread to free an object within a transaction.
+ */
+void stm_free_obj(void *obj, size_t size)
+{
+  struct stm_tx *tx = stm_current_tx();
+  int_stm_free_obj(tx, obj, size);
+}
+
+void stm_free_obj_tx(struct stm_tx *tx, void *obj, size_t size)
+{
+  int_stm_free_obj(tx, obj, size);
+}
+
 
 /*
  * Called upon transaction commit.
@@ -301,8 +1224,18 @@ static void mod_cb_on_commit(void *arg)
     icb->commit_nb--;
     icb->commit[icb->commit_nb].f(icb->commit[icb->commit_nb].arg);
   }
+  /* Hand asynchronous actions over to executor */
+  if (icb->async_first != NULL)
+    mod_async_submit(icb);
   /* Reset abort callback */
   icb->abort_nb = 0;
+#ifdef MEM_ARENA
+  if (icb->arena != NULL)
+    mod_arena_commit(icb->arena);
+#endif /* MEM_ARENA */
+#ifdef CLOSED_NESTING
+  icb->nested_nb = 0;
+#endif /* CLOSED_NESTING */
 }
 
 /*
@@ -322,7 +1255,96 @@ static void mod_cb_on_abort(void *arg)
   }
   /* Reset commit callback */
   icb->commit_nb = 0;
+#ifdef MEM_ARENA
+  if (icb->arena != NULL)
+    mod_arena_rewind(icb->arena);
+#endif /* MEM_ARENA */
+#ifdef CLOSED_NESTING
+  icb->nested_nb = 0;
+#endif /* CLOSED_NESTING */
+}
+
+#ifdef CLOSED_NESTING
+/*
+ * Called upon closed nested transaction start.
+ */
+static void mod_cb_on_nested_start(void *arg)
+{
+  mod_cb_info_t *icb;
+
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  assert(icb != NULL);
+
+  if (unlikely(icb->nested_nb >= icb->nested_size)) {
+    icb->nested_size *= 2;
+    icb->nested = xrealloc(icb->nested, sizeof(mod_cb_nested_t) * icb->nested_size);
+  }
+  icb->nested[icb->nested_nb].commit_nb = icb->commit_nb;
+  icb->nested[icb->nested_nb].abort_nb = icb->abort_nb;
+# ifdef MEM_ARENA
+  if (icb->arena != NULL) {
+    mod_mem_arena_t *a = icb->arena;
+    unsigned int i;
+
+    for (i = 0; i < MEM_ARENA_CLASSES; i++) {
+      /* Record watermark of parent first */
+      if (a->cls[i].seq != a->seq)
+        mod_arena_mark(a, &a->cls[i]);
+      icb->nested[icb->nested_nb].arena[i] = a->cls[i].cur;
+    }
+    icb->nested[icb->nested_nb].pending = a->pending;
+  }
+# endif /* MEM_ARENA */
+  icb->nested_nb++;
+}
+
+/*
+ * Called upon closed nested transaction commit.
+ */
+static void mod_cb_on_nested_commit(void *arg)
+{
+  mod_cb_info_t *icb;
+
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  assert(icb != NULL && icb->nested_nb > 0);
+
+  /* Callbacks now belong to parent */
+  icb->nested_nb--;
+}
+
+/*
+ * Called upon closed nested transaction abort.
+ */
+static void mod_cb_on_nested_abort(void *arg)
+{
+  mod_cb_info_t *icb;
+  mod_cb_nested_t *n;
+
+  icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
+  assert(icb != NULL && icb->nested_nb > 0);
+
+  n = &icb->nested[--icb->nested_nb];
+  /* Call abort callbacks of nested transaction */
+  while (icb->abort_nb > n->abort_nb) {
+    icb->abort_nb--;
+    icb->abort[icb->abort_nb].f(icb->abort[icb->abort_nb].arg);
+  }
+  /* Drop commit callbacks of nested transaction */
+  icb->commit_nb = n->commit_nb;
+# ifdef MEM_ARENA
+  if (icb->arena != NULL) {
+    mod_mem_arena_t *a = icb->arena;
+    unsigned int i;
+
+    /* Rewind arena to start of nested transaction */
+    for (i = 0; i < MEM_ARENA_CLASSES; i++)
+      a->cls[i].cur = n->arena[i];
+    a->rewinds += a->pending - n->pending;
+    a->pending = n->pending;
+  }
+# endif /* MEM_ARENA */
 }
+#endif /* CLOSED_NESTING */
 
 /*
  * Called upon thread creation.
@@ -336,6 +1358,22 @@ static void mod_cb_on_thread_init(void *arg)
   icb->commit_size = icb->abort_size = DEFAULT_CB_SIZE;
   icb->commit = xmalloc(sizeof(mod_cb_entry_t) * icb->commit_size);
   icb->abort = xmalloc(sizeof(mod_cb_entry_t) * icb->abort_size);
+#ifdef CLOSED_NESTING
+  icb->nested_nb = 0;
+  icb->nested_size = DEFAULT_CB_SIZE;
+  icb->nested = xmalloc(sizeof(mod_cb_nested_t) * icb->nested_size);
+#endif /* CLOSED_NESTING */
+#ifdef MEM_ARENA
+  icb->arena = (mod_arena.base != NULL ? mod_arena_get() : NULL);
+#endif /* MEM_ARENA */
+  icb->stripe_nb = icb->stripe_size = icb->stripe_waste = 0;
+  icb->executor = NULL;
+  icb->async_first = icb->async_last = NULL;
+  icb->async_nb = 0;
+  pthread_mutex_lock(&mod_stripe.lock);
+  icb->next = mod_stripe.threads;
+  mod_stripe.threads = icb;
+  pthread_mutex_unlock(&mod_stripe.lock);
 
   stm_set_specific(mod_cb.key, icb);
 }
@@ -345,13 +1383,30 @@ static void mod_cb_on_thread_init(void *arg)
  */
 static void mod_cb_on_thread_exit(void *arg)
 {
-  mod_cb_info_t *icb;
+  mod_cb_info_t *icb, **p;
 
   icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
   assert(icb != NULL);
 
+  /* Keep statistics of thread */
+  pthread_mutex_lock(&mod_stripe.lock);
+  for (p = &mod_stripe.threads; *p != icb; p = &(*p)->next)
+    ;
+  *p = icb->next;
+  mod_stripe.nb += icb->stripe_nb;
+  mod_stripe.size += icb->stripe_size;
+  mod_stripe.waste += icb->stripe_waste;
+  pthread_mutex_unlock(&mod_stripe.lock);
+
   xfree(icb->abort);
   xfree(icb->commit);
+#ifdef CLOSED_NESTING
+  xfree(icb->nested);
+#endif /* CLOSED_NESTING */
+#ifdef MEM_ARENA
+  if (icb->arena != NULL)
+    mod_arena_put(icb->arena);
+#endif /* MEM_ARENA */
   xfree(icb);
 }
 
@@ -366,6 +1421,16 @@ mod_cb_mem_init(void)
     fprintf(stderr, "Cannot register callbacks\n");
     exit(1);
   }
+#ifdef CLOSED_NESTING
+  if (!stm_register_nested(mod_cb_on_nested_start, mod_cb_on_nested_commit, mod_cb_on_nested_abort, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+#endif /* CLOSED_NESTING */
+  if (!stm_register_parameter(mod_mem_get_parameter, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
   mod_cb.key = stm_create_specific();
   if (mod_cb.key < 0) {
     fprintf(stderr, "Cannot create specific key\n");
@@ -381,11 +1446,45 @@ void mod_cb_init(void)
   mod_cb_mem_init();
 }
 
+void mod_cb_init_async(unsigned int nb_executors)
+{
+  mod_cb_mem_init();
+  if (mod_async.executors == NULL)
+    mod_async_init(nb_executors);
+}
+
 void mod_mem_init(int use_gc)
 {
   mod_cb_mem_init();
 #ifdef EPOCH_GC
+# ifdef MULTI_VERSION
+  /* Read-only transactions may still access freed memory in their snapshot */
+  use_gc = 1;
+# endif /* MULTI_VERSION */
   mod_cb.use_gc = use_gc;
 #endif /* EPOCH_GC */
 }
 
+void mod_mem_init_arena(int use_gc)
+{
+  mod_mem_init(use_gc);
+#ifdef MEM_ARENA
+  if (mod_arena.base == NULL)
+    mod_arena_init();
+#endif /* MEM_ARENA */
+}
+
+/*
+ * Called outside of transactions to free memory allocated by stm_malloc().
+ */
+void mod_mem_free(void *addr)
+{
+#ifdef MEM_ARENA
+  if (mod_arena_contains(addr)) {
+    mod_arena_release(addr);
+    return;
+  }
+#endif /* MEM_ARENA */
+  xfree(addr);
+}
+
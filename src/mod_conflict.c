@@ -0,0 +1,435 @@
+/*
+ * File:
+ *   mod_conflict.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for profiling conflict hot spots.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "mod_conflict.h"
+
+#include "stm.h"
+#include "utils.h"
+
+/* ################################################################### *
+ * TYPES
+ * ################################################################### */
+
+#define BUFFER_SIZE                     1024
+#define NB_ENTRIES                      64      /* Initial size of tables */
+#define NB_REASONS                      16
+
+typedef struct conflict_sample {        /* Sampled abort */
+  long lock;                            /* Lock index (-1 if unknown) */
+  void *addr;                           /* Faulting address (NULL if unknown) */
+  int id;                               /* Atomic block identifier */
+  int owner;                            /* Conflicting atomic block identifier (-1 if unknown) */
+  unsigned int reason;                  /* Abort reason */
+} conflict_sample_t;
+
+typedef struct samples_buffer {         /* Buffer to hold samples */
+  conflict_sample_t buffer[BUFFER_SIZE]; /* Buffer */
+  unsigned int nb;                      /* Number of samples */
+  unsigned long total;                  /* Total number of aborts seen by thread so far */
+  int owner;                            /* Conflicting atomic block of current attempt */
+} samples_buffer_t;
+
+typedef struct conflict_entry {         /* Aggregated samples */
+  long lock;                            /* Lock index (stripes) */
+  int id;                               /* Atomic block identifier (pairs) */
+  int owner;                            /* Conflicting atomic block identifier (pairs) */
+  void *addr;                           /* Last faulting address (stripes) */
+  unsigned long aborts;                 /* Number of sampled aborts */
+  unsigned long reasons[NB_REASONS];    /* Number of sampled aborts wrt. reason */
+  struct conflict_entry *next;          /* Next entry in bucket */
+} conflict_entry_t;
+
+typedef struct conflict_table {         /* Hash table of aggregated samples */
+  conflict_entry_t **buckets;           /* Buckets (chained) */
+  unsigned int size;                    /* Number of buckets */
+  unsigned int nb;                      /* Number of entries */
+} conflict_table_t;
+
+static int mod_conflict_key;
+static int mod_conflict_initialized = 0;
+static int sampling_period;             /* Inverse sampling frequency */
+static int report_size;                 /* Number of entries of report upon exit */
+
+static pthread_mutex_t conflict_mutex;  /* Mutex to update global profile */
+
+static conflict_table_t conflict_stripes; /* Aborts per stripe */
+static conflict_table_t conflict_pairs; /* Aborts per pair of atomic blocks */
+static unsigned long conflict_samples;  /* Number of aggregated samples */
+
+static const char *conflict_reasons[NB_REASONS] = {
+  "other", "rr", "rw", "wr", "ww", "val-r", "val-w", "val-c",
+  "?", "irrev", "killed", "signal", "ext-ws", "?", "?", "other"
+};
+
+#ifdef CONFLICT_TRACKING
+/* Undocumented function of the STM library */
+int stm_set_conflict_cb(void (*on_conflict)(struct stm_tx *tx1, struct stm_tx *tx2)) _CALLCONV;
+#endif /* CONFLICT_TRACKING */
+
+/* ################################################################### *
+ * FUNCTIONS
+ * ################################################################### */
+
+/*
+ * Hash of an entry key.
+ */
+static INLINE unsigned int table_hash(long lock, int id, int owner)
+{
+  return (unsigned int)lock * 2654435761U ^ (unsigned int)id * 40503U ^ (unsigned int)owner;
+}
+
+/*
+ * Initialize table.
+ */
+static void table_init(conflict_table_t *t)
+{
+  t->size = NB_ENTRIES;
+  t->nb = 0;
+  t->buckets = (conflict_entry_t **)xcalloc(t->size, sizeof(conflict_entry_t *));
+}
+
+/*
+ * Delete table.
+ */
+static void table_delete(conflict_table_t *t)
+{
+  unsigned int i;
+  conflict_entry_t *e, *n;
+
+  for (i = 0; i < t->size; i++) {
+    for (e = t->buckets[i]; e != NULL; e = n) {
+      n = e->next;
+      xfree(e);
+    }
+  }
+  xfree(t->buckets);
+}
+
+/*
+ * Find entry in table or create it (conflict_mutex must be held).
+ */
+static conflict_entry_t *table_get(conflict_table_t *t, long lock, int id, int owner)
+{
+  unsigned int i, b, size;
+  conflict_entry_t **buckets, *e, *n;
+
+  b = table_hash(lock, id, owner) % t->size;
+  for (e = t->buckets[b]; e != NULL; e = e->next) {
+    if (e->lock == lock && e->id == id && e->owner == owner)
+      return e;
+  }
+
+  if (t->nb >= t->size) {
+    /* Grow table */
+    size = t->size * 2;
+    buckets = (conflict_entry_t **)xcalloc(size, sizeof(conflict_entry_t *));
+    for (i = 0; i < t->size; i++) {
+      for (e = t->buckets[i]; e != NULL; e = n) {
+        n = e->next;
+        b = table_hash(e->lock, e->id, e->owner) % size;
+        e->next = buckets[b];
+        buckets[b] = e;
+      }
+    }
+    xfree(t->buckets);
+    t->buckets = buckets;
+    t->size = size;
+    b = table_hash(lock, id, owner) % t->size;
+  }
+
+  e = (conflict_entry_t *)xcalloc(1, sizeof(conflict_entry_t));
+  e->lock = lock;
+  e->id = id;
+  e->owner = owner;
+  e->next = t->buckets[b];
+  t->buckets[b] = e;
+  t->nb++;
+
+  return e;
+}
+
+/*
+ * Compare entries (by decreasing number of aborts).
+ */
+static int compare_entries(const void *a, const void *b)
+{
+  const conflict_entry_t *ea = *(const conflict_entry_t **)a;
+  const conflict_entry_t *eb = *(const conflict_entry_t **)b;
+  return (ea->aborts > eb->aborts ? -1 : (ea->aborts < eb->aborts ? 1 : 0));
+}
+
+/*
+ * Get entries of table sorted by decreasing number of aborts
+ * (conflict_mutex must be held).
+ */
+static conflict_entry_t **table_sort(conflict_table_t *t)
+{
+  unsigned int i, j;
+  conflict_entry_t **entries, *e;
+
+  entries = (conflict_entry_t **)xmalloc((t->nb + 1) * sizeof(conflict_entry_t *));
+  for (i = j = 0; i < t->size; i++) {
+    for (e = t->buckets[i]; e != NULL; e = e->next)
+      entries[j++] = e;
+  }
+  qsort(entries, j, sizeof(conflict_entry_t *), compare_entries);
+
+  return entries;
+}
+
+/*
+ * Add samples to global profile.
+ */
+static void conflict_add_samples(samples_buffer_t *samples)
+{
+  unsigned int i, r;
+  conflict_sample_t *s;
+  conflict_entry_t *e;
+
+  pthread_mutex_lock(&conflict_mutex);
+  for (i = 0, s = samples->buffer; i < samples->nb; i++, s++) {
+    r = (s->reason >> 8) & 0x0F;
+    if (s->lock >= 0) {
+      e = table_get(&conflict_stripes, s->lock, 0, 0);
+      e->aborts++;
+      e->reasons[r]++;
+      if (s->addr != NULL)
+        e->addr = s->addr;
+    }
+    e = table_get(&conflict_pairs, 0, s->id, s->owner);
+    e->aborts++;
+    e->reasons[r]++;
+  }
+  conflict_samples += samples->nb;
+  samples->nb = 0;
+  pthread_mutex_unlock(&conflict_mutex);
+}
+
+/*
+ * Print reasons of entry.
+ */
+static void conflict_print_reasons(FILE *f, conflict_entry_t *e)
+{
+  int i;
+
+  for (i = 0; i < NB_REASONS; i++) {
+    if (e->reasons[i] != 0)
+      fprintf(f, " %s=%lu", conflict_reasons[i], e->reasons[i]);
+  }
+  fprintf(f, "\n");
+}
+
+/*
+ * Print top entries of the profile.
+ */
+void stm_conflict_report(FILE *f, int k)
+{
+  conflict_entry_t **entries;
+  samples_buffer_t *samples;
+  unsigned int i;
+
+  if (!mod_conflict_initialized) {
+    fprintf(stderr, "Module mod_conflict not initialized\n");
+    exit(1);
+  }
+
+  /* Include samples of current thread */
+  if (stm_current_tx() != NULL) {
+    samples = (samples_buffer_t *)stm_get_specific(mod_conflict_key);
+    if (samples != NULL)
+      conflict_add_samples(samples);
+  }
+
+  pthread_mutex_lock(&conflict_mutex);
+  fprintf(f, "Conflict profile: %lu sampled aborts (1/%d)\n", conflict_samples, sampling_period);
+
+  fprintf(f, "Hottest stripes:\n");
+  entries = table_sort(&conflict_stripes);
+  for (i = 0; i < conflict_stripes.nb && i < (unsigned int)k; i++) {
+    fprintf(f, "  lock=%-8ld aborts=%-8lu addr=%p  ", entries[i]->lock, entries[i]->aborts, entries[i]->addr);
+    conflict_print_reasons(f, entries[i]);
+  }
+  xfree(entries);
+
+  fprintf(f, "Conflicting atomic blocks:\n");
+  entries = table_sort(&conflict_pairs);
+  for (i = 0; i < conflict_pairs.nb && i < (unsigned int)k; i++) {
+    if (entries[i]->owner >= 0)
+      fprintf(f, "  %5d <- %-5d aborts=%-8lu ", entries[i]->id, entries[i]->owner, entries[i]->aborts);
+    else
+      fprintf(f, "  %5d <- ?     aborts=%-8lu ", entries[i]->id, entries[i]->aborts);
+    conflict_print_reasons(f, entries[i]);
+  }
+  xfree(entries);
+  pthread_mutex_unlock(&conflict_mutex);
+}
+
+/*
+ * Clean up module.
+ */
+static void cleanup(void)
+{
+  if (report_size > 0)
+    stm_conflict_report(stderr, report_size);
+
+  pthread_mutex_lock(&conflict_mutex);
+  table_delete(&conflict_stripes);
+  table_delete(&conflict_pairs);
+  pthread_mutex_unlock(&conflict_mutex);
+
+  pthread_mutex_destroy(&conflict_mutex);
+}
+
+/*
+ * Called upon thread creation.
+ */
+static void mod_conflict_on_thread_init(void *arg)
+{
+  samples_buffer_t *samples;
+
+  samples = (samples_buffer_t *)xmalloc(sizeof(samples_buffer_t));
+  samples->nb = 0;
+  samples->total = 0;
+  samples->owner = -1;
+  stm_set_specific(mod_conflict_key, samples);
+}
+
+/*
+ * Called upon thread deletion.
+ */
+static void mod_conflict_on_thread_exit(void *arg)
+{
+  samples_buffer_t *samples;
+
+  samples = (samples_buffer_t *)stm_get_specific(mod_conflict_key);
+  assert(samples != NULL);
+
+  conflict_add_samples(samples);
+  stm_set_specific(mod_conflict_key, NULL);
+
+  xfree(samples);
+}
+
+#ifdef CONFLICT_TRACKING
+/*
+ * Called upon conflict (before abort).
+ */
+static void mod_conflict_on_conflict(struct stm_tx *tx, struct stm_tx *other)
+{
+  samples_buffer_t *samples;
+
+  samples = (samples_buffer_t *)stm_get_specific_tx(tx, mod_conflict_key);
+  if (samples != NULL)
+    samples->owner = stm_get_attributes_tx(other).id;
+}
+
+/*
+ * Called upon transaction commit.
+ */
+static void mod_conflict_on_commit(void *arg)
+{
+  samples_buffer_t *samples;
+
+  samples = (samples_buffer_t *)stm_get_specific(mod_conflict_key);
+  assert(samples != NULL);
+
+  /* Conflict did not cause an abort (e.g., other transaction killed) */
+  samples->owner = -1;
+}
+#endif /* CONFLICT_TRACKING */
+
+/*
+ * Called upon transaction abort.
+ */
+static void mod_conflict_on_abort(void *arg)
+{
+  samples_buffer_t *samples;
+  conflict_sample_t *s;
+  stm_tx_info_t info;
+
+  samples = (samples_buffer_t *)stm_get_specific(mod_conflict_key);
+  assert(samples != NULL);
+
+  stm_get_tx_info(&info);
+  /* Only keep aborts not requested by the application */
+  if ((info.abort_reason & STM_ABORT_EXPLICIT) == 0 && (++samples->total % sampling_period) == 0) {
+    s = &samples->buffer[samples->nb];
+    s->lock = info.conflict_lock;
+    s->addr = info.conflict_addr;
+    s->id = stm_get_attributes().id;
+    s->owner = samples->owner;
+    s->reason = info.abort_reason;
+    /* Is buffer full? */
+    if (++samples->nb == BUFFER_SIZE) {
+      /* Accumulate in global profile (and empty buffer) */
+      conflict_add_samples(samples);
+    }
+  }
+  samples->owner = -1;
+}
+
+/*
+ * Initialize module.
+ */
+void mod_conflict_init(int freq, int k)
+{
+  void (*on_commit)(void *arg) = NULL;
+
+  if (mod_conflict_initialized)
+    return;
+
+  sampling_period = (freq <= 0 ? 1 : freq);
+  report_size = k;
+
+#ifdef CONFLICT_TRACKING
+  stm_set_conflict_cb(mod_conflict_on_conflict);
+  on_commit = mod_conflict_on_commit;
+#endif /* CONFLICT_TRACKING */
+  if (!stm_register(mod_conflict_on_thread_init, mod_conflict_on_thread_exit, NULL, NULL, on_commit, mod_conflict_on_abort, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+  mod_conflict_key = stm_create_specific();
+  if (mod_conflict_key < 0) {
+    fprintf(stderr, "Cannot create specific key\n");
+    exit(1);
+  }
+  if (pthread_mutex_init(&conflict_mutex, NULL) != 0) {
+    fprintf(stderr, "Error creating mutex\n");
+    exit(1);
+  }
+  table_init(&conflict_stripes);
+  table_init(&conflict_pairs);
+  conflict_samples = 0;
+  atexit(cleanup);
+  mod_conflict_initialized = 1;
+}
@@ -0,0 +1,334 @@
+/*
+ * File:
+ *   mod_inc.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for commutative transactional increments.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mod_inc.h"
+
+#include "stm.h"
+#include "wrappers.h"
+#include "utils.h"
+
+#ifndef INC_SET_SIZE
+# define INC_SET_SIZE                   16
+#endif /* ! INC_SET_SIZE */
+
+/* ################################################################### *
+ * TYPES
+ * ################################################################### */
+
+enum {                                  /* Types of counters */
+  INC_WORD,
+  INC_DOUBLE
+};
+
+typedef struct mod_inc_entry {          /* Pending increment */
+  void *addr;                           /* Address of counter */
+  union {
+    stm_word_t w;                       /* Delta of word counter */
+    double d;                           /* Delta of double counter */
+  } delta;
+  int type;                             /* Type of counter */
+} mod_inc_entry_t;
+
+/*
+ * Increments of a counter are merged into a single entry, unless the
+ * entry belongs to an enclosing closed nested transaction: entries of
+ * a nested transaction are then simply dropped upon abort.
+ */
+typedef struct mod_inc_set {            /* Increment set */
+  mod_inc_entry_t *entries;             /* Array of entries */
+  int nb_entries;                       /* Number of entries */
+  int size;                             /* Size of array */
+#ifdef CLOSED_NESTING
+  int *nested;                          /* Number of entries upon start of closed nested transactions */
+  int nested_nb;                        /* Number of active closed nested transactions */
+  int nested_size;                      /* Size of array */
+#endif /* CLOSED_NESTING */
+} mod_inc_set_t;
+
+static int mod_inc_key;
+static int mod_inc_initialized = 0;
+
+/* ################################################################### *
+ * STATIC
+ * ################################################################### */
+
+/*
+ * Get the increment set of the CURRENT thread.
+ */
+static inline mod_inc_set_t *get_set(void)
+{
+  mod_inc_set_t *is;
+
+  if (!mod_inc_initialized) {
+    fprintf(stderr, "Module mod_inc not initialized\n");
+    exit(1);
+  }
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL);
+
+  return is;
+}
+
+/*
+ * Called by the CURRENT thread to get the entry of a counter
+ * (allocated if needed).
+ */
+static inline mod_inc_entry_t *get_entry(void *addr, int type)
+{
+  mod_inc_set_t *is;
+  mod_inc_entry_t *e;
+  int i, base;
+
+  is = get_set();
+
+  base = 0;
+#ifdef CLOSED_NESTING
+  if (is->nested_nb > 0)
+    base = is->nested[is->nested_nb - 1];
+#endif /* CLOSED_NESTING */
+  for (i = is->nb_entries - 1; i >= base; i--) {
+    if (is->entries[i].addr == addr) {
+      assert(is->entries[i].type == type);
+      return &is->entries[i];
+    }
+  }
+
+  if (is->nb_entries == is->size) {
+    /* Extend increment set */
+    is->size = (is->size == 0 ? INC_SET_SIZE : is->size * 2);
+    is->entries = (mod_inc_entry_t *)xrealloc(is->entries, is->size * sizeof(mod_inc_entry_t));
+  }
+  e = &is->entries[is->nb_entries++];
+  e->addr = addr;
+  e->type = type;
+  if (type == INC_WORD)
+    e->delta.w = 0;
+  else
+    e->delta.d = 0;
+
+  return e;
+}
+
+/* ################################################################### *
+ * FUNCTIONS
+ * ################################################################### */
+
+void stm_inc(stm_word_t *addr, stm_word_t delta)
+{
+  get_entry(addr, INC_WORD)->delta.w += delta;
+}
+
+void stm_add_double(double *addr, double delta)
+{
+  get_entry(addr, INC_DOUBLE)->delta.d += delta;
+}
+
+stm_word_t stm_inc_load(stm_word_t *addr)
+{
+  mod_inc_set_t *is;
+  stm_word_t v;
+  int i;
+
+  is = get_set();
+
+  v = stm_load(addr);
+  for (i = 0; i < is->nb_entries; i++) {
+    if (is->entries[i].addr == addr)
+      v += is->entries[i].delta.w;
+  }
+
+  return v;
+}
+
+double stm_inc_load_double(double *addr)
+{
+  mod_inc_set_t *is;
+  double v;
+  int i;
+
+  is = get_set();
+
+  v = stm_load_double(addr);
+  for (i = 0; i < is->nb_entries; i++) {
+    if (is->entries[i].addr == addr)
+      v += is->entries[i].delta.d;
+  }
+
+  return v;
+}
+
+/*
+ * Called upon thread creation.
+ */
+static void mod_inc_on_thread_init(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)xmalloc(sizeof(mod_inc_set_t));
+  is->entries = NULL;
+  is->nb_entries = is->size = 0;
+#ifdef CLOSED_NESTING
+  is->nested = NULL;
+  is->nested_nb = is->nested_size = 0;
+#endif /* CLOSED_NESTING */
+
+  stm_set_specific(mod_inc_key, is);
+}
+
+/*
+ * Called upon thread deletion.
+ */
+static void mod_inc_on_thread_exit(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL);
+
+  xfree(is->entries);
+#ifdef CLOSED_NESTING
+  xfree(is->nested);
+#endif /* CLOSED_NESTING */
+  xfree(is);
+}
+
+/*
+ * Called before transaction commit: apply increments.  Conflicts
+ * restart the transaction, which clears the increment set (unless
+ * started with no_retry, in which case we stop upon abort).
+ */
+static void mod_inc_on_precommit(void *arg)
+{
+  mod_inc_set_t *is;
+  mod_inc_entry_t *e;
+  int i;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL);
+
+  for (i = 0; i < is->nb_entries; i++) {
+    e = &is->entries[i];
+    if (e->type == INC_WORD)
+      stm_store((stm_word_t *)e->addr, stm_load((stm_word_t *)e->addr) + e->delta.w);
+    else
+      stm_store_double((double *)e->addr, stm_load_double((double *)e->addr) + e->delta.d);
+    if (!stm_active())
+      return;
+  }
+}
+
+/*
+ * Called upon transaction commit or abort.
+ */
+static void mod_inc_on_end(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL);
+
+  /* Erase increment set */
+  is->nb_entries = 0;
+#ifdef CLOSED_NESTING
+  is->nested_nb = 0;
+#endif /* CLOSED_NESTING */
+}
+
+#ifdef CLOSED_NESTING
+/*
+ * Called upon closed nested transaction start.
+ */
+static void mod_inc_on_nested_start(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL);
+
+  if (is->nested_nb == is->nested_size) {
+    is->nested_size = (is->nested_size == 0 ? 16 : is->nested_size * 2);
+    is->nested = (int *)xrealloc(is->nested, is->nested_size * sizeof(int));
+  }
+  is->nested[is->nested_nb++] = is->nb_entries;
+}
+
+/*
+ * Called upon closed nested transaction commit.
+ */
+static void mod_inc_on_nested_commit(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL && is->nested_nb > 0);
+
+  /* Entries now belong to parent */
+  is->nested_nb--;
+}
+
+/*
+ * Called upon closed nested transaction abort.
+ */
+static void mod_inc_on_nested_abort(void *arg)
+{
+  mod_inc_set_t *is;
+
+  is = (mod_inc_set_t *)stm_get_specific(mod_inc_key);
+  assert(is != NULL && is->nested_nb > 0);
+
+  is->nb_entries = is->nested[--is->nested_nb];
+}
+#endif /* CLOSED_NESTING */
+
+/*
+ * Initialize module.
+ */
+void mod_inc_init(void)
+{
+  if (mod_inc_initialized)
+    return;
+
+  if (!stm_register(mod_inc_on_thread_init, mod_inc_on_thread_exit, NULL, mod_inc_on_precommit, mod_inc_on_end, mod_inc_on_end, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+#ifdef CLOSED_NESTING
+  if (!stm_register_nested(mod_inc_on_nested_start, mod_inc_on_nested_commit, mod_inc_on_nested_abort, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+#endif /* CLOSED_NESTING */
+  mod_inc_key = stm_create_specific();
+  if (mod_inc_key < 0) {
+    fprintf(stderr, "Cannot create specific key\n");
+    exit(1);
+  }
+  mod_inc_initialized = 1;
+}
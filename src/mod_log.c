@@ -37,58 +37,35 @@
 # define LW_SET_SIZE                    1024
 #endif /* ! LW_SET_SIZE */
 
+/* Round up to alignment of records */
+#define LOG_ALIGN(s)                    (((s) + sizeof(stm_word_t) - 1) & ~(sizeof(stm_word_t) - 1))
+
 /* ################################################################### *
  * TYPES
  * ################################################################### */
 
-enum {
-  TYPE_WORD,
-  TYPE_U8,
-  TYPE_U16,
-  TYPE_U32,
-  TYPE_U64,
-  TYPE_CHAR,
-  TYPE_UCHAR,
-  TYPE_SHORT,
-  TYPE_USHORT,
-  TYPE_INT,
-  TYPE_UINT,
-  TYPE_LONG,
-  TYPE_ULONG,
-  TYPE_FLOAT,
-  TYPE_DOUBLE,
-  TYPE_PTR,
-  TYPE_BYTES
-};
-
-typedef struct mod_log_w_entry {        /* Write set entry */
-  int type;                             /* Data type */
-  union {                               /* Address written and old value */
-    struct { stm_word_t *a; stm_word_t v; } w;
-    struct { uint8_t *a; char v; } u8;
-    struct { uint16_t *a; char v; } u16;
-    struct { uint32_t *a; char v; } u32;
-    struct { uint64_t *a; char v; } u64;
-    struct { char *a; char v; } c;
-    struct { unsigned char *a; unsigned char v; } uc;
-    struct { short *a; short v; } s;
-    struct { unsigned short *a; unsigned short v; } us;
-    struct { int *a; int v; } i;
-    struct { unsigned int *a; unsigned int v; } ui;
-    struct { long *a; long v; } l;
-    struct { unsigned long *a; unsigned long v; } ul;
-    struct { float *a; float v; } f;
-    struct { double *a; double v; } d;
-    struct { void **a; void *v; } p;
-    struct { uint8_t *a; uint8_t *v; size_t s; } b;
-  } data;
+/*
+ * The undo log is a contiguous array of records, each made of the old
+ * bytes of a memory range (padded to a word) followed by the header
+ * describing the range.  Headers come last so that the log can be
+ * swept backwards upon rollback.  A range that extends or is contained
+ * in the range of the last record is merged with it.
+ */
+typedef struct mod_log_w_entry {        /* Header of undo log record */
+  uint8_t *addr;                        /* First address written */
+  size_t size;                          /* Number of bytes */
 } mod_log_w_entry_t;
 
 typedef struct mod_log_w_set {          /* Write set */
-  mod_log_w_entry_t *entries;           /* Array of entries */
-  int nb_entries;                       /* Number of entries */
-  int size;                             /* Size of array */
-  int allocated;                        /* Memory blocks allocated */
+  char *log;                            /* Undo log records */
+  size_t nb_bytes;                      /* Number of bytes used */
+  size_t size;                          /* Size of log */
+  size_t last;                          /* Offset after last record that can be merged (0 if none) */
+#ifdef CLOSED_NESTING
+  size_t *nested;                       /* Size of undo log upon start of closed nested transactions */
+  int nested_nb;                        /* Number of active closed nested transactions */
+  int nested_size;                      /* Size of array */
+#endif /* CLOSED_NESTING */
 } mod_log_w_set_t;
 
 static int mod_log_key;
@@ -99,28 +76,62 @@ static int mod_log_initialized = 0;
  * ################################################################### */
 
 /*
- * Called by the CURRENT thread to obtain log entry.
+ * Called by the CURRENT thread to log the old value of a memory range.
  */
-static inline mod_log_w_entry_t *get_entry(void)
+static inline void log_bytes(uint8_t *addr, size_t size)
 {
   mod_log_w_set_t *ws;
+  mod_log_w_entry_t *w;
+  size_t data;
 
   if (!mod_log_initialized) {
     fprintf(stderr, "Module mod_log not initialized\n");
     exit(1);
   }
 
-  /* Store in undo log */
   ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
   assert(ws != NULL);
 
-  if (ws->nb_entries == ws->size) {
-    /* Extend read set */
-    ws->size = (ws->size < LW_SET_SIZE ? LW_SET_SIZE : ws->size * 2);
-    ws->entries = (mod_log_w_entry_t *)xrealloc(ws->entries, ws->size * sizeof(mod_log_w_entry_t));
+  if (ws->last != 0) {
+    w = (mod_log_w_entry_t *)(ws->log + ws->last - sizeof(mod_log_w_entry_t));
+    if (addr >= w->addr && addr + size <= w->addr + w->size) {
+      /* Already logged: keep oldest value */
+      return;
+    }
+    if (addr == w->addr + w->size) {
+      /* Adjacent range: extend last record */
+      data = ws->last - sizeof(mod_log_w_entry_t) - LOG_ALIGN(w->size);
+      if (data + LOG_ALIGN(w->size + size) + sizeof(mod_log_w_entry_t) > ws->size) {
+        do {
+          ws->size *= 2;
+        } while (data + LOG_ALIGN(w->size + size) + sizeof(mod_log_w_entry_t) > ws->size);
+        ws->log = (char *)xrealloc(ws->log, ws->size);
+        w = (mod_log_w_entry_t *)(ws->log + ws->last - sizeof(mod_log_w_entry_t));
+      }
+      addr = w->addr;
+      size += w->size;
+      /* Header is overwritten by new bytes */
+      memcpy(ws->log + data + w->size, addr + w->size, size - w->size);
+      goto header;
+    }
   }
 
-  return &ws->entries[ws->nb_entries++];
+  data = ws->nb_bytes;
+  if (data + LOG_ALIGN(size) + sizeof(mod_log_w_entry_t) > ws->size) {
+    /* Extend undo log */
+    if (ws->size < LW_SET_SIZE)
+      ws->size = LW_SET_SIZE;
+    while (data + LOG_ALIGN(size) + sizeof(mod_log_w_entry_t) > ws->size)
+      ws->size *= 2;
+    ws->log = (char *)xrealloc(ws->log, ws->size);
+  }
+  memcpy(ws->log + data, addr, size);
+
+ header:
+  w = (mod_log_w_entry_t *)(ws->log + data + LOG_ALIGN(size));
+  w->addr = addr;
+  w->size = size;
+  ws->nb_bytes = ws->last = data + LOG_ALIGN(size) + sizeof(mod_log_w_entry_t);
 }
 
 /* ################################################################### *
@@ -129,160 +140,88 @@ static inline mod_log_w_entry_t *get_entry(void)
 
 void stm_log(stm_word_t *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_WORD;
-  w->data.w.a = addr;
-  w->data.w.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_u8(uint8_t *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_U8;
-  w->data.u8.a = addr;
-  w->data.u8.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_u16(uint16_t *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_U16;
-  w->data.u16.a = addr;
-  w->data.u16.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_u32(uint32_t *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_U32;
-  w->data.u32.a = addr;
-  w->data.u32.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_u64(uint64_t *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_U64;
-  w->data.u64.a = addr;
-  w->data.u64.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_char(char *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_CHAR;
-  w->data.c.a = addr;
-  w->data.c.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_uchar(unsigned char *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_UCHAR;
-  w->data.uc.a = addr;
-  w->data.uc.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_short(short *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_SHORT;
-  w->data.s.a = addr;
-  w->data.s.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_ushort(unsigned short *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_USHORT;
-  w->data.us.a = addr;
-  w->data.us.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_int(int *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_INT;
-  w->data.i.a = addr;
-  w->data.i.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_uint(unsigned int *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_UINT;
-  w->data.ui.a = addr;
-  w->data.ui.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_long(long *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_LONG;
-  w->data.l.a = addr;
-  w->data.l.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_ulong(unsigned long *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_ULONG;
-  w->data.ul.a = addr;
-  w->data.ul.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_float(float *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_FLOAT;
-  w->data.f.a = addr;
-  w->data.f.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_double(double *addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_DOUBLE;
-  w->data.d.a = addr;
-  w->data.d.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_ptr(void **addr)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_PTR;
-  w->data.p.a = addr;
-  w->data.p.v = *addr;
+  log_bytes((uint8_t *)addr, sizeof(*addr));
 }
 
 void stm_log_bytes(uint8_t *addr, size_t size)
 {
-  mod_log_w_entry_t *w = get_entry();
-
-  w->type = TYPE_BYTES;
-  w->data.b.a = addr;
-  w->data.b.v = (uint8_t *)xmalloc(size);
-  w->data.b.s = size;
-  memcpy(w->data.b.v, addr, size);
-
-  /* Remember we have allocated memory */
-  ((mod_log_w_set_t *)stm_get_specific(mod_log_key))->allocated++;
+  if (size > 0)
+    log_bytes(addr, size);
 }
 
 /*
@@ -293,8 +232,12 @@ static void mod_log_on_thread_init(void *arg)
   mod_log_w_set_t *ws;
 
   ws = (mod_log_w_set_t *)xmalloc(sizeof(mod_log_w_set_t));
-  ws->entries = NULL;
-  ws->nb_entries = ws->size = ws->allocated = 0;
+  ws->log = NULL;
+  ws->nb_bytes = ws->size = ws->last = 0;
+#ifdef CLOSED_NESTING
+  ws->nested = NULL;
+  ws->nested_nb = ws->nested_size = 0;
+#endif /* CLOSED_NESTING */
 
   stm_set_specific(mod_log_key, ws);
 }
@@ -309,7 +252,10 @@ static void mod_log_on_thread_exit(void *arg)
   ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
   assert(ws != NULL);
 
-  xfree(ws->entries);
+  xfree(ws->log);
+#ifdef CLOSED_NESTING
+  xfree(ws->nested);
+#endif /* CLOSED_NESTING */
   xfree(ws);
 }
 
@@ -319,25 +265,34 @@ static void mod_log_on_thread_exit(void *arg)
 static void mod_log_on_commit(void *arg)
 {
   mod_log_w_set_t *ws;
-  mod_log_w_entry_t *w;
 
   ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
   assert(ws != NULL);
 
-  /* Free memory */
-  if (ws->allocated > 0) {
-    w = ws->entries;
-    do {
-      assert(w < &ws->entries[ws->nb_entries]);
-      if (w->type == TYPE_BYTES) {
-        xfree(w->data.b.v);
-        ws->allocated--;
-      }
-      w++;
-    } while (ws->allocated > 0);
+  /* Erase undo log */
+  ws->nb_bytes = ws->last = 0;
+#ifdef CLOSED_NESTING
+  ws->nested_nb = 0;
+#endif /* CLOSED_NESTING */
+}
+
+/*
+ * Apply undo log in reverse order (down to the specified size).
+ */
+static void mod_log_undo(mod_log_w_set_t *ws, size_t nb)
+{
+  mod_log_w_entry_t *w;
+  size_t i;
+
+  i = ws->nb_bytes;
+  while (i > nb) {
+    w = (mod_log_w_entry_t *)(ws->log + i - sizeof(mod_log_w_entry_t));
+    i -= sizeof(mod_log_w_entry_t) + LOG_ALIGN(w->size);
+    memcpy(w->addr, ws->log + i, w->size);
   }
   /* Erase undo log */
-  ws->nb_entries = 0;
+  ws->nb_bytes = nb;
+  ws->last = 0;
 }
 
 /*
@@ -346,81 +301,64 @@ static void mod_log_on_commit(void *arg)
 static void mod_log_on_abort(void *arg)
 {
   mod_log_w_set_t *ws;
-  mod_log_w_entry_t *w;
 
   ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
   assert(ws != NULL);
 
-  if (ws->nb_entries > 0) {
-    /* Apply undo log in reverse order */
-    w = &ws->entries[ws->nb_entries - 1];
-    do {
-      switch (w->type) {
-       case TYPE_WORD:
-         *w->data.w.a = w->data.w.v;
-         break;
-       case TYPE_U8:
-         *w->data.u8.a = w->data.u8.v;
-         break;
-       case TYPE_U16:
-         *w->data.u16.a = w->data.u16.v;
-         break;
-       case TYPE_U32:
-         *w->data.u32.a = w->data.u32.v;
-         break;
-       case TYPE_U64:
-         *w->data.u64.a = w->data.u64.v;
-         break;
-       case TYPE_CHAR:
-         *w->data.c.a = w->data.c.v;
-         break;
-       case TYPE_UCHAR:
-         *w->data.uc.a = w->data.uc.v;
-         break;
-       case TYPE_SHORT:
-         *w->data.s.a = w->data.s.v;
-         break;
-       case TYPE_USHORT:
-         *w->data.us.a = w->data.us.v;
-         break;
-       case TYPE_INT:
-         *w->data.i.a = w->data.i.v;
-         break;
-       case TYPE_UINT:
-         *w->data.ui.a = w->data.ui.v;
-         break;
-       case TYPE_LONG:
-         *w->data.l.a = w->data.l.v;
-         break;
-       case TYPE_ULONG:
-         *w->data.ul.a = w->data.ul.v;
-         break;
-       case TYPE_FLOAT:
-         *w->data.f.a = w->data.f.v;
-         break;
-       case TYPE_DOUBLE:
-         *w->data.d.a = w->data.d.v;
-         break;
-       case TYPE_PTR:
-         *w->data.p.a = w->data.p.v;
-         break;
-       case TYPE_BYTES:
-         memcpy(w->data.b.a, w->data.b.v, w->data.b.s);
-         xfree(w->data.b.v);
-         ws->allocated--;
-         break;
-       default:
-         fprintf(stderr, "Unexpected entry in undo log\n");
-         abort();
-         exit(1);
-      }
-    } while (--w >= ws->entries);
-    /* Erase undo log */
-    ws->nb_entries = 0;
+  mod_log_undo(ws, 0);
+#ifdef CLOSED_NESTING
+  ws->nested_nb = 0;
+#endif /* CLOSED_NESTING */
+}
+
+#ifdef CLOSED_NESTING
+/*
+ * Called upon closed nested transaction start.
+ */
+static void mod_log_on_nested_start(void *arg)
+{
+  mod_log_w_set_t *ws;
+
+  ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
+  assert(ws != NULL);
+
+  if (ws->nested_nb == ws->nested_size) {
+    ws->nested_size = (ws->nested_size == 0 ? 16 : ws->nested_size * 2);
+    ws->nested = (size_t *)xrealloc(ws->nested, ws->nested_size * sizeof(size_t));
   }
-  assert(ws->allocated == 0);
+  ws->nested[ws->nested_nb++] = ws->nb_bytes;
+  /* Records of parent must keep the values upon start */
+  ws->last = 0;
+}
+
+/*
+ * Called upon closed nested transaction commit.
+ */
+static void mod_log_on_nested_commit(void *arg)
+{
+  mod_log_w_set_t *ws;
+
+  ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
+  assert(ws != NULL && ws->nested_nb > 0);
+
+  /* Entries now belong to parent */
+  ws->nested_nb--;
 }
 
+/*
+ * Called upon closed nested transaction abort.
+ */
+static void mod_log_on_nested_abort(void *arg)
+{
+  mod_log_w_set_t *ws;
+
+  ws = (mod_log_w_set_t *)stm_get_specific(mod_log_key);
+  assert(ws != NULL && ws->nested_nb > 0);
+
+  mod_log_undo(ws, ws->nested[--ws->nested_nb]);
+}
+#endif /* CLOSED_NESTING */
+
 /*
  * Initialize module.
  */
@@ -433,6 +371,12 @@ void mod_log_init(void)
     fprintf(stderr, "Cannot register callbacks\n");
     exit(1);
   }
+#ifdef CLOSED_NESTING
+  if (!stm_register_nested(mod_log_on_nested_start, mod_log_on_nested_commit, mod_log_on_nested_abort, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+#endif /* CLOSED_NESTING */
   mod_log_key = stm_create_specific();
   if (mod_log_key < 0) {
     fprintf(stderr, "Cannot create specific key\n");
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stm.h>
 #include "atomic.h"
 #include "utils.h"
@@ -34,10 +35,20 @@
 #define KILL_SELF                      0x00
 #define KILL_OTHER                     0x01
 
+#define ORDER_RING_SIZE                1024 /* Must be a power of 2 */
+#define ORDER_SPIN                     128  /* Spins before yielding */
+
+typedef struct order_slot {             /* Commit slot (pipelined mode) */
+  volatile stm_word_t turn;             /* Highest ticket allowed to commit */
+} ALIGNED order_slot_t;
+
 /* XXX Maybe these two could be in the same cacheline. */
 ALIGNED static stm_word_t mod_order_ts_next = 0;
 ALIGNED static stm_word_t mod_order_ts_commit = 0;
+/* In pipelined mode, each ticket waits on its own slot */
+static order_slot_t mod_order_ring[ORDER_RING_SIZE];
 static int mod_order_key;
+static int mod_order_wait_key;
 static int mod_order_initialized = 0;
 
 static void mod_order_on_start(void *arg)
@@ -80,24 +91,143 @@ static int mod_order_cm(struct stm_tx *tx, struct stm_tx *other_tx, int conflict
   return KILL_SELF;
 }
 
+/*
+ * Wait until it is the turn of the given ticket (pipelined mode).
+ * Tickets start at ORDER_RING_SIZE and the value of a slot only grows
+ * (by steps of ORDER_RING_SIZE), hence one can also wait for a ticket
+ * whose turn has long passed.
+ */
+static int mod_order_wait(stm_word_t ts, int check_killed)
+{
+  order_slot_t *slot;
+  int i;
+
+  slot = &mod_order_ring[ts & (ORDER_RING_SIZE - 1)];
+  /* Spin on its own slot (yield if predecessors are not running) */
+  for (i = 0; ATOMIC_LOAD_ACQ(&slot->turn) < ts; i++) {
+    if (check_killed && stm_killed())
+      return 0;
+    if (i >= ORDER_SPIN) {
+      sched_yield();
+      i = 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Let next ticket commit (pipelined mode).
+ */
+static void mod_order_release(stm_word_t ts)
+{
+  ATOMIC_STORE_REL(&mod_order_ring[(ts + 1) & (ORDER_RING_SIZE - 1)].turn, ts + 1);
+}
+
+static void mod_order_on_precommit_pipelined(void *arg)
+{
+  stm_tx_info_t info;
+
+  /* Same as above: abort before commit if killed */
+  if (!mod_order_wait((stm_word_t)stm_get_specific(mod_order_key), 1))
+    return;
+  /* All predecessors have committed: make sure that we have seen their
+   * updates (update transactions validate upon commit if needed) */
+  stm_get_tx_info(&info);
+  if (info.write_set_nb_entries == 0)
+    stm_validate();
+}
+
+static void mod_order_on_commit_pipelined(void *arg)
+{
+  mod_order_release((stm_word_t)stm_get_specific(mod_order_key));
+}
+
+static void mod_order_on_abort_pipelined(void *arg)
+{
+  stm_tx_info_t info;
+  stm_word_t ts;
+
+  stm_get_tx_info(&info);
+  if ((info.abort_reason & STM_ABORT_NO_RETRY) == STM_ABORT_NO_RETRY || stm_get_attributes().no_retry) {
+    /* A transaction that does not retry gives up its turn (in order) */
+    ts = (stm_word_t)stm_get_specific(mod_order_key);
+    mod_order_wait(ts, 0);
+    mod_order_release(ts);
+  } else if ((ts = (stm_word_t)stm_get_specific(mod_order_wait_key)) != 0) {
+    /* Do not restart before the conflicting predecessor has committed
+     * (locks have been released, so predecessors cannot wait for us) */
+    stm_set_specific(mod_order_wait_key, NULL);
+    mod_order_wait(ts, 0);
+  }
+}
+
+static int mod_order_cm_pipelined(struct stm_tx *tx, struct stm_tx *other_tx, int conflict)
+{
+  stm_word_t my_order = (stm_word_t)stm_get_specific_tx(tx, mod_order_key);
+  stm_word_t other_order = (stm_word_t)stm_get_specific_tx(other_tx, mod_order_key);
+
+  if (my_order < other_order)
+    return KILL_OTHER;
+
+  /* Wait for the predecessor upon abort (it might otherwise still own its
+   * locks when we restart) */
+  stm_set_specific_tx(tx, mod_order_wait_key, (void *)(other_order + 1));
+
+  return KILL_SELF;
+}
+
+/*
+ * Return ticket of current transaction.
+ */
+stm_word_t mod_order_ticket(void)
+{
+  return (stm_word_t)stm_get_specific(mod_order_key);
+}
+
 /*
  * Initialize module.
  */
 void mod_order_init(void)
 {
+  mod_order_init_mode(MOD_ORDER_STRICT);
+}
+
+void mod_order_init_mode(int mode)
+{
+#if CM == CM_MODULAR
+  int i;
+#endif /* CM == CM_MODULAR */
+
   if (mod_order_initialized)
     return;
 #if CM == CM_MODULAR
-  if (!stm_register(NULL, NULL, mod_order_on_start, mod_order_on_precommit, mod_order_on_commit, NULL, NULL)) {
-    fprintf(stderr, "Could not set callbacks for module 'mod_order'. Exiting.\n");
-    goto err;
-  }
-  if (stm_set_parameter("cm_function", mod_order_cm) == 0) {
-    fprintf(stderr, "Could not set contention manager for module 'mod_order'. Exiting.\n");
-    goto err;
+  if (mode == MOD_ORDER_PIPELINED) {
+    /* First ticket is ORDER_RING_SIZE */
+    mod_order_ts_next = ORDER_RING_SIZE;
+    mod_order_ring[0].turn = ORDER_RING_SIZE;
+    for (i = 1; i < ORDER_RING_SIZE; i++)
+      mod_order_ring[i].turn = i;
+    if (!stm_register(NULL, NULL, mod_order_on_start, mod_order_on_precommit_pipelined, mod_order_on_commit_pipelined, mod_order_on_abort_pipelined, NULL)) {
+      fprintf(stderr, "Could not set callbacks for module 'mod_order'. Exiting.\n");
+      goto err;
+    }
+    if (stm_set_parameter("cm_function", mod_order_cm_pipelined) == 0) {
+      fprintf(stderr, "Could not set contention manager for module 'mod_order'. Exiting.\n");
+      goto err;
+    }
+  } else {
+    if (!stm_register(NULL, NULL, mod_order_on_start, mod_order_on_precommit, mod_order_on_commit, NULL, NULL)) {
+      fprintf(stderr, "Could not set callbacks for module 'mod_order'. Exiting.\n");
+      goto err;
+    }
+    if (stm_set_parameter("cm_function", mod_order_cm) == 0) {
+      fprintf(stderr, "Could not set contention manager for module 'mod_order'. Exiting.\n");
+      goto err;
+    }
   }
   mod_order_key = stm_create_specific();
-  if (mod_order_key < 0) {
+  mod_order_wait_key = stm_create_specific();
+  if (mod_order_key < 0 || mod_order_wait_key < 0) {
     fprintf(stderr, "Cannot create specific key\n");
     goto err;
   }
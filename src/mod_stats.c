@@ -25,6 +25,8 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -38,44 +40,136 @@
  * TYPES
  * ################################################################### */
 
+/*
+ * Statistics are kept in per-thread slots that are only written by
+ * their owner and can be read at any time by other threads.  Slots
+ * are never freed: a thread that exits adds its statistics to the
+ * totals of exited threads and its slot is cleared for the next thread.
+ */
 typedef struct mod_stats_data {         /* Transaction statistics */
   unsigned long commits;                /* Total number of commits (cumulative) */
+  unsigned long aborts;                 /* Total number of aborts (cumulative) */
   unsigned long retries;                /* Number of consecutive aborts of current transaction (retries) */
   unsigned long retries_min;            /* Minimum number of consecutive aborts */
   unsigned long retries_max;            /* Maximum number of consecutive aborts */
-  unsigned long retries_acc;            /* Total number of aborts (cumulative) */
+  unsigned long retries_acc;            /* Total number of aborts followed by a commit (cumulative) */
   unsigned long retries_cnt;            /* Number of samples for cumulative aborts */
-} mod_stats_data_t;
+  unsigned long extensions;             /* Total number of snapshot extensions (cumulative) */
+  unsigned long aborts_r[STM_STATS_NB_REASONS]; /* Total number of aborts wrt. reason (cumulative) */
+  unsigned long rs_hist[STM_STATS_HIST_SIZE]; /* Read set sizes of commits (log2 buckets) */
+  unsigned long ws_hist[STM_STATS_HIST_SIZE]; /* Write set sizes of commits (log2 buckets) */
+  unsigned long rw_set_bytes;           /* Memory allocated for read and write sets (upon last commit) */
+  volatile stm_word_t used;             /* Is slot used by a thread? */
+  struct mod_stats_data *next;          /* Next slot */
+} ALIGNED mod_stats_data_t;
 
 static int mod_stats_key;
 static int mod_stats_initialized = 0;
 
-static mod_stats_data_t mod_stats_global = { 0, 0, ULONG_MAX, 0, 0, 0 };
+static mod_stats_data_t *volatile mod_stats_slots = NULL;
+/* Statistics of exited threads (protected by mutex, as well as snapshots) */
+static mod_stats_data_t mod_stats_exited = { .retries_min = ULONG_MAX };
+static pthread_mutex_t mod_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* ################################################################### *
+ * STATIC
+ * ################################################################### */
+
+/*
+ * Index of log2 bucket of histogram (0 for 0, i for [2^(i-1), 2^i)).
+ */
+static INLINE unsigned int
+mod_stats_bucket(unsigned int n)
+{
+  unsigned int i;
+
+#ifdef __GNUC__
+  i = (n == 0 ? 0 : sizeof(unsigned int) * 8 - __builtin_clz(n));
+#else /* ! __GNUC__ */
+  for (i = 0; n > 0; i++)
+    n >>= 1;
+#endif /* ! __GNUC__ */
+  return (i < STM_STATS_HIST_SIZE ? i : STM_STATS_HIST_SIZE - 1);
+}
+
+/*
+ * Add statistics of a slot to a snapshot.
+ */
+static void
+mod_stats_sum(stm_stats_snapshot_t *snap, mod_stats_data_t *stats)
+{
+  unsigned long v;
+  int i;
+
+  snap->commits += ATOMIC_LOAD(&stats->commits);
+  snap->aborts += ATOMIC_LOAD(&stats->aborts);
+  snap->retries += ATOMIC_LOAD(&stats->retries_acc);
+  snap->extensions += ATOMIC_LOAD(&stats->extensions);
+  if ((v = ATOMIC_LOAD(&stats->retries_min)) < snap->retries_min)
+    snap->retries_min = v;
+  if ((v = ATOMIC_LOAD(&stats->retries_max)) > snap->retries_max)
+    snap->retries_max = v;
+  for (i = 0; i < STM_STATS_NB_REASONS; i++)
+    snap->aborts_reason[i] += ATOMIC_LOAD(&stats->aborts_r[i]);
+  snap->rw_set_bytes += ATOMIC_LOAD(&stats->rw_set_bytes);
+  for (i = 0; i < STM_STATS_HIST_SIZE; i++) {
+    snap->read_set_hist[i] += ATOMIC_LOAD(&stats->rs_hist[i]);
+    snap->write_set_hist[i] += ATOMIC_LOAD(&stats->ws_hist[i]);
+  }
+}
 
 /* ################################################################### *
  * FUNCTIONS
  * ################################################################### */
 
 /*
- * Return aggregate statistics about transactions.
+ * Sum statistics of all threads (without locking threads that are
+ * running transactions).
  */
-int stm_get_global_stats(const char *name, void *val)
+void stm_stats_snapshot(stm_stats_snapshot_t *snap)
 {
+  mod_stats_data_t *stats;
+
   if (!mod_stats_initialized) {
     fprintf(stderr, "Module mod_stats not initialized\n");
     exit(1);
   }
 
+  memset(snap, 0, sizeof(*snap));
+  snap->retries_min = ULONG_MAX;
+  pthread_mutex_lock(&mod_stats_mutex);
+  mod_stats_sum(snap, &mod_stats_exited);
+  for (stats = (mod_stats_data_t *)ATOMIC_LOAD_ACQ(&mod_stats_slots); stats != NULL; stats = stats->next) {
+    if (ATOMIC_LOAD(&stats->used))
+      snap->nb_threads++;
+    mod_stats_sum(snap, stats);
+  }
+  pthread_mutex_unlock(&mod_stats_mutex);
+}
+
+/*
+ * Return aggregate statistics about transactions.
+ */
+int stm_get_global_stats(const char *name, void *val)
+{
+  stm_stats_snapshot_t snap;
+
+  stm_stats_snapshot(&snap);
+
   if (strcmp("global_nb_commits", name) == 0) {
-    *(unsigned long *)val = mod_stats_global.commits;
+    *(unsigned long *)val = snap.commits;
     return 1;
   }
   if (strcmp("global_nb_aborts", name) == 0) {
-    *(unsigned long *)val = mod_stats_global.retries_acc;
+    *(unsigned long *)val = snap.retries;
     return 1;
   }
   if (strcmp("global_max_retries", name) == 0) {
-    *(unsigned long *)val = mod_stats_global.retries_max;
+    *(unsigned long *)val = snap.retries_max;
+    return 1;
+  }
+  if (strcmp("global_rw_set_bytes", name) == 0) {
+    *(unsigned long *)val = snap.rw_set_bytes;
     return 1;
   }
 
@@ -126,15 +220,24 @@ int stm_get_local_stats(const char *name, void *val)
  */
 static void mod_stats_on_thread_init(void *arg)
 {
-  mod_stats_data_t *stats;
+  mod_stats_data_t *stats, *head;
 
-  stats = (mod_stats_data_t *)xmalloc(sizeof(mod_stats_data_t));
-  stats->commits = 0;
+  /* Reuse slot of exited thread if any */
+  for (stats = (mod_stats_data_t *)ATOMIC_LOAD_ACQ(&mod_stats_slots); stats != NULL; stats = stats->next) {
+    if (ATOMIC_LOAD(&stats->used) == 0 && ATOMIC_CAS_FULL(&stats->used, 0, 1) != 0)
+      break;
+  }
+  if (stats == NULL) {
+    stats = (mod_stats_data_t *)xmalloc_aligned(sizeof(mod_stats_data_t));
+    memset(stats, 0, sizeof(mod_stats_data_t));
+    stats->retries_min = ULONG_MAX;
+    stats->used = 1;
+    do {
+      head = (mod_stats_data_t *)ATOMIC_LOAD(&mod_stats_slots);
+      stats->next = head;
+    } while (ATOMIC_CAS_FULL(&mod_stats_slots, head, stats) == 0);
+  }
   stats->retries = 0;
-  stats->retries_acc = 0;
-  stats->retries_cnt = 0;
-  stats->retries_min = ULONG_MAX;
-  stats->retries_max = 0;
 
   stm_set_specific(mod_stats_key, stats);
 }
@@ -145,28 +248,33 @@ static void mod_stats_on_thread_init(void *arg)
 static void mod_stats_on_thread_exit(void *arg)
 {
   mod_stats_data_t *stats;
-  unsigned long max, min;
+  int i;
 
   stats = (mod_stats_data_t *)stm_get_specific(mod_stats_key);
   assert(stats != NULL);
 
-  ATOMIC_FETCH_ADD_FULL(&mod_stats_global.commits, stats->commits);
-  ATOMIC_FETCH_ADD_FULL(&mod_stats_global.retries_cnt, stats->retries_cnt);
-  ATOMIC_FETCH_ADD_FULL(&mod_stats_global.retries_acc, stats->retries_acc);
-retry_max:
-  max = ATOMIC_LOAD(&mod_stats_global.retries_max);
-  if (stats->retries_max > max) {
-    if (ATOMIC_CAS_FULL(&mod_stats_global.retries_max, max, stats->retries_max) == 0)
-      goto retry_max;
-  }
-retry_min:
-  min = ATOMIC_LOAD(&mod_stats_global.retries_min);
-  if (stats->retries_min < min) {
-    if (ATOMIC_CAS_FULL(&mod_stats_global.retries_min, min, stats->retries_min) == 0)
-      goto retry_min;
+  /* Move statistics to totals of exited threads (except memory, released by the thread) */
+  pthread_mutex_lock(&mod_stats_mutex);
+  mod_stats_exited.commits += stats->commits;
+  mod_stats_exited.aborts += stats->aborts;
+  mod_stats_exited.retries_acc += stats->retries_acc;
+  mod_stats_exited.retries_cnt += stats->retries_cnt;
+  if (mod_stats_exited.retries_min > stats->retries_min)
+    mod_stats_exited.retries_min = stats->retries_min;
+  if (mod_stats_exited.retries_max < stats->retries_max)
+    mod_stats_exited.retries_max = stats->retries_max;
+  mod_stats_exited.extensions += stats->extensions;
+  for (i = 0; i < STM_STATS_NB_REASONS; i++)
+    mod_stats_exited.aborts_r[i] += stats->aborts_r[i];
+  for (i = 0; i < STM_STATS_HIST_SIZE; i++) {
+    mod_stats_exited.rs_hist[i] += stats->rs_hist[i];
+    mod_stats_exited.ws_hist[i] += stats->ws_hist[i];
   }
-
-  xfree(stats);
+  /* Next thread using the slot starts from zero */
+  memset(stats, 0, offsetof(mod_stats_data_t, used));
+  stats->retries_min = ULONG_MAX;
+  pthread_mutex_unlock(&mod_stats_mutex);
+  ATOMIC_STORE_REL(&stats->used, 0);
 }
 
 /*
@@ -175,9 +283,12 @@ retry_min:
 static void mod_stats_on_commit(void *arg)
 {
   mod_stats_data_t *stats;
+  stm_tx_info_t info;
 
   stats = (mod_stats_data_t *)stm_get_specific(mod_stats_key);
   assert(stats != NULL);
+  stm_get_tx_info(&info);
+
   stats->commits++;
   stats->retries_acc += stats->retries;
   stats->retries_cnt++;
@@ -186,6 +297,10 @@ static void mod_stats_on_commit(void *arg)
   if (stats->retries_max < stats->retries)
     stats->retries_max = stats->retries;
   stats->retries = 0;
+  stats->extensions += info.nb_extensions;
+  stats->rs_hist[mod_stats_bucket(info.read_set_nb_entries)]++;
+  stats->ws_hist[mod_stats_bucket(info.write_set_nb_entries)]++;
+  stats->rw_set_bytes = info.rw_set_bytes;
 }
 
 /*
@@ -194,11 +309,16 @@ static void mod_stats_on_commit(void *arg)
 static void mod_stats_on_abort(void *arg)
 {
   mod_stats_data_t *stats;
+  stm_tx_info_t info;
 
   stats = (mod_stats_data_t *)stm_get_specific(mod_stats_key);
   assert(stats != NULL);
+  stm_get_tx_info(&info);
 
   stats->retries++;
+  stats->aborts++;
+  stats->extensions += info.nb_extensions;
+  stats->aborts_r[(info.abort_reason >> 8) & 0x0F]++;
 }
 
 /*
@@ -0,0 +1,440 @@
+/*
+ * File:
+ *   mod_trace.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Module for tracing transactional events.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include <pthread.h>
+
+#include "mod_trace.h"
+
+#include "atomic.h"
+#include "stm.h"
+#include "utils.h"
+
+/* ################################################################### *
+ * TYPES
+ * ################################################################### */
+
+#define TRACE_FILE                      "STM_TRACE_FILE"
+#define TRACE_FILE_DEFAULT              "stm.trace"
+#define TRACE_SIZE                      "STM_TRACE_SIZE"
+#define TRACE_SIZE_DEFAULT              (64UL << 20)
+#define TRACE_START                     "STM_TRACE_START"
+#define TRACE_RING_SIZE                 (1UL << 14)     /* Records per thread (power of 2) */
+#define TRACE_FLUSH_PERIOD              1000            /* Microseconds between flushes */
+
+/*
+ * Ring buffers are written by their owner thread and drained by the
+ * flusher thread.  Head and tail are on different cache lines and the
+ * owner only reads the tail when the ring seems to be full.  Rings of
+ * exited threads are reused once drained.
+ */
+typedef struct trace_ring {             /* Per-thread ring buffer */
+  volatile unsigned long head ALIGNED;  /* Next record to write (owner) */
+  unsigned long limit;                  /* Cached tail + ring size (owner) */
+  volatile unsigned long dropped;       /* Number of dropped records (owner) */
+  uint64_t start;                       /* Start time of current attempt (owner) */
+  uint16_t thread;                      /* Thread index (owner) */
+  uint8_t flags;                        /* Is start that of current attempt? (owner) */
+  volatile unsigned long tail ALIGNED;  /* Next record to flush (flusher) */
+  volatile stm_word_t used;             /* Is ring used by a thread? */
+  stm_trace_record_t *records;          /* Records */
+  struct trace_ring *next;              /* Next ring */
+} ALIGNED trace_ring_t;
+
+static struct {
+  int fd;                               /* Trace file */
+  size_t size;                          /* Size of mapping */
+  stm_trace_header_t *header;           /* Mapping of trace file */
+  stm_trace_record_t *records;          /* Records in trace file */
+  unsigned long max;                    /* Maximum number of records in file */
+  unsigned long dropped;                /* Number of records dropped because file is full */
+  trace_ring_t *volatile rings;         /* Ring buffers */
+  volatile stm_word_t nb_threads;       /* Number of threads seen so far */
+  volatile stm_word_t stop;             /* Should flusher thread stop? */
+  pthread_t flusher;                    /* Flusher thread */
+  pthread_mutex_t mutex;                /* Mutex to flush records */
+} trace;
+
+static int mod_trace_key;
+static int mod_trace_initialized = 0;
+
+/* ################################################################### *
+ * FUNCTIONS
+ * ################################################################### */
+
+/*
+ * Returns a time measurement (clock ticks for x86).
+ */
+static inline uint64_t get_time(void) {
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (((uint64_t)hi) << 32) | (((uint64_t)lo) & 0xffffffff);
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+#endif
+}
+
+/*
+ * Returns real time in nanoseconds.
+ */
+static uint64_t get_real_time(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000000ULL + (uint64_t)tv.tv_usec * 1000ULL;
+}
+
+/*
+ * Add record to ring buffer (owner thread only).
+ */
+static INLINE uint64_t trace_add(trace_ring_t *r, struct stm_tx *tx, int event, unsigned int reason, stm_tx_info_t *info)
+{
+  stm_trace_record_t *rec;
+  unsigned long h;
+  uint64_t now;
+
+  h = r->head;
+  if (unlikely(h >= r->limit)) {
+    /* Ring seems full: check again how far flusher is */
+    r->limit = ATOMIC_LOAD_ACQ(&r->tail) + TRACE_RING_SIZE;
+    if (h >= r->limit) {
+      ATOMIC_STORE(&r->dropped, r->dropped + 1);
+      return get_time();
+    }
+  }
+  now = get_time();
+  rec = &r->records[h & (TRACE_RING_SIZE - 1)];
+  rec->ts = now;
+  rec->duration = (now - r->start > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)(now - r->start));
+  rec->thread = r->thread;
+  rec->event = (uint8_t)event;
+  rec->flags = r->flags;
+  rec->id = (tx != NULL ? (uint16_t)stm_get_attributes_tx(tx).id : 0);
+  rec->reason = reason;
+  if (info != NULL) {
+    rec->rs = info->read_set_nb_entries;
+    rec->ws = info->write_set_nb_entries;
+    rec->extensions = (info->nb_extensions > 0xFFFF ? 0xFFFF : (uint16_t)info->nb_extensions);
+  } else {
+    rec->rs = rec->ws = 0;
+    rec->extensions = 0;
+  }
+  /* Publish record */
+  ATOMIC_STORE_REL(&r->head, h + 1);
+
+  return now;
+}
+
+/*
+ * Copy records of ring buffers to trace file (trace.mutex must be held).
+ */
+static void trace_flush(void)
+{
+  trace_ring_t *r;
+  unsigned long h, t, n;
+
+  for (r = (trace_ring_t *)ATOMIC_LOAD_ACQ(&trace.rings); r != NULL; r = r->next) {
+    h = ATOMIC_LOAD_ACQ(&r->head);
+    t = r->tail;
+    while (t != h) {
+      /* Contiguous records */
+      n = TRACE_RING_SIZE - (t & (TRACE_RING_SIZE - 1));
+      if (n > h - t)
+        n = h - t;
+      if (n > trace.max - trace.header->nb_records) {
+        /* File is full */
+        trace.dropped += n - (trace.max - trace.header->nb_records);
+        n = trace.max - trace.header->nb_records;
+      }
+      memcpy(trace.records + trace.header->nb_records, &r->records[t & (TRACE_RING_SIZE - 1)], n * sizeof(stm_trace_record_t));
+      trace.header->nb_records += n;
+      t += n;
+      if (trace.header->nb_records == trace.max) {
+        /* Skip remaining records */
+        trace.dropped += h - t;
+        t = h;
+      }
+    }
+    ATOMIC_STORE_REL(&r->tail, t);
+  }
+}
+
+/*
+ * Background thread flushing ring buffers.
+ */
+static void *trace_flusher(void *arg)
+{
+  while (!ATOMIC_LOAD(&trace.stop)) {
+    pthread_mutex_lock(&trace.mutex);
+    trace_flush();
+    pthread_mutex_unlock(&trace.mutex);
+    usleep(TRACE_FLUSH_PERIOD);
+  }
+  return NULL;
+}
+
+/*
+ * Stop tracing and close trace file.
+ */
+void stm_trace_close(void)
+{
+  trace_ring_t *r;
+  unsigned long dropped;
+
+  if (!mod_trace_initialized || trace.header == NULL)
+    return;
+
+  ATOMIC_STORE(&trace.stop, 1);
+  pthread_join(trace.flusher, NULL);
+
+  pthread_mutex_lock(&trace.mutex);
+  trace_flush();
+  dropped = trace.dropped;
+  for (r = trace.rings; r != NULL; r = r->next)
+    dropped += ATOMIC_LOAD(&r->dropped);
+  trace.header->nb_dropped = dropped;
+  trace.header->ts_end = get_time();
+  trace.header->ns_end = get_real_time();
+  /* Truncate file to records */
+  if (ftruncate(trace.fd, sizeof(stm_trace_header_t) + trace.header->nb_records * sizeof(stm_trace_record_t)) != 0)
+    perror("ftruncate");
+  munmap(trace.header, trace.size);
+  close(trace.fd);
+  trace.header = NULL;
+  pthread_mutex_unlock(&trace.mutex);
+}
+
+/*
+ * Clean up module.
+ */
+static void cleanup(void)
+{
+  trace_ring_t *r, *n;
+
+  stm_trace_close();
+
+  /* Rings can only be freed if no thread is still running */
+  for (r = trace.rings; r != NULL; r = r->next) {
+    if (ATOMIC_LOAD(&r->used) != 0)
+      return;
+  }
+  for (r = trace.rings; r != NULL; r = n) {
+    n = r->next;
+    xfree(r->records);
+    xfree(r);
+  }
+  trace.rings = NULL;
+  pthread_mutex_destroy(&trace.mutex);
+}
+
+/*
+ * Called upon thread creation.
+ */
+static void mod_trace_on_thread_init(void *arg)
+{
+  trace_ring_t *r, *head;
+
+  /* Reuse drained ring of exited thread if any */
+  for (r = (trace_ring_t *)ATOMIC_LOAD_ACQ(&trace.rings); r != NULL; r = r->next) {
+    if (ATOMIC_LOAD(&r->used) == 0 && ATOMIC_LOAD(&r->tail) == r->head && ATOMIC_CAS_FULL(&r->used, 0, 1) != 0)
+      break;
+  }
+  if (r == NULL) {
+    r = (trace_ring_t *)xmalloc_aligned(sizeof(trace_ring_t));
+    memset(r, 0, sizeof(trace_ring_t));
+    r->records = (stm_trace_record_t *)xmalloc_aligned(TRACE_RING_SIZE * sizeof(stm_trace_record_t));
+    r->used = 1;
+    do {
+      head = (trace_ring_t *)ATOMIC_LOAD(&trace.rings);
+      r->next = head;
+    } while (ATOMIC_CAS_FULL(&trace.rings, head, r) == 0);
+  }
+  r->limit = ATOMIC_LOAD_ACQ(&r->tail) + TRACE_RING_SIZE;
+  r->thread = (uint16_t)ATOMIC_FETCH_INC_FULL(&trace.nb_threads);
+  r->flags = 0;
+
+  stm_set_specific(mod_trace_key, r);
+  r->start = trace_add(r, NULL, STM_TRACE_THREAD_INIT, 0, NULL);
+}
+
+/*
+ * Called upon thread deletion.
+ */
+static void mod_trace_on_thread_exit(void *arg)
+{
+  trace_ring_t *r;
+
+  r = (trace_ring_t *)stm_get_specific(mod_trace_key);
+  assert(r != NULL);
+
+  trace_add(r, NULL, STM_TRACE_THREAD_EXIT, 0, NULL);
+  /* Ring will be drained by flusher before being reused */
+  ATOMIC_STORE_REL(&r->used, 0);
+}
+
+/*
+ * Called upon transaction start (only if STM_TRACE_START is set).
+ */
+static void mod_trace_on_start(void *arg)
+{
+  trace_ring_t *r;
+
+  r = (trace_ring_t *)stm_get_specific(mod_trace_key);
+  r->start = get_time();
+  r->flags = STM_TRACE_FLAG_START;
+}
+
+/*
+ * Called upon transaction commit.
+ */
+static void mod_trace_on_commit(void *arg)
+{
+  trace_ring_t *r;
+  struct stm_tx *tx;
+  stm_tx_info_t info;
+
+  tx = stm_current_tx();
+  r = (trace_ring_t *)stm_get_specific_tx(tx, mod_trace_key);
+  stm_get_tx_info_tx(tx, &info);
+  /* Next attempt starts at the latest upon commit (saves a clock read upon start) */
+  r->start = trace_add(r, tx, STM_TRACE_COMMIT, 0, &info);
+  r->flags = 0;
+}
+
+/*
+ * Called upon transaction abort.
+ */
+static void mod_trace_on_abort(void *arg)
+{
+  trace_ring_t *r;
+  struct stm_tx *tx;
+  stm_tx_info_t info;
+
+  tx = stm_current_tx();
+  r = (trace_ring_t *)stm_get_specific_tx(tx, mod_trace_key);
+  stm_get_tx_info_tx(tx, &info);
+  /* Next attempt starts upon abort */
+  r->start = trace_add(r, tx, STM_TRACE_ABORT, info.abort_reason, &info);
+  r->flags = STM_TRACE_FLAG_START;
+}
+
+/*
+ * Called upon snapshot extension and irrevocability.
+ */
+static void mod_trace_on_event(int event, void *arg)
+{
+  struct stm_tx *tx;
+  stm_tx_info_t info;
+
+  tx = stm_current_tx();
+  stm_get_tx_info_tx(tx, &info);
+  trace_add((trace_ring_t *)stm_get_specific_tx(tx, mod_trace_key), tx,
+            (event == STM_EVENT_EXTEND ? STM_TRACE_EXTEND : STM_TRACE_IRREVOCABLE), 0, &info);
+}
+
+/*
+ * Initialize module.
+ */
+void mod_trace_init(const char *path, size_t size)
+{
+  char *s;
+
+  if (mod_trace_initialized)
+    return;
+
+  if (path == NULL && (path = getenv(TRACE_FILE)) == NULL)
+    path = TRACE_FILE_DEFAULT;
+  if (size == 0) {
+    s = getenv(TRACE_SIZE);
+    size = (s != NULL ? (size_t)strtoul(s, NULL, 10) : TRACE_SIZE_DEFAULT);
+  }
+  if (size < sizeof(stm_trace_header_t) + sizeof(stm_trace_record_t)) {
+    fprintf(stderr, "Trace file too small\n");
+    exit(1);
+  }
+
+  /* Map trace file */
+  trace.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (trace.fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  if (ftruncate(trace.fd, size) != 0) {
+    perror("ftruncate");
+    exit(1);
+  }
+  trace.size = size;
+  trace.header = (stm_trace_header_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, trace.fd, 0);
+  if (trace.header == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  trace.records = (stm_trace_record_t *)(trace.header + 1);
+  trace.max = (size - sizeof(stm_trace_header_t)) / sizeof(stm_trace_record_t);
+  trace.dropped = 0;
+  trace.rings = NULL;
+  trace.nb_threads = 0;
+  trace.stop = 0;
+  memset(trace.header, 0, sizeof(stm_trace_header_t));
+  trace.header->magic = STM_TRACE_MAGIC;
+  trace.header->version = STM_TRACE_VERSION;
+  trace.header->record_size = sizeof(stm_trace_record_t);
+  trace.header->ts_start = get_time();
+  trace.header->ns_start = get_real_time();
+
+  s = getenv(TRACE_START);
+  if (!stm_register(mod_trace_on_thread_init, mod_trace_on_thread_exit, (s != NULL && atoi(s) != 0 ? mod_trace_on_start : NULL),
+                    NULL, mod_trace_on_commit, mod_trace_on_abort, NULL) ||
+      !stm_register_event(mod_trace_on_event, NULL)) {
+    fprintf(stderr, "Cannot register callbacks\n");
+    exit(1);
+  }
+  mod_trace_key = stm_create_specific();
+  if (mod_trace_key < 0) {
+    fprintf(stderr, "Cannot create specific key\n");
+    exit(1);
+  }
+  if (pthread_mutex_init(&trace.mutex, NULL) != 0) {
+    fprintf(stderr, "Error creating mutex\n");
+    exit(1);
+  }
+  if (pthread_create(&trace.flusher, NULL, trace_flusher, NULL) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    exit(1);
+  }
+  atexit(cleanup);
+  mod_trace_initialized = 1;
+}
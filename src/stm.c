@@ -25,13 +25,33 @@
 
 #include <assert.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <pthread.h>
 #include <sched.h>
+#ifdef DYNAMIC_LOCK_ARRAY
+# include <errno.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif /* DYNAMIC_LOCK_ARRAY */
+#ifdef AUTO_TUNE
+# include <errno.h>
+# include <time.h>
+#endif /* AUTO_TUNE */
+#ifdef HELPER_VALIDATION
+# include <time.h>
+#endif /* HELPER_VALIDATION */
+#ifdef PROCESS_SHARED
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+#endif /* PROCESS_SHARED */
 
 #include "stm.h"
+#include "stm_inline.h"
 #include "stm_internal.h"
 
 #include "utils.h"
@@ -47,7 +67,9 @@ static const char *design_names[] = {
   /* 0 */ "WRITE-BACK (ETL)",
   /* 1 */ "WRITE-BACK (CTL)",
   /* 2 */ "WRITE-THROUGH",
-  /* 3 */ "WRITE-MODULAR"
+  /* 3 */ "WRITE-MODULAR",
+  /* 4 */ "NOREC",
+  /* 5 */ "RING"
 };
 
 static const char *cm_names[] = {
@@ -57,6 +79,29 @@ static const char *cm_names[] = {
   /* 3 */ "MODULAR"
 };
 
+static const char *clock_names[] = {
+  /* 0 */ "COUNTER",
+  /* 1 */ "GV4",
+  /* 2 */ "DEFERRED",
+  /* 3 */ "TSC"
+};
+
+#ifdef SIMD_VALIDATION
+static const char *simd_names[] = {
+  /* 0 */ "NONE",
+  /* 1 */ "AVX2",
+  /* 2 */ "AVX512"
+};
+#endif /* SIMD_VALIDATION */
+
+#ifdef DURABLE_TX
+static const char *durable_flush_names[] = {
+  /* 0 */ "CLFLUSH",
+  /* 1 */ "CLFLUSHOPT",
+  /* 2 */ "CLWB"
+};
+#endif /* DURABLE_TX */
+
 /* Global variables */
 global_t _tinystm =
     { .nb_specific = 0
@@ -66,6 +111,13 @@ global_t _tinystm =
 #endif /* IRREVOCABLE_ENABLED */
     };
 
+/* Location of fields accessed by inlined loads (see stm_inline.h) */
+#ifdef INLINE_FAST_PATH
+const stm_word_t stm_inline_offset = offsetof(stm_tx_t, fast_locks);
+#else /* ! INLINE_FAST_PATH */
+const stm_word_t stm_inline_offset = 0;
+#endif /* ! INLINE_FAST_PATH */
+
 /* ################################################################### *
  * TYPES
  * ################################################################### */
@@ -92,6 +144,14 @@ global_t _tinystm =
  * composability.
  */
 
+/*
+ * With CLOSED_NESTING, a nested transaction started with the
+ * closed_nesting attribute gets its own environment for setjmp/longjmp.
+ * Upon conflict, only the changes of the innermost closed nested
+ * transaction are rolled back and it restarts, provided that the
+ * parent is still consistent (see stm_nested.h).
+ */
+
 /*
  * Reading from the previous version of locked addresses is implemented
  * by peeking into the write set of the transaction that owns the
@@ -180,6 +240,42 @@ cm_karma(struct stm_tx *me, struct stm_tx *other, int conflict)
   return KILL_SELF;
 }
 
+/*
+ * Transaction with higher priority has priority (oldest one if equal).
+ * Priorities are raised every PRIO_AGING consecutive aborts.
+ */
+static int
+cm_priority(struct stm_tx *me, struct stm_tx *other, int conflict)
+{
+  unsigned int me_prio, other_prio;
+
+  me_prio = me->attr.priority;
+  other_prio = other->attr.priority;
+# if PRIO_AGING > 0
+  me_prio += me->stat_retries / PRIO_AGING;
+  other_prio += other->stat_retries / PRIO_AGING;
+# endif /* PRIO_AGING > 0 */
+
+  if (me_prio > other_prio)
+    return KILL_OTHER;
+  if (me_prio < other_prio)
+    return KILL_SELF | DELAY_RESTART;
+  return cm_timestamp(me, other, conflict);
+}
+
+# ifdef ADAPTIVE_SCHEDULING
+/*
+ * Transaction serialized by the scheduler has priority.
+ */
+static int
+cm_ats(struct stm_tx *me, struct stm_tx *other, int conflict)
+{
+  if (me->ats_queue != NULL && other->ats_queue == NULL)
+    return KILL_OTHER;
+  return KILL_SELF | DELAY_RESTART;
+}
+# endif /* ADAPTIVE_SCHEDULING */
+
 struct {
   const char *name;
   int (*f)(stm_tx_t *, stm_tx_t *, int);
@@ -189,10 +285,49 @@ struct {
   { "delay", cm_delay },
   { "timestamp", cm_timestamp },
   { "karma", cm_karma },
+  { "priority", cm_priority },
+# ifdef ADAPTIVE_SCHEDULING
+  { "ats", cm_ats },
+# endif /* ADAPTIVE_SCHEDULING */
   { NULL, NULL }
 };
 #endif /* CM == CM_MODULAR */
 
+#if DESIGN == MODULAR
+# define DESIGN_TABLE(id, name) \
+  { id, name##_read, name##_write, name##_RaR, name##_RaW, name##_RfW, name##_WaR, name##_WaW, \
+    name##_validate, name##_extend, name##_commit, name##_rollback }
+
+/* Functions of designs (indexed by design) */
+const stm_design_t stm_designs[3] = {
+  DESIGN_TABLE(WRITE_BACK_ETL, stm_wbetl),
+  DESIGN_TABLE(WRITE_BACK_CTL, stm_wbctl),
+  DESIGN_TABLE(WRITE_THROUGH, stm_wt)
+};
+
+/* Short names of designs (also accepted besides design_names) */
+static const char *design_short_names[] = {
+  /* 0 */ "wbetl",
+  /* 1 */ "wbctl",
+  /* 2 */ "wt"
+};
+
+/*
+ * Find design from name (NULL if unknown).
+ */
+static const stm_design_t *
+stm_design_lookup(const char *name)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    if (strcasecmp(name, design_names[i]) == 0 || strcasecmp(name, design_short_names[i]) == 0)
+      return &stm_designs[i];
+  }
+  return NULL;
+}
+#endif /* DESIGN == MODULAR */
+
 #ifdef SIGNAL_HANDLER
 /*
  * Catch signal (to emulate non-faulting load).
@@ -213,6 +348,15 @@ signal_catcher(int sig)
     exit(1);
   }
 
+#ifdef SANDBOXING
+  /* A transaction with a consistent snapshot would also fault outside of the transaction */
+  if (!tx->attr.read_only && stm_extend(tx)) {
+    /* Not caused by inconsistent values: let the fault happen again without handler */
+    signal(sig, SIG_DFL);
+    return;
+  }
+#endif /* SANDBOXING */
+
   /* Unblock the signal since there is no return to signal handler */
   sigemptyset(&block_signal);
   sigaddset(&block_signal, sig);
@@ -227,15 +371,650 @@ signal_catcher(int sig)
  * STM FUNCTIONS
  * ################################################################### */
 
+#ifdef DYNAMIC_LOCK_ARRAY
+# ifndef MPOL_INTERLEAVE
+#  define MPOL_INTERLEAVE               3
+# endif /* ! MPOL_INTERLEAVE */
+# define NUMA_NODES_ONLINE              "/sys/devices/system/node/online"
+# define NUMA_MAX_NODES                 1024
+
+# ifdef SYS_mbind
+/*
+ * Get mask of online NUMA nodes (return number of nodes, 0 if unknown).
+ */
+static int
+lock_array_nodes(unsigned long *nodes)
+{
+  FILE *f;
+  unsigned long first, last, i;
+  int nb, c;
+
+  memset(nodes, 0, NUMA_MAX_NODES / 8);
+  if ((f = fopen(NUMA_NODES_ONLINE, "r")) == NULL)
+    return 0;
+  /* List of ranges (e.g., "0-3,6") */
+  nb = 0;
+  while (fscanf(f, "%lu", &first) == 1) {
+    last = first;
+    if ((c = fgetc(f)) == '-') {
+      if (fscanf(f, "%lu", &last) != 1)
+        break;
+      c = fgetc(f);
+    }
+    for (i = first; i <= last && i < NUMA_MAX_NODES; i++) {
+      nodes[i / (sizeof(unsigned long) * 8)] |= 1UL << (i % (sizeof(unsigned long) * 8));
+      nb++;
+    }
+    if (c != ',')
+      break;
+  }
+  fclose(f);
+  return nb;
+}
+# endif /* SYS_mbind */
+
+/*
+ * Map zeroed memory for per-lock data (try huge pages first).
+ */
+static void *
+lock_array_map(size_t size, int *huge)
+{
+  void *p = MAP_FAILED;
+# ifdef SYS_mbind
+  unsigned long nodes[NUMA_MAX_NODES / (sizeof(unsigned long) * 8)];
+  int nb;
+# endif /* SYS_mbind */
+
+  *huge = 0;
+# ifdef MAP_HUGETLB
+  /* Explicit huge pages (only if some have been reserved) */
+  if (size % LOCK_ARRAY_HUGE_PAGE == 0) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+      *huge = 1;
+  }
+# endif /* MAP_HUGETLB */
+  if (p == MAP_FAILED) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+    }
+# ifdef MADV_HUGEPAGE
+    /* Transparent huge pages */
+    if (size >= LOCK_ARRAY_HUGE_PAGE && madvise(p, size, MADV_HUGEPAGE) == 0)
+      *huge = 2;
+# endif /* MADV_HUGEPAGE */
+  }
+# ifdef SYS_mbind
+  if (_tinystm.lock_array_interleave) {
+    /* Nothing to interleave on a single node */
+    if ((nb = lock_array_nodes(nodes)) > 1 && syscall(SYS_mbind, p, size, MPOL_INTERLEAVE, nodes, NUMA_MAX_NODES, 0) != 0) {
+      fprintf(stderr, "Warning: cannot interleave lock array (%s)\n", strerror(errno));
+      _tinystm.lock_array_interleave = 0;
+    }
+  }
+# endif /* SYS_mbind */
+  /* Pages are allocated upon first access */
+
+  return p;
+}
+
+/*
+ * Check size of lock array.
+ */
+static int
+lock_array_valid(unsigned int log_size)
+{
+# ifdef LOCK_IDX_SWAP
+  if (log_size < 16)
+    return 0;
+# endif /* LOCK_IDX_SWAP */
+  return log_size >= 8 && log_size <= 31;
+}
+
+#ifdef PROCESS_SHARED
+/*
+ * Check whether the shared segment has been removed (or replaced) since
+ * it was opened, e.g., by the last process detaching from it.
+ */
+static int
+shm_removed(int fd)
+{
+  struct stat st, cur;
+  int fd2, removed;
+
+  if ((fd2 = shm_open(_tinystm.shm_name, O_RDWR, 0)) < 0)
+    return (errno == ENOENT);
+  removed = (fstat(fd, &st) == 0 && fstat(fd2, &cur) == 0 && (st.st_dev != cur.st_dev || st.st_ino != cur.st_ino));
+  close(fd2);
+
+  return removed;
+}
+
+/*
+ * Create the shared segment or attach to the segment of other processes
+ * (whose settings of the lock array are then used).  Attaching restarts
+ * if the segment is removed by its last process in the meantime.
+ */
+static void
+shm_attach(void)
+{
+  struct stat st;
+  shm_header_t *shm;
+  stm_word_t nb;
+  size_t size;
+  int fd, creator, i, retries;
+  void *p;
+
+  if ((_tinystm.shm_name = getenv(SHM_NAME_ENV)) == NULL)
+    _tinystm.shm_name = SHM_NAME_DEFAULT;
+  retries = 0;
+ retry:
+  size = SHM_LOCKS_OFFSET + LOCK_ARRAY_SIZE * sizeof(stm_word_t);
+  creator = 1;
+  fd = shm_open(_tinystm.shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    creator = 0;
+    fd = shm_open(_tinystm.shm_name, O_RDWR, 0);
+    if (fd < 0 && errno == ENOENT)
+      goto retry;
+  }
+  if (fd < 0) {
+    perror("shm_open");
+    exit(1);
+  }
+  if (creator) {
+    /* Clock, locks and slots are zeroed */
+    if (ftruncate(fd, size) != 0) {
+      perror("ftruncate");
+      shm_unlink(_tinystm.shm_name);
+      exit(1);
+    }
+  } else {
+    /* Wait for the creator to set the size */
+    for (i = 0; fstat(fd, &st) == 0 && st.st_size == 0; i++) {
+      if (shm_removed(fd)) {
+        close(fd);
+        goto retry;
+      }
+      if (i == SHM_WAIT)
+        goto timeout;
+      usleep(1000);
+    }
+    size = (size_t)st.st_size;
+  }
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  shm = (shm_header_t *)p;
+  if (creator) {
+    shm->lock_array_log_size = _tinystm.lock_array_log_size;
+    shm->lock_shift = _tinystm.lock_shift;
+    shm->nb_procs = 1;
+    ATOMIC_STORE_REL(&shm->magic, SHM_MAGIC ^ sizeof(shm_header_t));
+  } else {
+    for (i = 0; ATOMIC_LOAD_ACQ(&shm->magic) == 0; i++) {
+      if (shm_removed(fd)) {
+        munmap(p, size);
+        close(fd);
+        goto retry;
+      }
+      if (i == SHM_WAIT)
+        goto timeout;
+      usleep(1000);
+    }
+    if (shm->magic != (SHM_MAGIC ^ sizeof(shm_header_t)) || !lock_array_valid(shm->lock_array_log_size)
+        || size != SHM_LOCKS_OFFSET + ((size_t)1 << shm->lock_array_log_size) * sizeof(stm_word_t)) {
+      fprintf(stderr, "Error: incompatible shared segment %s\n", _tinystm.shm_name);
+      exit(1);
+    }
+    /* No process may join once the last one has left (it removes the segment) */
+    do {
+      if ((nb = ATOMIC_LOAD_ACQ(&shm->nb_procs)) == 0) {
+        munmap(p, size);
+        close(fd);
+        if (++retries == SHM_WAIT)
+          goto timeout;
+        usleep(1000);
+        goto retry;
+      }
+    } while (ATOMIC_CAS_FULL(&shm->nb_procs, nb, nb + 1) == 0);
+    _tinystm.lock_array_log_size = shm->lock_array_log_size;
+    _tinystm.lock_mask = ((stm_word_t)1 << shm->lock_array_log_size) - 1;
+    _tinystm.lock_shift = shm->lock_shift;
+  }
+  _tinystm.shm = shm;
+  _tinystm.shm_size = size;
+  _tinystm.locks = (volatile stm_word_t *)((char *)p + SHM_LOCKS_OFFSET);
+  close(fd);
+  PRINT_DEBUG("\tSTM_SHM_NAME=%s CREATOR=%d PROCESSES=%lu\n", _tinystm.shm_name, creator, (unsigned long)shm->nb_procs);
+  return;
+
+ timeout:
+  fprintf(stderr, "Error: shared segment %s not initialized by its creator\n", _tinystm.shm_name);
+  exit(1);
+}
+
+/*
+ * Detach from the shared segment (removed by the last process).
+ */
+static void
+shm_detach(void)
+{
+  stm_word_t pid = (stm_word_t)getpid();
+  unsigned int i;
+  int last;
+
+  /* Release slots still held (e.g., by pooled descriptors) */
+  for (i = 0; i < SHM_SLOT_MASK; i++) {
+    if (ATOMIC_LOAD(&_tinystm.shm->slots[i]) == pid)
+      ATOMIC_STORE_REL(&_tinystm.shm->slots[i], 0);
+    _tinystm.shm_ws[i] = NULL;
+  }
+  last = (ATOMIC_FETCH_DEC_FULL(&_tinystm.shm->nb_procs) == 1);
+  munmap((void *)_tinystm.shm, _tinystm.shm_size);
+  if (last)
+    shm_unlink(_tinystm.shm_name);
+  _tinystm.shm = NULL;
+}
+#endif /* PROCESS_SHARED */
+
+/*
+ * Allocate lock array (and associated data) of the requested size.
+ */
+static void
+lock_array_alloc(void)
+{
+  unsigned int log_size = _tinystm.lock_array_log_size;
+  int huge;
+
+  if (!lock_array_valid(log_size)) {
+    fprintf(stderr, "Error: invalid lock array size (2^%u)\n", log_size);
+    exit(1);
+  }
+  _tinystm.lock_mask = ((stm_word_t)1 << log_size) - 1;
+# ifdef AUTO_TUNE
+  /* Sizes explored by the tuner (the array is mapped with the largest one) */
+  _tinystm.tune_log_min = _tinystm.tune_log_max = log_size;
+  if (_tinystm.tune_period != 0) {
+    while (_tinystm.tune_log_min > log_size - TUNE_LOG_RANGE && lock_array_valid(_tinystm.tune_log_min - 1))
+      _tinystm.tune_log_min--;
+    while (_tinystm.tune_log_max < log_size + TUNE_LOG_RANGE && lock_array_valid(_tinystm.tune_log_max + 1))
+      _tinystm.tune_log_max++;
+  }
+# endif /* AUTO_TUNE */
+# ifdef PROCESS_SHARED
+  shm_attach();
+# else /* ! PROCESS_SHARED */
+  _tinystm.locks = (volatile stm_word_t *)lock_array_map(LOCK_ARRAY_MAP_SIZE * sizeof(stm_word_t), &_tinystm.lock_array_huge_pages);
+# endif /* ! PROCESS_SHARED */
+# ifdef MULTI_VERSION
+  _tinystm.mv_history = (mv_history_t *)lock_array_map(LOCK_ARRAY_MAP_SIZE * sizeof(mv_history_t), &huge);
+# endif /* MULTI_VERSION */
+  (void)huge;
+  PRINT_DEBUG("\tLOCK_ARRAY_LOG_SIZE=%u HUGE_PAGES=%d INTERLEAVE=%d\n", log_size, _tinystm.lock_array_huge_pages, _tinystm.lock_array_interleave);
+}
+
+/*
+ * Release lock array.
+ */
+static void
+lock_array_free(void)
+{
+# ifdef MULTI_VERSION
+  stm_mv_reset();
+  munmap((void *)_tinystm.mv_history, LOCK_ARRAY_MAP_SIZE * sizeof(mv_history_t));
+  _tinystm.mv_history = NULL;
+# endif /* MULTI_VERSION */
+# ifdef PROCESS_SHARED
+  shm_detach();
+# else /* ! PROCESS_SHARED */
+  munmap((void *)_tinystm.locks, LOCK_ARRAY_MAP_SIZE * sizeof(stm_word_t));
+# endif /* ! PROCESS_SHARED */
+  _tinystm.locks = NULL;
+}
+#endif /* DYNAMIC_LOCK_ARRAY */
+
+#ifdef AUTO_TUNE
+/*
+ * The tuner thread samples the number of commits per second and
+ * hill-climbs over the size of the lock array, the number of bytes
+ * covered by a lock and (with DESIGN=MODULAR) the default design, as in
+ * [PPoPP-08].  Each period, it either measures the current settings or
+ * evaluates one move (a single setting changed by one step), which is
+ * kept if throughput improves by more than TUNE_GAIN percent and
+ * reverted otherwise.  Kept moves are repeated, and tuning stops once
+ * no move improves throughput, until it changes by more than TUNE_DRIFT
+ * percent.  Settings are changed while no transaction is active, as for
+ * irrevocable transactions, and lock versions are kept: they are not
+ * newer than the clock, hence valid for any address.  Unit transactions
+ * and transactions waiting for others (e.g., with mod_order) are not
+ * blocked: they must not run concurrently with the tuner.  Decisions are
+ * logged on stderr with the environment variables that freeze them.
+ */
+typedef struct tune_config {            /* Settings explored by the tuner */
+  unsigned int log_size;                /* Log2 of size of array of locks */
+  unsigned int shift_extra;             /* Extra shift of addresses (LOCK_SHIFT_EXTRA) */
+# if DESIGN == MODULAR
+  int design;                           /* Default design */
+# endif /* DESIGN == MODULAR */
+} tune_config_t;
+
+enum {                                  /* States of the tuner */
+  TUNE_MEASURE,                         /* Measuring current settings */
+  TUNE_TRIAL,                           /* Evaluating a move */
+  TUNE_CONVERGED                        /* No move improves throughput */
+};
+
+/* Moves: lock array size +1/-1, shift +1/-1 and (with MODULAR) design +1/+2 */
+# if DESIGN == MODULAR
+#  define TUNE_MOVES                    6
+# else /* DESIGN != MODULAR */
+#  define TUNE_MOVES                    4
+# endif /* DESIGN != MODULAR */
+
+/*
+ * Get total number of commits (modulo 2^32).
+ */
+static unsigned int
+stm_tune_commits(void)
+{
+  stm_tx_t *t;
+  unsigned int n;
+
+  /* Threads enter and exit with the lock held (see stm_quiesce_exit_thread()) */
+  pthread_mutex_lock(&_tinystm.quiesce_mutex);
+  n = _tinystm.tune_commits;
+  for (t = _tinystm.threads; t != NULL; t = t->next)
+    n += *(volatile unsigned int *)&t->stat_commits;
+  pthread_mutex_unlock(&_tinystm.quiesce_mutex);
+
+  return n;
+}
+
+/*
+ * Apply move to settings (return 0 if out of range).
+ */
+static int
+stm_tune_move(tune_config_t *c, int move)
+{
+  switch (move) {
+    case 0:
+      if (c->log_size >= _tinystm.tune_log_max)
+        return 0;
+      c->log_size++;
+      return 1;
+    case 1:
+      if (c->log_size <= _tinystm.tune_log_min)
+        return 0;
+      c->log_size--;
+      return 1;
+    case 2:
+      if (c->shift_extra >= TUNE_SHIFT_EXTRA_MAX)
+        return 0;
+      c->shift_extra++;
+      return 1;
+    case 3:
+      if (c->shift_extra == 0)
+        return 0;
+      c->shift_extra--;
+      return 1;
+# if DESIGN == MODULAR
+    default:
+      c->design = (c->design + move - 3) % 3;
+      return 1;
+# endif /* DESIGN == MODULAR */
+  }
+  return 0;
+}
+
+/*
+ * Change settings while no transaction is active (return 0 if not possible).
+ */
+static int
+stm_tune_apply(const tune_config_t *c)
+{
+  stm_tx_t *t;
+  int ok;
+
+  pthread_mutex_lock(&_tinystm.quiesce_mutex);
+  /* Clock rollover in progress (see stm_quiesce_barrier()) */
+  if (_tinystm.quiesce != 0) {
+    pthread_mutex_unlock(&_tinystm.quiesce_mutex);
+    return 0;
+  }
+  /* Block new transactions and wait for active ones (see stm_quiesce()) */
+  ATOMIC_STORE_REL(&_tinystm.quiesce, 2);
+  ATOMIC_MB_FULL;
+  for (t = _tinystm.threads; t != NULL; t = t->next) {
+    while (IS_ACTIVE(ATOMIC_LOAD(&t->status)))
+      sched_yield();
+  }
+  ok = 1;
+  if (c->log_size != _tinystm.lock_array_log_size || LOCK_SHIFT_WORD + c->shift_extra != _tinystm.lock_shift) {
+# ifdef BLOCKING_RETRY
+    /* Sleepers watch the locks of their read set (see stm_retry_wait()) */
+    if (ATOMIC_LOAD(&_tinystm.retry_waiters) != 0)
+      ok = 0;
+# endif /* BLOCKING_RETRY */
+    if (ok) {
+# ifdef MULTI_VERSION
+      /* Histories are indexed by lock */
+      stm_mv_reset();
+# endif /* MULTI_VERSION */
+      _tinystm.lock_array_log_size = c->log_size;
+      _tinystm.lock_mask = ((stm_word_t)1 << c->log_size) - 1;
+      _tinystm.lock_shift = LOCK_SHIFT_WORD + c->shift_extra;
+    }
+  }
+# if DESIGN == MODULAR
+  if (ok)
+    _tinystm.design = &stm_designs[c->design];
+# endif /* DESIGN == MODULAR */
+  stm_quiesce_release(NULL);
+
+  return ok;
+}
+
+/*
+ * Log decision of the tuner.
+ */
+static void
+stm_tune_log(const tune_config_t *c, unsigned long tput, const char *what)
+{
+  flockfile(stderr);
+  fprintf(stderr, "TUNE: LOCK_ARRAY_LOG_SIZE=%u LOCK_SHIFT_EXTRA=%u", c->log_size, c->shift_extra);
+# if DESIGN == MODULAR
+  fprintf(stderr, " STM_DESIGN=%s", design_short_names[c->design]);
+# endif /* DESIGN == MODULAR */
+  fprintf(stderr, " %lu commits/s (%s)\n", tput, what);
+  funlockfile(stderr);
+}
+
+/*
+ * Tuner thread.
+ */
+static void *
+stm_tune_thread(void *arg)
+{
+  tune_config_t cur, trial;
+  struct timespec ts, last, now;
+  unsigned long tput, base;
+  unsigned int prev, c;
+  int state, move, failed, next;
+
+  cur.log_size = _tinystm.lock_array_log_size;
+  cur.shift_extra = _tinystm.lock_shift - LOCK_SHIFT_WORD;
+# if DESIGN == MODULAR
+  cur.design = _tinystm.design->id;
+# endif /* DESIGN == MODULAR */
+  trial = cur;
+  state = TUNE_MEASURE;
+  move = failed = 0;
+  base = 0;
+  prev = stm_tune_commits();
+  clock_gettime(CLOCK_MONOTONIC, &last);
+
+  pthread_mutex_lock(&_tinystm.tune_mutex);
+  while (!_tinystm.tune_stop) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += _tinystm.tune_period / 1000;
+    ts.tv_nsec += (long)(_tinystm.tune_period % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    while (!_tinystm.tune_stop && pthread_cond_timedwait(&_tinystm.tune_cond, &_tinystm.tune_mutex, &ts) != ETIMEDOUT)
+      ;
+    if (_tinystm.tune_stop)
+      break;
+    pthread_mutex_unlock(&_tinystm.tune_mutex);
+
+    c = stm_tune_commits();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    tput = (unsigned long)((c - prev) / ((now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) / 1e9));
+    last = now;
+    if (c == prev) {
+      /* No transaction: nothing to learn */
+      pthread_mutex_lock(&_tinystm.tune_mutex);
+      continue;
+    }
+    prev = c;
+
+    next = 0;
+    switch (state) {
+      case TUNE_MEASURE:
+        stm_tune_log(&cur, tput, "measure");
+        base = tput;
+        next = 1;
+        break;
+      case TUNE_TRIAL:
+        if (tput * 100 > base * (100 + TUNE_GAIN)) {
+          /* Keep and repeat move */
+          stm_tune_log(&trial, tput, "keep");
+          cur = trial;
+          base = tput;
+          failed = 0;
+          next = 1;
+        } else if (stm_tune_apply(&cur)) {
+          /* Measure again before next move */
+          stm_tune_log(&trial, tput, "revert");
+          move = (move + 1) % TUNE_MOVES;
+          failed++;
+          state = TUNE_MEASURE;
+        } else {
+          stm_tune_log(&trial, tput, "keep (cannot revert)");
+          cur = trial;
+          base = tput;
+          failed = 0;
+          next = 1;
+        }
+        break;
+      case TUNE_CONVERGED:
+        if (tput * 100 < base * (100 - TUNE_DRIFT) || tput * 100 > base * (100 + TUNE_DRIFT)) {
+          stm_tune_log(&cur, tput, "restart");
+          base = tput;
+          failed = 0;
+          next = 1;
+        }
+        break;
+    }
+    if (next) {
+      /* Try current move or next ones that can be applied */
+      for (state = TUNE_CONVERGED; failed < TUNE_MOVES; failed++, move = (move + 1) % TUNE_MOVES) {
+        trial = cur;
+        if (stm_tune_move(&trial, move) && stm_tune_apply(&trial)) {
+          state = TUNE_TRIAL;
+          break;
+        }
+      }
+      if (state == TUNE_CONVERGED)
+        stm_tune_log(&cur, base, "converged");
+    }
+
+    pthread_mutex_lock(&_tinystm.tune_mutex);
+  }
+  pthread_mutex_unlock(&_tinystm.tune_mutex);
+
+  stm_tune_log(&cur, base, "final");
+
+  return NULL;
+}
+#endif /* AUTO_TUNE */
+
+#ifdef HELPER_VALIDATION
+/*
+ * Helper thread: validate chunks of all slots in turn, and sleep when
+ * there is nothing to validate.
+ */
+static void *
+stm_hv_thread(void *arg)
+{
+  struct timespec idle;
+  hv_slot_t *s;
+  unsigned int i;
+  int work;
+
+  idle.tv_sec = 0;
+  idle.tv_nsec = HV_IDLE;
+  while (ATOMIC_LOAD(&_tinystm.hv_stop) == 0) {
+    work = 0;
+    for (i = 0; i < HV_SLOTS; i++) {
+      s = &_tinystm.hv_slots[i];
+      if (ATOMIC_LOAD(&s->tx) == 0 || ATOMIC_CAS_FULL(&s->busy, 0, 1) == 0)
+        continue;
+      work |= stm_hv_chunk(s);
+      stm_hv_unlock(s);
+    }
+    if (!work)
+      nanosleep(&idle, NULL);
+  }
+
+  return NULL;
+}
+
+/*
+ * Start helper thread.
+ */
+static void
+stm_hv_init(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < HV_SLOTS; i++) {
+    _tinystm.hv_slots[i].tx = NULL;
+    _tinystm.hv_slots[i].busy = 0;
+  }
+  _tinystm.hv_stop = 0;
+  if (pthread_create(&_tinystm.hv_thread, NULL, stm_hv_thread, NULL) != 0) {
+    perror("pthread_create");
+    exit(1);
+  }
+}
+
+/*
+ * Stop helper thread.
+ */
+static void
+stm_hv_exit(void)
+{
+  ATOMIC_STORE_REL(&_tinystm.hv_stop, 1);
+  pthread_join(_tinystm.hv_thread, NULL);
+}
+#endif /* HELPER_VALIDATION */
+
 /*
  * Called once (from main) to initialize STM infrastructure.
  */
 _CALLCONV void
 stm_init(void)
 {
-#if CM == CM_MODULAR
+#if CM == CM_MODULAR || DESIGN == MODULAR || defined(HYBRID_HTM) || defined(DYNAMIC_LOCK_ARRAY) || defined(ADAPTIVE_SCHEDULING) || defined(ELASTIC_TX) || defined(TM_STATISTICS2) || defined(IRREVOCABLE_FALLBACK) || defined(HELPER_VALIDATION)
   char *s;
-#endif /* CM == CM_MODULAR */
+#endif /* CM == CM_MODULAR || DESIGN == MODULAR || defined(HYBRID_HTM) || defined(DYNAMIC_LOCK_ARRAY) || defined(ADAPTIVE_SCHEDULING) || defined(ELASTIC_TX) || defined(TM_STATISTICS2) || defined(IRREVOCABLE_FALLBACK) || defined(HELPER_VALIDATION) */
 #ifdef SIGNAL_HANDLER
   struct sigaction act;
 #endif /* SIGNAL_HANDLER */
@@ -251,11 +1030,36 @@ stm_init(void)
 
   COMPILE_TIME_ASSERT(sizeof(stm_word_t) == sizeof(void *));
   COMPILE_TIME_ASSERT(sizeof(stm_word_t) == sizeof(atomic_t));
+#ifdef INLINE_FAST_PATH
+  /* Layout of descriptor and locks must match stm_inline.h */
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, fast_shift) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, shift));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, fast_mask) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, mask));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, fast_stop) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, stop));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, end) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, end));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, r_set.entries) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, entries));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, r_set.nb_entries) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, nb_entries));
+  COMPILE_TIME_ASSERT(offsetof(stm_tx_t, r_set.size) - offsetof(stm_tx_t, fast_locks) == offsetof(struct stm_inline, size));
+  COMPILE_TIME_ASSERT(offsetof(r_entry_t, lock) == offsetof(struct stm_inline_entry, lock));
+  COMPILE_TIME_ASSERT(sizeof(r_entry_t) == sizeof(struct stm_inline_entry));
+  COMPILE_TIME_ASSERT(LOCK_BITS == STM_INLINE_LOCK_BITS && WRITE_MASK == STM_INLINE_WRITE_MASK);
+#endif /* INLINE_FAST_PATH */
 
 #ifdef EPOCH_GC
   gc_init(stm_get_clock);
 #endif /* EPOCH_GC */
 
+#if DESIGN == MODULAR
+  /* Design set using stm_set_parameter() before initialization takes precedence */
+  if (_tinystm.design == NULL) {
+    s = getenv(DESIGN_ENV);
+    if (s != NULL && (_tinystm.design = stm_design_lookup(s)) == NULL)
+      fprintf(stderr, "Warning: unknown design \"%s\" (using %s)\n", s, design_names[WRITE_BACK_ETL]);
+    if (_tinystm.design == NULL)
+      _tinystm.design = &stm_designs[WRITE_BACK_ETL];
+  }
+  PRINT_DEBUG("\tSTM_DESIGN=%s\n", design_names[_tinystm.design->id]);
+#endif /* DESIGN == MODULAR */
+
 #if CM == CM_MODULAR
   s = getenv(VR_THRESHOLD);
   if (s != NULL)
@@ -265,9 +1069,115 @@ stm_init(void)
   PRINT_DEBUG("\tVR_THRESHOLD=%d\n", _tinystm.vr_threshold);
 #endif /* CM == CM_MODULAR */
 
+#ifdef ADAPTIVE_SCHEDULING
+  s = getenv(ATS_THRESHOLD);
+  if (s != NULL)
+    stm_ats_set_threshold((int)strtol(s, NULL, 10));
+  else
+    stm_ats_set_threshold(ATS_THRESHOLD_DEFAULT);
+  PRINT_DEBUG("\tATS_THRESHOLD=%d\n", _tinystm.ats_threshold);
+#endif /* ADAPTIVE_SCHEDULING */
+
+#ifdef SIMD_VALIDATION
+  COMPILE_TIME_ASSERT(sizeof(r_entry_t) == 2 * sizeof(stm_word_t));
+  _tinystm.simd = stm_simd_detect();
+  PRINT_DEBUG("\tSIMD=%s\n", simd_names[_tinystm.simd]);
+#endif /* SIMD_VALIDATION */
+
+#ifdef HYBRID_HTM
+  _tinystm.htm_enabled = stm_htm_supported();
+  s = getenv(HTM_RETRIES);
+  if (s != NULL)
+    _tinystm.htm_retries = (int)strtol(s, NULL, 10);
+  else
+    _tinystm.htm_retries = HTM_RETRIES_DEFAULT;
+  PRINT_DEBUG("\tHTM=%d HTM_RETRIES=%d\n", _tinystm.htm_enabled, _tinystm.htm_retries);
+#endif /* HYBRID_HTM */
+
+#ifdef ELASTIC_TX
+  s = getenv(ELASTIC_WINDOW);
+  if (s != NULL)
+    _tinystm.elastic_window = (unsigned int)strtoul(s, NULL, 10);
+  if (_tinystm.elastic_window == 0)
+    _tinystm.elastic_window = ELASTIC_WINDOW_DEFAULT;
+  PRINT_DEBUG("\tELASTIC_WINDOW=%u\n", _tinystm.elastic_window);
+#endif /* ELASTIC_TX */
+
+#ifdef TM_STATISTICS2
+  s = getenv(STATS_SAMPLING);
+  if (s != NULL)
+    _tinystm.prof_period = (unsigned int)strtoul(s, NULL, 10);
+  else
+    _tinystm.prof_period = STATS_SAMPLING_DEFAULT;
+  PRINT_DEBUG("\tSTATS_SAMPLING=%u\n", _tinystm.prof_period);
+#endif /* TM_STATISTICS2 */
+
+#ifdef IRREVOCABLE_FALLBACK
+  {
+    unsigned int retries = IRREVOCABLE_RETRIES_DEFAULT;
+    unsigned long cycles = IRREVOCABLE_CYCLES_DEFAULT;
+    int serial = 0;
+    if ((s = getenv(IRREVOCABLE_RETRIES)) != NULL)
+      retries = (unsigned int)strtoul(s, NULL, 10);
+    if ((s = getenv(IRREVOCABLE_CYCLES)) != NULL)
+      cycles = strtoul(s, NULL, 10);
+    if ((s = getenv(IRREVOCABLE_SERIAL)) != NULL)
+      serial = (int)strtol(s, NULL, 10);
+    stm_fallback_init(retries, cycles, serial);
+    PRINT_DEBUG("\tIRREVOCABLE_RETRIES=%u IRREVOCABLE_CYCLES=%lu IRREVOCABLE_SERIAL=%d\n", retries, cycles, serial);
+  }
+#endif /* IRREVOCABLE_FALLBACK */
+
+#ifdef HELPER_VALIDATION
+  s = getenv(HELPER_THRESHOLD);
+  if (s != NULL)
+    _tinystm.hv_threshold = (unsigned int)strtoul(s, NULL, 10);
+  else
+    _tinystm.hv_threshold = HELPER_THRESHOLD_DEFAULT;
+  PRINT_DEBUG("\tHELPER_THRESHOLD=%u\n", _tinystm.hv_threshold);
+#endif /* HELPER_VALIDATION */
+
+#ifdef DYNAMIC_LOCK_ARRAY
+  /* Size set using stm_set_parameter() before initialization takes precedence */
+  if (_tinystm.lock_array_log_size == 0) {
+    s = getenv(LOCK_ARRAY_LOG_SIZE_ENV);
+    if (s != NULL)
+      _tinystm.lock_array_log_size = (unsigned int)strtol(s, NULL, 10);
+    else
+      _tinystm.lock_array_log_size = LOCK_ARRAY_LOG_SIZE;
+  }
+  if (getenv(LOCK_ARRAY_INTERLEAVE) != NULL)
+    _tinystm.lock_array_interleave = 1;
+  if (_tinystm.lock_shift == 0) {
+    s = getenv(LOCK_SHIFT_EXTRA_ENV);
+    _tinystm.lock_shift = LOCK_SHIFT_WORD + (s != NULL ? (unsigned int)strtoul(s, NULL, 10) : LOCK_SHIFT_EXTRA);
+    if (_tinystm.lock_shift > LOCK_SHIFT_WORD + LOCK_SHIFT_EXTRA_MAX) {
+      fprintf(stderr, "Error: invalid lock shift (%u)\n", _tinystm.lock_shift - LOCK_SHIFT_WORD);
+      exit(1);
+    }
+  }
+  PRINT_DEBUG("\tLOCK_SHIFT_EXTRA=%u\n", _tinystm.lock_shift - LOCK_SHIFT_WORD);
+# ifdef AUTO_TUNE
+  /* The tuner also changes the size of the lock array */
+  s = getenv(TUNE_ENV);
+  if (s != NULL)
+    _tinystm.tune_period = (unsigned int)strtoul(s, NULL, 10);
+  PRINT_DEBUG("\tSTM_TUNE=%u\n", _tinystm.tune_period);
+# endif /* AUTO_TUNE */
+  /* Freshly mapped memory is zeroed */
+  lock_array_alloc();
+#else /* ! DYNAMIC_LOCK_ARRAY */
   /* Set locks and clock but should be already to 0 */
   memset((void *)_tinystm.locks, 0, LOCK_ARRAY_SIZE * sizeof(stm_word_t));
+#endif /* ! DYNAMIC_LOCK_ARRAY */
+#ifndef PROCESS_SHARED
+  /* The shared segment is zeroed by its creator */
   CLOCK = 0;
+#endif /* ! PROCESS_SHARED */
+#ifdef DURABLE_TX
+  /* Roll back transactions interrupted by a crash */
+  stm_durable_init();
+#endif /* DURABLE_TX */
 
   stm_quiesce_init();
 
@@ -286,7 +1196,41 @@ stm_init(void)
   }
 #endif /* SIGNAL_HANDLER */
   _tinystm.initialized = 1;
+
+#ifdef AUTO_TUNE
+  if (_tinystm.tune_period != 0) {
+    _tinystm.tune_stop = 0;
+    if (pthread_mutex_init(&_tinystm.tune_mutex, NULL) != 0 || pthread_cond_init(&_tinystm.tune_cond, NULL) != 0) {
+      fprintf(stderr, "Error initializing tuner\n");
+      exit(1);
+    }
+    if (pthread_create(&_tinystm.tune_thread, NULL, stm_tune_thread, NULL) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+#endif /* AUTO_TUNE */
+
+#ifdef HELPER_VALIDATION
+  stm_hv_init();
+#endif /* HELPER_VALIDATION */
+}
+
+#ifdef LOCK_REGIONS
+/*
+ * Block all transactions to modify the lock regions (return 0 if in a transaction).
+ */
+static int
+lock_regions_quiesce(stm_tx_t *tx)
+{
+  if (tx != NULL && IS_ACTIVE(tx->status)) {
+    fprintf(stderr, "Error: lock regions cannot be modified inside a transaction\n");
+    return 0;
+  }
+  stm_quiesce(tx, 1);
+  return 1;
 }
+#endif /* LOCK_REGIONS */
 
 /*
  * Called once (from main) to clean up STM infrastructure.
@@ -299,13 +1243,46 @@ stm_exit(void)
   if (!_tinystm.initialized)
     return;
 
+#ifdef AUTO_TUNE
+  if (_tinystm.tune_period != 0) {
+    pthread_mutex_lock(&_tinystm.tune_mutex);
+    _tinystm.tune_stop = 1;
+    pthread_cond_signal(&_tinystm.tune_cond);
+    pthread_mutex_unlock(&_tinystm.tune_mutex);
+    pthread_join(_tinystm.tune_thread, NULL);
+    pthread_cond_destroy(&_tinystm.tune_cond);
+    pthread_mutex_destroy(&_tinystm.tune_mutex);
+  }
+#endif /* AUTO_TUNE */
+
+#ifdef HELPER_VALIDATION
+  stm_hv_exit();
+#endif /* HELPER_VALIDATION */
+
+#ifdef DESCRIPTOR_POOL
+  stm_pool_exit();
+#endif /* DESCRIPTOR_POOL */
+
   tls_exit();
   stm_quiesce_exit();
 
+#ifdef LOCK_REGIONS
+  while (_tinystm.nb_regions > 0)
+    xfree((void *)_tinystm.regions[--_tinystm.nb_regions].locks);
+#endif /* LOCK_REGIONS */
+
 #ifdef EPOCH_GC
   gc_exit();
 #endif /* EPOCH_GC */
 
+#ifdef DURABLE_TX
+  stm_durable_exit();
+#endif /* DURABLE_TX */
+
+#ifdef DYNAMIC_LOCK_ARRAY
+  lock_array_free();
+#endif /* DYNAMIC_LOCK_ARRAY */
+
   _tinystm.initialized = 0;
 }
 
@@ -334,6 +1311,53 @@ stm_exit_thread_tx(stm_tx_t *tx)
   int_stm_exit_thread(tx);
 }
 
+/*
+ * Called by the CURRENT thread to hand over its descriptor to another thread.
+ */
+_CALLCONV stm_tx_t *
+stm_detach_thread(void)
+{
+  TX_GET;
+
+  PRINT_DEBUG("==> stm_detach_thread(%p)\n", tx);
+
+  if (tx == NULL)
+    return NULL;
+  /* Can only be called if non-active */
+  assert(!IS_ACTIVE(tx->status));
+
+#ifdef EPOCH_GC
+  /* No lower bound on GC while detached */
+  gc_exit_thread();
+#endif /* EPOCH_GC */
+  tls_set_tx(NULL);
+
+  return tx;
+}
+
+/*
+ * Called by the CURRENT thread to take over a detached descriptor.
+ */
+_CALLCONV int
+stm_attach_thread(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_attach_thread(%p)\n", tx);
+
+  /* Thread must not have a descriptor */
+  if (tls_get_tx() != NULL)
+    return 0;
+
+#ifdef EPOCH_GC
+  gc_init_thread();
+#endif /* EPOCH_GC */
+#ifdef CONFLICT_TRACKING
+  tx->thread_id = pthread_self();
+#endif /* CONFLICT_TRACKING */
+  tls_set_tx(tx);
+
+  return 1;
+}
+
 /*
  * Called by the CURRENT thread to start a transaction.
  */
@@ -341,14 +1365,53 @@ _CALLCONV sigjmp_buf *
 stm_start(stm_tx_attr_t attr)
 {
   TX_GET;
+#ifdef CTX_CKPT_MAGIC
+  sigjmp_buf *env = int_stm_start(tx, attr);
+  /* The application calls sigsetjmp() */
+  if (env != NULL)
+    CTX_CKPT_MARK(*env) = 0;
+  return env;
+#else /* ! CTX_CKPT_MAGIC */
   return int_stm_start(tx, attr);
+#endif /* ! CTX_CKPT_MAGIC */
 }
 
 _CALLCONV sigjmp_buf *
 stm_start_tx(stm_tx_t *tx, stm_tx_attr_t attr)
 {
+#ifdef CTX_CKPT_MAGIC
+  sigjmp_buf *env = int_stm_start(tx, attr);
+  if (env != NULL)
+    CTX_CKPT_MARK(*env) = 0;
+  return env;
+#else /* ! CTX_CKPT_MAGIC */
   return int_stm_start(tx, attr);
+#endif /* ! CTX_CKPT_MAGIC */
+}
+
+#ifdef CTX_CKPT_MAGIC
+/*
+ * Called by stm_start_ckpt() (arch.S) with the context of its caller.
+ */
+__attribute__((visibility("hidden"))) int
+stm_ckpt_begin(stm_tx_attr_t attr, const stm_word_t *ctx)
+{
+  TX_GET;
+  sigjmp_buf *env = int_stm_start(tx, attr);
+  if (env != NULL) {
+    memcpy(*env, ctx, CTX_CKPT_SIZE);
+    CTX_CKPT_MARK(*env) = CTX_CKPT_MAGIC;
+  }
+  return 0;
 }
+#else /* ! CTX_CKPT_MAGIC */
+_CALLCONV int
+stm_start_ckpt(stm_tx_attr_t attr)
+{
+  fprintf(stderr, "Lightweight checkpoints are not enabled\n");
+  exit(-1);
+}
+#endif /* ! CTX_CKPT_MAGIC */
 
 /*
  * Called by the CURRENT thread to commit a transaction.
@@ -382,6 +1445,96 @@ stm_abort_tx(stm_tx_t *tx, int reason)
   stm_rollback(tx, reason | STM_ABORT_EXPLICIT);
 }
 
+/*
+ * Called by the CURRENT thread to block until some location read changes.
+ */
+_CALLCONV void
+stm_retry(void)
+{
+  TX_GET;
+  int_stm_retry(tx);
+}
+
+_CALLCONV void
+stm_retry_tx(stm_tx_t *tx)
+{
+  int_stm_retry(tx);
+}
+
+/*
+ * Called by the CURRENT thread to record a savepoint.
+ */
+_CALLCONV sigjmp_buf *
+stm_savepoint(void)
+{
+  TX_GET;
+  return int_stm_savepoint(tx);
+}
+
+_CALLCONV sigjmp_buf *
+stm_savepoint_tx(stm_tx_t *tx)
+{
+  return int_stm_savepoint(tx);
+}
+
+/*
+ * Called by the CURRENT thread to roll back to a savepoint.
+ */
+_CALLCONV void
+stm_rollback_to(sigjmp_buf *savepoint)
+{
+  TX_GET;
+  int_stm_rollback_to(tx, savepoint);
+}
+
+_CALLCONV void
+stm_rollback_to_tx(stm_tx_t *tx, sigjmp_buf *savepoint)
+{
+  int_stm_rollback_to(tx, savepoint);
+}
+
+/*
+ * Called by the CURRENT thread to validate a transaction.
+ */
+_CALLCONV void
+stm_validate(void)
+{
+  TX_GET;
+  int_stm_validate(tx);
+}
+
+_CALLCONV void
+stm_validate_tx(stm_tx_t *tx)
+{
+  int_stm_validate(tx);
+}
+
+/*
+ * Called by the CURRENT thread to remove a location from its read set.
+ */
+_CALLCONV void
+stm_release(volatile stm_word_t *addr)
+{
+#ifdef ELASTIC_TX
+  TX_GET;
+  int_stm_release(tx, addr);
+#else /* ! ELASTIC_TX */
+  fprintf(stderr, "Early release is not enabled\n");
+  exit(-1);
+#endif /* ! ELASTIC_TX */
+}
+
+_CALLCONV void
+stm_release_tx(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+#ifdef ELASTIC_TX
+  int_stm_release(tx, addr);
+#else /* ! ELASTIC_TX */
+  fprintf(stderr, "Early release is not enabled\n");
+  exit(-1);
+#endif /* ! ELASTIC_TX */
+}
+
 /*
  * Called by the CURRENT thread to load a word-sized value.
  */
@@ -430,6 +1583,118 @@ stm_store2_tx(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_wor
   int_stm_store2(tx, addr, value, mask);
 }
 
+/*
+ * Called by the CURRENT thread to load consecutive words.
+ */
+_CALLCONV void
+stm_load_range(volatile stm_word_t *addr, stm_word_t *buf, size_t nb)
+{
+  TX_GET;
+  int_stm_load_range(tx, addr, buf, nb);
+}
+
+_CALLCONV void
+stm_load_range_tx(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t *buf, size_t nb)
+{
+  int_stm_load_range(tx, addr, buf, nb);
+}
+
+/*
+ * Called by the CURRENT thread to load words at independent addresses.
+ */
+_CALLCONV void
+stm_load_n(volatile stm_word_t **addrs, stm_word_t *buf, size_t nb)
+{
+  TX_GET;
+  int_stm_load_n(tx, addrs, buf, nb);
+}
+
+_CALLCONV void
+stm_load_n_tx(stm_tx_t *tx, volatile stm_word_t **addrs, stm_word_t *buf, size_t nb)
+{
+  int_stm_load_n(tx, addrs, buf, nb);
+}
+
+/*
+ * Called by the CURRENT thread to announce an upcoming load.
+ */
+_CALLCONV void
+stm_prefetch(const volatile void *addr)
+{
+  TX_GET;
+  int_stm_prefetch(tx, addr);
+}
+
+_CALLCONV void
+stm_prefetch_tx(stm_tx_t *tx, const volatile void *addr)
+{
+  int_stm_prefetch(tx, addr);
+}
+
+/*
+ * Called by the CURRENT thread to store consecutive words.
+ */
+_CALLCONV void
+stm_store_range(volatile stm_word_t *addr, const stm_word_t *buf, size_t nb)
+{
+  TX_GET;
+  int_stm_store_range(tx, addr, buf, nb);
+}
+
+_CALLCONV void
+stm_store_range_tx(stm_tx_t *tx, volatile stm_word_t *addr, const stm_word_t *buf, size_t nb)
+{
+  int_stm_store_range(tx, addr, buf, nb);
+}
+
+/*
+ * Called by the CURRENT thread to load a field of an object.
+ */
+_CALLCONV stm_word_t
+stm_load_obj(void *obj, volatile stm_word_t *addr)
+{
+  TX_GET;
+  return int_stm_load_obj(tx, obj, addr);
+}
+
+_CALLCONV stm_word_t
+stm_load_obj_tx(stm_tx_t *tx, void *obj, volatile stm_word_t *addr)
+{
+  return int_stm_load_obj(tx, obj, addr);
+}
+
+/*
+ * Called by the CURRENT thread to store a field of an object.
+ */
+_CALLCONV void
+stm_store_obj(void *obj, volatile stm_word_t *addr, stm_word_t value)
+{
+  TX_GET;
+  int_stm_store2_obj(tx, obj, addr, value, ~(stm_word_t)0);
+}
+
+_CALLCONV void
+stm_store_obj_tx(stm_tx_t *tx, void *obj, volatile stm_word_t *addr, stm_word_t value)
+{
+  int_stm_store2_obj(tx, obj, addr, value, ~(stm_word_t)0);
+}
+
+/*
+ * Called by the CURRENT thread to store part of a field of an object.
+ */
+_CALLCONV void
+stm_store2_obj(void *obj, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  TX_GET;
+  int_stm_store2_obj(tx, obj, addr, value, mask);
+}
+
+_CALLCONV void
+stm_store2_obj_tx(stm_tx_t *tx, void *obj, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  int_stm_store2_obj(tx, obj, addr, value, mask);
+}
+
 /*
  * Called by the CURRENT thread to inquire about the status of a transaction.
  */
@@ -518,7 +1783,7 @@ stm_get_attributes(void)
 {
   TX_GET;
   assert (tx != NULL);
-  return tx->attr;
+  return stm_get_attributes_tx(tx);
 }
 
 /*
@@ -527,8 +1792,32 @@ stm_get_attributes(void)
 _CALLCONV stm_tx_attr_t
 stm_get_attributes_tx(struct stm_tx *tx)
 {
+  stm_tx_attr_t attr;
+
   assert (tx != NULL);
-  return tx->attr;
+  attr = tx->attr;
+#ifdef ADAPTIVE_READ_ONLY
+  /* Learned read-only mode is not an attribute of the caller */
+  if (tx->ro_learned)
+    attr.read_only = 0;
+#endif /* ADAPTIVE_READ_ONLY */
+  return attr;
+}
+
+/*
+ * Get information about the current attempt of a transaction.
+ */
+_CALLCONV void
+stm_get_tx_info(stm_tx_info_t *info)
+{
+  TX_GET;
+  int_stm_get_tx_info(tx, info);
+}
+
+_CALLCONV void
+stm_get_tx_info_tx(stm_tx_t *tx, stm_tx_info_t *info)
+{
+  int_stm_get_tx_info(tx, info);
 }
 
 /*
@@ -553,40 +1842,179 @@ stm_get_stats_tx(stm_tx_t *tx, const char *name, void *val)
 _CALLCONV int
 stm_get_parameter(const char *name, void *val)
 {
+  cb_chain_t *c;
+  unsigned int i;
+
   if (strcmp("contention_manager", name) == 0) {
     *(const char **)val = cm_names[CM];
     return 1;
   }
-  if (strcmp("design", name) == 0) {
-    *(const char **)val = design_names[DESIGN];
+  if (strcmp("design", name) == 0) {
+#if DESIGN == MODULAR
+    /* Design of transactions that do not select one */
+    *(const char **)val = design_names[_tinystm.design != NULL ? _tinystm.design->id : WRITE_BACK_ETL];
+#else /* DESIGN != MODULAR */
+    *(const char **)val = design_names[DESIGN];
+#endif /* DESIGN != MODULAR */
+    return 1;
+  }
+  if (strcmp("clock", name) == 0) {
+    *(const char **)val = clock_names[CLOCK_MODE];
+    return 1;
+  }
+  if (strcmp("initial_rw_set_size", name) == 0) {
+    *(int *)val = RW_SET_SIZE;
+    return 1;
+  }
+  if (strcmp("stripe_size", name) == 0) {
+    *(unsigned long *)val = 1UL << LOCK_SHIFT;
+    return 1;
+  }
+#if CM == CM_BACKOFF
+  if (strcmp("min_backoff", name) == 0) {
+    *(unsigned long *)val = MIN_BACKOFF;
+    return 1;
+  }
+  if (strcmp("max_backoff", name) == 0) {
+    *(unsigned long *)val = MAX_BACKOFF;
+    return 1;
+  }
+#endif /* CM == CM_BACKOFF */
+#if CM == CM_MODULAR
+  if (strcmp("vr_threshold", name) == 0) {
+    *(int *)val = _tinystm.vr_threshold;
+    return 1;
+  }
+#endif /* CM == CM_MODULAR */
+#ifdef DYNAMIC_LOCK_ARRAY
+  if (strcmp("lock_array_log_size", name) == 0) {
+    *(unsigned int *)val = _tinystm.lock_array_log_size;
+    return 1;
+  }
+  if (strcmp("lock_array_interleave", name) == 0) {
+    *(int *)val = _tinystm.lock_array_interleave;
+    return 1;
+  }
+  if (strcmp("lock_array_huge_pages", name) == 0) {
+    *(int *)val = _tinystm.lock_array_huge_pages;
+    return 1;
+  }
+  if (strcmp("lock_shift_extra", name) == 0) {
+    *(unsigned int *)val = _tinystm.lock_shift - LOCK_SHIFT_WORD;
+    return 1;
+  }
+#endif /* DYNAMIC_LOCK_ARRAY */
+#ifdef AUTO_TUNE
+  if (strcmp("tune_period", name) == 0) {
+    *(unsigned int *)val = _tinystm.tune_period;
     return 1;
   }
-  if (strcmp("initial_rw_set_size", name) == 0) {
-    *(int *)val = RW_SET_SIZE;
+#endif /* AUTO_TUNE */
+#ifdef CTX_CKPT_MAGIC
+  if (strcmp("checkpoint", name) == 0) {
+    *(int *)val = 1;
     return 1;
   }
-#if CM == CM_BACKOFF
-  if (strcmp("min_backoff", name) == 0) {
-    *(unsigned long *)val = MIN_BACKOFF;
+#endif /* CTX_CKPT_MAGIC */
+#ifdef SIMD_VALIDATION
+  if (strcmp("simd", name) == 0) {
+    *(const char **)val = simd_names[_tinystm.simd];
     return 1;
   }
-  if (strcmp("max_backoff", name) == 0) {
-    *(unsigned long *)val = MAX_BACKOFF;
+#endif /* SIMD_VALIDATION */
+#ifdef DURABLE_TX
+  if (strcmp("durable_flush", name) == 0) {
+    *(const char **)val = (_tinystm.durable == NULL ? NULL : durable_flush_names[_tinystm.durable_flush]);
     return 1;
   }
-#endif /* CM == CM_BACKOFF */
-#if CM == CM_MODULAR
-  if (strcmp("vr_threshold", name) == 0) {
-    *(int *)val = _tinystm.vr_threshold;
+  if (strcmp("durable_recovered", name) == 0) {
+    *(unsigned long *)val = _tinystm.durable_recovered;
     return 1;
   }
-#endif /* CM == CM_MODULAR */
+#endif /* DURABLE_TX */
+#ifdef ADAPTIVE_SCHEDULING
+  if (strcmp("ats_threshold", name) == 0) {
+    *(int *)val = _tinystm.ats_threshold;
+    return 1;
+  }
+#endif /* ADAPTIVE_SCHEDULING */
+#ifdef HYBRID_HTM
+  if (strcmp("htm_enabled", name) == 0) {
+    *(int *)val = _tinystm.htm_enabled;
+    return 1;
+  }
+  if (strcmp("htm_retries", name) == 0) {
+    *(int *)val = _tinystm.htm_retries;
+    return 1;
+  }
+#endif /* HYBRID_HTM */
+#ifdef ELASTIC_TX
+  if (strcmp("elastic_window", name) == 0) {
+    *(unsigned int *)val = _tinystm.elastic_window;
+    return 1;
+  }
+#endif /* ELASTIC_TX */
+#ifdef TM_STATISTICS2
+  if (strcmp("stats_sampling", name) == 0) {
+    *(unsigned int *)val = _tinystm.prof_period;
+    return 1;
+  }
+#endif /* TM_STATISTICS2 */
+#ifdef IRREVOCABLE_FALLBACK
+  if (strcmp("irrevocable_retries", name) == 0) {
+    *(unsigned int *)val = _tinystm.fallback_default.retries;
+    return 1;
+  }
+  if (strcmp("irrevocable_cycles", name) == 0) {
+    *(unsigned long *)val = _tinystm.fallback_default.cycles;
+    return 1;
+  }
+  if (strcmp("irrevocable_serial", name) == 0) {
+    *(int *)val = _tinystm.fallback_default.serial;
+    return 1;
+  }
+#endif /* IRREVOCABLE_FALLBACK */
+#ifdef HELPER_VALIDATION
+  if (strcmp("helper_threshold", name) == 0) {
+    *(unsigned int *)val = _tinystm.hv_threshold;
+    return 1;
+  }
+#endif /* HELPER_VALIDATION */
+#ifdef EPOCH_GC
+  if (strcmp("gc_backlog_thread", name) == 0) {
+    gc_word_t thread, global;
+    gc_get_backlog(&thread, &global);
+    *(unsigned long *)val = (unsigned long)thread;
+    return 1;
+  }
+  if (strcmp("gc_backlog_global", name) == 0) {
+    gc_word_t thread, global;
+    gc_get_backlog(&thread, &global);
+    *(unsigned long *)val = (unsigned long)global;
+    return 1;
+  }
+  if (strcmp("gc_backlog", name) == 0) {
+    *(unsigned long *)val = (unsigned long)gc_backlog_depth(1);
+    return 1;
+  }
+  if (strcmp("gc_nb_pressure", name) == 0) {
+    *(unsigned long *)val = (unsigned long)gc_nb_pressure();
+    return 1;
+  }
+#endif /* EPOCH_GC */
 #ifdef COMPILE_FLAGS
   if (strcmp("compile_flags", name) == 0) {
     *(const char **)val = XSTR(COMPILE_FLAGS);
     return 1;
   }
 #endif /* COMPILE_FLAGS */
+  /* Parameters of external modules */
+  if ((c = (cb_chain_t *)ATOMIC_LOAD_ACQ(&_tinystm.param_cb)) != NULL) {
+    for (i = 0; i < c->nb; i++) {
+      if (c->e.param[i].f(name, val, c->e.param[i].arg))
+        return 1;
+    }
+  }
   return 0;
 }
 
@@ -598,7 +2026,19 @@ stm_set_parameter(const char *name, void *val)
 {
 #if CM == CM_MODULAR
   int i;
+#endif /* CM == CM_MODULAR */
+#if DESIGN == MODULAR
+  const stm_design_t *d;
 
+  /* Transactions already started keep their design */
+  if (strcmp("design", name) == 0) {
+    if ((d = stm_design_lookup((const char *)val)) == NULL)
+      return 0;
+    _tinystm.design = d;
+    return 1;
+  }
+#endif /* DESIGN == MODULAR */
+#if CM == CM_MODULAR
   if (strcmp("cm_policy", name) == 0) {
     for (i = 0; cms[i].name != NULL; i++) {
       if (strcasecmp(cms[i].name, (const char *)val) == 0) {
@@ -617,20 +2057,111 @@ stm_set_parameter(const char *name, void *val)
     return 1;
   }
 #endif /* CM == CM_MODULAR */
+#ifdef ADAPTIVE_SCHEDULING
+  if (strcmp("ats_threshold", name) == 0) {
+    stm_ats_set_threshold(*(int *)val);
+    return 1;
+  }
+#endif /* ADAPTIVE_SCHEDULING */
+#ifdef HYBRID_HTM
+  if (strcmp("htm_retries", name) == 0) {
+    _tinystm.htm_retries = *(int *)val;
+    return 1;
+  }
+#endif /* HYBRID_HTM */
+#ifdef ELASTIC_TX
+  if (strcmp("elastic_window", name) == 0) {
+    if (*(unsigned int *)val == 0)
+      return 0;
+    _tinystm.elastic_window = *(unsigned int *)val;
+    return 1;
+  }
+#endif /* ELASTIC_TX */
+#ifdef TM_STATISTICS2
+  if (strcmp("stats_sampling", name) == 0) {
+    _tinystm.prof_period = *(unsigned int *)val;
+    return 1;
+  }
+#endif /* TM_STATISTICS2 */
+#ifdef IRREVOCABLE_FALLBACK
+  if (strcmp("irrevocable_retries", name) == 0) {
+    _tinystm.fallback_default.retries = *(unsigned int *)val;
+    return 1;
+  }
+  if (strcmp("irrevocable_cycles", name) == 0) {
+    _tinystm.fallback_default.cycles = *(unsigned long *)val;
+    return 1;
+  }
+  if (strcmp("irrevocable_serial", name) == 0) {
+    _tinystm.fallback_default.serial = *(int *)val;
+    return 1;
+  }
+#endif /* IRREVOCABLE_FALLBACK */
+#ifdef HELPER_VALIDATION
+  if (strcmp("helper_threshold", name) == 0) {
+    _tinystm.hv_threshold = *(unsigned int *)val;
+    return 1;
+  }
+#endif /* HELPER_VALIDATION */
+#ifdef EPOCH_GC
+  /* GC backlog limits can be set before initialization */
+  if (strcmp("gc_backlog_thread", name) == 0) {
+    gc_word_t thread, global;
+    gc_get_backlog(&thread, &global);
+    gc_set_backlog(*(unsigned long *)val, global);
+    return 1;
+  }
+  if (strcmp("gc_backlog_global", name) == 0) {
+    gc_word_t thread, global;
+    gc_get_backlog(&thread, &global);
+    gc_set_backlog(thread, *(unsigned long *)val);
+    return 1;
+  }
+#endif /* EPOCH_GC */
+#ifdef DYNAMIC_LOCK_ARRAY
+# ifdef AUTO_TUNE
+  /* The tuner owns the lock array settings */
+  if (_tinystm.initialized && _tinystm.tune_period != 0 && strncmp("lock_", name, 5) == 0)
+    return 0;
+# endif /* AUTO_TUNE */
+  /* Lock array can only be changed while no thread is initialized */
+  if (strcmp("lock_shift_extra", name) == 0) {
+    if (_tinystm.threads_nb != 0 || *(unsigned int *)val > LOCK_SHIFT_EXTRA_MAX)
+      return 0;
+    _tinystm.lock_shift = LOCK_SHIFT_WORD + *(unsigned int *)val;
+    return 1;
+  }
+  if (strcmp("lock_array_log_size", name) == 0) {
+    if (_tinystm.threads_nb != 0 || !lock_array_valid(*(unsigned int *)val))
+      return 0;
+    if (_tinystm.initialized)
+      lock_array_free();
+    _tinystm.lock_array_log_size = *(unsigned int *)val;
+    if (_tinystm.initialized)
+      lock_array_alloc();
+    return 1;
+  }
+  if (strcmp("lock_array_interleave", name) == 0) {
+    if (_tinystm.threads_nb != 0)
+      return 0;
+    if (_tinystm.initialized)
+      lock_array_free();
+    _tinystm.lock_array_interleave = *(int *)val;
+    if (_tinystm.initialized)
+      lock_array_alloc();
+    return 1;
+  }
+#endif /* DYNAMIC_LOCK_ARRAY */
   return 0;
 }
 
 /*
- * Create transaction-specific data (return -1 on error).
+ * Create transaction-specific data.
  */
 _CALLCONV int
 stm_create_specific(void)
 {
-  if (_tinystm.nb_specific >= MAX_SPECIFIC) {
-    fprintf(stderr, "Error: maximum number of specific slots reached\n");
-    return -1;
-  }
-  return _tinystm.nb_specific++;
+  return (int)ATOMIC_FETCH_INC_FULL(&_tinystm.nb_specific);
 }
 
 /*
@@ -673,7 +2204,45 @@ stm_get_specific_tx(stm_tx_t *tx, int key)
 }
 
 /*
- * Register callbacks for an external module (must be called before creating transactions).
+ * Append a callback to the chain of a phase.
+ */
+static void
+stm_cb_append(cb_chain_t *volatile *chain, const void *entry, size_t size)
+{
+  cb_chain_t *old, *c;
+  unsigned int nb;
+
+  for (;;) {
+    old = (cb_chain_t *)ATOMIC_LOAD_ACQ(chain);
+    nb = (old == NULL ? 0 : old->nb);
+    c = (cb_chain_t *)xmalloc(sizeof(cb_chain_t) + nb * size);
+    if (old != NULL)
+      memcpy(&c->e, &old->e, nb * size);
+    memcpy((char *)&c->e + nb * size, entry, size);
+    c->nb = nb + 1;
+    c->prev = old;
+    /* Concurrent registrations retry with the chain of the winner */
+    if (ATOMIC_CAS_FULL(chain, old, c))
+      return;
+    xfree(c);
+  }
+}
+
+static void
+stm_cb_add(cb_chain_t *volatile *chain, void (*f)(void *), void *arg, stm_word_t module)
+{
+  cb_entry_t cb;
+
+  if (f == NULL)
+    return;
+  cb.f = f;
+  cb.arg = arg;
+  cb.module = module;
+  stm_cb_append(chain, &cb, sizeof(cb));
+}
+
+/*
+ * Register callbacks for an external module (can be called while transactions run).
  */
 _CALLCONV int
 stm_register(void (*on_thread_init)(void *arg),
@@ -684,49 +2253,108 @@ stm_register(void (*on_thread_init)(void *arg),
              void (*on_abort)(void *arg),
              void *arg)
 {
-  if ((on_thread_init != NULL && _tinystm.nb_init_cb >= MAX_CB) ||
-      (on_thread_exit != NULL && _tinystm.nb_exit_cb >= MAX_CB) ||
-      (on_start != NULL && _tinystm.nb_start_cb >= MAX_CB) ||
-      (on_precommit != NULL && _tinystm.nb_precommit_cb >= MAX_CB) ||
-      (on_commit != NULL && _tinystm.nb_commit_cb >= MAX_CB) ||
-      (on_abort != NULL && _tinystm.nb_abort_cb >= MAX_CB)) {
-    fprintf(stderr, "Error: maximum number of modules reached\n");
-    return 0;
-  }
-  /* New callback */
-  if (on_thread_init != NULL) {
-    _tinystm.init_cb[_tinystm.nb_init_cb].f = on_thread_init;
-    _tinystm.init_cb[_tinystm.nb_init_cb++].arg = arg;
-  }
-  /* Delete callback */
-  if (on_thread_exit != NULL) {
-    _tinystm.exit_cb[_tinystm.nb_exit_cb].f = on_thread_exit;
-    _tinystm.exit_cb[_tinystm.nb_exit_cb++].arg = arg;
-  }
-  /* Start callback */
-  if (on_start != NULL) {
-    _tinystm.start_cb[_tinystm.nb_start_cb].f = on_start;
-    _tinystm.start_cb[_tinystm.nb_start_cb++].arg = arg;
-  }
-  /* Pre-commit callback */
-  if (on_precommit != NULL) {
-    _tinystm.precommit_cb[_tinystm.nb_precommit_cb].f = on_precommit;
-    _tinystm.precommit_cb[_tinystm.nb_precommit_cb++].arg = arg;
-  }
-  /* Commit callback */
-  if (on_commit != NULL) {
-    _tinystm.commit_cb[_tinystm.nb_commit_cb].f = on_commit;
-    _tinystm.commit_cb[_tinystm.nb_commit_cb++].arg = arg;
-  }
-  /* Abort callback */
-  if (on_abort != NULL) {
-    _tinystm.abort_cb[_tinystm.nb_abort_cb].f = on_abort;
-    _tinystm.abort_cb[_tinystm.nb_abort_cb++].arg = arg;
-  }
+  stm_word_t module, bit;
+
+  module = ATOMIC_FETCH_INC_FULL(&_tinystm.nb_modules) + 1;
+  /* Modules beyond the bits of a word cannot be disabled */
+  bit = (module <= sizeof(stm_word_t) * 8 ? (stm_word_t)1 << (module - 1) : 0);
+  stm_cb_add(&_tinystm.init_cb, on_thread_init, arg, bit);
+  stm_cb_add(&_tinystm.exit_cb, on_thread_exit, arg, bit);
+  stm_cb_add(&_tinystm.start_cb, on_start, arg, bit);
+  stm_cb_add(&_tinystm.precommit_cb, on_precommit, arg, bit);
+  stm_cb_add(&_tinystm.commit_cb, on_commit, arg, bit);
+  stm_cb_add(&_tinystm.abort_cb, on_abort, arg, bit);
+
+  return (int)module;
+}
+
+/*
+ * Register callbacks for closed nested transactions (can be called while transactions run).
+ */
+_CALLCONV int
+stm_register_nested(void (*on_start)(void *arg),
+                    void (*on_commit)(void *arg),
+                    void (*on_abort)(void *arg),
+                    void *arg)
+{
+#ifdef CLOSED_NESTING
+  stm_cb_add(&_tinystm.nested_start_cb, on_start, arg, 0);
+  stm_cb_add(&_tinystm.nested_commit_cb, on_commit, arg, 0);
+  stm_cb_add(&_tinystm.nested_abort_cb, on_abort, arg, 0);
+
+  return 1;
+#else /* ! CLOSED_NESTING */
+  fprintf(stderr, "Closed nesting is not enabled\n");
+  exit(-1);
+  return 0;
+#endif /* ! CLOSED_NESTING */
+}
+
+/*
+ * Register parameter callback for an external module.
+ */
+_CALLCONV int
+stm_register_parameter(int (*get)(const char *name, void *val, void *arg), void *arg)
+{
+  param_cb_entry_t cb;
+
+  cb.f = get;
+  cb.arg = arg;
+  stm_cb_append(&_tinystm.param_cb, &cb, sizeof(cb));
+
+  return 1;
+}
+
+/*
+ * Register event callback for an external module.
+ */
+_CALLCONV int
+stm_register_event(void (*on_event)(int event, void *arg), void *arg)
+{
+  event_cb_entry_t cb;
+
+  cb.f = on_event;
+  cb.arg = arg;
+  stm_cb_append(&_tinystm.event_cb, &cb, sizeof(cb));
 
   return 1;
 }
 
+/*
+ * Enable or disable the callbacks of a module for the current thread.
+ */
+_CALLCONV int
+stm_enable_module(int module, int enabled)
+{
+  TX_GET;
+  return int_stm_enable_module(tx, module, enabled);
+}
+
+/*
+ * Enable or disable the callbacks of a module for a specific thread.
+ */
+_CALLCONV int
+stm_enable_module_tx(stm_tx_t *tx, int module, int enabled)
+{
+  return int_stm_enable_module(tx, module, enabled);
+}
+
+/*
+ * Wait for transactions that might still access privatized data.
+ */
+_CALLCONV void
+stm_privatize_fence(void)
+{
+#ifdef PRIVATIZATION_FENCE
+  /* Transactions would wait for themselves */
+  assert(tls_get_tx() == NULL || !IS_ACTIVE(tls_get_tx()->status));
+  stm_fence_wait();
+#else /* ! PRIVATIZATION_FENCE */
+  fprintf(stderr, "Privatization fences are not enabled\n");
+  exit(-1);
+#endif /* ! PRIVATIZATION_FENCE */
+}
+
 /*
  * Called by the CURRENT thread to load a word-sized value in a unit transaction.
  */
@@ -807,9 +2435,12 @@ stm_unit_write(volatile stm_word_t *addr, stm_word_t value, stm_word_t mask, stm
   /* TODO: would need to store thread ID to be able to kill it (for wait freedom) */
   if (ATOMIC_CAS_FULL(lock, l, LOCK_UNIT) == 0)
     goto restart;
-  ATOMIC_STORE(addr, value);
   /* Update timestamp with newer value (may exceed VERSION_MAX by up to MAX_THREADS) */
   l = FETCH_INC_CLOCK + 1;
+#ifdef MULTI_VERSION
+  stm_mv_save(addr, ATOMIC_LOAD(addr), lock, l);
+#endif /* MULTI_VERSION */
+  ATOMIC_STORE(addr, value);
   if (timestamp != NULL)
     *timestamp = l;
   /* Make sure that lock release becomes visible */
@@ -844,6 +2475,138 @@ stm_unit_store2(volatile stm_word_t *addr, stm_word_t value, stm_word_t mask, st
   return stm_unit_write(addr, value, mask, timestamp);
 }
 
+#ifdef UNIT_TX
+/*
+ * Compare and swap several word-sized values (locks and versions must
+ * have room for n entries).
+ */
+static int
+unit_cas(size_t n, volatile stm_word_t **addrs, const stm_word_t *expected, const stm_word_t *desired, stm_word_t *timestamp,
+         volatile stm_word_t **locks, stm_word_t *versions)
+{
+  volatile stm_word_t *lock;
+  stm_word_t l, max;
+  size_t i, j, nb;
+  int ok;
+
+  /* Sort locks by address (without duplicates) to avoid deadlocks between unit CASes */
+  nb = 0;
+  for (i = 0; i < n; i++) {
+    lock = GET_LOCK(addrs[i]);
+    for (j = nb; j > 0 && locks[j - 1] > lock; j--)
+      ;
+    if (j > 0 && locks[j - 1] == lock)
+      continue;
+    memmove(&locks[j + 1], &locks[j], (nb - j) * sizeof(locks[0]));
+    locks[j] = lock;
+    nb++;
+  }
+
+  /* Acquire locks in order */
+ restart:
+  max = 0;
+  for (i = 0; i < nb; i++) {
+   restart_lock:
+    l = ATOMIC_LOAD_ACQ(locks[i]);
+    if (LOCK_GET_OWNED(l)) {
+      /* Locked: wait until lock is free, without holding other locks
+       * (transactions spin on our locks while possibly owning this one) */
+      for (j = i; j > 0; j--)
+        ATOMIC_STORE_REL(locks[j - 1], versions[j - 1]);
+      while (LOCK_GET_OWNED(ATOMIC_LOAD_ACQ(locks[i]))) {
+#ifdef WAIT_YIELD
+        sched_yield();
+#endif /* WAIT_YIELD */
+      }
+      if (i > 0)
+        goto restart;
+      goto restart_lock;
+    }
+    if (timestamp != NULL && LOCK_GET_TIMESTAMP(l) > *timestamp) {
+      /* Newer version: release locks and return current timestamp */
+      for (j = i; j > 0; j--)
+        ATOMIC_STORE_REL(locks[j - 1], versions[j - 1]);
+      *timestamp = LOCK_GET_TIMESTAMP(l);
+      return 0;
+    }
+    if (ATOMIC_CAS_FULL(locks[i], l, LOCK_UNIT) == 0)
+      goto restart_lock;
+    versions[i] = l;
+    if (LOCK_GET_TIMESTAMP(l) > max)
+      max = LOCK_GET_TIMESTAMP(l);
+  }
+
+  /* Compare values */
+  ok = 1;
+  for (i = 0; i < n; i++) {
+    if (ATOMIC_LOAD(addrs[i]) != expected[i]) {
+      ok = 0;
+      break;
+    }
+  }
+  if (!ok) {
+    /* Nothing has been written: restore versions */
+    for (i = nb; i > 0; i--)
+      ATOMIC_STORE_REL(locks[i - 1], versions[i - 1]);
+    if (timestamp != NULL)
+      *timestamp = max;
+    return 0;
+  }
+
+  /* Update timestamp with newer value (may exceed VERSION_MAX by up to MAX_THREADS) */
+  l = FETCH_INC_CLOCK + 1;
+  for (i = 0; i < n; i++) {
+#ifdef MULTI_VERSION
+    stm_mv_save(addrs[i], ATOMIC_LOAD(addrs[i]), GET_LOCK(addrs[i]), l);
+#endif /* MULTI_VERSION */
+    ATOMIC_STORE(addrs[i], desired[i]);
+  }
+  if (timestamp != NULL)
+    *timestamp = l;
+  /* Make sure that lock releases become visible */
+  for (i = 0; i < nb; i++)
+    ATOMIC_STORE_REL(locks[i], LOCK_SET_TIMESTAMP(l));
+  if (unlikely(l >= VERSION_MAX)) {
+    /* Block all transactions and reset clock (current thread is not in active transaction) */
+    stm_quiesce_barrier(NULL, rollover_clock, NULL);
+  }
+  return 1;
+}
+#endif /* UNIT_TX */
+
+/*
+ * Called by the CURRENT thread to atomically compare and swap several
+ * word-sized values in a unit transaction.
+ */
+_CALLCONV int
+stm_unit_cas(size_t n, volatile stm_word_t **addrs, const stm_word_t *expected, const stm_word_t *desired, stm_word_t *timestamp)
+{
+#ifdef UNIT_TX
+  volatile stm_word_t *locks[STM_UNIT_CAS_MAX];
+  stm_word_t versions[STM_UNIT_CAS_MAX];
+  volatile stm_word_t **heap_locks;
+  stm_word_t *heap_versions;
+  int ret;
+
+  PRINT_DEBUG2("==> stm_unit_cas(n=%lu)\n", (unsigned long)n);
+
+  if (likely(n <= STM_UNIT_CAS_MAX))
+    return unit_cas(n, addrs, expected, desired, timestamp, locks, versions);
+
+  /* Too many locations for the stack */
+  heap_locks = (volatile stm_word_t **)xmalloc(n * sizeof(*heap_locks));
+  heap_versions = (stm_word_t *)xmalloc(n * sizeof(*heap_versions));
+  ret = unit_cas(n, addrs, expected, desired, timestamp, heap_locks, heap_versions);
+  xfree(heap_versions);
+  xfree(heap_locks);
+  return ret;
+#else /* ! UNIT_TX */
+  fprintf(stderr, "Unit transaction is not enabled\n");
+  exit(-1);
+  return 1;
+#endif /* ! UNIT_TX */
+}
+
 /*
  * Enable or disable extensions and set upper bound on snapshot.
  */
@@ -928,6 +2691,19 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
   stm_word_t t;
 # endif /* CM == CM_MODULAR */
 
+# ifdef HYBRID_HTM
+  /* Irrevocability requires the software path */
+  if (tx->htm)
+    stm_htm_rollback(tx);
+# endif /* HYBRID_HTM */
+
+# ifdef PROCESS_SHARED
+  /* Threads of other processes cannot be stopped (not even by fallbacks) */
+  if (serial > 0)
+    serial = 0;
+  tx->irrevocable &= 0x07;
+# endif /* PROCESS_SHARED */
+
   if (!IS_ACTIVE(tx->status) && serial != -1) {
     /* Request irrevocability outside of a transaction or in abort handler (for next execution) */
     tx->irrevocable = 1 + (serial ? 0x08 : 0);
@@ -939,17 +2715,27 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
     return 1;
   }
 
+# ifdef ADAPTIVE_READ_ONLY
+  if (stm_ro_irrevocable(tx))
+    return 0;
+# endif /* ADAPTIVE_READ_ONLY */
+
   if (tx->irrevocable == 0) {
     /* Acquire irrevocability for the first time */
     tx->irrevocable = 1 + (serial ? 0x08 : 0);
     /* Try acquiring global lock */
-    if (_tinystm.irrevocable == 1 || ATOMIC_CAS_FULL(&_tinystm.irrevocable, 0, 1) == 0) {
+    if (IRREVOCABLE_FLAG != 0 || ATOMIC_CAS_FULL(&IRREVOCABLE_FLAG, 0, 1) == 0) {
       /* Transaction will acquire irrevocability after rollback */
       stm_rollback(tx, STM_ABORT_IRREVOCABLE);
       return 0;
     }
     /* Success: remember we have the lock */
     tx->irrevocable++;
+# ifdef IRREVOCABLE_IMPROVED
+    /* Stop other update transactions before validation if reads cannot be locked */
+    if (serial || tx->r_set.nb_entries > tx->w_set.size - tx->w_set.nb_entries)
+      stm_irrevocable_block(tx);
+# endif /* IRREVOCABLE_IMPROVED */
     /* Try validating transaction */
 #if DESIGN == WRITE_BACK_ETL
     if (!stm_wbetl_validate(tx)) {
@@ -967,13 +2753,34 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
       return 0;
     }
 #elif DESIGN == MODULAR
-    if ((tx->attr.id == WRITE_BACK_CTL && stm_wbctl_validate(tx))
-       || (tx->attr.id == WRITE_THROUGH && stm_wt_validate(tx))
-       || (tx->attr.id != WRITE_BACK_CTL && tx->attr.id != WRITE_THROUGH && stm_wbetl_validate(tx))) {
+    if (!tx->design->validate(tx)) {
       stm_rollback(tx, STM_ABORT_VALIDATE);
       return 0;
     }
-#endif /* DESIGN == MODULAR */
+#elif DESIGN == NOREC
+    if (!stm_norec_validate(tx)) {
+      stm_rollback(tx, STM_ABORT_VALIDATE);
+      return 0;
+    }
+#elif DESIGN == RING
+    if (!stm_ring_validate(tx)) {
+      stm_rollback(tx, STM_ABORT_VALIDATE);
+      return 0;
+    }
+#endif /* DESIGN == RING */
+# ifdef IRREVOCABLE_IMPROVED
+    /* Make sure that data read cannot change anymore */
+    if (ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 1) {
+#  if DESIGN == WRITE_BACK_ETL
+      if (!stm_wbetl_lock_reads(tx)) {
+#  elif DESIGN == WRITE_THROUGH
+      if (!stm_wt_lock_reads(tx)) {
+#  endif /* DESIGN == WRITE_THROUGH */
+        stm_rollback(tx, STM_ABORT_VALIDATE);
+        return 0;
+      }
+    }
+# endif /* IRREVOCABLE_IMPROVED */
 
 # if CM == CM_MODULAR
    /* We might still abort if we cannot set status (e.g., we are being killed) */
@@ -991,12 +2798,20 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
     }
   } else if ((tx->irrevocable & 0x07) == 1) {
     /* Acquire irrevocability after restart (no need to validate) */
-    while (_tinystm.irrevocable == 1 || ATOMIC_CAS_FULL(&_tinystm.irrevocable, 0, 1) == 0)
+    while (IRREVOCABLE_FLAG != 0 || ATOMIC_CAS_FULL(&IRREVOCABLE_FLAG, 0, 1) == 0)
       ;
     /* Success: remember we have the lock */
     tx->irrevocable++;
+# ifdef IRREVOCABLE_IMPROVED
+    if ((tx->irrevocable & 0x08) != 0)
+      stm_irrevocable_block(tx);
+# endif /* IRREVOCABLE_IMPROVED */
   }
   assert((tx->irrevocable & 0x07) == 2);
+# ifdef INLINE_FAST_PATH
+  /* Irrevocable reads are neither validated nor logged (and may lock data) */
+  tx->fast_locks = NULL;
+# endif /* INLINE_FAST_PATH */
 
   /* Are we in serial irrevocable mode? */
   if ((tx->irrevocable & 0x08) != 0) {
@@ -1011,6 +2826,14 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
 
   /* We are in irrevocable mode */
   tx->irrevocable++;
+  stm_notify_event(STM_EVENT_IRREVOCABLE);
+# ifdef TM_STATISTICS
+  tx->stat_irrevocable++;
+#  ifndef IRREVOCABLE_IMPROVED
+  /* Other update transactions cannot commit */
+  tx->stat_irrevocable_stopped++;
+#  endif /* ! IRREVOCABLE_IMPROVED */
+# endif /* TM_STATISTICS */
 
 #else /* ! IRREVOCABLE_ENABLED */
   fprintf(stderr, "Irrevocability is not supported in this configuration\n");
@@ -1032,12 +2855,114 @@ stm_set_irrevocable_tx(stm_tx_t *tx, int serial)
   return int_stm_set_irrevocable(tx, serial);
 }
 
+/*
+ * Set policy for making transactions irrevocable after repeated aborts.
+ */
+_CALLCONV int
+stm_set_irrevocable_fallback(int id, unsigned int retries, unsigned long cycles, int serial)
+{
+#ifdef IRREVOCABLE_FALLBACK
+  stm_fallback_set(id, retries, cycles, serial);
+  return 1;
+#else /* ! IRREVOCABLE_FALLBACK */
+  return 0;
+#endif /* ! IRREVOCABLE_FALLBACK */
+}
+
+/*
+ * Register memory region with its own lock table.
+ */
+_CALLCONV int
+stm_register_region(void *base, size_t size, unsigned int shift)
+{
+#ifdef LOCK_REGIONS
+  lock_region_t *r;
+  stm_word_t b = (stm_word_t)base;
+  unsigned int i;
+  TX_GET;
+
+  PRINT_DEBUG("==> stm_register_region(%p,%lu,%u)\n", base, (unsigned long)size, shift);
+
+  /* Locks must cover at least one word */
+  if (size == 0 || shift < ((sizeof(stm_word_t) == 4) ? 2 : 3) || shift >= sizeof(stm_word_t) * 8)
+    return 0;
+  if (!lock_regions_quiesce(tx))
+    return 0;
+  for (i = 0; i < _tinystm.nb_regions; i++) {
+    r = &_tinystm.regions[i];
+    if (b < r->base + r->size && r->base < b + size)
+      break;
+  }
+  if (i < _tinystm.nb_regions || _tinystm.nb_regions == MAX_REGIONS) {
+    /* Overlapping region or too many regions */
+    stm_quiesce_release(tx);
+    return 0;
+  }
+  r = &_tinystm.regions[_tinystm.nb_regions];
+  r->base = b;
+  r->size = size;
+  r->shift = shift;
+  r->nb_locks = ((size - 1) >> shift) + 1;
+  /* New locks have timestamp 0 (all data was committed before) */
+  r->locks = (volatile stm_word_t *)xcalloc(r->nb_locks, sizeof(stm_word_t));
+  _tinystm.nb_regions++;
+  stm_quiesce_release(tx);
+  return 1;
+#else /* ! LOCK_REGIONS */
+  fprintf(stderr, "Lock regions are not enabled\n");
+  exit(-1);
+  return 0;
+#endif /* ! LOCK_REGIONS */
+}
+
+/*
+ * Unregister memory region.
+ */
+_CALLCONV int
+stm_unregister_region(void *base)
+{
+#ifdef LOCK_REGIONS
+  unsigned int i;
+  TX_GET;
+
+  PRINT_DEBUG("==> stm_unregister_region(%p)\n", base);
+
+  if (!lock_regions_quiesce(tx))
+    return 0;
+  for (i = 0; i < _tinystm.nb_regions; i++) {
+    if (_tinystm.regions[i].base == (stm_word_t)base)
+      break;
+  }
+  if (i == _tinystm.nb_regions) {
+    stm_quiesce_release(tx);
+    return 0;
+  }
+  xfree((void *)_tinystm.regions[i].locks);
+  /* Keep regions contiguous */
+  _tinystm.regions[i] = _tinystm.regions[--_tinystm.nb_regions];
+  stm_quiesce_release(tx);
+  return 1;
+#else /* ! LOCK_REGIONS */
+  fprintf(stderr, "Lock regions are not enabled\n");
+  exit(-1);
+  return 0;
+#endif /* ! LOCK_REGIONS */
+}
+
 /*
  * Increment the value of global clock (Only for TinySTM developers).
  */
 void
 stm_inc_clock(void)
 {
+#if DESIGN == NOREC
+  /* Keep the parity of the sequence lock */
+  ATOMIC_FETCH_ADD_FULL(&CLOCK, 2);
+#elif DESIGN == RING
+  /* Readers expect a signature for each time */
+  stm_ring_tick();
+#else /* DESIGN != NOREC && DESIGN != RING */
   FETCH_INC_CLOCK;
+#endif /* DESIGN != NOREC && DESIGN != RING */
 }
 
@@ -0,0 +1,171 @@
+/*
+ * File:
+ *   stm_ats.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for adaptive transaction scheduling.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_ATS_H_
+#define _STM_ATS_H_
+
+/*
+ * Each thread and each atomic block (identified by the id attribute of
+ * the transaction) maintain a contention intensity, i.e., an
+ * exponential moving average of the outcome of their transactions (1
+ * for an abort due to a conflict, 0 for a commit).  When the intensity
+ * of the thread or of the atomic block exceeds the threshold, the
+ * transaction takes a ticket in the queue of its atomic block before
+ * (re)starting and keeps it until it commits.  Contended instances of
+ * the same atomic block hence execute one after the other, while other
+ * transactions are not affected.  Transactions only wait in the queue
+ * between attempts, i.e., when they do not own any lock.
+ *
+ * The intensity of atomic blocks is updated without synchronization:
+ * concurrent updates may be lost but it is only used as a hint.
+ */
+
+/*
+ * Set threshold (percent, 100 or more never serializes transactions).
+ */
+static INLINE void
+stm_ats_set_threshold(int threshold)
+{
+  if (threshold < 0)
+    threshold = 0;
+  else if (threshold > 100)
+    threshold = 100;
+  _tinystm.ats_threshold = threshold;
+  _tinystm.ats_limit = (stm_word_t)threshold * ATS_ONE / 100;
+}
+
+/*
+ * Update contention intensity with outcome of last transaction.
+ */
+static INLINE stm_word_t
+stm_ats_update(stm_word_t ci, int aborted)
+{
+  /* Round up so that intensity eventually drops to 0 */
+  ci -= (ci + (1 << ATS_WEIGHT_SHIFT) - 1) >> ATS_WEIGHT_SHIFT;
+  if (aborted)
+    ci += ATS_ONE >> ATS_WEIGHT_SHIFT;
+  return ci;
+}
+
+/*
+ * Get scheduling queue of atomic block.
+ */
+static INLINE ats_queue_t *
+stm_ats_queue(stm_tx_t *tx)
+{
+  return &_tinystm.ats_queues[tx->attr.id & (ATS_QUEUES - 1)];
+}
+
+/*
+ * Record outcome of transaction.
+ */
+static INLINE void
+stm_ats_record(stm_tx_t *tx, int aborted)
+{
+  ats_queue_t *q;
+  stm_word_t ci;
+
+  tx->ats_intensity = stm_ats_update(tx->ats_intensity, aborted);
+
+  q = stm_ats_queue(tx);
+  ci = ATOMIC_LOAD(&q->intensity);
+  /* Do not write shared intensity in the absence of contention */
+  if (ci != 0 || aborted)
+    ATOMIC_STORE(&q->intensity, stm_ats_update(ci, aborted));
+}
+
+/*
+ * Record abort of transaction (only conflicts count as contention).
+ */
+static INLINE void
+stm_ats_abort(stm_tx_t *tx, unsigned int reason)
+{
+  switch (reason) {
+    case STM_ABORT_RR_CONFLICT:
+    case STM_ABORT_RW_CONFLICT:
+    case STM_ABORT_WR_CONFLICT:
+    case STM_ABORT_WW_CONFLICT:
+    case STM_ABORT_VAL_READ:
+    case STM_ABORT_VAL_WRITE:
+    case STM_ABORT_VALIDATE:
+    case STM_ABORT_KILLED:
+      stm_ats_record(tx, 1);
+  }
+}
+
+/*
+ * Wait for turn in queue of atomic block if contention is high (before
+ * start or restart).
+ */
+static INLINE void
+stm_ats_schedule(stm_tx_t *tx)
+{
+  ats_queue_t *q;
+  stm_word_t t;
+
+  /* Ticket is kept upon restart */
+  if (tx->ats_queue != NULL)
+    return;
+#ifdef IRREVOCABLE_ENABLED
+  /* Irrevocable transactions might hold the irrevocability lock */
+  if (tx->irrevocable != 0)
+    return;
+#endif /* IRREVOCABLE_ENABLED */
+
+  q = stm_ats_queue(tx);
+  if (likely(tx->ats_intensity <= _tinystm.ats_limit && ATOMIC_LOAD(&q->intensity) <= _tinystm.ats_limit))
+    return;
+
+  PRINT_DEBUG("==> stm_ats_schedule(%p,%u)\n", tx, (unsigned int)(q - _tinystm.ats_queues));
+
+  t = ATOMIC_FETCH_INC_FULL(&q->next);
+  /* Yield as waiting can last for several transactions */
+  while (ATOMIC_LOAD_ACQ(&q->serving) != t) {
+    /* Owner of the queue might wait for us to reset the clock */
+    if (unlikely(GET_CLOCK >= VERSION_MAX))
+      stm_quiesce_barrier(tx, rollover_clock, NULL);
+    sched_yield();
+  }
+  tx->ats_queue = q;
+#ifdef TM_STATISTICS
+  tx->stat_serialized++;
+#endif /* TM_STATISTICS */
+}
+
+/*
+ * Leave queue of atomic block (upon commit or abort without retry).
+ */
+static INLINE void
+stm_ats_release(stm_tx_t *tx)
+{
+  ats_queue_t *q;
+
+  if ((q = tx->ats_queue) != NULL) {
+    tx->ats_queue = NULL;
+    ATOMIC_STORE_REL(&q->serving, q->serving + 1);
+  }
+}
+
+#endif /* _STM_ATS_H_ */
@@ -0,0 +1,442 @@
+/*
+ * File:
+ *   stm_durable.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for durable transactions (persistent memory).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_DURABLE_H_
+#define _STM_DURABLE_H_
+
+/*
+ * An update transaction commits in three steps, each ending with a
+ * store fence, while it holds the locks of the data it writes:
+ *   1. the old values of written words are saved in the undo log of the
+ *      thread and the log is flushed (the memory is not modified yet);
+ *   2. new values are written back and their cache lines flushed;
+ *   3. the log is truncated.
+ * Locks are only released after the last step: otherwise, another
+ * transaction could make its own writes to the same words persistent
+ * before the truncation and recovery would then revert them.
+ *
+ * Upon recovery, the valid logs (see durable_log_t) belong to
+ * transactions that were between steps 1 and 3, hence hold locks on
+ * disjoint data, and are rolled back in any order.
+ *
+ * Logs are extended in the log file when transactions write more than
+ * DURABLE_LOG_SIZE words (see durable_ext_t).  Threads wait for a log
+ * when DURABLE_LOG_SLOTS of them are already in use.
+ */
+
+#include <cpuid.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {                                  /* Instructions for flushing cache lines */
+  DURABLE_CLFLUSH,
+  DURABLE_CLFLUSHOPT,
+  DURABLE_CLWB
+};
+
+#define DURABLE_LINE(a)                 ((stm_word_t)(a) & ~(stm_word_t)(CACHELINE_SIZE - 1))
+
+/*
+ * Select the best flush instruction supported by the processor.
+ */
+static INLINE int
+stm_durable_detect(void)
+{
+  unsigned int a, b, c, d;
+
+  if (__get_cpuid_max(0, NULL) < 7)
+    return DURABLE_CLFLUSH;
+  __cpuid_count(7, 0, a, b, c, d);
+  /* CLWB is bit 24 and CLFLUSHOPT bit 23 of EBX */
+  if (b & (1 << 24))
+    return DURABLE_CLWB;
+  if (b & (1 << 23))
+    return DURABLE_CLFLUSHOPT;
+  return DURABLE_CLFLUSH;
+}
+
+/*
+ * Write back the cache line of an address (emitted as raw prefixes so
+ * that the library does not need to be compiled with -mclwb).
+ */
+static INLINE void
+stm_durable_flush(const volatile void *addr)
+{
+  switch (_tinystm.durable_flush) {
+    case DURABLE_CLWB:
+      /* clwb = 66 0F AE /6 */
+      __asm__ __volatile__ (".byte 0x66; xsaveopt %0" : "+m" (*(volatile char *)addr));
+      break;
+    case DURABLE_CLFLUSHOPT:
+      /* clflushopt = 66 0F AE /7 */
+      __asm__ __volatile__ (".byte 0x66; clflush %0" : "+m" (*(volatile char *)addr));
+      break;
+    default:
+      __asm__ __volatile__ ("clflush %0" : "+m" (*(volatile char *)addr));
+  }
+}
+
+static INLINE void
+stm_durable_fence(void)
+{
+  __asm__ __volatile__ ("sfence" : : : "memory");
+}
+
+/*
+ * Map part of the log file.
+ */
+static void *
+stm_durable_map(size_t size, off_t offset)
+{
+  void *p;
+
+  p = MAP_FAILED;
+#ifdef MAP_SYNC
+  /* Synchronous page faults on DAX file systems */
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED_VALIDATE | MAP_SYNC, _tinystm.durable_fd, offset);
+#endif /* MAP_SYNC */
+  if (p == MAP_FAILED)
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _tinystm.durable_fd, offset);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  return p;
+}
+
+/*
+ * Claim a log for a new descriptor (kept by pooled descriptors).
+ */
+static INLINE void
+stm_durable_enter_thread(stm_tx_t *tx)
+{
+  unsigned int i;
+
+  tx->durable_log = NULL;
+  if (_tinystm.durable == NULL)
+    return;
+  while (1) {
+    for (i = 0; i < DURABLE_LOG_SLOTS; i++) {
+      if (ATOMIC_LOAD(&_tinystm.durable_used[i]) == 0 && ATOMIC_CAS_FULL(&_tinystm.durable_used[i], 0, 1) != 0) {
+        tx->durable_log = &_tinystm.durable->logs[i];
+        /* Generations must increase across executions */
+        tx->durable_gen = tx->durable_log->gen;
+        return;
+      }
+    }
+    /* All logs are used: wait for a thread to exit */
+    sched_yield();
+  }
+}
+
+static INLINE void
+stm_durable_exit_thread(stm_tx_t *tx)
+{
+  if (tx->durable_log != NULL)
+    ATOMIC_STORE_REL(&_tinystm.durable_used[tx->durable_log - _tinystm.durable->logs], 0);
+}
+
+/*
+ * Get the extension following another one (or the first extension of
+ * the log if NULL), appending it to the log file if needed.
+ */
+static NOINLINE durable_ext_t *
+stm_durable_extend(stm_tx_t *tx, durable_ext_t *ext)
+{
+  durable_ext_t *next;
+  volatile stm_word_t *link;
+  unsigned int slot;
+  size_t offset;
+
+  slot = tx->durable_log - _tinystm.durable->logs;
+  next = (ext == NULL ? _tinystm.durable_ext[slot] : ext->next_ext);
+  if (next != NULL)
+    return next;
+
+  PRINT_DEBUG("==> stm_durable_extend(%p[%u])\n", tx, slot);
+
+  pthread_mutex_lock(&_tinystm.durable_mutex);
+  offset = _tinystm.durable_size;
+  /* New part of the file is zeroed (lines have generation 0) */
+  if (ftruncate(_tinystm.durable_fd, offset + sizeof(durable_ext_t)) != 0) {
+    perror("ftruncate");
+    exit(1);
+  }
+  _tinystm.durable_size = offset + sizeof(durable_ext_t);
+  pthread_mutex_unlock(&_tinystm.durable_mutex);
+  next = (durable_ext_t *)stm_durable_map(sizeof(durable_ext_t), offset);
+
+  /* Link becomes persistent with the fence that validates the log */
+  link = (ext == NULL ? &tx->durable_log->next : &ext->next);
+  *link = offset;
+  stm_durable_flush(link);
+  if (ext == NULL)
+    _tinystm.durable_ext[slot] = next;
+  else
+    ext->next_ext = next;
+  return next;
+}
+
+/*
+ * Save and flush old values of written words (step 1).  Returns the
+ * number of entries (the log is not used if there are none).
+ */
+static INLINE stm_word_t
+stm_durable_log(stm_tx_t *tx)
+{
+  durable_log_t *log = tx->durable_log;
+  durable_line_t *line, *end;
+  durable_ext_t *ext;
+  w_entry_t *w;
+  stm_word_t n, gen;
+  int i, k;
+
+  gen = tx->durable_gen + 1;
+  line = log->lines;
+  end = line + DURABLE_LOG_LINES;
+  ext = NULL;
+  n = k = 0;
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    if (w->mask == 0)
+      continue;
+    if (unlikely(line == end)) {
+      /* Continue in next extension */
+      ext = stm_durable_extend(tx, ext);
+      line = ext->lines;
+      end = line + DURABLE_EXT_LINES;
+    }
+    /* Memory still holds old value (write-back) and is locked */
+    line->entries[2 * k] = (stm_word_t)w->addr;
+    line->entries[2 * k + 1] = ATOMIC_LOAD(w->addr);
+    n++;
+    if (++k == DURABLE_LINE_ENTRIES) {
+      line->gen = gen;
+      stm_durable_flush(line);
+      line++;
+      k = 0;
+    }
+  }
+  if (n == 0)
+    return 0;
+  if (k != 0) {
+    line->gen = gen;
+    stm_durable_flush(line);
+  }
+  /* Count is written last (log is invalid until then) */
+  log->gen = gen;
+  log->count = n;
+  stm_durable_flush(log);
+  stm_durable_fence();
+  tx->durable_gen = gen;
+  return n;
+}
+
+/*
+ * Truncate the log once data is persistent (step 3).
+ */
+static INLINE void
+stm_durable_truncate(stm_tx_t *tx)
+{
+  tx->durable_log->count = 0;
+  stm_durable_flush(tx->durable_log);
+  stm_durable_fence();
+}
+
+/*
+ * Get a line of a log upon recovery (NULL if not in the log file).
+ */
+static durable_line_t *
+stm_durable_line(durable_log_t *log, stm_word_t i)
+{
+  durable_ext_t *ext;
+  stm_word_t offset;
+
+  if (i < DURABLE_LOG_LINES)
+    return &log->lines[i];
+  i -= DURABLE_LOG_LINES;
+  offset = log->next;
+  while (1) {
+    if (offset < DURABLE_FILE_SIZE || offset > _tinystm.durable_size - sizeof(durable_ext_t) ||
+        (offset - DURABLE_FILE_SIZE) % sizeof(durable_ext_t) != 0)
+      return NULL;
+    ext = (durable_ext_t *)((char *)_tinystm.durable + offset);
+    if (i < DURABLE_EXT_LINES)
+      return &ext->lines[i];
+    i -= DURABLE_EXT_LINES;
+    offset = ext->next;
+  }
+}
+
+/*
+ * Roll back a valid log (returns 0 if the log is not valid).
+ */
+static int
+stm_durable_recover(durable_log_t *log)
+{
+  durable_line_t *line;
+  volatile stm_word_t *addr;
+  stm_word_t n, i;
+
+  n = log->count;
+  if (n == 0)
+    return 0;
+  for (i = 0; i < (n + DURABLE_LINE_ENTRIES - 1) / DURABLE_LINE_ENTRIES; i++) {
+    /* Log was not completely persistent: memory was not modified */
+    if ((line = stm_durable_line(log, i)) == NULL || line->gen != log->gen)
+      return 0;
+  }
+  /* Restore in reverse order */
+  for (i = n; i > 0; i--) {
+    line = stm_durable_line(log, (i - 1) / DURABLE_LINE_ENTRIES);
+    addr = (volatile stm_word_t *)line->entries[2 * ((i - 1) % DURABLE_LINE_ENTRIES)];
+    *addr = line->entries[2 * ((i - 1) % DURABLE_LINE_ENTRIES) + 1];
+    stm_durable_flush(addr);
+  }
+  return 1;
+}
+
+/*
+ * Drop extensions of the (truncated) logs from the log file.
+ */
+static void
+stm_durable_shrink(void)
+{
+  int i;
+
+  for (i = 0; i < DURABLE_LOG_SLOTS; i++) {
+    _tinystm.durable->logs[i].next = 0;
+    stm_durable_flush(&_tinystm.durable->logs[i]);
+  }
+  stm_durable_fence();
+  if (_tinystm.durable_size != DURABLE_FILE_SIZE) {
+    if (ftruncate(_tinystm.durable_fd, DURABLE_FILE_SIZE) != 0) {
+      perror("ftruncate");
+      exit(1);
+    }
+    _tinystm.durable_size = DURABLE_FILE_SIZE;
+  }
+}
+
+/*
+ * Map the log file and roll back interrupted transactions.
+ */
+static void
+stm_durable_init(void)
+{
+  const char *path;
+  struct stat st;
+  int i;
+
+  _tinystm.durable = NULL;
+  _tinystm.durable_recovered = 0;
+  if ((path = getenv(DURABLE_LOG_ENV)) == NULL)
+    return;
+  _tinystm.durable_flush = stm_durable_detect();
+  if ((_tinystm.durable_fd = open(path, O_RDWR | O_CREAT, 0600)) < 0 || fstat(_tinystm.durable_fd, &st) != 0) {
+    perror("open");
+    exit(1);
+  }
+  if (st.st_size != 0 && (st.st_size < DURABLE_FILE_SIZE || (st.st_size - DURABLE_FILE_SIZE) % sizeof(durable_ext_t) != 0)) {
+    fprintf(stderr, "Error: incompatible durable log %s\n", path);
+    exit(1);
+  }
+  if (st.st_size == 0 && ftruncate(_tinystm.durable_fd, DURABLE_FILE_SIZE) != 0) {
+    perror("ftruncate");
+    exit(1);
+  }
+  /* Extensions of logs are mapped with the file upon recovery */
+  _tinystm.durable_size = (st.st_size == 0 ? DURABLE_FILE_SIZE : st.st_size);
+  _tinystm.durable = (durable_file_t *)stm_durable_map(_tinystm.durable_size, 0);
+  memset(_tinystm.durable_ext, 0, sizeof(_tinystm.durable_ext));
+  if (pthread_mutex_init(&_tinystm.durable_mutex, NULL) != 0) {
+    fprintf(stderr, "Error creating mutex\n");
+    exit(1);
+  }
+
+  if (_tinystm.durable->magic != DURABLE_MAGIC) {
+    /* New file (zeroed) */
+    _tinystm.durable->nb_logs = DURABLE_LOG_SLOTS;
+    _tinystm.durable->log_size = DURABLE_LOG_SIZE;
+    stm_durable_flush(_tinystm.durable);
+    stm_durable_fence();
+    _tinystm.durable->magic = DURABLE_MAGIC;
+    stm_durable_flush(_tinystm.durable);
+    stm_durable_fence();
+  } else if (_tinystm.durable->nb_logs != DURABLE_LOG_SLOTS || _tinystm.durable->log_size != DURABLE_LOG_SIZE) {
+    fprintf(stderr, "Error: incompatible durable log %s\n", path);
+    exit(1);
+  } else {
+    for (i = 0; i < DURABLE_LOG_SLOTS; i++) {
+      if (stm_durable_recover(&_tinystm.durable->logs[i]))
+        _tinystm.durable_recovered++;
+    }
+    if (_tinystm.durable_recovered != 0) {
+      /* Restored data must be persistent before logs are truncated */
+      stm_durable_fence();
+      for (i = 0; i < DURABLE_LOG_SLOTS; i++) {
+        _tinystm.durable->logs[i].count = 0;
+        stm_durable_flush(&_tinystm.durable->logs[i]);
+      }
+      stm_durable_fence();
+    }
+  }
+  stm_durable_shrink();
+  if (st.st_size > DURABLE_FILE_SIZE) {
+    /* Only map logs from now on */
+    munmap((void *)_tinystm.durable, st.st_size);
+    _tinystm.durable = (durable_file_t *)stm_durable_map(DURABLE_FILE_SIZE, 0);
+  }
+  PRINT_DEBUG("\tSTM_DURABLE_LOG=%s FLUSH=%d RECOVERED=%lu\n", path, _tinystm.durable_flush, _tinystm.durable_recovered);
+}
+
+static void
+stm_durable_exit(void)
+{
+  durable_ext_t *ext, *next;
+  int i;
+
+  if (_tinystm.durable == NULL)
+    return;
+  for (i = 0; i < DURABLE_LOG_SLOTS; i++) {
+    for (ext = _tinystm.durable_ext[i]; ext != NULL; ext = next) {
+      next = ext->next_ext;
+      munmap((void *)ext, sizeof(durable_ext_t));
+    }
+  }
+  memset(_tinystm.durable_ext, 0, sizeof(_tinystm.durable_ext));
+  /* Logs are truncated: extensions can be dropped */
+  stm_durable_shrink();
+  munmap((void *)_tinystm.durable, DURABLE_FILE_SIZE);
+  close(_tinystm.durable_fd);
+  pthread_mutex_destroy(&_tinystm.durable_mutex);
+  _tinystm.durable = NULL;
+  memset((void *)_tinystm.durable_used, 0, sizeof(_tinystm.durable_used));
+}
+
+#endif /* _STM_DURABLE_H_ */
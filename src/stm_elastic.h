@@ -0,0 +1,75 @@
+/*
+ * File:
+ *   stm_elastic.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM early release and elastic transactions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_ELASTIC_H_
+#define _STM_ELASTIC_H_
+
+/*
+ * Reads removed from the read set are neither validated upon snapshot
+ * extension nor upon commit.  Until its first write, an elastic
+ * transaction keeps between _tinystm.elastic_window and twice as many
+ * of its last reads: entries are dropped in batches to amortize the
+ * cost of moving the array.  Entries that closed nested transactions
+ * restore upon rollback are never removed.
+ */
+
+/*
+ * Drop the oldest reads of an elastic transaction (before its first write).
+ */
+static INLINE void
+stm_elastic_cut(stm_tx_t *tx)
+{
+  unsigned int base, k;
+
+  k = _tinystm.elastic_window;
+  if (likely(tx->r_set.nb_entries < 2 * k) || tx->w_set.nb_entries != 0)
+    return;
+  base = stm_rs_base(tx);
+  if (tx->r_set.nb_entries - base < 2 * k)
+    return;
+  memmove(&tx->r_set.entries[base], &tx->r_set.entries[tx->r_set.nb_entries - k], k * sizeof(r_entry_t));
+  tx->r_set.nb_entries = base + k;
+}
+
+/*
+ * Remove all reads of a lock from the read set.
+ */
+static INLINE void
+stm_elastic_release(stm_tx_t *tx, volatile stm_word_t *lock)
+{
+  r_entry_t *r, *d, *end;
+
+  PRINT_DEBUG("==> stm_elastic_release(%p[%lu-%lu],%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, lock);
+
+  d = r = &tx->r_set.entries[stm_rs_base(tx)];
+  end = &tx->r_set.entries[tx->r_set.nb_entries];
+  for (; r < end; r++) {
+    if (r->lock != lock)
+      *d++ = *r;
+  }
+  tx->r_set.nb_entries = d - tx->r_set.entries;
+}
+
+#endif /* _STM_ELASTIC_H_ */
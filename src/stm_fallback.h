@@ -0,0 +1,124 @@
+/*
+ * File:
+ *   stm_fallback.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM fallback to irrevocable mode after repeated aborts.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_FALLBACK_H_
+#define _STM_FALLBACK_H_
+
+/*
+ * Each atomic block (attr.id modulo FALLBACK_IDS) follows the policy set
+ * for it or, by default, the global one.  A transaction that has aborted
+ * the given number of consecutive times (each abort counting 1 +
+ * attr.priority times), or whose aborted attempts have
+ * lasted the given number of cycles, requests irrevocability before it
+ * restarts: it then acquires it upon restart (see int_stm_prepare()) and
+ * cannot abort anymore.  Cycles are only measured if the policy has a
+ * budget.
+ */
+
+/*
+ * Get policy of atomic block.
+ */
+static INLINE fallback_t *
+stm_fallback_get(unsigned int id)
+{
+  fallback_t *f;
+
+  f = &_tinystm.fallback[id & (FALLBACK_IDS - 1)];
+  return f->set ? f : &_tinystm.fallback_default;
+}
+
+/*
+ * Set policy of atomic block (all blocks without policy if id < 0).
+ */
+static INLINE void
+stm_fallback_set(int id, unsigned int retries, unsigned long cycles, int serial)
+{
+  fallback_t *f;
+
+  f = (id < 0 ? &_tinystm.fallback_default : &_tinystm.fallback[id & (FALLBACK_IDS - 1)]);
+  f->retries = retries;
+  f->cycles = cycles;
+  f->serial = serial;
+  f->set = 1;
+}
+
+/*
+ * Forget policies of atomic blocks.
+ */
+static INLINE void
+stm_fallback_init(unsigned int retries, unsigned long cycles, int serial)
+{
+  memset(_tinystm.fallback, 0, sizeof(_tinystm.fallback));
+  stm_fallback_set(-1, retries, cycles, serial);
+}
+
+/*
+ * Start counting aborts (upon start).
+ */
+static INLINE void
+stm_fallback_start(stm_tx_t *tx)
+{
+  tx->fallback = stm_fallback_get(tx->attr.id);
+  tx->fb_retries = 0;
+  /* Budget is kept in case the policy changes while active */
+  if (unlikely((tx->fb_cycles = tx->fallback->cycles) != 0)) {
+    tx->fb_wasted = 0;
+    tx->fb_ts = stm_cycles();
+  }
+}
+
+/*
+ * Request irrevocability for next attempt if the policy says so (upon rollback).
+ */
+static INLINE void
+stm_fallback_abort(stm_tx_t *tx, unsigned int reason)
+{
+  fallback_t *f;
+  uint64_t now;
+  int fall;
+
+  /* Already requested, or cannot retry in irrevocable mode */
+  if (tx->irrevocable != 0 || reason == STM_ABORT_RETRY || reason == STM_ABORT_RO_WRITE)
+    return;
+  f = tx->fallback;
+  /* Higher priorities become irrevocable after fewer aborts */
+  tx->fb_retries += 1 + tx->attr.priority;
+  fall = (f->retries != 0 && tx->fb_retries >= f->retries);
+  if (tx->fb_cycles != 0) {
+    now = stm_cycles();
+    tx->fb_wasted += now - tx->fb_ts;
+    tx->fb_ts = now;
+    if (tx->fb_wasted >= tx->fb_cycles)
+      fall = 1;
+  }
+  if (fall) {
+    tx->irrevocable = 1 + (f->serial ? 0x08 : 0);
+#ifdef TM_STATISTICS
+    tx->stat_fallbacks++;
+#endif /* TM_STATISTICS */
+  }
+}
+
+#endif /* _STM_FALLBACK_H_ */
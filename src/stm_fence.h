@@ -0,0 +1,121 @@
+/*
+ * File:
+ *   stm_fence.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for privatization fences.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_FENCE_H_
+#define _STM_FENCE_H_
+
+/*
+ * Each thread owns a slot with an epoch counter that is odd while it
+ * executes a (software) transaction: it is incremented upon start and
+ * restart, and after the transaction has committed (including write
+ * back) or aborted.  A fence takes a snapshot of the counters and waits
+ * for the odd ones to change, i.e., only for the transactions that were
+ * running when the fence started.  Fences do not take any lock and do
+ * not modify shared data, hence several threads can execute them
+ * concurrently.  Slots are allocated upon thread initialization (under
+ * the quiescence mutex) and reused after threads exit.
+ */
+
+/*
+ * Allocate slot of thread (quiescence mutex held).
+ */
+static INLINE void
+stm_fence_enter_thread(stm_tx_t *tx)
+{
+  unsigned int i;
+
+  for (i = 0; i < FENCE_MAX_THREADS && _tinystm.fence_slots[i].used; i++)
+    ;
+  if (i == FENCE_MAX_THREADS) {
+    fprintf(stderr, "Error: too many threads for privatization fences\n");
+    exit(1);
+  }
+  _tinystm.fence_slots[i].used = 1;
+  if (i >= _tinystm.fence_nb)
+    ATOMIC_STORE_REL(&_tinystm.fence_nb, i + 1);
+  tx->fence = &_tinystm.fence_slots[i];
+}
+
+/*
+ * Release slot of thread (quiescence mutex held).
+ */
+static INLINE void
+stm_fence_exit_thread(stm_tx_t *tx)
+{
+  /* Counter is even as the thread is not in a transaction */
+  assert((tx->fence->epoch & 1) == 0);
+  tx->fence->used = 0;
+  tx->fence = NULL;
+}
+
+/*
+ * Transaction starts or restarts.
+ */
+static INLINE void
+stm_fence_start(stm_tx_t *tx)
+{
+  /* Full barrier: fences must see us before we read shared data */
+  ATOMIC_FETCH_INC_FULL(&tx->fence->epoch);
+}
+
+/*
+ * Transaction is done (after commit or rollback).
+ */
+static INLINE void
+stm_fence_end(stm_tx_t *tx)
+{
+  /* Hardware transactions do not update the counter upon start */
+  if ((tx->fence->epoch & 1) != 0)
+    ATOMIC_STORE_REL(&tx->fence->epoch, tx->fence->epoch + 1);
+}
+
+/*
+ * Wait for transactions running upon call to complete.
+ */
+static INLINE void
+stm_fence_wait(void)
+{
+  stm_word_t epochs[FENCE_MAX_THREADS];
+  stm_word_t i, nb;
+
+  PRINT_DEBUG("==> stm_fence_wait()\n");
+
+  /* Make sure that previous writes (e.g., unlinking data) are visible */
+  ATOMIC_MB_FULL;
+  nb = ATOMIC_LOAD_ACQ(&_tinystm.fence_nb);
+  for (i = 0; i < nb; i++)
+    epochs[i] = ATOMIC_LOAD(&_tinystm.fence_slots[i].epoch);
+  for (i = 0; i < nb; i++) {
+    if ((epochs[i] & 1) == 0)
+      continue;
+    /* Yield as waiting can last for a whole transaction */
+    while (ATOMIC_LOAD_ACQ(&_tinystm.fence_slots[i].epoch) == epochs[i])
+      sched_yield();
+  }
+  /* Do not read private data before the transactions are done */
+  ATOMIC_MB_READ;
+}
+
+#endif /* _STM_FENCE_H_ */
@@ -0,0 +1,120 @@
+/*
+ * File:
+ *   stm_futex.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for sleeping on contended locks.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_FUTEX_H_
+#define _STM_FUTEX_H_
+
+/*
+ * A transaction that waits for the contended lock that caused its
+ * abort spins for FUTEX_SPIN iterations and then sleeps on a futex.
+ * Lock words have no spare bit (and are too large for futexes), hence
+ * waiters sleep on a small table of sequence numbers indexed by a hash
+ * of the lock address.  Parked threads are also counted globally so
+ * that transactions only look up the table for the locks they release
+ * upon commit or abort when some thread is sleeping.  Sleeps are
+ * bounded by FUTEX_TIMEOUT: a lock released without waking up waiters
+ * (e.g., after being stolen with CM_MODULAR) only delays them.
+ */
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* Futexes are 32-bit words: use least significant half of sequence number */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define FUTEX_WORD(s)                  ((int *)&(s)->seq + (sizeof(stm_word_t) / sizeof(int) - 1))
+#else /* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
+# define FUTEX_WORD(s)                  ((int *)&(s)->seq)
+#endif /* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
+
+/*
+ * Get futex of lock.
+ */
+static INLINE futex_slot_t *
+stm_futex_slot(volatile stm_word_t *lock)
+{
+  return &_tinystm.futex_slots[((stm_word_t)lock >> 3) & (FUTEX_SLOTS - 1)];
+}
+
+/*
+ * Wait until lock is free (spin first, then sleep).
+ */
+static NOINLINE void
+stm_futex_wait(volatile stm_word_t *lock)
+{
+  futex_slot_t *s;
+  struct timespec ts;
+  stm_word_t seq;
+  unsigned int i;
+
+  for (i = 0; i < FUTEX_SPIN; i++) {
+    if (!LOCK_GET_OWNED(ATOMIC_LOAD(lock)))
+      return;
+  }
+
+  s = stm_futex_slot(lock);
+  ATOMIC_FETCH_INC_FULL(&_tinystm.futex_waiters);
+  ATOMIC_FETCH_INC_FULL(&s->waiters);
+  for (;;) {
+    /* Read sequence number before checking the lock (see stm_futex_wake()) */
+    seq = ATOMIC_LOAD_ACQ(&s->seq);
+    if (!LOCK_GET_OWNED(ATOMIC_LOAD_ACQ(lock)))
+      break;
+    ts.tv_sec = 0;
+    ts.tv_nsec = FUTEX_TIMEOUT;
+    syscall(SYS_futex, FUTEX_WORD(s), FUTEX_WAIT_PRIVATE, (int)seq, &ts, NULL, 0);
+  }
+  ATOMIC_FETCH_DEC_FULL(&s->waiters);
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.futex_waiters);
+}
+
+/*
+ * Wake up threads sleeping on the locks of the write set (after release).
+ */
+static INLINE void
+stm_futex_wake(stm_tx_t *tx)
+{
+  futex_slot_t *s;
+  w_entry_t *w;
+  int i;
+
+  /* Lock releases must be visible before checking for waiters */
+  ATOMIC_MB_FULL;
+  if (likely(ATOMIC_LOAD(&_tinystm.futex_waiters) == 0))
+    return;
+
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    s = stm_futex_slot(w->lock);
+    if (ATOMIC_LOAD(&s->waiters) != 0) {
+      ATOMIC_FETCH_INC_FULL(&s->seq);
+      syscall(SYS_futex, FUTEX_WORD(s), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+  }
+}
+
+#endif /* _STM_FUTEX_H_ */
@@ -0,0 +1,258 @@
+/*
+ * File:
+ *   stm_htm.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for hybrid execution (hardware fast path).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_HTM_H_
+#define _STM_HTM_H_
+
+/*
+ * Hardware transactions first try to execute the whole transaction with
+ * Intel RTM.  They access memory directly but subscribe to the locks of
+ * the addresses they access (and to the irrevocability and quiescence
+ * flags), so that any concurrent software transaction acquiring one of
+ * these locks aborts them.  Upon commit, they update the version of the
+ * locks covering written addresses with a new timestamp from the global
+ * clock, so that software transactions can detect the changes.  After
+ * _tinystm.htm_retries failed attempts (or if the abort cannot succeed
+ * upon retry), the transaction falls back to the software path of the
+ * selected design.
+ *
+ * The RTM instructions are emitted as raw opcodes so that the library
+ * does not need to be compiled with -mrtm, and support is detected at
+ * runtime (CPUID) before ever executing them.
+ */
+
+#include <cpuid.h>
+
+#define HTM_STARTED                     (~0U)
+#define HTM_ABORT_EXPLICIT              (1 << 0)
+#define HTM_ABORT_RETRY                 (1 << 1)
+#define HTM_ABORT_CONFLICT              (1 << 2)
+#define HTM_ABORT_CAPACITY              (1 << 3)
+#define HTM_ABORT_DEBUG                 (1 << 4)
+#define HTM_ABORT_NESTED                (1 << 5)
+#define HTM_ABORT_CODE(s)               (((s) >> 24) & 0xFF)
+
+/* Explicit abort codes */
+#define HTM_CODE_LOCKED                 0x01  /* Lock owned by a software transaction */
+#define HTM_CODE_BUSY                   0x02  /* Irrevocable transaction or quiescence */
+#define HTM_CODE_FULL                   0x03  /* Too many written locks */
+#define HTM_CODE_SOFTWARE               0xFF  /* Operation requires the software path */
+
+static INLINE unsigned int
+htm_begin(void)
+{
+  unsigned int status = HTM_STARTED;
+  /* xbegin (fallback address is the next instruction) */
+  __asm__ __volatile__ (".byte 0xc7,0xf8 ; .long 0" : "+a" (status) : : "memory");
+  return status;
+}
+
+static INLINE void
+htm_end(void)
+{
+  /* xend */
+  __asm__ __volatile__ (".byte 0x0f,0x01,0xd5" : : : "memory");
+}
+
+#define htm_abort(code)                 __asm__ __volatile__ (".byte 0xc6,0xf8,%P0" : : "i" (code) : "memory")
+
+/*
+ * Check if the processor supports RTM.
+ */
+static INLINE int
+stm_htm_supported(void)
+{
+  unsigned int a, b, c, d;
+
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid_count(7, 0, a, b, c, d);
+  /* RTM is bit 11 of EBX */
+  return (b & (1 << 11)) != 0;
+}
+
+/*
+ * Record hardware abort reason.
+ */
+static INLINE void
+stm_htm_abort_stats(stm_tx_t *tx, unsigned int status)
+{
+  tx->stat_htm_aborts++;
+  if (status & HTM_ABORT_CONFLICT)
+    tx->stat_htm_aborts_r[HTM_STAT_CONFLICT]++;
+  else if (status & HTM_ABORT_CAPACITY)
+    tx->stat_htm_aborts_r[HTM_STAT_CAPACITY]++;
+  else if (status & HTM_ABORT_EXPLICIT) {
+    if (HTM_ABORT_CODE(status) == HTM_CODE_LOCKED)
+      tx->stat_htm_aborts_r[HTM_STAT_LOCKED]++;
+    else
+      tx->stat_htm_aborts_r[HTM_STAT_EXPLICIT]++;
+  } else
+    tx->stat_htm_aborts_r[HTM_STAT_OTHER]++;
+}
+
+/*
+ * Try to start a hardware transaction (return 1 if running in hardware).
+ */
+static INLINE int
+stm_htm_start(stm_tx_t *tx)
+{
+  unsigned int status, code;
+  int retries;
+
+  if (!_tinystm.htm_enabled)
+    return 0;
+#ifdef IRREVOCABLE_ENABLED
+  /* Irrevocable transactions must run in software */
+  if (unlikely(tx->irrevocable != 0))
+    return 0;
+#endif /* IRREVOCABLE_ENABLED */
+
+  for (retries = 0; retries < _tinystm.htm_retries; retries++) {
+    status = htm_begin();
+    if (likely(status == HTM_STARTED)) {
+      /* Subscribe to irrevocability and quiescence */
+#ifdef IRREVOCABLE_ENABLED
+      if (ATOMIC_LOAD(&IRREVOCABLE_FLAG) != 0)
+        htm_abort(HTM_CODE_BUSY);
+#endif /* IRREVOCABLE_ENABLED */
+      if (ATOMIC_LOAD(&_tinystm.quiesce) != 0)
+        htm_abort(HTM_CODE_BUSY);
+      /* Write set only keeps track of locks to update */
+      tx->w_set.nb_entries = 0;
+      tx->r_set.nb_entries = 0;
+      tx->htm = 1;
+      SET_STATUS(tx->status, TX_ACTIVE);
+      return 1;
+    }
+    /* Hardware transaction aborted (all its effects have been undone) */
+    stm_htm_abort_stats(tx, status);
+    if ((status & HTM_ABORT_EXPLICIT) != 0) {
+      code = HTM_ABORT_CODE(status);
+      /* No need to retry in hardware if the software path is required */
+      if (code != HTM_CODE_LOCKED && code != HTM_CODE_BUSY)
+        break;
+      /* Wait until irrevocable transaction or quiescence completes */
+      if (code == HTM_CODE_BUSY) {
+        while (
+#ifdef IRREVOCABLE_ENABLED
+               ATOMIC_LOAD(&IRREVOCABLE_FLAG) != 0 ||
+#endif /* IRREVOCABLE_ENABLED */
+               ATOMIC_LOAD(&_tinystm.quiesce) != 0) {
+# ifdef WAIT_YIELD
+          sched_yield();
+# endif /* WAIT_YIELD */
+        }
+      }
+    } else if ((status & HTM_ABORT_RETRY) == 0) {
+      /* Transaction will likely fail again (e.g., capacity) */
+      break;
+    }
+  }
+  tx->stat_htm_fallbacks++;
+
+  return 0;
+}
+
+/*
+ * Abort a hardware transaction (the transaction will restart in software).
+ */
+static INLINE void
+stm_htm_rollback(stm_tx_t *tx)
+{
+  htm_abort(HTM_CODE_SOFTWARE);
+}
+
+static INLINE stm_word_t
+stm_htm_read(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t l;
+
+  PRINT_DEBUG2("==> stm_htm_read(t=%p,a=%p)\n", tx, addr);
+
+  /* Subscribe to the lock */
+  l = ATOMIC_LOAD(GET_LOCK(addr));
+  if (unlikely(LOCK_GET_WRITE(l)))
+    htm_abort(HTM_CODE_LOCKED);
+
+  return ATOMIC_LOAD(addr);
+}
+
+static INLINE void
+stm_htm_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  volatile stm_word_t *lock;
+  stm_word_t l;
+
+  PRINT_DEBUG2("==> stm_htm_write(t=%p,a=%p,d=%p-%lu,m=0x%lx)\n",
+               tx, addr, (void *)value, (unsigned long)value, (unsigned long)mask);
+
+  /* Subscribe to the lock */
+  lock = GET_LOCK(addr);
+  l = ATOMIC_LOAD(lock);
+  if (unlikely(LOCK_GET_OWNED(l)))
+    htm_abort(HTM_CODE_LOCKED);
+
+  if (mask == 0)
+    return;
+  if (mask != ~(stm_word_t)0)
+    value = (ATOMIC_LOAD(addr) & ~mask) | (value & mask);
+  ATOMIC_STORE(addr, value);
+
+  /* Remember lock to update upon commit (duplicates are harmless) */
+  if (unlikely(tx->w_set.nb_entries == tx->w_set.size))
+    htm_abort(HTM_CODE_FULL);
+  tx->w_set.entries[tx->w_set.nb_entries++].lock = lock;
+}
+
+static INLINE int
+stm_htm_commit(stm_tx_t *tx)
+{
+  w_entry_t *w;
+  stm_word_t t;
+  int i, validate;
+
+  PRINT_DEBUG("==> stm_htm_commit(%p)\n", tx);
+
+  if (tx->w_set.nb_entries > 0) {
+    /* Get commit timestamp (no validation needed in hardware) */
+    t = stm_clock_commit(tx, &validate);
+    /* Let the software path handle clock rollover */
+    if (unlikely(t >= VERSION_MAX))
+      htm_abort(HTM_CODE_SOFTWARE);
+    w = tx->w_set.entries;
+    for (i = tx->w_set.nb_entries; i > 0; i--, w++)
+      ATOMIC_STORE(w->lock, LOCK_SET_TIMESTAMP(t));
+  }
+  htm_end();
+
+  tx->htm = 0;
+  tx->w_set.nb_entries = 0;
+  tx->stat_htm_commits++;
+
+  return 1;
+}
+
+#endif /* _STM_HTM_H_ */
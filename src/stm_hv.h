@@ -0,0 +1,180 @@
+/*
+ * File:
+ *   stm_hv.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM helper thread validating the read sets of long transactions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_HV_H_
+#define _STM_HV_H_
+
+/*
+ * A transaction whose read set reaches the helper threshold takes a
+ * slot in which it publishes the number of entries it has logged, every
+ * HV_CHUNK reads.  A single helper thread validates the published
+ * entries of all slots, HV_CHUNK entries at a time, against the clock
+ * read before the first of them, and records in the slot a watermark:
+ * the first idx entries were valid at time ts.  As the clock is a
+ * counter and locks are acquired before the clock is incremented, any
+ * commit with timestamp up to ts was visible when these entries were
+ * checked.  Extensions to a time not greater than ts and commits with a
+ * timestamp not greater than ts + 1 therefore only validate the
+ * remaining entries.  The watermark restarts from the first entry
+ * whenever the clock has changed, hence the helper only saves work when
+ * there are no concurrent commits, e.g., for long reconciliation
+ * transactions running alone.  The owner and the helper take the busy
+ * flag of the slot, respectively, to modify the read set other than by
+ * appending to it (or read the watermark) and to validate a chunk.
+ */
+
+/*
+ * Take busy flag of slot.
+ */
+static INLINE void
+stm_hv_lock(hv_slot_t *s)
+{
+  while (ATOMIC_LOAD(&s->busy) != 0 || ATOMIC_CAS_FULL(&s->busy, 0, 1) == 0)
+    ;
+}
+
+/*
+ * Release busy flag of slot.
+ */
+static INLINE void
+stm_hv_unlock(hv_slot_t *s)
+{
+  ATOMIC_STORE_REL(&s->busy, 0);
+}
+
+/*
+ * Publish the read set of a transaction to the helper (called every
+ * HV_CHUNK reads, once the entries have been logged).
+ */
+static NOINLINE void
+stm_hv_publish(stm_tx_t *tx)
+{
+  hv_slot_t *s;
+  unsigned int i;
+
+  if (tx->hv == NULL) {
+    if (_tinystm.hv_threshold == 0 || tx->r_set.nb_entries < _tinystm.hv_threshold)
+      return;
+    for (i = 0; i < HV_SLOTS; i++) {
+      s = &_tinystm.hv_slots[i];
+      if (ATOMIC_LOAD(&s->tx) != 0)
+        continue;
+      stm_hv_lock(s);
+      if (s->tx == NULL) {
+        s->idx = 0;
+        s->ts = 0;
+        s->nb = tx->r_set.nb_entries;
+        ATOMIC_STORE_REL(&s->tx, tx);
+        stm_hv_unlock(s);
+        tx->hv = s;
+        return;
+      }
+      stm_hv_unlock(s);
+    }
+    /* No free slot: validate alone */
+    return;
+  }
+  ATOMIC_STORE_REL(&tx->hv->nb, tx->r_set.nb_entries);
+}
+
+/*
+ * Release slot (upon commit or abort).
+ */
+static INLINE void
+stm_hv_release(stm_tx_t *tx)
+{
+  if (likely(tx->hv == NULL))
+    return;
+  stm_hv_lock(tx->hv);
+  ATOMIC_STORE(&tx->hv->tx, NULL);
+  stm_hv_unlock(tx->hv);
+  tx->hv = NULL;
+}
+
+/*
+ * Get number of first read set entries known to be valid at time ts.
+ */
+static INLINE unsigned int
+stm_hv_validated(stm_tx_t *tx, stm_word_t ts)
+{
+  unsigned int n;
+
+  if (likely(tx->hv == NULL))
+    return 0;
+  stm_hv_lock(tx->hv);
+  n = (tx->hv->ts >= ts ? (unsigned int)tx->hv->idx : 0);
+  stm_hv_unlock(tx->hv);
+#ifdef TM_STATISTICS
+  tx->stat_hv_skipped += n;
+#endif /* TM_STATISTICS */
+  return n;
+}
+
+/*
+ * Validate the next chunk of published read set entries of a slot (busy
+ * flag held).  Returns 0 if there was nothing to do.
+ */
+static INLINE int
+stm_hv_chunk(hv_slot_t *s)
+{
+  stm_tx_t *tx;
+  r_entry_t *r;
+  w_entry_t *w, *ws;
+  stm_word_t now, l, i, n, first;
+
+  tx = s->tx;
+  if (tx == NULL)
+    return 0;
+  now = GET_CLOCK;
+  if (s->ts != now) {
+    /* Commits since last chunk: restart */
+    s->idx = 0;
+    s->ts = now;
+  }
+  n = ATOMIC_LOAD_ACQ(&s->nb);
+  if (s->idx >= n)
+    return 0;
+  if (n > s->idx + HV_CHUNK)
+    n = s->idx + HV_CHUNK;
+  /* Entries that point to the write set are locked by the transaction itself */
+  ws = tx->w_set.entries;
+  first = s->idx;
+  r = &tx->r_set.entries[first];
+  for (i = first; i < n; i++, r++) {
+    l = ATOMIC_LOAD(r->lock);
+    if (LOCK_GET_OWNED(l)) {
+      w = (w_entry_t *)LOCK_GET_ADDR(l);
+      if (!(ws <= w && w < ws + tx->w_set.size))
+        break;
+    } else if (LOCK_GET_TIMESTAMP(l) != r->version) {
+      break;
+    }
+  }
+  /* Stop at first invalid entry (the transaction will fail to validate) */
+  s->idx = i;
+  return (i > first);
+}
+
+#endif /* _STM_HV_H_ */
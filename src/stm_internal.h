@@ -28,11 +28,18 @@
 
 #include <pthread.h>
 #include <string.h>
+#include <time.h>
 #include <stm.h>
 #include "tls.h"
 #include "utils.h"
 #include "atomic.h"
 #include "gc.h"
+#ifdef NON_TEMPORAL_STORES
+# include <emmintrin.h>
+#endif /* NON_TEMPORAL_STORES */
+#ifdef PROCESS_SHARED
+# include <unistd.h>
+#endif /* PROCESS_SHARED */
 
 /* ################################################################### *
  * DEFINES
@@ -43,6 +50,8 @@
 #define WRITE_BACK_CTL                  1
 #define WRITE_THROUGH                   2
 #define MODULAR                         3
+#define NOREC                           4
+#define RING                            5
 
 #ifndef DESIGN
 # define DESIGN                         WRITE_BACK_ETL
@@ -58,6 +67,20 @@
 # define CM                             CM_SUICIDE
 #endif /* ! CM */
 
+/* Global clock implementations */
+#define CLOCK_COUNTER                   0
+#define CLOCK_GV4                       1
+#define CLOCK_DEFERRED                  2
+#define CLOCK_TSC                       3
+
+#ifndef CLOCK_MODE
+# define CLOCK_MODE                     CLOCK_COUNTER
+#endif /* ! CLOCK_MODE */
+
+#if CLOCK_MODE == CLOCK_TSC && ! defined(__x86_64__)
+# error "CLOCK_TSC requires an x86_64 processor"
+#endif /* CLOCK_MODE == CLOCK_TSC && ! defined(__x86_64__) */
+
 #if DESIGN != WRITE_BACK_ETL && CM == CM_MODULAR
 # error "MODULAR contention manager can only be used with WB-ETL design"
 #endif /* DESIGN != WRITE_BACK_ETL && CM == CM_MODULAR */
@@ -70,13 +93,149 @@
 # error "MODULAR contention manager requires EPOCH_GC"
 #endif /* CM == CM_MODULAR && ! defined(EPOCH_GC) */
 
-#if defined(READ_LOCKED_DATA) && CM != CM_MODULAR
-# error "READ_LOCKED_DATA can only be used with MODULAR contention manager"
-#endif /* defined(READ_LOCKED_DATA) && CM != CM_MODULAR */
+#if defined(READ_LOCKED_DATA) && DESIGN == WRITE_BACK_ETL && CM != CM_MODULAR
+# error "READ_LOCKED_DATA can only be used with MODULAR contention manager for WB-ETL design"
+#endif /* defined(READ_LOCKED_DATA) && DESIGN == WRITE_BACK_ETL && CM != CM_MODULAR */
+
+#if defined(READ_LOCKED_DATA) && DESIGN == MODULAR
+# error "READ_LOCKED_DATA cannot be used with MODULAR design"
+#endif /* defined(READ_LOCKED_DATA) && DESIGN == MODULAR */
+
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL && ! defined(EPOCH_GC)
+# error "READ_LOCKED_DATA requires EPOCH_GC for WB-CTL and WT designs"
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL && ! defined(EPOCH_GC) */
+
+#if defined(SHARED_VISIBLE_READS) && CM != CM_MODULAR
+# error "SHARED_VISIBLE_READS can only be used with MODULAR contention manager"
+#endif /* defined(SHARED_VISIBLE_READS) && CM != CM_MODULAR */
+
+#if defined(EPOCH_GC) && defined(SIGNAL_HANDLER) && ! defined(SANDBOXING)
+# error "SIGNAL_HANDLER can only be used without EPOCH_GC (unless SANDBOXING is enabled)"
+#endif /* defined(EPOCH_GC) && defined(SIGNAL_HANDLER) && ! defined(SANDBOXING) */
+
+#if defined(SANDBOXING) && ! defined(SIGNAL_HANDLER)
+# error "SANDBOXING requires SIGNAL_HANDLER"
+#endif /* defined(SANDBOXING) && ! defined(SIGNAL_HANDLER) */
+
+#if defined(MULTI_VERSION) && ! defined(EPOCH_GC)
+# error "MULTI_VERSION requires EPOCH_GC"
+#endif /* defined(MULTI_VERSION) && ! defined(EPOCH_GC) */
+
+#if defined(MULTI_VERSION) && (CM == CM_MODULAR || defined(HYBRID_HTM))
+# error "MULTI_VERSION cannot be used with MODULAR contention manager or HYBRID_HTM"
+#endif /* defined(MULTI_VERSION) && (CM == CM_MODULAR || defined(HYBRID_HTM)) */
+
+#if defined(MULTI_VERSION) && defined(LOCK_REGIONS)
+# error "MULTI_VERSION cannot be used with LOCK_REGIONS"
+#endif /* defined(MULTI_VERSION) && defined(LOCK_REGIONS) */
+
+#if defined(CLOSED_NESTING) && CM == CM_MODULAR
+# error "CLOSED_NESTING cannot be used with MODULAR contention manager"
+#endif /* defined(CLOSED_NESTING) && CM == CM_MODULAR */
+
+#if defined(WAIT_FUTEX) && CM != CM_DELAY && CM != CM_MODULAR
+# error "WAIT_FUTEX requires DELAY or MODULAR contention manager"
+#endif /* defined(WAIT_FUTEX) && CM != CM_DELAY && CM != CM_MODULAR */
+
+#if defined(WAIT_FUTEX) && ! defined(__linux__)
+# error "WAIT_FUTEX requires Linux"
+#endif /* defined(WAIT_FUTEX) && ! defined(__linux__) */
+
+#if defined(BLOCKING_RETRY) && ! defined(__linux__)
+# error "BLOCKING_RETRY requires Linux"
+#endif /* defined(BLOCKING_RETRY) && ! defined(__linux__) */
+
+#if defined(IRREVOCABLE_IMPROVED) && ! defined(IRREVOCABLE_ENABLED)
+# error "IRREVOCABLE_IMPROVED requires IRREVOCABLE_ENABLED"
+#endif /* defined(IRREVOCABLE_IMPROVED) && ! defined(IRREVOCABLE_ENABLED) */
+
+#if defined(IRREVOCABLE_FALLBACK) && ! defined(IRREVOCABLE_ENABLED)
+# error "IRREVOCABLE_FALLBACK requires IRREVOCABLE_ENABLED"
+#endif /* defined(IRREVOCABLE_FALLBACK) && ! defined(IRREVOCABLE_ENABLED) */
+
+#if defined(IRREVOCABLE_IMPROVED) && DESIGN != WRITE_BACK_ETL && DESIGN != WRITE_THROUGH
+# error "IRREVOCABLE_IMPROVED can only be used with WB-ETL or WT design"
+#endif /* defined(IRREVOCABLE_IMPROVED) && DESIGN != WRITE_BACK_ETL && DESIGN != WRITE_THROUGH */
+
+#if defined(HYBRID_HTM) && ! defined(__x86_64__) && ! defined(__i386__)
+# error "HYBRID_HTM requires an x86 processor"
+#endif /* defined(HYBRID_HTM) && ! defined(__x86_64__) && ! defined(__i386__) */
+
+#if defined(AUTO_TUNE) && (! defined(DYNAMIC_LOCK_ARRAY) || ! defined(TM_STATISTICS))
+# error "AUTO_TUNE requires DYNAMIC_LOCK_ARRAY and TM_STATISTICS"
+#endif /* defined(AUTO_TUNE) && (! defined(DYNAMIC_LOCK_ARRAY) || ! defined(TM_STATISTICS)) */
+
+#if defined(NON_TEMPORAL_STORES) && DESIGN != WRITE_THROUGH
+# error "NON_TEMPORAL_STORES can only be used with WT design"
+#endif /* defined(NON_TEMPORAL_STORES) && DESIGN != WRITE_THROUGH */
+
+#if defined(NON_TEMPORAL_STORES) && ! defined(__x86_64__)
+# error "NON_TEMPORAL_STORES requires x86_64"
+#endif /* defined(NON_TEMPORAL_STORES) && ! defined(__x86_64__) */
+
+#if defined(PROCESS_SHARED) && ! defined(DYNAMIC_LOCK_ARRAY)
+# error "PROCESS_SHARED requires DYNAMIC_LOCK_ARRAY"
+#endif /* defined(PROCESS_SHARED) && ! defined(DYNAMIC_LOCK_ARRAY) */
+
+#if defined(PROCESS_SHARED) && (CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA) || defined(MULTI_VERSION))
+# error "PROCESS_SHARED cannot be used with MODULAR contention manager, CONFLICT_TRACKING, READ_LOCKED_DATA or MULTI_VERSION"
+#endif /* defined(PROCESS_SHARED) && (CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA) || defined(MULTI_VERSION)) */
+
+#if defined(PROCESS_SHARED) && (defined(LOCK_REGIONS) || defined(AUTO_TUNE) || defined(PRIVATIZATION_FENCE) || defined(WAIT_FUTEX) || defined(BLOCKING_RETRY))
+# error "PROCESS_SHARED cannot be used with LOCK_REGIONS, AUTO_TUNE, PRIVATIZATION_FENCE, WAIT_FUTEX or BLOCKING_RETRY"
+#endif /* defined(PROCESS_SHARED) && (defined(LOCK_REGIONS) || defined(AUTO_TUNE) || defined(PRIVATIZATION_FENCE) || defined(WAIT_FUTEX) || defined(BLOCKING_RETRY)) */
+
+#if defined(DURABLE_TX) && (DESIGN != WRITE_BACK_ETL || ! defined(__x86_64__))
+# error "DURABLE_TX can only be used with WB-ETL design on x86_64"
+#endif /* defined(DURABLE_TX) && (DESIGN != WRITE_BACK_ETL || ! defined(__x86_64__)) */
+
+#if defined(DURABLE_TX) && (defined(PROCESS_SHARED) || defined(HYBRID_HTM))
+# error "DURABLE_TX cannot be used with PROCESS_SHARED or HYBRID_HTM"
+#endif /* defined(DURABLE_TX) && (defined(PROCESS_SHARED) || defined(HYBRID_HTM)) */
+
+#if defined(STRIPE_INDEX) && DESIGN != WRITE_BACK_ETL && DESIGN != MODULAR
+# error "STRIPE_INDEX can only be used with WB-ETL or MODULAR design"
+#endif /* defined(STRIPE_INDEX) && DESIGN != WRITE_BACK_ETL && DESIGN != MODULAR */
+
+#if DESIGN == NOREC && CLOCK_MODE != CLOCK_COUNTER
+# error "NOREC design requires CLOCK_COUNTER (the clock is a sequence lock)"
+#endif /* DESIGN == NOREC && CLOCK_MODE != CLOCK_COUNTER */
+
+#if DESIGN == NOREC && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(READ_LOCKED_DATA) || defined(SIMD_VALIDATION))
+# error "NOREC design cannot be used with MULTI_VERSION, HYBRID_HTM, READ_LOCKED_DATA or SIMD_VALIDATION"
+#endif /* DESIGN == NOREC && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(READ_LOCKED_DATA) || defined(SIMD_VALIDATION)) */
+
+#if DESIGN == NOREC && (defined(ELASTIC_TX) || defined(UNIT_TX))
+# error "NOREC design cannot be used with ELASTIC_TX or UNIT_TX"
+#endif /* DESIGN == NOREC && (defined(ELASTIC_TX) || defined(UNIT_TX)) */
+
+#if DESIGN == RING && CLOCK_MODE != CLOCK_COUNTER
+# error "RING design requires CLOCK_COUNTER (the clock is a sequence lock)"
+#endif /* DESIGN == RING && CLOCK_MODE != CLOCK_COUNTER */
 
-#if defined(EPOCH_GC) && defined(SIGNAL_HANDLER)
-# error "SIGNAL_HANDLER can only be used without EPOCH_GC"
-#endif /* defined(EPOCH_GC) && defined(SIGNAL_HANDLER) */
+#if DESIGN == RING && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(READ_LOCKED_DATA) || defined(SIMD_VALIDATION))
+# error "RING design cannot be used with MULTI_VERSION, HYBRID_HTM, READ_LOCKED_DATA or SIMD_VALIDATION"
+#endif /* DESIGN == RING && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(READ_LOCKED_DATA) || defined(SIMD_VALIDATION)) */
+
+#if DESIGN == RING && (defined(ELASTIC_TX) || defined(UNIT_TX) || defined(PROCESS_SHARED))
+# error "RING design cannot be used with ELASTIC_TX, UNIT_TX or PROCESS_SHARED"
+#endif /* DESIGN == RING && (defined(ELASTIC_TX) || defined(UNIT_TX) || defined(PROCESS_SHARED)) */
+
+#if DESIGN == RING && (defined(BLOCKING_RETRY) || defined(READ_SET_FILTER) || defined(NO_DUPLICATES_IN_RW_SETS))
+# error "RING design has no read set (cannot be used with BLOCKING_RETRY, READ_SET_FILTER or NO_DUPLICATES_IN_RW_SETS)"
+#endif /* DESIGN == RING && (defined(BLOCKING_RETRY) || defined(READ_SET_FILTER) || defined(NO_DUPLICATES_IN_RW_SETS)) */
+
+#if defined(OBJECT_LOCKS) && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(ELASTIC_TX) || defined(UNIT_TX))
+# error "OBJECT_LOCKS cannot be used with MULTI_VERSION, HYBRID_HTM, ELASTIC_TX or UNIT_TX"
+#endif /* defined(OBJECT_LOCKS) && (defined(MULTI_VERSION) || defined(HYBRID_HTM) || defined(ELASTIC_TX) || defined(UNIT_TX)) */
+
+#if defined(HELPER_VALIDATION) && (DESIGN != WRITE_BACK_ETL || CLOCK_MODE != CLOCK_COUNTER)
+# error "HELPER_VALIDATION can only be used with WB-ETL design and CLOCK_COUNTER"
+#endif /* defined(HELPER_VALIDATION) && (DESIGN != WRITE_BACK_ETL || CLOCK_MODE != CLOCK_COUNTER) */
+
+#if defined(HELPER_VALIDATION) && (defined(CLOSED_NESTING) || defined(ELASTIC_TX) || defined(HYBRID_HTM) || defined(PROCESS_SHARED))
+# error "HELPER_VALIDATION cannot be used with CLOSED_NESTING, ELASTIC_TX, HYBRID_HTM or PROCESS_SHARED"
+#endif /* defined(HELPER_VALIDATION) && (defined(CLOSED_NESTING) || defined(ELASTIC_TX) || defined(HYBRID_HTM) || defined(PROCESS_SHARED)) */
 
 #define TX_GET                          stm_tx_t *tx = tls_get_tx()
 
@@ -84,6 +243,80 @@
 # define RW_SET_SIZE                    4096                /* Initial size of read/write sets */
 #endif /* ! RW_SET_SIZE */
 
+#ifndef PREFETCH_AHEAD
+# define PREFETCH_AHEAD                 8                   /* Words prefetched ahead by stm_load_n() */
+#endif /* ! PREFETCH_AHEAD */
+
+#ifdef SANDBOXING
+# ifndef SANDBOX_PERIOD
+#  define SANDBOX_PERIOD                64                  /* Reads between validations of inconsistent snapshot */
+# endif /* ! SANDBOX_PERIOD */
+#endif /* SANDBOXING */
+
+#ifdef NON_TEMPORAL_STORES
+# ifndef NT_THRESHOLD
+#  define NT_THRESHOLD                  64                  /* Minimal number of words for non-temporal stores */
+# endif /* ! NT_THRESHOLD */
+#endif /* NON_TEMPORAL_STORES */
+
+#ifdef PROCESS_SHARED
+# ifndef SHM_SLOT_BITS
+#  define SHM_SLOT_BITS                 10                  /* Bits of lock words identifying the owner slot */
+# endif /* ! SHM_SLOT_BITS */
+# define SHM_SLOTS                      (1 << SHM_SLOT_BITS)
+# define SHM_SLOT_MASK                  (SHM_SLOTS - 1)     /* Last slot is never used (LOCK_UNIT) */
+# define SHM_NAME_ENV                   "STM_SHM_NAME"
+# define SHM_NAME_DEFAULT               "/tinystm"
+# define SHM_MAGIC                      0x53544d31UL        /* Set when the segment is initialized */
+# define SHM_WAIT                       10000               /* Milliseconds waited for the creator of the segment */
+#endif /* PROCESS_SHARED */
+
+#ifdef DURABLE_TX
+# ifndef DURABLE_LOG_SIZE
+#  define DURABLE_LOG_SIZE              3072                /* Number of words logged before extending the log */
+# endif /* ! DURABLE_LOG_SIZE */
+# ifndef DURABLE_LOG_SLOTS
+#  define DURABLE_LOG_SLOTS             64                  /* Number of logs (threads) in log file */
+# endif /* ! DURABLE_LOG_SLOTS */
+# define DURABLE_LINE_ENTRIES           3                   /* Log entries per cache line */
+# define DURABLE_LOG_LINES              ((DURABLE_LOG_SIZE + DURABLE_LINE_ENTRIES - 1) / DURABLE_LINE_ENTRIES)
+# define DURABLE_EXT_LINES              1023                /* Lines per extension of a log (64 KB with header) */
+# define DURABLE_LOG_ENV                "STM_DURABLE_LOG"
+# define DURABLE_MAGIC                  0x53544d44UL        /* Set when the log file is initialized */
+#endif /* DURABLE_TX */
+
+#ifdef ADAPTIVE_RW_SETS
+# define RW_HINTS                       16                  /* Sizes of sets recorded per thread (indexed by atomic block) */
+# ifndef RW_SET_TRIM
+#  define RW_SET_TRIM                   256                 /* Transactions with small sets before shrinking */
+# endif /* ! RW_SET_TRIM */
+#endif /* ADAPTIVE_RW_SETS */
+
+#ifdef ADAPTIVE_READ_ONLY
+# define RO_HINTS                       16                  /* Modes recorded per thread (indexed by atomic block) */
+# ifndef RO_THRESHOLD
+#  define RO_THRESHOLD                  8                   /* Commits without writes before starting in read-only mode */
+# endif /* ! RO_THRESHOLD */
+# ifndef RO_VAL_ABORTS
+#  define RO_VAL_ABORTS                 4                   /* Validation aborts before restarting in update mode */
+# endif /* ! RO_VAL_ABORTS */
+#endif /* ADAPTIVE_READ_ONLY */
+
+#if DESIGN == RING
+# ifndef RING_SIZE
+#  define RING_SIZE                     1024                /* Signatures of last commits kept in the ring (power of 2) */
+# endif /* ! RING_SIZE */
+# ifndef RING_SIG_BITS
+#  define RING_SIG_BITS                 1024                /* Size of read and write signatures in bits (power of 2) */
+# endif /* ! RING_SIG_BITS */
+# define RING_SIG_WORDS                 (RING_SIG_BITS / (8 * sizeof(stm_word_t)))
+#endif /* DESIGN == RING */
+
+#ifdef READ_SET_FILTER
+# define RS_FILTER_SIZE                 64                  /* Entries of read set filter (power of 2) */
+# define RS_COMPACT_MIN                 256                 /* Minimal size of read set before compaction */
+#endif /* READ_SET_FILTER */
+
 #ifndef LOCK_ARRAY_LOG_SIZE
 # define LOCK_ARRAY_LOG_SIZE            20                  /* Size of lock array: 2^20 = 1M */
 #endif /* LOCK_ARRAY_LOG_SIZE */
@@ -101,6 +334,150 @@
 # endif /* MAX_BACKOFF */
 #endif /* CM == CM_BACKOFF */
 
+#ifdef USE_BLOOM_FILTER
+# ifndef BLOOM_FILTER_WORDS
+#  define BLOOM_FILTER_WORDS            1                   /* Size of Bloom filter (power of 2) */
+# endif /* BLOOM_FILTER_WORDS */
+#endif /* USE_BLOOM_FILTER */
+
+#ifdef WRITE_SET_HASH
+# ifndef WS_HASH_THRESHOLD
+#  define WS_HASH_THRESHOLD             32                  /* Writes before indexing write set */
+# endif /* WS_HASH_THRESHOLD */
+#endif /* WRITE_SET_HASH */
+
+#ifdef STRIPE_INDEX
+# ifndef STRIPE_SLOTS
+#  define STRIPE_SLOTS                  4                   /* Words indexed per lock (power of 2) */
+# endif /* STRIPE_SLOTS */
+# if STRIPE_SLOTS <= 0 || (STRIPE_SLOTS & (STRIPE_SLOTS - 1)) != 0
+#  error "STRIPE_SLOTS must be a power of 2"
+# endif
+#endif /* STRIPE_INDEX */
+
+#ifdef SORTED_COMMIT
+# ifndef WS_SORT_THRESHOLD
+#  define WS_SORT_THRESHOLD             64                  /* Write set entries before committing in lock order */
+# endif /* ! WS_SORT_THRESHOLD */
+#endif /* SORTED_COMMIT */
+
+#ifdef MULTI_VERSION
+# ifndef MV_HISTORY_SIZE
+#  define MV_HISTORY_SIZE               8                   /* Old versions kept per lock */
+# endif /* MV_HISTORY_SIZE */
+# define MV_SPIN_MAX                    (1UL << 16)         /* Wait for owned locks before aborting */
+#endif /* MULTI_VERSION */
+
+#ifdef CLOSED_NESTING
+# ifndef MAX_NESTED
+#  define MAX_NESTED                    8                   /* Closed nested transactions (deeper ones are flattened) */
+# endif /* MAX_NESTED */
+# define NESTED_UNDO_SIZE               64                  /* Initial size of undo log for outer write set entries */
+#endif /* CLOSED_NESTING */
+
+#ifdef ADAPTIVE_SCHEDULING
+# define ATS_THRESHOLD                  "ATS_THRESHOLD"
+# ifndef ATS_THRESHOLD_DEFAULT
+#  define ATS_THRESHOLD_DEFAULT         50                  /* Contention intensity (percent) above which transactions are serialized */
+# endif /* ATS_THRESHOLD_DEFAULT */
+# ifndef ATS_WEIGHT_SHIFT
+#  define ATS_WEIGHT_SHIFT              2                   /* Weight of last outcome in contention intensity: 1/2^2 */
+# endif /* ATS_WEIGHT_SHIFT */
+# define ATS_QUEUES                     64                  /* Scheduling queues (indexed by transaction id) */
+# define ATS_ONE                        (1 << 16)           /* Maximal contention intensity (fixed point) */
+#endif /* ADAPTIVE_SCHEDULING */
+
+#ifdef PRIVATIZATION_FENCE
+# ifndef FENCE_MAX_THREADS
+#  define FENCE_MAX_THREADS             256                 /* Maximal number of threads using fences */
+# endif /* FENCE_MAX_THREADS */
+#endif /* PRIVATIZATION_FENCE */
+
+#ifdef WAIT_FUTEX
+# ifndef FUTEX_SPIN
+#  define FUTEX_SPIN                    1024                /* Spin iterations before sleeping on contended lock */
+# endif /* FUTEX_SPIN */
+# define FUTEX_SLOTS                    256                 /* Futexes (indexed by hash of lock address) */
+# define FUTEX_TIMEOUT                  1000000             /* Maximal sleep duration (in ns) */
+#endif /* WAIT_FUTEX */
+
+#ifdef BLOCKING_RETRY
+# define RETRY_SLOTS                    256                 /* Sleepers (indexed by hash of lock address) */
+# define RETRY_TIMEOUT                  10000000            /* Maximal sleep duration (in ns) */
+#endif /* BLOCKING_RETRY */
+
+#ifdef SIMD_VALIDATION
+# if !defined(__x86_64__)
+#  error SIMD_VALIDATION requires x86_64
+# endif /* !defined(__x86_64__) */
+# define SIMD_NONE                      0
+# define SIMD_AVX2                      1
+# define SIMD_AVX512                    2
+#endif /* SIMD_VALIDATION */
+
+#ifdef HYBRID_HTM
+# define HTM_RETRIES                    "HTM_RETRIES"
+# ifndef HTM_RETRIES_DEFAULT
+#  define HTM_RETRIES_DEFAULT           4                   /* Hardware attempts before falling back to software */
+# endif /* HTM_RETRIES_DEFAULT */
+/* Hardware abort reasons (statistics) */
+# define HTM_STAT_CONFLICT              0
+# define HTM_STAT_CAPACITY              1
+# define HTM_STAT_LOCKED                2
+# define HTM_STAT_EXPLICIT              3
+# define HTM_STAT_OTHER                 4
+# define HTM_STAT_NB                    5
+#endif /* HYBRID_HTM */
+
+#if DESIGN == MODULAR
+# define DESIGN_ENV                     "STM_DESIGN"
+#endif /* DESIGN == MODULAR */
+
+#ifdef ELASTIC_TX
+# define ELASTIC_WINDOW                 "ELASTIC_WINDOW"
+# ifndef ELASTIC_WINDOW_DEFAULT
+#  define ELASTIC_WINDOW_DEFAULT        4                   /* Minimal number of last reads validated by elastic transactions */
+# endif /* ELASTIC_WINDOW_DEFAULT */
+#endif /* ELASTIC_TX */
+
+#ifdef IRREVOCABLE_FALLBACK
+# define IRREVOCABLE_RETRIES            "IRREVOCABLE_RETRIES"
+# ifndef IRREVOCABLE_RETRIES_DEFAULT
+#  define IRREVOCABLE_RETRIES_DEFAULT   32                  /* Consecutive aborts before becoming irrevocable (0 means no limit) */
+# endif /* IRREVOCABLE_RETRIES_DEFAULT */
+# define IRREVOCABLE_CYCLES             "IRREVOCABLE_CYCLES"
+# ifndef IRREVOCABLE_CYCLES_DEFAULT
+#  define IRREVOCABLE_CYCLES_DEFAULT    0                   /* Cycles of aborted attempts before becoming irrevocable (0 means no limit) */
+# endif /* IRREVOCABLE_CYCLES_DEFAULT */
+# define IRREVOCABLE_SERIAL             "IRREVOCABLE_SERIAL"
+# define FALLBACK_IDS                   64                  /* Atomic blocks with their own policy (power of 2) */
+#endif /* IRREVOCABLE_FALLBACK */
+
+#ifdef TM_STATISTICS2
+# define STATS_SAMPLING                 "STATS_SAMPLING"
+# ifndef STATS_SAMPLING_DEFAULT
+#  define STATS_SAMPLING_DEFAULT        64                  /* One in how many transactions are profiled (0 means none) */
+# endif /* STATS_SAMPLING_DEFAULT */
+/* Phases of transactions whose cycles are sampled */
+enum {
+  PROF_OTHER,                           /* Outside of barriers (application code) */
+  PROF_READ,                            /* Read barriers */
+  PROF_WRITE,                           /* Write barriers */
+  PROF_VALIDATE,                        /* Validation and snapshot extension */
+  PROF_COMMIT,                          /* Commit */
+  PROF_ROLLBACK,                        /* Rollback */
+  PROF_WAIT,                            /* Contention manager (backoff or wait after abort) */
+  PROF_NB
+};
+#endif /* TM_STATISTICS2 */
+
+#define PRIO_LEVELS                     STM_PRIO_LEVELS     /* Priorities of transactions (attr.priority) */
+#if CM == CM_MODULAR
+# ifndef PRIO_AGING
+#  define PRIO_AGING                    4                   /* Consecutive aborts that raise priority by one level (0 means no aging) */
+# endif /* ! PRIO_AGING */
+#endif /* CM == CM_MODULAR */
+
 #if CM == CM_MODULAR
 # define VR_THRESHOLD                   "VR_THRESHOLD"
 # ifndef VR_THRESHOLD_DEFAULT
@@ -108,6 +485,39 @@
 # endif /* VR_THRESHOLD_DEFAULT */
 #endif /* CM == CM_MODULAR */
 
+#ifdef SHARED_VISIBLE_READS
+# define VR_SLOTS                       1024                /* Reader indicators (indexed by hash of lock address) */
+# define VR_WAIT                        1024                /* Maximal number of yields of writers waiting for readers */
+# define VR_BACKOFF_LOG                 8                   /* Log2 of maximal number of yields after giving up */
+# define VR_SLOT_IDX(lock)              (((stm_word_t)(lock) / sizeof(stm_word_t)) & (VR_SLOTS - 1))
+#endif /* SHARED_VISIBLE_READS */
+
+#ifdef DYNAMIC_LOCK_ARRAY
+# define LOCK_ARRAY_LOG_SIZE_ENV        "LOCK_ARRAY_LOG_SIZE"
+# define LOCK_SHIFT_EXTRA_ENV           "LOCK_SHIFT_EXTRA"
+# define LOCK_SHIFT_EXTRA_MAX           12                  /* Locks cover at most 2^12 words */
+# define LOCK_ARRAY_INTERLEAVE          "LOCK_ARRAY_INTERLEAVE"
+# define LOCK_ARRAY_HUGE_PAGE           (2UL * 1024 * 1024)  /* Minimal size for huge pages */
+#endif /* DYNAMIC_LOCK_ARRAY */
+
+#ifdef AUTO_TUNE
+# define TUNE_ENV                       "STM_TUNE"          /* Sampling period of the tuner (milliseconds) */
+# define TUNE_LOG_RANGE                 4                   /* Sizes of lock array explored around the initial one (log2) */
+# define TUNE_SHIFT_EXTRA_MAX           6                   /* Largest LOCK_SHIFT_EXTRA explored */
+# define TUNE_GAIN                      5                   /* Improvement (percent) required to keep a change */
+# define TUNE_DRIFT                     25                  /* Change of throughput (percent) that restarts tuning */
+#endif /* AUTO_TUNE */
+
+#ifdef HELPER_VALIDATION
+# define HELPER_THRESHOLD               "HELPER_THRESHOLD"
+# ifndef HELPER_THRESHOLD_DEFAULT
+#  define HELPER_THRESHOLD_DEFAULT      16384               /* Read set entries before validation by helper (0 means never) */
+# endif /* HELPER_THRESHOLD_DEFAULT */
+# define HV_SLOTS                       64                  /* Transactions validated concurrently by helper */
+# define HV_CHUNK                       1024                /* Entries published or validated at once (power of 2) */
+# define HV_IDLE                        100000              /* Sleep duration of idle helper (in ns) */
+#endif /* HELPER_VALIDATION */
+
 #define NO_SIGNAL_HANDLER               "NO_SIGNAL_HANDLER"
 
 #if defined(CTX_LONGJMP)
@@ -117,10 +527,28 @@
 /* TODO adjust size to real size. */
 # define JMP_BUF                        jmp_buf
 # define LONGJMP(ctx, value)            CTX_ITM(value, ctx)
-#else /* !CTX_LONGJMP && !CTX_ITM */
+#elif defined(CTX_CHECKPOINT)
+/* Environments filled by stm_start_ckpt() (arch.S) are marked in their
+ * last word (part of the signal mask, not written by sigsetjmp(env, 0)) */
+# define JMP_BUF                        sigjmp_buf
+# if defined(__x86_64__)
+#  define CTX_CKPT_SIZE                 (8 * 8)
+# elif defined(__aarch64__)
+#  define CTX_CKPT_SIZE                 (21 * 8)
+# endif /* defined(__aarch64__) */
+# define CTX_CKPT_MAGIC                 ((stm_word_t)0x54504b4350544d53UL)
+# define CTX_CKPT_MARK(ctx)             (*(stm_word_t *)((char *)(ctx) + sizeof(sigjmp_buf) - sizeof(stm_word_t)))
+# define LONGJMP(ctx, value) \
+  do { \
+    if (CTX_CKPT_MARK(ctx) == CTX_CKPT_MAGIC) \
+      stm_ckpt_restore(ctx, value); \
+    siglongjmp(ctx, value); \
+  } while (0)
+extern void stm_ckpt_restore(sigjmp_buf ctx, int value) __attribute__((noreturn));
+#else /* !CTX_LONGJMP && !CTX_ITM && !CTX_CHECKPOINT */
 # define JMP_BUF                        sigjmp_buf
 # define LONGJMP(ctx, value)            siglongjmp(ctx, value)
-#endif /* !CTX_LONGJMP && !CTX_ITM */
+#endif /* !CTX_LONGJMP && !CTX_ITM && !CTX_CHECKPOINT */
 
 
 /* ################################################################### *
@@ -195,8 +623,14 @@ enum {                                  /* Transaction status */
 
 #define LOCK_GET_OWNED(l)               (l & OWNED_MASK)
 #define LOCK_GET_WRITE(l)               (l & WRITE_MASK)
-#define LOCK_SET_ADDR_WRITE(a)          (a | WRITE_MASK)    /* WRITE bit set */
-#define LOCK_GET_ADDR(l)                (l & ~(stm_word_t)OWNED_MASK)
+#ifdef PROCESS_SHARED
+/* Index of entry in write set and slot of owner ("tx" must be the owner) */
+# define LOCK_SET_ADDR_WRITE(a)         (((((stm_word_t)((w_entry_t *)(a) - tx->w_set.entries) << SHM_SLOT_BITS) | tx->shm_slot) << OWNED_BITS) | WRITE_MASK)
+# define LOCK_GET_ADDR(l)               ((stm_word_t)lock_get_entry(l))
+#else /* ! PROCESS_SHARED */
+# define LOCK_SET_ADDR_WRITE(a)         (a | WRITE_MASK)    /* WRITE bit set */
+# define LOCK_GET_ADDR(l)               (l & ~(stm_word_t)OWNED_MASK)
+#endif /* ! PROCESS_SHARED */
 #if CM == CM_MODULAR
 # define LOCK_GET_READ(l)               (l & READ_MASK)
 # define LOCK_SET_ADDR_READ(a)          (a | READ_MASK)     /* READ bit set */
@@ -213,87 +647,215 @@ enum {                                  /* Transaction status */
 
 /*
  * We use the very same hash functions as TL2 for degenerate Bloom
- * filters on 32 bits.
+ * filters on 32 bits (the next bits select the word of larger filters).
  */
 #ifdef USE_BLOOM_FILTER
 # define FILTER_HASH(a)                 (((stm_word_t)a >> 2) ^ ((stm_word_t)a >> 5))
 # define FILTER_BITS(a)                 (1 << (FILTER_HASH(a) & 0x1F))
+# define FILTER_WORD(a)                 ((FILTER_HASH(a) >> 5) & (BLOOM_FILTER_WORDS - 1))
 #endif /* USE_BLOOM_FILTER */
 
+/*
+ * Multiplicative hash for the write set index (the multiplier is odd,
+ * hence consecutive words never collide).
+ */
+#ifdef WRITE_SET_HASH
+# define WS_HASH_SHIFT                  ((sizeof(stm_word_t) == 4) ? 2 : 3)
+# define WS_HASH(a)                     ((unsigned int)((stm_word_t)a >> WS_HASH_SHIFT) * 2654435761U)
+#endif /* WRITE_SET_HASH */
+
 /*
  * We use an array of locks and hash the address to find the location of the lock.
  * We try to avoid collisions as much as possible (two addresses covered by the same lock).
  */
-#define LOCK_ARRAY_SIZE                 (1 << LOCK_ARRAY_LOG_SIZE)
-#define LOCK_MASK                       (LOCK_ARRAY_SIZE - 1)
-#define LOCK_SHIFT                      (((sizeof(stm_word_t) == 4) ? 2 : 3) + LOCK_SHIFT_EXTRA)
+#ifdef DYNAMIC_LOCK_ARRAY
+/* Size chosen in stm_init() (LOCK_ARRAY_LOG_SIZE is the default) */
+# define LOCK_ARRAY_SIZE                (_tinystm.lock_mask + 1)
+# define LOCK_MASK                      (_tinystm.lock_mask)
+# define LOCK_SHIFT                     (_tinystm.lock_shift)
+# ifdef AUTO_TUNE
+/* The tuner changes the size within the mapped array */
+#  define LOCK_ARRAY_MAP_SIZE           ((stm_word_t)1 << _tinystm.tune_log_max)
+# else /* ! AUTO_TUNE */
+#  define LOCK_ARRAY_MAP_SIZE           LOCK_ARRAY_SIZE
+# endif /* ! AUTO_TUNE */
+#else /* ! DYNAMIC_LOCK_ARRAY */
+# define LOCK_ARRAY_SIZE                (1 << LOCK_ARRAY_LOG_SIZE)
+# define LOCK_ARRAY_MAP_SIZE            LOCK_ARRAY_SIZE
+# define LOCK_MASK                      (LOCK_ARRAY_SIZE - 1)
+# define LOCK_SHIFT                     (LOCK_SHIFT_WORD + LOCK_SHIFT_EXTRA)
+#endif /* ! DYNAMIC_LOCK_ARRAY */
+#define LOCK_SHIFT_WORD                 ((sizeof(stm_word_t) == 4) ? 2 : 3)
 #define LOCK_IDX(a)                     (((stm_word_t)(a) >> LOCK_SHIFT) & LOCK_MASK)
 #ifdef LOCK_IDX_SWAP
 # if LOCK_ARRAY_LOG_SIZE < 16
 #  error "LOCK_IDX_SWAP requires LOCK_ARRAY_LOG_SIZE to be at least 16"
 # endif /* LOCK_ARRAY_LOG_SIZE < 16 */
-# define GET_LOCK(a)                    (_tinystm.locks + lock_idx_swap(LOCK_IDX(a)))
+# define GET_GLOBAL_LOCK(a)             (_tinystm.locks + lock_idx_swap(LOCK_IDX(a)))
 #else /* ! LOCK_IDX_SWAP */
-# define GET_LOCK(a)                    (_tinystm.locks + LOCK_IDX(a))
+# define GET_GLOBAL_LOCK(a)             (_tinystm.locks + LOCK_IDX(a))
 #endif /* ! LOCK_IDX_SWAP */
+#ifdef LOCK_REGIONS
+/* Registered regions have their own lock table */
+# define GET_ADDR_LOCK(a)               stm_get_lock((stm_word_t)(a))
+#else /* ! LOCK_REGIONS */
+# define GET_ADDR_LOCK(a)               GET_GLOBAL_LOCK(a)
+#endif /* ! LOCK_REGIONS */
+#ifdef OBJECT_LOCKS
+/* Object barriers set the lock of the object (in the word preceding it) */
+# define OBJ_LOCK(obj)                  ((volatile stm_word_t *)(obj) - 1)
+# define GET_LOCK(a)                    (unlikely(tx->obj_lock != NULL) ? tx->obj_lock : GET_ADDR_LOCK(a))
+#else /* ! OBJECT_LOCKS */
+# define GET_LOCK(a)                    GET_ADDR_LOCK(a)
+#endif /* ! OBJECT_LOCKS */
+/* Inlined loads of stm_inline.h (only if the read path is that of the fast path) */
+#if (DESIGN == WRITE_BACK_ETL || DESIGN == WRITE_THROUGH || DESIGN == MODULAR) && CM != CM_MODULAR && !defined(NO_DUPLICATES_IN_RW_SETS) && !defined(READ_SET_FILTER) && !defined(LOCK_REGIONS) && !defined(LOCK_IDX_SWAP) && !defined(SANDBOXING) && !defined(TM_STATISTICS2)
+# define INLINE_FAST_PATH
+#endif /* (DESIGN == WRITE_BACK_ETL || DESIGN == WRITE_THROUGH || DESIGN == MODULAR) && CM != CM_MODULAR && !defined(NO_DUPLICATES_IN_RW_SETS) && !defined(READ_SET_FILTER) && !defined(LOCK_REGIONS) && !defined(LOCK_IDX_SWAP) && !defined(SANDBOXING) && !defined(TM_STATISTICS2) */
+/* Record location of conflict before aborting (for abort callbacks) */
+#define SET_CONFLICT(tx, a, l)          ((tx)->conflict_addr = (void *)(a), (tx)->conflict_lock = (l))
 
 /* ################################################################### *
  * CLOCK
  * ################################################################### */
 
 /* At least twice a cache line (not required if properly aligned and padded) */
-#define CLOCK                           (_tinystm.gclock[(CACHELINE_SIZE * 2) / sizeof(stm_word_t)])
+#ifdef PROCESS_SHARED
+# define CLOCK                          (_tinystm.shm->gclock[(CACHELINE_SIZE * 2) / sizeof(stm_word_t)])
+#else /* ! PROCESS_SHARED */
+# define CLOCK                          (_tinystm.gclock[(CACHELINE_SIZE * 2) / sizeof(stm_word_t)])
+#endif /* ! PROCESS_SHARED */
+
+#ifdef IRREVOCABLE_ENABLED
+# ifdef PROCESS_SHARED
+#  define IRREVOCABLE_FLAG              (_tinystm.shm->irrevocable)
+# else /* ! PROCESS_SHARED */
+#  define IRREVOCABLE_FLAG              (_tinystm.irrevocable)
+# endif /* ! PROCESS_SHARED */
+#endif /* IRREVOCABLE_ENABLED */
+
+#if CLOCK_MODE == CLOCK_TSC
+/*
+ * Read the (invariant and synchronized) time stamp counter.  Timestamps
+ * never overflow VERSION_MAX in practice (60 bits on 64-bit CPUs).
+ */
+static INLINE stm_word_t
+clock_tsc(void)
+{
+  uint32_t lo, hi;
+  /* rdtscp waits for previous instructions, lfence prevents later loads
+   * from being executed before reading the counter */
+  __asm__ __volatile__ ("rdtscp; lfence" : "=a" (lo), "=d" (hi) : : "ecx", "memory");
+  return (((stm_word_t)hi) << 32) | lo;
+}
+
+# define GET_CLOCK                      (clock_tsc())
+# define FETCH_INC_CLOCK                (clock_tsc())
+#else /* CLOCK_MODE != CLOCK_TSC */
+# define GET_CLOCK                      (ATOMIC_LOAD_ACQ(&CLOCK))
+# define FETCH_INC_CLOCK                (ATOMIC_FETCH_INC_FULL(&CLOCK))
+#endif /* CLOCK_MODE != CLOCK_TSC */
 
-#define GET_CLOCK                       (ATOMIC_LOAD_ACQ(&CLOCK))
-#define FETCH_INC_CLOCK                 (ATOMIC_FETCH_INC_FULL(&CLOCK))
+/*
+ * Read cycle counter for measurements (nanoseconds if not on x86).
+ */
+static INLINE uint64_t
+stm_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (((uint64_t)hi) << 32) | lo;
+#else /* !defined(__x86_64__) && !defined(__i386__) */
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif /* !defined(__x86_64__) && !defined(__i386__) */
+}
 
 /* ################################################################### *
  * CALLBACKS
  * ################################################################### */
 
-/* The number of 7 is chosen to make fit the number and the array in a
- * same cacheline (assuming 64bytes cacheline and 64bits CPU). */
-#define MAX_CB                          7
-
-/* Declare as static arrays (vs. lists) to improve cache locality */
-/* The number transaction local specific for modules. */
+/* The number of transaction-specific slots for modules kept in the
+ * descriptor (static array to improve cache locality).  Other slots are
+ * kept in an array allocated on demand. */
 #ifndef MAX_SPECIFIC
 # define MAX_SPECIFIC                   7
 #endif /* MAX_SPECIFIC */
 
+/* The number of memory regions with their own lock table. */
+#ifdef LOCK_REGIONS
+# ifndef MAX_REGIONS
+#  define MAX_REGIONS                   8
+# endif /* MAX_REGIONS */
+#endif /* LOCK_REGIONS */
+
 
 typedef struct r_entry {                /* Read set entry */
-  stm_word_t version;                   /* Version read */
-  volatile stm_word_t *lock;            /* Pointer to lock (for fast access) */
+  stm_word_t version;                   /* Version read (NOREC: value read) */
+  volatile stm_word_t *lock;            /* Pointer to lock (NOREC: address read) */
 } r_entry_t;
 
 typedef struct r_set {                  /* Read set */
   r_entry_t *entries;                   /* Array of entries */
   unsigned int nb_entries;              /* Number of entries */
   unsigned int size;                    /* Size of array */
+#ifdef READ_SET_FILTER
+  unsigned int compact_at;              /* Number of entries that triggers compaction */
+#endif /* READ_SET_FILTER */
 } r_set_t;
 
 typedef struct w_entry {                /* Write set entry */
+#ifndef COMPACT_WRITE_SET
   union {                               /* For padding... */
     struct {
+#endif /* ! COMPACT_WRITE_SET */
       volatile stm_word_t *addr;        /* Address written */
       stm_word_t value;                 /* New (write-back) or old (write-through) value */
       stm_word_t mask;                  /* Write mask */
       stm_word_t version;               /* Version overwritten */
       volatile stm_word_t *lock;        /* Pointer to lock (for fast access) */
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA)
       struct stm_tx *tx;                /* Transaction owning the write set */
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA) */
       union {
         struct w_entry *next;           /* WRITE_BACK_ETL || WRITE_THROUGH: Next address covered by same lock (if any) */
         stm_word_t no_drop;             /* WRITE_BACK_CTL: Should we drop lock upon abort? */
       };
+#ifdef STRIPE_INDEX
+      unsigned short slots[STRIPE_SLOTS]; /* WRITE_BACK_ETL, first entry of a lock: entries by word offset */
+      unsigned short last;              /* WRITE_BACK_ETL, first entry of a lock: last entry of the list */
+#endif /* STRIPE_INDEX */
+#ifndef COMPACT_WRITE_SET
     };
     char padding[CACHELINE_SIZE];       /* Padding (multiple of a cache line) */
     /* Note padding is not useful here as long as the address can be defined in the lock scheme. */
   };
+#endif /* ! COMPACT_WRITE_SET */
 } w_entry_t;
 
+#ifdef MULTI_VERSION
+typedef struct mv_entry {               /* Old version of a memory word */
+  volatile stm_word_t *addr;            /* Address overwritten */
+  stm_word_t value;                     /* Value overwritten */
+  stm_word_t end;                       /* Timestamp of overwrite (end of validity) */
+  struct mv_entry *next;                /* Next (older) version covered by same lock */
+} mv_entry_t;
+
+typedef struct mv_history {             /* Old versions covered by a lock */
+  mv_entry_t *head;                     /* Most recent version */
+  stm_word_t low;                       /* Most recent timestamp dropped from history */
+} mv_history_t;
+#endif /* MULTI_VERSION */
+
+#ifdef WRITE_SET_HASH
+typedef struct ws_hash_entry {          /* Write set index entry */
+  unsigned int gen;                     /* Generation (valid if same as index) */
+  unsigned int idx;                     /* Position in write set */
+} ws_hash_entry_t;
+#endif /* WRITE_SET_HASH */
+
 typedef struct w_set {                  /* Write set */
   w_entry_t *entries;                   /* Array of entries */
   unsigned int nb_entries;              /* Number of entries */
@@ -302,33 +864,221 @@ typedef struct w_set {                  /* Write set */
     unsigned int has_writes;            /* WRITE_BACK_ETL: Has the write set any real write (vs. visible reads) */
     unsigned int nb_acquired;           /* WRITE_BACK_CTL: Number of locks acquired */
   };
+  unsigned int last;                    /* WRITE_BACK_CTL: Entry of last write (checked first by lookups) */
 #ifdef USE_BLOOM_FILTER
-  stm_word_t bloom;                     /* WRITE_BACK_CTL: Same Bloom filter as in TL2 */
+  stm_word_t bloom[BLOOM_FILTER_WORDS]; /* WRITE_BACK_CTL: Same Bloom filter as in TL2 */
 #endif /* USE_BLOOM_FILTER */
+#ifdef WRITE_SET_HASH
+  ws_hash_entry_t *hash;                /* WRITE_BACK_CTL: Index (allocated lazily) */
+  unsigned int hash_size;               /* Number of buckets (twice the size of array) */
+  unsigned int hash_gen;                /* Current generation of index */
+  unsigned int nb_indexed;              /* Number of entries in index */
+#endif /* WRITE_SET_HASH */
+#ifdef SORTED_COMMIT
+  struct w_entry **sorted;              /* WRITE_BACK_ETL || WRITE_BACK_CTL: Entries in lock order (allocated lazily) */
+  unsigned int sorted_size;             /* Size of array */
+#endif /* SORTED_COMMIT */
 } w_set_t;
 
+#ifdef ADAPTIVE_RW_SETS
+typedef struct rw_hint {                /* Sizes of sets needed by an atomic block */
+  unsigned int r_size;                  /* Size of read set */
+  unsigned int w_size;                  /* Size of write set */
+  unsigned int r_small;                 /* Consecutive commits using at most a quarter of r_size */
+  unsigned int w_small;                 /* Consecutive commits using at most a quarter of w_size */
+} rw_hint_t;
+#endif /* ADAPTIVE_RW_SETS */
+
+#ifdef IRREVOCABLE_FALLBACK
+typedef struct fallback {               /* Policy of an atomic block for becoming irrevocable */
+  unsigned int retries;                 /* Consecutive aborts (0 means no limit) */
+  unsigned long cycles;                 /* Cycles spent in aborted attempts (0 means no limit) */
+  int serial;                           /* Use serial irrevocable mode? */
+  int set;                              /* Has the policy been set for the block? */
+} fallback_t;
+#endif /* IRREVOCABLE_FALLBACK */
+
 typedef struct cb_entry {               /* Callback entry */
   void (*f)(void *);                    /* Function */
   void *arg;                            /* Argument to be passed to function */
+  stm_word_t module;                    /* Bit of the module in cb_disabled (0 if none) */
 } cb_entry_t;
 
+typedef struct param_cb_entry {         /* Parameter callback entry */
+  int (*f)(const char *, void *, void *); /* Function */
+  void *arg;                            /* Argument to be passed to function */
+} param_cb_entry_t;
+
+typedef struct event_cb_entry {         /* Event callback entry */
+  void (*f)(int, void *);               /* Function */
+  void *arg;                            /* Argument to be passed to function */
+} event_cb_entry_t;
+
+/*
+ * Callbacks of a phase.  Chains are never modified once published:
+ * registration builds a new chain with one more entry and installs it
+ * atomically, hence callbacks can be registered while transactions run.
+ * Phases without callbacks have no chain.  Older chains might still be
+ * in use by other threads and are kept until the process exits.
+ */
+typedef struct cb_chain {
+  unsigned int nb;                      /* Number of entries */
+  struct cb_chain *prev;                /* Chain replaced by this one */
+  union {
+    cb_entry_t cb[1];
+    param_cb_entry_t param[1];
+    event_cb_entry_t event[1];
+  } e;                                  /* Entries (allocated with the chain) */
+} cb_chain_t;
+
+typedef struct specific_ext {           /* Specific slots beyond MAX_SPECIFIC */
+  unsigned int size;                    /* Number of slots */
+  struct specific_ext *prev;            /* Array replaced by this one (might still be read by other threads) */
+  void *data[1];                        /* Slots (allocated with the array) */
+} specific_ext_t;
+
+#ifdef CLOSED_NESTING
+typedef struct nested_undo {            /* Outer write set entry modified by nested transaction */
+  unsigned int idx;                     /* Position in write set */
+  stm_word_t value;                     /* Previous value of entry */
+  stm_word_t mask;                      /* Previous mask of entry */
+  volatile stm_word_t *addr;            /* WRITE_THROUGH: address overwritten in memory (or NULL) */
+  stm_word_t data;                      /* WRITE_THROUGH: previous value in memory */
+} nested_undo_t;
+
+typedef struct nested {                 /* Closed nested transaction or savepoint */
+  JMP_BUF env;                          /* Environment for setjmp/longjmp */
+  unsigned int nesting;                 /* Nesting level */
+  int savepoint;                        /* Is it a savepoint? */
+  unsigned int r_nb;                    /* Size of read set upon start */
+  unsigned int w_nb;                    /* Size of write set upon start */
+  unsigned int has_writes;              /* WRITE_BACK_ETL: Number of writes upon start */
+  unsigned int u_nb;                    /* Size of undo log upon start */
+# ifdef USE_BLOOM_FILTER
+  stm_word_t bloom[BLOOM_FILTER_WORDS]; /* WRITE_BACK_CTL: Bloom filter upon start */
+# endif /* USE_BLOOM_FILTER */
+} nested_t;
+#endif /* CLOSED_NESTING */
+
+#if DESIGN == RING
+typedef struct ring_entry {             /* Write signature of a commit */
+  volatile stm_word_t ts;               /* Commit time (0 while being published) */
+  volatile stm_word_t sig[RING_SIG_WORDS]; /* Bloom filter of addresses written */
+} ring_entry_t;
+#endif /* DESIGN == RING */
+
+#ifdef ADAPTIVE_SCHEDULING
+typedef union ats_queue {               /* Scheduling queue of atomic block */
+  struct {
+    volatile stm_word_t intensity;      /* Contention intensity of atomic block */
+    volatile stm_word_t next;           /* Next ticket */
+    volatile stm_word_t serving;        /* Ticket being served */
+  };
+  char padding[CACHELINE_SIZE];         /* Padding (multiple of a cache line) */
+} ats_queue_t;
+#endif /* ADAPTIVE_SCHEDULING */
+
+#ifdef PRIVATIZATION_FENCE
+typedef union fence_slot {              /* Epoch of thread for privatization fences */
+  struct {
+    volatile stm_word_t epoch;          /* Odd while executing a transaction */
+    int used;                           /* Is the slot allocated to a thread? */
+  };
+  char padding[CACHELINE_SIZE];         /* Padding (multiple of a cache line) */
+} fence_slot_t;
+#endif /* PRIVATIZATION_FENCE */
+
+#ifdef HELPER_VALIDATION
+typedef union hv_slot {                 /* Read set validated by helper thread */
+  struct {
+    struct stm_tx *volatile tx;         /* Transaction (NULL if slot is free) */
+    volatile stm_word_t busy;           /* Held while read set or watermark is accessed */
+    volatile stm_word_t nb;             /* Number of entries published by transaction */
+    volatile stm_word_t idx;            /* Number of first entries validated... */
+    volatile stm_word_t ts;             /* ...at this time */
+  };
+  char padding[CACHELINE_SIZE];         /* Padding (multiple of a cache line) */
+} hv_slot_t;
+#endif /* HELPER_VALIDATION */
+
+#ifdef WAIT_FUTEX
+typedef struct futex_slot {             /* Futex for threads waiting on locks */
+  volatile stm_word_t seq;              /* Sequence number (incremented to wake up waiters) */
+  volatile stm_word_t waiters;          /* Number of sleeping threads */
+} futex_slot_t;
+#endif /* WAIT_FUTEX */
+
+#ifdef SHARED_VISIBLE_READS
+typedef union vr_slot {                 /* Reader indicator */
+  volatile stm_word_t readers;          /* Number of transactions reading locks of the slot */
+  char padding[CACHELINE_SIZE];         /* Padding (multiple of a cache line) */
+} vr_slot_t;
+#endif /* SHARED_VISIBLE_READS */
+
 typedef struct stm_tx {                 /* Transaction descriptor */
   JMP_BUF env;                          /* Environment for setjmp/longjmp */
   stm_tx_attr_t attr;                   /* Transaction attributes (user-specified) */
+#if DESIGN == MODULAR
+  const struct stm_design *design;      /* Design of current transaction */
+#endif /* DESIGN == MODULAR */
   volatile stm_word_t status;           /* Transaction status */
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL
+  volatile stm_word_t lock_seq;         /* Odd while committing or rolling back (for readers of locked data) */
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL */
   stm_word_t start;                     /* Start timestamp */
+#ifdef INLINE_FAST_PATH
+  /* Fields up to r_set must match struct stm_inline of stm_inline.h */
+  volatile stm_word_t *fast_locks;      /* Lock array for inlined loads (NULL if disabled) */
+  stm_word_t fast_shift;                /* Shift of lock index for inlined loads */
+  stm_word_t fast_mask;                 /* Mask of lock index for inlined loads */
+  const volatile stm_word_t *fast_stop; /* Inlined loads call the library when set */
+#endif /* INLINE_FAST_PATH */
   stm_word_t end;                       /* End timestamp (validity range) */
   r_set_t r_set;                        /* Read set */
   w_set_t w_set;                        /* Write set */
+#if DESIGN == RING
+  stm_word_t ring_rsig[RING_SIG_WORDS]; /* Signature of addresses read */
+  stm_word_t ring_wsig[RING_SIG_WORDS]; /* Signature of addresses written */
+#endif /* DESIGN == RING */
+#ifdef STACK_CHECK
+  stm_word_t stack_low;                 /* Lowest address of stack of thread (0 if unknown) */
+  stm_word_t stack_size;                /* Size of stack below stack pointer at start (not live upon rollback) */
+#endif /* STACK_CHECK */
 #ifdef IRREVOCABLE_ENABLED
   unsigned int irrevocable:4;           /* Is this execution irrevocable? */
 #endif /* IRREVOCABLE_ENABLED */
+#ifdef IRREVOCABLE_IMPROVED
+  unsigned int empty_writes:1;          /* Has data been written with an empty mask? */
+#endif /* IRREVOCABLE_IMPROVED */
+#ifdef NON_TEMPORAL_STORES
+  unsigned int nt_stores:1;             /* Should writes use non-temporal stores? */
+  unsigned int nt_pending:1;            /* Have non-temporal stores been issued since last fence? */
+#endif /* NON_TEMPORAL_STORES */
+#ifdef PROCESS_SHARED
+  unsigned int shm_slot;                /* Slot identifying the thread in locks of the shared segment */
+#endif /* PROCESS_SHARED */
+#ifdef DURABLE_TX
+  struct durable_log *durable_log;      /* Undo log in persistent memory (NULL if not durable) */
+  stm_word_t durable_gen;               /* Generation of last use of the log */
+#endif /* DURABLE_TX */
   unsigned int nesting;                 /* Nesting level */
+#ifdef CLOSED_NESTING
+  unsigned int nb_nested;               /* Number of active closed nested transactions */
+  nested_t nested[MAX_NESTED];          /* Closed nested transactions (innermost last) */
+  nested_undo_t *nested_undo;           /* Undo log for outer write set entries (allocated lazily) */
+  unsigned int nested_undo_nb;          /* Number of entries in undo log */
+  unsigned int nested_undo_size;        /* Size of undo log */
+#endif /* CLOSED_NESTING */
 #if CM == CM_MODULAR
   stm_word_t timestamp;                 /* Timestamp (not changed upon restart) */
 #endif /* CM == CM_MODULAR */
   void *data[MAX_SPECIFIC];             /* Transaction-specific data (fixed-size array for better speed) */
+  specific_ext_t *volatile data_ext;    /* Transaction-specific data beyond MAX_SPECIFIC */
+  stm_word_t cb_disabled;               /* Modules disabled for this thread (one bit per module) */
   struct stm_tx *next;                  /* For keeping track of all transactional threads */
+#ifdef DESCRIPTOR_POOL
+  volatile stm_word_t attached;         /* Is descriptor used by a thread? */
+#endif /* DESCRIPTOR_POOL */
 #ifdef CONFLICT_TRACKING
   pthread_t thread_id;                  /* Thread identifier (immutable) */
 #endif /* CONFLICT_TRACKING */
@@ -345,11 +1095,74 @@ typedef struct stm_tx {                 /* Transaction descriptor */
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   unsigned int stat_retries;            /* Number of consecutive aborts (retries) */
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
+  unsigned int abort_reason;            /* Reason of last abort */
+  unsigned int nb_extensions;           /* Number of snapshot extensions of current attempt */
+#ifdef SANDBOXING
+  unsigned int sb_reads;                /* Reads since snapshot became inconsistent plus one (0 if consistent) */
+#endif /* SANDBOXING */
+#ifdef EPOCH_GC
+  volatile gc_word_t *gc_pressure;      /* Set by GC when transaction holds back reclamation */
+#endif /* EPOCH_GC */
+#ifdef HELPER_VALIDATION
+  hv_slot_t *hv;                        /* Slot of read set validated by helper (NULL if none) */
+#endif /* HELPER_VALIDATION */
+  void *conflict_addr;                  /* Address that caused last abort (if known) */
+  volatile stm_word_t *conflict_lock;   /* Lock that caused last abort (if known) */
+#ifdef OBJECT_LOCKS
+  volatile stm_word_t *obj_lock;        /* Lock of object being accessed (NULL if none) */
+#endif /* OBJECT_LOCKS */
+#ifdef PRIVATIZATION_FENCE
+  fence_slot_t *fence;                  /* Epoch for privatization fences */
+#endif /* PRIVATIZATION_FENCE */
+#ifdef ADAPTIVE_SCHEDULING
+  stm_word_t ats_intensity;             /* Contention intensity of thread */
+  ats_queue_t *ats_queue;               /* Queue whose ticket is held (NULL if not serialized) */
+#endif /* ADAPTIVE_SCHEDULING */
 #ifdef TM_STATISTICS
   unsigned int stat_commits;            /* Total number of commits (cumulative) */
   unsigned int stat_aborts;             /* Total number of aborts (cumulative) */
   unsigned int stat_retries_max;        /* Maximum number of consecutive aborts (retries) */
+# ifdef CLOSED_NESTING
+  unsigned int stat_nested_aborts;      /* Total number of aborts of closed nested transactions only (cumulative) */
+# endif /* CLOSED_NESTING */
+# ifdef ADAPTIVE_SCHEDULING
+  unsigned int stat_serialized;         /* Total number of transactions serialized by the scheduler (cumulative) */
+# endif /* ADAPTIVE_SCHEDULING */
+# ifdef IRREVOCABLE_ENABLED
+  unsigned int stat_irrevocable;        /* Total number of irrevocable transactions (cumulative) */
+  unsigned int stat_irrevocable_stopped; /* Total number of irrevocable transactions that stopped other update transactions (cumulative) */
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef STACK_CHECK
+  unsigned int stat_stack_filtered;     /* Total number of accesses to the stack done without barrier (cumulative) */
+# endif /* STACK_CHECK */
+# ifdef ADAPTIVE_RW_SETS
+  unsigned int stat_rw_resizes;         /* Total number of reallocations of sets upon start (cumulative) */
+# endif /* ADAPTIVE_RW_SETS */
+# ifdef ADAPTIVE_READ_ONLY
+  unsigned int stat_ro_hits;            /* Total number of commits in learned read-only mode (cumulative) */
+  unsigned int stat_ro_misses;          /* Total number of restarts in update mode after a write (cumulative) */
+# endif /* ADAPTIVE_READ_ONLY */
+# ifdef IRREVOCABLE_FALLBACK
+  unsigned int stat_fallbacks;          /* Total number of transactions made irrevocable after repeated aborts (cumulative) */
+# endif /* IRREVOCABLE_FALLBACK */
+# ifdef EPOCH_GC
+  unsigned int stat_gc_pressure;        /* Total number of extensions or aborts requested by GC (cumulative) */
+# endif /* EPOCH_GC */
+# ifdef HELPER_VALIDATION
+  unsigned long stat_hv_skipped;        /* Total number of read set entries validated by helper (cumulative) */
+# endif /* HELPER_VALIDATION */
+  uint64_t prio_ts;                     /* Start of first attempt (cycles) */
+  unsigned int stat_prio_commits[PRIO_LEVELS]; /* Total number of commits per priority (cumulative) */
+  unsigned int stat_prio_aborts[PRIO_LEVELS]; /* Total number of aborts per priority (cumulative) */
+  uint64_t stat_prio_cycles[PRIO_LEVELS]; /* Total latency of committed transactions per priority, including aborted attempts (cumulative) */
 #endif /* TM_STATISTICS */
+#ifdef HYBRID_HTM
+  int htm;                              /* Is the transaction executing in hardware? */
+  unsigned int stat_htm_commits;        /* Total number of hardware commits (cumulative) */
+  unsigned int stat_htm_aborts;         /* Total number of hardware aborts (cumulative) */
+  unsigned int stat_htm_fallbacks;      /* Total number of fallbacks to software (cumulative) */
+  unsigned int stat_htm_aborts_r[HTM_STAT_NB]; /* Total number of hardware aborts wrt. abort reason (cumulative) */
+#endif /* HYBRID_HTM */
 #ifdef TM_STATISTICS2
   unsigned int stat_aborts_1;           /* Total number of transactions that abort once or more (cumulative) */
   unsigned int stat_aborts_2;           /* Total number of transactions that abort twice or more (cumulative) */
@@ -358,31 +1171,215 @@ typedef struct stm_tx {                 /* Transaction descriptor */
   unsigned int stat_locked_reads_ok;    /* Successful reads of previous value */
   unsigned int stat_locked_reads_failed;/* Failed reads of previous value */
 # endif /* READ_LOCKED_DATA */
+  int prof;                             /* Is the current transaction sampled? */
+  int prof_phase;                       /* Phase of sampled transaction */
+  unsigned int prof_count;              /* Transactions started since last sample */
+  unsigned int prof_samples;            /* Total number of sampled transactions (cumulative) */
+  uint64_t prof_ts;                     /* Timestamp of last phase transition */
+  uint64_t prof_attempt;                /* Timestamp of start of current attempt */
+  uint64_t prof_cycles[PROF_NB];        /* Cycles spent in each phase by sampled transactions (cumulative) */
+  uint64_t prof_aborted;                /* Cycles spent in aborted attempts of sampled transactions (cumulative) */
 #endif /* TM_STATISTICS2 */
+#ifdef READ_SET_FILTER
+  unsigned int rs_filter[RS_FILTER_SIZE]; /* Read set indexes of recently read locks (direct-mapped) */
+#endif /* READ_SET_FILTER */
+#ifdef ADAPTIVE_RW_SETS
+  rw_hint_t *rw_hint;                   /* Sizes of sets needed by current atomic block */
+  unsigned int rw_trim;                 /* Consecutive starts with sets larger than needed */
+  unsigned int rw_trim_r;               /* Largest sizes needed during these starts */
+  unsigned int rw_trim_w;
+  rw_hint_t rw_hints[RW_HINTS];         /* Sizes of sets needed by atomic blocks */
+#endif /* ADAPTIVE_RW_SETS */
+#ifdef ADAPTIVE_READ_ONLY
+  unsigned int *ro_hint;                /* Commits without writes of current atomic block */
+  int ro_learned;                       /* Has read-only mode been set from the hint? */
+  unsigned int ro_aborts;               /* Consecutive validation aborts in learned read-only mode */
+  unsigned int ro_hints[RO_HINTS];      /* Consecutive commits without writes of atomic blocks */
+#endif /* ADAPTIVE_READ_ONLY */
+#ifdef IRREVOCABLE_FALLBACK
+  fallback_t *fallback;                 /* Policy of current atomic block */
+  unsigned int fb_retries;              /* Consecutive aborts of current transaction */
+  unsigned long fb_cycles;              /* Cycle budget of current transaction (0 means none) */
+  uint64_t fb_wasted;                   /* Cycles spent in aborted attempts of current transaction */
+  uint64_t fb_ts;                       /* Timestamp of start of current attempt (only with a budget) */
+#endif /* IRREVOCABLE_FALLBACK */
+#ifdef SHARED_VISIBLE_READS
+  volatile int vr_waiting;              /* Is the transaction waiting for readers before committing? */
+  volatile stm_word_t *vr_c_slot;       /* Pointer to contented reader indicator (cause of abort) */
+  unsigned long vr_seed;                /* RNG seed (backoff after waiting for readers) */
+  unsigned int vr_nb;                   /* Number of reader indicators held */
+  stm_word_t vr_held[VR_SLOTS / (sizeof(stm_word_t) * 8)]; /* Reader indicators held (bitmap) */
+#endif /* SHARED_VISIBLE_READS */
 } stm_tx_t;
 
+#if DESIGN == MODULAR
+typedef struct stm_design {             /* Functions of a design (one table per design) */
+  int id;                               /* WRITE_BACK_ETL, WRITE_BACK_CTL or WRITE_THROUGH */
+  stm_word_t (*read)(stm_tx_t *, volatile stm_word_t *);
+  w_entry_t *(*write)(stm_tx_t *, volatile stm_word_t *, stm_word_t, stm_word_t);
+  stm_word_t (*RaR)(stm_tx_t *, volatile stm_word_t *);
+  stm_word_t (*RaW)(stm_tx_t *, volatile stm_word_t *);
+  stm_word_t (*RfW)(stm_tx_t *, volatile stm_word_t *);
+  void (*WaR)(stm_tx_t *, volatile stm_word_t *, stm_word_t, stm_word_t);
+  void (*WaW)(stm_tx_t *, volatile stm_word_t *, stm_word_t, stm_word_t);
+  int (*validate)(stm_tx_t *);
+  int (*extend)(stm_tx_t *);
+  int (*commit)(stm_tx_t *);
+  void (*rollback)(stm_tx_t *);
+} stm_design_t;
+#endif /* DESIGN == MODULAR */
+
+#ifdef LOCK_REGIONS
+typedef struct lock_region {            /* Memory region with its own lock table */
+  stm_word_t base;                      /* First address of region */
+  stm_word_t size;                      /* Size of region (in bytes) */
+  unsigned int shift;                   /* Log2 of number of bytes covered by a lock */
+  unsigned int nb_locks;                /* Number of locks */
+  volatile stm_word_t *locks;           /* Array of locks */
+} lock_region_t;
+#endif /* LOCK_REGIONS */
+
+#ifdef PROCESS_SHARED
+/* Header of the shared-memory segment (followed by the lock array) */
+typedef struct {
+  volatile stm_word_t magic;            /* SHM_MAGIC once initialized by the creator */
+  volatile stm_word_t nb_procs;         /* Number of attached processes */
+  unsigned int lock_array_log_size;     /* Log2 of size of array of locks */
+  unsigned int lock_shift;              /* Log2 of number of bytes covered by a lock */
+  volatile stm_word_t irrevocable;      /* Irrevocability status */
+  volatile stm_word_t gclock[512 / sizeof(stm_word_t)] ALIGNED;
+  volatile stm_word_t slots[SHM_SLOTS]; /* Process owning each slot (0 if free) */
+} ALIGNED shm_header_t;
+
+/* Lock array starts on its own page */
+# define SHM_LOCKS_OFFSET               ((sizeof(shm_header_t) + 4095) & ~(size_t)4095)
+#endif /* PROCESS_SHARED */
+
+#ifdef DURABLE_TX
+/*
+ * The log of a transaction is valid if its header has a non-zero count
+ * and all lines holding its entries have the same generation as the
+ * header.  Entries of a line are written before its generation, and the
+ * generation of the header before its count (stores to a cache line
+ * become persistent in order).
+ */
+typedef struct durable_line {           /* Cache line of undo log */
+  stm_word_t entries[2 * DURABLE_LINE_ENTRIES]; /* Addresses and old values */
+  volatile stm_word_t gen;              /* Generation of log (written last) */
+  char padding[CACHELINE_SIZE - (2 * DURABLE_LINE_ENTRIES + 1) * sizeof(stm_word_t)];
+} durable_line_t;
+
+/*
+ * Entries beyond the lines of a log are stored in extensions appended to
+ * the log file and chained by their offsets.  Extensions are kept by the
+ * log until the library exits.
+ */
+typedef struct durable_ext {            /* Extension of undo log */
+  volatile stm_word_t next;             /* Offset of next extension in log file (0 if none) */
+  struct durable_ext *volatile next_ext; /* Mapped next extension (not used upon recovery) */
+  char padding[CACHELINE_SIZE - 2 * sizeof(stm_word_t)];
+  durable_line_t lines[DURABLE_EXT_LINES];
+} durable_ext_t;
+
+typedef struct durable_log {            /* Undo log of a thread */
+  volatile stm_word_t count;            /* Number of entries (0 if truncated, written last) */
+  volatile stm_word_t gen;              /* Generation of log */
+  volatile stm_word_t next;             /* Offset of first extension in log file (0 if none) */
+  char padding[CACHELINE_SIZE - 3 * sizeof(stm_word_t)];
+  durable_line_t lines[DURABLE_LOG_LINES];
+} durable_log_t;
+
+typedef struct {                        /* Log file */
+  volatile stm_word_t magic;            /* DURABLE_MAGIC once initialized */
+  stm_word_t nb_logs;                   /* Number of logs (checked upon recovery) */
+  stm_word_t log_size;                  /* Size of logs (checked upon recovery) */
+  char padding[CACHELINE_SIZE - 3 * sizeof(stm_word_t)];
+  durable_log_t logs[DURABLE_LOG_SLOTS];
+} durable_file_t;
+
+/* Extensions start on their own page */
+# define DURABLE_FILE_SIZE              ((sizeof(durable_file_t) + 4095) & ~(size_t)4095)
+#endif /* DURABLE_TX */
+
 /* This structure should be ordered by hot and cold variables */
 typedef struct {
+#ifdef DYNAMIC_LOCK_ARRAY
+  volatile stm_word_t *locks;           /* Array of locks (allocated in stm_init) */
+  stm_word_t lock_mask;                 /* Size of array of locks minus 1 */
+  unsigned int lock_shift;              /* Log2 of number of bytes covered by a lock (0 = default) */
+#else /* ! DYNAMIC_LOCK_ARRAY */
   volatile stm_word_t locks[LOCK_ARRAY_SIZE] ALIGNED;
+#endif /* ! DYNAMIC_LOCK_ARRAY */
+#ifdef PROCESS_SHARED
+  shm_header_t *shm;                    /* Shared-memory segment (mapped in stm_init) */
+  size_t shm_size;                      /* Size of segment */
+  const char *shm_name;                 /* Name of segment */
+  w_entry_t *volatile shm_ws[SHM_SLOTS]; /* Write sets of local threads (indexed by slot) */
+#endif /* PROCESS_SHARED */
+#ifdef DURABLE_TX
+  durable_file_t *durable;              /* Mapped log file (NULL if not durable) */
+  int durable_flush;                    /* Instruction used for flushing cache lines */
+  unsigned long durable_recovered;      /* Number of transactions rolled back by recovery */
+  volatile stm_word_t durable_used[DURABLE_LOG_SLOTS]; /* Is log used by a descriptor? */
+  durable_ext_t *durable_ext[DURABLE_LOG_SLOTS]; /* Mapped first extensions of logs */
+  int durable_fd;                       /* Log file (kept open for extensions) */
+  size_t durable_size;                  /* Size of log file */
+  pthread_mutex_t durable_mutex;        /* Mutex to extend the log file */
+#endif /* DURABLE_TX */
+#ifdef LOCK_REGIONS
+  unsigned int nb_regions;              /* Number of registered regions */
+  lock_region_t regions[MAX_REGIONS];   /* Registered regions */
+#endif /* LOCK_REGIONS */
   volatile stm_word_t gclock[512 / sizeof(stm_word_t)] ALIGNED;
-  unsigned int nb_specific;             /* Number of specific slots used (<= MAX_SPECIFIC) */
-  unsigned int nb_init_cb;
-  cb_entry_t init_cb[MAX_CB];           /* Init thread callbacks */
-  unsigned int nb_exit_cb;
-  cb_entry_t exit_cb[MAX_CB];           /* Exit thread callbacks */
-  unsigned int nb_start_cb;
-  cb_entry_t start_cb[MAX_CB];          /* Start callbacks */
-  unsigned int nb_precommit_cb;
-  cb_entry_t precommit_cb[MAX_CB];      /* Commit callbacks */
-  unsigned int nb_commit_cb;
-  cb_entry_t commit_cb[MAX_CB];         /* Commit callbacks */
-  unsigned int nb_abort_cb;
-  cb_entry_t abort_cb[MAX_CB];          /* Abort callbacks */
+#if DESIGN == RING
+  ring_entry_t ring[RING_SIZE] ALIGNED; /* Write signatures of last commits (indexed by time) */
+#endif /* DESIGN == RING */
+#ifdef ADAPTIVE_SCHEDULING
+  ats_queue_t ats_queues[ATS_QUEUES] ALIGNED;
+#endif /* ADAPTIVE_SCHEDULING */
+#ifdef PRIVATIZATION_FENCE
+  fence_slot_t fence_slots[FENCE_MAX_THREADS] ALIGNED;
+  volatile stm_word_t fence_nb;         /* Number of slots used (including released ones) */
+#endif /* PRIVATIZATION_FENCE */
+#ifdef MULTI_VERSION
+# ifdef DYNAMIC_LOCK_ARRAY
+  mv_history_t *mv_history;             /* Old versions (one entry per lock) */
+# else /* ! DYNAMIC_LOCK_ARRAY */
+  mv_history_t mv_history[LOCK_ARRAY_SIZE] ALIGNED;
+# endif /* ! DYNAMIC_LOCK_ARRAY */
+#endif /* MULTI_VERSION */
+  volatile stm_word_t nb_specific;      /* Number of specific slots used */
+  volatile stm_word_t nb_modules;       /* Number of modules registered with stm_register() */
+  cb_chain_t *volatile init_cb;         /* Init thread callbacks */
+  cb_chain_t *volatile exit_cb;         /* Exit thread callbacks */
+  cb_chain_t *volatile start_cb;        /* Start callbacks */
+  cb_chain_t *volatile precommit_cb;    /* Pre-commit callbacks */
+  cb_chain_t *volatile commit_cb;       /* Commit callbacks */
+  cb_chain_t *volatile abort_cb;        /* Abort callbacks */
+  cb_chain_t *volatile param_cb;        /* Parameter callbacks */
+  cb_chain_t *volatile event_cb;        /* Event callbacks */
+#ifdef CLOSED_NESTING
+  cb_chain_t *volatile nested_start_cb; /* Closed nested start callbacks */
+  cb_chain_t *volatile nested_commit_cb; /* Closed nested commit callbacks */
+  cb_chain_t *volatile nested_abort_cb; /* Closed nested abort callbacks */
+#endif /* CLOSED_NESTING */
   unsigned int initialized;             /* Has the library been initialized? */
+#if DESIGN == MODULAR
+  const stm_design_t *design;           /* Design of transactions that do not choose one */
+#endif /* DESIGN == MODULAR */
 #ifdef IRREVOCABLE_ENABLED
   volatile stm_word_t irrevocable;      /* Irrevocability status */
 #endif /* IRREVOCABLE_ENABLED */
   volatile stm_word_t quiesce;          /* Prevent threads from entering transactions upon quiescence */
+#ifdef WAIT_FUTEX
+  volatile stm_word_t futex_waiters;    /* Number of threads sleeping on contended locks */
+  futex_slot_t futex_slots[FUTEX_SLOTS];
+#endif /* WAIT_FUTEX */
+#ifdef BLOCKING_RETRY
+  volatile stm_word_t retry_waiters;    /* Number of threads sleeping in stm_retry() */
+  volatile stm_word_t retry_seq;        /* Sequence number (incremented to wake up sleepers) */
+  volatile stm_word_t retry_slots[RETRY_SLOTS]; /* Number of sleepers per hash of lock */
+#endif /* BLOCKING_RETRY */
   volatile stm_word_t threads_nb;       /* Number of active threads */
   stm_tx_t *threads;                    /* Head of linked list of threads */
   pthread_mutex_t quiesce_mutex;        /* Mutex to support quiescence */
@@ -390,6 +1387,52 @@ typedef struct {
 #if CM == CM_MODULAR
   int vr_threshold;                     /* Number of retries before to switch to visible reads. */
 #endif /* CM == CM_MODULAR */
+#ifdef SHARED_VISIBLE_READS
+  volatile stm_word_t vr_readers;       /* Number of transactions holding reader indicators */
+  vr_slot_t vr_slots[VR_SLOTS];         /* Reader indicators */
+#endif /* SHARED_VISIBLE_READS */
+#ifdef DYNAMIC_LOCK_ARRAY
+  unsigned int lock_array_log_size;     /* Log2 of size of array of locks (0 = default) */
+  int lock_array_interleave;            /* Interleave array of locks across NUMA nodes? */
+  int lock_array_huge_pages;            /* Huge pages: 0 = none, 1 = explicit, 2 = transparent */
+#endif /* DYNAMIC_LOCK_ARRAY */
+#ifdef AUTO_TUNE
+  unsigned int tune_period;             /* Sampling period of the tuner in milliseconds (0 = no tuner) */
+  unsigned int tune_log_min;            /* Sizes of lock array explored by the tuner (log2) */
+  unsigned int tune_log_max;
+  unsigned int tune_commits;            /* Commits of threads that have exited */
+  int tune_stop;                        /* Should the tuner stop? */
+  pthread_t tune_thread;
+  pthread_mutex_t tune_mutex;
+  pthread_cond_t tune_cond;
+#endif /* AUTO_TUNE */
+#ifdef HELPER_VALIDATION
+  unsigned int hv_threshold;            /* Read set entries before validation by helper (0 means never) */
+  volatile stm_word_t hv_stop;          /* Should the helper stop? */
+  pthread_t hv_thread;
+  hv_slot_t hv_slots[HV_SLOTS];
+#endif /* HELPER_VALIDATION */
+#ifdef ADAPTIVE_SCHEDULING
+  int ats_threshold;                    /* Contention intensity (percent) above which transactions are serialized */
+  stm_word_t ats_limit;                 /* Same as above (fixed point) */
+#endif /* ADAPTIVE_SCHEDULING */
+#ifdef SIMD_VALIDATION
+  int simd;                             /* Instruction set used for validation */
+#endif /* SIMD_VALIDATION */
+#ifdef HYBRID_HTM
+  int htm_enabled;                      /* Does the processor support hardware transactions? */
+  int htm_retries;                      /* Number of hardware attempts before falling back to software. */
+#endif /* HYBRID_HTM */
+#ifdef ELASTIC_TX
+  unsigned int elastic_window;          /* Number of last reads kept by elastic transactions before their first write */
+#endif /* ELASTIC_TX */
+#ifdef IRREVOCABLE_FALLBACK
+  fallback_t fallback_default;          /* Policy of atomic blocks without their own */
+  fallback_t fallback[FALLBACK_IDS];    /* Policies of atomic blocks (indexed by attr.id) */
+#endif /* IRREVOCABLE_FALLBACK */
+#ifdef TM_STATISTICS2
+  unsigned int prof_period;             /* One in how many transactions of each thread are sampled (0 means none) */
+#endif /* TM_STATISTICS2 */
 #ifdef CONFLICT_TRACKING
   void (*conflict_cb)(stm_tx_t *, stm_tx_t *);
 #endif /* CONFLICT_TRACKING */
@@ -402,6 +1445,34 @@ typedef struct {
 
 extern global_t _tinystm;
 
+#if defined(INLINE_FAST_PATH) && !defined(EPOCH_GC)
+/* Inlined loads never need to stop */
+static const stm_word_t stm_fast_go = 0;
+#endif /* defined(INLINE_FAST_PATH) && !defined(EPOCH_GC) */
+
+#ifdef PROCESS_SHARED
+/*
+ * Get the write set entry that owns a lock.  Entries of other processes
+ * are not accessible (NULL is returned), which is fine as owners only
+ * check whether the entry falls in their own write set.
+ */
+static INLINE w_entry_t *
+lock_get_entry(stm_word_t l)
+{
+  w_entry_t *ws;
+
+  ws = _tinystm.shm_ws[(l >> OWNED_BITS) & SHM_SLOT_MASK];
+  if (ws == NULL)
+    return NULL;
+  return ws + (l >> (OWNED_BITS + SHM_SLOT_BITS));
+}
+#endif /* PROCESS_SHARED */
+
+#if DESIGN == MODULAR
+/* Indexed by design (defined in stm.c) */
+extern const stm_design_t stm_designs[3];
+#endif /* DESIGN == MODULAR */
+
 #if CM == CM_MODULAR
 # define KILL_SELF                      0x00
 # define KILL_OTHER                     0x01
@@ -435,6 +1506,97 @@ lock_idx_swap(unsigned int idx)
 }
 #endif /* LOCK_IDX_SWAP */
 
+#ifdef LOCK_REGIONS
+/*
+ * Get lock covering address (regions are only modified upon quiescence).
+ */
+static INLINE volatile stm_word_t *
+stm_get_lock(stm_word_t a)
+{
+  lock_region_t *r;
+  unsigned int i;
+
+  for (i = 0, r = _tinystm.regions; i < _tinystm.nb_regions; i++, r++) {
+    /* Unsigned comparison also catches addresses below base */
+    if (a - r->base < r->size)
+      return r->locks + ((a - r->base) >> r->shift);
+  }
+  return GET_GLOBAL_LOCK(a);
+}
+#endif /* LOCK_REGIONS */
+
+
+/*
+ * Get commit timestamp for an update transaction (must be called once
+ * all locks have been acquired).  Set *validate if another transaction
+ * may have committed since the start and the read set must be validated.
+ */
+static INLINE stm_word_t
+stm_clock_commit(stm_tx_t *tx, int *validate)
+{
+  stm_word_t t;
+#if CLOCK_MODE == CLOCK_GV4
+  stm_word_t now;
+#endif /* CLOCK_MODE == CLOCK_GV4 */
+
+#if CLOCK_MODE == CLOCK_COUNTER
+  t = FETCH_INC_CLOCK + 1;
+  *validate = (tx->start != t - 1);
+#elif CLOCK_MODE == CLOCK_GV4
+  /* Pass on failure: if the clock has been incremented concurrently,
+   * share the new timestamp but do not skip validation */
+  now = GET_CLOCK;
+  if (likely(ATOMIC_CAS_FULL(&CLOCK, now, now + 1) != 0)) {
+    t = now + 1;
+    *validate = (tx->start != now);
+  } else {
+    t = GET_CLOCK;
+    *validate = 1;
+  }
+#elif CLOCK_MODE == CLOCK_DEFERRED
+  /* Do not increment the clock: versions may be ahead of the clock by
+   * one and the clock is advanced by readers that encounter them */
+  t = GET_CLOCK + 1;
+  *validate = 1;
+#elif CLOCK_MODE == CLOCK_TSC
+  t = GET_CLOCK + 1;
+  *validate = 1;
+#endif /* CLOCK_MODE == CLOCK_TSC */
+
+  return t;
+}
+
+/*
+ * Get current time to extend the snapshot of a transaction (all versions
+ * released before the call are guaranteed not to be greater).
+ */
+static INLINE stm_word_t
+stm_clock_extend(void)
+{
+#if CLOCK_MODE == CLOCK_DEFERRED
+  stm_word_t now;
+
+  now = GET_CLOCK;
+  /* Versions can be one ahead of the clock: advance clock to cover them
+   * (if the CAS fails, another thread has already done it) */
+  ATOMIC_CAS_FULL(&CLOCK, now, now + 1);
+  return now + 1;
+#else /* CLOCK_MODE != CLOCK_DEFERRED */
+  return GET_CLOCK;
+#endif /* CLOCK_MODE != CLOCK_DEFERRED */
+}
+
+#ifdef MULTI_VERSION
+# include "stm_mv.h"
+#endif /* MULTI_VERSION */
+
+#ifdef PRIVATIZATION_FENCE
+# include "stm_fence.h"
+#endif /* PRIVATIZATION_FENCE */
+
+#ifdef HELPER_VALIDATION
+# include "stm_hv.h"
+#endif /* HELPER_VALIDATION */
 
 /*
  * Initialize quiescence support.
@@ -478,10 +1640,13 @@ stm_quiesce_enter_thread(stm_tx_t *tx)
   PRINT_DEBUG("==> stm_quiesce_enter_thread(%p)\n", tx);
 
   pthread_mutex_lock(&_tinystm.quiesce_mutex);
-  /* Add new descriptor at head of list */
+  /* Add new descriptor at head of list (can be traversed without lock) */
   tx->next = _tinystm.threads;
-  _tinystm.threads = tx;
-  _tinystm.threads_nb++;
+  ATOMIC_STORE_REL(&_tinystm.threads, tx);
+  ATOMIC_FETCH_INC_FULL(&_tinystm.threads_nb);
+#ifdef PRIVATIZATION_FENCE
+  stm_fence_enter_thread(tx);
+#endif /* PRIVATIZATION_FENCE */
   pthread_mutex_unlock(&_tinystm.quiesce_mutex);
 }
 
@@ -511,7 +1676,14 @@ stm_quiesce_exit_thread(stm_tx_t *tx)
     _tinystm.threads = t->next;
   else
     p->next = t->next;
-  _tinystm.threads_nb--;
+#ifdef AUTO_TUNE
+  /* Commits are sampled under the same lock (see stm_tune_commits()) */
+  _tinystm.tune_commits += tx->stat_commits;
+#endif /* AUTO_TUNE */
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.threads_nb);
+#ifdef PRIVATIZATION_FENCE
+  stm_fence_exit_thread(tx);
+#endif /* PRIVATIZATION_FENCE */
   if (_tinystm.quiesce) {
     /* Wake up someone in case other threads are waiting for us */
     pthread_cond_signal(&_tinystm.quiesce_cond);
@@ -519,6 +1691,38 @@ stm_quiesce_exit_thread(stm_tx_t *tx)
   pthread_mutex_unlock(&_tinystm.quiesce_mutex);
 }
 
+#ifdef PROCESS_SHARED
+/*
+ * Claim a free slot of the shared segment for a new descriptor (before
+ * allocating its write set).  The slot is kept by pooled descriptors.
+ */
+static INLINE void
+stm_shm_enter_thread(stm_tx_t *tx)
+{
+  stm_word_t pid = (stm_word_t)getpid();
+  unsigned int i;
+
+  for (i = 0; i < SHM_SLOT_MASK; i++) {
+    if (ATOMIC_LOAD(&_tinystm.shm->slots[i]) == 0 && ATOMIC_CAS_FULL(&_tinystm.shm->slots[i], 0, pid) != 0) {
+      tx->shm_slot = i;
+      return;
+    }
+  }
+  fprintf(stderr, "Error: no free slot in shared segment (SHM_SLOT_BITS=%d)\n", SHM_SLOT_BITS);
+  exit(1);
+}
+
+/*
+ * Release the slot of a descriptor (its write set is not used anymore).
+ */
+static INLINE void
+stm_shm_exit_thread(stm_tx_t *tx)
+{
+  _tinystm.shm_ws[tx->shm_slot] = NULL;
+  ATOMIC_STORE_REL(&_tinystm.shm->slots[tx->shm_slot], 0);
+}
+#endif /* PROCESS_SHARED */
+
 /*
  * Wait for all transactions to be block on a barrier.
  */
@@ -532,10 +1736,12 @@ stm_quiesce_barrier(stm_tx_t *tx, void (*f)(void *), void *arg)
 
   pthread_mutex_lock(&_tinystm.quiesce_mutex);
   /* Wait for all other transactions to block on barrier */
-  _tinystm.threads_nb--;
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.threads_nb);
   if (_tinystm.quiesce == 0) {
     /* We are first on the barrier */
     _tinystm.quiesce = 1;
+    /* Threads might start counting in without lock (see stm_pool_join()) */
+    ATOMIC_MB_FULL;
   }
   while (_tinystm.quiesce) {
     if (_tinystm.threads_nb == 0) {
@@ -550,7 +1756,7 @@ stm_quiesce_barrier(stm_tx_t *tx, void (*f)(void *), void *arg)
       pthread_cond_wait(&_tinystm.quiesce_cond, &_tinystm.quiesce_mutex);
     }
   }
-  _tinystm.threads_nb++;
+  ATOMIC_FETCH_INC_FULL(&_tinystm.threads_nb);
   pthread_mutex_unlock(&_tinystm.quiesce_mutex);
 }
 
@@ -567,7 +1773,7 @@ stm_quiesce(stm_tx_t *tx, int block)
 
   PRINT_DEBUG("==> stm_quiesce(%p,%d)\n", tx, block);
 
-  if (IS_ACTIVE(tx->status)) {
+  if (tx != NULL && IS_ACTIVE(tx->status)) {
     /* Only one active transaction can quiesce at a time, others must abort */
     if (pthread_mutex_trylock(&_tinystm.quiesce_mutex) != 0)
       return 1;
@@ -656,12 +1862,40 @@ stm_quiesce_release(stm_tx_t *tx)
 static INLINE void
 rollover_clock(void *arg)
 {
+# ifdef LOCK_REGIONS
+  unsigned int i;
+# endif /* LOCK_REGIONS */
+
   PRINT_DEBUG("==> rollover_clock()\n");
 
+# ifdef PROCESS_SHARED
+  /* Threads of other processes cannot be stopped */
+  fprintf(stderr, "Error: clock overflow in shared segment\n");
+  exit(1);
+# endif /* PROCESS_SHARED */
+
+# ifdef OBJECT_LOCKS
+  /* Locks embedded in objects cannot be found */
+  fprintf(stderr, "Error: clock overflow with object locks\n");
+  exit(1);
+# endif /* OBJECT_LOCKS */
+
   /* Reset clock */
   CLOCK = 0;
   /* Reset timestamps */
-  memset((void *)_tinystm.locks, 0, LOCK_ARRAY_SIZE * sizeof(stm_word_t));
+  memset((void *)_tinystm.locks, 0, LOCK_ARRAY_MAP_SIZE * sizeof(stm_word_t));
+# ifdef LOCK_REGIONS
+  for (i = 0; i < _tinystm.nb_regions; i++)
+    memset((void *)_tinystm.regions[i].locks, 0, _tinystm.regions[i].nb_locks * sizeof(stm_word_t));
+# endif /* LOCK_REGIONS */
+# ifdef MULTI_VERSION
+  /* Reset histories */
+  stm_mv_reset();
+# endif /* MULTI_VERSION */
+# if DESIGN == RING
+  /* Reset times of signatures */
+  memset((void *)_tinystm.ring, 0, sizeof(_tinystm.ring));
+# endif /* DESIGN == RING */
 # ifdef EPOCH_GC
   /* Reset GC */
   gc_reset();
@@ -694,6 +1928,197 @@ stm_has_read(stm_tx_t *tx, volatile stm_word_t *lock)
   return NULL;
 }
 
+/*
+ * Index of first read set entry that can be removed (entries of parents
+ * are restored upon rollback of closed nested transactions).
+ */
+static INLINE unsigned int
+stm_rs_base(stm_tx_t *tx)
+{
+#ifdef CLOSED_NESTING
+  if (tx->nb_nested > 0)
+    return tx->nested[tx->nb_nested - 1].r_nb;
+#endif /* CLOSED_NESTING */
+  return 0;
+}
+
+#ifdef READ_SET_FILTER
+# define RS_FILTER_IDX(lock)            (((stm_word_t)(lock) / sizeof(stm_word_t)) & (RS_FILTER_SIZE - 1))
+
+/*
+ * Check if stripe has recently been read (misses only cause duplicate
+ * entries).  Otherwise, remember the index of the entry to be added.
+ * Versions need not be compared: if the stripe has changed since the
+ * previous read, the existing entry makes validation fail anyway.
+ */
+static INLINE int
+stm_rs_filter(stm_tx_t *tx, volatile stm_word_t *lock)
+{
+  unsigned int *f;
+
+  f = &tx->rs_filter[RS_FILTER_IDX(lock)];
+  if (*f < tx->r_set.nb_entries && tx->r_set.entries[*f].lock == lock)
+    return 1;
+  *f = tx->r_set.nb_entries;
+  return 0;
+}
+
+/*
+ * Remove duplicate entries missed by the filter (in place).
+ */
+static NOINLINE void
+stm_rs_compact(stm_tx_t *tx)
+{
+  r_entry_t *r, *d, *end, *e;
+  unsigned int *f;
+
+  PRINT_DEBUG("==> stm_rs_compact(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+#ifdef HELPER_VALIDATION
+  /* Entries move: the helper restarts from the first one */
+  if (tx->hv != NULL)
+    stm_hv_lock(tx->hv);
+#endif /* HELPER_VALIDATION */
+  e = tx->r_set.entries;
+  d = r = &e[stm_rs_base(tx)];
+  end = &e[tx->r_set.nb_entries];
+  for (; r < end; r++) {
+    f = &tx->rs_filter[RS_FILTER_IDX(r->lock)];
+    if (*f < (unsigned int)(d - e) && e[*f].lock == r->lock)
+      continue;
+    *f = d - e;
+    *d++ = *r;
+  }
+  tx->r_set.nb_entries = d - e;
+#ifdef HELPER_VALIDATION
+  if (tx->hv != NULL) {
+    tx->hv->idx = 0;
+    tx->hv->nb = tx->r_set.nb_entries;
+    stm_hv_unlock(tx->hv);
+  }
+#endif /* HELPER_VALIDATION */
+  /* Compact again when the read set has doubled */
+  tx->r_set.compact_at = 2 * tx->r_set.nb_entries;
+  if (tx->r_set.compact_at < RS_COMPACT_MIN)
+    tx->r_set.compact_at = RS_COMPACT_MIN;
+}
+#endif /* READ_SET_FILTER */
+
+#ifdef WRITE_SET_HASH
+/*
+ * Add new write set entries to index.
+ */
+static NOINLINE void
+stm_ws_hash_update(stm_tx_t *tx)
+{
+  ws_hash_entry_t *h;
+  unsigned int i, mask;
+
+  PRINT_DEBUG("==> stm_ws_hash_update(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  if (tx->w_set.hash_size < 2 * tx->w_set.size) {
+    /* (Re)allocate index (keep load factor below 1/2) */
+    xfree(tx->w_set.hash);
+    tx->w_set.hash_size = 2 * tx->w_set.size;
+    tx->w_set.hash = (ws_hash_entry_t *)xcalloc(tx->w_set.hash_size, sizeof(ws_hash_entry_t));
+    tx->w_set.hash_gen = 1;
+    tx->w_set.nb_indexed = 0;
+  }
+  h = tx->w_set.hash;
+  mask = tx->w_set.hash_size - 1;
+  for (; tx->w_set.nb_indexed < tx->w_set.nb_entries; tx->w_set.nb_indexed++) {
+    /* Linear probing (addresses are unique in the write set) */
+    i = WS_HASH(tx->w_set.entries[tx->w_set.nb_indexed].addr) & mask;
+    while (h[i].gen == tx->w_set.hash_gen)
+      i = (i + 1) & mask;
+    h[i].gen = tx->w_set.hash_gen;
+    h[i].idx = tx->w_set.nb_indexed;
+  }
+}
+
+/*
+ * Invalidate index (upon start or restart).
+ */
+static INLINE void
+stm_ws_hash_reset(stm_tx_t *tx)
+{
+  if (tx->w_set.nb_indexed > 0) {
+    tx->w_set.nb_indexed = 0;
+    if (unlikely(++tx->w_set.hash_gen == 0)) {
+      /* Generation wrapped around */
+      memset(tx->w_set.hash, 0, tx->w_set.hash_size * sizeof(ws_hash_entry_t));
+      tx->w_set.hash_gen = 1;
+    }
+  }
+}
+
+/*
+ * Look for address in index.
+ */
+static INLINE w_entry_t *
+stm_ws_hash_lookup(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  ws_hash_entry_t *h;
+  w_entry_t *w;
+  unsigned int i, mask;
+
+  if (tx->w_set.nb_indexed < tx->w_set.nb_entries)
+    stm_ws_hash_update(tx);
+  mask = tx->w_set.hash_size - 1;
+  for (i = WS_HASH(addr) & mask; ; i = (i + 1) & mask) {
+    h = &tx->w_set.hash[i];
+    if (h->gen != tx->w_set.hash_gen)
+      return NULL;
+    w = &tx->w_set.entries[h->idx];
+    if (w->addr == addr)
+      return w;
+  }
+}
+#endif /* WRITE_SET_HASH */
+
+#ifdef SORTED_COMMIT
+/*
+ * Compare write set entries by lock (entries covered by the same lock
+ * keep their order).
+ */
+static int
+stm_ws_sort_cmp(const void *a, const void *b)
+{
+  const w_entry_t *x = *(const w_entry_t * const *)a;
+  const w_entry_t *y = *(const w_entry_t * const *)b;
+
+  if (x->lock != y->lock)
+    return (x->lock < y->lock ? -1 : 1);
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/*
+ * Sort write set by lock for commit (NULL if the write set is small).
+ */
+static NOINLINE w_entry_t **
+stm_ws_sort(stm_tx_t *tx)
+{
+  w_entry_t **ws;
+  unsigned int i;
+
+  if (tx->w_set.nb_entries < WS_SORT_THRESHOLD)
+    return NULL;
+
+  PRINT_DEBUG("==> stm_ws_sort(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  if (tx->w_set.sorted_size < tx->w_set.size) {
+    xfree(tx->w_set.sorted);
+    tx->w_set.sorted_size = tx->w_set.size;
+    tx->w_set.sorted = (w_entry_t **)xmalloc(tx->w_set.sorted_size * sizeof(w_entry_t *));
+  }
+  ws = tx->w_set.sorted;
+  for (i = 0; i < tx->w_set.nb_entries; i++)
+    ws[i] = &tx->w_set.entries[i];
+  qsort(ws, tx->w_set.nb_entries, sizeof(w_entry_t *), stm_ws_sort_cmp);
+  return ws;
+}
+#endif /* SORTED_COMMIT */
+
 /*
  * Check if address has been written previously.
  */
@@ -710,10 +2135,16 @@ stm_has_written(stm_tx_t *tx, volatile stm_word_t *addr)
 
 # ifdef USE_BLOOM_FILTER
   mask = FILTER_BITS(addr);
-  if ((tx->w_set.bloom & mask) != mask)
+  if ((tx->w_set.bloom[FILTER_WORD(addr)] & mask) != mask)
     return NULL;
 # endif /* USE_BLOOM_FILTER */
 
+# ifdef WRITE_SET_HASH
+  /* Large write set: use index */
+  if (tx->w_set.nb_entries >= WS_HASH_THRESHOLD)
+    return stm_ws_hash_lookup(tx, addr);
+# endif /* WRITE_SET_HASH */
+
   /* Look for write */
   w = tx->w_set.entries;
   for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
@@ -734,8 +2165,17 @@ stm_allocate_rs_entries(stm_tx_t *tx, int extend)
 
   if (extend) {
     /* Extend read set */
+#ifdef HELPER_VALIDATION
+    /* The helper must not read the entries while they move */
+    if (tx->hv != NULL)
+      stm_hv_lock(tx->hv);
+#endif /* HELPER_VALIDATION */
     tx->r_set.size *= 2;
     tx->r_set.entries = (r_entry_t *)xrealloc(tx->r_set.entries, tx->r_set.size * sizeof(r_entry_t));
+#ifdef HELPER_VALIDATION
+    if (tx->hv != NULL)
+      stm_hv_unlock(tx->hv);
+#endif /* HELPER_VALIDATION */
   } else {
     /* Allocate read set */
     tx->r_set.entries = (r_entry_t *)xmalloc_aligned(tx->r_set.size * sizeof(r_entry_t));
@@ -748,9 +2188,9 @@ stm_allocate_rs_entries(stm_tx_t *tx, int extend)
 static NOINLINE void
 stm_allocate_ws_entries(stm_tx_t *tx, int extend)
 {
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA)
   int i, first = (extend ? tx->w_set.size : 0);
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA) */
 #ifdef EPOCH_GC
   void *a;
 #endif /* ! EPOCH_GC */
@@ -775,39 +2215,321 @@ stm_allocate_ws_entries(stm_tx_t *tx, int extend)
   }
   /* Ensure that memory is aligned. */
   assert((((stm_word_t)tx->w_set.entries) & OWNED_MASK) == 0);
+#ifdef PROCESS_SHARED
+  /* Locks acquired from now on are decoded using the new entries */
+  _tinystm.shm_ws[tx->shm_slot] = tx->w_set.entries;
+#endif /* PROCESS_SHARED */
 
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA)
   /* Initialize fields */
   for (i = first; i < tx->w_set.size; i++)
     tx->w_set.entries[i].tx = tx;
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(READ_LOCKED_DATA) */
 }
 
-
-#if DESIGN == WRITE_BACK_ETL
-# include "stm_wbetl.h"
-#elif DESIGN == WRITE_BACK_CTL
-# include "stm_wbctl.h"
-#elif DESIGN == WRITE_THROUGH
-# include "stm_wt.h"
-#elif DESIGN == MODULAR
-# include "stm_wbetl.h"
-# include "stm_wbctl.h"
-# include "stm_wt.h"
-#endif /* DESIGN == MODULAR */
-
-#if CM == CM_MODULAR
+#ifdef CLOSED_NESTING
 /*
- * Kill other transaction.
+ * Save write set entry of an outer transaction before it is modified by
+ * a closed nested transaction (restored if the nested one aborts).
  */
-static NOINLINE int
-stm_kill(stm_tx_t *tx, stm_tx_t *other, stm_word_t status)
+static INLINE void
+stm_nested_save(stm_tx_t *tx, w_entry_t *w, volatile stm_word_t *addr)
 {
-  stm_word_t c, t;
+  nested_undo_t *u;
 
-  PRINT_DEBUG("==> stm_kill(%p[%lu-%lu],%p,s=%d)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, other, status);
+  if (likely(tx->nb_nested == 0 || w >= tx->w_set.entries + tx->nested[tx->nb_nested - 1].w_nb))
+    return;
 
-# ifdef CONFLICT_TRACKING
+  if (unlikely(tx->nested_undo_nb == tx->nested_undo_size)) {
+    tx->nested_undo_size = (tx->nested_undo_size == 0 ? NESTED_UNDO_SIZE : tx->nested_undo_size * 2);
+    tx->nested_undo = (nested_undo_t *)xrealloc(tx->nested_undo, tx->nested_undo_size * sizeof(nested_undo_t));
+  }
+  u = &tx->nested_undo[tx->nested_undo_nb++];
+  /* Write set may be reallocated (WRITE_BACK_CTL): remember position */
+  u->idx = w - tx->w_set.entries;
+  u->value = w->value;
+  u->mask = w->mask;
+  u->addr = addr;
+  if (addr != NULL)
+    u->data = ATOMIC_LOAD(addr);
+}
+#endif /* CLOSED_NESTING */
+
+#ifdef IRREVOCABLE_ENABLED
+/*
+ * Extend the write set of an irrevocable transaction, which cannot
+ * abort for that purpose (return 0 if the transaction is not
+ * irrevocable).  The locks owned are re-pointed to the new entries;
+ * concurrent transactions that decoded the old ones either only compare
+ * addresses or re-check the lock (old entries are freed by EPOCH_GC).
+ */
+static NOINLINE int
+stm_irrevocable_extend(stm_tx_t *tx)
+{
+  w_entry_t *old, *w;
+# ifndef PROCESS_SHARED
+  stm_word_t l;
+# endif /* ! PROCESS_SHARED */
+  unsigned int i;
+
+  if ((tx->irrevocable & 0x07) != 3)
+    return 0;
+
+  PRINT_DEBUG("==> stm_irrevocable_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  old = tx->w_set.entries;
+  stm_allocate_ws_entries(tx, 1);
+  w = tx->w_set.entries;
+  for (i = 0; i < tx->w_set.nb_entries; i++, w++) {
+    if (w->next != NULL)
+      w->next = tx->w_set.entries + (w->next - old);
+    /* With PROCESS_SHARED, locks encode the position of the entry */
+# ifndef PROCESS_SHARED
+    l = ATOMIC_LOAD(w->lock);
+    if (LOCK_GET_OWNED(l) && (w_entry_t *)LOCK_GET_ADDR(l) == old + i)
+      ATOMIC_STORE_REL(w->lock, (stm_word_t)w | LOCK_GET_OWNED(l));
+# endif /* ! PROCESS_SHARED */
+  }
+  return 1;
+}
+#endif /* IRREVOCABLE_ENABLED */
+
+#ifdef IRREVOCABLE_IMPROVED
+/*
+ * The irrevocable transaction acquires the locks of the data it reads
+ * (as for writes, with an empty mask) and waits for the other owners,
+ * so that other update transactions can commit concurrently.  They
+ * must only be blocked (global irrevocability flag set to 2) in serial
+ * mode or when the irrevocable transaction runs out of write set
+ * entries for locking its reads.
+ */
+static INLINE void
+stm_irrevocable_block(stm_tx_t *tx)
+{
+  if (ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 2)
+    return;
+  ATOMIC_STORE(&IRREVOCABLE_FLAG, 2);
+  /* Committing transactions must see the flag or we must see their locks */
+  ATOMIC_MB_FULL;
+# ifdef TM_STATISTICS
+  tx->stat_irrevocable_stopped++;
+# endif /* TM_STATISTICS */
+}
+#endif /* IRREVOCABLE_IMPROVED */
+
+/*
+ * Call the callbacks of a phase, except those of modules disabled by
+ * the thread.
+ */
+static INLINE void
+stm_callbacks(stm_tx_t *tx, cb_chain_t *volatile *chain)
+{
+  cb_chain_t *c;
+  cb_entry_t *cb, *end;
+
+  /* No callbacks for this phase */
+  if ((c = (cb_chain_t *)ATOMIC_LOAD_ACQ(chain)) == NULL)
+    return;
+  cb = c->e.cb;
+  end = cb + c->nb;
+  if (likely(tx->cb_disabled == 0)) {
+    for (; cb < end; cb++)
+      cb->f(cb->arg);
+  } else {
+    for (; cb < end; cb++) {
+      if ((cb->module & tx->cb_disabled) == 0)
+        cb->f(cb->arg);
+    }
+  }
+}
+
+/*
+ * Notify event callbacks (only called on slow paths).
+ */
+static INLINE void
+stm_notify_event(int event)
+{
+  cb_chain_t *c;
+  unsigned int i;
+
+  if (unlikely((c = (cb_chain_t *)ATOMIC_LOAD_ACQ(&_tinystm.event_cb)) != NULL)) {
+    for (i = 0; i < c->nb; i++)
+      c->e.event[i].f(event, c->e.event[i].arg);
+  }
+}
+
+/*
+ * Grow the array of specific slots beyond MAX_SPECIFIC (only called by
+ * the thread of the descriptor).
+ */
+static NOINLINE specific_ext_t *
+stm_specific_grow(stm_tx_t *tx, unsigned int key)
+{
+  specific_ext_t *old, *ext;
+  unsigned int size;
+
+  old = tx->data_ext;
+  size = (old == NULL ? MAX_SPECIFIC : old->size);
+  while (size <= key - MAX_SPECIFIC)
+    size *= 2;
+  ext = (specific_ext_t *)xmalloc(sizeof(specific_ext_t) + (size - 1) * sizeof(void *));
+  memset(ext->data, 0, size * sizeof(void *));
+  if (old != NULL)
+    memcpy(ext->data, old->data, old->size * sizeof(void *));
+  ext->size = size;
+  ext->prev = old;
+  /* Slots must be initialized before the array is visible */
+  ATOMIC_STORE_REL(&tx->data_ext, ext);
+  return ext;
+}
+
+static INLINE void
+stm_specific_free(stm_tx_t *tx)
+{
+  specific_ext_t *ext, *prev;
+
+  for (ext = tx->data_ext; ext != NULL; ext = prev) {
+    prev = ext->prev;
+    xfree(ext);
+  }
+  tx->data_ext = NULL;
+}
+
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL
+/*
+ * With WB-CTL and WT designs, transactions can read the values that
+ * locations locked by an active transaction had before it acquired
+ * their locks (without CM_MODULAR, they do not know the status of the
+ * owner).  The owner makes its sequence number odd before getting its
+ * commit timestamp or undoing its writes, and even again after having
+ * released its locks: readers check that the sequence number has not
+ * changed and the lock is still owned while they read.
+ */
+static INLINE void
+stm_lock_seq_enter(stm_tx_t *tx)
+{
+  if ((tx->lock_seq & 1) == 0) {
+    ATOMIC_STORE(&tx->lock_seq, tx->lock_seq + 1);
+    /* Readers must see the change before the commit timestamp is taken (may be a TSC read) or writes are undone */
+    ATOMIC_MB_FULL;
+  }
+}
+
+static INLINE void
+stm_lock_seq_leave(stm_tx_t *tx)
+{
+  if ((tx->lock_seq & 1) != 0)
+    ATOMIC_STORE_REL(&tx->lock_seq, tx->lock_seq + 1);
+}
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL */
+
+/*
+ * Accept a version newer than the snapshot without validating (return 0
+ * if the snapshot must be extended immediately).
+ */
+static INLINE int
+stm_defer_validation(stm_tx_t *tx)
+{
+#ifdef SANDBOXING
+  /* Read-only transactions have no read set to validate later */
+  if (tx->attr.read_only)
+    return 0;
+# ifdef UNIT_TX
+  if (tx->attr.no_extend)
+    return 0;
+# endif /* UNIT_TX */
+  if (tx->sb_reads == 0)
+    tx->sb_reads = 1;
+  return 1;
+#else /* ! SANDBOXING */
+  return 0;
+#endif /* ! SANDBOXING */
+}
+
+#ifdef SIMD_VALIDATION
+# include "stm_simd.h"
+#endif /* SIMD_VALIDATION */
+
+#ifdef SHARED_VISIBLE_READS
+# include "stm_vr.h"
+#endif /* SHARED_VISIBLE_READS */
+
+#ifdef TM_STATISTICS2
+# include "stm_prof.h"
+#endif /* TM_STATISTICS2 */
+
+#ifdef IRREVOCABLE_FALLBACK
+# include "stm_fallback.h"
+#endif /* IRREVOCABLE_FALLBACK */
+
+#ifdef DURABLE_TX
+# include "stm_durable.h"
+#endif /* DURABLE_TX */
+
+#if DESIGN == WRITE_BACK_ETL
+# include "stm_wbetl.h"
+#elif DESIGN == WRITE_BACK_CTL
+# include "stm_wbctl.h"
+#elif DESIGN == WRITE_THROUGH
+# include "stm_wt.h"
+#elif DESIGN == MODULAR
+# include "stm_wbetl.h"
+# include "stm_wbctl.h"
+# include "stm_wt.h"
+#elif DESIGN == NOREC
+# include "stm_norec.h"
+#elif DESIGN == RING
+# include "stm_ring.h"
+#endif /* DESIGN == RING */
+
+#ifdef HYBRID_HTM
+# include "stm_htm.h"
+#endif /* HYBRID_HTM */
+
+#ifdef WAIT_FUTEX
+# include "stm_futex.h"
+#endif /* WAIT_FUTEX */
+
+#ifdef BLOCKING_RETRY
+# include "stm_retry.h"
+#endif /* BLOCKING_RETRY */
+
+#ifdef CLOSED_NESTING
+# include "stm_nested.h"
+#endif /* CLOSED_NESTING */
+
+#ifdef ELASTIC_TX
+# include "stm_elastic.h"
+#endif /* ELASTIC_TX */
+
+#ifdef ADAPTIVE_SCHEDULING
+# include "stm_ats.h"
+#endif /* ADAPTIVE_SCHEDULING */
+
+#ifdef ADAPTIVE_RW_SETS
+# include "stm_rwset.h"
+#endif /* ADAPTIVE_RW_SETS */
+
+#ifdef ADAPTIVE_READ_ONLY
+# include "stm_ro.h"
+#endif /* ADAPTIVE_READ_ONLY */
+
+#ifdef DESCRIPTOR_POOL
+# include "stm_pool.h"
+#endif /* DESCRIPTOR_POOL */
+
+#if CM == CM_MODULAR
+/*
+ * Kill other transaction.
+ */
+static NOINLINE int
+stm_kill(stm_tx_t *tx, stm_tx_t *other, stm_word_t status)
+{
+  stm_word_t c, t;
+
+  PRINT_DEBUG("==> stm_kill(%p[%lu-%lu],%p,s=%d)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, other, status);
+
+# ifdef CONFLICT_TRACKING
   if (_tinystm.conflict_cb != NULL)
     _tinystm.conflict_cb(tx, other);
 # endif /* CONFLICT_TRACKING */
@@ -886,7 +2608,10 @@ int_stm_prepare(stm_tx_t *tx)
   if (tx->attr.visible_reads || (tx->visible_reads >= _tinystm.vr_threshold && _tinystm.vr_threshold >= 0)) {
     /* Use visible read */
     tx->attr.visible_reads = 1;
+#ifndef SHARED_VISIBLE_READS
+    /* Visible reads acquire locks */
     tx->attr.read_only = 0;
+#endif /* ! SHARED_VISIBLE_READS */
   }
 #endif /* CM == CM_MODULAR */
 
@@ -895,14 +2620,44 @@ int_stm_prepare(stm_tx_t *tx)
   tx->w_set.has_writes = 0;
   /* tx->w_set.nb_acquired = 0; */
 #ifdef USE_BLOOM_FILTER
-  tx->w_set.bloom = 0;
+  memset(tx->w_set.bloom, 0, sizeof(tx->w_set.bloom));
 #endif /* USE_BLOOM_FILTER */
+#ifdef WRITE_SET_HASH
+  stm_ws_hash_reset(tx);
+#endif /* WRITE_SET_HASH */
   tx->w_set.nb_entries = 0;
   tx->r_set.nb_entries = 0;
+#ifdef READ_SET_FILTER
+  tx->r_set.compact_at = RS_COMPACT_MIN;
+#endif /* READ_SET_FILTER */
+#if DESIGN == RING
+  memset(tx->ring_rsig, 0, sizeof(tx->ring_rsig));
+  memset(tx->ring_wsig, 0, sizeof(tx->ring_wsig));
+#endif /* DESIGN == RING */
+#ifdef IRREVOCABLE_IMPROVED
+  tx->empty_writes = 0;
+#endif /* IRREVOCABLE_IMPROVED */
+  tx->nb_extensions = 0;
+#ifdef SANDBOXING
+  tx->sb_reads = 0;
+#endif /* SANDBOXING */
+#ifdef CLOSED_NESTING
+  tx->nb_nested = 0;
+  tx->nested_undo_nb = 0;
+#endif /* CLOSED_NESTING */
+
+#ifdef PRIVATIZATION_FENCE
+  stm_fence_start(tx);
+#endif /* PRIVATIZATION_FENCE */
 
  start:
   /* Start timestamp */
   tx->start = tx->end = GET_CLOCK; /* OPT: Could be delayed until first read/write */
+#if DESIGN == NOREC || DESIGN == RING
+  /* Wait for commit in progress (snapshots start at even times) */
+  if (unlikely((tx->start & 1) != 0))
+    goto start;
+#endif /* DESIGN == NOREC || DESIGN == RING */
   if (unlikely(tx->start >= VERSION_MAX)) {
     /* Block all transactions and reset clock */
     stm_quiesce_barrier(tx, rollover_clock, NULL);
@@ -930,6 +2685,29 @@ int_stm_prepare(stm_tx_t *tx)
 #endif /* ! IRREVOCABLE_ENABLED */
 
   stm_check_quiesce(tx);
+
+#ifdef INLINE_FAST_PATH
+  /* Inlined loads of update transactions (the lock array may only change while quiescent) */
+  if (!tx->attr.read_only
+# ifdef IRREVOCABLE_ENABLED
+      && tx->irrevocable == 0
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef ELASTIC_TX
+      && !tx->attr.elastic
+# endif /* ELASTIC_TX */
+# if DESIGN == MODULAR
+      && tx->design->id != WRITE_BACK_CTL
+# endif /* DESIGN == MODULAR */
+# ifdef HELPER_VALIDATION
+      /* Only the library publishes the read set to the helper */
+      && _tinystm.hv_threshold == 0
+# endif /* HELPER_VALIDATION */
+     ) {
+    tx->fast_shift = LOCK_SHIFT;
+    tx->fast_mask = LOCK_MASK;
+    tx->fast_locks = _tinystm.locks;
+  }
+#endif /* INLINE_FAST_PATH */
 }
 
 /*
@@ -948,6 +2726,12 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
 
   PRINT_DEBUG("==> stm_rollback(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
+#ifdef HYBRID_HTM
+  /* Restart in software (does not return) */
+  if (tx->htm)
+    stm_htm_rollback(tx);
+#endif /* HYBRID_HTM */
+
   assert(IS_ACTIVE(tx->status));
 
 #ifdef IRREVOCABLE_ENABLED
@@ -955,6 +2739,25 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
   assert((tx->irrevocable & 0x07) != 3);
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef OBJECT_LOCKS
+  /* May abort in an object barrier */
+  tx->obj_lock = NULL;
+#endif /* OBJECT_LOCKS */
+
+#ifdef CLOSED_NESTING
+  /* Only rollback innermost closed nested transaction if possible */
+  if (tx->nb_nested > 0 && stm_nested_rollback(tx, reason))
+    return;
+#endif /* CLOSED_NESTING */
+
+#ifdef INLINE_FAST_PATH
+  tx->fast_locks = NULL;
+#endif /* INLINE_FAST_PATH */
+
+#ifdef TM_STATISTICS2
+  stm_prof_abort(tx);
+#endif /* TM_STATISTICS2 */
+
 #if CM == CM_MODULAR
   /* Set status to ABORTING */
   t = tx->status;
@@ -974,23 +2777,39 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
 #elif DESIGN == WRITE_THROUGH
   stm_wt_rollback(tx);
 #elif DESIGN == MODULAR
-  if (tx->attr.id == WRITE_BACK_CTL)
-    stm_wbctl_rollback(tx);
-  else if (tx->attr.id == WRITE_THROUGH)
-    stm_wt_rollback(tx);
-  else
-    stm_wbetl_rollback(tx);
-#endif /* DESIGN == MODULAR */
+  tx->design->rollback(tx);
+#elif DESIGN == NOREC
+  stm_norec_rollback(tx);
+#elif DESIGN == RING
+  stm_ring_rollback(tx);
+#endif /* DESIGN == RING */
+
+#ifdef WAIT_FUTEX
+  stm_futex_wake(tx);
+#endif /* WAIT_FUTEX */
 
 #if CM == CM_MODULAR
  dropped:
 #endif /* CM == CM_MODULAR */
 
+#ifdef SHARED_VISIBLE_READS
+  stm_vr_exit(tx);
+#endif /* SHARED_VISIBLE_READS */
+
+#ifdef HELPER_VALIDATION
+  stm_hv_release(tx);
+#endif /* HELPER_VALIDATION */
+
+#ifdef PRIVATIZATION_FENCE
+  stm_fence_end(tx);
+#endif /* PRIVATIZATION_FENCE */
+
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   tx->stat_retries++;
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
 #ifdef TM_STATISTICS
   tx->stat_aborts++;
+  tx->stat_prio_aborts[tx->attr.priority]++;
   if (tx->stat_retries_max < tx->stat_retries)
     tx->stat_retries_max = tx->stat_retries;
 #endif /* TM_STATISTICS */
@@ -1002,24 +2821,38 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
   else if (tx->stat_retries == 2)
     tx->stat_aborts_2++;
 #endif /* TM_STATISTICS2 */
+#ifdef ADAPTIVE_SCHEDULING
+  stm_ats_abort(tx, reason);
+#endif /* ADAPTIVE_SCHEDULING */
 
   /* Set status to ABORTED */
   SET_STATUS(tx->status, TX_ABORTED);
+  tx->abort_reason = reason;
 
   /* Abort for extending the write set */
   if (unlikely(reason == STM_ABORT_EXTEND_WS)) {
     stm_allocate_ws_entries(tx, 1);
   }
 
+#if CLOCK_MODE == CLOCK_DEFERRED
+  /* Versions newer than the clock would make the transaction (e.g., when
+   * read-only) fail again after restart: advance the clock */
+  if (reason == STM_ABORT_VAL_READ || reason == STM_ABORT_VAL_WRITE)
+    stm_clock_extend();
+#endif /* CLOCK_MODE == CLOCK_DEFERRED */
+
   /* Reset nesting level */
   tx->nesting = 1;
 
   /* Callbacks */
-  if (likely(_tinystm.nb_abort_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_abort_cb; cb++)
-      _tinystm.abort_cb[cb].f(_tinystm.abort_cb[cb].arg);
-  }
+  stm_callbacks(tx, &_tinystm.abort_cb);
+  /* Location of conflict is only reported to abort callbacks */
+  tx->conflict_addr = NULL;
+  tx->conflict_lock = NULL;
+
+#ifdef TM_STATISTICS2
+  stm_prof_enter(tx, PROF_WAIT);
+#endif /* TM_STATISTICS2 */
 
 #if CM == CM_BACKOFF
   /* Simple RNG (good enough for backoff) */
@@ -1037,22 +2870,66 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
 #if CM == CM_DELAY || CM == CM_MODULAR
   /* Wait until contented lock is free */
   if (tx->c_lock != NULL) {
+# ifdef WAIT_FUTEX
+    /* Spin for a while, then sleep */
+    stm_futex_wait(tx->c_lock);
+# else /* ! WAIT_FUTEX */
     /* Busy waiting (yielding is expensive) */
     while (LOCK_GET_OWNED(ATOMIC_LOAD(tx->c_lock))) {
-# ifdef WAIT_YIELD
+#  ifdef WAIT_YIELD
       sched_yield();
-# endif /* WAIT_YIELD */
+#  endif /* WAIT_YIELD */
     }
+# endif /* ! WAIT_FUTEX */
     tx->c_lock = NULL;
   }
 #endif /* CM == CM_DELAY || CM == CM_MODULAR */
+#ifdef SHARED_VISIBLE_READS
+  /* Wait until contented reader indicator is free */
+  if (tx->vr_c_slot != NULL)
+    stm_vr_backoff(tx);
+#endif /* SHARED_VISIBLE_READS */
 
   /* Don't prepare a new transaction if no retry. */
   if (tx->attr.no_retry || (reason & STM_ABORT_NO_RETRY) == STM_ABORT_NO_RETRY) {
     tx->nesting = 0;
+#ifdef ADAPTIVE_SCHEDULING
+    stm_ats_release(tx);
+#endif /* ADAPTIVE_SCHEDULING */
+#ifdef TM_STATISTICS2
+    stm_prof_end(tx);
+#endif /* TM_STATISTICS2 */
     return;
   }
 
+#ifdef ADAPTIVE_READ_ONLY
+  /* Leave learned read-only mode if the snapshot cannot be kept */
+  stm_ro_abort(tx, reason);
+#endif /* ADAPTIVE_READ_ONLY */
+
+#ifdef IRREVOCABLE_FALLBACK
+  /* Become irrevocable if the transaction aborted too often */
+  stm_fallback_abort(tx, reason);
+#endif /* IRREVOCABLE_FALLBACK */
+
+  /* Wait for an update of the read set before retrying */
+  if (reason == STM_ABORT_RETRY) {
+#ifdef BLOCKING_RETRY
+    stm_retry_wait(tx);
+#else /* ! BLOCKING_RETRY */
+    sched_yield();
+#endif /* ! BLOCKING_RETRY */
+  }
+
+#ifdef ADAPTIVE_SCHEDULING
+  /* Serialize transaction if contention is high */
+  stm_ats_schedule(tx);
+#endif /* ADAPTIVE_SCHEDULING */
+
+#ifdef TM_STATISTICS2
+  stm_prof_restart(tx);
+#endif /* TM_STATISTICS2 */
+
   /* Reset field to restart transaction */
   int_stm_prepare(tx);
 
@@ -1069,6 +2946,104 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
   LONGJMP(tx->env, reason);
 }
 
+#if defined(SANDBOXING) || defined(EPOCH_GC)
+/*
+ * Validate read set and extend snapshot (return 0 if invalid).
+ */
+static INLINE int
+stm_extend(stm_tx_t *tx)
+{
+#if DESIGN == WRITE_BACK_ETL
+  return stm_wbetl_extend(tx);
+#elif DESIGN == WRITE_BACK_CTL
+  return stm_wbctl_extend(tx);
+#elif DESIGN == WRITE_THROUGH
+  return stm_wt_extend(tx);
+#elif DESIGN == MODULAR
+  return tx->design->extend(tx);
+#elif DESIGN == NOREC
+  return stm_norec_extend(tx);
+#elif DESIGN == RING
+  return stm_ring_extend(tx);
+#endif /* DESIGN == RING */
+}
+#endif /* defined(SANDBOXING) || defined(EPOCH_GC) */
+
+#ifdef SANDBOXING
+/*
+ * Abort if the values read since the snapshot became inconsistent are
+ * not valid anymore.
+ */
+static NOINLINE void
+stm_sandbox_validate(stm_tx_t *tx)
+{
+  if (!stm_extend(tx)) {
+    SET_CONFLICT(tx, NULL, NULL);
+    stm_rollback(tx, STM_ABORT_VAL_READ);
+  }
+}
+#endif /* SANDBOXING */
+
+#ifdef EPOCH_GC
+/*
+ * Let the GC reclaim the memory freed since the start of the
+ * transaction: move the epoch of the thread forward by extending the
+ * snapshot (no pointer read before can then lead to memory freed
+ * earlier), or restart the transaction if it cannot be extended.
+ */
+static NOINLINE void
+stm_gc_pressure(stm_tx_t *tx)
+{
+  ATOMIC_STORE(tx->gc_pressure, 0);
+  /* Irrevocable transactions cannot restart and elastic ones do not validate all their reads */
+  if (!IS_ACTIVE(tx->status) || tx->attr.elastic)
+    return;
+# ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable != 0)
+    return;
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef TM_STATISTICS
+  tx->stat_gc_pressure++;
+# endif /* TM_STATISTICS */
+  if (!tx->attr.read_only && stm_extend(tx)) {
+    gc_set_epoch(tx->end);
+    return;
+  }
+  stm_rollback(tx, STM_ABORT_KILLED);
+}
+#endif /* EPOCH_GC */
+
+/*
+ * Checks after each read (also by the compiler barriers).
+ */
+static INLINE void
+stm_read_checks(stm_tx_t *tx)
+{
+#ifdef SANDBOXING
+  /* Bound execution on an inconsistent snapshot (e.g., in loops) */
+  if (unlikely(tx->sb_reads != 0) && ++tx->sb_reads > SANDBOX_PERIOD)
+    stm_sandbox_validate(tx);
+#endif /* SANDBOXING */
+#ifdef EPOCH_GC
+  /* Stop holding back reclamation if the GC backlog is too large */
+  if (unlikely(*tx->gc_pressure != 0))
+    stm_gc_pressure(tx);
+#endif /* EPOCH_GC */
+}
+
+/*
+ * Checks before each write (also by the compiler barriers).
+ */
+static INLINE void
+stm_write_checks(stm_tx_t *tx)
+{
+#ifdef SANDBOXING
+  /* Never write to an address computed from inconsistent values */
+  if (unlikely(tx->sb_reads != 0))
+    stm_sandbox_validate(tx);
+#endif /* SANDBOXING */
+}
+
 /*
  * Store a word-sized value (return write set entry or NULL).
  */
@@ -1089,11 +3064,31 @@ stm_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t
   assert(IS_ACTIVE(tx->status));
 #endif /* CM != CM_MODULAR */
 
+#ifdef ADAPTIVE_READ_ONLY
+  if (stm_ro_write(tx))
+    return NULL;
+#endif /* ADAPTIVE_READ_ONLY */
+
 #ifdef DEBUG
   /* Check consistency with read_only attribute. */
   assert(!tx->attr.read_only);
 #endif /* DEBUG */
 
+#ifdef HYBRID_HTM
+  if (tx->htm) {
+    stm_htm_write(tx, addr, value, mask);
+    return NULL;
+  }
+#endif /* HYBRID_HTM */
+
+  stm_write_checks(tx);
+
+#ifdef IRREVOCABLE_IMPROVED
+  /* Empty writes must update versions (e.g., stm_free()), reads of irrevocable transactions do not */
+  if (unlikely(mask == 0))
+    tx->empty_writes = 1;
+#endif /* IRREVOCABLE_IMPROVED */
+
 #if DESIGN == WRITE_BACK_ETL
   w = stm_wbetl_write(tx, addr, value, mask);
 #elif DESIGN == WRITE_BACK_CTL
@@ -1101,122 +3096,78 @@ stm_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t
 #elif DESIGN == WRITE_THROUGH
   w = stm_wt_write(tx, addr, value, mask);
 #elif DESIGN == MODULAR
-  if (tx->attr.id == WRITE_BACK_CTL)
-    w = stm_wbctl_write(tx, addr, value, mask);
-  else if (tx->attr.id == WRITE_THROUGH)
-    w = stm_wt_write(tx, addr, value, mask);
-  else
-    w = stm_wbetl_write(tx, addr, value, mask);
-#endif /* DESIGN == WRITE_THROUGH */
+  w = tx->design->write(tx, addr, value, mask);
+#elif DESIGN == NOREC
+  w = stm_norec_write(tx, addr, value, mask);
+#elif DESIGN == RING
+  w = stm_ring_write(tx, addr, value, mask);
+#endif /* DESIGN == RING */
 
   return w;
 }
 
-static INLINE stm_word_t
-int_stm_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
-{
-  stm_word_t value;
-#if DESIGN == WRITE_BACK_ETL
-  value = stm_wbetl_RaR(tx, addr);
-#elif DESIGN == WRITE_BACK_CTL
-  value = stm_wbctl_RaR(tx, addr);
-#elif DESIGN == WRITE_THROUGH
-  value = stm_wt_RaR(tx, addr);
-#endif /* DESIGN == WRITE_THROUGH */
-  return value;
-}
-
-static INLINE stm_word_t
-int_stm_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
-{
-  stm_word_t value;
-#if DESIGN == WRITE_BACK_ETL
-  value = stm_wbetl_RaW(tx, addr);
-#elif DESIGN == WRITE_BACK_CTL
-  value = stm_wbctl_RaW(tx, addr);
-#elif DESIGN == WRITE_THROUGH
-  value = stm_wt_RaW(tx, addr);
-#endif /* DESIGN == WRITE_THROUGH */
-  return value;
-}
-
-static INLINE stm_word_t
-int_stm_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
-{
-  stm_word_t value;
-#if DESIGN == WRITE_BACK_ETL
-  value = stm_wbetl_RfW(tx, addr);
-#elif DESIGN == WRITE_BACK_CTL
-  value = stm_wbctl_RfW(tx, addr);
-#elif DESIGN == WRITE_THROUGH
-  value = stm_wt_RfW(tx, addr);
-#endif /* DESIGN == WRITE_THROUGH */
-  return value;
-}
-
-static INLINE void
-int_stm_WaR(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
-{
-#if DESIGN == WRITE_BACK_ETL
-  stm_wbetl_WaR(tx, addr, value, mask);
-#elif DESIGN == WRITE_BACK_CTL
-  stm_wbctl_WaR(tx, addr, value, mask);
-#elif DESIGN == WRITE_THROUGH
-  stm_wt_WaR(tx, addr, value, mask);
-#endif /* DESIGN == WRITE_THROUGH */
-}
-
+/*
+ * Initialize fields of new or reused transaction descriptor.
+ */
 static INLINE void
-int_stm_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+stm_init_tx(stm_tx_t *tx)
 {
-#if DESIGN == WRITE_BACK_ETL
-  stm_wbetl_WaW(tx, addr, value, mask);
-#elif DESIGN == WRITE_BACK_CTL
-  stm_wbctl_WaW(tx, addr, value, mask);
-#elif DESIGN == WRITE_THROUGH
-  stm_wt_WaW(tx, addr, value, mask);
-#endif /* DESIGN == WRITE_THROUGH */
-}
-
-static INLINE stm_tx_t *
-int_stm_init_thread(void)
-{
-  stm_tx_t *tx;
-
-  PRINT_DEBUG("==> stm_init_thread()\n");
-
-  /* Avoid initializing more than once */
-  if ((tx = tls_get_tx()) != NULL)
-    return tx;
-
-#ifdef EPOCH_GC
-  gc_init_thread();
-#endif /* EPOCH_GC */
-
-  /* Allocate descriptor */
-  tx = (stm_tx_t *)xmalloc_aligned(sizeof(stm_tx_t));
   /* Set attribute */
   tx->attr = (stm_tx_attr_t)0;
-  /* Set status (no need for CAS or atomic op) */
-  tx->status = TX_IDLE;
+#if DESIGN == MODULAR
+  tx->design = _tinystm.design;
+#endif /* DESIGN == MODULAR */
   /* Read set */
   tx->r_set.nb_entries = 0;
-  tx->r_set.size = RW_SET_SIZE;
-  stm_allocate_rs_entries(tx, 0);
   /* Write set */
   tx->w_set.nb_entries = 0;
-  tx->w_set.size = RW_SET_SIZE;
+  tx->w_set.last = 0;
+#ifdef STACK_CHECK
+  /* No filtering until the bounds of the stack are known */
+  tx->stack_low = 0;
+  tx->stack_size = 0;
+#endif /* STACK_CHECK */
+  tx->abort_reason = 0;
+  tx->nb_extensions = 0;
+#ifdef SANDBOXING
+  tx->sb_reads = 0;
+#endif /* SANDBOXING */
+#ifdef EPOCH_GC
+  /* Descriptor may be reused with another GC slot */
+  tx->gc_pressure = gc_pressure_flag();
+#endif /* EPOCH_GC */
+#ifdef HELPER_VALIDATION
+  tx->hv = NULL;
+#endif /* HELPER_VALIDATION */
+  tx->conflict_addr = NULL;
+  tx->conflict_lock = NULL;
+#ifdef OBJECT_LOCKS
+  tx->obj_lock = NULL;
+#endif /* OBJECT_LOCKS */
+#ifdef INLINE_FAST_PATH
+  tx->fast_locks = NULL;
+# ifdef EPOCH_GC
+  /* Stop holding back reclamation upon GC pressure (see stm_read_checks()) */
+  tx->fast_stop = (const volatile stm_word_t *)tx->gc_pressure;
+# else /* ! EPOCH_GC */
+  tx->fast_stop = &stm_fast_go;
+# endif /* ! EPOCH_GC */
+#endif /* INLINE_FAST_PATH */
   /* has_writes / nb_acquired are the same field. */
   tx->w_set.has_writes = 0;
   /* tx->w_set.nb_acquired = 0; */
 #ifdef USE_BLOOM_FILTER
-  tx->w_set.bloom = 0;
+  memset(tx->w_set.bloom, 0, sizeof(tx->w_set.bloom));
 #endif /* USE_BLOOM_FILTER */
-  stm_allocate_ws_entries(tx, 0);
   /* Nesting level */
   tx->nesting = 0;
+#ifdef CLOSED_NESTING
+  tx->nb_nested = 0;
+  tx->nested_undo_nb = 0;
+#endif /* CLOSED_NESTING */
   /* Transaction-specific data */
   memset(tx->data, 0, MAX_SPECIFIC * sizeof(void *));
+  tx->data_ext = NULL;
 #ifdef CONFLICT_TRACKING
   /* Thread identifier */
   tx->thread_id = pthread_self();
@@ -1237,11 +3188,54 @@ int_stm_init_thread(void)
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   tx->stat_retries = 0;
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
+#ifdef SHARED_VISIBLE_READS
+  tx->vr_waiting = 0;
+  tx->vr_c_slot = NULL;
+  tx->vr_seed = (unsigned long)tx | 1;
+  tx->vr_nb = 0;
+  memset(tx->vr_held, 0, sizeof(tx->vr_held));
+#endif /* SHARED_VISIBLE_READS */
+#ifdef ADAPTIVE_SCHEDULING
+  tx->ats_intensity = 0;
+  tx->ats_queue = NULL;
+#endif /* ADAPTIVE_SCHEDULING */
 #ifdef TM_STATISTICS
   /* Statistics */
   tx->stat_commits = 0;
   tx->stat_aborts = 0;
   tx->stat_retries_max = 0;
+# ifdef CLOSED_NESTING
+  tx->stat_nested_aborts = 0;
+# endif /* CLOSED_NESTING */
+# ifdef ADAPTIVE_SCHEDULING
+  tx->stat_serialized = 0;
+# endif /* ADAPTIVE_SCHEDULING */
+# ifdef IRREVOCABLE_ENABLED
+  tx->stat_irrevocable = 0;
+  tx->stat_irrevocable_stopped = 0;
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef STACK_CHECK
+  tx->stat_stack_filtered = 0;
+# endif /* STACK_CHECK */
+# ifdef ADAPTIVE_RW_SETS
+  tx->stat_rw_resizes = 0;
+# endif /* ADAPTIVE_RW_SETS */
+# ifdef ADAPTIVE_READ_ONLY
+  tx->stat_ro_hits = 0;
+  tx->stat_ro_misses = 0;
+# endif /* ADAPTIVE_READ_ONLY */
+# ifdef IRREVOCABLE_FALLBACK
+  tx->stat_fallbacks = 0;
+# endif /* IRREVOCABLE_FALLBACK */
+# ifdef EPOCH_GC
+  tx->stat_gc_pressure = 0;
+# endif /* EPOCH_GC */
+# ifdef HELPER_VALIDATION
+  tx->stat_hv_skipped = 0;
+# endif /* HELPER_VALIDATION */
+  memset(tx->stat_prio_commits, 0, sizeof(tx->stat_prio_commits));
+  memset(tx->stat_prio_aborts, 0, sizeof(tx->stat_prio_aborts));
+  memset(tx->stat_prio_cycles, 0, sizeof(tx->stat_prio_cycles));
 #endif /* TM_STATISTICS */
 #ifdef TM_STATISTICS2
   tx->stat_aborts_1 = 0;
@@ -1251,20 +3245,110 @@ int_stm_init_thread(void)
   tx->stat_locked_reads_ok = 0;
   tx->stat_locked_reads_failed = 0;
 # endif /* READ_LOCKED_DATA */
+  tx->prof = 0;
+  tx->prof_count = 0;
+  tx->prof_samples = 0;
+  memset(tx->prof_cycles, 0, sizeof(tx->prof_cycles));
+  tx->prof_aborted = 0;
 #endif /* TM_STATISTICS2 */
+#ifdef HYBRID_HTM
+  tx->htm = 0;
+  tx->stat_htm_commits = 0;
+  tx->stat_htm_aborts = 0;
+  tx->stat_htm_fallbacks = 0;
+  memset(tx->stat_htm_aborts_r, 0, sizeof(unsigned int) * HTM_STAT_NB);
+#endif /* HYBRID_HTM */
 #ifdef IRREVOCABLE_ENABLED
   tx->irrevocable = 0;
 #endif /* IRREVOCABLE_ENABLED */
+#ifdef NON_TEMPORAL_STORES
+  tx->nt_stores = tx->nt_pending = 0;
+#endif /* NON_TEMPORAL_STORES */
+#ifdef ADAPTIVE_RW_SETS
+  stm_rwset_init(tx);
+#endif /* ADAPTIVE_RW_SETS */
+#ifdef ADAPTIVE_READ_ONLY
+  stm_ro_init(tx);
+#endif /* ADAPTIVE_READ_ONLY */
+#ifdef IRREVOCABLE_FALLBACK
+  tx->fallback = &_tinystm.fallback_default;
+  tx->fb_retries = 0;
+  tx->fb_cycles = 0;
+#endif /* IRREVOCABLE_FALLBACK */
+}
+
+static INLINE stm_tx_t *
+int_stm_init_thread(void)
+{
+  stm_tx_t *tx;
+
+  PRINT_DEBUG("==> stm_init_thread()\n");
+
+  /* Avoid initializing more than once */
+  if ((tx = tls_get_tx()) != NULL)
+    return tx;
+
+#ifdef EPOCH_GC
+  gc_init_thread();
+#endif /* EPOCH_GC */
+
+#ifdef DESCRIPTOR_POOL
+  /* Reuse descriptor of a thread that has exited */
+  if ((tx = stm_pool_get()) != NULL) {
+    stm_init_tx(tx);
+    tls_set_tx(tx);
+    goto callbacks;
+  }
+#endif /* DESCRIPTOR_POOL */
+
+  /* Allocate descriptor */
+  tx = (stm_tx_t *)xmalloc_aligned(sizeof(stm_tx_t));
+  /* Set status (no need for CAS or atomic op) */
+  tx->status = TX_IDLE;
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL
+  tx->lock_seq = 0;
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL */
+  /* Read set */
+  tx->r_set.size = RW_SET_SIZE;
+  stm_allocate_rs_entries(tx, 0);
+  /* Write set */
+  tx->w_set.size = RW_SET_SIZE;
+#ifdef PROCESS_SHARED
+  stm_shm_enter_thread(tx);
+#endif /* PROCESS_SHARED */
+#ifdef WRITE_SET_HASH
+  tx->w_set.hash = NULL;
+  tx->w_set.hash_size = 0;
+  tx->w_set.hash_gen = 0;
+  tx->w_set.nb_indexed = 0;
+#endif /* WRITE_SET_HASH */
+#ifdef SORTED_COMMIT
+  tx->w_set.sorted = NULL;
+  tx->w_set.sorted_size = 0;
+#endif /* SORTED_COMMIT */
+  stm_allocate_ws_entries(tx, 0);
+#ifdef CLOSED_NESTING
+  tx->nested_undo = NULL;
+  tx->nested_undo_size = 0;
+#endif /* CLOSED_NESTING */
+#ifdef DURABLE_TX
+  stm_durable_enter_thread(tx);
+#endif /* DURABLE_TX */
+#ifdef DESCRIPTOR_POOL
+  tx->attached = 1;
+#endif /* DESCRIPTOR_POOL */
+  stm_init_tx(tx);
   /* Store as thread-local data */
   tls_set_tx(tx);
   stm_quiesce_enter_thread(tx);
 
+#ifdef DESCRIPTOR_POOL
+ callbacks:
+#endif /* DESCRIPTOR_POOL */
+  /* All modules are enabled for a new thread */
+  tx->cb_disabled = 0;
   /* Callbacks */
-  if (likely(_tinystm.nb_init_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_init_cb; cb++)
-      _tinystm.init_cb[cb].f(_tinystm.init_cb[cb].arg);
-  }
+  stm_callbacks(tx, &_tinystm.init_cb);
 
   return tx;
 }
@@ -1283,11 +3367,7 @@ int_stm_exit_thread(stm_tx_t *tx)
     return;
 
   /* Callbacks */
-  if (likely(_tinystm.nb_exit_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_exit_cb; cb++)
-      _tinystm.exit_cb[cb].f(_tinystm.exit_cb[cb].arg);
-  }
+  stm_callbacks(tx, &_tinystm.exit_cb);
 
 #ifdef TM_STATISTICS
   /* Display statistics before to lose it */
@@ -1299,17 +3379,49 @@ int_stm_exit_thread(stm_tx_t *tx)
   }
 #endif /* TM_STATISTICS */
 
+#ifdef DESCRIPTOR_POOL
+  /* Keep descriptor and its sets for next thread */
+  stm_pool_put(tx);
+  return;
+#endif /* DESCRIPTOR_POOL */
+
   stm_quiesce_exit_thread(tx);
+#ifdef PROCESS_SHARED
+  stm_shm_exit_thread(tx);
+#endif /* PROCESS_SHARED */
+#ifdef DURABLE_TX
+  stm_durable_exit_thread(tx);
+#endif /* DURABLE_TX */
 
 #ifdef EPOCH_GC
   t = GET_CLOCK;
   gc_free(tx->r_set.entries, t);
   gc_free(tx->w_set.entries, t);
+# ifdef WRITE_SET_HASH
+  xfree(tx->w_set.hash);
+# endif /* WRITE_SET_HASH */
+# ifdef SORTED_COMMIT
+  xfree(tx->w_set.sorted);
+# endif /* SORTED_COMMIT */
+# ifdef CLOSED_NESTING
+  xfree(tx->nested_undo);
+# endif /* CLOSED_NESTING */
+  stm_specific_free(tx);
   gc_free(tx, t);
   gc_exit_thread();
 #else /* ! EPOCH_GC */
   xfree(tx->r_set.entries);
   xfree(tx->w_set.entries);
+# ifdef WRITE_SET_HASH
+  xfree(tx->w_set.hash);
+# endif /* WRITE_SET_HASH */
+# ifdef SORTED_COMMIT
+  xfree(tx->w_set.sorted);
+# endif /* SORTED_COMMIT */
+# ifdef CLOSED_NESTING
+  xfree(tx->nested_undo);
+# endif /* CLOSED_NESTING */
+  stm_specific_free(tx);
   xfree(tx);
 #endif /* ! EPOCH_GC */
 
@@ -1325,21 +3437,58 @@ int_stm_start(stm_tx_t *tx, stm_tx_attr_t attr)
    * with parent ones.  */
 
   /* Increment nesting level */
-  if (tx->nesting++ > 0)
+  if (tx->nesting++ > 0) {
+#ifdef CLOSED_NESTING
+    if (attr.closed_nesting)
+      return stm_nested_start(tx);
+#endif /* CLOSED_NESTING */
     return NULL;
+  }
 
   /* Attributes */
   tx->attr = attr;
+#if DESIGN == MODULAR
+  /* Atomic blocks can select their design, other ones use the default */
+  if (attr.id == WRITE_BACK_CTL || attr.id == WRITE_THROUGH)
+    tx->design = &stm_designs[attr.id];
+  else
+    tx->design = _tinystm.design;
+#endif /* DESIGN == MODULAR */
+#ifdef ELASTIC_TX
+  /* Elastic transactions need a read set to extend their snapshot */
+  if (attr.elastic)
+    tx->attr.read_only = 0;
+#endif /* ELASTIC_TX */
+#ifdef ADAPTIVE_RW_SETS
+  stm_rwset_start(tx);
+#endif /* ADAPTIVE_RW_SETS */
+#ifdef TM_STATISTICS2
+  stm_prof_start(tx);
+#endif /* TM_STATISTICS2 */
+#ifdef IRREVOCABLE_FALLBACK
+  stm_fallback_start(tx);
+#endif /* IRREVOCABLE_FALLBACK */
+#ifdef ADAPTIVE_READ_ONLY
+  stm_ro_start(tx);
+#endif /* ADAPTIVE_READ_ONLY */
+#ifdef TM_STATISTICS
+  tx->prio_ts = stm_cycles();
+#endif /* TM_STATISTICS */
+
+#ifdef ADAPTIVE_SCHEDULING
+  /* Serialize transaction if contention is high */
+  stm_ats_schedule(tx);
+#endif /* ADAPTIVE_SCHEDULING */
 
+#ifdef HYBRID_HTM
+  /* Try first to execute in hardware */
+  if (!stm_htm_start(tx))
+#endif /* HYBRID_HTM */
   /* Initialize transaction descriptor */
   int_stm_prepare(tx);
 
   /* Callbacks */
-  if (likely(_tinystm.nb_start_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_start_cb; cb++)
-      _tinystm.start_cb[cb].f(_tinystm.start_cb[cb].arg);
-  }
+  stm_callbacks(tx, &_tinystm.start_cb);
 
   return &tx->env;
 }
@@ -1354,17 +3503,44 @@ int_stm_commit(stm_tx_t *tx)
   PRINT_DEBUG("==> stm_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
   /* Decrement nesting level */
-  if (unlikely(--tx->nesting > 0))
+  if (unlikely(--tx->nesting > 0)) {
+#ifdef CLOSED_NESTING
+    /* Merge closed nested transactions (and drop savepoints) into their parent */
+    while (tx->nb_nested > 0 && tx->nested[tx->nb_nested - 1].nesting > tx->nesting)
+      stm_nested_commit(tx);
+#endif /* CLOSED_NESTING */
     return 1;
+  }
+
+#ifdef TM_STATISTICS2
+  stm_prof_enter(tx, PROF_COMMIT);
+#endif /* TM_STATISTICS2 */
 
   /* Callbacks */
-  if (unlikely(_tinystm.nb_precommit_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_precommit_cb; cb++)
-      _tinystm.precommit_cb[cb].f(_tinystm.precommit_cb[cb].arg);
+  stm_callbacks(tx, &_tinystm.precommit_cb);
+
+  /* Pre-commit callbacks may access memory and abort without restart */
+  if (unlikely(!IS_ACTIVE(tx->status)))
+    return 0;
+
+#ifdef HYBRID_HTM
+  if (tx->htm) {
+    stm_htm_commit(tx);
+# ifdef EPOCH_GC
+    /* Hardware transactions do not update the epoch upon start */
+    gc_set_epoch(GET_CLOCK);
+# endif /* EPOCH_GC */
+    goto end;
   }
+#endif /* HYBRID_HTM */
 
-  assert(IS_ACTIVE(tx->status));
+#ifdef SHARED_VISIBLE_READS
+  /* Wait for readers of written locks (while we can still be killed) */
+  if (tx->w_set.nb_entries != 0 && (t = stm_vr_wait(tx)) != 0) {
+    stm_rollback(tx, (unsigned int)t);
+    return 0;
+  }
+#endif /* SHARED_VISIBLE_READS */
 
 #if CM == CM_MODULAR
   /* Set status to COMMITTING */
@@ -1378,32 +3554,70 @@ int_stm_commit(stm_tx_t *tx)
 #endif /* CM == CM_MODULAR */
 
   /* A read-only transaction can commit immediately */
-  if (unlikely(tx->w_set.nb_entries == 0))
+  if (unlikely(tx->w_set.nb_entries == 0)) {
+#ifdef SANDBOXING
+    /* Unless its snapshot is inconsistent */
+    if (unlikely(tx->sb_reads != 0))
+      stm_sandbox_validate(tx);
+#endif /* SANDBOXING */
     goto end;
+  }
 
-  /* Update transaction */
+  /* Update transaction (rolled back without restart if it fails with no_retry) */
 #if DESIGN == WRITE_BACK_ETL
-  stm_wbetl_commit(tx);
+  if (!stm_wbetl_commit(tx))
+    return 0;
 #elif DESIGN == WRITE_BACK_CTL
-  stm_wbctl_commit(tx);
+  if (!stm_wbctl_commit(tx))
+    return 0;
 #elif DESIGN == WRITE_THROUGH
-  stm_wt_commit(tx);
+  if (!stm_wt_commit(tx))
+    return 0;
 #elif DESIGN == MODULAR
-  if (tx->attr.id == WRITE_BACK_CTL)
-    stm_wbctl_commit(tx);
-  else if (tx->attr.id == WRITE_THROUGH)
-    stm_wt_commit(tx);
-  else
-    stm_wbetl_commit(tx);
-#endif /* DESIGN == MODULAR */
+  if (!tx->design->commit(tx))
+    return 0;
+#elif DESIGN == NOREC
+  if (!stm_norec_commit(tx))
+    return 0;
+#elif DESIGN == RING
+  if (!stm_ring_commit(tx))
+    return 0;
+#endif /* DESIGN == RING */
+
+#ifdef WAIT_FUTEX
+  stm_futex_wake(tx);
+#endif /* WAIT_FUTEX */
+#ifdef BLOCKING_RETRY
+  stm_retry_wake(tx);
+#endif /* BLOCKING_RETRY */
 
  end:
+#ifdef INLINE_FAST_PATH
+  tx->fast_locks = NULL;
+#endif /* INLINE_FAST_PATH */
+#ifdef SHARED_VISIBLE_READS
+  stm_vr_exit(tx);
+#endif /* SHARED_VISIBLE_READS */
+#ifdef HELPER_VALIDATION
+  stm_hv_release(tx);
+#endif /* HELPER_VALIDATION */
+#ifdef PRIVATIZATION_FENCE
+  stm_fence_end(tx);
+#endif /* PRIVATIZATION_FENCE */
 #ifdef TM_STATISTICS
   tx->stat_commits++;
+  tx->stat_prio_commits[tx->attr.priority]++;
+  tx->stat_prio_cycles[tx->attr.priority] += stm_cycles() - tx->prio_ts;
 #endif /* TM_STATISTICS */
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   tx->stat_retries = 0;
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
+#ifdef ADAPTIVE_RW_SETS
+  stm_rwset_commit(tx);
+#endif /* ADAPTIVE_RW_SETS */
+#ifdef ADAPTIVE_READ_ONLY
+  stm_ro_commit(tx);
+#endif /* ADAPTIVE_READ_ONLY */
 
 #if CM == CM_BACKOFF
   /* Reset backoff */
@@ -1414,24 +3628,29 @@ int_stm_commit(stm_tx_t *tx)
   tx->visible_reads = 0;
 #endif /* CM == CM_MODULAR */
 
+#ifdef ADAPTIVE_SCHEDULING
+  stm_ats_record(tx, 0);
+  stm_ats_release(tx);
+#endif /* ADAPTIVE_SCHEDULING */
+
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable)) {
-    ATOMIC_STORE(&_tinystm.irrevocable, 0);
+    ATOMIC_STORE(&IRREVOCABLE_FLAG, 0);
     if ((tx->irrevocable & 0x08) != 0)
       stm_quiesce_release(tx);
     tx->irrevocable = 0;
   }
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef TM_STATISTICS2
+  stm_prof_end(tx);
+#endif /* TM_STATISTICS2 */
+
   /* Set status to COMMITTED */
   SET_STATUS(tx->status, TX_COMMITTED);
 
   /* Callbacks */
-  if (likely(_tinystm.nb_commit_cb != 0)) {
-    unsigned int cb;
-    for (cb = 0; cb < _tinystm.nb_commit_cb; cb++)
-      _tinystm.commit_cb[cb].f(_tinystm.commit_cb[cb].arg);
-  }
+  stm_callbacks(tx, &_tinystm.commit_cb);
 
   return 1;
 }
@@ -1439,32 +3658,518 @@ int_stm_commit(stm_tx_t *tx)
 static INLINE stm_word_t
 int_stm_load(stm_tx_t *tx, volatile stm_word_t *addr)
 {
+  stm_word_t value;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
+
+#ifdef HYBRID_HTM
+  if (tx->htm)
+    return stm_htm_read(tx, addr);
+#endif /* HYBRID_HTM */
+#ifdef MULTI_VERSION
+  /* Read-only transactions read from their snapshot */
+  if (tx->attr.read_only)
+    return stm_mv_read(tx, addr);
+#endif /* MULTI_VERSION */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_READ);
+#endif /* TM_STATISTICS2 */
 #if DESIGN == WRITE_BACK_ETL
-  return stm_wbetl_read(tx, addr);
+  value = stm_wbetl_read(tx, addr);
 #elif DESIGN == WRITE_BACK_CTL
-  return stm_wbctl_read(tx, addr);
+  value = stm_wbctl_read(tx, addr);
 #elif DESIGN == WRITE_THROUGH
-  return stm_wt_read(tx, addr);
+  value = stm_wt_read(tx, addr);
 #elif DESIGN == MODULAR
-  if (tx->attr.id == WRITE_BACK_CTL)
-    return stm_wbctl_read(tx, addr);
-  else if (tx->attr.id == WRITE_THROUGH)
-    return stm_wt_read(tx, addr);
-  else
-    return stm_wbetl_read(tx, addr);
-#endif /* DESIGN == MODULAR */
+  value = tx->design->read(tx, addr);
+#elif DESIGN == NOREC
+  value = stm_norec_read(tx, addr);
+#elif DESIGN == RING
+  value = stm_ring_read(tx, addr);
+#endif /* DESIGN == RING */
+#ifdef ELASTIC_TX
+  if (unlikely(tx->attr.elastic))
+    stm_elastic_cut(tx);
+#endif /* ELASTIC_TX */
+  stm_read_checks(tx);
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
+  return value;
 }
 
 static INLINE void
 int_stm_store(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value)
 {
+#ifdef TM_STATISTICS2
+  int phase = stm_prof_enter(tx, PROF_WRITE);
   stm_write(tx, addr, value, ~(stm_word_t)0);
+  stm_prof_leave(tx, phase);
+#else /* ! TM_STATISTICS2 */
+  stm_write(tx, addr, value, ~(stm_word_t)0);
+#endif /* ! TM_STATISTICS2 */
 }
 
 static INLINE void
 int_stm_store2(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
 {
+#ifdef TM_STATISTICS2
+  int phase = stm_prof_enter(tx, PROF_WRITE);
   stm_write(tx, addr, value, mask);
+  stm_prof_leave(tx, phase);
+#else /* ! TM_STATISTICS2 */
+  stm_write(tx, addr, value, mask);
+#endif /* ! TM_STATISTICS2 */
+}
+
+static INLINE stm_word_t
+int_stm_load_obj(stm_tx_t *tx, void *obj, volatile stm_word_t *addr)
+{
+#ifdef OBJECT_LOCKS
+  stm_word_t value;
+
+  tx->obj_lock = OBJ_LOCK(obj);
+  value = int_stm_load(tx, addr);
+  tx->obj_lock = NULL;
+  return value;
+#else /* ! OBJECT_LOCKS */
+  return int_stm_load(tx, addr);
+#endif /* ! OBJECT_LOCKS */
+}
+
+static INLINE void
+int_stm_store2_obj(stm_tx_t *tx, void *obj, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+#ifdef OBJECT_LOCKS
+  tx->obj_lock = OBJ_LOCK(obj);
+  int_stm_store2(tx, addr, value, mask);
+  tx->obj_lock = NULL;
+#else /* ! OBJECT_LOCKS */
+  int_stm_store2(tx, addr, value, mask);
+#endif /* ! OBJECT_LOCKS */
+}
+
+static INLINE stm_word_t
+int_stm_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+#ifdef HYBRID_HTM
+  if (tx->htm)
+    return stm_htm_read(tx, addr);
+#endif /* HYBRID_HTM */
+#ifdef MULTI_VERSION
+  if (tx->attr.read_only)
+    return stm_mv_read(tx, addr);
+#endif /* MULTI_VERSION */
+#ifdef ELASTIC_TX
+  /* Reads may have been removed from the read set */
+  if (unlikely(tx->attr.elastic))
+    return int_stm_load(tx, addr);
+#endif /* ELASTIC_TX */
+#if DESIGN == WRITE_BACK_ETL
+  value = stm_wbetl_RaR(tx, addr);
+#elif DESIGN == WRITE_BACK_CTL
+  value = stm_wbctl_RaR(tx, addr);
+#elif DESIGN == WRITE_THROUGH
+  value = stm_wt_RaR(tx, addr);
+#elif DESIGN == MODULAR
+  value = tx->design->RaR(tx, addr);
+#elif DESIGN == NOREC
+  value = stm_norec_RaR(tx, addr);
+#elif DESIGN == RING
+  value = stm_ring_RaR(tx, addr);
+#endif /* DESIGN == RING */
+  stm_read_checks(tx);
+  return value;
+}
+
+static INLINE stm_word_t
+int_stm_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+#ifdef HYBRID_HTM
+  if (tx->htm)
+    return stm_htm_read(tx, addr);
+#endif /* HYBRID_HTM */
+#ifdef MULTI_VERSION
+  if (tx->attr.read_only)
+    return stm_mv_read(tx, addr);
+#endif /* MULTI_VERSION */
+#if DESIGN == WRITE_BACK_ETL
+  value = stm_wbetl_RaW(tx, addr);
+#elif DESIGN == WRITE_BACK_CTL
+  value = stm_wbctl_RaW(tx, addr);
+#elif DESIGN == WRITE_THROUGH
+  value = stm_wt_RaW(tx, addr);
+#elif DESIGN == MODULAR
+  value = tx->design->RaW(tx, addr);
+#elif DESIGN == NOREC
+  value = stm_norec_RaW(tx, addr);
+#elif DESIGN == RING
+  value = stm_ring_RaW(tx, addr);
+#endif /* DESIGN == RING */
+  stm_read_checks(tx);
+  return value;
+}
+
+static INLINE stm_word_t
+int_stm_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+#ifdef HYBRID_HTM
+  if (tx->htm)
+    return stm_htm_read(tx, addr);
+#endif /* HYBRID_HTM */
+#ifdef ADAPTIVE_READ_ONLY
+  /* Reads for write acquire the lock */
+  if (stm_ro_write(tx))
+    return 0;
+#endif /* ADAPTIVE_READ_ONLY */
+#ifdef MULTI_VERSION
+  if (tx->attr.read_only)
+    return stm_mv_read(tx, addr);
+#endif /* MULTI_VERSION */
+#if DESIGN == WRITE_BACK_ETL
+  value = stm_wbetl_RfW(tx, addr);
+#elif DESIGN == WRITE_BACK_CTL
+  value = stm_wbctl_RfW(tx, addr);
+#elif DESIGN == WRITE_THROUGH
+  value = stm_wt_RfW(tx, addr);
+#elif DESIGN == MODULAR
+  value = tx->design->RfW(tx, addr);
+#elif DESIGN == NOREC
+  value = stm_norec_RfW(tx, addr);
+#elif DESIGN == RING
+  value = stm_ring_RfW(tx, addr);
+#endif /* DESIGN == RING */
+  stm_read_checks(tx);
+  return value;
+}
+
+static INLINE void
+int_stm_WaR(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+#if CM == CM_MODULAR
+  if (GET_STATUS(tx->status) == TX_KILLED) {
+    stm_rollback(tx, STM_ABORT_KILLED);
+    return;
+  }
+#endif /* CM == CM_MODULAR */
+#ifdef HYBRID_HTM
+  if (tx->htm) {
+    stm_htm_write(tx, addr, value, mask);
+    return;
+  }
+#endif /* HYBRID_HTM */
+  stm_write_checks(tx);
+#ifdef IRREVOCABLE_IMPROVED
+  /* Empty writes must update versions (e.g., stm_free()), reads of irrevocable transactions do not */
+  if (unlikely(mask == 0))
+    tx->empty_writes = 1;
+#endif /* IRREVOCABLE_IMPROVED */
+#ifdef ADAPTIVE_READ_ONLY
+  if (stm_ro_write(tx))
+    return;
+#endif /* ADAPTIVE_READ_ONLY */
+#if DESIGN == WRITE_BACK_ETL
+  stm_wbetl_WaR(tx, addr, value, mask);
+#elif DESIGN == WRITE_BACK_CTL
+  stm_wbctl_WaR(tx, addr, value, mask);
+#elif DESIGN == WRITE_THROUGH
+  stm_wt_WaR(tx, addr, value, mask);
+#elif DESIGN == MODULAR
+  tx->design->WaR(tx, addr, value, mask);
+#elif DESIGN == NOREC
+  stm_norec_WaR(tx, addr, value, mask);
+#elif DESIGN == RING
+  stm_ring_WaR(tx, addr, value, mask);
+#endif /* DESIGN == RING */
+}
+
+static INLINE void
+int_stm_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+#if CM == CM_MODULAR
+  if (GET_STATUS(tx->status) == TX_KILLED) {
+    stm_rollback(tx, STM_ABORT_KILLED);
+    return;
+  }
+#endif /* CM == CM_MODULAR */
+#ifdef HYBRID_HTM
+  if (tx->htm) {
+    stm_htm_write(tx, addr, value, mask);
+    return;
+  }
+#endif /* HYBRID_HTM */
+  stm_write_checks(tx);
+#if DESIGN == WRITE_BACK_ETL
+  stm_wbetl_WaW(tx, addr, value, mask);
+#elif DESIGN == WRITE_BACK_CTL
+  stm_wbctl_WaW(tx, addr, value, mask);
+#elif DESIGN == WRITE_THROUGH
+  stm_wt_WaW(tx, addr, value, mask);
+#elif DESIGN == MODULAR
+  tx->design->WaW(tx, addr, value, mask);
+#elif DESIGN == NOREC
+  stm_norec_WaW(tx, addr, value, mask);
+#elif DESIGN == RING
+  stm_ring_WaW(tx, addr, value, mask);
+#endif /* DESIGN == RING */
+}
+
+/*
+ * Can consecutive words covered by the same lock be copied directly?
+ */
+static INLINE int
+stm_range_direct(stm_tx_t *tx)
+{
+#ifdef HYBRID_HTM
+  if (tx->htm)
+    return 0;
+#endif /* HYBRID_HTM */
+#ifdef MULTI_VERSION
+  /* Snapshot may be older than memory */
+  if (tx->attr.read_only)
+    return 0;
+#endif /* MULTI_VERSION */
+#if CM == CM_MODULAR
+  if (tx->attr.visible_reads)
+    return 0;
+#endif /* CM == CM_MODULAR */
+#if DESIGN == WRITE_BACK_CTL
+  /* Written values are not in memory (and do not own the lock) */
+  return tx->w_set.nb_entries == 0;
+#elif DESIGN == MODULAR
+  return tx->design->id != WRITE_BACK_CTL || tx->w_set.nb_entries == 0;
+#elif DESIGN == NOREC || DESIGN == RING
+  /* Each word read is logged with its value (NOREC) or in the read signature (RING) */
+  return 0;
+#else /* DESIGN != WRITE_BACK_CTL && DESIGN != MODULAR && DESIGN != NOREC && DESIGN != RING */
+  return 1;
+#endif /* DESIGN != WRITE_BACK_CTL && DESIGN != MODULAR && DESIGN != NOREC && DESIGN != RING */
+}
+
+/*
+ * Prefetch lock and data of a word that is about to be read.
+ */
+static INLINE void
+int_stm_prefetch(stm_tx_t *tx, const volatile void *addr)
+{
+#if DESIGN != NOREC && DESIGN != RING
+# ifdef HYBRID_HTM
+  /* Hardware transactions do not read locks */
+  if (!tx->htm)
+# endif /* HYBRID_HTM */
+    PREFETCH(GET_LOCK(addr));
+#endif /* DESIGN != NOREC && DESIGN != RING */
+  PREFETCH(addr);
+}
+
+/*
+ * Read words at independent addresses.  Locks and data of the next
+ * words are prefetched before reading each word, so that cache misses
+ * of independent reads overlap.
+ */
+static INLINE void
+int_stm_load_n(stm_tx_t *tx, volatile stm_word_t **addrs, stm_word_t *buf, size_t nb)
+{
+  size_t i;
+
+  for (i = 0; i < nb && i < PREFETCH_AHEAD; i++)
+    int_stm_prefetch(tx, addrs[i]);
+  for (i = 0; i < nb; i++) {
+    if (i + PREFETCH_AHEAD < nb)
+      int_stm_prefetch(tx, addrs[i + PREFETCH_AHEAD]);
+    buf[i] = int_stm_load(tx, addrs[i]);
+    /* Do not read once aborted without restart (no_retry) */
+    if (unlikely(!IS_ACTIVE(tx->status)))
+      return;
+  }
+}
+
+/*
+ * Read consecutive words, with a single read set entry per lock.
+ */
+static INLINE void
+int_stm_load_range(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t *buf, size_t nb)
+{
+  volatile stm_word_t *lock;
+  stm_word_t l;
+  size_t i, n;
+
+  while (nb > 0) {
+    /* Words covered by the same lock */
+    lock = GET_LOCK(addr);
+    for (n = 1; n < nb && GET_LOCK(addr + n) == lock; n++)
+      ;
+    if (n > 1 && stm_range_direct(tx)) {
+      l = ATOMIC_LOAD_ACQ(lock);
+      if (!LOCK_GET_OWNED(l)) {
+        /* Copy other words, then read first one as usual (validates version) */
+        memcpy(buf + 1, (stm_word_t *)addr + 1, (n - 1) * sizeof(stm_word_t));
+        ATOMIC_MB_READ;
+        buf[0] = int_stm_load(tx, addr);
+        if (unlikely(!IS_ACTIVE(tx->status)))
+          return;
+        /* Lock unchanged: all words have the version of the first one */
+        if (likely(ATOMIC_LOAD_ACQ(lock) == l))
+          goto next;
+      }
+    }
+    for (i = 0; i < n; i++) {
+      buf[i] = int_stm_load(tx, addr + i);
+      /* Do not read once aborted without restart (no_retry) */
+      if (unlikely(!IS_ACTIVE(tx->status)))
+        return;
+    }
+ next:
+    addr += n;
+    buf += n;
+    nb -= n;
+  }
+}
+
+/*
+ * Write consecutive words.
+ */
+static INLINE void
+int_stm_store_range(stm_tx_t *tx, volatile stm_word_t *addr, const stm_word_t *buf, size_t nb)
+{
+  /* Write sets (and undo logs) have one entry per word */
+#ifdef NON_TEMPORAL_STORES
+  /* Reset upon rollback if the range is not completely written */
+  tx->nt_stores = (nb >= NT_THRESHOLD);
+#endif /* NON_TEMPORAL_STORES */
+  for (; nb > 0; nb--) {
+    stm_write(tx, addr++, *buf++, ~(stm_word_t)0);
+    /* Do not write once aborted without restart (no_retry) */
+    if (unlikely(!IS_ACTIVE(tx->status)))
+      return;
+  }
+#ifdef NON_TEMPORAL_STORES
+  tx->nt_stores = 0;
+#endif /* NON_TEMPORAL_STORES */
+}
+
+/*
+ * Abort and restart once some location read has been updated.
+ */
+static INLINE void
+int_stm_retry(stm_tx_t *tx)
+{
+  assert(IS_ACTIVE(tx->status));
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable != 0) {
+    fprintf(stderr, "Irrevocable transactions cannot retry\n");
+    exit(1);
+  }
+#endif /* IRREVOCABLE_ENABLED */
+  stm_rollback(tx, STM_ABORT_RETRY);
+}
+
+/*
+ * Record savepoint (return NULL if not supported).
+ */
+static INLINE sigjmp_buf *
+int_stm_savepoint(stm_tx_t *tx)
+{
+  assert(IS_ACTIVE(tx->status));
+#ifdef CLOSED_NESTING
+  return stm_nested_savepoint(tx);
+#else /* ! CLOSED_NESTING */
+  return NULL;
+#endif /* ! CLOSED_NESTING */
+}
+
+/*
+ * Roll back to savepoint (restart transaction if NULL).
+ */
+static INLINE void
+int_stm_rollback_to(stm_tx_t *tx, sigjmp_buf *savepoint)
+{
+  assert(IS_ACTIVE(tx->status));
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable != 0) {
+    fprintf(stderr, "Irrevocable transactions cannot roll back\n");
+    exit(1);
+  }
+#endif /* IRREVOCABLE_ENABLED */
+#ifdef CLOSED_NESTING
+  if (savepoint != NULL)
+    stm_nested_rollback_to(tx, savepoint);
+  /* Restart from the beginning */
+  tx->nb_nested = 0;
+#endif /* CLOSED_NESTING */
+  stm_rollback(tx, STM_ABORT_EXPLICIT);
+}
+
+#ifdef ELASTIC_TX
+/*
+ * Remove reads of a stripe from the read set.
+ */
+static INLINE void
+int_stm_release(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  assert(IS_ACTIVE(tx->status));
+#ifdef HYBRID_HTM
+  /* Hardware transactions have no read set */
+  if (tx->htm)
+    return;
+#endif /* HYBRID_HTM */
+  stm_elastic_release(tx, GET_LOCK(addr));
+}
+#endif /* ELASTIC_TX */
+
+/*
+ * Validate read set and extend snapshot up to current time (abort if invalid).
+ */
+static INLINE void
+int_stm_validate(stm_tx_t *tx)
+{
+  int valid;
+
+  assert(IS_ACTIVE(tx->status));
+#ifdef IRREVOCABLE_ENABLED
+  /* Irrevocable transactions are always consistent */
+  if (tx->irrevocable != 0)
+    return;
+#endif /* IRREVOCABLE_ENABLED */
+#ifdef HYBRID_HTM
+  /* Hardware transactions are validated by the hardware */
+  if (tx->htm)
+    return;
+#endif /* HYBRID_HTM */
+  if (tx->attr.read_only) {
+#ifdef MULTI_VERSION
+    /* Read from a fixed snapshot */
+#else /* ! MULTI_VERSION */
+    /* No read set: snapshot cannot be extended */
+    if (GET_CLOCK > tx->end) {
+      SET_CONFLICT(tx, NULL, NULL);
+      stm_rollback(tx, STM_ABORT_VAL_READ);
+    }
+#endif /* ! MULTI_VERSION */
+    return;
+  }
+
+#if DESIGN == WRITE_BACK_ETL
+  valid = stm_wbetl_extend(tx);
+#elif DESIGN == WRITE_BACK_CTL
+  valid = stm_wbctl_extend(tx);
+#elif DESIGN == WRITE_THROUGH
+  valid = stm_wt_extend(tx);
+#elif DESIGN == MODULAR
+  valid = tx->design->extend(tx);
+#elif DESIGN == NOREC
+  valid = stm_norec_extend(tx);
+#elif DESIGN == RING
+  valid = stm_ring_extend(tx);
+#endif /* DESIGN == RING */
+  if (!valid) {
+    SET_CONFLICT(tx, NULL, NULL);
+    stm_rollback(tx, STM_ABORT_VALIDATE);
+  }
 }
 
 static INLINE int
@@ -1507,11 +4212,51 @@ int_stm_get_env(stm_tx_t *tx)
   return tx->nesting == 0 ? &tx->env : NULL;
 }
 
+/*
+ * Get memory used by read and write sets.
+ */
+static INLINE unsigned long
+stm_rw_set_bytes(stm_tx_t *tx)
+{
+  unsigned long n;
+
+  n = tx->r_set.size * sizeof(r_entry_t) + tx->w_set.size * sizeof(w_entry_t);
+#ifdef WRITE_SET_HASH
+  n += tx->w_set.hash_size * sizeof(ws_hash_entry_t);
+#endif /* WRITE_SET_HASH */
+#ifdef SORTED_COMMIT
+  n += tx->w_set.sorted_size * sizeof(w_entry_t *);
+#endif /* SORTED_COMMIT */
+  return n;
+}
+
+static INLINE void
+int_stm_get_tx_info(stm_tx_t *tx, stm_tx_info_t *info)
+{
+  assert (tx != NULL);
+
+  info->abort_reason = tx->abort_reason;
+  info->read_set_nb_entries = tx->r_set.nb_entries;
+  info->write_set_nb_entries = tx->w_set.nb_entries;
+  info->nb_extensions = tx->nb_extensions;
+  info->rw_set_bytes = stm_rw_set_bytes(tx);
+  info->conflict_addr = tx->conflict_addr;
+  if (tx->conflict_lock >= _tinystm.locks && tx->conflict_lock < _tinystm.locks + LOCK_ARRAY_SIZE)
+    info->conflict_lock = (long)(tx->conflict_lock - _tinystm.locks);
+  else
+    info->conflict_lock = -1;
+}
+
 static INLINE int
 int_stm_get_stats(stm_tx_t *tx, const char *name, void *val)
 {
   assert (tx != NULL);
 
+  if (strcmp("rw_set_bytes", name) == 0) {
+    *(unsigned long *)val = stm_rw_set_bytes(tx);
+    return 1;
+  }
+
   if (strcmp("read_set_size", name) == 0) {
     *(unsigned int *)val = tx->r_set.size;
     return 1;
@@ -1549,7 +4294,122 @@ int_stm_get_stats(stm_tx_t *tx, const char *name, void *val)
     *(unsigned int *)val = tx->stat_retries_max;
     return 1;
   }
+# ifdef CLOSED_NESTING
+  if (strcmp("nb_nested_aborts", name) == 0) {
+    *(unsigned int *)val = tx->stat_nested_aborts;
+    return 1;
+  }
+# endif /* CLOSED_NESTING */
+# ifdef ADAPTIVE_SCHEDULING
+  if (strcmp("nb_serialized", name) == 0) {
+    *(unsigned int *)val = tx->stat_serialized;
+    return 1;
+  }
+# endif /* ADAPTIVE_SCHEDULING */
+# ifdef IRREVOCABLE_ENABLED
+  if (strcmp("nb_irrevocable", name) == 0) {
+    *(unsigned int *)val = tx->stat_irrevocable;
+    return 1;
+  }
+  if (strcmp("nb_irrevocable_stopped", name) == 0) {
+    *(unsigned int *)val = tx->stat_irrevocable_stopped;
+    return 1;
+  }
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef STACK_CHECK
+  if (strcmp("nb_stack_filtered", name) == 0) {
+    *(unsigned int *)val = tx->stat_stack_filtered;
+    return 1;
+  }
+# endif /* STACK_CHECK */
+# ifdef ADAPTIVE_RW_SETS
+  if (strcmp("nb_rw_set_resizes", name) == 0) {
+    *(unsigned int *)val = tx->stat_rw_resizes;
+    return 1;
+  }
+# endif /* ADAPTIVE_RW_SETS */
+# ifdef ADAPTIVE_READ_ONLY
+  if (strcmp("nb_ro_hits", name) == 0) {
+    *(unsigned int *)val = tx->stat_ro_hits;
+    return 1;
+  }
+  if (strcmp("nb_ro_misses", name) == 0) {
+    *(unsigned int *)val = tx->stat_ro_misses;
+    return 1;
+  }
+# endif /* ADAPTIVE_READ_ONLY */
+# ifdef IRREVOCABLE_FALLBACK
+  if (strcmp("nb_irrevocable_fallbacks", name) == 0) {
+    *(unsigned int *)val = tx->stat_fallbacks;
+    return 1;
+  }
+# endif /* IRREVOCABLE_FALLBACK */
+# ifdef EPOCH_GC
+  if (strcmp("nb_gc_pressure", name) == 0) {
+    *(unsigned int *)val = tx->stat_gc_pressure;
+    return 1;
+  }
+# endif /* EPOCH_GC */
+# ifdef HELPER_VALIDATION
+  if (strcmp("nb_helper_validated", name) == 0) {
+    *(unsigned long *)val = tx->stat_hv_skipped;
+    return 1;
+  }
+# endif /* HELPER_VALIDATION */
+  /* Arrays indexed by priority */
+  if (strcmp("nb_commits_prio", name) == 0) {
+    memcpy(val, tx->stat_prio_commits, sizeof(tx->stat_prio_commits));
+    return 1;
+  }
+  if (strcmp("nb_aborts_prio", name) == 0) {
+    memcpy(val, tx->stat_prio_aborts, sizeof(tx->stat_prio_aborts));
+    return 1;
+  }
+  if (strcmp("cycles_prio", name) == 0) {
+    memcpy(val, tx->stat_prio_cycles, sizeof(tx->stat_prio_cycles));
+    return 1;
+  }
 #endif /* TM_STATISTICS */
+#ifdef EPOCH_GC
+  if (strcmp("gc_backlog", name) == 0) {
+    *(unsigned long *)val = (unsigned long)gc_backlog_depth(0);
+    return 1;
+  }
+#endif /* EPOCH_GC */
+#ifdef HYBRID_HTM
+  if (strcmp("nb_htm_commits", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_commits;
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts;
+    return 1;
+  }
+  if (strcmp("nb_htm_fallbacks", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_fallbacks;
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts_conflict", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts_r[HTM_STAT_CONFLICT];
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts_capacity", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts_r[HTM_STAT_CAPACITY];
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts_locked", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts_r[HTM_STAT_LOCKED];
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts_explicit", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts_r[HTM_STAT_EXPLICIT];
+    return 1;
+  }
+  if (strcmp("nb_htm_aborts_other", name) == 0) {
+    *(unsigned int *)val = tx->stat_htm_aborts_r[HTM_STAT_OTHER];
+    return 1;
+  }
+#endif /* HYBRID_HTM */
 #ifdef TM_STATISTICS2
   if (strcmp("nb_aborts_1", name) == 0) {
     *(unsigned int *)val = tx->stat_aborts_1;
@@ -1597,6 +4457,42 @@ int_stm_get_stats(stm_tx_t *tx, const char *name, void *val)
     return 1;
   }
 # endif /* READ_LOCKED_DATA */
+  if (strcmp("nb_sampled", name) == 0) {
+    *(unsigned int *)val = tx->prof_samples;
+    return 1;
+  }
+  if (strcmp("cycles_other", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_OTHER];
+    return 1;
+  }
+  if (strcmp("cycles_read", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_READ];
+    return 1;
+  }
+  if (strcmp("cycles_write", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_WRITE];
+    return 1;
+  }
+  if (strcmp("cycles_validate", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_VALIDATE];
+    return 1;
+  }
+  if (strcmp("cycles_commit", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_COMMIT];
+    return 1;
+  }
+  if (strcmp("cycles_rollback", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_ROLLBACK];
+    return 1;
+  }
+  if (strcmp("cycles_wait", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_cycles[PROF_WAIT];
+    return 1;
+  }
+  if (strcmp("cycles_aborted", name) == 0) {
+    *(unsigned long *)val = (unsigned long)tx->prof_aborted;
+    return 1;
+  }
 #endif /* TM_STATISTICS2 */
   return 0;
 }
@@ -1604,15 +4500,53 @@ int_stm_get_stats(stm_tx_t *tx, const char *name, void *val)
 static INLINE void
 int_stm_set_specific(stm_tx_t *tx, int key, void *data)
 {
-  assert (tx != NULL && key >= 0 && key < _tinystm.nb_specific);
-  ATOMIC_STORE(&tx->data[key], data);
+  specific_ext_t *ext;
+
+  assert (tx != NULL && key >= 0 && key < (int)_tinystm.nb_specific);
+  if (likely(key < MAX_SPECIFIC)) {
+    ATOMIC_STORE(&tx->data[key], data);
+    return;
+  }
+  ext = tx->data_ext;
+  if (ext == NULL || (unsigned int)key - MAX_SPECIFIC >= ext->size)
+    ext = stm_specific_grow(tx, key);
+  ATOMIC_STORE(&ext->data[key - MAX_SPECIFIC], data);
 }
 
 static INLINE void *
 int_stm_get_specific(stm_tx_t *tx, int key)
 {
-  assert (tx != NULL && key >= 0 && key < _tinystm.nb_specific);
-  return (void *)ATOMIC_LOAD(&tx->data[key]);
+  specific_ext_t *ext;
+
+  assert (tx != NULL && key >= 0 && key < (int)_tinystm.nb_specific);
+  if (likely(key < MAX_SPECIFIC))
+    return (void *)ATOMIC_LOAD(&tx->data[key]);
+  /* Slots that have never been set are not allocated */
+  ext = (specific_ext_t *)ATOMIC_LOAD_ACQ(&tx->data_ext);
+  if (ext == NULL || (unsigned int)key - MAX_SPECIFIC >= ext->size)
+    return NULL;
+  return (void *)ATOMIC_LOAD(&ext->data[key - MAX_SPECIFIC]);
+}
+
+/*
+ * Enable or disable the callbacks of a module for the thread (only
+ * called by the thread of the descriptor, outside transactions).
+ */
+static INLINE int
+int_stm_enable_module(stm_tx_t *tx, int module, int enabled)
+{
+  stm_word_t bit;
+
+  if (module <= 0 || module > (int)_tinystm.nb_modules || module > (int)(sizeof(stm_word_t) * 8))
+    return 0;
+  if (IS_ACTIVE(tx->status))
+    return 0;
+  bit = (stm_word_t)1 << (module - 1);
+  if (enabled)
+    tx->cb_disabled &= ~bit;
+  else
+    tx->cb_disabled |= bit;
+  return 1;
 }
 
 #endif /* _STM_INTERNAL_H_ */
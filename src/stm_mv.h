@@ -0,0 +1,165 @@
+/*
+ * File:
+ *   stm_mv.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for multi-version snapshots.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_MV_H_
+#define _STM_MV_H_
+
+/*
+ * Update transactions save the value they overwrite in a per-lock
+ * history, together with their commit timestamp (i.e., the end of the
+ * validity range of the old value).  Histories are only modified by the
+ * owner of the lock and are bounded to MV_HISTORY_SIZE entries; dropped
+ * entries are reclaimed by the epoch-based GC and "low" remembers the
+ * most recent timestamp that is not covered anymore.
+ *
+ * Read-only transactions read the snapshot at tx->start: they neither
+ * log reads nor validate, and only abort if the version they need has
+ * been dropped from the history or if a lock remains owned for too
+ * long.
+ */
+
+/*
+ * Save value overwritten by an update transaction (lock must be owned).
+ */
+static INLINE void
+stm_mv_save(volatile stm_word_t *addr, stm_word_t value, volatile stm_word_t *lock, stm_word_t t)
+{
+  mv_history_t *h;
+  mv_entry_t *e, *n;
+  stm_word_t now;
+  int i;
+
+  h = &_tinystm.mv_history[lock - _tinystm.locks];
+
+  e = (mv_entry_t *)xmalloc(sizeof(mv_entry_t));
+  e->addr = addr;
+  e->value = value;
+  e->end = t;
+  e->next = h->head;
+  /* Make sure that entry is initialized before readers can see it */
+  ATOMIC_STORE_REL(&h->head, e);
+
+  /* Bound history (readers may still access dropped entries) */
+  for (i = 1; i < MV_HISTORY_SIZE && e != NULL; i++)
+    e = e->next;
+  if (e != NULL && e->next != NULL) {
+    n = e->next;
+    ATOMIC_STORE(&e->next, NULL);
+    ATOMIC_STORE(&h->low, n->end);
+    now = GET_CLOCK;
+    for (e = n; e != NULL; e = n) {
+      n = e->next;
+      gc_free(e, now);
+    }
+  }
+}
+
+/*
+ * Read value of the snapshot at tx->start (read-only transactions).
+ */
+static INLINE stm_word_t
+stm_mv_read(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  volatile stm_word_t *lock;
+  stm_word_t l, l2, value, low;
+  mv_history_t *h;
+  mv_entry_t *e, *c;
+  unsigned long spin;
+
+  PRINT_DEBUG2("==> stm_mv_read(t=%p[%lu-%lu],a=%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, addr);
+
+  lock = GET_LOCK(addr);
+  h = &_tinystm.mv_history[lock - _tinystm.locks];
+  spin = 0;
+
+ restart:
+  l = ATOMIC_LOAD_ACQ(lock);
+  if (unlikely(LOCK_GET_OWNED(l))) {
+    /* The owner may commit with a timestamp older than our snapshot: wait */
+    if (++spin > MV_SPIN_MAX) {
+      stm_rollback(tx, STM_ABORT_WR_CONFLICT);
+      return 0;
+    }
+#ifdef WAIT_YIELD
+    sched_yield();
+#endif /* WAIT_YIELD */
+    goto restart;
+  }
+  value = ATOMIC_LOAD_ACQ(addr);
+  if (likely(LOCK_GET_TIMESTAMP(l) <= tx->start)) {
+    /* Common case: latest version is part of the snapshot */
+    if (unlikely(ATOMIC_LOAD_ACQ(lock) != l))
+      goto restart;
+    return value;
+  }
+  /* History is consistent with version as long as the lock has not changed */
+  e = (mv_entry_t *)ATOMIC_LOAD_ACQ(&h->head);
+  low = ATOMIC_LOAD_ACQ(&h->low);
+  l2 = ATOMIC_LOAD_ACQ(lock);
+  if (unlikely(l != l2))
+    goto restart;
+  if (unlikely(tx->start < low)) {
+    /* Version has been dropped from history */
+    stm_rollback(tx, STM_ABORT_VAL_READ);
+    return 0;
+  }
+  /* Oldest overwritten value that was still valid at tx->start (newest entries first) */
+  for (c = NULL; e != NULL; e = (mv_entry_t *)ATOMIC_LOAD_ACQ(&e->next)) {
+    if (e->addr != addr)
+      continue;
+    if (e->end <= tx->start)
+      break;
+    c = e;
+  }
+  if (c != NULL)
+    value = c->value;
+  /* The history may have been truncated during the walk (as for a
+   * seqlock, it has not changed if neither the lock nor low has) */
+  ATOMIC_MB_READ;
+  if (unlikely(ATOMIC_LOAD_ACQ(&h->low) != low || ATOMIC_LOAD_ACQ(lock) != l))
+    goto restart;
+
+  return value;
+}
+
+/*
+ * Drop all histories (upon clock rollover, no transaction is active).
+ */
+static INLINE void
+stm_mv_reset(void)
+{
+  mv_entry_t *e, *n;
+  unsigned int i;
+
+  for (i = 0; i < LOCK_ARRAY_MAP_SIZE; i++) {
+    for (e = _tinystm.mv_history[i].head; e != NULL; e = n) {
+      n = e->next;
+      xfree(e);
+    }
+  }
+  memset((void *)_tinystm.mv_history, 0, LOCK_ARRAY_MAP_SIZE * sizeof(mv_history_t));
+}
+
+#endif /* _STM_MV_H_ */
@@ -0,0 +1,425 @@
+/*
+ * File:
+ *   stm_nested.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for closed nesting.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_NESTED_H_
+#define _STM_NESTED_H_
+
+/*
+ * A nested transaction started with the closed_nesting attribute
+ * records the size of the read and write sets of its parent.  Upon
+ * conflict, only the entries added by the nested transaction are
+ * dropped (releasing the locks it has acquired) and the write set
+ * entries of the parent that it has modified are restored from a small
+ * undo log.  The snapshot of the parent is then extended (hence
+ * validated): if it is still consistent, only the nested transaction
+ * restarts, otherwise the whole transaction aborts as with flat
+ * nesting.
+ *
+ * A savepoint records the sizes of the sets in the same way, without
+ * starting a nested transaction: it belongs to the enclosing (closed
+ * nested or top-level) transaction and is dropped when the latter
+ * commits.  stm_rollback_to() undoes the changes made since a savepoint
+ * and continues execution from there.  Upon conflict, execution also
+ * restarts from the innermost savepoint or closed nested transaction:
+ * if its snapshot is no longer consistent, the next outer one is tried,
+ * and so on.  Explicit aborts are not handled by savepoints.
+ *
+ * Nested transactions and savepoints beyond MAX_NESTED, within hardware
+ * or irrevocable transactions, are flattened (ignored).
+ */
+
+/*
+ * Record sizes of sets for closed nested transaction or savepoint
+ * (return NULL if flattened).
+ */
+static INLINE sigjmp_buf *
+stm_nested_push(stm_tx_t *tx, int savepoint)
+{
+  nested_t *n;
+
+  if (tx->nb_nested == MAX_NESTED)
+    return NULL;
+#ifdef HYBRID_HTM
+  /* Hardware transactions restart as a whole */
+  if (tx->htm)
+    return NULL;
+#endif /* HYBRID_HTM */
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable != 0)
+    return NULL;
+#endif /* IRREVOCABLE_ENABLED */
+
+  n = &tx->nested[tx->nb_nested++];
+  n->nesting = tx->nesting;
+  n->savepoint = savepoint;
+  n->r_nb = tx->r_set.nb_entries;
+  n->w_nb = tx->w_set.nb_entries;
+  n->has_writes = tx->w_set.has_writes;
+  n->u_nb = tx->nested_undo_nb;
+#ifdef USE_BLOOM_FILTER
+  memcpy(n->bloom, tx->w_set.bloom, sizeof(n->bloom));
+#endif /* USE_BLOOM_FILTER */
+
+  stm_callbacks(tx, &_tinystm.nested_start_cb);
+
+  return &n->env;
+}
+
+/*
+ * Start closed nested transaction (return NULL if flattened).
+ */
+static INLINE sigjmp_buf *
+stm_nested_start(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_nested_start(%p[%lu-%lu],%u)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, tx->nesting);
+
+  return stm_nested_push(tx, 0);
+}
+
+/*
+ * Record savepoint in current transaction (return NULL if ignored).
+ */
+static INLINE sigjmp_buf *
+stm_nested_savepoint(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_nested_savepoint(%p[%lu-%lu],%u)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, tx->nesting);
+
+  return stm_nested_push(tx, 1);
+}
+
+/*
+ * Commit closed nested transaction or drop savepoint (changes are
+ * merged into parent).
+ */
+static INLINE void
+stm_nested_commit(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_nested_commit(%p[%lu-%lu],%u)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, tx->nesting);
+
+  /* Undo log entries are kept in case the parent aborts */
+  tx->nb_nested--;
+
+  stm_callbacks(tx, &_tinystm.nested_commit_cb);
+}
+
+/*
+ * Drop write set entry added by nested transaction (lock owned).
+ */
+static INLINE void
+stm_nested_drop(stm_tx_t *tx, w_entry_t *w, int restore)
+{
+  w_entry_t *p;
+#ifdef STRIPE_INDEX
+  w_entry_t *h;
+#endif /* STRIPE_INDEX */
+#if DESIGN == WRITE_THROUGH || DESIGN == MODULAR
+  stm_word_t j, t;
+#endif /* DESIGN == WRITE_THROUGH || DESIGN == MODULAR */
+
+  /* Entries for the same lock are linked in order and the lock points to the first one */
+  p = (w_entry_t *)LOCK_GET_ADDR(ATOMIC_LOAD(w->lock));
+  if (p != w) {
+    /* Lock must be released by first entry: unlink last entry from list */
+#ifdef STRIPE_INDEX
+    h = p;
+#endif /* STRIPE_INDEX */
+    while (p->next != w)
+      p = p->next;
+    p->next = NULL;
+#ifdef STRIPE_INDEX
+    if (h->last != STRIPE_SHARED)
+      h->last = p - h;
+#endif /* STRIPE_INDEX */
+    return;
+  }
+#if DESIGN == WRITE_THROUGH || DESIGN == MODULAR
+  if (restore) {
+    /* Incarnation numbers allow readers to detect dirty reads */
+    j = LOCK_GET_INCARNATION(w->version) + 1;
+    if (j > INCARNATION_MAX) {
+      /* Get new version (may exceed VERSION_MAX by up to MAX_THREADS) */
+      t = FETCH_INC_CLOCK + 1;
+      ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
+    } else {
+      ATOMIC_STORE_REL(w->lock, LOCK_UPD_INCARNATION(w->version, j));
+    }
+    return;
+  }
+#endif /* DESIGN == WRITE_THROUGH || DESIGN == MODULAR */
+  ATOMIC_STORE(w->lock, LOCK_SET_TIMESTAMP(w->version));
+}
+
+/*
+ * Undo changes of innermost closed nested transaction.
+ */
+static INLINE void
+stm_nested_undo(stm_tx_t *tx, nested_t *n)
+{
+  nested_undo_t *u;
+  w_entry_t *w;
+  unsigned int i;
+  int locks, restore;
+
+  /* Locks are only acquired during execution with encounter-time locking */
+#if DESIGN == WRITE_BACK_ETL
+  locks = 1;
+  restore = 0;
+#elif DESIGN == WRITE_BACK_CTL
+  locks = 0;
+  restore = 0;
+#elif DESIGN == WRITE_THROUGH
+  locks = 1;
+  restore = 1;
+#elif DESIGN == MODULAR
+  locks = (tx->design->id != WRITE_BACK_CTL);
+  restore = (tx->design->id == WRITE_THROUGH);
+#elif DESIGN == NOREC || DESIGN == RING
+  locks = 0;
+  restore = 0;
+#endif /* DESIGN == NOREC || DESIGN == RING */
+
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL
+  /* Entries read by other transactions are modified or reused */
+  stm_lock_seq_enter(tx);
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL */
+#ifdef NON_TEMPORAL_STORES
+  /* Streaming stores must not overwrite restored values */
+  stm_wt_store_fence(tx);
+#endif /* NON_TEMPORAL_STORES */
+  /* Restore entries of parents (most recent first) */
+  for (i = tx->nested_undo_nb; i > n->u_nb; i--) {
+    u = &tx->nested_undo[i - 1];
+    if (u->addr != NULL)
+      ATOMIC_STORE(u->addr, u->data);
+    w = &tx->w_set.entries[u->idx];
+    w->value = u->value;
+    w->mask = u->mask;
+  }
+  tx->nested_undo_nb = n->u_nb;
+
+  /* Drop entries of nested transaction (most recent first) */
+  if (locks && tx->w_set.nb_entries > n->w_nb) {
+    for (i = tx->w_set.nb_entries; i > n->w_nb; i--) {
+      w = &tx->w_set.entries[i - 1];
+      /* Restore previous value */
+      if (restore && w->mask != 0)
+        ATOMIC_STORE(w->addr, w->value);
+      stm_nested_drop(tx, w, restore);
+    }
+    /* Make sure that all lock releases become visible */
+    ATOMIC_MB_WRITE;
+  }
+#if defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL
+  stm_lock_seq_leave(tx);
+#endif /* defined(READ_LOCKED_DATA) && DESIGN != WRITE_BACK_ETL */
+  tx->w_set.nb_entries = n->w_nb;
+  tx->w_set.has_writes = n->has_writes;
+  tx->r_set.nb_entries = n->r_nb;
+#ifdef USE_BLOOM_FILTER
+  memcpy(tx->w_set.bloom, n->bloom, sizeof(n->bloom));
+#endif /* USE_BLOOM_FILTER */
+#ifdef WRITE_SET_HASH
+  if (tx->w_set.nb_indexed > n->w_nb)
+    stm_ws_hash_reset(tx);
+#endif /* WRITE_SET_HASH */
+}
+
+/*
+ * Undo changes since closed nested transaction or savepoint i, or an
+ * outer one if the snapshot is no longer consistent (return the index
+ * of the one to restart plus one, or 0 if the whole transaction must
+ * abort).  Inner ones are dropped.
+ */
+static INLINE unsigned int
+stm_nested_revert(stm_tx_t *tx, unsigned int i, int outer)
+{
+  unsigned int j;
+  int valid;
+
+  for (;;) {
+    stm_nested_undo(tx, &tx->nested[i]);
+    /* Make sure that the parent is still consistent */
+#if DESIGN == WRITE_BACK_ETL
+    valid = stm_wbetl_extend(tx);
+#elif DESIGN == WRITE_BACK_CTL
+    valid = stm_wbctl_extend(tx);
+#elif DESIGN == WRITE_THROUGH
+    valid = stm_wt_extend(tx);
+#elif DESIGN == MODULAR
+    valid = tx->design->extend(tx);
+#elif DESIGN == NOREC
+    valid = stm_norec_extend(tx);
+#elif DESIGN == RING
+    valid = stm_ring_extend(tx);
+#endif /* DESIGN == RING */
+    if (valid)
+      break;
+    if (!outer || i == 0) {
+      /* Sets are now smaller than recorded by remaining ones */
+      tx->nb_nested = 0;
+      return 0;
+    }
+    i--;
+  }
+
+#ifdef TM_STATISTICS
+  tx->stat_nested_aborts++;
+#endif /* TM_STATISTICS */
+
+  /* Modules undo changes (innermost first) */
+  if (unlikely(_tinystm.nested_abort_cb != NULL)) {
+    for (j = tx->nb_nested; j > i; j--)
+      stm_callbacks(tx, &_tinystm.nested_abort_cb);
+  }
+  tx->nb_nested = i + 1;
+
+  return i + 1;
+}
+
+/*
+ * Restart closed nested transaction or savepoint i (does not return).
+ */
+static INLINE void
+stm_nested_restart(stm_tx_t *tx, unsigned int i, unsigned int reason)
+{
+  nested_t *n;
+
+  n = &tx->nested[i];
+  tx->nesting = n->nesting;
+  stm_callbacks(tx, &_tinystm.nested_start_cb);
+
+  LONGJMP(n->env, reason | STM_PATH_INSTRUMENTED);
+}
+
+/*
+ * Rollback innermost closed nested transaction or savepoint (return 0
+ * if the whole transaction must abort, 1 if the nested transaction is
+ * not retried).
+ */
+static NOINLINE int
+stm_nested_rollback(stm_tx_t *tx, unsigned int reason)
+{
+  unsigned int i;
+
+  PRINT_DEBUG("==> stm_nested_rollback(%p[%lu-%lu],%u)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, tx->nesting);
+
+  /* Only conflicts and explicit aborts can be handled by nested transactions */
+  switch (reason) {
+    case STM_ABORT_EXPLICIT:
+    case STM_ABORT_NO_RETRY:
+    case STM_ABORT_RR_CONFLICT:
+    case STM_ABORT_RW_CONFLICT:
+    case STM_ABORT_WR_CONFLICT:
+    case STM_ABORT_WW_CONFLICT:
+    case STM_ABORT_VAL_READ:
+    case STM_ABORT_VAL_WRITE:
+      break;
+    default:
+      return 0;
+  }
+  if (tx->attr.no_retry && reason != STM_ABORT_NO_RETRY)
+    return 0;
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable != 0)
+    return 0;
+#endif /* IRREVOCABLE_ENABLED */
+#ifdef MULTI_VERSION
+  /* Snapshot of read-only transactions cannot be extended */
+  if (tx->attr.read_only)
+    return 0;
+#endif /* MULTI_VERSION */
+
+  i = tx->nb_nested;
+  if (reason == STM_ABORT_EXPLICIT || reason == STM_ABORT_NO_RETRY) {
+    /* Explicit aborts are for the innermost nested transaction */
+    while (i > 0 && tx->nested[i - 1].savepoint)
+      i--;
+    if (i == 0)
+      return 0;
+  }
+
+  /* Aborts without retry only concern the innermost nested transaction */
+  i = stm_nested_revert(tx, i - 1, reason != STM_ABORT_NO_RETRY);
+  if (i == 0)
+    return 0;
+
+#if CM == CM_DELAY
+  /* Wait until contented lock is free */
+  if (tx->c_lock != NULL) {
+# ifdef WAIT_FUTEX
+    stm_futex_wait(tx->c_lock);
+# else /* ! WAIT_FUTEX */
+    /* Busy waiting (yielding is expensive) */
+    while (LOCK_GET_OWNED(ATOMIC_LOAD(tx->c_lock))) {
+#  ifdef WAIT_YIELD
+      sched_yield();
+#  endif /* WAIT_YIELD */
+    }
+# endif /* ! WAIT_FUTEX */
+    tx->c_lock = NULL;
+  }
+#endif /* CM == CM_DELAY */
+
+  if (reason == STM_ABORT_NO_RETRY) {
+    /* Execution continues in parent */
+    tx->nb_nested--;
+    tx->nesting = tx->nested[i - 1].nesting - 1;
+    return 1;
+  }
+
+  /* Restart nested transaction or savepoint */
+  stm_nested_restart(tx, i - 1, reason);
+  /* Not reached */
+  return 1;
+}
+
+/*
+ * Roll back to savepoint (does not return).
+ */
+static INLINE void
+stm_nested_rollback_to(stm_tx_t *tx, sigjmp_buf *savepoint)
+{
+  unsigned int i;
+
+  PRINT_DEBUG("==> stm_nested_rollback_to(%p[%lu-%lu],%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, savepoint);
+
+  for (i = tx->nb_nested; i > 0; i--) {
+    if (&tx->nested[i - 1].env == savepoint)
+      break;
+  }
+  if (i == 0 || !tx->nested[i - 1].savepoint) {
+    fprintf(stderr, "Invalid savepoint\n");
+    exit(1);
+  }
+  i = stm_nested_revert(tx, i - 1, 1);
+  if (i == 0) {
+    SET_CONFLICT(tx, NULL, NULL);
+    stm_rollback(tx, STM_ABORT_VALIDATE);
+    return;
+  }
+  stm_nested_restart(tx, i - 1, STM_ABORT_EXPLICIT);
+}
+
+#endif /* _STM_NESTED_H_ */
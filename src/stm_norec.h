@@ -0,0 +1,409 @@
+/*
+ * File:
+ *   stm_norec.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for NOrec (value-based validation).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_NOREC_H_
+#define _STM_NOREC_H_
+
+/*
+ * The global clock is a sequence lock: it is odd while an update
+ * transaction writes back its updates and is incremented by 2 upon each
+ * commit.  The lock array is not used.  Reads log the address and the
+ * value read (r->lock and r->version) and are consistent as long as
+ * the clock has not changed since tx->end.  Otherwise, the snapshot is
+ * extended by checking that all logged values are still in memory.
+ * Writes are buffered (w->lock is the address written) and installed
+ * while holding the sequence lock, so update transactions commit
+ * one at a time.
+ */
+
+/*
+ * Wait until no transaction writes back and check that the values read
+ * are still in memory (returns 0 upon conflict, or the stable time of
+ * the check in *now).
+ */
+static INLINE int
+stm_norec_check(stm_tx_t *tx, stm_word_t *now)
+{
+  r_entry_t *r;
+  stm_word_t t;
+  int i;
+
+  for (;;) {
+    /* Wait for commit in progress */
+    while (((t = GET_CLOCK) & 1) != 0)
+      ;
+    r = tx->r_set.entries;
+    for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+      if (ATOMIC_LOAD(r->lock) != r->version) {
+        /* Other value: cannot validate */
+        SET_CONFLICT(tx, r->lock, NULL);
+        return 0;
+      }
+    }
+    /* Values must have been read before checking the clock again */
+    ATOMIC_MB_READ;
+    if (likely(ATOMIC_LOAD_ACQ(&CLOCK) == t)) {
+      *now = t;
+      return 1;
+    }
+    /* Another transaction committed meanwhile: check again */
+  }
+}
+
+static INLINE int
+stm_norec_validate(stm_tx_t *tx)
+{
+  stm_word_t now;
+
+  PRINT_DEBUG("==> stm_norec_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  if (!stm_norec_check(tx, &now))
+    return 0;
+  /* Values are also valid until now */
+  tx->end = now;
+  return 1;
+}
+
+/*
+ * Extend snapshot range.
+ */
+static INLINE int
+stm_norec_extend(stm_tx_t *tx)
+{
+  stm_word_t now;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
+
+  PRINT_DEBUG("==> stm_norec_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+#ifdef READ_SET_FILTER
+  if (unlikely(tx->r_set.nb_entries >= tx->r_set.compact_at))
+    stm_rs_compact(tx);
+#endif /* READ_SET_FILTER */
+
+  /* Try to validate read set */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+  if (stm_norec_check(tx, &now)) {
+#ifdef TM_STATISTICS2
+    stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
+    /* It works: we can extend until now */
+    tx->end = now;
+    tx->nb_extensions++;
+#ifdef SANDBOXING
+    tx->sb_reads = 0;
+#endif /* SANDBOXING */
+    stm_notify_event(STM_EVENT_EXTEND);
+    return 1;
+  }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
+  return 0;
+}
+
+static INLINE void
+stm_norec_rollback(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_norec_rollback(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  assert(IS_ACTIVE(tx->status));
+
+  /* Nothing to do: updates are buffered and the clock is not held */
+}
+
+/*
+ * Get write set entry of an address (accesses after a write usually
+ * target the address written last).
+ */
+static INLINE w_entry_t *
+stm_norec_written(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  w_entry_t *w;
+
+  if (likely(tx->w_set.last < tx->w_set.nb_entries)) {
+    w = &tx->w_set.entries[tx->w_set.last];
+    /* Addresses appear only once in the write set */
+    if (likely(w->addr == addr))
+      return w;
+  }
+  return stm_has_written(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_norec_read(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+  r_entry_t *r;
+  w_entry_t *written;
+
+  PRINT_DEBUG2("==> stm_norec_read(t=%p[%lu-%lu],a=%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, addr);
+
+  assert(IS_ACTIVE(tx->status));
+
+  /* Did we previously write the same address? */
+  written = stm_norec_written(tx, addr);
+  if (written != NULL) {
+    /* Yes: get value from write set if possible */
+    if (written->mask == ~(stm_word_t)0) {
+      value = written->value;
+      /* No need to add to read set */
+      return value;
+    }
+  }
+
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable) {
+    /* Commits that started before we became irrevocable may still write back */
+    while ((GET_CLOCK & 1) != 0)
+      ;
+    /* In irrevocable mode, no need to check the clock nor to log the value */
+    value = ATOMIC_LOAD_ACQ(addr);
+    goto return_value;
+  }
+#endif /* IRREVOCABLE_ENABLED */
+
+  value = ATOMIC_LOAD_ACQ(addr);
+  /* Valid value if no transaction has committed since the snapshot */
+  while (unlikely(GET_CLOCK != tx->end) && !stm_defer_validation(tx)) {
+    /* Read-only transactions also log values: they can extend */
+    if (!stm_norec_extend(tx)) {
+      /* Not much we can do: abort */
+      SET_CONFLICT(tx, addr, NULL);
+      stm_rollback(tx, STM_ABORT_VAL_READ);
+      return 0;
+    }
+    /* The value may have been overwritten before extension: read again */
+    value = ATOMIC_LOAD_ACQ(addr);
+  }
+
+#ifdef NO_DUPLICATES_IN_RW_SETS
+  if (stm_has_read(tx, addr) != NULL)
+    goto return_value;
+#endif /* NO_DUPLICATES_IN_RW_SETS */
+#ifdef READ_SET_FILTER
+  if (stm_rs_filter(tx, addr))
+    goto return_value;
+#endif /* READ_SET_FILTER */
+  /* Add address and value to read set */
+  if (tx->r_set.nb_entries == tx->r_set.size)
+    stm_allocate_rs_entries(tx, 1);
+  r = &tx->r_set.entries[tx->r_set.nb_entries++];
+  r->version = value;
+  r->lock = addr;
+
+ return_value:
+  /* Did we previously write the same address? */
+  if (written != NULL)
+    value = (value & ~written->mask) | (written->value & written->mask);
+  return value;
+}
+
+static INLINE w_entry_t *
+stm_norec_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  w_entry_t *w;
+
+  PRINT_DEBUG2("==> stm_norec_write(t=%p[%lu-%lu],a=%p,d=%p-%lu,m=0x%lx)\n",
+               tx, (unsigned long)tx->start, (unsigned long)tx->end, addr, (void *)value, (unsigned long)value, (unsigned long)mask);
+
+  w = stm_norec_written(tx, addr);
+  if (w != NULL) {
+#ifdef CLOSED_NESTING
+    stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
+    w->value = (w->value & ~mask) | (value & mask);
+    w->mask |= mask;
+    tx->w_set.last = w - tx->w_set.entries;
+    return w;
+  }
+
+  /* Add address to write set (no lock to acquire nor version to check) */
+  if (tx->w_set.nb_entries == tx->w_set.size)
+    stm_allocate_ws_entries(tx, 1);
+  tx->w_set.last = tx->w_set.nb_entries;
+  w = &tx->w_set.entries[tx->w_set.nb_entries++];
+  w->addr = addr;
+  w->mask = mask;
+  w->lock = addr;
+  if (mask == 0) {
+    /* Do not write anything */
+#ifndef NDEBUG
+    w->value = 0;
+#endif /* ! NDEBUG */
+  } else {
+    /* Remember new value */
+    w->value = value;
+  }
+#ifndef NDEBUG
+  w->version = 0;
+#endif /* ! NDEBUG */
+  w->no_drop = 1;
+#ifdef USE_BLOOM_FILTER
+  tx->w_set.bloom[FILTER_WORD(addr)] |= FILTER_BITS(addr);
+#endif /* USE_BLOOM_FILTER */
+
+  return w;
+}
+
+static INLINE stm_word_t
+stm_norec_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+
+  /* The address may have been written on some paths since it was read */
+  if (likely(stm_has_written(tx, addr) == NULL)) {
+    value = ATOMIC_LOAD_ACQ(addr);
+    /* The value is already in the read set: no need to log it again if
+     * no transaction has committed since the snapshot */
+    if (likely(GET_CLOCK == tx->end))
+      return value;
+  }
+  return stm_norec_read(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_norec_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  w_entry_t *w;
+
+  w = stm_norec_written(tx, addr);
+  if (likely(w != NULL && w->mask == ~(stm_word_t)0))
+    return w->value;
+  /* Partially written (or not written on all paths): merge with memory */
+  return stm_norec_read(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_norec_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+
+  /* We need to return the value here, so write with mask=0 is not enough. */
+  value = stm_norec_read(tx, addr);
+  /* Add empty entry such that the next write finds it directly */
+  stm_norec_write(tx, addr, 0, 0);
+  return value;
+}
+
+static INLINE void
+stm_norec_WaR(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  stm_norec_write(tx, addr, value, mask);
+}
+
+static INLINE void
+stm_norec_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  w_entry_t *w;
+
+  /* Get the write set entry. */
+  w = stm_norec_written(tx, addr);
+  if (unlikely(w == NULL)) {
+    /* Not written on all paths */
+    stm_norec_write(tx, addr, value, mask);
+    return;
+  }
+#ifdef CLOSED_NESTING
+  stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
+  /* Update directly into the write set (installed upon commit). */
+  w->value = (w->value & ~mask) | (value & mask);
+  w->mask |= mask;
+}
+
+/*
+ * Write back new value of an entry.
+ */
+static INLINE void
+stm_norec_install(w_entry_t *w)
+{
+  stm_word_t value;
+
+  if (w->mask == ~(stm_word_t)0) {
+    ATOMIC_STORE(w->addr, w->value);
+  } else if (w->mask != 0) {
+    value = (ATOMIC_LOAD(w->addr) & ~w->mask) | (w->value & w->mask);
+    ATOMIC_STORE(w->addr, value);
+  }
+}
+
+static INLINE int
+stm_norec_commit(stm_tx_t *tx)
+{
+  w_entry_t *w;
+  stm_word_t t;
+  int i;
+
+  PRINT_DEBUG("==> stm_norec_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  /* Acquire the sequence lock at a time our snapshot is still valid */
+  for (;;) {
+#ifdef IRREVOCABLE_ENABLED
+    if (unlikely(tx->irrevocable)) {
+      /* Other update transactions cannot commit: no need to validate */
+      while (((t = GET_CLOCK) & 1) != 0)
+        ;
+      if (ATOMIC_CAS_FULL(&CLOCK, t, t + 1) != 0)
+        break;
+      continue;
+    }
+#endif /* IRREVOCABLE_ENABLED */
+    t = tx->end;
+    if (likely(ATOMIC_CAS_FULL(&CLOCK, t, t + 1) != 0))
+      break;
+    /* Another transaction has committed since the snapshot */
+    if (!stm_norec_extend(tx)) {
+      /* Cannot commit */
+      stm_rollback(tx, STM_ABORT_VALIDATE);
+      return 0;
+    }
+  }
+
+#ifdef IRREVOCABLE_ENABLED
+  /* Verify if there is an irrevocable transaction once the lock is held */
+  if (!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG)) {
+    /* Nothing has been written: release without changing the time */
+    ATOMIC_STORE_REL(&CLOCK, t);
+    stm_rollback(tx, STM_ABORT_IRREVOCABLE);
+    return 0;
+  }
+#endif /* IRREVOCABLE_ENABLED */
+
+  /* Install new values */
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++)
+    stm_norec_install(w);
+
+  /* Release the sequence lock (may exceed VERSION_MAX: rollover upon next start) */
+  ATOMIC_STORE_REL(&CLOCK, t + 2);
+
+  return 1;
+}
+
+#endif /* _STM_NOREC_H_ */
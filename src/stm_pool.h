@@ -0,0 +1,151 @@
+/*
+ * File:
+ *   stm_pool.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for reusing transaction descriptors.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_POOL_H_
+#define _STM_POOL_H_
+
+/*
+ * Descriptors are never removed from the list of threads: upon exit, a
+ * thread frees its specific data and clears the attached flag of its
+ * descriptor, which keeps its read and write sets (and privatization
+ * fence slot).  A new thread
+ * first looks for a detached descriptor and claims it with a CAS.  The
+ * list is only modified under the quiescence mutex when it grows, and
+ * new descriptors are inserted at its head, hence it can be traversed
+ * without lock.  Detached descriptors are inactive and are not counted
+ * in threads_nb, so they are ignored by quiescence.  Descriptors are
+ * freed by stm_exit().
+ */
+
+/*
+ * Count thread as active (for quiescence).
+ */
+static INLINE void
+stm_pool_join(void)
+{
+  ATOMIC_FETCH_INC_FULL(&_tinystm.threads_nb);
+  if (unlikely(ATOMIC_LOAD(&_tinystm.quiesce) == 1)) {
+    /* Barrier in progress: it might run without us, wait until it completes */
+    pthread_mutex_lock(&_tinystm.quiesce_mutex);
+    ATOMIC_FETCH_DEC_FULL(&_tinystm.threads_nb);
+    /* Wake up someone in case other threads are waiting for us */
+    pthread_cond_signal(&_tinystm.quiesce_cond);
+    while (_tinystm.quiesce == 1)
+      pthread_cond_wait(&_tinystm.quiesce_cond, &_tinystm.quiesce_mutex);
+    ATOMIC_FETCH_INC_FULL(&_tinystm.threads_nb);
+    pthread_mutex_unlock(&_tinystm.quiesce_mutex);
+  }
+}
+
+/*
+ * Stop counting thread as active (for quiescence).
+ */
+static INLINE void
+stm_pool_leave(void)
+{
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.threads_nb);
+  if (unlikely(ATOMIC_LOAD(&_tinystm.quiesce) != 0)) {
+    /* Wake up someone in case other threads are waiting for us */
+    pthread_mutex_lock(&_tinystm.quiesce_mutex);
+    pthread_cond_signal(&_tinystm.quiesce_cond);
+    pthread_mutex_unlock(&_tinystm.quiesce_mutex);
+  }
+}
+
+/*
+ * Claim detached descriptor (NULL if none).
+ */
+static INLINE stm_tx_t *
+stm_pool_get(void)
+{
+  stm_tx_t *t;
+
+  for (t = (stm_tx_t *)ATOMIC_LOAD_ACQ(&_tinystm.threads); t != NULL; t = t->next) {
+    if (ATOMIC_LOAD(&t->attached) == 0 && ATOMIC_CAS_FULL(&t->attached, 0, 1) != 0) {
+      PRINT_DEBUG("==> stm_pool_get(%p)\n", t);
+      assert(!IS_ACTIVE(t->status));
+      stm_pool_join();
+      return t;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Detach descriptor from exiting thread.
+ */
+static INLINE void
+stm_pool_put(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_pool_put(%p)\n", tx);
+
+  /* Can only be called if non-active */
+  assert(!IS_ACTIVE(tx->status));
+
+  stm_pool_leave();
+  /* Specific data belongs to the thread (slots are cleared upon reattach) */
+  stm_specific_free(tx);
+#ifdef EPOCH_GC
+  gc_exit_thread();
+#endif /* EPOCH_GC */
+  tls_set_tx(NULL);
+  /* Descriptor must not be used anymore once another thread can claim it */
+  ATOMIC_STORE_REL(&tx->attached, 0);
+}
+
+/*
+ * Free all descriptors (upon library shutdown).
+ */
+static INLINE void
+stm_pool_exit(void)
+{
+  stm_tx_t *t;
+
+  PRINT_DEBUG("==> stm_pool_exit()\n");
+
+  while ((t = _tinystm.threads) != NULL) {
+    /* All threads must have exited */
+    assert(t->attached == 0);
+    _tinystm.threads = t->next;
+#ifdef PRIVATIZATION_FENCE
+    stm_fence_exit_thread(t);
+#endif /* PRIVATIZATION_FENCE */
+    xfree(t->r_set.entries);
+    xfree(t->w_set.entries);
+#ifdef WRITE_SET_HASH
+    xfree(t->w_set.hash);
+#endif /* WRITE_SET_HASH */
+#ifdef SORTED_COMMIT
+    xfree(t->w_set.sorted);
+#endif /* SORTED_COMMIT */
+#ifdef CLOSED_NESTING
+    xfree(t->nested_undo);
+#endif /* CLOSED_NESTING */
+    stm_specific_free(t);
+    xfree(t);
+  }
+}
+
+#endif /* _STM_POOL_H_ */
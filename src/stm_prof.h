@@ -0,0 +1,121 @@
+/*
+ * File:
+ *   stm_prof.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM sampling of cycles spent in each phase of transactions.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_PROF_H_
+#define _STM_PROF_H_
+
+/*
+ * One in _tinystm.prof_period transactions of each thread is sampled:
+ * from its start until it commits (or gives up), each transition
+ * between phases is timestamped and the time elapsed since the previous
+ * transition is charged to the phase being left.  Nested phases (e.g.,
+ * validation upon a read) restore the enclosing one when they complete.
+ * Time of attempts that abort is additionally accumulated on its own.
+ * Transactions that are not sampled only test a thread-local flag.
+ */
+
+/*
+ * Switch to phase and return the previous one.
+ */
+static INLINE int
+stm_prof_enter(stm_tx_t *tx, int phase)
+{
+  uint64_t now;
+  int prev;
+
+  if (likely(!tx->prof))
+    return PROF_OTHER;
+  now = stm_cycles();
+  prev = tx->prof_phase;
+  tx->prof_cycles[prev] += now - tx->prof_ts;
+  tx->prof_ts = now;
+  tx->prof_phase = phase;
+  return prev;
+}
+
+/*
+ * Return to phase left by stm_prof_enter().
+ */
+static INLINE void
+stm_prof_leave(stm_tx_t *tx, int prev)
+{
+  if (unlikely(tx->prof))
+    stm_prof_enter(tx, prev);
+}
+
+/*
+ * Decide whether to sample the transaction (upon start).
+ */
+static INLINE void
+stm_prof_start(stm_tx_t *tx)
+{
+  if (likely(++tx->prof_count < _tinystm.prof_period))
+    return;
+  tx->prof_count = 0;
+  if (_tinystm.prof_period == 0)
+    return;
+  tx->prof = 1;
+  tx->prof_samples++;
+  tx->prof_phase = PROF_OTHER;
+  tx->prof_ts = tx->prof_attempt = stm_cycles();
+}
+
+/*
+ * Charge aborted attempt (upon rollback).
+ */
+static INLINE void
+stm_prof_abort(stm_tx_t *tx)
+{
+  if (likely(!tx->prof))
+    return;
+  stm_prof_enter(tx, PROF_ROLLBACK);
+  tx->prof_aborted += tx->prof_ts - tx->prof_attempt;
+}
+
+/*
+ * Start new attempt (upon restart).
+ */
+static INLINE void
+stm_prof_restart(stm_tx_t *tx)
+{
+  if (likely(!tx->prof))
+    return;
+  stm_prof_enter(tx, PROF_OTHER);
+  tx->prof_attempt = tx->prof_ts;
+}
+
+/*
+ * Stop sampling (upon commit or when not retrying).
+ */
+static INLINE void
+stm_prof_end(stm_tx_t *tx)
+{
+  if (likely(!tx->prof))
+    return;
+  stm_prof_enter(tx, PROF_OTHER);
+  tx->prof = 0;
+}
+
+#endif /* _STM_PROF_H_ */
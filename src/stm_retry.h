@@ -0,0 +1,148 @@
+/*
+ * File:
+ *   stm_retry.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM blocking retry.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_RETRY_H_
+#define _STM_RETRY_H_
+
+/*
+ * A transaction that calls stm_retry() is rolled back and then sleeps
+ * until one of the locks of its read set gets a new version.  Sleeping
+ * threads are counted globally and in a small table indexed by a hash
+ * of the locks they have read.  Committing transactions only look up
+ * the table for the locks of their write set when some thread is
+ * sleeping, and only wake up sleepers when one of these locks hashes to
+ * a slot with sleepers.  All sleepers share a single futex and check
+ * their own read set when woken up.  Sleeps are bounded by RETRY_TIMEOUT:
+ * updates that do not wake up sleepers (e.g., unit stores) only delay
+ * them.
+ */
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* Futexes are 32-bit words: use least significant half of sequence number */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+# define RETRY_FUTEX_WORD               ((int *)&_tinystm.retry_seq + (sizeof(stm_word_t) / sizeof(int) - 1))
+#else /* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
+# define RETRY_FUTEX_WORD               ((int *)&_tinystm.retry_seq)
+#endif /* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
+
+/*
+ * Get slot of lock.
+ */
+static INLINE volatile stm_word_t *
+stm_retry_slot(volatile stm_word_t *lock)
+{
+  return &_tinystm.retry_slots[((stm_word_t)lock >> 3) & (RETRY_SLOTS - 1)];
+}
+
+/*
+ * Check if some lock of the read set has a new version.
+ */
+static INLINE int
+stm_retry_changed(stm_tx_t *tx)
+{
+  r_entry_t *r;
+  stm_word_t l;
+  int i;
+
+  r = tx->r_set.entries;
+  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+    l = ATOMIC_LOAD_ACQ(r->lock);
+#if DESIGN == NOREC
+    /* Entries hold the values read */
+    if (l != r->version)
+      return 1;
+#else /* DESIGN != NOREC */
+    /* Owners wake us up after releasing the lock */
+    if (!LOCK_GET_OWNED(l) && LOCK_GET_TIMESTAMP(l) != r->version)
+      return 1;
+#endif /* DESIGN != NOREC */
+  }
+  return 0;
+}
+
+/*
+ * Sleep until some location of the read set is updated (after rollback).
+ */
+static NOINLINE void
+stm_retry_wait(stm_tx_t *tx)
+{
+  struct timespec ts;
+  stm_word_t seq;
+  r_entry_t *r;
+  int i;
+
+  /* Nothing could ever wake us up */
+  if (tx->r_set.nb_entries == 0)
+    return;
+
+  r = tx->r_set.entries;
+  for (i = tx->r_set.nb_entries; i > 0; i--, r++)
+    ATOMIC_FETCH_INC_FULL(stm_retry_slot(r->lock));
+  ATOMIC_FETCH_INC_FULL(&_tinystm.retry_waiters);
+  for (;;) {
+    /* Read sequence number before checking the locks (see stm_retry_wake()) */
+    seq = ATOMIC_LOAD_ACQ(&_tinystm.retry_seq);
+    if (stm_retry_changed(tx))
+      break;
+    ts.tv_sec = 0;
+    ts.tv_nsec = RETRY_TIMEOUT;
+    syscall(SYS_futex, RETRY_FUTEX_WORD, FUTEX_WAIT_PRIVATE, (int)seq, &ts, NULL, 0);
+  }
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.retry_waiters);
+  r = tx->r_set.entries;
+  for (i = tx->r_set.nb_entries; i > 0; i--, r++)
+    ATOMIC_FETCH_DEC_FULL(stm_retry_slot(r->lock));
+}
+
+/*
+ * Wake up threads sleeping on the locks of the write set (after release).
+ */
+static INLINE void
+stm_retry_wake(stm_tx_t *tx)
+{
+  w_entry_t *w;
+  int i;
+
+  /* Lock releases must be visible before checking for sleepers */
+  ATOMIC_MB_FULL;
+  if (likely(ATOMIC_LOAD(&_tinystm.retry_waiters) == 0))
+    return;
+
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    if (ATOMIC_LOAD(stm_retry_slot(w->lock)) != 0) {
+      ATOMIC_FETCH_INC_FULL(&_tinystm.retry_seq);
+      syscall(SYS_futex, RETRY_FUTEX_WORD, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+      return;
+    }
+  }
+}
+
+#endif /* _STM_RETRY_H_ */
@@ -0,0 +1,466 @@
+/*
+ * File:
+ *   stm_ring.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for RingSTM (validation with write signatures).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_RING_H_
+#define _STM_RING_H_
+
+/*
+ * Single-writer variant of RingSTM (RingSW).  As with NOrec, the global
+ * clock is a sequence lock: it is odd while an update transaction
+ * writes back its updates and is incremented by 2 upon each commit.
+ * Before writing back, the committer publishes the Bloom filter of the
+ * addresses it writes (write signature) in the ring entry of its
+ * commit time.  Reads do not use the read set: addresses are added to
+ * the read signature of the transaction, and reads are consistent as
+ * long as the clock has not changed since tx->end.  Otherwise, the
+ * snapshot is extended by intersecting the read signature with the
+ * write signatures of the commits since tx->end, so validation costs
+ * O(commits) instead of O(reads).  Signatures may yield false conflicts,
+ * and transactions whose snapshot is older than the ring cannot extend.
+ */
+
+/* Index of bit of an address in signatures */
+#define RING_SIG_HASH(a)                ((((stm_word_t)(a) >> LOCK_SHIFT_WORD) ^ ((stm_word_t)(a) >> (LOCK_SHIFT_WORD + 10))) & (RING_SIG_BITS - 1))
+#define RING_SIG_WORD(h)                ((h) / (8 * sizeof(stm_word_t)))
+#define RING_SIG_BIT(h)                 ((stm_word_t)1 << ((h) % (8 * sizeof(stm_word_t))))
+/* Ring entry of a commit time (times are even) */
+#define RING_ENTRY(t)                   (&_tinystm.ring[((t) >> 1) & (RING_SIZE - 1)])
+
+/*
+ * Add address to signature.
+ */
+static INLINE void
+stm_ring_sig_add(stm_word_t *sig, volatile stm_word_t *addr)
+{
+  stm_word_t h = RING_SIG_HASH(addr);
+
+  sig[RING_SIG_WORD(h)] |= RING_SIG_BIT(h);
+}
+
+/*
+ * Wait until no transaction writes back and check that no commit since
+ * the snapshot has written an address read (returns 0 upon conflict or
+ * if the ring has been overwritten, or the stable time of the check in
+ * *now).
+ */
+static INLINE int
+stm_ring_check(stm_tx_t *tx, stm_word_t *now)
+{
+  ring_entry_t *e;
+  stm_word_t t, ts;
+  int i;
+
+  /* Wait for commit in progress */
+  while (((t = GET_CLOCK) & 1) != 0)
+    ;
+  if (unlikely(t - tx->end > 2 * RING_SIZE)) {
+    /* Signatures have been overwritten: cannot validate */
+    SET_CONFLICT(tx, NULL, NULL);
+    return 0;
+  }
+  /* Signatures up to t are published (before the clock is released) */
+  for (ts = tx->end + 2; ts <= t; ts += 2) {
+    e = RING_ENTRY(ts);
+    if (unlikely(ATOMIC_LOAD_ACQ(&e->ts) != ts))
+      goto overwritten;
+    for (i = 0; i < RING_SIG_WORDS; i++) {
+      if ((ATOMIC_LOAD(&e->sig[i]) & tx->ring_rsig[i]) != 0) {
+        /* Address read may have been written: cannot validate */
+        SET_CONFLICT(tx, NULL, NULL);
+        return 0;
+      }
+    }
+    /* Signature must have been read before checking its time again */
+    ATOMIC_MB_READ;
+    if (unlikely(ATOMIC_LOAD(&e->ts) != ts))
+      goto overwritten;
+  }
+  *now = t;
+  return 1;
+
+ overwritten:
+  /* Entry reused by a later commit */
+  SET_CONFLICT(tx, NULL, NULL);
+  return 0;
+}
+
+static INLINE int
+stm_ring_validate(stm_tx_t *tx)
+{
+  stm_word_t now;
+
+  PRINT_DEBUG("==> stm_ring_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  if (!stm_ring_check(tx, &now))
+    return 0;
+  /* Reads are also valid until now */
+  tx->end = now;
+  return 1;
+}
+
+/*
+ * Extend snapshot range.
+ */
+static INLINE int
+stm_ring_extend(stm_tx_t *tx)
+{
+  stm_word_t now;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
+
+  PRINT_DEBUG("==> stm_ring_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  /* Try to validate read signature */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+  if (stm_ring_check(tx, &now)) {
+#ifdef TM_STATISTICS2
+    stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
+    /* It works: we can extend until now */
+    tx->end = now;
+    tx->nb_extensions++;
+#ifdef SANDBOXING
+    tx->sb_reads = 0;
+#endif /* SANDBOXING */
+    stm_notify_event(STM_EVENT_EXTEND);
+    return 1;
+  }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
+  return 0;
+}
+
+static INLINE void
+stm_ring_rollback(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_ring_rollback(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  assert(IS_ACTIVE(tx->status));
+
+  /* Nothing to do: updates are buffered and the clock is not held */
+}
+
+/*
+ * Get write set entry of an address (accesses after a write usually
+ * target the address written last).
+ */
+static INLINE w_entry_t *
+stm_ring_written(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  w_entry_t *w;
+
+  if (likely(tx->w_set.last < tx->w_set.nb_entries)) {
+    w = &tx->w_set.entries[tx->w_set.last];
+    /* Addresses appear only once in the write set */
+    if (likely(w->addr == addr))
+      return w;
+  }
+  return stm_has_written(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_ring_read(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+  w_entry_t *written;
+
+  PRINT_DEBUG2("==> stm_ring_read(t=%p[%lu-%lu],a=%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, addr);
+
+  assert(IS_ACTIVE(tx->status));
+
+  /* Did we previously write the same address? */
+  written = stm_ring_written(tx, addr);
+  if (written != NULL) {
+    /* Yes: get value from write set if possible */
+    if (written->mask == ~(stm_word_t)0) {
+      value = written->value;
+      /* No need to add to read signature */
+      return value;
+    }
+  }
+
+#ifdef IRREVOCABLE_ENABLED
+  if (tx->irrevocable) {
+    /* Commits that started before we became irrevocable may still write back */
+    while ((GET_CLOCK & 1) != 0)
+      ;
+    /* In irrevocable mode, no need to check the clock nor to add to the signature */
+    value = ATOMIC_LOAD_ACQ(addr);
+    goto return_value;
+  }
+#endif /* IRREVOCABLE_ENABLED */
+
+  /* Add address to read signature (checked by extensions) */
+  stm_ring_sig_add(tx->ring_rsig, addr);
+
+  value = ATOMIC_LOAD_ACQ(addr);
+  /* Valid value if no transaction has committed since the snapshot */
+  while (unlikely(GET_CLOCK != tx->end) && !stm_defer_validation(tx)) {
+    /* Read-only transactions also keep a read signature: they can extend */
+    if (!stm_ring_extend(tx)) {
+      /* Not much we can do: abort */
+      SET_CONFLICT(tx, addr, NULL);
+      stm_rollback(tx, STM_ABORT_VAL_READ);
+      return 0;
+    }
+    /* The value may have been overwritten before extension: read again */
+    value = ATOMIC_LOAD_ACQ(addr);
+  }
+
+#ifdef IRREVOCABLE_ENABLED
+ return_value:
+#endif /* IRREVOCABLE_ENABLED */
+  /* Did we previously write the same address? */
+  if (written != NULL)
+    value = (value & ~written->mask) | (written->value & written->mask);
+  return value;
+}
+
+static INLINE w_entry_t *
+stm_ring_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  w_entry_t *w;
+
+  PRINT_DEBUG2("==> stm_ring_write(t=%p[%lu-%lu],a=%p,d=%p-%lu,m=0x%lx)\n",
+               tx, (unsigned long)tx->start, (unsigned long)tx->end, addr, (void *)value, (unsigned long)value, (unsigned long)mask);
+
+  w = stm_ring_written(tx, addr);
+  if (w != NULL) {
+#ifdef CLOSED_NESTING
+    stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
+    w->value = (w->value & ~mask) | (value & mask);
+    w->mask |= mask;
+    tx->w_set.last = w - tx->w_set.entries;
+    return w;
+  }
+
+  /* Add address to write set and write signature (no lock to acquire nor version to check) */
+  if (tx->w_set.nb_entries == tx->w_set.size)
+    stm_allocate_ws_entries(tx, 1);
+  tx->w_set.last = tx->w_set.nb_entries;
+  w = &tx->w_set.entries[tx->w_set.nb_entries++];
+  w->addr = addr;
+  w->mask = mask;
+  w->lock = addr;
+  if (mask == 0) {
+    /* Do not write anything */
+#ifndef NDEBUG
+    w->value = 0;
+#endif /* ! NDEBUG */
+  } else {
+    /* Remember new value */
+    w->value = value;
+  }
+#ifndef NDEBUG
+  w->version = 0;
+#endif /* ! NDEBUG */
+  w->no_drop = 1;
+#ifdef USE_BLOOM_FILTER
+  tx->w_set.bloom[FILTER_WORD(addr)] |= FILTER_BITS(addr);
+#endif /* USE_BLOOM_FILTER */
+  stm_ring_sig_add(tx->ring_wsig, addr);
+
+  return w;
+}
+
+static INLINE stm_word_t
+stm_ring_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+
+  /* The address may have been written on some paths since it was read */
+  if (likely(stm_has_written(tx, addr) == NULL)) {
+    value = ATOMIC_LOAD_ACQ(addr);
+    /* The address is already in the read signature: the value is valid
+     * if no transaction has committed since the snapshot */
+    if (likely(GET_CLOCK == tx->end))
+      return value;
+  }
+  return stm_ring_read(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_ring_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  w_entry_t *w;
+
+  w = stm_ring_written(tx, addr);
+  if (likely(w != NULL && w->mask == ~(stm_word_t)0))
+    return w->value;
+  /* Partially written (or not written on all paths): merge with memory */
+  return stm_ring_read(tx, addr);
+}
+
+static INLINE stm_word_t
+stm_ring_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  stm_word_t value;
+
+  /* We need to return the value here, so write with mask=0 is not enough. */
+  value = stm_ring_read(tx, addr);
+  /* Add empty entry such that the next write finds it directly */
+  stm_ring_write(tx, addr, 0, 0);
+  return value;
+}
+
+static INLINE void
+stm_ring_WaR(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  stm_ring_write(tx, addr, value, mask);
+}
+
+static INLINE void
+stm_ring_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
+{
+  w_entry_t *w;
+
+  /* Get the write set entry. */
+  w = stm_ring_written(tx, addr);
+  if (unlikely(w == NULL)) {
+    /* Not written on all paths */
+    stm_ring_write(tx, addr, value, mask);
+    return;
+  }
+#ifdef CLOSED_NESTING
+  stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
+  /* Update directly into the write set (installed upon commit). */
+  w->value = (w->value & ~mask) | (value & mask);
+  w->mask |= mask;
+}
+
+/*
+ * Publish write signature of commit time t (the sequence lock must be
+ * held, sig is NULL for an empty signature).
+ */
+static INLINE void
+stm_ring_publish(stm_word_t t, const stm_word_t *sig)
+{
+  ring_entry_t *e;
+  int i;
+
+  e = RING_ENTRY(t);
+  /* Readers of the previous use of the entry detect the overwrite */
+  ATOMIC_STORE(&e->ts, 0);
+  ATOMIC_MB_WRITE;
+  for (i = 0; i < RING_SIG_WORDS; i++)
+    ATOMIC_STORE(&e->sig[i], sig == NULL ? 0 : sig[i]);
+  ATOMIC_STORE_REL(&e->ts, t);
+}
+
+/*
+ * Advance the clock without writing (publishes an empty signature).
+ */
+static INLINE void
+stm_ring_tick(void)
+{
+  stm_word_t t;
+
+  do {
+    while (((t = GET_CLOCK) & 1) != 0)
+      ;
+  } while (ATOMIC_CAS_FULL(&CLOCK, t, t + 1) == 0);
+  stm_ring_publish(t + 2, NULL);
+  ATOMIC_STORE_REL(&CLOCK, t + 2);
+}
+
+/*
+ * Write back new value of an entry.
+ */
+static INLINE void
+stm_ring_install(w_entry_t *w)
+{
+  stm_word_t value;
+
+  if (w->mask == ~(stm_word_t)0) {
+    ATOMIC_STORE(w->addr, w->value);
+  } else if (w->mask != 0) {
+    value = (ATOMIC_LOAD(w->addr) & ~w->mask) | (w->value & w->mask);
+    ATOMIC_STORE(w->addr, value);
+  }
+}
+
+static INLINE int
+stm_ring_commit(stm_tx_t *tx)
+{
+  w_entry_t *w;
+  stm_word_t t;
+  int i;
+
+  PRINT_DEBUG("==> stm_ring_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  /* Acquire the sequence lock at a time our snapshot is still valid */
+  for (;;) {
+#ifdef IRREVOCABLE_ENABLED
+    if (unlikely(tx->irrevocable)) {
+      /* Other update transactions cannot commit: no need to validate */
+      while (((t = GET_CLOCK) & 1) != 0)
+        ;
+      if (ATOMIC_CAS_FULL(&CLOCK, t, t + 1) != 0)
+        break;
+      continue;
+    }
+#endif /* IRREVOCABLE_ENABLED */
+    t = tx->end;
+    if (likely(ATOMIC_CAS_FULL(&CLOCK, t, t + 1) != 0))
+      break;
+    /* Another transaction has committed since the snapshot */
+    if (!stm_ring_extend(tx)) {
+      /* Cannot commit */
+      stm_rollback(tx, STM_ABORT_VALIDATE);
+      return 0;
+    }
+  }
+
+#ifdef IRREVOCABLE_ENABLED
+  /* Verify if there is an irrevocable transaction once the lock is held */
+  if (!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG)) {
+    /* Nothing has been published nor written: release without changing the time */
+    ATOMIC_STORE_REL(&CLOCK, t);
+    stm_rollback(tx, STM_ABORT_IRREVOCABLE);
+    return 0;
+  }
+#endif /* IRREVOCABLE_ENABLED */
+
+  /* Publish write signature before writing back */
+  stm_ring_publish(t + 2, tx->ring_wsig);
+
+  /* Install new values */
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++)
+    stm_ring_install(w);
+
+  /* Release the sequence lock (may exceed VERSION_MAX: rollover upon next start) */
+  ATOMIC_STORE_REL(&CLOCK, t + 2);
+
+  return 1;
+}
+
+#endif /* _STM_RING_H_ */
@@ -0,0 +1,174 @@
+/*
+ * File:
+ *   stm_ro.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM read-only mode learned per atomic block.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_RO_H_
+#define _STM_RO_H_
+
+/*
+ * Each thread counts, per atomic block (attr.id modulo RO_HINTS), the
+ * consecutive commits of its transactions that did not write.  After
+ * RO_THRESHOLD of them, transactions of the block start in read-only
+ * mode (no read set, commit without validation) unless their attributes
+ * already say so.  The first write (or request for irrevocability)
+ * demotes the transaction: it restarts as an update transaction with
+ * STM_ABORT_RO_WRITE and the count of the block starts over.  As
+ * transactions in read-only mode cannot extend their snapshot, they
+ * also restart in update mode after RO_VAL_ABORTS consecutive aborts
+ * due to failed validation (e.g., under heavy update traffic).
+ */
+
+/*
+ * Select the mode of the atomic block (upon start).
+ */
+static INLINE void
+stm_ro_start(stm_tx_t *tx)
+{
+  tx->ro_hint = &tx->ro_hints[(unsigned int)tx->attr.id & (RO_HINTS - 1)];
+  tx->ro_learned = 0;
+  tx->ro_aborts = 0;
+  if (tx->attr.read_only || *tx->ro_hint < RO_THRESHOLD)
+    return;
+#ifdef ELASTIC_TX
+  if (tx->attr.elastic)
+    return;
+#endif /* ELASTIC_TX */
+#ifdef IRREVOCABLE_ENABLED
+  /* Irrevocable transactions only validate their read set */
+  if (tx->irrevocable != 0)
+    return;
+#endif /* IRREVOCABLE_ENABLED */
+  tx->attr.read_only = 1;
+  tx->ro_learned = 1;
+}
+
+/*
+ * Restart transaction in update mode.
+ */
+static NOINLINE void
+stm_ro_demote(stm_tx_t *tx)
+{
+  PRINT_DEBUG("==> stm_ro_demote(%p)\n", tx);
+
+  *tx->ro_hint = 0;
+  tx->ro_learned = 0;
+  tx->attr.read_only = 0;
+#ifdef TM_STATISTICS
+  tx->stat_ro_misses++;
+#endif /* TM_STATISTICS */
+  stm_rollback(tx, STM_ABORT_RO_WRITE);
+}
+
+/*
+ * Demote transaction before it writes if in learned read-only mode
+ * (return 1 if it has been rolled back without restart).
+ */
+static INLINE int
+stm_ro_write(stm_tx_t *tx)
+{
+  /* Read-only mode may have been cleared (e.g., by visible reads) */
+  if (likely(!tx->ro_learned || !tx->attr.read_only))
+    return 0;
+  stm_ro_demote(tx);
+  return 1;
+}
+
+/*
+ * Restart in update mode after too many validation aborts (upon abort).
+ */
+static INLINE void
+stm_ro_abort(stm_tx_t *tx, unsigned int reason)
+{
+  if (likely(!tx->ro_learned))
+    return;
+  if (reason != STM_ABORT_VAL_READ && reason != STM_ABORT_VALIDATE)
+    return;
+  if (++tx->ro_aborts < RO_VAL_ABORTS)
+    return;
+  *tx->ro_hint = 0;
+  tx->ro_learned = 0;
+  tx->attr.read_only = 0;
+#ifdef TM_STATISTICS
+  tx->stat_ro_misses++;
+#endif /* TM_STATISTICS */
+}
+
+#ifdef IRREVOCABLE_ENABLED
+/*
+ * Leave read-only mode before becoming irrevocable, as validation of an
+ * active transaction needs a read set (return 1 if it has been rolled
+ * back without restart).
+ */
+static INLINE int
+stm_ro_irrevocable(stm_tx_t *tx)
+{
+  if (likely(!tx->ro_learned || !tx->attr.read_only))
+    return 0;
+  if (IS_ACTIVE(tx->status)) {
+    stm_ro_demote(tx);
+    return 1;
+  }
+  /* Restarting in irrevocable mode */
+  tx->ro_learned = 0;
+  tx->attr.read_only = 0;
+  return 0;
+}
+#endif /* IRREVOCABLE_ENABLED */
+
+/*
+ * Record whether the atomic block wrote (upon commit).
+ */
+static INLINE void
+stm_ro_commit(stm_tx_t *tx)
+{
+#ifdef HYBRID_HTM
+  /* Hardware transactions have no write set */
+  if (tx->htm)
+    return;
+#endif /* HYBRID_HTM */
+  if (tx->w_set.nb_entries != 0) {
+    *tx->ro_hint = 0;
+    return;
+  }
+  if (*tx->ro_hint < RO_THRESHOLD)
+    (*tx->ro_hint)++;
+#ifdef TM_STATISTICS
+  if (tx->ro_learned)
+    tx->stat_ro_hits++;
+#endif /* TM_STATISTICS */
+}
+
+/*
+ * Forget modes learned for atomic blocks.
+ */
+static INLINE void
+stm_ro_init(stm_tx_t *tx)
+{
+  memset(tx->ro_hints, 0, sizeof(tx->ro_hints));
+  tx->ro_hint = &tx->ro_hints[0];
+  tx->ro_learned = 0;
+  tx->ro_aborts = 0;
+}
+
+#endif /* _STM_RO_H_ */
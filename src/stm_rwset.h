@@ -0,0 +1,177 @@
+/*
+ * File:
+ *   stm_rwset.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM adaptive sizing of read and write sets.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_RWSET_H_
+#define _STM_RWSET_H_
+
+/*
+ * Each thread keeps, per atomic block (attr.id modulo RW_HINTS), the
+ * sizes of read and write sets that its transactions needed: a size
+ * grows to the smallest power of two (times RW_SET_SIZE) that holds a
+ * committed set and is halved after RW_SET_TRIM commits that used at
+ * most a quarter of it.  Sets are enlarged upon start when the block
+ * needs more, so that they do not have to be extended while active
+ * (with WRITE_BACK_ETL and WRITE_THROUGH, the transaction restarts).
+ * They are shrunk after RW_SET_TRIM consecutive starts of blocks that
+ * all need less, to the largest size these blocks need.
+ */
+
+/*
+ * Update size needed by a block.
+ */
+static INLINE unsigned int
+stm_rwset_need(unsigned int size, unsigned int *small, unsigned int nb)
+{
+  if (nb > size) {
+    *small = 0;
+    while (size < nb)
+      size *= 2;
+  } else if (nb <= size / 4 && size > RW_SET_SIZE) {
+    if (++*small >= RW_SET_TRIM) {
+      *small = 0;
+      size /= 2;
+    }
+  } else
+    *small = 0;
+  return size;
+}
+
+/*
+ * Reallocate read and write sets (while inactive).
+ */
+static NOINLINE void
+stm_rwset_resize(stm_tx_t *tx, unsigned int r, unsigned int w)
+{
+  PRINT_DEBUG("==> stm_rwset_resize(%p,%u,%u)\n", tx, r, w);
+
+  if (r != tx->r_set.size) {
+#ifdef EPOCH_GC
+    gc_free(tx->r_set.entries, GET_CLOCK);
+#else /* ! EPOCH_GC */
+    xfree(tx->r_set.entries);
+#endif /* ! EPOCH_GC */
+    tx->r_set.size = r;
+    stm_allocate_rs_entries(tx, 0);
+  }
+  if (w != tx->w_set.size) {
+#ifdef EPOCH_GC
+    /* Other transactions may still access entries through locks */
+    gc_free(tx->w_set.entries, GET_CLOCK);
+#else /* ! EPOCH_GC */
+    xfree(tx->w_set.entries);
+#endif /* ! EPOCH_GC */
+    tx->w_set.size = w;
+    stm_allocate_ws_entries(tx, 0);
+#ifdef WRITE_SET_HASH
+    if (tx->w_set.hash_size > 2 * w) {
+      /* Reallocated upon next use (see stm_ws_hash_update()) */
+      xfree(tx->w_set.hash);
+      tx->w_set.hash = NULL;
+      tx->w_set.hash_size = 0;
+      tx->w_set.nb_indexed = 0;
+    }
+#endif /* WRITE_SET_HASH */
+#ifdef SORTED_COMMIT
+    if (tx->w_set.sorted_size > w) {
+      /* Reallocated upon next use (see stm_ws_sort()) */
+      xfree(tx->w_set.sorted);
+      tx->w_set.sorted = NULL;
+      tx->w_set.sorted_size = 0;
+    }
+#endif /* SORTED_COMMIT */
+  }
+#ifdef TM_STATISTICS
+  tx->stat_rw_resizes++;
+#endif /* TM_STATISTICS */
+}
+
+/*
+ * Size read and write sets for the atomic block (before start).
+ */
+static INLINE void
+stm_rwset_start(stm_tx_t *tx)
+{
+  rw_hint_t *h;
+  unsigned int r, w;
+
+  h = tx->rw_hint = &tx->rw_hints[(unsigned int)tx->attr.id & (RW_HINTS - 1)];
+  r = h->r_size;
+  w = h->w_size;
+  if (likely(r == tx->r_set.size && w == tx->w_set.size)) {
+    tx->rw_trim = 0;
+    return;
+  }
+  if (r > tx->r_set.size || w > tx->w_set.size) {
+    /* Block is known to need more */
+    stm_rwset_resize(tx, r > tx->r_set.size ? r : tx->r_set.size, w > tx->w_set.size ? w : tx->w_set.size);
+    tx->rw_trim = 0;
+    return;
+  }
+  /* Sets are larger than needed */
+  if (tx->rw_trim++ == 0) {
+    tx->rw_trim_r = r;
+    tx->rw_trim_w = w;
+  } else {
+    if (tx->rw_trim_r < r)
+      tx->rw_trim_r = r;
+    if (tx->rw_trim_w < w)
+      tx->rw_trim_w = w;
+  }
+  if (unlikely(tx->rw_trim >= RW_SET_TRIM)) {
+    stm_rwset_resize(tx, tx->rw_trim_r, tx->rw_trim_w);
+    tx->rw_trim = 0;
+  }
+}
+
+/*
+ * Record sizes of read and write sets needed by the atomic block (upon commit).
+ */
+static INLINE void
+stm_rwset_commit(stm_tx_t *tx)
+{
+  rw_hint_t *h;
+
+  h = tx->rw_hint;
+  h->r_size = stm_rwset_need(h->r_size, &h->r_small, tx->r_set.nb_entries);
+  h->w_size = stm_rwset_need(h->w_size, &h->w_small, tx->w_set.nb_entries);
+}
+
+/*
+ * Forget sizes needed by atomic blocks.
+ */
+static INLINE void
+stm_rwset_init(stm_tx_t *tx)
+{
+  unsigned int i;
+
+  for (i = 0; i < RW_HINTS; i++) {
+    tx->rw_hints[i].r_size = tx->rw_hints[i].w_size = RW_SET_SIZE;
+    tx->rw_hints[i].r_small = tx->rw_hints[i].w_small = 0;
+  }
+  tx->rw_hint = &tx->rw_hints[0];
+  tx->rw_trim = 0;
+}
+
+#endif /* _STM_RWSET_H_ */
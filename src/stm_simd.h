@@ -0,0 +1,130 @@
+/*
+ * File:
+ *   stm_simd.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM internal functions for vectorized read set validation.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_SIMD_H_
+#define _STM_SIMD_H_
+
+/*
+ * The validation functions of the designs first skip, several entries
+ * at a time, the read set entries whose lock is not owned and still has
+ * the version that was read.  The lock words are gathered directly
+ * from the (version, lock) pairs of the read set.  The first entry that
+ * does not pass this fast check is handled by the regular validation
+ * code (e.g., lock owned by the transaction itself), which tries again
+ * with the vector code on the next entries.
+ *
+ * The instruction set is selected at runtime in stm_init().  Functions
+ * are compiled with the target attribute so that the library does not
+ * need to be compiled with -mavx2 or -mavx512f.
+ */
+
+#include <immintrin.h>
+
+/*
+ * Detect best instruction set supported by the processor.
+ */
+static INLINE int
+stm_simd_detect(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return SIMD_AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  return SIMD_NONE;
+}
+
+/*
+ * Return number of leading entries (by groups of 4) that are valid.
+ */
+static NOINLINE __attribute__((target("avx2"))) int
+stm_simd_validate_avx2(r_entry_t *r, int n)
+{
+  __m256i a, b, v, p, l, ok;
+  const __m256i owned = _mm256_set1_epi64x(OWNED_MASK);
+  int i;
+
+  for (i = 0; i + 4 <= n; i += 4, r += 4) {
+    /* Entries come as (version, lock) pairs */
+    a = _mm256_loadu_si256((__m256i *)r);
+    b = _mm256_loadu_si256((__m256i *)(r + 2));
+    /* Same (permuted) order for versions and locks */
+    v = _mm256_unpacklo_epi64(a, b);
+    p = _mm256_unpackhi_epi64(a, b);
+    l = _mm256_i64gather_epi64((const long long *)0, p, 1);
+    /* Not owned and same version? */
+    ok = _mm256_and_si256(_mm256_cmpeq_epi64(_mm256_and_si256(l, owned), _mm256_setzero_si256()),
+                          _mm256_cmpeq_epi64(_mm256_srli_epi64(l, LOCK_BITS), v));
+    if (_mm256_movemask_epi8(ok) != -1)
+      break;
+  }
+  return i;
+}
+
+/*
+ * Return number of leading entries (by groups of 8) that are valid.
+ */
+static NOINLINE __attribute__((target("avx512f"))) int
+stm_simd_validate_avx512(r_entry_t *r, int n)
+{
+  __m512i a, b, v, p, l;
+  const __m512i owned = _mm512_set1_epi64(OWNED_MASK);
+  const __m512i iv = _mm512_set_epi64(14, 12, 10, 8, 6, 4, 2, 0);
+  const __m512i il = _mm512_set_epi64(15, 13, 11, 9, 7, 5, 3, 1);
+  __mmask8 ok;
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8, r += 8) {
+    a = _mm512_loadu_si512((void *)r);
+    b = _mm512_loadu_si512((void *)(r + 4));
+    v = _mm512_permutex2var_epi64(a, iv, b);
+    p = _mm512_permutex2var_epi64(a, il, b);
+    l = _mm512_i64gather_epi64(p, (const void *)0, 1);
+    ok = _mm512_testn_epi64_mask(l, owned) & _mm512_cmpeq_epi64_mask(_mm512_srli_epi64(l, LOCK_BITS), v);
+    if (ok != 0xFF)
+      break;
+  }
+  return i;
+}
+
+/*
+ * Return number of leading entries that are trivially valid.
+ */
+static INLINE int
+stm_simd_validate(r_entry_t *r, int n)
+{
+  switch (_tinystm.simd) {
+    case SIMD_AVX512:
+      if (n >= 8)
+        return stm_simd_validate_avx512(r, n);
+      /* Fall through */
+    case SIMD_AVX2:
+      if (n >= 4)
+        return stm_simd_validate_avx2(r, n);
+  }
+  return 0;
+}
+
+#endif /* _STM_SIMD_H_ */
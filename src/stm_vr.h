@@ -0,0 +1,168 @@
+/*
+ * File:
+ *   stm_vr.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   STM shared visible reads (reader indicators).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _STM_VR_H_
+#define _STM_VR_H_
+
+/*
+ * A transaction with visible reads announces itself in a reader
+ * indicator (a counter in a table indexed by a hash of the lock) before
+ * reading a location, and leaves all its indicators when it commits or
+ * aborts.  It does not acquire the lock nor keep a read set: as long as
+ * the indicator is non-zero, update transactions that have acquired the
+ * lock wait before committing, hence the value cannot change.  Readers
+ * can therefore share a location and never need to validate.  Writers
+ * only look up the table when some transaction holds an indicator, and
+ * they give up (abort) after VR_WAIT attempts to break cycles between
+ * writers waiting for each other's reads.  A writer that gives up waits
+ * for the readers, after having left its own indicators, before
+ * restarting, and then for a random delay: otherwise writers in a cycle
+ * would abort and meet again.  Readers never kill a writer
+ * that waits for readers, and readers that abort because of a writer
+ * wait for the lock to be released before restarting: otherwise they
+ * would immediately take their indicators again.  Unit stores do not
+ * wait for readers.
+ */
+
+/*
+ * Get indicator of lock.
+ */
+static INLINE volatile stm_word_t *
+stm_vr_slot(volatile stm_word_t *lock)
+{
+  return &_tinystm.vr_slots[VR_SLOT_IDX(lock)].readers;
+}
+
+/*
+ * Announce a visible read of a lock (before reading the lock).
+ */
+static INLINE void
+stm_vr_enter(stm_tx_t *tx, volatile stm_word_t *lock)
+{
+  unsigned int i;
+  stm_word_t b;
+
+  i = VR_SLOT_IDX(lock);
+  b = (stm_word_t)1 << (i % (sizeof(stm_word_t) * 8));
+  if (likely((tx->vr_held[i / (sizeof(stm_word_t) * 8)] & b) != 0))
+    return;
+  if (tx->vr_nb++ == 0)
+    ATOMIC_FETCH_INC_FULL(&_tinystm.vr_readers);
+  tx->vr_held[i / (sizeof(stm_word_t) * 8)] |= b;
+  ATOMIC_FETCH_INC_FULL(&_tinystm.vr_slots[i].readers);
+}
+
+/*
+ * Leave all reader indicators (upon commit or abort).
+ */
+static INLINE void
+stm_vr_exit(stm_tx_t *tx)
+{
+  unsigned int i;
+  stm_word_t b;
+
+  if (likely(tx->vr_nb == 0))
+    return;
+  for (i = 0; i < VR_SLOTS / (sizeof(stm_word_t) * 8); i++) {
+    b = tx->vr_held[i];
+    while (b != 0) {
+      ATOMIC_FETCH_DEC_FULL(&_tinystm.vr_slots[i * sizeof(stm_word_t) * 8 + __builtin_ctzl(b)].readers);
+      b &= b - 1;
+    }
+    tx->vr_held[i] = 0;
+  }
+  tx->vr_nb = 0;
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.vr_readers);
+}
+
+/*
+ * Wait until no other transaction reads the locks of the write set
+ * (before committing).  Returns 0 upon success and the abort reason
+ * otherwise.
+ */
+static NOINLINE unsigned int
+stm_vr_wait(stm_tx_t *tx)
+{
+  w_entry_t *w;
+  stm_word_t own;
+  unsigned int i, j, n, reason;
+
+  /* Lock acquisitions must be visible before checking for readers (see stm_vr_enter()) */
+  ATOMIC_MB_FULL;
+  if (likely(ATOMIC_LOAD(&_tinystm.vr_readers) <= (tx->vr_nb != 0 ? 1 : 0)))
+    return 0;
+
+  reason = 0;
+  /* Readers that conflict with us from now on abort instead of killing us */
+  tx->vr_waiting = 1;
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0 && reason == 0; i--, w++) {
+    j = VR_SLOT_IDX(w->lock);
+    own = (tx->vr_held[j / (sizeof(stm_word_t) * 8)] >> (j % (sizeof(stm_word_t) * 8))) & 1;
+    for (n = 0; ATOMIC_LOAD_ACQ(&_tinystm.vr_slots[j].readers) > own; n++) {
+      if (GET_STATUS(tx->status) == TX_KILLED) {
+        reason = STM_ABORT_KILLED;
+        break;
+      }
+      if (n >= VR_WAIT
+#ifdef IRREVOCABLE_ENABLED
+          /* Irrevocable transactions cannot abort: wait for readers */
+          && GET_STATUS(tx->status) != TX_IRREVOCABLE
+#endif /* IRREVOCABLE_ENABLED */
+         ) {
+        /* Wait for readers after rollback (see stm_vr_backoff()) */
+        tx->vr_c_slot = &_tinystm.vr_slots[j].readers;
+        reason = STM_ABORT_RW_CONFLICT;
+        break;
+      }
+      sched_yield();
+    }
+  }
+  tx->vr_waiting = 0;
+  return reason;
+}
+
+/*
+ * Wait until the readers that made us abort are gone, then for a random
+ * delay that grows with consecutive aborts (after rollback).
+ */
+static NOINLINE void
+stm_vr_backoff(stm_tx_t *tx)
+{
+  unsigned int n;
+
+  for (n = 0; n < VR_WAIT && ATOMIC_LOAD_ACQ(tx->vr_c_slot) != 0; n++)
+    sched_yield();
+  tx->vr_c_slot = NULL;
+  /* Writers that gave up together would otherwise meet again */
+  tx->vr_seed ^= (tx->vr_seed << 17);
+  tx->vr_seed ^= (tx->vr_seed >> 13);
+  tx->vr_seed ^= (tx->vr_seed << 5);
+  n = tx->vr_seed % (1U << (tx->stat_retries < VR_BACKOFF_LOG ? tx->stat_retries : VR_BACKOFF_LOG));
+  for (; n > 0; n--)
+    sched_yield();
+}
+
+#endif /* _STM_VR_H_ */
@@ -31,6 +31,9 @@ stm_wbctl_validate(stm_tx_t *tx)
 {
   r_entry_t *r;
   int i;
+#ifdef SIMD_VALIDATION
+  int j;
+#endif /* SIMD_VALIDATION */
   stm_word_t l;
 
   PRINT_DEBUG("==> stm_wbctl_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
@@ -38,6 +41,15 @@ stm_wbctl_validate(stm_tx_t *tx)
   /* Validate reads */
   r = tx->r_set.entries;
   for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+#ifdef SIMD_VALIDATION
+    /* Skip entries that are not locked and still have the same version */
+    j = stm_simd_validate(r, i);
+    if (j > 0) {
+      r += j;
+      if ((i -= j) == 0)
+        break;
+    }
+#endif /* SIMD_VALIDATION */
     /* Read lock */
     l = ATOMIC_LOAD(r->lock);
     /* Unlocked and still the same version? */
@@ -61,16 +73,19 @@ stm_wbctl_validate(stm_tx_t *tx)
 # endif /* UNIT_TX */
         }
 #endif /* CONFLICT_TRACKING */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* We own the lock: OK */
       if (w->version != r->version) {
         /* Other version: cannot validate */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
     } else {
       if (LOCK_GET_TIMESTAMP(l) != r->version) {
         /* Other version: cannot validate */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* Same version: OK */
@@ -86,6 +101,9 @@ static INLINE int
 stm_wbctl_extend(stm_tx_t *tx)
 {
   stm_word_t now;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
 
   PRINT_DEBUG("==> stm_wbctl_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -96,15 +114,34 @@ stm_wbctl_extend(stm_tx_t *tx)
 #endif /* UNIT_TX */
 
   /* Get current time */
-  now = GET_CLOCK;
+  now = stm_clock_extend();
   /* No need to check clock overflow here. The clock can exceed up to MAX_THREADS and it will be reset when the quiescence is reached. */
 
+#ifdef READ_SET_FILTER
+  if (unlikely(tx->r_set.nb_entries >= tx->r_set.compact_at))
+    stm_rs_compact(tx);
+#endif /* READ_SET_FILTER */
+
   /* Try to validate read set */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
   if (stm_wbctl_validate(tx)) {
+#ifdef TM_STATISTICS2
+    stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
     /* It works: we can extend until now */
     tx->end = now;
+    tx->nb_extensions++;
+#ifdef SANDBOXING
+    tx->sb_reads = 0;
+#endif /* SANDBOXING */
+    stm_notify_event(STM_EVENT_EXTEND);
     return 1;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
   return 0;
 }
 
@@ -117,6 +154,10 @@ stm_wbctl_rollback(stm_tx_t *tx)
 
   assert(IS_ACTIVE(tx->status));
 
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_enter(tx);
+#endif /* READ_LOCKED_DATA */
+
   if (tx->w_set.nb_acquired > 0) {
     w = tx->w_set.entries + tx->w_set.nb_entries;
     do {
@@ -131,8 +172,58 @@ stm_wbctl_rollback(stm_tx_t *tx)
       }
     } while (tx->w_set.nb_acquired > 0);
   }
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_leave(tx);
+#endif /* READ_LOCKED_DATA */
+}
+
+/*
+ * Get write set entry of an address (accesses after a write usually
+ * target the address written last).
+ */
+static INLINE w_entry_t *
+stm_wbctl_written(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  w_entry_t *w;
+
+  if (likely(tx->w_set.last < tx->w_set.nb_entries)) {
+    w = &tx->w_set.entries[tx->w_set.last];
+    /* Addresses appear only once in the write set */
+    if (likely(w->addr == addr))
+      return w;
+  }
+  return stm_has_written(tx, addr);
 }
 
+#ifdef READ_LOCKED_DATA
+/*
+ * Get the value of a location locked by a committing transaction that
+ * has not started writing back its updates yet, and the version of the
+ * lock when it was acquired (return 0 if the owner may have taken its
+ * commit timestamp or has released the lock).
+ */
+static INLINE int
+stm_wbctl_read_locked(volatile stm_word_t *addr, volatile stm_word_t *lock, stm_word_t l, stm_word_t *value, stm_word_t *version)
+{
+  w_entry_t *w;
+  stm_tx_t *owner;
+  stm_word_t s, v, o;
+
+  w = (w_entry_t *)LOCK_GET_ADDR(l);
+  owner = w->tx;
+  s = ATOMIC_LOAD_ACQ(&owner->lock_seq);
+  if ((s & 1) != 0 || ATOMIC_LOAD_ACQ(lock) != l)
+    return 0;
+  o = w->version;
+  v = ATOMIC_LOAD_ACQ(addr);
+  if (ATOMIC_LOAD_ACQ(&owner->lock_seq) != s || ATOMIC_LOAD_ACQ(lock) != l)
+    return 0;
+  *value = v;
+  *version = o;
+  return 1;
+}
+#endif /* READ_LOCKED_DATA */
+
 static INLINE stm_word_t
 stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
 {
@@ -146,7 +237,7 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
   assert(IS_ACTIVE(tx->status));
 
   /* Did we previously write the same address? */
-  written = stm_has_written(tx, addr);
+  written = stm_wbctl_written(tx, addr);
   if (written != NULL) {
     /* Yes: get value from write set if possible */
     if (written->mask == ~(stm_word_t)0) {
@@ -167,6 +258,33 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
  restart_no_load:
   if (LOCK_GET_WRITE(l)) {
     /* Locked */
+#ifdef READ_LOCKED_DATA
+    /* Read old version (memory is only written after the commit timestamp is taken) */
+    if (
+# ifdef IRREVOCABLE_ENABLED
+        !tx->irrevocable &&
+# endif /* IRREVOCABLE_ENABLED */
+        stm_wbctl_read_locked(addr, lock, l, &value, &version)) {
+      if (version <= tx->end) {
+        /* Success (validation fails while the lock is owned) */
+# ifdef TM_STATISTICS2
+        tx->stat_locked_reads_ok++;
+# endif /* TM_STATISTICS2 */
+        goto add_to_read_set;
+      }
+      /* The old value may not be valid anymore after extension: read again */
+      if (!tx->attr.read_only && stm_wbctl_extend(tx))
+        goto restart;
+      /* Invalid version: wait for the new one (which is not valid either) */
+# ifdef TM_STATISTICS2
+      tx->stat_locked_reads_failed++;
+# endif /* TM_STATISTICS2 */
+      while ((l2 = ATOMIC_LOAD_ACQ(lock)) == l)
+        ;
+      l = l2;
+      goto restart_no_load;
+    }
+#endif /* READ_LOCKED_DATA */
     /* Do we own the lock? */
     /* Spin while locked (should not last long) */
     goto restart;
@@ -186,10 +304,11 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
     /* Check timestamp */
     version = LOCK_GET_TIMESTAMP(l);
     /* Valid version? */
-    if (version > tx->end) {
+    if (version > tx->end && !stm_defer_validation(tx)) {
       /* No: try to extend first (except for read-only transactions: no read set) */
       if (tx->attr.read_only || !stm_wbctl_extend(tx)) {
         /* Not much we can do: abort */
+        SET_CONFLICT(tx, addr, lock);
         stm_rollback(tx, STM_ABORT_VAL_READ);
         return 0;
       }
@@ -206,19 +325,23 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
   }
   /* We have a good version: add to read set (update transactions) and return value */
 
+#ifdef READ_LOCKED_DATA
+ add_to_read_set:
+#endif /* READ_LOCKED_DATA */
   /* Did we previously write the same address? */
   if (written != NULL) {
     value = (value & ~written->mask) | (written->value & written->mask);
     /* Must still add to read set */
   }
-#ifdef READ_LOCKED_DATA
- add_to_read_set:
-#endif /* READ_LOCKED_DATA */
   if (!tx->attr.read_only) {
 #ifdef NO_DUPLICATES_IN_RW_SETS
     if (stm_has_read(tx, lock) != NULL)
       goto return_value;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
+#ifdef READ_SET_FILTER
+    if (stm_rs_filter(tx, lock))
+      goto return_value;
+#endif /* READ_SET_FILTER */
     /* Add address and version to read set */
     if (tx->r_set.nb_entries == tx->r_set.size)
       stm_allocate_rs_entries(tx, 1);
@@ -253,10 +376,14 @@ stm_wbctl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
     goto restart;
   }
   /* Not locked */
-  w = stm_has_written(tx, addr);
+  w = stm_wbctl_written(tx, addr);
   if (w != NULL) {
+#ifdef CLOSED_NESTING
+    stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
     w->value = (w->value & ~mask) | (value & mask);
     w->mask |= mask;
+    tx->w_set.last = w - tx->w_set.entries;
     return w;
   }
   /* Handle write after reads (before CAS) */
@@ -271,6 +398,7 @@ stm_wbctl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
     /* We might have read an older version previously */
 #ifdef UNIT_TX
     if (tx->attr.no_extend) {
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -278,6 +406,7 @@ stm_wbctl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
     if (stm_has_read(tx, lock) != NULL) {
       /* Read version must be older (otherwise, tx->end >= version) */
       /* Not much we can do: abort */
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -291,6 +420,7 @@ do_write:
   /* Add address to write set */
   if (tx->w_set.nb_entries == tx->w_set.size)
     stm_allocate_ws_entries(tx, 1);
+  tx->w_set.last = tx->w_set.nb_entries;
   w = &tx->w_set.entries[tx->w_set.nb_entries++];
   w->addr = addr;
   w->mask = mask;
@@ -309,7 +439,7 @@ do_write:
 # endif /* !NDEBUG */
   w->no_drop = 1;
 # ifdef USE_BLOOM_FILTER
-  tx->w_set.bloom |= FILTER_BITS(addr) ;
+  tx->w_set.bloom[FILTER_WORD(addr)] |= FILTER_BITS(addr);
 # endif /* USE_BLOOM_FILTER */
 
   return w;
@@ -318,22 +448,44 @@ do_write:
 static INLINE stm_word_t
 stm_wbctl_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
 {
-  /* Possible optimization: avoid adding to read set. */
+  volatile stm_word_t *lock;
+  stm_word_t l, value;
+
+  /* The address may have been written on some paths since it was read */
+  if (likely(stm_has_written(tx, addr) == NULL)) {
+    lock = GET_LOCK(addr);
+    l = ATOMIC_LOAD_ACQ(lock);
+    value = ATOMIC_LOAD_ACQ(addr);
+    /* The lock is already in the read set: only check that the version is
+     * part of the snapshot (commit fails if it differs from the read set) */
+    if (likely(!LOCK_GET_WRITE(l) && ATOMIC_LOAD_ACQ(lock) == l && LOCK_GET_TIMESTAMP(l) <= tx->end))
+      return value;
+  }
   return stm_wbctl_read(tx, addr);
 }
 
 static INLINE stm_word_t
 stm_wbctl_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
 {
-  /* Cannot be much better than regular due to mask == 0 case. */
+  w_entry_t *w;
+
+  w = stm_wbctl_written(tx, addr);
+  if (likely(w != NULL && w->mask == ~(stm_word_t)0))
+    return w->value;
+  /* Partially written (or not written on all paths): merge with memory */
   return stm_wbctl_read(tx, addr);
 }
 
 static INLINE stm_word_t
 stm_wbctl_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
 {
+  stm_word_t value;
+
   /* We need to return the value here, so write with mask=0 is not enough. */
-  return stm_wbctl_read(tx, addr);
+  value = stm_wbctl_read(tx, addr);
+  /* Add empty entry such that the next write finds it directly */
+  stm_wbctl_write(tx, addr, 0, 0);
+  return value;
 }
 
 static INLINE void
@@ -347,120 +499,192 @@ static INLINE void
 stm_wbctl_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
 {
   w_entry_t *w;
+
   /* Get the write set entry. */
-  w = stm_has_written(tx, addr);
-  assert(w != NULL);
-  /* Update directly into the write set. */
+  w = stm_wbctl_written(tx, addr);
+  if (unlikely(w == NULL)) {
+    /* Not written on all paths */
+    stm_wbctl_write(tx, addr, value, mask);
+    return;
+  }
+#ifdef CLOSED_NESTING
+  stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
+  /* Update directly into the write set (locks are acquired upon commit). */
   w->value = (w->value & ~mask) | (value & mask);
   w->mask |= mask;
 }
 
+/*
+ * Acquire lock of an entry at commit time unless already owned (returns
+ * 0 upon abort).
+ */
+static INLINE int
+stm_wbctl_acquire(stm_tx_t *tx, w_entry_t *w)
+{
+  stm_word_t l;
+
+  /* Try to acquire lock */
+ restart:
+  l = ATOMIC_LOAD(w->lock);
+  if (LOCK_GET_OWNED(l)) {
+    /* Do we already own the lock? */
+    if (tx->w_set.entries <= (w_entry_t *)LOCK_GET_ADDR(l) && (w_entry_t *)LOCK_GET_ADDR(l) < tx->w_set.entries + tx->w_set.nb_entries) {
+      /* Yes: ignore */
+      return 1;
+    }
+    /* Conflict: CM kicks in */
+# if CM == CM_DELAY
+    tx->c_lock = w->lock;
+# endif /* CM == CM_DELAY */
+
+#ifdef IRREVOCABLE_ENABLED
+    if (tx->irrevocable) {
+      /* Spin while locked */
+      goto restart;
+    }
+#endif /* IRREVOCABLE_ENABLED */
+
+    /* Abort self */
+    SET_CONFLICT(tx, w->addr, w->lock);
+    stm_rollback(tx, STM_ABORT_WW_CONFLICT);
+    return 0;
+  }
+  /* Store version for validation of read set (and readers of locked data) */
+  w->version = LOCK_GET_TIMESTAMP(l);
+  if (ATOMIC_CAS_FULL(w->lock, l, LOCK_SET_ADDR_WRITE((stm_word_t)w)) == 0)
+    goto restart;
+  /* We own the lock here */
+  w->no_drop = 0;
+  tx->w_set.nb_acquired++;
+  return 1;
+}
+
+/*
+ * Write back new value of an entry.
+ */
+static INLINE void
+stm_wbctl_install(stm_tx_t *tx, w_entry_t *w, stm_word_t t)
+{
+  stm_word_t value;
+
+#ifdef MULTI_VERSION
+  if (w->mask != 0)
+    stm_mv_save(w->addr, ATOMIC_LOAD(w->addr), w->lock, t);
+#endif /* MULTI_VERSION */
+  if (w->mask == ~(stm_word_t)0) {
+    ATOMIC_STORE(w->addr, w->value);
+  } else if (w->mask != 0) {
+    value = (ATOMIC_LOAD(w->addr) & ~w->mask) | (w->value & w->mask);
+    ATOMIC_STORE(w->addr, value);
+  }
+}
+
 static INLINE int
 stm_wbctl_commit(stm_tx_t *tx)
 {
   w_entry_t *w;
   stm_word_t t;
-  int i;
-  stm_word_t l, value;
+  int i, validate;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
+#ifdef SORTED_COMMIT
+  w_entry_t **ws;
+#endif /* SORTED_COMMIT */
 
   PRINT_DEBUG("==> stm_wbctl_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
+#ifdef SORTED_COMMIT
+  if ((ws = stm_ws_sort(tx)) != NULL) {
+    /* Acquire locks in global order (first entry covered by a lock owns it) */
+    for (i = 0; i < tx->w_set.nb_entries; i++) {
+      if (!stm_wbctl_acquire(tx, ws[i]))
+        return 0;
+    }
+    goto acquired;
+  }
+#endif /* SORTED_COMMIT */
+
   /* Acquire locks (in reverse order) */
   w = tx->w_set.entries + tx->w_set.nb_entries;
   do {
     w--;
-    /* Try to acquire lock */
- restart:
-    l = ATOMIC_LOAD(w->lock);
-    if (LOCK_GET_OWNED(l)) {
-      /* Do we already own the lock? */
-      if (tx->w_set.entries <= (w_entry_t *)LOCK_GET_ADDR(l) && (w_entry_t *)LOCK_GET_ADDR(l) < tx->w_set.entries + tx->w_set.nb_entries) {
-        /* Yes: ignore */
-        continue;
-      }
-      /* Conflict: CM kicks in */
-# if CM == CM_DELAY
-      tx->c_lock = w->lock;
-# endif /* CM == CM_DELAY */
-
-#ifdef IRREVOCABLE_ENABLED
-      if (tx->irrevocable) {
-# ifdef IRREVOCABLE_IMPROVED
-        if (ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-          ATOMIC_STORE(&_tinystm.irrevocable, 2);
-# endif /* IRREVOCABLE_IMPROVED */
-        /* Spin while locked */
-        goto restart;
-      }
-#endif /* IRREVOCABLE_ENABLED */
-
-      /* Abort self */
-      stm_rollback(tx, STM_ABORT_WW_CONFLICT);
+    if (!stm_wbctl_acquire(tx, w))
       return 0;
-    }
-    if (ATOMIC_CAS_FULL(w->lock, l, LOCK_SET_ADDR_WRITE((stm_word_t)w)) == 0)
-      goto restart;
-    /* We own the lock here */
-    w->no_drop = 0;
-    /* Store version for validation of read set */
-    w->version = LOCK_GET_TIMESTAMP(l);
-    tx->w_set.nb_acquired++;
   } while (w > tx->w_set.entries);
 
+#ifdef SORTED_COMMIT
+ acquired:
+#endif /* SORTED_COMMIT */
+
 #ifdef IRREVOCABLE_ENABLED
   /* Verify if there is an irrevocable transaction once all locks have been acquired */
-# ifdef IRREVOCABLE_IMPROVED
-  /* FIXME: it is bogus. the status should be changed to idle otherwise stm_quiesce will not progress */
-  if (unlikely(!tx->irrevocable)) {
-    do {
-      t = ATOMIC_LOAD(&_tinystm.irrevocable);
-      /* If the irrevocable transaction have encountered an acquired lock, abort */
-      if (t == 2) {
-        stm_rollback(tx, STM_ABORT_IRREVOCABLE);
-        return 0;
-      }
-    } while (t);
-  }
-# else /* ! IRREVOCABLE_IMPROVED */
-  if (!tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable)) {
+  if (!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG)) {
     stm_rollback(tx, STM_ABORT_IRREVOCABLE);
     return 0;
   }
-# endif /* ! IRREVOCABLE_IMPROVED */
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef READ_LOCKED_DATA
+  /* Old values are not valid anymore once the commit timestamp is taken */
+  stm_lock_seq_enter(tx);
+#endif /* READ_LOCKED_DATA */
+
   /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-  t = FETCH_INC_CLOCK + 1;
+  t = stm_clock_commit(tx, &validate);
 
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable))
     goto release_locks;
 #endif /* IRREVOCABLE_ENABLED */
 
-  /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-  if (unlikely(tx->start != t - 1 && !stm_wbctl_validate(tx))) {
+  /* Try to validate (only if a concurrent transaction may have committed since tx->start) */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+  if (unlikely(validate && !stm_wbctl_validate(tx))) {
     /* Cannot commit */
     stm_rollback(tx, STM_ABORT_VALIDATE);
     return 0;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
 
 #ifdef IRREVOCABLE_ENABLED
   release_locks:
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef SORTED_COMMIT
+  if (ws != NULL) {
+    /* Install in lock order and drop each lock after its last covered address */
+    for (i = 0; i < tx->w_set.nb_entries; i++) {
+      if (i + PREFETCH_AHEAD < tx->w_set.nb_entries)
+        PREFETCH_W(ws[i + PREFETCH_AHEAD]->addr);
+      w = ws[i];
+      stm_wbctl_install(tx, w, t);
+      if (i + 1 == tx->w_set.nb_entries || ws[i + 1]->lock != w->lock)
+        ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
+    }
+    goto released;
+  }
+#endif /* SORTED_COMMIT */
+
   /* Install new versions, drop locks and set new timestamp */
   w = tx->w_set.entries;
   for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
-    if (w->mask == ~(stm_word_t)0) {
-      ATOMIC_STORE(w->addr, w->value);
-    } else if (w->mask != 0) {
-      value = (ATOMIC_LOAD(w->addr) & ~w->mask) | (w->value & w->mask);
-      ATOMIC_STORE(w->addr, value);
-    }
+    stm_wbctl_install(tx, w, t);
     /* Only drop lock for last covered address in write set (cannot be "no drop") */
     if (!w->no_drop)
       ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
   }
+#ifdef SORTED_COMMIT
+ released:
+#endif /* SORTED_COMMIT */
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_leave(tx);
+#endif /* READ_LOCKED_DATA */
 
  end:
   return 1;
@@ -34,19 +34,126 @@
 static NOINLINE void stm_drop(stm_tx_t *tx);
 static NOINLINE int stm_kill(stm_tx_t *tx, stm_tx_t *other, stm_word_t status);
 #endif /* CM == CM_MODULAR */
+#ifdef IRREVOCABLE_IMPROVED
+static INLINE w_entry_t *stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask);
+#endif /* IRREVOCABLE_IMPROVED */
 
+#ifdef STRIPE_INDEX
+/*
+ * The first entry of the list of a lock (the one the lock points to)
+ * indexes the entries of the list by word offset modulo STRIPE_SLOTS.
+ * A slot holds the distance plus one from the first entry to the only
+ * entry of the list with that offset, 0 if there is none, or
+ * STRIPE_SHARED if there might be several (stripes larger than
+ * STRIPE_SLOTS words, aliased stripes, or distances too large), in
+ * which case the list is scanned.  Slots of entries dropped by closed
+ * nested transactions are stale and ignored: they point beyond the
+ * write set or to another address.
+ */
+# define STRIPE_SLOT(a)                 (((stm_word_t)(a) >> LOCK_SHIFT_WORD) & (STRIPE_SLOTS - 1))
+# define STRIPE_SHARED                  0xFFFF
+
+/*
+ * Initialize the index of a new first entry.
+ */
+static INLINE void
+stm_wbetl_index_init(w_entry_t *w)
+{
+  memset(w->slots, 0, sizeof(w->slots));
+  w->slots[STRIPE_SLOT(w->addr)] = 1;
+  w->last = 0;
+}
+
+/*
+ * Index a new entry appended to the list of first entry h.
+ */
+static INLINE void
+stm_wbetl_index_add(w_entry_t *h, w_entry_t *w)
+{
+  unsigned short *s;
+  stm_word_t d;
+
+  s = &h->slots[STRIPE_SLOT(w->addr)];
+  d = w - h;
+  if (unlikely(d >= STRIPE_SHARED - 1)) {
+    /* Cannot be indexed */
+    *s = STRIPE_SHARED;
+    h->last = STRIPE_SHARED;
+    return;
+  }
+  /* Is the slot used by another live entry (located before w)? */
+  if (*s != 0 && *s != STRIPE_SHARED && h + *s - 1 < w)
+    *s = STRIPE_SHARED;
+  else if (*s != STRIPE_SHARED)
+    *s = d + 1;
+  h->last = d;
+}
+
+/*
+ * Get the last entry of the list of first entry w.
+ */
+static INLINE w_entry_t *
+stm_wbetl_index_last(w_entry_t *w)
+{
+  if (likely(w->last != STRIPE_SHARED))
+    return w + w->last;
+  while (w->next != NULL)
+    w = w->next;
+  return w;
+}
+#endif /* STRIPE_INDEX */
+
+/*
+ * Find the entry of an address in the list of first entry w (return
+ * NULL if the address has not been written).
+ */
+static INLINE w_entry_t *
+stm_wbetl_find(stm_tx_t *tx, w_entry_t *w, volatile stm_word_t *addr)
+{
+#ifdef STRIPE_INDEX
+  unsigned int s;
+
+  s = w->slots[STRIPE_SLOT(addr)];
+  if (likely(s != STRIPE_SHARED)) {
+    if (s != 0 && w + s - 1 < tx->w_set.entries + tx->w_set.nb_entries && w[s - 1].addr == addr)
+      return &w[s - 1];
+    return NULL;
+  }
+#endif /* STRIPE_INDEX */
+  for (; w != NULL; w = w->next) {
+    if (addr == w->addr)
+      return w;
+  }
+  return NULL;
+}
+
+/*
+ * Validate read set entries starting from the given one.
+ */
 static INLINE int
-stm_wbetl_validate(stm_tx_t *tx)
+stm_wbetl_validate_from(stm_tx_t *tx, unsigned int first)
 {
   r_entry_t *r;
   int i;
+#ifdef SIMD_VALIDATION
+  int j;
+#endif /* SIMD_VALIDATION */
   stm_word_t l;
 
-  PRINT_DEBUG("==> stm_wbetl_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+  PRINT_DEBUG("==> stm_wbetl_validate_from(%p[%lu-%lu],%u)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, first);
 
   /* Validate reads */
-  r = tx->r_set.entries;
-  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+  r = tx->r_set.entries + first;
+  for (i = tx->r_set.nb_entries - first; i > 0; i--, r++) {
+#ifdef SIMD_VALIDATION
+    /* Skip entries that are not locked and still have the same version */
+    j = stm_simd_validate(r, i);
+    if (j > 0) {
+      r += j;
+      if ((i -= j) == 0)
+        break;
+    }
+#endif /* SIMD_VALIDATION */
     /* Read lock */
     l = ATOMIC_LOAD(r->lock);
     /* Unlocked and still the same version? */
@@ -70,12 +177,14 @@ stm_wbetl_validate(stm_tx_t *tx)
 # endif /* UNIT_TX */
         }
 #endif /* CONFLICT_TRACKING */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* We own the lock: OK */
     } else {
       if (LOCK_GET_TIMESTAMP(l) != r->version) {
         /* Other version: cannot validate */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* Same version: OK */
@@ -84,6 +193,60 @@ stm_wbetl_validate(stm_tx_t *tx)
   return 1;
 }
 
+static INLINE int
+stm_wbetl_validate(stm_tx_t *tx)
+{
+  return stm_wbetl_validate_from(tx, 0);
+}
+
+#ifdef IRREVOCABLE_IMPROVED
+/*
+ * Lock read set when becoming irrevocable (return 0 if some data read
+ * has changed).  The caller makes sure that the write set is large
+ * enough.
+ */
+static INLINE int
+stm_wbetl_lock_reads(stm_tx_t *tx)
+{
+  r_entry_t *r;
+  w_entry_t *w;
+  stm_word_t l;
+  int i;
+
+  PRINT_DEBUG("==> stm_wbetl_lock_reads(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  r = tx->r_set.entries;
+  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+    l = ATOMIC_LOAD_ACQ(r->lock);
+    if (LOCK_GET_OWNED(l)) {
+      w = (w_entry_t *)LOCK_GET_ADDR(l);
+      /* Only locks already acquired by us are fine */
+      if (tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)
+        continue;
+      return 0;
+    }
+    if (LOCK_GET_TIMESTAMP(l) != r->version)
+      return 0;
+    /* Lock without address (nothing is read from or written to the entry) */
+    assert(tx->w_set.nb_entries < tx->w_set.size);
+    w = &tx->w_set.entries[tx->w_set.nb_entries];
+    if (ATOMIC_CAS_ACQ_REL(r->lock, l, LOCK_SET_ADDR_WRITE((stm_word_t)w)) == 0)
+      return 0;
+    w->addr = NULL;
+    w->mask = 0;
+    w->lock = r->lock;
+    w->version = r->version;
+    w->next = NULL;
+#ifdef STRIPE_INDEX
+    stm_wbetl_index_init(w);
+#endif /* STRIPE_INDEX */
+    tx->w_set.nb_entries++;
+    tx->w_set.has_writes++;
+  }
+  return 1;
+}
+#endif /* IRREVOCABLE_IMPROVED */
+
 /*
  * Extend snapshot range.
  */
@@ -91,6 +254,9 @@ static INLINE int
 stm_wbetl_extend(stm_tx_t *tx)
 {
   stm_word_t now;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
 
   PRINT_DEBUG("==> stm_wbetl_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -101,15 +267,39 @@ stm_wbetl_extend(stm_tx_t *tx)
 #endif /* UNIT_TX */
 
   /* Get current time */
-  now = GET_CLOCK;
+  now = stm_clock_extend();
   /* No need to check clock overflow here. The clock can exceed up to MAX_THREADS and it will be reset when the quiescence is reached. */
 
+#ifdef READ_SET_FILTER
+  if (unlikely(tx->r_set.nb_entries >= tx->r_set.compact_at))
+    stm_rs_compact(tx);
+#endif /* READ_SET_FILTER */
+
   /* Try to validate read set */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+#ifdef HELPER_VALIDATION
+  /* Skip entries validated by the helper since now */
+  if (stm_wbetl_validate_from(tx, stm_hv_validated(tx, now))) {
+#else /* ! HELPER_VALIDATION */
   if (stm_wbetl_validate(tx)) {
+#endif /* ! HELPER_VALIDATION */
+#ifdef TM_STATISTICS2
+    stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
     /* It works: we can extend until now */
     tx->end = now;
+    tx->nb_extensions++;
+#ifdef SANDBOXING
+    tx->sb_reads = 0;
+#endif /* SANDBOXING */
+    stm_notify_event(STM_EVENT_EXTEND);
     return 1;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
   return 0;
 }
 
@@ -193,24 +383,18 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
     /* Simply check if address falls inside our write set (avoids non-faulting load) */
     if (likely(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)) {
       /* Yes: did we previously write the same address? */
-      while (1) {
-        if (addr == w->addr) {
-          /* Yes: get value from write set (or from memory if mask was empty) */
-          value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
-          break;
-        }
-        if (w->next == NULL) {
-          /* No: get value from memory */
-          value = ATOMIC_LOAD(addr);
+      if ((w = stm_wbetl_find(tx, w, addr)) != NULL) {
+        /* Yes: get value from write set (or from memory if mask was empty) */
+        value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
+      } else {
+        /* No: get value from memory */
+        value = ATOMIC_LOAD(addr);
 # if CM == CM_MODULAR
-          if (GET_STATUS(tx->status) == TX_KILLED) {
-            stm_rollback(tx, STM_ABORT_KILLED);
-            return 0;
-          }
-# endif /* CM == CM_MODULAR */
-          break;
+        if (GET_STATUS(tx->status) == TX_KILLED) {
+          stm_rollback(tx, STM_ABORT_KILLED);
+          return 0;
         }
-        w = w->next;
+# endif /* CM == CM_MODULAR */
       }
       /* No need to add to read set (will remain valid) */
       return value;
@@ -224,10 +408,6 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
 # endif /* UNIT_TX */
 
     /* Conflict: CM kicks in (we could also check for duplicate reads and get value from read set) */
-# if defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED)
-    if (tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-      ATOMIC_STORE(&_tinystm.irrevocable, 2);
-# endif /* defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED) */
 # if CM != CM_MODULAR && defined(IRREVOCABLE_ENABLED)
     if (unlikely(tx->irrevocable)) {
       /* Spin while locked */
@@ -296,7 +476,7 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
     if (decision == KILL_OTHER) {
       /* Steal lock */
       l2 = LOCK_SET_TIMESTAMP(w->version);
-      if (ATOMIC_CAS_FULL(lock, l, l2) == 0)
+      if (ATOMIC_CAS_ACQ_REL(lock, l, l2) == 0)
         goto restart;
       l = l2;
       goto restart_no_load;
@@ -321,6 +501,7 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
 #  endif /* UNIT_TX */
     }
 # endif /* CONFLICT_TRACKING */
+    SET_CONFLICT(tx, addr, lock);
     stm_rollback(tx, STM_ABORT_RW_CONFLICT);
     return 0;
   } else {
@@ -346,7 +527,7 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
     version = LOCK_GET_TIMESTAMP(l);
 #endif /* CM != CM_MODULAR */
     /* Valid version? */
-    if (unlikely(version > tx->end)) {
+    if (unlikely(version > tx->end) && !stm_defer_validation(tx)) {
       /* No: try to extend first (except for read-only transactions: no read set) */
       if (tx->attr.read_only || !stm_wbetl_extend(tx)) {
         /* Not much we can do: abort */
@@ -354,6 +535,7 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
         /* Abort caused by invisible reads */
         tx->visible_reads++;
 #endif /* CM == CM_MODULAR */
+        SET_CONFLICT(tx, addr, lock);
         stm_rollback(tx, STM_ABORT_VAL_READ);
         return 0;
       }
@@ -385,12 +567,20 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
     if (stm_has_read(tx, lock) != NULL)
       goto return_value;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
+#ifdef READ_SET_FILTER
+    if (stm_rs_filter(tx, lock))
+      goto return_value;
+#endif /* READ_SET_FILTER */
     /* Add address and version to read set */
     if (tx->r_set.nb_entries == tx->r_set.size)
       stm_allocate_rs_entries(tx, 1);
     r = &tx->r_set.entries[tx->r_set.nb_entries++];
     r->version = version;
     r->lock = lock;
+#ifdef HELPER_VALIDATION
+    if (unlikely((tx->r_set.nb_entries & (HV_CHUNK - 1)) == 0))
+      stm_hv_publish(tx);
+#endif /* HELPER_VALIDATION */
   }
  return_value:
   return value;
@@ -440,18 +630,12 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
         value = ATOMIC_LOAD(addr);
       } else {
         /* No: did we previously write the same address? */
-        while (1) {
-          if (addr == w->addr) {
-            /* Yes: get value from write set (or from memory if mask was empty) */
-            value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
-            break;
-          }
-          if (w->next == NULL) {
-            /* No: get value from memory */
-            value = ATOMIC_LOAD(addr);
-            break;
-          }
-          w = w->next;
+        if ((w = stm_wbetl_find(tx, w, addr)) != NULL) {
+          /* Yes: get value from write set (or from memory if mask was empty) */
+          value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
+        } else {
+          /* No: get value from memory */
+          value = ATOMIC_LOAD(addr);
         }
       }
       if (GET_STATUS(tx->status) == TX_KILLED) {
@@ -462,10 +646,6 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
       return value;
     }
     /* Conflict: CM kicks in */
-# if defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED)
-    if (tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-      ATOMIC_STORE(&_tinystm.irrevocable, 2);
-# endif /* defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED) */
     t = w->tx->status;
     l2 = ATOMIC_LOAD_ACQ(lock);
     if (l != l2) {
@@ -516,6 +696,7 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
 #  endif /* UNIT_TX */
     }
 # endif /* CONFLICT_TRACKING */
+    SET_CONFLICT(tx, addr, lock);
     stm_rollback(tx, (LOCK_GET_WRITE(l) ? STM_ABORT_WR_CONFLICT : STM_ABORT_RR_CONFLICT));
     return 0;
   }
@@ -523,12 +704,17 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
   version = LOCK_GET_TIMESTAMP(l);
  acquire:
   /* Acquire lock (ETL) */
-  if (tx->w_set.nb_entries == tx->w_set.size)
+  if (tx->w_set.nb_entries == tx->w_set.size) {
+#ifdef IRREVOCABLE_ENABLED
+    if (stm_irrevocable_extend(tx))
+      goto restart;
+#endif /* IRREVOCABLE_ENABLED */
     stm_rollback(tx, STM_ABORT_EXTEND_WS);
+  }
   w = &tx->w_set.entries[tx->w_set.nb_entries];
   w->version = version;
   value = ATOMIC_LOAD(addr);
-  if (ATOMIC_CAS_FULL(lock, l, LOCK_SET_ADDR_READ((stm_word_t)w)) == 0)
+  if (ATOMIC_CAS_ACQ_REL(lock, l, LOCK_SET_ADDR_READ((stm_word_t)w)) == 0)
     goto restart;
   /* Add entry to write set */
   w->addr = addr;
@@ -536,18 +722,156 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
   w->lock = lock;
   w->value = value;
   w->next = NULL;
+#ifdef STRIPE_INDEX
+  stm_wbetl_index_init(w);
+#endif /* STRIPE_INDEX */
   tx->w_set.nb_entries++;
   return value;
 }
 #endif /* CM == CM_MODULAR */
 
+#ifdef SHARED_VISIBLE_READS
+/*
+ * Load a word-sized value (shared visible read).
+ */
+static INLINE stm_word_t
+stm_wbetl_read_shared(stm_tx_t *tx, volatile stm_word_t *addr)
+{
+  volatile stm_word_t *lock;
+  stm_word_t l, l2, t, value;
+  w_entry_t *w;
+  int decision;
+
+  PRINT_DEBUG2("==> stm_wbetl_read_shared(t=%p[%lu-%lu],a=%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, addr);
+
+  if (GET_STATUS(tx->status) == TX_KILLED) {
+    stm_rollback(tx, STM_ABORT_KILLED);
+    return 0;
+  }
+
+  /* Get reference to lock */
+  lock = GET_LOCK(addr);
+
+  /* Announce read before reading lock (see stm_vr_wait()) */
+  stm_vr_enter(tx, lock);
+ restart:
+  l = ATOMIC_LOAD_ACQ(lock);
+ restart_no_load:
+  if (LOCK_GET_OWNED(l)) {
+    /* Locked */
+#ifdef UNIT_TX
+    if (l == LOCK_UNIT) {
+      /* Data modified by a unit store: should not last long => retry */
+      goto restart;
+    }
+#endif /* UNIT_TX */
+    /* Do we own the lock? */
+    w = (w_entry_t *)LOCK_GET_ADDR(l);
+    /* Simply check if address falls inside our write set (avoids non-faulting load) */
+    if (tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries) {
+      /* Yes: did we previously write the same address? */
+      if ((w = stm_wbetl_find(tx, w, addr)) != NULL) {
+        /* Yes: get value from write set (or from memory if mask was empty) */
+        value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
+      } else {
+        /* No: get value from memory */
+        value = ATOMIC_LOAD(addr);
+      }
+      return value;
+    }
+    /* Conflict: CM kicks in */
+    t = w->tx->status;
+    l2 = ATOMIC_LOAD_ACQ(lock);
+    if (l != l2) {
+      l = l2;
+      goto restart_no_load;
+    }
+    if (t != w->tx->status) {
+      /* Transaction status has changed: restart the whole procedure */
+      goto restart;
+    }
+    if (GET_STATUS(t) == TX_KILLED) {
+      /* We can safely steal lock */
+      decision = KILL_OTHER;
+    } else {
+      decision =
+# ifdef IRREVOCABLE_ENABLED
+        GET_STATUS(tx->status) == TX_IRREVOCABLE ? KILL_OTHER :
+        GET_STATUS(t) == TX_IRREVOCABLE ? KILL_SELF :
+# endif /* IRREVOCABLE_ENABLED */
+        GET_STATUS(tx->status) == TX_KILLED ? KILL_SELF :
+        /* Owner is waiting for readers before committing: let it commit */
+        w->tx->vr_waiting ? KILL_SELF | DELAY_RESTART :
+        (_tinystm.contention_manager != NULL ? _tinystm.contention_manager(tx, w->tx, WR_CONFLICT) : KILL_SELF);
+      if (decision == KILL_OTHER) {
+        /* Kill other */
+        if (!stm_kill(tx, w->tx, t)) {
+          /* Transaction may have committed or aborted: retry */
+          goto restart;
+        }
+      }
+    }
+    if (decision == KILL_OTHER) {
+      /* Steal lock (writers cannot commit before we leave the indicator) */
+      l2 = LOCK_SET_TIMESTAMP(w->version);
+      if (ATOMIC_CAS_ACQ_REL(lock, l, l2) == 0)
+        goto restart;
+      l = l2;
+      goto restart_no_load;
+    }
+    /* Kill self */
+    if ((decision & DELAY_RESTART) != 0)
+      tx->c_lock = lock;
+    /* Abort */
+# ifdef CONFLICT_TRACKING
+    if (_tinystm.conflict_cb != NULL) {
+#  ifdef UNIT_TX
+      if (l != LOCK_UNIT) {
+#  endif /* UNIT_TX */
+        /* Call conflict callback */
+        stm_tx_t *other = ((w_entry_t *)LOCK_GET_ADDR(l))->tx;
+        _tinystm.conflict_cb(tx, other);
+#  ifdef UNIT_TX
+      }
+#  endif /* UNIT_TX */
+    }
+# endif /* CONFLICT_TRACKING */
+    SET_CONFLICT(tx, addr, lock);
+    stm_rollback(tx, STM_ABORT_WR_CONFLICT);
+    return 0;
+  }
+  /* Not locked: value cannot change until we leave the indicator */
+  value = ATOMIC_LOAD_ACQ(addr);
+  l2 = ATOMIC_LOAD_ACQ(lock);
+  if (unlikely(l != l2)) {
+    l = l2;
+    goto restart_no_load;
+  }
+  /* No need to add to read set (no validation) */
+  return value;
+}
+#endif /* SHARED_VISIBLE_READS */
+
 static INLINE stm_word_t
 stm_wbetl_read(stm_tx_t *tx, volatile stm_word_t *addr)
 {
+#ifdef IRREVOCABLE_IMPROVED
+  if (unlikely(tx->irrevocable) && ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 1) {
+    /* Irrevocable transaction: lock data (then read it as if written) */
+    if (likely(tx->w_set.nb_entries < tx->w_set.size))
+      stm_wbetl_write(tx, addr, 0, 0);
+    else
+      stm_irrevocable_block(tx);
+  }
+#endif /* IRREVOCABLE_IMPROVED */
 #if CM == CM_MODULAR
   if (unlikely((tx->attr.visible_reads))) {
     /* Use visible read */
+# ifdef SHARED_VISIBLE_READS
+    return stm_wbetl_read_shared(tx, addr);
+# else /* ! SHARED_VISIBLE_READS */
     return stm_wbetl_read_visible(tx, addr);
+# endif /* ! SHARED_VISIBLE_READS */
   }
 #endif /* CM == CM_MODULAR */
   return stm_wbetl_read_invisible(tx, addr);
@@ -605,42 +929,55 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
         /* No need to insert new entry or modify existing one */
         return w;
       }
+#ifdef STRIPE_INDEX
+      /* Did we previously write the same address? */
+      if ((prev = stm_wbetl_find(tx, w, addr)) != NULL)
+        goto coalesce;
+      /* Remember last entry in linked list (for adding new entry) */
+      prev = stm_wbetl_index_last(w);
+#else /* ! STRIPE_INDEX */
       prev = w;
       /* Did we previously write the same address? */
       while (1) {
-        if (addr == prev->addr) {
-          /* No need to add to write set */
-          if (mask != ~(stm_word_t)0) {
-            if (prev->mask == 0)
-              prev->value = ATOMIC_LOAD(addr);
-            value = (prev->value & ~mask) | (value & mask);
-          }
-          prev->value = value;
-          prev->mask |= mask;
-          return prev;
-        }
+        if (addr == prev->addr)
+          goto coalesce;
         if (prev->next == NULL) {
           /* Remember last entry in linked list (for adding new entry) */
           break;
         }
         prev = prev->next;
       }
+#endif /* ! STRIPE_INDEX */
       /* Get version from previous write set entry (all entries in linked list have same version) */
       version = prev->version;
       /* Must add to write set */
-      if (tx->w_set.nb_entries == tx->w_set.size)
+      if (tx->w_set.nb_entries == tx->w_set.size) {
+#ifdef IRREVOCABLE_ENABLED
+        if (stm_irrevocable_extend(tx))
+          goto restart;
+#endif /* IRREVOCABLE_ENABLED */
         stm_rollback(tx, STM_ABORT_EXTEND_WS);
+      }
       w = &tx->w_set.entries[tx->w_set.nb_entries];
 #if CM == CM_MODULAR
       w->version = version;
 #endif /* CM == CM_MODULAR */
       goto do_write;
+ coalesce:
+      /* No need to add to write set */
+#ifdef CLOSED_NESTING
+      stm_nested_save(tx, prev, NULL);
+#endif /* CLOSED_NESTING */
+      if (mask != ~(stm_word_t)0) {
+        if (prev->mask == 0)
+          prev->value = ATOMIC_LOAD(addr);
+        value = (prev->value & ~mask) | (value & mask);
+      }
+      prev->value = value;
+      prev->mask |= mask;
+      return prev;
     }
     /* Conflict: CM kicks in */
-#if defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED)
-    if (tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-      ATOMIC_STORE(&_tinystm.irrevocable, 2);
-#endif /* defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED) */
 #if CM != CM_MODULAR && defined(IRREVOCABLE_ENABLED)
     if (tx->irrevocable) {
       /* Spin while locked */
@@ -668,6 +1005,10 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
         GET_STATUS(t) == TX_IRREVOCABLE ? KILL_SELF :
 # endif /* IRREVOCABLE_ENABLED */
         GET_STATUS(tx->status) == TX_KILLED ? KILL_SELF :
+# ifdef SHARED_VISIBLE_READS
+        /* Owner is waiting for readers before committing: let it commit */
+        w->tx->vr_waiting ? KILL_SELF | DELAY_RESTART :
+# endif /* SHARED_VISIBLE_READS */
         (_tinystm.contention_manager != NULL ? _tinystm.contention_manager(tx, w->tx, WW_CONFLICT) : KILL_SELF);
       if (decision == KILL_OTHER) {
         /* Kill other */
@@ -702,6 +1043,7 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
 # endif /* UNIT_TX */
     }
 #endif /* CONFLICT_TRACKING */
+    SET_CONFLICT(tx, addr, lock);
     stm_rollback(tx, STM_ABORT_WW_CONFLICT);
     return NULL;
   }
@@ -718,6 +1060,7 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
     /* We might have read an older version previously */
 #ifdef UNIT_TX
     if (unlikely(tx->attr.no_extend)) {
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -729,6 +1072,7 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
       /* Abort caused by invisible reads */
       tx->visible_reads++;
 #endif /* CM == CM_MODULAR */
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -737,8 +1081,13 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
 #ifdef IRREVOCABLE_ENABLED
  acquire_no_check:
 #endif /* IRREVOCABLE_ENABLED */
-  if (unlikely(tx->w_set.nb_entries == tx->w_set.size))
+  if (unlikely(tx->w_set.nb_entries == tx->w_set.size)) {
+#ifdef IRREVOCABLE_ENABLED
+    if (stm_irrevocable_extend(tx))
+      goto restart;
+#endif /* IRREVOCABLE_ENABLED */
     stm_rollback(tx, STM_ABORT_EXTEND_WS);
+  }
   w = &tx->w_set.entries[tx->w_set.nb_entries];
 #if CM == CM_MODULAR
   w->version = version;
@@ -769,6 +1118,11 @@ do_write:
   if (prev != NULL) {
     /* Link new entry in list */
     prev->next = w;
+#ifdef STRIPE_INDEX
+    stm_wbetl_index_add((w_entry_t *)LOCK_GET_ADDR(l), w);
+  } else {
+    stm_wbetl_index_init(w);
+#endif /* STRIPE_INDEX */
   }
   tx->w_set.nb_entries++;
   tx->w_set.has_writes++;
@@ -790,14 +1144,15 @@ stm_wbetl_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
   w_entry_t *w;
 
   l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
-  /* Does the lock owned? */
-  assert(LOCK_GET_WRITE(l));
-  /* Do we own the lock? */
   w = (w_entry_t *)LOCK_GET_ADDR(l);
-  assert(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries);
-
-  /* Read directly from write set entry. */
-  return w->value;
+  /* Do we own the lock? */
+  if (likely(LOCK_GET_WRITE(l) && tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)) {
+    /* Read directly from write set entry (or from memory if mask was empty) */
+    if ((w = stm_wbetl_find(tx, w, addr)) != NULL)
+      return (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
+  }
+  /* Not written on all paths (or lock stolen) */
+  return stm_wbetl_read(tx, addr);
 }
 
 static INLINE stm_word_t
@@ -805,9 +1160,8 @@ stm_wbetl_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
 {
   /* Acquire lock as write. */
   stm_wbetl_write(tx, addr, 0, 0);
-  /* Now the lock is owned, read directly from memory is safe. */
-  /* TODO Unsafe with CM_MODULAR */
-  return *addr;
+  /* Now the lock is owned: the address may have been written before */
+  return stm_wbetl_RaW(tx, addr);
 }
 
 static INLINE void
@@ -823,17 +1177,17 @@ stm_wbetl_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_wor
   stm_word_t l;
   w_entry_t *w;
 
-  l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
-  /* Does the lock owned? */
-  assert(LOCK_GET_WRITE(l));
-  /* Do we own the lock? */
-  w = (w_entry_t *)LOCK_GET_ADDR(l);
-  assert(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries);
   /* in WaW, mask can never be 0 */
   assert(mask != 0);
-  while (1) {
-    if (addr == w->addr) {
+  l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
+  w = (w_entry_t *)LOCK_GET_ADDR(l);
+  /* Do we own the lock? */
+  if (likely(LOCK_GET_WRITE(l) && tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)) {
+    if ((w = stm_wbetl_find(tx, w, addr)) != NULL) {
       /* No need to add to write set */
+#ifdef CLOSED_NESTING
+      stm_nested_save(tx, w, NULL);
+#endif /* CLOSED_NESTING */
       if (mask != ~(stm_word_t)0) {
         if (w->mask == 0)
           w->value = ATOMIC_LOAD(addr);
@@ -843,18 +1197,124 @@ stm_wbetl_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_wor
       w->mask |= mask;
       return;
     }
-    /* The entry must exist */
-    assert (w->next != NULL);
-    w = w->next;
   }
+  /* Not written on all paths (or lock stolen) */
+  stm_wbetl_write(tx, addr, value, mask);
 }
 
+# if CM == CM_MODULAR || defined(IRREVOCABLE_IMPROVED)
+/*
+ * Can the lock of the last entry of a list be released with its
+ * previous version (its data has only been read)?  Empty writes must
+ * update the version (e.g., stm_free() prevents inconsistent reads of
+ * freed memory).
+ */
+static INLINE int
+stm_wbetl_only_read(stm_tx_t *tx, w_entry_t *w)
+{
+  if (w->mask != 0)
+    return 0;
+#  if CM == CM_MODULAR
+  /* Visible read (writes upgrade the lock) */
+  if (!LOCK_GET_WRITE(ATOMIC_LOAD(w->lock)))
+    return 1;
+#  endif /* CM == CM_MODULAR */
+#  ifdef IRREVOCABLE_IMPROVED
+  /* Read of irrevocable transaction */
+  if (tx->irrevocable && !tx->empty_writes) {
+    for (w = (w_entry_t *)LOCK_GET_ADDR(ATOMIC_LOAD(w->lock)); w != NULL; w = w->next) {
+      if (w->mask != 0)
+        return 0;
+    }
+    return 1;
+  }
+#  endif /* IRREVOCABLE_IMPROVED */
+  return 0;
+}
+# endif /* CM == CM_MODULAR || defined(IRREVOCABLE_IMPROVED) */
+
+/*
+ * Drop the lock of an entry if it is the last address covered.
+ */
+static INLINE void
+stm_wbetl_release(stm_tx_t *tx, w_entry_t *w, stm_word_t t)
+{
+  /* Only drop lock for last covered address in write set */
+  if (w->next == NULL) {
+# if CM == CM_MODULAR || defined(IRREVOCABLE_IMPROVED)
+    /* In case of visible (or irrevocable) read, reset lock to its previous timestamp */
+    if (stm_wbetl_only_read(tx, w))
+      ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(w->version));
+    else
+# endif /* CM == CM_MODULAR || defined(IRREVOCABLE_IMPROVED) */
+      ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
+  }
+}
+
+/*
+ * Install new version of an entry and drop its lock if it is the last
+ * address covered.
+ */
+static INLINE void
+stm_wbetl_install(stm_tx_t *tx, w_entry_t *w, stm_word_t t)
+{
+#ifdef MULTI_VERSION
+  if (w->mask != 0)
+    stm_mv_save(w->addr, ATOMIC_LOAD(w->addr), w->lock, t);
+#endif /* MULTI_VERSION */
+  if (w->mask != 0)
+    ATOMIC_STORE(w->addr, w->value);
+  stm_wbetl_release(tx, w, t);
+}
+
+#ifdef DURABLE_TX
+/*
+ * Install new versions of a logged transaction and make them persistent
+ * before truncating the log and dropping locks.  Lines written by
+ * consecutive entries are only flushed once.
+ */
+static NOINLINE void
+stm_wbetl_install_durable(stm_tx_t *tx, stm_word_t t)
+{
+  w_entry_t *w;
+  stm_word_t line, prev;
+  int i;
+
+  prev = 0;
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    if (w->mask == 0)
+      continue;
+# ifdef MULTI_VERSION
+    stm_mv_save(w->addr, ATOMIC_LOAD(w->addr), w->lock, t);
+# endif /* MULTI_VERSION */
+    ATOMIC_STORE(w->addr, w->value);
+    line = DURABLE_LINE(w->addr);
+    if (line != prev && prev != 0)
+      stm_durable_flush((void *)prev);
+    prev = line;
+  }
+  stm_durable_flush((void *)prev);
+  stm_durable_fence();
+  stm_durable_truncate(tx);
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++)
+    stm_wbetl_release(tx, w, t);
+}
+#endif /* DURABLE_TX */
+
 static INLINE int
 stm_wbetl_commit(stm_tx_t *tx)
 {
   w_entry_t *w;
   stm_word_t t;
-  int i;
+  int i, validate;
+#ifdef SORTED_COMMIT
+  w_entry_t **ws;
+#endif /* SORTED_COMMIT */
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
 
   PRINT_DEBUG("==> stm_wbetl_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -878,19 +1338,13 @@ stm_wbetl_commit(stm_tx_t *tx)
 #ifdef IRREVOCABLE_ENABLED
   /* Verify if there is an irrevocable transaction once all locks have been acquired */
 # ifdef IRREVOCABLE_IMPROVED
-  /* FIXME: it is bogus. the status should be changed to idle otherwise stm_quiesce will not progress */
-  if (unlikely(!tx->irrevocable)) {
-    do {
-      t = ATOMIC_LOAD(&_tinystm.irrevocable);
-      /* If the irrevocable transaction have encountered an acquired lock, abort */
-      if (t == 2) {
-        stm_rollback(tx, STM_ABORT_IRREVOCABLE);
-        return 0;
-      }
-    } while (t);
+  /* Conflicts are detected using locks unless irrevocable transaction blocks us */
+  if (unlikely(!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 2)) {
+    stm_rollback(tx, STM_ABORT_IRREVOCABLE);
+    return 0;
   }
 # else /* ! IRREVOCABLE_IMPROVED */
-  if (!tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable)) {
+  if (!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG)) {
     stm_rollback(tx, STM_ABORT_IRREVOCABLE);
     return 0;
   }
@@ -898,14 +1352,22 @@ stm_wbetl_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
   /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-  t = FETCH_INC_CLOCK + 1;
+  t = stm_clock_commit(tx, &validate);
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable))
     goto release_locks;
 #endif /* IRREVOCABLE_ENABLED */
 
-  /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-  if (unlikely(tx->start != t - 1 && !stm_wbetl_validate(tx))) {
+  /* Try to validate (only if a concurrent transaction may have committed since tx->start) */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+#ifdef HELPER_VALIDATION
+  /* Skip entries validated by the helper after all commits before ours */
+  if (unlikely(validate && !stm_wbetl_validate_from(tx, stm_hv_validated(tx, t - 1)))) {
+#else /* ! HELPER_VALIDATION */
+  if (unlikely(validate && !stm_wbetl_validate(tx))) {
+#endif /* ! HELPER_VALIDATION */
     /* Cannot commit */
 #if CM == CM_MODULAR
     /* Abort caused by invisible reads */
@@ -914,27 +1376,38 @@ stm_wbetl_commit(stm_tx_t *tx)
     stm_rollback(tx, STM_ABORT_VALIDATE);
     return 0;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
 
 #ifdef IRREVOCABLE_ENABLED
   release_locks:
 #endif /* IRREVOCABLE_ENABLED */
 
-  /* Install new versions, drop locks and set new timestamp */
-  w = tx->w_set.entries;
-  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
-    if (w->mask != 0)
-      ATOMIC_STORE(w->addr, w->value);
-    /* Only drop lock for last covered address in write set */
-    if (w->next == NULL) {
-# if CM == CM_MODULAR
-      /* In case of visible read, reset lock to its previous timestamp */
-      if (w->mask == 0)
-        ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(w->version));
-      else
-# endif /* CM == CM_MODULAR */
-        ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
+#ifdef DURABLE_TX
+  /* Log old values (fails if nothing is written) */
+  if (tx->durable_log != NULL && stm_durable_log(tx) != 0) {
+    stm_wbetl_install_durable(tx, t);
+    goto end;
+  }
+#endif /* DURABLE_TX */
+
+#ifdef SORTED_COMMIT
+  if ((ws = stm_ws_sort(tx)) != NULL) {
+    /* Install in lock order (entries covered by a lock are adjacent, last one drops lock) */
+    for (i = 0; i < tx->w_set.nb_entries; i++) {
+      if (i + PREFETCH_AHEAD < tx->w_set.nb_entries)
+        PREFETCH_W(ws[i + PREFETCH_AHEAD]->addr);
+      stm_wbetl_install(tx, ws[i], t);
     }
+    goto end;
   }
+#endif /* SORTED_COMMIT */
+
+  /* Install new versions, drop locks and set new timestamp */
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++)
+    stm_wbetl_install(tx, w, t);
 
  end:
   return 1;
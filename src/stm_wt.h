@@ -26,11 +26,50 @@
 #ifndef _STM_WT_H_
 #define _STM_WT_H_
 
+#ifdef IRREVOCABLE_IMPROVED
+/* Function declaration */
+static INLINE w_entry_t *stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask);
+#endif /* IRREVOCABLE_IMPROVED */
+
+/*
+ * Update memory in place (bypassing caches for large ranges).
+ */
+static INLINE void
+stm_wt_store(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value)
+{
+#ifdef NON_TEMPORAL_STORES
+  if (tx->nt_stores) {
+    _mm_stream_si64((long long *)addr, (long long)value);
+    tx->nt_pending = 1;
+    return;
+  }
+#endif /* NON_TEMPORAL_STORES */
+  ATOMIC_STORE(addr, value);
+}
+
+/*
+ * Order non-temporal stores before subsequent stores (lock releases).
+ */
+static INLINE void
+stm_wt_store_fence(stm_tx_t *tx)
+{
+#ifdef NON_TEMPORAL_STORES
+  tx->nt_stores = 0;
+  if (tx->nt_pending) {
+    _mm_sfence();
+    tx->nt_pending = 0;
+  }
+#endif /* NON_TEMPORAL_STORES */
+}
+
 static INLINE int
 stm_wt_validate(stm_tx_t *tx)
 {
   r_entry_t *r;
   int i;
+#ifdef SIMD_VALIDATION
+  int j;
+#endif /* SIMD_VALIDATION */
   stm_word_t l;
 
   PRINT_DEBUG("==> stm_wt_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
@@ -38,6 +77,15 @@ stm_wt_validate(stm_tx_t *tx)
   /* Validate reads */
   r = tx->r_set.entries;
   for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+#ifdef SIMD_VALIDATION
+    /* Skip entries that are not locked and still have the same version */
+    j = stm_simd_validate(r, i);
+    if (j > 0) {
+      r += j;
+      if ((i -= j) == 0)
+        break;
+    }
+#endif /* SIMD_VALIDATION */
     /* Read lock */
     l = ATOMIC_LOAD(r->lock);
     /* Unlocked and still the same version? */
@@ -61,12 +109,14 @@ stm_wt_validate(stm_tx_t *tx)
 # endif /* UNIT_TX */
         }
 #endif /* CONFLICT_TRACKING */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* We own the lock: OK */
     } else {
       if (LOCK_GET_TIMESTAMP(l) != r->version) {
         /* Other version: cannot validate */
+        SET_CONFLICT(tx, NULL, r->lock);
         return 0;
       }
       /* Same version: OK */
@@ -75,6 +125,51 @@ stm_wt_validate(stm_tx_t *tx)
   return 1;
 }
 
+#ifdef IRREVOCABLE_IMPROVED
+/*
+ * Lock read set when becoming irrevocable (return 0 if some data read
+ * has changed).  The caller makes sure that the write set is large
+ * enough.
+ */
+static INLINE int
+stm_wt_lock_reads(stm_tx_t *tx)
+{
+  r_entry_t *r;
+  w_entry_t *w;
+  stm_word_t l;
+  int i;
+
+  PRINT_DEBUG("==> stm_wt_lock_reads(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
+
+  r = tx->r_set.entries;
+  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+    l = ATOMIC_LOAD_ACQ(r->lock);
+    if (LOCK_GET_OWNED(l)) {
+      w = (w_entry_t *)LOCK_GET_ADDR(l);
+      /* Only locks already acquired by us are fine */
+      if (tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)
+        continue;
+      return 0;
+    }
+    if (LOCK_GET_TIMESTAMP(l) != r->version)
+      return 0;
+    /* Lock without address (nothing is read from or written to the entry) */
+    assert(tx->w_set.nb_entries < tx->w_set.size);
+    w = &tx->w_set.entries[tx->w_set.nb_entries];
+    /* Fill entry first (readers of locked data may access it) */
+    w->addr = NULL;
+    w->mask = 0;
+    w->lock = r->lock;
+    w->version = l;
+    w->next = NULL;
+    if (ATOMIC_CAS_ACQ_REL(r->lock, l, LOCK_SET_ADDR_WRITE((stm_word_t)w)) == 0)
+      return 0;
+    tx->w_set.nb_entries++;
+  }
+  return 1;
+}
+#endif /* IRREVOCABLE_IMPROVED */
+
 /*
  * Extend snapshot range.
  */
@@ -82,6 +177,9 @@ static INLINE int
 stm_wt_extend(stm_tx_t *tx)
 {
   stm_word_t now;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
 
   PRINT_DEBUG("==> stm_wt_extend(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -92,15 +190,34 @@ stm_wt_extend(stm_tx_t *tx)
 #endif /* UNIT_TX */
 
   /* Get current time */
-  now = GET_CLOCK;
+  now = stm_clock_extend();
   /* No need to check clock overflow here. The clock can exceed up to MAX_THREADS and it will be reset when the quiescence is reached. */
 
+#ifdef READ_SET_FILTER
+  if (unlikely(tx->r_set.nb_entries >= tx->r_set.compact_at))
+    stm_rs_compact(tx);
+#endif /* READ_SET_FILTER */
+
   /* Try to validate read set */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
   if (stm_wt_validate(tx)) {
+#ifdef TM_STATISTICS2
+    stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
     /* It works: we can extend until now */
     tx->end = now;
+    tx->nb_extensions++;
+#ifdef SANDBOXING
+    tx->sb_reads = 0;
+#endif /* SANDBOXING */
+    stm_notify_event(STM_EVENT_EXTEND);
     return 1;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
   return 0;
 }
 
@@ -115,6 +232,13 @@ stm_wt_rollback(stm_tx_t *tx)
 
   assert(IS_ACTIVE(tx->status));
 
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_enter(tx);
+#endif /* READ_LOCKED_DATA */
+
+  /* Streaming stores must not overwrite restored values */
+  stm_wt_store_fence(tx);
+
   t = 0;
   /* Undo writes and drop locks */
   w = tx->w_set.entries;
@@ -141,6 +265,9 @@ stm_wt_rollback(stm_tx_t *tx)
   }
   /* Make sure that all lock releases become visible */
   ATOMIC_MB_WRITE;
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_leave(tx);
+#endif /* READ_LOCKED_DATA */
 }
 
 static INLINE void
@@ -154,8 +281,12 @@ stm_wt_add_to_rs(stm_tx_t *tx, stm_word_t version, volatile stm_word_t *lock)
 
 #ifdef NO_DUPLICATES_IN_RW_SETS
   if (stm_has_read(tx, lock) != NULL)
-    return value;
+    return;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
+#ifdef READ_SET_FILTER
+  if (stm_rs_filter(tx, lock))
+    return;
+#endif /* READ_SET_FILTER */
 
   /* Add address and version to read set */
   if (tx->r_set.nb_entries == tx->r_set.size)
@@ -165,6 +296,45 @@ stm_wt_add_to_rs(stm_tx_t *tx, stm_word_t version, volatile stm_word_t *lock)
   r->lock = lock;
 }
 
+#ifdef READ_LOCKED_DATA
+/*
+ * Get the value that a location locked by another transaction had
+ * before being written, from the undo log of the owner, and the
+ * version of the lock when it was acquired (return 0 if the owner is
+ * not active anymore or has released the lock).  Write set entries
+ * are filled before the lock is acquired or the entry is linked, and
+ * memory is written after the entry.
+ */
+static INLINE int
+stm_wt_read_locked(volatile stm_word_t *addr, volatile stm_word_t *lock, stm_word_t l, stm_word_t *value, stm_word_t *version)
+{
+  w_entry_t *w;
+  stm_tx_t *owner;
+  stm_word_t s, v, o;
+
+  w = (w_entry_t *)LOCK_GET_ADDR(l);
+  owner = w->tx;
+  s = ATOMIC_LOAD_ACQ(&owner->lock_seq);
+  if ((s & 1) != 0 || ATOMIC_LOAD_ACQ(lock) != l)
+    return 0;
+  o = w->version;
+  /* Memory has the old value unless the owner wrote the address */
+  v = ATOMIC_LOAD_ACQ(addr);
+  for (; w != NULL; w = (w_entry_t *)ATOMIC_LOAD_ACQ(&w->next)) {
+    if (w->addr == addr) {
+      if (ATOMIC_LOAD_ACQ(&w->mask) != 0)
+        v = w->value;
+      break;
+    }
+  }
+  if (ATOMIC_LOAD_ACQ(&owner->lock_seq) != s || ATOMIC_LOAD_ACQ(lock) != l)
+    return 0;
+  *value = v;
+  *version = LOCK_GET_TIMESTAMP(o);
+  return 1;
+}
+#endif /* READ_LOCKED_DATA */
+
 static INLINE stm_word_t
 stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
 {
@@ -176,6 +346,16 @@ stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
 
   assert(IS_ACTIVE(tx->status));
 
+#ifdef IRREVOCABLE_IMPROVED
+  if (unlikely(tx->irrevocable) && ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 1) {
+    /* Irrevocable transaction: lock data (then read it as if written) */
+    if (likely(tx->w_set.nb_entries < tx->w_set.size))
+      stm_wt_write(tx, addr, 0, 0);
+    else
+      stm_irrevocable_block(tx);
+  }
+#endif /* IRREVOCABLE_IMPROVED */
+
   /* Get reference to lock */
   lock = GET_LOCK(addr);
 
@@ -207,10 +387,11 @@ stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
     stm_wt_add_to_rs(tx, version, lock);
 
     /* Valid version? */
-    if (unlikely(version > tx->end)) {
+    if (unlikely(version > tx->end) && !stm_defer_validation(tx)) {
       /* No: try to extend first (except for read-only transactions: no read set) */
       if (tx->attr.read_only || !stm_wt_extend(tx)) {
         /* Not much we can do: abort */
+        SET_CONFLICT(tx, addr, lock);
         stm_rollback(tx, STM_ABORT_VAL_READ);
         return 0;
       }
@@ -243,16 +424,36 @@ stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
 # endif /* UNIT_TX */
 
     /* Conflict: CM kicks in (we could also check for duplicate reads and get value from read set) */
-# if defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED)
-    if (tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-      ATOMIC_STORE(&_tinystm.irrevocable, 2);
-# endif /* defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED) */
 # if defined(IRREVOCABLE_ENABLED)
     if (tx->irrevocable) {
       /* Spin while locked */
       goto restart;
     }
 # endif /* defined(IRREVOCABLE_ENABLED) */
+# ifdef READ_LOCKED_DATA
+    /* Read old version */
+    if (stm_wt_read_locked(addr, lock, l, &value, &version)) {
+      if (version <= tx->end) {
+        /* Success (validation fails while the lock is owned) */
+#  ifdef TM_STATISTICS2
+        tx->stat_locked_reads_ok++;
+#  endif /* TM_STATISTICS2 */
+        stm_wt_add_to_rs(tx, version, lock);
+        return value;
+      }
+      /* The old value may not be valid anymore after extension: read again */
+      if (!tx->attr.read_only && stm_wt_extend(tx))
+        goto restart;
+      /* Invalid version: not much we can do => fail */
+#  ifdef TM_STATISTICS2
+      tx->stat_locked_reads_failed++;
+#  endif /* TM_STATISTICS2 */
+    } else if (!LOCK_GET_WRITE(l2 = ATOMIC_LOAD_ACQ(lock))) {
+      /* Lock released in the meantime */
+      l = l2;
+      goto restart_no_load;
+    }
+# endif /* READ_LOCKED_DATA */
 # if CM == CM_DELAY
     tx->c_lock = lock;
 # endif /* CM == CM_DELAY */
@@ -272,6 +473,7 @@ stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
     }
 # endif /* CONFLICT_TRACKING */
 
+    SET_CONFLICT(tx, addr, lock);
     stm_rollback(tx, STM_ABORT_RW_CONFLICT);
     return 0;
   }
@@ -317,15 +519,24 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
       /* Did we previously write the same address? */
       while (1) {
         if (addr == prev->addr) {
-          if (w->mask == 0) {
+#ifdef CLOSED_NESTING
+          stm_nested_save(tx, w, addr);
+#endif /* CLOSED_NESTING */
+          if (prev->mask == 0) {
             /* Remember old value */
-            w->value = ATOMIC_LOAD(addr);
-            w->mask = mask;
+            prev->value = ATOMIC_LOAD(addr);
+#ifdef READ_LOCKED_DATA
+            /* Readers must find the old value before memory changes */
+            ATOMIC_STORE_REL(&prev->mask, mask);
+            ATOMIC_MB_WRITE;
+#else /* ! READ_LOCKED_DATA */
+            prev->mask = mask;
+#endif /* ! READ_LOCKED_DATA */
           }
           /* Yes: only write to memory */
           if (mask != ~(stm_word_t)0)
             value = (ATOMIC_LOAD(addr) & ~mask) | (value & mask);
-          ATOMIC_STORE(addr, value);
+          stm_wt_store(tx, addr, value);
           return w;
         }
         if (prev->next == NULL) {
@@ -335,18 +546,19 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
         prev = prev->next;
       }
       /* Must add to write set */
-      if (tx->w_set.nb_entries == tx->w_set.size)
+      if (tx->w_set.nb_entries == tx->w_set.size) {
+#ifdef IRREVOCABLE_ENABLED
+        if (stm_irrevocable_extend(tx))
+          goto restart;
+#endif /* IRREVOCABLE_ENABLED */
         stm_rollback(tx, STM_ABORT_EXTEND_WS);
+      }
       w = &tx->w_set.entries[tx->w_set.nb_entries];
       /* Get version from previous write set entry (all entries in linked list have same version) */
       w->version = prev->version;
       goto do_write;
     }
     /* Conflict: CM kicks in */
-# if defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED)
-    if (tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable) == 1)
-      ATOMIC_STORE(&_tinystm.irrevocable, 2);
-# endif /* defined(IRREVOCABLE_ENABLED) && defined(IRREVOCABLE_IMPROVED) */
 # if defined(IRREVOCABLE_ENABLED)
     if (tx->irrevocable) {
       /* Spin while locked */
@@ -372,6 +584,7 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
     }
 # endif /* CONFLICT_TRACKING */
 
+    SET_CONFLICT(tx, addr, lock);
     stm_rollback(tx, STM_ABORT_WW_CONFLICT);
     return NULL;
   }
@@ -388,6 +601,7 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
     /* We might have read an older version previously */
 #ifdef UNIT_TX
     if (tx->attr.no_extend) {
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -395,6 +609,7 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
     if (stm_has_read(tx, lock) != NULL) {
       /* Read version must be older (otherwise, tx->end >= version) */
       /* Not much we can do: abort */
+      SET_CONFLICT(tx, addr, lock);
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
       return NULL;
     }
@@ -403,9 +618,22 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
 #ifdef IRREVOCABLE_ENABLED
  acquire_no_check:
 #endif /* IRREVOCABLE_ENABLED */
-  if (tx->w_set.nb_entries == tx->w_set.size)
+  if (tx->w_set.nb_entries == tx->w_set.size) {
+#ifdef IRREVOCABLE_ENABLED
+    if (stm_irrevocable_extend(tx))
+      goto restart;
+#endif /* IRREVOCABLE_ENABLED */
     stm_rollback(tx, STM_ABORT_EXTEND_WS);
+  }
   w = &tx->w_set.entries[tx->w_set.nb_entries];
+#ifdef READ_LOCKED_DATA
+  /* Readers access the entry as soon as the lock is acquired (memory only changes with the lock) */
+  w->addr = addr;
+  w->mask = mask;
+  w->value = ATOMIC_LOAD(addr);
+  w->version = l;
+  w->next = NULL;
+#endif /* READ_LOCKED_DATA */
   if (ATOMIC_CAS_FULL(lock, l, LOCK_SET_ADDR_WRITE((stm_word_t)w)) == 0)
     goto restart;
   /* We store the old value of the lock (timestamp and incarnation) */
@@ -425,15 +653,21 @@ do_write:
     /* Remember old value */
     w->value = ATOMIC_LOAD(addr);
   }
-  if (mask != 0) {
-    if (mask != ~(stm_word_t)0)
-      value = (w->value & ~mask) | (value & mask);
-    ATOMIC_STORE(addr, value);
-  }
   w->next = NULL;
   if (prev != NULL) {
     /* Link new entry in list */
+#ifdef READ_LOCKED_DATA
+    /* Readers must find the old value before memory changes */
+    ATOMIC_STORE_REL(&prev->next, w);
+    ATOMIC_MB_WRITE;
+#else /* ! READ_LOCKED_DATA */
     prev->next = w;
+#endif /* ! READ_LOCKED_DATA */
+  }
+  if (mask != 0) {
+    if (mask != ~(stm_word_t)0)
+      value = (w->value & ~mask) | (value & mask);
+    stm_wt_store(tx, addr, value);
   }
   tx->w_set.nb_entries++;
 
@@ -443,26 +677,41 @@ do_write:
 static INLINE stm_word_t
 stm_wt_RaR(stm_tx_t *tx, volatile stm_word_t *addr)
 {
-  /* TODO same as fast read but no need to add into the RS */
+  volatile stm_word_t *lock;
+  stm_word_t l, value;
+  w_entry_t *w;
+
+  lock = GET_LOCK(addr);
+  l = ATOMIC_LOAD_ACQ(lock);
+  value = ATOMIC_LOAD_ACQ(addr);
+  if (LOCK_GET_WRITE(l)) {
+    w = (w_entry_t *)LOCK_GET_ADDR(l);
+    /* Written by us since it was read: memory has our value */
+    if (likely(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries))
+      return value;
+  } else if (likely(ATOMIC_LOAD_ACQ(lock) == l && LOCK_GET_TIMESTAMP(l) <= tx->end)) {
+    /* The lock is already in the read set: only check that the version is
+     * part of the snapshot (commit fails if it differs from the read set) */
+    return value;
+  }
   return stm_wt_read(tx, addr);
 }
 
 static INLINE stm_word_t
 stm_wt_RaW(stm_tx_t *tx, volatile stm_word_t *addr)
 {
-#ifndef NDEBUG
   stm_word_t l;
   w_entry_t *w;
+
   l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
-  /* Does the lock owned? */
-  assert(LOCK_GET_WRITE(l));
-  /* Do we own the lock? */
   w = (w_entry_t *)LOCK_GET_ADDR(l);
-  assert(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries);
-#endif /* ! NDEBUG */
-
-  /* Read directly from memory. */
-  return *addr;
+  /* Do we own the lock? */
+  if (likely(LOCK_GET_WRITE(l) && tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)) {
+    /* Read directly from memory. */
+    return ATOMIC_LOAD(addr);
+  }
+  /* Not written on all paths */
+  return stm_wt_read(tx, addr);
 }
 
 static INLINE stm_word_t
@@ -471,7 +720,7 @@ stm_wt_RfW(stm_tx_t *tx, volatile stm_word_t *addr)
   /* Acquire lock as write. */
   stm_wt_write(tx, addr, 0, 0);
   /* Now the lock is owned, read directly from memory is safe. */
-  return *addr;
+  return ATOMIC_LOAD(addr);
 }
 
 static INLINE void
@@ -484,30 +733,60 @@ stm_wt_WaR(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t
 static INLINE void
 stm_wt_WaW(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word_t mask)
 {
-#ifndef NDEBUG
   stm_word_t l;
   w_entry_t *w;
-  l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
-  /* Does the lock owned? */
-  assert(LOCK_GET_WRITE(l));
-  /* Do we own the lock? */
-  w = (w_entry_t *)LOCK_GET_ADDR(l);
-  assert(tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries);
+
   /* in WaW, mask can never be 0 */
   assert(mask != 0);
-#endif /* ! NDEBUG */
-  if (mask != ~(stm_word_t)0) {
-    value = (ATOMIC_LOAD(addr) & ~mask) | (value & mask);
+  l = ATOMIC_LOAD_ACQ(GET_LOCK(addr));
+  w = (w_entry_t *)LOCK_GET_ADDR(l);
+  /* Do we own the lock? */
+  if (likely(LOCK_GET_WRITE(l) && tx->w_set.entries <= w && w < tx->w_set.entries + tx->w_set.nb_entries)) {
+    for (; w != NULL; w = w->next) {
+      /* Old value must have been saved (not the case after RfW) */
+      if (addr == w->addr && w->mask != 0) {
+#ifdef CLOSED_NESTING
+        stm_nested_save(tx, w, addr);
+#endif /* CLOSED_NESTING */
+        if (mask != ~(stm_word_t)0)
+          value = (ATOMIC_LOAD(addr) & ~mask) | (value & mask);
+        ATOMIC_STORE(addr, value);
+        return;
+      }
+    }
   }
-  ATOMIC_STORE(addr, value);
+  stm_wt_write(tx, addr, value, mask);
 }
 
+#ifdef IRREVOCABLE_IMPROVED
+/*
+ * Can the lock of the last entry of a list be released with its
+ * previous version (its data has only been read by the irrevocable
+ * transaction)?  Empty writes must update the version (e.g., stm_free()
+ * prevents inconsistent reads of freed memory).
+ */
+static INLINE int
+stm_wt_only_read(stm_tx_t *tx, w_entry_t *w)
+{
+  if (w->mask != 0 || !tx->irrevocable || tx->empty_writes)
+    return 0;
+  for (w = (w_entry_t *)LOCK_GET_ADDR(ATOMIC_LOAD(w->lock)); w != NULL; w = w->next) {
+    if (w->mask != 0)
+      return 0;
+  }
+  return 1;
+}
+#endif /* IRREVOCABLE_IMPROVED */
+
 static INLINE int
 stm_wt_commit(stm_tx_t *tx)
 {
   w_entry_t *w;
   stm_word_t t;
-  int i;
+  int i, validate;
+#ifdef TM_STATISTICS2
+  int phase;
+#endif /* TM_STATISTICS2 */
 
   PRINT_DEBUG("==> stm_wt_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -515,57 +794,81 @@ stm_wt_commit(stm_tx_t *tx)
 #ifdef IRREVOCABLE_ENABLED
   /* Verify if there is an irrevocable transaction once all locks have been acquired */
 # ifdef IRREVOCABLE_IMPROVED
-  /* FIXME: it is bogus. the status should be changed to idle otherwise stm_quiesce will not progress */
-  if (unlikely(!tx->irrevocable)) {
-    do {
-      t = ATOMIC_LOAD(&_tinystm.irrevocable);
-      /* If the irrevocable transaction have encountered an acquired lock, abort */
-      if (t == 2) {
-        stm_rollback(tx, STM_ABORT_IRREVOCABLE);
-        return 0;
-      }
-    } while (t);
+  /* Conflicts are detected using locks unless irrevocable transaction blocks us */
+  if (unlikely(!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG) == 2)) {
+    stm_rollback(tx, STM_ABORT_IRREVOCABLE);
+    return 0;
   }
 # else /* ! IRREVOCABLE_IMPROVED */
-  if (!tx->irrevocable && ATOMIC_LOAD(&_tinystm.irrevocable)) {
+  if (!tx->irrevocable && ATOMIC_LOAD(&IRREVOCABLE_FLAG)) {
     stm_rollback(tx, STM_ABORT_IRREVOCABLE);
     return 0;
   }
 # endif /* ! IRREVOCABLE_IMPROVED */
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef READ_LOCKED_DATA
+  /* Old values are not valid anymore once the commit timestamp is taken */
+  stm_lock_seq_enter(tx);
+#endif /* READ_LOCKED_DATA */
+
   /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-  t = FETCH_INC_CLOCK + 1;
+  t = stm_clock_commit(tx, &validate);
 
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable))
     goto release_locks;
 #endif /* IRREVOCABLE_ENABLED */
 
-  /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-  if (unlikely(tx->start != t - 1 && !stm_wt_validate(tx))) {
+  /* Try to validate (only if a concurrent transaction may have committed since tx->start) */
+#ifdef TM_STATISTICS2
+  phase = stm_prof_enter(tx, PROF_VALIDATE);
+#endif /* TM_STATISTICS2 */
+  if (unlikely(validate && !stm_wt_validate(tx))) {
     /* Cannot commit */
     stm_rollback(tx, STM_ABORT_VALIDATE);
     return 0;
   }
+#ifdef TM_STATISTICS2
+  stm_prof_leave(tx, phase);
+#endif /* TM_STATISTICS2 */
 
 #ifdef IRREVOCABLE_ENABLED
   release_locks:
 #endif /* IRREVOCABLE_ENABLED */
 
+#ifdef MULTI_VERSION
+  /* Save overwritten values (kept in the undo log) */
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    if (w->mask != 0)
+      stm_mv_save(w->addr, w->value, w->lock, t);
+  }
+#endif /* MULTI_VERSION */
+
   /* Make sure that the updates become visible before releasing locks */
+  stm_wt_store_fence(tx);
   ATOMIC_MB_WRITE;
   /* Drop locks and set new timestamp */
   w = tx->w_set.entries;
   for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
     if (w->next == NULL) {
       /* No need for CAS (can only be modified by owner transaction) */
-      ATOMIC_STORE(w->lock, LOCK_SET_TIMESTAMP(t));
+#ifdef IRREVOCABLE_IMPROVED
+      /* In case of irrevocable read, reset lock to its previous value */
+      if (stm_wt_only_read(tx, w))
+        ATOMIC_STORE(w->lock, w->version);
+      else
+#endif /* IRREVOCABLE_IMPROVED */
+        ATOMIC_STORE(w->lock, LOCK_SET_TIMESTAMP(t));
     }
   }
   /* Make sure that all lock releases become visible */
   /* TODO: is ATOMIC_MB_WRITE required? */
   ATOMIC_MB_WRITE;
+#ifdef READ_LOCKED_DATA
+  stm_lock_seq_leave(tx);
+#endif /* READ_LOCKED_DATA */
 end:
   return 1;
 }
@@ -64,6 +64,8 @@
 #if defined(__GNUC__) || defined(__INTEL_COMPILER)
 # define likely(x)                      __builtin_expect(!!(x), 1)
 # define unlikely(x)                    __builtin_expect(!!(x), 0)
+# define PREFETCH(a)                    __builtin_prefetch((const void *)(a))
+# define PREFETCH_W(a)                  __builtin_prefetch((const void *)(a), 1)
 # define INLINE                         inline __attribute__((always_inline))
 # define NOINLINE                       __attribute__((noinline))
 # if defined(__INTEL_COMPILER)
@@ -74,6 +76,8 @@
 #else /* ! (defined(__GNUC__) || defined(__INTEL_COMPILER)) */
 # define likely(x)                      (x)
 # define unlikely(x)                    (x)
+# define PREFETCH(a)                    /* None in the C standard */
+# define PREFETCH_W(a)                  /* None in the C standard */
 # define INLINE                         inline
 # define NOINLINE                       /* None in the C standard */
 # define ALIGNED                        /* None in the C standard */
@@ -122,17 +126,17 @@ xfree(void *mem)
 }
 
 static INLINE void*
-xmalloc_aligned(size_t size)
+xmemalign(size_t alignment, size_t size)
 {
   void *memptr;
   /* TODO is posix_memalign is not available, provide malloc fallback. */
-  /* Make sure that the allocation is aligned with cacheline size. */
+  /* Alignment must be a power of 2 (at most the page size on Darwin). */
 #if defined(__CYGWIN__) || defined (__sun__)
-  memptr = memalign(CACHELINE_SIZE, size);
+  memptr = memalign(alignment, size);
 #elif defined(__APPLE__)
   memptr = valloc(size);
 #else
-  if (unlikely(posix_memalign(&memptr, CACHELINE_SIZE, size)))
+  if (unlikely(posix_memalign(&memptr, alignment, size)))
     memptr = NULL;
 #endif
   if (unlikely(memptr == NULL)) {
@@ -142,5 +146,12 @@ xmalloc_aligned(size_t size)
   return memptr;
 }
 
+static INLINE void*
+xmalloc_aligned(size_t size)
+{
+  /* Make sure that the allocation is aligned with cacheline size. */
+  return xmemalign(CACHELINE_SIZE, size);
+}
+
 #endif /* !_UTILS_H_ */
 
@@ -31,9 +31,15 @@
 
 #define ALLOW_MISALIGNED_ACCESSES
 
-#define TM_LOAD(addr)                stm_load(addr)
-#define TM_STORE(addr, val)          stm_store(addr, val)
-#define TM_STORE2(addr, val, mask)   stm_store2(addr, val, mask)
+/* Barriers of the explicit descriptor (no thread-local lookup) */
+#define TM_LOAD(tx, addr)                 stm_load_tx(tx, addr)
+#define TM_STORE(tx, addr, val)           stm_store_tx(tx, addr, val)
+#define TM_STORE2(tx, addr, val, mask)    stm_store2_tx(tx, addr, val, mask)
+#define TM_LOAD_RANGE(tx, addr, buf, nb)  stm_load_range_tx(tx, addr, buf, nb)
+#define TM_STORE_RANGE(tx, addr, buf, nb) stm_store_range_tx(tx, addr, buf, nb)
+
+/* Size of the buffer used to move memory regions */
+#define MOVE_BUFFER_SIZE              256
 
 typedef union convert_64 {
   uint64_t u64;
@@ -75,7 +81,7 @@ static void sanity_checks(void)
   COMPILE_TIME_ASSERT(sizeof(char) == 1);
   COMPILE_TIME_ASSERT(sizeof(short) == 2);
   COMPILE_TIME_ASSERT(sizeof(int) == 4);
-  COMPILE_TIME_ASSERT(sizeof(long) == 4 || sizeof(long) == 8);
+  COMPILE_TIME_ASSERT(sizeof(long) == sizeof(stm_word_t));
   COMPILE_TIME_ASSERT(sizeof(float) == 4);
   COMPILE_TIME_ASSERT(sizeof(double) == 8);
 }
@@ -85,67 +91,67 @@ static void sanity_checks(void)
  * ################################################################### */
 
 static INLINE
-uint8_t int_stm_load_u8(volatile uint8_t *addr)
+uint8_t int_stm_load_u8(stm_tx_t *tx, volatile uint8_t *addr)
 {
   if (sizeof(stm_word_t) == 4) {
     convert_32_t val;
-    val.u32 = (uint32_t)TM_LOAD((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03));
+    val.u32 = (uint32_t)TM_LOAD(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03));
     return val.u8[(uintptr_t)addr & 0x03];
   } else {
     convert_64_t val;
-    val.u64 = (uint64_t)TM_LOAD((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
+    val.u64 = (uint64_t)TM_LOAD(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
     return val.u8[(uintptr_t)addr & 0x07];
   }
 }
 
 static INLINE
-uint16_t int_stm_load_u16(volatile uint16_t *addr)
+uint16_t int_stm_load_u16(stm_tx_t *tx, volatile uint16_t *addr)
 {
   if (unlikely(((uintptr_t)addr & 0x01) != 0)) {
     uint16_t val;
-    stm_load_bytes((volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint16_t));
+    stm_load_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint16_t));
     return val;
   } else if (sizeof(stm_word_t) == 4) {
     convert_32_t val;
-    val.u32 = (uint32_t)TM_LOAD((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03));
+    val.u32 = (uint32_t)TM_LOAD(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03));
     return val.u16[((uintptr_t)addr & 0x03) >> 1];
   } else {
     convert_64_t val;
-    val.u64 = (uint64_t)TM_LOAD((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
+    val.u64 = (uint64_t)TM_LOAD(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
     return val.u16[((uintptr_t)addr & 0x07) >> 1];
   }
 }
 
 static INLINE
-uint32_t int_stm_load_u32(volatile uint32_t *addr)
+uint32_t int_stm_load_u32(stm_tx_t *tx, volatile uint32_t *addr)
 {
   if (unlikely(((uintptr_t)addr & 0x03) != 0)) {
     uint32_t val;
-    stm_load_bytes((volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint32_t));
+    stm_load_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint32_t));
     return val;
   } else if (sizeof(stm_word_t) == 4) {
-    return (uint32_t)TM_LOAD((volatile stm_word_t *)addr);
+    return (uint32_t)TM_LOAD(tx, (volatile stm_word_t *)addr);
   } else {
     convert_64_t val;
-    val.u64 = (uint64_t)TM_LOAD((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
+    val.u64 = (uint64_t)TM_LOAD(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07));
     return val.u32[((uintptr_t)addr & 0x07) >> 2];
   }
 }
 
 static INLINE
-uint64_t int_stm_load_u64(volatile uint64_t *addr)
+uint64_t int_stm_load_u64(stm_tx_t *tx, volatile uint64_t *addr)
 {
   if (unlikely(((uintptr_t)addr & 0x07) != 0)) {
     uint64_t val;
-    stm_load_bytes((volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint64_t));
+    stm_load_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&val, sizeof(uint64_t));
     return val;
   } else if (sizeof(stm_word_t) == 4) {
     convert_64_t val;
-    val.u32[0] = (uint32_t)TM_LOAD((volatile stm_word_t *)addr);
-    val.u32[1] = (uint32_t)TM_LOAD((volatile stm_word_t *)addr + 1);
+    val.u32[0] = (uint32_t)TM_LOAD(tx, (volatile stm_word_t *)addr);
+    val.u32[1] = (uint32_t)TM_LOAD(tx, (volatile stm_word_t *)addr + 1);
     return val.u64;
   } else {
-    return (uint64_t)TM_LOAD((volatile stm_word_t *)addr);
+    return (uint64_t)TM_LOAD(tx, (volatile stm_word_t *)addr);
   }
 }
 
@@ -153,110 +159,174 @@ uint64_t int_stm_load_u64(volatile uint64_t *addr)
  * LOADS
  * ################################################################### */
 
+_CALLCONV uint8_t stm_load_u8_tx(struct stm_tx *tx, volatile uint8_t *addr)
+{
+  return int_stm_load_u8(tx, addr);
+}
+
 _CALLCONV uint8_t stm_load_u8(volatile uint8_t *addr)
 {
-  return int_stm_load_u8(addr);
+  TX_GET;
+  return stm_load_u8_tx(tx, addr);
+}
+
+_CALLCONV uint16_t stm_load_u16_tx(struct stm_tx *tx, volatile uint16_t *addr)
+{
+  return int_stm_load_u16(tx, addr);
 }
 
 _CALLCONV uint16_t stm_load_u16(volatile uint16_t *addr)
 {
-  return int_stm_load_u16(addr);
+  TX_GET;
+  return stm_load_u16_tx(tx, addr);
+}
+
+_CALLCONV uint32_t stm_load_u32_tx(struct stm_tx *tx, volatile uint32_t *addr)
+{
+  return int_stm_load_u32(tx, addr);
 }
 
 _CALLCONV uint32_t stm_load_u32(volatile uint32_t *addr)
 {
-  return int_stm_load_u32(addr);
+  TX_GET;
+  return stm_load_u32_tx(tx, addr);
+}
+
+_CALLCONV uint64_t stm_load_u64_tx(struct stm_tx *tx, volatile uint64_t *addr)
+{
+  return int_stm_load_u64(tx, addr);
 }
 
 _CALLCONV uint64_t stm_load_u64(volatile uint64_t *addr)
 {
-  return int_stm_load_u64(addr);
+  TX_GET;
+  return stm_load_u64_tx(tx, addr);
 }
 
-_CALLCONV char stm_load_char(volatile char *addr)
+_CALLCONV char stm_load_char_tx(struct stm_tx *tx, volatile char *addr)
 {
   convert_8_t val;
-  val.u8 = int_stm_load_u8((volatile uint8_t *)addr);
+  val.u8 = int_stm_load_u8(tx, (volatile uint8_t *)addr);
   return val.s8;
 }
 
+_CALLCONV char stm_load_char(volatile char *addr)
+{
+  TX_GET;
+  return stm_load_char_tx(tx, addr);
+}
+
+_CALLCONV unsigned char stm_load_uchar_tx(struct stm_tx *tx, volatile unsigned char *addr)
+{
+  return (unsigned char)int_stm_load_u8(tx, (volatile uint8_t *)addr);
+}
+
 _CALLCONV unsigned char stm_load_uchar(volatile unsigned char *addr)
 {
-  return (unsigned char)int_stm_load_u8((volatile uint8_t *)addr);
+  TX_GET;
+  return stm_load_uchar_tx(tx, addr);
 }
 
-_CALLCONV short stm_load_short(volatile short *addr)
+_CALLCONV short stm_load_short_tx(struct stm_tx *tx, volatile short *addr)
 {
   convert_16_t val;
-  val.u16 = int_stm_load_u16((volatile uint16_t *)addr);
+  val.u16 = int_stm_load_u16(tx, (volatile uint16_t *)addr);
   return val.s16;
 }
 
+_CALLCONV short stm_load_short(volatile short *addr)
+{
+  TX_GET;
+  return stm_load_short_tx(tx, addr);
+}
+
+_CALLCONV unsigned short stm_load_ushort_tx(struct stm_tx *tx, volatile unsigned short *addr)
+{
+  return (unsigned short)int_stm_load_u16(tx, (volatile uint16_t *)addr);
+}
+
 _CALLCONV unsigned short stm_load_ushort(volatile unsigned short *addr)
 {
-  return (unsigned short)int_stm_load_u16((volatile uint16_t *)addr);
+  TX_GET;
+  return stm_load_ushort_tx(tx, addr);
 }
 
-_CALLCONV int stm_load_int(volatile int *addr)
+_CALLCONV int stm_load_int_tx(struct stm_tx *tx, volatile int *addr)
 {
   convert_32_t val;
-  val.u32 = int_stm_load_u32((volatile uint32_t *)addr);
+  val.u32 = int_stm_load_u32(tx, (volatile uint32_t *)addr);
   return val.s32;
 }
 
+_CALLCONV int stm_load_int(volatile int *addr)
+{
+  TX_GET;
+  return stm_load_int_tx(tx, addr);
+}
+
+_CALLCONV unsigned int stm_load_uint_tx(struct stm_tx *tx, volatile unsigned int *addr)
+{
+  return (unsigned int)int_stm_load_u32(tx, (volatile uint32_t *)addr);
+}
+
 _CALLCONV unsigned int stm_load_uint(volatile unsigned int *addr)
 {
-  return (unsigned int)int_stm_load_u32((volatile uint32_t *)addr);
+  TX_GET;
+  return stm_load_uint_tx(tx, addr);
 }
 
 _CALLCONV long stm_load_long(volatile long *addr)
 {
-  if (sizeof(long) == 4) {
-    convert_32_t val;
-    val.u32 = int_stm_load_u32((volatile uint32_t *)addr);
-    return val.s32;
-  } else {
-    convert_64_t val;
-    val.u64 = int_stm_load_u64((volatile uint64_t *)addr);
-    return val.s64;
-  }
+  TX_GET;
+  return stm_load_long_tx(tx, addr);
 }
 
 _CALLCONV unsigned long stm_load_ulong(volatile unsigned long *addr)
 {
-  if (sizeof(long) == 4) {
-    return (unsigned long)int_stm_load_u32((volatile uint32_t *)addr);
-  } else {
-    return (unsigned long)int_stm_load_u64((volatile uint64_t *)addr);
-  }
+  TX_GET;
+  return stm_load_ulong_tx(tx, addr);
 }
 
-_CALLCONV float stm_load_float(volatile float *addr)
+_CALLCONV float stm_load_float_tx(struct stm_tx *tx, volatile float *addr)
 {
   convert_32_t val;
-  val.u32 = int_stm_load_u32((volatile uint32_t *)addr);
+  val.u32 = int_stm_load_u32(tx, (volatile uint32_t *)addr);
   return val.f;
 }
 
-_CALLCONV double stm_load_double(volatile double *addr)
+_CALLCONV float stm_load_float(volatile float *addr)
+{
+  TX_GET;
+  return stm_load_float_tx(tx, addr);
+}
+
+_CALLCONV double stm_load_double_tx(struct stm_tx *tx, volatile double *addr)
 {
   convert_64_t val;
-  val.u64 = int_stm_load_u64((volatile uint64_t *)addr);
+  val.u64 = int_stm_load_u64(tx, (volatile uint64_t *)addr);
   return val.d;
 }
 
+_CALLCONV double stm_load_double(volatile double *addr)
+{
+  TX_GET;
+  return stm_load_double_tx(tx, addr);
+}
+
 _CALLCONV void *stm_load_ptr(volatile void **addr)
 {
-  union { stm_word_t w; void *v; } convert;
-  convert.w = TM_LOAD((stm_word_t *)addr);
-  return convert.v;
+  TX_GET;
+  return stm_load_ptr_tx(tx, addr);
 }
 
-_CALLCONV void stm_load_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size)
+_CALLCONV void stm_load_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t *buf, size_t size)
 {
   convert_t val;
   unsigned int i;
   stm_word_t *a;
+#ifdef ALLOW_MISALIGNED_ACCESSES
+  size_t n;
+#endif /* ALLOW_MISALIGNED_ACCESSES */
 
   if (size == 0)
     return;
@@ -264,102 +334,111 @@ _CALLCONV void stm_load_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size)
   if (i != 0) {
     /* First bytes */
     a = (stm_word_t *)((uintptr_t)addr & ~(uintptr_t)(sizeof(stm_word_t) - 1));
-    val.w = TM_LOAD(a++);
+    val.w = TM_LOAD(tx, a++);
     for (; i < sizeof(stm_word_t) && size > 0; i++, size--)
       *buf++ = val.b[i];
   } else
     a = (stm_word_t *)addr;
   /* Full words */
-  while (size >= sizeof(stm_word_t)) {
 #ifdef ALLOW_MISALIGNED_ACCESSES
-    *((stm_word_t *)buf) = TM_LOAD(a++);
-    buf += sizeof(stm_word_t);
+  n = size / sizeof(stm_word_t);
+  TM_LOAD_RANGE(tx, a, (stm_word_t *)buf, n);
+  a += n;
+  buf += n * sizeof(stm_word_t);
+  size -= n * sizeof(stm_word_t);
 #else /* ! ALLOW_MISALIGNED_ACCESSES */
-    val.w = TM_LOAD(a++);
+  while (size >= sizeof(stm_word_t)) {
+    val.w = TM_LOAD(tx, a++);
     for (i = 0; i < sizeof(stm_word_t); i++)
       *buf++ = val.b[i];
-#endif /* ! ALLOW_MISALIGNED_ACCESSES */
     size -= sizeof(stm_word_t);
   }
+#endif /* ! ALLOW_MISALIGNED_ACCESSES */
   if (size > 0) {
     /* Last bytes */
-    val.w = TM_LOAD(a);
+    val.w = TM_LOAD(tx, a);
     i = 0;
     for (i = 0; size > 0; i++, size--)
       *buf++ = val.b[i];
   }
 }
 
+_CALLCONV void stm_load_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size)
+{
+  TX_GET;
+  stm_load_bytes_tx(tx, addr, buf, size);
+}
+
 /* ################################################################### *
  * INLINE STORES
  * ################################################################### */
 
 static INLINE
-void int_stm_store_u8(volatile uint8_t *addr, uint8_t value)
+void int_stm_store_u8(stm_tx_t *tx, volatile uint8_t *addr, uint8_t value)
 {
   if (sizeof(stm_word_t) == 4) {
     convert_32_t val, mask;
     val.u8[(uintptr_t)addr & 0x03] = value;
     mask.u32 = 0;
     mask.u8[(uintptr_t)addr & 0x03] = ~(uint8_t)0;
-    TM_STORE2((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03), (stm_word_t)val.u32, (stm_word_t)mask.u32);
+    TM_STORE2(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03), (stm_word_t)val.u32, (stm_word_t)mask.u32);
   } else {
     convert_64_t val, mask;
     val.u8[(uintptr_t)addr & 0x07] = value;
     mask.u64 = 0;
     mask.u8[(uintptr_t)addr & 0x07] = ~(uint8_t)0;
-    TM_STORE2((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
+    TM_STORE2(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
   }
 }
 
 static INLINE
-void int_stm_store_u16(volatile uint16_t *addr, uint16_t value)
+void int_stm_store_u16(stm_tx_t *tx, volatile uint16_t *addr, uint16_t value)
 {
   if (unlikely(((uintptr_t)addr & 0x01) != 0)) {
-    stm_store_bytes((volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint16_t));
+    stm_store_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint16_t));
   } else if (sizeof(stm_word_t) == 4) {
     convert_32_t val, mask;
     val.u16[((uintptr_t)addr & 0x03) >> 1] = value;
     mask.u32 = 0;
     mask.u16[((uintptr_t)addr & 0x03) >> 1] = ~(uint16_t)0;
-    TM_STORE2((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03), (stm_word_t)val.u32, (stm_word_t)mask.u32);
+    TM_STORE2(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x03), (stm_word_t)val.u32, (stm_word_t)mask.u32);
   } else {
     convert_64_t val, mask;
     val.u16[((uintptr_t)addr & 0x07) >> 1] = value;
     mask.u64 = 0;
     mask.u16[((uintptr_t)addr & 0x07) >> 1] = ~(uint16_t)0;
-    TM_STORE2((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
+    TM_STORE2(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
   }
 }
 
 static INLINE
-void int_stm_store_u32(volatile uint32_t *addr, uint32_t value)
+void int_stm_store_u32(stm_tx_t *tx, volatile uint32_t *addr, uint32_t value)
 {
   if (unlikely(((uintptr_t)addr & 0x03) != 0)) {
-    stm_store_bytes((volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint32_t));
+    stm_store_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint32_t));
   } else if (sizeof(stm_word_t) == 4) {
-    TM_STORE((volatile stm_word_t *)addr, (stm_word_t)value);
+    TM_STORE(tx, (volatile stm_word_t *)addr, (stm_word_t)value);
   } else {
     convert_64_t val, mask;
     val.u32[((uintptr_t)addr & 0x07) >> 2] = value;
     mask.u64 = 0;
     mask.u32[((uintptr_t)addr & 0x07) >> 2] = ~(uint32_t)0;
-    TM_STORE2((volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
+    TM_STORE2(tx, (volatile stm_word_t *)((uintptr_t)addr & ~(uintptr_t)0x07), (stm_word_t)val.u64, (stm_word_t)mask.u64);
   }
 }
 
 static INLINE
-void int_stm_store_u64(volatile uint64_t *addr, uint64_t value)
+void int_stm_store_u64(stm_tx_t *tx, volatile uint64_t *addr, uint64_t value)
 {
   if (unlikely(((uintptr_t)addr & 0x07) != 0)) {
-    stm_store_bytes((volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint64_t));
+    stm_store_bytes_tx(tx, (volatile uint8_t *)addr, (uint8_t *)&value, sizeof(uint64_t));
   } else if (sizeof(stm_word_t) == 4) {
     convert_64_t val;
     val.u64 = value;
-    TM_STORE((volatile stm_word_t *)addr, (stm_word_t)val.u32[0]);
-    TM_STORE((volatile stm_word_t *)addr + 1, (stm_word_t)val.u32[1]);
+    TM_STORE(tx, (volatile stm_word_t *)addr, (stm_word_t)val.u32[0]);
+    TM_STORE(tx, (volatile stm_word_t *)addr + 1, (stm_word_t)val.u32[1]);
   } else {
-    return TM_STORE((volatile stm_word_t *)addr, (stm_word_t)value);
+    return TM_STORE(tx, (volatile stm_word_t *)addr, (stm_word_t)value);
   }
 }
 
@@ -367,110 +446,174 @@ void int_stm_store_u64(volatile uint64_t *addr, uint64_t value)
  * STORES
  * ################################################################### */
 
+_CALLCONV void stm_store_u8_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t value)
+{
+  int_stm_store_u8(tx, addr, value);
+}
+
 _CALLCONV void stm_store_u8(volatile uint8_t *addr, uint8_t value)
 {
-  int_stm_store_u8(addr, value);
+  TX_GET;
+  stm_store_u8_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_u16_tx(struct stm_tx *tx, volatile uint16_t *addr, uint16_t value)
+{
+  int_stm_store_u16(tx, addr, value);
 }
 
 _CALLCONV void stm_store_u16(volatile uint16_t *addr, uint16_t value)
 {
-  int_stm_store_u16(addr, value);
+  TX_GET;
+  stm_store_u16_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_u32_tx(struct stm_tx *tx, volatile uint32_t *addr, uint32_t value)
+{
+  int_stm_store_u32(tx, addr, value);
 }
 
 _CALLCONV void stm_store_u32(volatile uint32_t *addr, uint32_t value)
 {
-  int_stm_store_u32(addr, value);
+  TX_GET;
+  stm_store_u32_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_u64_tx(struct stm_tx *tx, volatile uint64_t *addr, uint64_t value)
+{
+  int_stm_store_u64(tx, addr, value);
 }
 
 _CALLCONV void stm_store_u64(volatile uint64_t *addr, uint64_t value)
 {
-  int_stm_store_u64(addr, value);
+  TX_GET;
+  stm_store_u64_tx(tx, addr, value);
 }
 
-_CALLCONV void stm_store_char(volatile char *addr, char value)
+_CALLCONV void stm_store_char_tx(struct stm_tx *tx, volatile char *addr, char value)
 {
   convert_8_t val;
   val.s8 = value;
-  int_stm_store_u8((volatile uint8_t *)addr, val.u8);
+  int_stm_store_u8(tx, (volatile uint8_t *)addr, val.u8);
+}
+
+_CALLCONV void stm_store_char(volatile char *addr, char value)
+{
+  TX_GET;
+  stm_store_char_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_uchar_tx(struct stm_tx *tx, volatile unsigned char *addr, unsigned char value)
+{
+  int_stm_store_u8(tx, (volatile uint8_t *)addr, (uint8_t)value);
 }
 
 _CALLCONV void stm_store_uchar(volatile unsigned char *addr, unsigned char value)
 {
-  int_stm_store_u8((volatile uint8_t *)addr, (uint8_t)value);
+  TX_GET;
+  stm_store_uchar_tx(tx, addr, value);
 }
 
-_CALLCONV void stm_store_short(volatile short *addr, short value)
+_CALLCONV void stm_store_short_tx(struct stm_tx *tx, volatile short *addr, short value)
 {
   convert_16_t val;
   val.s16 = value;
-  int_stm_store_u16((volatile uint16_t *)addr, val.u16);
+  int_stm_store_u16(tx, (volatile uint16_t *)addr, val.u16);
+}
+
+_CALLCONV void stm_store_short(volatile short *addr, short value)
+{
+  TX_GET;
+  stm_store_short_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_ushort_tx(struct stm_tx *tx, volatile unsigned short *addr, unsigned short value)
+{
+  int_stm_store_u16(tx, (volatile uint16_t *)addr, (uint16_t)value);
 }
 
 _CALLCONV void stm_store_ushort(volatile unsigned short *addr, unsigned short value)
 {
-  int_stm_store_u16((volatile uint16_t *)addr, (uint16_t)value);
+  TX_GET;
+  stm_store_ushort_tx(tx, addr, value);
 }
 
-_CALLCONV void stm_store_int(volatile int *addr, int value)
+_CALLCONV void stm_store_int_tx(struct stm_tx *tx, volatile int *addr, int value)
 {
   convert_32_t val;
   val.s32 = value;
-  int_stm_store_u32((volatile uint32_t *)addr, val.u32);
+  int_stm_store_u32(tx, (volatile uint32_t *)addr, val.u32);
+}
+
+_CALLCONV void stm_store_int(volatile int *addr, int value)
+{
+  TX_GET;
+  stm_store_int_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_uint_tx(struct stm_tx *tx, volatile unsigned int *addr, unsigned int value)
+{
+  int_stm_store_u32(tx, (volatile uint32_t *)addr, (uint32_t)value);
 }
 
 _CALLCONV void stm_store_uint(volatile unsigned int *addr, unsigned int value)
 {
-  int_stm_store_u32((volatile uint32_t *)addr, (uint32_t)value);
+  TX_GET;
+  stm_store_uint_tx(tx, addr, value);
 }
 
 _CALLCONV void stm_store_long(volatile long *addr, long value)
 {
-  if (sizeof(long) == 4) {
-    convert_32_t val;
-    val.s32 = value;
-    int_stm_store_u32((volatile uint32_t *)addr, val.u32);
-  } else {
-    convert_64_t val;
-    val.s64 = value;
-    int_stm_store_u64((volatile uint64_t *)addr, val.u64);
-  }
+  TX_GET;
+  stm_store_long_tx(tx, addr, value);
 }
 
 _CALLCONV void stm_store_ulong(volatile unsigned long *addr, unsigned long value)
 {
-  if (sizeof(long) == 4) {
-    int_stm_store_u32((volatile uint32_t *)addr, (uint32_t)value);
-  } else {
-    int_stm_store_u64((volatile uint64_t *)addr, (uint64_t)value);
-  }
+  TX_GET;
+  stm_store_ulong_tx(tx, addr, value);
 }
 
-_CALLCONV void stm_store_float(volatile float *addr, float value)
+_CALLCONV void stm_store_float_tx(struct stm_tx *tx, volatile float *addr, float value)
 {
   convert_32_t val;
   val.f = value;
-  int_stm_store_u32((volatile uint32_t *)addr, val.u32);
+  int_stm_store_u32(tx, (volatile uint32_t *)addr, val.u32);
 }
 
-_CALLCONV void stm_store_double(volatile double *addr, double value)
+_CALLCONV void stm_store_float(volatile float *addr, float value)
+{
+  TX_GET;
+  stm_store_float_tx(tx, addr, value);
+}
+
+_CALLCONV void stm_store_double_tx(struct stm_tx *tx, volatile double *addr, double value)
 {
   convert_64_t val;
   val.d = value;
-  int_stm_store_u64((volatile uint64_t *)addr, val.u64);
+  int_stm_store_u64(tx, (volatile uint64_t *)addr, val.u64);
+}
+
+_CALLCONV void stm_store_double(volatile double *addr, double value)
+{
+  TX_GET;
+  stm_store_double_tx(tx, addr, value);
 }
 
 _CALLCONV void stm_store_ptr(volatile void **addr, void *value)
 {
-  union { stm_word_t w; void *v; } convert;
-  convert.v = value;
-  TM_STORE((stm_word_t *)addr, convert.w);
+  TX_GET;
+  stm_store_ptr_tx(tx, addr, value);
 }
 
-_CALLCONV void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size)
+_CALLCONV void stm_store_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t *buf, size_t size)
 {
   convert_t val, mask;
   unsigned int i;
   stm_word_t *a;
+#ifdef ALLOW_MISALIGNED_ACCESSES
+  size_t n;
+#endif /* ALLOW_MISALIGNED_ACCESSES */
 
   if (size == 0)
     return;
@@ -483,21 +626,24 @@ _CALLCONV void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size
       mask.b[i] = 0xFF;
       val.b[i] = *buf++;
     }
-    TM_STORE2(a++, val.w, mask.w);
+    TM_STORE2(tx, a++, val.w, mask.w);
   } else
     a = (stm_word_t *)addr;
   /* Full words */
-  while (size >= sizeof(stm_word_t)) {
 #ifdef ALLOW_MISALIGNED_ACCESSES
-    TM_STORE(a++, *((stm_word_t *)buf));
-    buf += sizeof(stm_word_t);
+  n = size / sizeof(stm_word_t);
+  TM_STORE_RANGE(tx, a, (stm_word_t *)buf, n);
+  a += n;
+  buf += n * sizeof(stm_word_t);
+  size -= n * sizeof(stm_word_t);
 #else /* ! ALLOW_MISALIGNED_ACCESSES */
+  while (size >= sizeof(stm_word_t)) {
     for (i = 0; i < sizeof(stm_word_t); i++)
       val.b[i] = *buf++;
-    TM_STORE(a++, val.w);
-#endif /* ! ALLOW_MISALIGNED_ACCESSES */
+    TM_STORE(tx, a++, val.w);
     size -= sizeof(stm_word_t);
   }
+#endif /* ! ALLOW_MISALIGNED_ACCESSES */
   if (size > 0) {
     /* Last bytes */
     val.w = mask.w = 0;
@@ -505,11 +651,17 @@ _CALLCONV void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size
       mask.b[i] = 0xFF;
       val.b[i] = *buf++;
     }
-    TM_STORE2(a, val.w, mask.w);
+    TM_STORE2(tx, a, val.w, mask.w);
   }
 }
 
-_CALLCONV void stm_set_bytes(volatile uint8_t *addr, uint8_t byte, size_t count)
+_CALLCONV void stm_store_bytes(volatile uint8_t *addr, uint8_t *buf, size_t size)
+{
+  TX_GET;
+  stm_store_bytes_tx(tx, addr, buf, size);
+}
+
+_CALLCONV void stm_set_bytes_tx(struct stm_tx *tx, volatile uint8_t *addr, uint8_t byte, size_t count)
 {
   convert_t val, mask;
   unsigned int i;
@@ -528,12 +680,12 @@ _CALLCONV void stm_set_bytes(volatile uint8_t *addr, uint8_t byte, size_t count)
     mask.w = 0;
     for (; i < sizeof(stm_word_t) && count > 0; i++, count--)
       mask.b[i] = 0xFF;
-    TM_STORE2(a++, val.w, mask.w);
+    TM_STORE2(tx, a++, val.w, mask.w);
   } else
     a = (stm_word_t *)addr;
   /* Full words */
   while (count >= sizeof(stm_word_t)) {
-    TM_STORE(a++, val.w);
+    TM_STORE(tx, a++, val.w);
     count -= sizeof(stm_word_t);
   }
   if (count > 0) {
@@ -541,11 +693,51 @@ _CALLCONV void stm_set_bytes(volatile uint8_t *addr, uint8_t byte, size_t count)
     mask.w = 0;
     for (i = 0; count > 0; i++, count--)
       mask.b[i] = 0xFF;
-    TM_STORE2(a, val.w, mask.w);
+    TM_STORE2(tx, a, val.w, mask.w);
   }
 }
 
+_CALLCONV void stm_set_bytes(volatile uint8_t *addr, uint8_t byte, size_t count)
+{
+  TX_GET;
+  stm_set_bytes_tx(tx, addr, byte, count);
+}
+
+_CALLCONV void stm_move_bytes_tx(struct stm_tx *tx, volatile uint8_t *dst, volatile uint8_t *src, size_t size)
+{
+  uint8_t buf[MOVE_BUFFER_SIZE];
+  size_t n;
+
+  if (dst <= src || dst >= src + size) {
+    /* Copy forward (reads see previous writes of the transaction) */
+    while (size > 0) {
+      n = (size < MOVE_BUFFER_SIZE ? size : MOVE_BUFFER_SIZE);
+      stm_load_bytes_tx(tx, src, buf, n);
+      stm_store_bytes_tx(tx, dst, buf, n);
+      src += n;
+      dst += n;
+      size -= n;
+    }
+  } else {
+    /* Overlapping with destination after source: copy backward */
+    while (size > 0) {
+      n = (size < MOVE_BUFFER_SIZE ? size : MOVE_BUFFER_SIZE);
+      size -= n;
+      stm_load_bytes_tx(tx, src + size, buf, n);
+      stm_store_bytes_tx(tx, dst + size, buf, n);
+    }
+  }
+}
+
+_CALLCONV void stm_move_bytes(volatile uint8_t *dst, volatile uint8_t *src, size_t size)
+{
+  TX_GET;
+  stm_move_bytes_tx(tx, dst, src, size);
+}
+
 #undef TM_LOAD
 #undef TM_STORE
 #undef TM_STORE2
+#undef TM_LOAD_RANGE
+#undef TM_STORE_RANGE
 
@@ -23,13 +23,19 @@
  * under the terms of the MIT license.
  */
 
+#include "../bench.h"
+
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -62,6 +68,8 @@ void perror(const char *s);
 
 #include "stm.h"
 #include "mod_ab.h"
+#include "mod_inc.h"
+#include "mod_trace.h"
 
 /*
  * Useful macros to work with transactions. Note that, to use nested
@@ -73,8 +81,9 @@ void perror(const char *s);
 #define TM_LOAD(addr)                   stm_load((stm_word_t *)addr)
 #define TM_STORE(addr, value)           stm_store((stm_word_t *)addr, (stm_word_t)value)
 #define TM_COMMIT                       stm_commit(); }
+#define TM_INC(addr, delta)             stm_inc((stm_word_t *)addr, (stm_word_t)delta)
 
-#define TM_INIT                         stm_init(); mod_ab_init(0, NULL)
+#define TM_INIT                         stm_init(); mod_ab_init(0, NULL); mod_inc_init()
 #define TM_EXIT                         stm_exit()
 #define TM_INIT_THREAD                  stm_init_thread()
 #define TM_EXIT_THREAD                  stm_exit_thread()
@@ -90,6 +99,13 @@ void perror(const char *s);
 #define DEFAULT_READ_THREADS            0
 #define DEFAULT_WRITE_THREADS           0
 #define DEFAULT_DISJOINT                0
+#define DEFAULT_DISTRIBUTION            "uniform"
+#define DEFAULT_ZIPF_THETA              0.99
+#define DEFAULT_HOT_ACCOUNTS            10
+#define DEFAULT_HOT_RATE                90
+#define DEFAULT_BATCH                   1
+#define DEFAULT_INTERVAL                0
+#define DEFAULT_COUNTER                 0
 
 #define XSTR(s)                         STR(s)
 #define STR(s)                          #s
@@ -99,6 +115,263 @@ void perror(const char *s);
  * ################################################################### */
 
 static volatile int stop;
+static volatile int caught;
+
+/* ################################################################### *
+ * GLOBAL COUNTER
+ * ################################################################### */
+
+enum {
+  COUNTER_NONE,                         /* No counter */
+  COUNTER_RMW,                          /* Read-modify-write in each update transaction */
+  COUNTER_INC                           /* Commutative increment (mod_inc) */
+};
+
+static int counter_mode = DEFAULT_COUNTER;
+static long counter;                    /* Number of update transactions */
+
+static inline void count(void)
+{
+  long c;
+
+  if (counter_mode == COUNTER_RMW) {
+    c = TM_LOAD(&counter);
+    TM_STORE(&counter, c + 1);
+  }
+#ifndef TM_COMPILER
+  else if (counter_mode == COUNTER_INC)
+    TM_INC(&counter, 1);
+#endif /* ! TM_COMPILER */
+}
+
+/* ################################################################### *
+ * ACCOUNT DISTRIBUTION
+ * ################################################################### */
+
+enum {
+  DIST_UNIFORM,
+  DIST_ZIPF,
+  DIST_HOTSPOT
+};
+
+typedef struct dist {
+  int type;
+  long range;
+  /* Zipf: cumulative probabilities of ranks (rank 0 is the most popular) */
+  double theta;
+  double *cdf;
+  /* Hotspot: hot_rate percent of accesses go to the first hot_accounts percent of accounts */
+  int hot_accounts;
+  int hot_rate;
+  long hot;
+} dist_t;
+
+/* Parse "uniform", "zipf[:<theta>]" or "hotspot[:<accounts>[:<rate>]]" */
+static int dist_parse(dist_t *d, const char *s)
+{
+  char *e;
+
+  d->theta = DEFAULT_ZIPF_THETA;
+  d->hot_accounts = DEFAULT_HOT_ACCOUNTS;
+  d->hot_rate = DEFAULT_HOT_RATE;
+  if (strcmp(s, "uniform") == 0) {
+    d->type = DIST_UNIFORM;
+  } else if (strncmp(s, "zipf", 4) == 0 && (s[4] == '\0' || s[4] == ':')) {
+    d->type = DIST_ZIPF;
+    if (s[4] == ':') {
+      d->theta = strtod(s + 5, &e);
+      if (*e != '\0' || d->theta <= 0)
+        return 0;
+    }
+  } else if (strncmp(s, "hotspot", 7) == 0 && (s[7] == '\0' || s[7] == ':')) {
+    d->type = DIST_HOTSPOT;
+    if (s[7] == ':') {
+      d->hot_accounts = (int)strtol(s + 8, &e, 10);
+      if (*e == ':')
+        d->hot_rate = (int)strtol(e + 1, &e, 10);
+      if (*e != '\0' || d->hot_accounts <= 0 || d->hot_accounts > 100 || d->hot_rate < 0 || d->hot_rate > 100)
+        return 0;
+    }
+  } else
+    return 0;
+  return 1;
+}
+
+static const char *dist_name(dist_t *d)
+{
+  return d->type == DIST_ZIPF ? "zipf" : (d->type == DIST_HOTSPOT ? "hotspot" : "uniform");
+}
+
+/* Prepare for picking accounts in [0, range) */
+static void dist_init(dist_t *d, long range)
+{
+  long i;
+  double sum;
+
+  d->range = range;
+  d->cdf = NULL;
+  if (d->type == DIST_ZIPF) {
+    if ((d->cdf = (double *)malloc(range * sizeof(double))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    sum = 0;
+    for (i = 0; i < range; i++) {
+      sum += 1.0 / pow((double)(i + 1), d->theta);
+      d->cdf[i] = sum;
+    }
+    for (i = 0; i < range; i++)
+      d->cdf[i] /= sum;
+  } else if (d->type == DIST_HOTSPOT) {
+    d->hot = range * d->hot_accounts / 100;
+    if (d->hot < 1)
+      d->hot = 1;
+  }
+}
+
+static void dist_exit(dist_t *d)
+{
+  free(d->cdf);
+}
+
+static long dist_next(dist_t *d, unsigned short *seed)
+{
+  long lo, hi, mid;
+  double u;
+
+  u = erand48(seed);
+  switch (d->type) {
+   case DIST_ZIPF:
+     /* Smallest rank with cumulative probability above u */
+     lo = 0;
+     hi = d->range - 1;
+     while (lo < hi) {
+       mid = (lo + hi) / 2;
+       if (d->cdf[mid] <= u)
+         lo = mid + 1;
+       else
+         hi = mid;
+     }
+     return lo;
+   case DIST_HOTSPOT:
+     if (d->hot == d->range || u * 100 < d->hot_rate)
+       return (long)(erand48(seed) * d->hot);
+     return d->hot + (long)(erand48(seed) * (d->range - d->hot));
+   default:
+     return (long)(u * d->range);
+  }
+}
+
+/* ################################################################### *
+ * LATENCY HISTOGRAMS
+ * ################################################################### */
+
+enum {
+  OP_TRANSFER,
+  OP_READ_ALL,
+  OP_WRITE_ALL,
+  NB_OPS
+};
+
+static const char *op_names[NB_OPS] = { "transfer", "read_all", "write_all" };
+
+/* Latencies (ns) below LAT_SUB have their own bucket, larger ones share
+ * LAT_SUB buckets per power of two (relative error below 1/LAT_SUB) */
+#define LAT_SUB_BITS                    4
+#define LAT_SUB                         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS                     ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+typedef struct lat_stats {
+  unsigned long samples;
+  double mean;
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+} lat_stats_t;
+
+static inline uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int lat_bucket(uint64_t v)
+{
+  int k;
+
+  if (v < LAT_SUB)
+    return (int)v;
+  k = 63 - __builtin_clzll(v);
+  return (k - LAT_SUB_BITS + 1) * LAT_SUB + (int)((v >> (k - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Middle of bucket */
+static uint64_t lat_value(int i)
+{
+  int k;
+
+  if (i < LAT_SUB)
+    return i;
+  k = i / LAT_SUB + LAT_SUB_BITS - 1;
+  return ((uint64_t)(LAT_SUB + i % LAT_SUB) << (k - LAT_SUB_BITS)) + (((uint64_t)1 << (k - LAT_SUB_BITS)) >> 1);
+}
+
+static uint64_t lat_percentile(const unsigned long *h, unsigned long samples, double p)
+{
+  unsigned long n, rank;
+  int i;
+
+  if (samples == 0)
+    return 0;
+  rank = (unsigned long)ceil(p * samples);
+  if (rank == 0)
+    rank = 1;
+  for (i = 0, n = 0; i < LAT_BUCKETS; i++) {
+    n += h[i];
+    if (n >= rank)
+      return lat_value(i);
+  }
+  return lat_value(LAT_BUCKETS - 1);
+}
+
+static void lat_summary(const unsigned long *h, uint64_t sum, uint64_t max, lat_stats_t *s)
+{
+  int i;
+
+  s->samples = 0;
+  for (i = 0; i < LAT_BUCKETS; i++)
+    s->samples += h[i];
+  s->mean = (s->samples == 0 ? 0 : (double)sum / s->samples);
+  s->p50 = lat_percentile(h, s->samples, 0.5);
+  s->p99 = lat_percentile(h, s->samples, 0.99);
+  s->p999 = lat_percentile(h, s->samples, 0.999);
+  s->max = max;
+}
+
+/* ################################################################### *
+ * JSON OUTPUT
+ * ################################################################### */
+
+static void json_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', f);
+    if ((unsigned char)*s >= 0x20)
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+static void json_lat(FILE *f, lat_stats_t *s)
+{
+  fprintf(f, "{\"samples\": %lu, \"mean\": %.1f, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}",
+          s->samples, s->mean, (unsigned long)s->p50, (unsigned long)s->p99, (unsigned long)s->p999, (unsigned long)s->max);
+}
 
 /* ################################################################### *
  * BANK ACCOUNTS
@@ -126,11 +399,33 @@ static int transfer(account_t *src, account_t *dst, int amount)
   i = TM_LOAD(&dst->balance);
   i += amount;
   TM_STORE(&dst->balance, i);
+  count();
   TM_COMMIT;
 
   return amount;
 }
 
+/* Several transfers in one transaction */
+static int transfer_batch(bank_t *bank, long *src, long *dst, int nb, int amount)
+{
+  long i;
+  int j;
+
+  TM_START(3, RW);
+  for (j = 0; j < nb; j++) {
+    i = TM_LOAD(&bank->accounts[src[j]].balance);
+    i -= amount;
+    TM_STORE(&bank->accounts[src[j]].balance, i);
+    i = TM_LOAD(&bank->accounts[dst[j]].balance);
+    i += amount;
+    TM_STORE(&bank->accounts[dst[j]].balance, i);
+  }
+  count();
+  TM_COMMIT;
+
+  return amount * nb;
+}
+
 static int total(bank_t *bank, int transactional)
 {
   long i, total;
@@ -208,6 +503,7 @@ typedef struct thread_data {
   unsigned long nb_transfer;
   unsigned long nb_read_all;
   unsigned long nb_write_all;
+  unsigned long nb_counted;             /* Update transactions including warm-up */
 #ifndef TM_COMPILER
   unsigned long nb_aborts;
   unsigned long nb_aborts_1;
@@ -222,9 +518,17 @@ typedef struct thread_data {
   unsigned long locked_reads_ok;
   unsigned long locked_reads_failed;
   unsigned long max_retries;
+  bench_stats_t base;                   /* Statistics at end of warm-up */
 #endif /* ! TM_COMPILER */
+  /* Latency histograms (ns), when enabled */
+  unsigned long lat[NB_OPS][LAT_BUCKETS];
+  uint64_t lat_sum[NB_OPS];
+  uint64_t lat_max[NB_OPS];
+  dist_t *dist;
   unsigned int seed;
   int id;
+  int batch;
+  int latency;
   int read_all;
   int read_threads;
   int write_all;
@@ -234,10 +538,30 @@ typedef struct thread_data {
   char padding[64];
 } thread_data_t;
 
+static thread_data_t *threads_data;
+static int threads_nb;
+
+/* Operations performed so far by all threads (read without synchronization) */
+static unsigned long count_txs(void)
+{
+  volatile thread_data_t *d;
+  unsigned long txs;
+  int i;
+
+  txs = 0;
+  for (i = 0; i < threads_nb; i++) {
+    d = &threads_data[i];
+    txs += d->nb_transfer + d->nb_read_all + d->nb_write_all;
+  }
+  return txs;
+}
+
 static void *test(void *data)
 {
-  int src, dst, nb;
-  int rand_max, rand_min;
+  long src, dst, *srcs, *dsts;
+  int nb, op, i, measuring;
+  long rand_max, rand_min;
+  uint64_t t0, t;
   thread_data_t *d = (thread_data_t *)data;
   unsigned short seed[3];
 
@@ -246,6 +570,17 @@ static void *test(void *data)
   seed[1] = (unsigned short)rand_r(&d->seed);
   seed[2] = (unsigned short)rand_r(&d->seed);
 
+  bench_pin(d->id);
+  if (bench.numa_init) {
+    /* Initialize a slice of the accounts from the CPU that uses it */
+    src = d->bank->size / d->nb_threads * d->id;
+    dst = (d->id == d->nb_threads - 1 ? d->bank->size : src + d->bank->size / d->nb_threads);
+    for (; src < dst; src++) {
+      d->bank->accounts[src].number = src;
+      d->bank->accounts[src].balance = 0;
+    }
+  }
+
   /* Prepare for disjoint access */
   if (d->disjoint) {
     rand_max = d->bank->size / d->nb_threads;
@@ -259,41 +594,86 @@ static void *test(void *data)
     rand_min = 0;
   }
 
+  if ((srcs = (long *)malloc(2 * d->batch * sizeof(long))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  dsts = srcs + d->batch;
+
   /* Create transaction */
   TM_INIT_THREAD;
   /* Wait on barrier */
   barrier_cross(d->barrier);
 
+  t0 = 0;
+  measuring = 0;
   while (stop == 0) {
+    if (bench_measure(&measuring)) {
+      /* End of warm-up */
+      d->nb_transfer = d->nb_read_all = d->nb_write_all = 0;
+      memset(d->lat, 0, sizeof(d->lat));
+      memset(d->lat_sum, 0, sizeof(d->lat_sum));
+      memset(d->lat_max, 0, sizeof(d->lat_max));
+#ifndef TM_COMPILER
+      bench_get_stats(&d->base);
+#endif /* ! TM_COMPILER */
+      bench_ack();
+    }
     if (d->id < d->read_threads) {
-      /* Read all */
-      total(d->bank, 1);
-      d->nb_read_all++;
+      op = OP_READ_ALL;
     } else if (d->id < d->read_threads + d->write_threads) {
-      /* Write all */
-      reset(d->bank);
-      d->nb_write_all++;
+      op = OP_WRITE_ALL;
     } else {
       nb = (int)(erand48(seed) * 100);
-      if (nb < d->read_all) {
-        /* Read all */
-        total(d->bank, 1);
-        d->nb_read_all++;
-      } else if (nb < d->read_all + d->write_all) {
-        /* Write all */
-        reset(d->bank);
-        d->nb_write_all++;
-      } else {
-        /* Choose random accounts */
-        src = (int)(erand48(seed) * rand_max) + rand_min;
-        dst = (int)(erand48(seed) * rand_max) + rand_min;
+      if (nb < d->read_all)
+        op = OP_READ_ALL;
+      else if (nb < d->read_all + d->write_all)
+        op = OP_WRITE_ALL;
+      else
+        op = OP_TRANSFER;
+    }
+    if (op == OP_TRANSFER) {
+      /* Choose accounts (outside of the transaction) */
+      for (i = 0; i < d->batch; i++) {
+        src = dist_next(d->dist, seed);
+        dst = dist_next(d->dist, seed);
         if (dst == src)
-          dst = ((src + 1) % rand_max) + rand_min;
-        transfer(&d->bank->accounts[src], &d->bank->accounts[dst], 1);
-        d->nb_transfer++;
+          dst = (src + 1) % rand_max;
+        srcs[i] = src + rand_min;
+        dsts[i] = dst + rand_min;
       }
     }
+    if (d->latency)
+      t0 = now_ns();
+    switch (op) {
+     case OP_READ_ALL:
+       /* Read all */
+       total(d->bank, 1);
+       d->nb_read_all++;
+       break;
+     case OP_WRITE_ALL:
+       /* Write all */
+       reset(d->bank);
+       d->nb_write_all++;
+       break;
+     default:
+       if (d->batch == 1)
+         transfer(&d->bank->accounts[srcs[0]], &d->bank->accounts[dsts[0]], 1);
+       else
+         transfer_batch(d->bank, srcs, dsts, d->batch, 1);
+       d->nb_transfer++;
+       d->nb_counted++;
+       break;
+    }
+    if (d->latency) {
+      t = now_ns() - t0;
+      d->lat[op][lat_bucket(t)]++;
+      d->lat_sum[op] += t;
+      if (d->lat_max[op] < t)
+        d->lat_max[op] = t;
+    }
   }
+  free(srcs);
 #ifndef TM_COMPILER
   stm_get_stats("nb_aborts", &d->nb_aborts);
   stm_get_stats("nb_aborts_1", &d->nb_aborts_1);
@@ -308,6 +688,19 @@ static void *test(void *data)
   stm_get_stats("locked_reads_ok", &d->locked_reads_ok);
   stm_get_stats("locked_reads_failed", &d->locked_reads_failed);
   stm_get_stats("max_retries", &d->max_retries);
+  /* Exclude warm-up */
+  d->nb_aborts -= d->base.nb_aborts;
+  d->nb_aborts_1 -= d->base.nb_aborts_1;
+  d->nb_aborts_2 -= d->base.nb_aborts_2;
+  d->nb_aborts_locked_read -= d->base.nb_aborts_locked_read;
+  d->nb_aborts_locked_write -= d->base.nb_aborts_locked_write;
+  d->nb_aborts_validate_read -= d->base.nb_aborts_validate_read;
+  d->nb_aborts_validate_write -= d->base.nb_aborts_validate_write;
+  d->nb_aborts_validate_commit -= d->base.nb_aborts_validate_commit;
+  d->nb_aborts_invalid_memory -= d->base.nb_aborts_invalid_memory;
+  d->nb_aborts_killed -= d->base.nb_aborts_killed;
+  d->locked_reads_ok -= d->base.locked_reads_ok;
+  d->locked_reads_failed -= d->base.locked_reads_failed;
 #endif /* ! TM_COMPILER */
   /* Free transaction */
   TM_EXIT_THREAD;
@@ -319,6 +712,7 @@ static void catcher(int sig)
 {
   static int nb = 0;
   printf("CAUGHT SIGNAL %d\n", sig);
+  caught = 1;
   if (++nb >= 3)
     exit(1);
 }
@@ -335,17 +729,37 @@ int main(int argc, char **argv)
     {"read-all-rate",             required_argument, NULL, 'r'},
     {"read-threads",              required_argument, NULL, 'R'},
     {"seed",                      required_argument, NULL, 's'},
+    {"trace",                     required_argument, NULL, 't'},
     {"write-all-rate",            required_argument, NULL, 'w'},
     {"write-threads",             required_argument, NULL, 'W'},
     {"disjoint",                  no_argument,       NULL, 'j'},
+    {"batch",                     required_argument, NULL, 'b'},
+    {"distribution",              required_argument, NULL, 'D'},
+    {"interval",                  required_argument, NULL, 'i'},
+    {"json",                      required_argument, NULL, 'J'},
+    {"latency",                   no_argument,       NULL, 'l'},
+    {"counter",                   required_argument, NULL, 'g'},
+    BENCH_LONG_OPTIONS
     {NULL, 0, NULL, 0}
   };
 
   bank_t *bank;
-  int i, c, ret;
-  unsigned long reads, writes, updates;
+  int i, j, c, ret;
+  unsigned long reads, writes, updates, counted;
+  unsigned long (*lat)[LAT_BUCKETS], (*lat_prev)[LAT_BUCKETS], *lat_diff;
+  uint64_t lat_sum[NB_OPS], lat_max[NB_OPS];
+  lat_stats_t lat_stats;
+  unsigned long txs, txs_prev, nb_intervals;
+  long elapsed, elapsed_prev, next;
+  dist_t dist;
+  FILE *json = NULL;
+  char *json_file = NULL;
+  const char *distribution = DEFAULT_DISTRIBUTION;
+  int batch = DEFAULT_BATCH;
+  int interval = DEFAULT_INTERVAL;
+  int latency = 0;
+  char *s = NULL;
 #ifndef TM_COMPILER
-  char *s;
   unsigned long aborts, aborts_1, aborts_2,
     aborts_locked_read, aborts_locked_write,
     aborts_validate_read, aborts_validate_write, aborts_validate_commit,
@@ -353,6 +767,7 @@ int main(int argc, char **argv)
     locked_reads_ok, locked_reads_failed, max_retries;
   stm_ab_stats_t ab_stats;
   char *cm = NULL;
+  char *trace = NULL;
 #endif /* ! TM_COMPILER */
   thread_data_t *data;
   pthread_t *threads;
@@ -369,11 +784,10 @@ int main(int argc, char **argv)
   int write_all = DEFAULT_WRITE_ALL;
   int write_threads = DEFAULT_WRITE_THREADS;
   int disjoint = DEFAULT_DISJOINT;
-  sigset_t block_set;
 
   while(1) {
     i = 0;
-    c = getopt_long(argc, argv, "ha:c:d:n:r:R:s:w:W:j", long_options, &i);
+    c = getopt_long(argc, argv, "ha:b:c:d:D:g:i:J:ln:r:R:s:t:w:W:j", long_options, &i);
 
     if(c == -1)
       break;
@@ -396,12 +810,33 @@ int main(int argc, char **argv)
               "        Print this message\n"
               "  -a, --accounts <int>\n"
               "        Number of accounts in the bank (default=" XSTR(DEFAULT_NB_ACCOUNTS) ")\n"
+              "  -b, --batch <int>\n"
+              "        Number of transfers per update transaction (default=" XSTR(DEFAULT_BATCH) ")\n"
 #ifndef TM_COMPILER
               "  -c, --contention-manager <string>\n"
               "        Contention manager for resolving conflicts (default=suicide)\n"
 #endif /* ! TM_COMPILER */
               "  -d, --duration <int>\n"
               "        Test duration in milliseconds (0=infinite, default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -D, --distribution <string>\n"
+              "        Distribution of accounts chosen for transfers (default=" DEFAULT_DISTRIBUTION ")\n"
+              "          uniform\n"
+              "          zipf[:<theta>] (account 0 is the most popular, default theta=" XSTR(DEFAULT_ZIPF_THETA) ")\n"
+              "          hotspot[:<accounts>[:<rate>]] (<rate> percent of transfers use the first\n"
+              "            <accounts> percent of accounts, default=" XSTR(DEFAULT_HOT_ACCOUNTS) ":" XSTR(DEFAULT_HOT_RATE) ")\n"
+              "  -g, --counter <int>\n"
+              "        Count update transactions in a global counter (default=" XSTR(DEFAULT_COUNTER) ")\n"
+              "          0=no counter\n"
+              "          1=read-modify-write of the counter\n"
+#ifndef TM_COMPILER
+              "          2=commutative increment of the counter (mod_inc)\n"
+#endif /* ! TM_COMPILER */
+              "  -i, --interval <int>\n"
+              "        Report throughput (and latencies) every <int> milliseconds (0=never, default=" XSTR(DEFAULT_INTERVAL) ")\n"
+              "  -J, --json <string>\n"
+              "        Write configuration and results to file in JSON format (default=no file)\n"
+              "  -l, --latency\n"
+              "        Record latency histograms of operations (default=no)\n"
               "  -n, --num-threads <int>\n"
               "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
               "  -r, --read-all-rate <int>\n"
@@ -410,15 +845,23 @@ int main(int argc, char **argv)
               "        Number of threads issuing only read-all transactions (default=" XSTR(DEFAULT_READ_THREADS) ")\n"
               "  -s, --seed <int>\n"
               "        RNG seed (0=time-based, default=" XSTR(DEFAULT_SEED) ")\n"
+#ifndef TM_COMPILER
+              "  -t, --trace <string>\n"
+              "        Trace transactional events to file (default=no trace)\n"
+#endif /* ! TM_COMPILER */
               "  -w, --write-all-rate <int>\n"
               "        Percentage of write-all transactions (default=" XSTR(DEFAULT_WRITE_ALL) ")\n"
               "  -W, --write-threads <int>\n"
               "        Number of threads issuing only write-all transactions (default=" XSTR(DEFAULT_WRITE_THREADS) ")\n"
+              BENCH_USAGE
          );
        exit(0);
      case 'a':
        nb_accounts = atoi(optarg);
        break;
+     case 'b':
+       batch = atoi(optarg);
+       break;
 #ifndef TM_COMPILER
      case 'c':
        cm = optarg;
@@ -427,6 +870,21 @@ int main(int argc, char **argv)
      case 'd':
        duration = atoi(optarg);
        break;
+     case 'D':
+       distribution = optarg;
+       break;
+     case 'g':
+       counter_mode = atoi(optarg);
+       break;
+     case 'i':
+       interval = atoi(optarg);
+       break;
+     case 'J':
+       json_file = optarg;
+       break;
+     case 'l':
+       latency = 1;
+       break;
      case 'n':
        nb_threads = atoi(optarg);
        break;
@@ -439,6 +897,11 @@ int main(int argc, char **argv)
      case 's':
        seed = atoi(optarg);
        break;
+#ifndef TM_COMPILER
+     case 't':
+       trace = optarg;
+       break;
+#endif /* ! TM_COMPILER */
      case 'w':
        write_all = atoi(optarg);
        break;
@@ -452,6 +915,8 @@ int main(int argc, char **argv)
        printf("Use -h or --help for help\n");
        exit(0);
      default:
+       if (bench_option(c, optarg))
+         break;
        exit(1);
     }
   }
@@ -461,12 +926,37 @@ int main(int argc, char **argv)
   assert(nb_threads > 0);
   assert(read_all >= 0 && write_all >= 0 && read_all + write_all <= 100);
   assert(read_threads + write_threads <= nb_threads);
+  assert(batch > 0);
+  assert(interval >= 0);
+#ifdef TM_COMPILER
+  assert(counter_mode >= COUNTER_NONE && counter_mode <= COUNTER_RMW);
+#else /* ! TM_COMPILER */
+  assert(counter_mode >= COUNTER_NONE && counter_mode <= COUNTER_INC);
+#endif /* ! TM_COMPILER */
+  if (!dist_parse(&dist, distribution)) {
+    fprintf(stderr, "Invalid distribution \"%s\"\n", distribution);
+    exit(1);
+  }
+  if (interval > 0) {
+    /* Intervals report progress of a single measurement */
+    bench.trials = 1;
+  }
+  assert(bench.trials > 0 && bench.warmup >= 0);
+  bench_init();
 
   printf("Nb accounts    : %d\n", nb_accounts);
 #ifndef TM_COMPILER
   printf("CM             : %s\n", (cm == NULL ? "DEFAULT" : cm));
 #endif /* ! TM_COMPILER */
   printf("Duration       : %d\n", duration);
+  printf("Distribution   : %s", dist_name(&dist));
+  if (dist.type == DIST_ZIPF)
+    printf(" (theta=%g)", dist.theta);
+  else if (dist.type == DIST_HOTSPOT)
+    printf(" (%d%% of transfers on %d%% of accounts)", dist.hot_rate, dist.hot_accounts);
+  printf("\n");
+  printf("Batch size     : %d\n", batch);
+  printf("Counter        : %d\n", counter_mode);
   printf("Nb threads     : %d\n", nb_threads);
   printf("Read-all rate  : %d\n", read_all);
   printf("Read threads   : %d\n", read_threads);
@@ -478,9 +968,7 @@ int main(int argc, char **argv)
          (int)sizeof(long),
          (int)sizeof(void *),
          (int)sizeof(size_t));
-
-  timeout.tv_sec = duration / 1000;
-  timeout.tv_nsec = (duration % 1000) * 1000000;
+  bench_print();
 
   if ((data = (thread_data_t *)malloc(nb_threads * sizeof(thread_data_t))) == NULL) {
     perror("malloc");
@@ -499,9 +987,18 @@ int main(int argc, char **argv)
   bank = (bank_t *)malloc(sizeof(bank_t));
   bank->accounts = (account_t *)malloc(nb_accounts * sizeof(account_t));
   bank->size = nb_accounts;
-  for (i = 0; i < bank->size; i++) {
-    bank->accounts[i].number = i;
-    bank->accounts[i].balance = 0;
+  if (!bench.numa_init) {
+    for (i = 0; i < bank->size; i++) {
+      bank->accounts[i].number = i;
+      bank->accounts[i].balance = 0;
+    }
+  }
+
+  dist_init(&dist, disjoint ? nb_accounts / nb_threads : nb_accounts);
+
+  if (json_file != NULL && (json = fopen(json_file, "w")) == NULL) {
+    perror("fopen");
+    exit(1);
   }
 
   stop = 0;
@@ -511,6 +1008,9 @@ int main(int argc, char **argv)
   TM_INIT;
 
 #ifndef TM_COMPILER
+  if (trace != NULL)
+    mod_trace_init(trace, 0);
+
   if (stm_get_parameter("compile_flags", &s))
     printf("STM flags      : %s\n", s);
 
@@ -520,7 +1020,25 @@ int main(int argc, char **argv)
   }
 #endif /* ! TM_COMPILER */
 
+  if (json != NULL) {
+    fprintf(json, "{\n  \"config\": {\"accounts\": %d, \"threads\": %d, \"duration\": %d, \"distribution\": \"%s\", ",
+            nb_accounts, nb_threads, duration, dist_name(&dist));
+    if (dist.type == DIST_ZIPF)
+      fprintf(json, "\"zipf_theta\": %g, ", dist.theta);
+    else if (dist.type == DIST_HOTSPOT)
+      fprintf(json, "\"hot_accounts\": %d, \"hot_rate\": %d, ", dist.hot_accounts, dist.hot_rate);
+    fprintf(json, "\"batch\": %d, \"counter\": %d, \"read_all_rate\": %d, \"write_all_rate\": %d, \"read_threads\": %d, \"write_threads\": %d, \"disjoint\": %s, \"seed\": %d, \"interval\": %d, \"latency\": %s",
+            batch, counter_mode, read_all, write_all, read_threads, write_threads, disjoint ? "true" : "false", seed, interval, latency ? "true" : "false");
+    if (s != NULL) {
+      fprintf(json, ", \"stm_flags\": ");
+      json_string(json, s);
+    }
+    fprintf(json, "},\n  \"intervals\": [");
+  }
+
   /* Access set from all threads */
+  threads_data = data;
+  threads_nb = nb_threads;
   barrier_init(&barrier, nb_threads + 1);
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -532,8 +1050,15 @@ int main(int argc, char **argv)
     data[i].write_all = write_all;
     data[i].write_threads = write_threads;
     data[i].disjoint = disjoint;
+    data[i].dist = &dist;
+    data[i].batch = batch;
+    data[i].latency = latency;
+    memset(data[i].lat, 0, sizeof(data[i].lat));
+    memset(data[i].lat_sum, 0, sizeof(data[i].lat_sum));
+    memset(data[i].lat_max, 0, sizeof(data[i].lat_max));
     data[i].nb_threads = nb_threads;
     data[i].nb_transfer = 0;
+    data[i].nb_counted = 0;
     data[i].nb_read_all = 0;
     data[i].nb_write_all = 0;
 #ifndef TM_COMPILER
@@ -550,6 +1075,7 @@ int main(int argc, char **argv)
     data[i].locked_reads_ok = 0;
     data[i].locked_reads_failed = 0;
     data[i].max_retries = 0;
+    memset(&data[i].base, 0, sizeof(data[i].base));
 #endif /* ! TM_COMPILER */
     data[i].seed = rand();
     data[i].bank = bank;
@@ -571,17 +1097,86 @@ int main(int argc, char **argv)
  
   /* Start threads */
   barrier_cross(&barrier);
+  bench_warmup(nb_threads, &caught);
 
   printf("STARTING...\n");
-  gettimeofday(&start, NULL);
-  if (duration > 0) {
-    nanosleep(&timeout, NULL);
+  if (interval > 0) {
+    gettimeofday(&start, NULL);
+    /* Report progress (counters and histograms are read without synchronization) */
+    lat = lat_prev = NULL;
+    lat_diff = NULL;
+    if (latency) {
+      lat_prev = (unsigned long (*)[LAT_BUCKETS])calloc(NB_OPS, sizeof(*lat_prev));
+      lat = (unsigned long (*)[LAT_BUCKETS])malloc(NB_OPS * sizeof(*lat));
+      lat_diff = (unsigned long *)malloc(LAT_BUCKETS * sizeof(unsigned long));
+      if (lat_prev == NULL || lat == NULL || lat_diff == NULL) {
+        perror("malloc");
+        exit(1);
+      }
+    }
+    txs_prev = 0;
+    elapsed_prev = 0;
+    nb_intervals = 0;
+    for (next = interval; caught == 0; next += interval) {
+      if (duration > 0 && next > duration)
+        next = duration;
+      do {
+        gettimeofday(&end, NULL);
+        elapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+        if (elapsed >= next)
+          break;
+        timeout.tv_sec = (next - elapsed) / 1000;
+        timeout.tv_nsec = ((next - elapsed) % 1000) * 1000000;
+      } while (nanosleep(&timeout, NULL) == 0 || (errno == EINTR && caught == 0));
+      if (caught)
+        break;
+      txs = count_txs();
+      printf("Interval      : %ld (ms) #txs %lu (%f / s)", elapsed, txs - txs_prev,
+             elapsed > elapsed_prev ? (txs - txs_prev) * 1000.0 / (elapsed - elapsed_prev) : 0.0);
+      if (json != NULL)
+        fprintf(json, "%s\n    {\"time\": %ld, \"txs\": %lu, \"txs_per_s\": %f", nb_intervals++ == 0 ? "" : ",",
+                elapsed, txs - txs_prev, elapsed > elapsed_prev ? (txs - txs_prev) * 1000.0 / (elapsed - elapsed_prev) : 0.0);
+      if (latency) {
+        memset(lat, 0, NB_OPS * sizeof(*lat));
+        for (i = 0; i < nb_threads; i++) {
+          for (c = 0; c < NB_OPS; c++) {
+            for (j = 0; j < LAT_BUCKETS; j++)
+              lat[c][j] += ((volatile unsigned long *)data[i].lat[c])[j];
+          }
+        }
+        for (c = 0; c < NB_OPS; c++) {
+          for (j = 0; j < LAT_BUCKETS; j++)
+            lat_diff[j] = lat[c][j] - lat_prev[c][j];
+          lat_summary(lat_diff, 0, 0, &lat_stats);
+          if (lat_stats.samples == 0)
+            continue;
+          printf(" %s p50/p99/p999 %lu/%lu/%lu (ns)", op_names[c],
+                 (unsigned long)lat_stats.p50, (unsigned long)lat_stats.p99, (unsigned long)lat_stats.p999);
+          if (json != NULL)
+            fprintf(json, ", \"%s\": {\"samples\": %lu, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu}", op_names[c], lat_stats.samples,
+                    (unsigned long)lat_stats.p50, (unsigned long)lat_stats.p99, (unsigned long)lat_stats.p999);
+        }
+        memcpy(lat_prev, lat, NB_OPS * sizeof(*lat));
+      }
+      printf("\n");
+      if (json != NULL)
+        fprintf(json, "}");
+      fflush(NULL);
+      txs_prev = txs;
+      elapsed_prev = elapsed;
+      if (duration > 0 && elapsed >= duration)
+        break;
+    }
+    if (latency) {
+      free(lat_prev);
+      free(lat);
+      free(lat_diff);
+    }
+    gettimeofday(&end, NULL);
   } else {
-    sigemptyset(&block_set);
-    sigsuspend(&block_set);
+    bench_trials(duration, count_txs, &start, &end);
   }
   stop = 1;
-  gettimeofday(&end, NULL);
   printf("STOPPING...\n");
 
   /* Wait for thread completion */
@@ -611,6 +1206,7 @@ int main(int argc, char **argv)
   reads = 0;
   writes = 0;
   updates = 0;
+  counted = 0;
   for (i = 0; i < nb_threads; i++) {
     printf("Thread %d\n", i);
     printf("  #transfer   : %lu\n", data[i].nb_transfer);
@@ -646,17 +1242,25 @@ int main(int argc, char **argv)
       max_retries = data[i].max_retries;
 #endif /* ! TM_COMPILER */
     updates += data[i].nb_transfer;
+    counted += data[i].nb_counted;
     reads += data[i].nb_read_all;
     writes += data[i].nb_write_all;
   }
   /* Sanity check */
-  ret = total(bank, 0);
-  printf("Bank total    : %d (expected: 0)\n", ret);
+  i = total(bank, 0);
+  printf("Bank total    : %d (expected: 0)\n", i);
+  ret = (i != 0);
+  if (counter_mode != COUNTER_NONE) {
+    printf("Counter       : %lu (expected: %lu)\n", (unsigned long)counter, counted);
+    if ((unsigned long)counter != counted)
+      ret = 1;
+  }
   printf("Duration      : %d (ms)\n", duration);
   printf("#txs          : %lu (%f / s)\n", reads + writes + updates, (reads + writes + updates) * 1000.0 / duration);
   printf("#read txs     : %lu (%f / s)\n", reads, reads * 1000.0 / duration);
   printf("#write txs    : %lu (%f / s)\n", writes, writes * 1000.0 / duration);
   printf("#update txs   : %lu (%f / s)\n", updates, updates * 1000.0 / duration);
+  printf("#transfers    : %lu (%f / s)\n", updates * batch, updates * batch * 1000.0 / duration);
 #ifndef TM_COMPILER
   printf("#aborts       : %lu (%f / s)\n", aborts, aborts * 1000.0 / duration);
   printf("  #lock-r     : %lu (%f / s)\n", aborts_locked_read, aborts_locked_read * 1000.0 / duration);
@@ -685,9 +1289,72 @@ int main(int argc, char **argv)
   }
 #endif /* ! TM_COMPILER */
 
+  if (json != NULL) {
+    fprintf(json, "\n  ],\n  \"results\": {\"bank_total\": %d, \"duration\": %d, \"txs\": %lu, \"txs_per_s\": %f, "
+            "\"read_txs\": %lu, \"write_txs\": %lu, \"update_txs\": %lu, \"transfers\": %lu",
+            ret, duration, reads + writes + updates, (reads + writes + updates) * 1000.0 / duration,
+            reads, writes, updates, updates * batch);
+#ifndef TM_COMPILER
+    fprintf(json, ", \"aborts\": %lu, \"aborts_per_s\": %f, \"aborts_locked_read\": %lu, \"aborts_locked_write\": %lu, "
+            "\"aborts_validate_read\": %lu, \"aborts_validate_write\": %lu, \"aborts_validate_commit\": %lu, "
+            "\"aborts_invalid_memory\": %lu, \"aborts_killed\": %lu, \"max_retries\": %lu",
+            aborts, aborts * 1000.0 / duration, aborts_locked_read, aborts_locked_write,
+            aborts_validate_read, aborts_validate_write, aborts_validate_commit,
+            aborts_invalid_memory, aborts_killed, max_retries);
+#endif /* ! TM_COMPILER */
+    fprintf(json, "}");
+  }
+
+  if (latency) {
+    if ((lat = (unsigned long (*)[LAT_BUCKETS])calloc(NB_OPS, sizeof(*lat))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    memset(lat_sum, 0, sizeof(lat_sum));
+    memset(lat_max, 0, sizeof(lat_max));
+    for (i = 0; i < nb_threads; i++) {
+      for (c = 0; c < NB_OPS; c++) {
+        for (j = 0; j < LAT_BUCKETS; j++)
+          lat[c][j] += data[i].lat[c][j];
+        lat_sum[c] += data[i].lat_sum[c];
+        if (lat_max[c] < data[i].lat_max[c])
+          lat_max[c] = data[i].lat_max[c];
+      }
+    }
+    if (json != NULL)
+      fprintf(json, ",\n  \"latency\": {");
+    for (c = 0; c < NB_OPS; c++) {
+      lat_summary(lat[c], lat_sum[c], lat_max[c], &lat_stats);
+      if (json != NULL) {
+        fprintf(json, "%s\n    \"%s\": ", c == 0 ? "" : ",", op_names[c]);
+        json_lat(json, &lat_stats);
+      }
+      if (lat_stats.samples == 0)
+        continue;
+      printf("Latency (ns)  : %s\n", op_names[c]);
+      printf("  #samples    : %lu\n", lat_stats.samples);
+      printf("  Mean        : %f\n", lat_stats.mean);
+      printf("  50th perc.  : %lu\n", (unsigned long)lat_stats.p50);
+      printf("  99th perc.  : %lu\n", (unsigned long)lat_stats.p99);
+      printf("  99.9th perc.: %lu\n", (unsigned long)lat_stats.p999);
+      printf("  Max         : %lu\n", (unsigned long)lat_stats.max);
+    }
+    if (json != NULL)
+      fprintf(json, "\n  }");
+    free(lat);
+  }
+
+  if (json != NULL) {
+    fprintf(json, "\n}\n");
+    fclose(json);
+  }
+
+  bench_report();
+
   /* Delete bank and accounts */
   free(bank->accounts);
   free(bank);
+  dist_exit(&dist);
 
   /* Cleanup STM */
   TM_EXIT;
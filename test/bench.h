@@ -0,0 +1,474 @@
+/*
+ * File:
+ *   bench.h
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Options shared by benchmark drivers: pinning of threads to CPUs,
+ *   initialization of data by the threads that use it (first touch on
+ *   NUMA systems), warm-up excluded from measurements, repeated trials
+ *   and report of the effective configuration.  Must be included before
+ *   system headers.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif /* ! _GNU_SOURCE */
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#if !defined(TM_GCC) && !defined(TM_DTMC) && !defined(TM_INTEL) && !defined(TM_ABI)
+/* Explicit calls to tinySTM */
+# define BENCH_STM
+# include "stm.h"
+#endif /* !defined(TM_GCC) && !defined(TM_DTMC) && !defined(TM_INTEL) && !defined(TM_ABI) */
+
+/* ################################################################### *
+ * OPTIONS
+ * ################################################################### */
+
+/* Long options only (values do not collide with short options) */
+enum {
+  BENCH_OPT_AFFINITY = 256,
+  BENCH_OPT_NUMA_INIT,
+  BENCH_OPT_WARMUP,
+  BENCH_OPT_TRIALS
+};
+
+#define BENCH_LONG_OPTIONS \
+    {"affinity",                  required_argument, NULL, BENCH_OPT_AFFINITY}, \
+    {"numa-init",                 no_argument,       NULL, BENCH_OPT_NUMA_INIT}, \
+    {"warmup",                    required_argument, NULL, BENCH_OPT_WARMUP}, \
+    {"trials",                    required_argument, NULL, BENCH_OPT_TRIALS},
+
+#define BENCH_USAGE \
+  "  --affinity <string>\n" \
+  "        Pin threads to CPUs: none, compact (fill sockets first), scatter\n" \
+  "        (round-robin over sockets) or list:<cpus> (e.g., list:0,2,4-7) (default=none)\n" \
+  "  --numa-init\n" \
+  "        Initialize data from the threads that use it (after pinning)\n" \
+  "  --warmup <int>\n" \
+  "        Warm-up in milliseconds, excluded from measurements (default=0)\n" \
+  "  --trials <int>\n" \
+  "        Number of measurements of the given duration (default=1)\n"
+
+enum {
+  BENCH_PIN_NONE,
+  BENCH_PIN_COMPACT,
+  BENCH_PIN_SCATTER,
+  BENCH_PIN_LIST
+};
+
+typedef struct bench {
+  int policy;
+  const char *list;
+  int numa_init;
+  int warmup;
+  int trials;
+  int nb_cpus;
+  int *cpus;                            /* CPU of thread i is cpus[i % nb_cpus] */
+  double *rates;                        /* Throughput of trials */
+  volatile int measuring;               /* Set after warm-up */
+  volatile int acks;                    /* Threads that have seen the end of warm-up */
+} bench_t;
+
+static bench_t bench = { BENCH_PIN_NONE, NULL, 0, 0, 1, 0, NULL, NULL, 0, 0 };
+
+/* Returns 1 if the option is handled */
+static int bench_option(int c, const char *arg)
+{
+  switch (c) {
+   case BENCH_OPT_AFFINITY:
+     if (strcmp(arg, "none") == 0)
+       bench.policy = BENCH_PIN_NONE;
+     else if (strcmp(arg, "compact") == 0)
+       bench.policy = BENCH_PIN_COMPACT;
+     else if (strcmp(arg, "scatter") == 0)
+       bench.policy = BENCH_PIN_SCATTER;
+     else if (strncmp(arg, "list:", 5) == 0) {
+       bench.policy = BENCH_PIN_LIST;
+       bench.list = arg + 5;
+     } else {
+       fprintf(stderr, "Invalid affinity \"%s\"\n", arg);
+       exit(1);
+     }
+     return 1;
+   case BENCH_OPT_NUMA_INIT:
+     bench.numa_init = 1;
+     return 1;
+   case BENCH_OPT_WARMUP:
+     bench.warmup = atoi(arg);
+     return 1;
+   case BENCH_OPT_TRIALS:
+     bench.trials = atoi(arg);
+     return 1;
+  }
+  return 0;
+}
+
+/* ################################################################### *
+ * AFFINITY
+ * ################################################################### */
+
+typedef struct bench_cpu {
+  int cpu;
+  int package;
+  int core;
+  int smt;                              /* Index among CPUs of the same core */
+  int rank;                             /* Index among CPUs of the same package */
+} bench_cpu_t;
+
+static int bench_topology(int cpu, const char *name)
+{
+  char path[128];
+  FILE *f;
+  int v;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+  if ((f = fopen(path, "r")) == NULL)
+    return 0;
+  if (fscanf(f, "%d", &v) != 1)
+    v = 0;
+  fclose(f);
+  return v;
+}
+
+static int bench_cmp_compact(const void *a, const void *b)
+{
+  const bench_cpu_t *x = (const bench_cpu_t *)a, *y = (const bench_cpu_t *)b;
+
+  if (x->package != y->package)
+    return x->package - y->package;
+  if (x->core != y->core)
+    return x->core - y->core;
+  return x->cpu - y->cpu;
+}
+
+static int bench_cmp_scatter(const void *a, const void *b)
+{
+  const bench_cpu_t *x = (const bench_cpu_t *)a, *y = (const bench_cpu_t *)b;
+
+  if (x->rank != y->rank)
+    return x->rank - y->rank;
+  return x->package - y->package;
+}
+
+static int bench_cmp_rank(const void *a, const void *b)
+{
+  const bench_cpu_t *x = (const bench_cpu_t *)a, *y = (const bench_cpu_t *)b;
+
+  if (x->package != y->package)
+    return x->package - y->package;
+  if (x->smt != y->smt)
+    return x->smt - y->smt;
+  if (x->core != y->core)
+    return x->core - y->core;
+  return x->cpu - y->cpu;
+}
+
+/* Parse "0,2,4-7" */
+static void bench_parse_list(const char *s)
+{
+  char *e;
+  int i, first, last;
+
+  bench.nb_cpus = 0;
+  while (*s != '\0') {
+    first = last = (int)strtol(s, &e, 10);
+    if (e == s)
+      break;
+    if (*e == '-')
+      last = (int)strtol(e + 1, &e, 10);
+    for (i = first; i <= last; i++) {
+      if ((bench.cpus = (int *)realloc(bench.cpus, (bench.nb_cpus + 1) * sizeof(int))) == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+      bench.cpus[bench.nb_cpus++] = i;
+    }
+    s = (*e == ',' ? e + 1 : e);
+  }
+  if (*s != '\0' || bench.nb_cpus == 0) {
+    fprintf(stderr, "Invalid CPU list \"%s\"\n", bench.list);
+    exit(1);
+  }
+}
+
+/* Compute placement of threads (after parsing options) */
+static void bench_init(void)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  bench_cpu_t *c;
+  int i, j, n;
+
+  if (bench.policy == BENCH_PIN_LIST) {
+    bench_parse_list(bench.list);
+    return;
+  }
+  if (bench.policy == BENCH_PIN_NONE)
+    return;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  n = CPU_COUNT(&set);
+  if ((c = (bench_cpu_t *)malloc(n * sizeof(bench_cpu_t))) == NULL ||
+      (bench.cpus = (int *)malloc(n * sizeof(int))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0, j = 0; j < n; i++) {
+    if (!CPU_ISSET(i, &set))
+      continue;
+    c[j].cpu = i;
+    c[j].package = bench_topology(i, "physical_package_id");
+    c[j].core = bench_topology(i, "core_id");
+    j++;
+  }
+  /* Hardware threads of the same core are used last by scatter */
+  qsort(c, n, sizeof(bench_cpu_t), bench_cmp_compact);
+  for (i = 0; i < n; i++)
+    c[i].smt = (i > 0 && c[i].package == c[i - 1].package && c[i].core == c[i - 1].core ? c[i - 1].smt + 1 : 0);
+  qsort(c, n, sizeof(bench_cpu_t), bench_cmp_rank);
+  for (i = 0; i < n; i++)
+    c[i].rank = (i > 0 && c[i].package == c[i - 1].package ? c[i - 1].rank + 1 : 0);
+  qsort(c, n, sizeof(bench_cpu_t), bench.policy == BENCH_PIN_COMPACT ? bench_cmp_compact : bench_cmp_scatter);
+  for (i = 0; i < n; i++)
+    bench.cpus[i] = c[i].cpu;
+  bench.nb_cpus = n;
+  free(c);
+#else /* ! __linux__ */
+  if (bench.policy != BENCH_PIN_NONE)
+    printf("WARNING: thread pinning is not supported on this platform\n");
+  bench.policy = BENCH_PIN_NONE;
+#endif /* ! __linux__ */
+}
+
+/* Pin calling thread (before initializing data) */
+static void bench_pin(int id)
+{
+#ifdef __linux__
+  cpu_set_t set;
+
+  if (bench.nb_cpus == 0)
+    return;
+  CPU_ZERO(&set);
+  CPU_SET(bench.cpus[id % bench.nb_cpus], &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    fprintf(stderr, "WARNING: cannot pin thread %d to CPU %d\n", id, bench.cpus[id % bench.nb_cpus]);
+#endif /* __linux__ */
+}
+
+/* ################################################################### *
+ * WARM-UP AND TRIALS
+ * ################################################################### */
+
+/*
+ * Threads call bench_measure() before each operation: it returns 1
+ * once, after warm-up, when the thread must reset its counters and
+ * statistics.  Measurements start when all threads have done so.
+ */
+static inline int bench_measure(int *measuring)
+{
+  if (*measuring || !bench.measuring)
+    return 0;
+  *measuring = 1;
+  return 1;
+}
+
+#ifdef BENCH_STM
+/* Statistics that are reset after warm-up */
+typedef struct bench_stats {
+  unsigned long nb_aborts;
+  unsigned long nb_aborts_1;
+  unsigned long nb_aborts_2;
+  unsigned long nb_aborts_locked_read;
+  unsigned long nb_aborts_locked_write;
+  unsigned long nb_aborts_validate_read;
+  unsigned long nb_aborts_validate_write;
+  unsigned long nb_aborts_validate_commit;
+  unsigned long nb_aborts_invalid_memory;
+  unsigned long nb_aborts_killed;
+  unsigned long locked_reads_ok;
+  unsigned long locked_reads_failed;
+} bench_stats_t;
+
+static void bench_get_stats(bench_stats_t *s)
+{
+  memset(s, 0, sizeof(*s));
+  stm_get_stats("nb_aborts", &s->nb_aborts);
+  stm_get_stats("nb_aborts_1", &s->nb_aborts_1);
+  stm_get_stats("nb_aborts_2", &s->nb_aborts_2);
+  stm_get_stats("nb_aborts_locked_read", &s->nb_aborts_locked_read);
+  stm_get_stats("nb_aborts_locked_write", &s->nb_aborts_locked_write);
+  stm_get_stats("nb_aborts_validate_read", &s->nb_aborts_validate_read);
+  stm_get_stats("nb_aborts_validate_write", &s->nb_aborts_validate_write);
+  stm_get_stats("nb_aborts_validate_commit", &s->nb_aborts_validate_commit);
+  stm_get_stats("nb_aborts_invalid_memory", &s->nb_aborts_invalid_memory);
+  stm_get_stats("nb_aborts_killed", &s->nb_aborts_killed);
+  stm_get_stats("locked_reads_ok", &s->locked_reads_ok);
+  stm_get_stats("locked_reads_failed", &s->locked_reads_failed);
+}
+#endif /* BENCH_STM */
+
+static inline void bench_ack(void)
+{
+  __sync_fetch_and_add(&bench.acks, 1);
+}
+
+static void bench_sleep(int ms)
+{
+  struct timespec timeout;
+
+  timeout.tv_sec = ms / 1000;
+  timeout.tv_nsec = (ms % 1000) * 1000000;
+  nanosleep(&timeout, NULL);
+}
+
+/* Called by main thread once threads have started */
+static void bench_warmup(int nb_threads, volatile int *stop)
+{
+  if (bench.warmup > 0) {
+    printf("WARMING UP...\n");
+    bench_sleep(bench.warmup);
+  }
+  bench.measuring = 1;
+  while (bench.acks < nb_threads && !*stop)
+    sched_yield();
+}
+
+static long bench_elapsed(struct timeval *start, struct timeval *end)
+{
+  return (end->tv_sec * 1000 + end->tv_usec / 1000) - (start->tv_sec * 1000 + start->tv_usec / 1000);
+}
+
+/*
+ * Run trials of duration milliseconds (until a signal if 0) and record
+ * their throughput; count() returns the number of operations performed
+ * so far by all threads.
+ */
+static void bench_trials(int duration, unsigned long (*count)(void), struct timeval *start, struct timeval *end)
+{
+  struct timeval s, e;
+  sigset_t block_set;
+  unsigned long c;
+  long ms;
+  int i;
+
+  if ((bench.rates = (double *)malloc(bench.trials * sizeof(double))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  gettimeofday(start, NULL);
+  e = *start;
+  for (i = 0; i < bench.trials; i++) {
+    s = e;
+    c = count();
+    if (duration > 0) {
+      bench_sleep(duration);
+    } else {
+      sigemptyset(&block_set);
+      sigsuspend(&block_set);
+    }
+    gettimeofday(&e, NULL);
+    c = count() - c;
+    ms = bench_elapsed(&s, &e);
+    bench.rates[i] = (ms > 0 ? c * 1000.0 / ms : 0);
+    if (bench.trials > 1)
+      printf("Trial %-7d : %lu (%f / s)\n", i, c, bench.rates[i]);
+    if (duration == 0) {
+      bench.trials = i + 1;
+      break;
+    }
+  }
+  *end = e;
+}
+
+/* ################################################################### *
+ * REPORT
+ * ################################################################### */
+
+static void bench_print(void)
+{
+  int i;
+
+  printf("Affinity       : %s", bench.policy == BENCH_PIN_NONE ? "none" :
+         (bench.policy == BENCH_PIN_COMPACT ? "compact" : (bench.policy == BENCH_PIN_SCATTER ? "scatter" : "list")));
+  for (i = 0; i < bench.nb_cpus; i++)
+    printf("%s%d", i == 0 ? " (CPUs " : ",", bench.cpus[i]);
+  printf("%s\n", bench.nb_cpus > 0 ? ")" : "");
+  printf("NUMA init      : %d\n", bench.numa_init);
+  printf("Warm-up        : %d\n", bench.warmup);
+  printf("Trials         : %d\n", bench.trials);
+}
+
+/* Mean and standard deviation of trials, then parameters of the STM (possibly tuned at run time) */
+static void bench_report(void)
+{
+  double mean, var;
+  int i;
+#ifdef BENCH_STM
+  const char *s;
+  unsigned long l;
+  unsigned int u;
+#endif /* BENCH_STM */
+
+  if (bench.rates != NULL && bench.trials > 1) {
+    mean = 0;
+    for (i = 0; i < bench.trials; i++)
+      mean += bench.rates[i];
+    mean /= bench.trials;
+    var = 0;
+    for (i = 0; i < bench.trials; i++)
+      var += (bench.rates[i] - mean) * (bench.rates[i] - mean);
+    var /= bench.trials - 1;
+    printf("Trials        : %d (mean %f / s, stddev %f / s, %.2f%%)\n", bench.trials, mean, sqrt(var),
+           mean > 0 ? sqrt(var) * 100 / mean : 0);
+  }
+#ifdef BENCH_STM
+  if (stm_get_parameter("design", &s))
+    printf("STM design    : %s\n", s);
+  if (stm_get_parameter("contention_manager", &s))
+    printf("STM CM        : %s\n", s);
+  if (stm_get_parameter("clock", &s))
+    printf("STM clock     : %s\n", s);
+  if (stm_get_parameter("stripe_size", &l))
+    printf("STM stripe    : %lu\n", l);
+  if (stm_get_parameter("lock_array_log_size", &u))
+    printf("STM locks     : 2^%u\n", u);
+  if (stm_get_parameter("compile_flags", &s))
+    printf("STM flags     : %s\n", s);
+#endif /* BENCH_STM */
+  free(bench.rates);
+  free(bench.cpus);
+}
+
+#endif /* _BENCH_H_ */
@@ -23,6 +23,8 @@
  * under the terms of the MIT license.
  */
 
+#include "../bench.h"
+
 #include <assert.h>
 #include <getopt.h>
 #include <limits.h>
@@ -67,7 +69,8 @@ void perror(const char *s);
  * transactions, one should check the environment returned by
  * stm_get_env() and only call sigsetjmp() if it is not null.
  */
-# define TM_START(tid, ro)                  { stm_tx_attr_t _a = {{.id = tid, .read_only = ro}}; \
+# define TM_START(tid, ro)                  TM_START_EL(tid, ro, 0)
+# define TM_START_EL(tid, ro, el)           { stm_tx_attr_t _a = {{.id = tid, .read_only = ro, .elastic = el}}; \
                                               sigjmp_buf *_e = stm_start(_a); \
                                               if (_e != NULL) sigsetjmp(*_e, 0); 
 # define TM_START_TS(ts, label)             { sigjmp_buf *_e = stm_start((stm_tx_attr_t)0); \
@@ -93,14 +96,19 @@ void perror(const char *s);
 
 #endif /* Compile with explicit calls to tinySTM */
 
+#ifdef TM_COMPILER
+/* Elastic transactions are only supported with explicit calls */
+# define TM_START_EL(tid, ro, el)           TM_START(tid, ro)
+#endif /* TM_COMPILER */
+
 #ifdef DEBUG
 # define IO_FLUSH                       fflush(NULL)
 /* Note: stdio is thread-safe */
 #endif
 
-#if !(defined(USE_LINKEDLIST) || defined(USE_RBTREE) || defined(USE_SKIPLIST) || defined(USE_HASHSET))
-# error "Must define USE_LINKEDLIST or USE_RBTREE or USE_SKIPLIST or USE_HASHSET"
-#endif /* !(defined(USE_LINKEDLIST) || defined(USE_RBTREE) || defined(USE_SKIPLIST) || defined(USE_HASHSET)) */
+#if !(defined(USE_LINKEDLIST) || defined(USE_RBTREE) || defined(USE_SKIPLIST) || defined(USE_HASHSET) || defined(USE_DS))
+# error "Must define USE_LINKEDLIST or USE_RBTREE or USE_SKIPLIST or USE_HASHSET or USE_DS"
+#endif /* !(defined(USE_LINKEDLIST) || defined(USE_RBTREE) || defined(USE_SKIPLIST) || defined(USE_HASHSET) || defined(USE_DS)) */
 
 
 #define DEFAULT_DURATION                10000
@@ -155,8 +163,11 @@ typedef struct thread_data {
   unsigned long locked_reads_ok;
   unsigned long locked_reads_failed;
   unsigned long max_retries;
+  bench_stats_t base;                   /* Statistics at end of warm-up */
 #endif /* ! TM_COMPILER */
   unsigned short seed[3];
+  int id;
+  int initial;                          /* Elements added by thread (NUMA init) */
   int diff;
   int range;
   int update;
@@ -164,6 +175,9 @@ typedef struct thread_data {
 #ifdef USE_LINKEDLIST
   int unit_tx;
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+  int elastic;
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
   char padding[64];
 } thread_data_t;
 
@@ -273,7 +287,7 @@ static int set_contains(intset_t *set, val_t val, thread_data_t *td)
     }
     result = (next->val == val);
   } else if (td->unit_tx == 0) {
-    TM_START(0, RO);
+    TM_START_EL(0, RO, td->elastic);
     prev = (node_t *)TM_LOAD(&set->head);
     next = (node_t *)TM_LOAD(&prev->next);
     while (1) {
@@ -347,7 +361,7 @@ static int set_add(intset_t *set, val_t val, thread_data_t *td)
       prev->next = new_node(val, next, 0);
     }
   } else if (td->unit_tx == 0) {
-    TM_START(1, RW);
+    TM_START_EL(1, RW, td->elastic);
     prev = (node_t *)TM_LOAD(&set->head);
     next = (node_t *)TM_LOAD(&prev->next);
     while (1) {
@@ -434,7 +448,7 @@ static int set_remove(intset_t *set, val_t val, thread_data_t *td)
       free(next);
     }
   } else if (td->unit_tx == 0) {
-    TM_START(2, RW);
+    TM_START_EL(2, RW, td->elastic);
     prev = (node_t *)TM_LOAD(&set->head);
     next = (node_t *)TM_LOAD(&prev->next);
     while (1) {
@@ -755,7 +769,8 @@ static int set_contains(intset_t *set, val_t val, thread_data_t *td)
     node = node->forward[0];
     result = (node->val == val);
   } else {
-    TM_START(0, RO);
+    /* Updates write to predecessors found at all levels: only lookups are elastic */
+    TM_START_EL(0, RO, td->elastic);
     v = VAL_MIN; /* Avoid compiler warning (should not be necessary) */
     node = set->head;
     for (i = TM_LOAD(&set->level); i >= 0; i--) {
@@ -1178,7 +1193,167 @@ static int set_remove(intset_t *set, val_t val, thread_data_t *td)
   return result;
 }
 
-#endif /* defined(USE_HASHSET) */
+#elif defined(USE_DS)
+
+/* ################################################################### *
+ * LIBSTM-DS
+ * ################################################################### */
+
+# ifdef TM_COMPILER
+#  error "USE_DS requires explicit calls to tinySTM"
+# endif /* TM_COMPILER */
+
+# include "stm_ds.h"
+
+/*
+ * Structures of libstm-ds behind the set interface.  Queues, deques and
+ * priority queues always add the value, remove the next element
+ * whatever the value and look up the next element (found if not
+ * empty).  The parity of values selects the end of deques.
+ */
+
+# define INIT_SET_PARAMETERS            ds_type
+
+# define NB_BUCKETS                     (1UL << 17)
+
+typedef intptr_t val_t;
+
+enum {
+  DS_LIST,
+  DS_SKIPLIST,
+  DS_RBTREE,
+  DS_HASHSET,
+  DS_QUEUE,
+  DS_DEQUE,
+  DS_PQUEUE,
+  DS_NB
+};
+
+static const char *ds_names[DS_NB] = {
+  "list", "skiplist", "rbtree", "hashset", "queue", "deque", "pqueue"
+};
+
+static int ds_type = DS_LIST;
+
+typedef struct intset {
+  int type;
+  void *ds;
+} intset_t;
+
+static intset_t *set_new(int type)
+{
+  intset_t *set;
+
+  if ((set = (intset_t *)malloc(sizeof(intset_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  set->type = type;
+  switch (type) {
+   case DS_LIST: set->ds = ds_list_new(); break;
+   case DS_SKIPLIST: set->ds = ds_skiplist_new(); break;
+   case DS_RBTREE: set->ds = ds_rbtree_new(); break;
+   case DS_HASHSET: set->ds = ds_hashset_new(NB_BUCKETS); break;
+   case DS_QUEUE: set->ds = ds_queue_new(); break;
+   case DS_DEQUE: set->ds = ds_deque_new(); break;
+   case DS_PQUEUE: set->ds = ds_pqueue_new(); break;
+  }
+
+  return set;
+}
+
+static void set_delete(intset_t *set)
+{
+  switch (set->type) {
+   case DS_LIST: ds_list_delete(set->ds); break;
+   case DS_SKIPLIST: ds_skiplist_delete(set->ds); break;
+   case DS_RBTREE: ds_rbtree_delete(set->ds); break;
+   case DS_HASHSET: ds_hashset_delete(set->ds); break;
+   case DS_QUEUE: ds_queue_delete(set->ds); break;
+   case DS_DEQUE: ds_deque_delete(set->ds); break;
+   case DS_PQUEUE: ds_pqueue_delete(set->ds); break;
+  }
+  free(set);
+}
+
+static int set_size(intset_t *set)
+{
+  switch (set->type) {
+   case DS_LIST: return (int)ds_list_size(set->ds);
+   case DS_SKIPLIST: return (int)ds_skiplist_size(set->ds);
+   case DS_RBTREE: return (int)ds_rbtree_size(set->ds);
+   case DS_HASHSET: return (int)ds_hashset_size(set->ds);
+   case DS_QUEUE: return (int)ds_queue_size(set->ds);
+   case DS_DEQUE: return (int)ds_deque_size(set->ds);
+   case DS_PQUEUE: return (int)ds_pqueue_size(set->ds);
+  }
+  return 0;
+}
+
+/* All operations are transactions (the main thread has one too) */
+static int set_contains(intset_t *set, val_t val, thread_data_t *td)
+{
+# ifdef DEBUG
+  printf("++> set_contains(%d)\n", val);
+  IO_FLUSH;
+# endif
+
+  switch (set->type) {
+   case DS_LIST: return ds_list_contains(set->ds, val);
+   case DS_SKIPLIST: return ds_skiplist_contains(set->ds, val);
+   case DS_RBTREE: return ds_rbtree_contains(set->ds, val);
+   case DS_HASHSET: return ds_hashset_contains(set->ds, val);
+   case DS_QUEUE: return ds_queue_peek(set->ds, NULL);
+   case DS_DEQUE: return (val & 1) ? ds_deque_peek_back(set->ds, NULL) : ds_deque_peek_front(set->ds, NULL);
+   case DS_PQUEUE: return ds_pqueue_peek_min(set->ds, NULL);
+  }
+  return 0;
+}
+
+static int set_add(intset_t *set, val_t val, thread_data_t *td)
+{
+# ifdef DEBUG
+  printf("++> set_add(%d)\n", val);
+  IO_FLUSH;
+# endif
+
+  switch (set->type) {
+   case DS_LIST: return ds_list_add(set->ds, val);
+   case DS_SKIPLIST: return ds_skiplist_add(set->ds, val);
+   case DS_RBTREE: return ds_rbtree_add(set->ds, val);
+   case DS_HASHSET: return ds_hashset_add(set->ds, val);
+   case DS_QUEUE: ds_queue_enqueue(set->ds, val); return 1;
+   case DS_DEQUE:
+     if (val & 1)
+       ds_deque_push_back(set->ds, val);
+     else
+       ds_deque_push_front(set->ds, val);
+     return 1;
+   case DS_PQUEUE: ds_pqueue_insert(set->ds, val); return 1;
+  }
+  return 0;
+}
+
+static int set_remove(intset_t *set, val_t val, thread_data_t *td)
+{
+# ifdef DEBUG
+  printf("++> set_remove(%d)\n", val);
+  IO_FLUSH;
+# endif
+
+  switch (set->type) {
+   case DS_LIST: return ds_list_remove(set->ds, val);
+   case DS_SKIPLIST: return ds_skiplist_remove(set->ds, val);
+   case DS_RBTREE: return ds_rbtree_remove(set->ds, val);
+   case DS_HASHSET: return ds_hashset_remove(set->ds, val);
+   case DS_QUEUE: return ds_queue_dequeue(set->ds, NULL);
+   case DS_DEQUE: return (val & 1) ? ds_deque_pop_back(set->ds, NULL) : ds_deque_pop_front(set->ds, NULL);
+   case DS_PQUEUE: return ds_pqueue_remove_min(set->ds, NULL);
+  }
+  return 0;
+}
+
+#endif /* defined(USE_DS) */
 
 /* ################################################################### *
  * BARRIER
@@ -1221,15 +1396,32 @@ static void barrier_cross(barrier_t *b)
 
 static void *test(void *data)
 {
-  int op, val, last = -1;
+  int op, val, last = -1, measuring = 0;
   thread_data_t *d = (thread_data_t *)data;
 
+  bench_pin(d->id);
   /* Create transaction */
   TM_INIT_THREAD;
+  /* Populate part of the set from the CPU that uses it */
+  while (d->initial > 0) {
+    val = rand_range(d->range, d->seed) + 1;
+    if (set_add(d->set, val, d)) {
+      d->diff++;
+      d->initial--;
+    }
+  }
   /* Wait on barrier */
   barrier_cross(d->barrier);
 
   while (stop == 0) {
+    if (bench_measure(&measuring)) {
+      /* End of warm-up */
+      d->nb_add = d->nb_remove = d->nb_contains = d->nb_found = 0;
+#ifndef TM_COMPILER
+      bench_get_stats(&d->base);
+#endif /* ! TM_COMPILER */
+      bench_ack();
+    }
     op = rand_range(100, d->seed);
     if (op < d->update) {
       if (d->alternate) {
@@ -1286,6 +1478,19 @@ static void *test(void *data)
   stm_get_stats("locked_reads_ok", &d->locked_reads_ok);
   stm_get_stats("locked_reads_failed", &d->locked_reads_failed);
   stm_get_stats("max_retries", &d->max_retries);
+  /* Exclude warm-up */
+  d->nb_aborts -= d->base.nb_aborts;
+  d->nb_aborts_1 -= d->base.nb_aborts_1;
+  d->nb_aborts_2 -= d->base.nb_aborts_2;
+  d->nb_aborts_locked_read -= d->base.nb_aborts_locked_read;
+  d->nb_aborts_locked_write -= d->base.nb_aborts_locked_write;
+  d->nb_aborts_validate_read -= d->base.nb_aborts_validate_read;
+  d->nb_aborts_validate_write -= d->base.nb_aborts_validate_write;
+  d->nb_aborts_validate_commit -= d->base.nb_aborts_validate_commit;
+  d->nb_aborts_invalid_memory -= d->base.nb_aborts_invalid_memory;
+  d->nb_aborts_killed -= d->base.nb_aborts_killed;
+  d->locked_reads_ok -= d->base.locked_reads_ok;
+  d->locked_reads_failed -= d->base.locked_reads_failed;
 #endif /* ! TM_COMPILER */
   /* Free transaction */
   TM_EXIT_THREAD;
@@ -1293,6 +1498,24 @@ static void *test(void *data)
   return NULL;
 }
 
+static thread_data_t *threads_data;
+static int threads_nb;
+
+/* Operations performed so far by all threads (read without synchronization) */
+static unsigned long count_txs(void)
+{
+  volatile thread_data_t *d;
+  unsigned long txs;
+  int i;
+
+  txs = 0;
+  for (i = 0; i < threads_nb; i++) {
+    d = &threads_data[i];
+    txs += d->nb_add + d->nb_remove + d->nb_contains;
+  }
+  return txs;
+}
+
 int main(int argc, char **argv)
 {
   struct option long_options[] = {
@@ -1311,6 +1534,13 @@ int main(int argc, char **argv)
 #ifdef USE_LINKEDLIST
     {"unit-tx",                   no_argument,       NULL, 'x'},
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+    {"elastic",                   no_argument,       NULL, 'e'},
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
+#ifdef USE_DS
+    {"type",                      required_argument, NULL, 't'},
+#endif /* USE_DS */
+    BENCH_LONG_OPTIONS
     {NULL, 0, NULL, 0}
   };
 
@@ -1331,7 +1561,6 @@ int main(int argc, char **argv)
   pthread_attr_t attr;
   barrier_t barrier;
   struct timeval start, end;
-  struct timespec timeout;
   int duration = DEFAULT_DURATION;
   int initial = DEFAULT_INITIAL;
   int nb_threads = DEFAULT_NB_THREADS;
@@ -1345,7 +1574,9 @@ int main(int argc, char **argv)
 #ifdef USE_LINKEDLIST
   int unit_tx = 0;
 #endif /* LINKEDLIST */
-  sigset_t block_set;
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+  int elastic = 0;
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
 
   while(1) {
     i = 0;
@@ -1357,6 +1588,12 @@ int main(int argc, char **argv)
 #ifdef USE_LINKEDLIST
                     "x"
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+                    "e"
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
+#ifdef USE_DS
+                    "t:"
+#endif /* USE_DS */
                     , long_options, &i);
 
     if(c == -1)
@@ -1379,7 +1616,9 @@ int main(int argc, char **argv)
               "(skip list)\n"
 #elif defined(USE_HASHSET)
               "(hash set)\n"
-#endif /* defined(USE_HASHSET) */
+#elif defined(USE_DS)
+              "(libstm-ds)\n"
+#endif /* defined(USE_DS) */
               "\n"
               "Usage:\n"
               "  intset [options...]\n"
@@ -1409,6 +1648,18 @@ int main(int argc, char **argv)
               "  -x, --unit-tx\n"
               "        Use unit transactions\n"
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST)
+              "  -e, --elastic\n"
+              "        Use elastic transactions (requires ELASTIC_TX)\n"
+#elif defined(USE_SKIPLIST)
+              "  -e, --elastic\n"
+              "        Use elastic transactions for lookups (requires ELASTIC_TX)\n"
+#endif /* defined(USE_SKIPLIST) */
+#ifdef USE_DS
+              "  -t, --type <string>\n"
+              "        Structure: list, skiplist, rbtree, hashset, queue, deque or pqueue (default=list)\n"
+#endif /* USE_DS */
+              BENCH_USAGE
          );
        exit(0);
      case 'a':
@@ -1442,10 +1693,27 @@ int main(int argc, char **argv)
        unit_tx++;
        break;
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+     case 'e':
+       elastic = 1;
+       break;
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
+#ifdef USE_DS
+     case 't':
+       for (ds_type = 0; ds_type < DS_NB && strcmp(optarg, ds_names[ds_type]) != 0; ds_type++)
+         ;
+       if (ds_type == DS_NB) {
+         fprintf(stderr, "Unknown structure \"%s\"\n", optarg);
+         exit(1);
+       }
+       break;
+#endif /* USE_DS */
      case '?':
        printf("Use -h or --help for help\n");
        exit(0);
      default:
+       if (bench_option(c, optarg))
+         break;
        exit(1);
     }
   }
@@ -1455,6 +1723,8 @@ int main(int argc, char **argv)
   assert(nb_threads > 0);
   assert(range > 0 && range >= initial);
   assert(update >= 0 && update <= 100);
+  assert(bench.trials > 0 && bench.warmup >= 0);
+  bench_init();
 
 #if defined(USE_LINKEDLIST)
   printf("Set type     : linked list\n");
@@ -1464,7 +1734,9 @@ int main(int argc, char **argv)
   printf("Set type     : skip list\n");
 #elif defined(USE_HASHSET)
   printf("Set type     : hash set\n");
-#endif /* defined(USE_HASHSET) */
+#elif defined(USE_DS)
+  printf("Set type     : libstm-ds %s\n", ds_names[ds_type]);
+#endif /* defined(USE_DS) */
 #ifndef TM_COMPILER
   printf("CM           : %s\n", (cm == NULL ? "DEFAULT" : cm));
 #endif /* ! TM_COMPILER */
@@ -1478,14 +1750,15 @@ int main(int argc, char **argv)
 #ifdef USE_LINKEDLIST
   printf("Unit tx      : %d\n", unit_tx);
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+  printf("Elastic      : %d\n", elastic);
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
   printf("Type sizes   : int=%d/long=%d/ptr=%d/word=%d\n",
          (int)sizeof(int),
          (int)sizeof(long),
          (int)sizeof(void *),
          (int)sizeof(size_t));
-
-  timeout.tv_sec = duration / 1000;
-  timeout.tv_nsec = (duration % 1000) * 1000000;
+  bench_print();
 
   if ((data = (thread_data_t *)malloc(nb_threads * sizeof(thread_data_t))) == NULL) {
     perror("malloc");
@@ -1501,8 +1774,6 @@ int main(int argc, char **argv)
   else
     srand(seed);
 
-  set = set_new(INIT_SET_PARAMETERS);
-
   stop = 0;
 
   /* Thread-local seed for main thread */
@@ -1511,6 +1782,13 @@ int main(int argc, char **argv)
   /* Init STM */
   printf("Initializing STM\n");
   TM_INIT;
+#ifdef USE_DS
+  /* Operations on the structures are always transactions */
+  TM_INIT_THREAD;
+#endif /* USE_DS */
+
+  /* Created after the STM, whose parameters may determine its layout */
+  set = set_new(INIT_SET_PARAMETERS);
 
 #ifndef TM_COMPILER
   if (stm_get_parameter("compile_flags", &s))
@@ -1525,28 +1803,37 @@ int main(int argc, char **argv)
     printf("WARNING: range is not twice the initial set size\n");
 
   /* Populate set */
-  printf("Adding %d entries to set\n", initial);
+  printf("Adding %d entries to set%s\n", initial, bench.numa_init ? " (from threads)" : "");
   i = 0;
-  while (i < initial) {
+  while (i < initial && !bench.numa_init) {
     val = rand_range(range, main_seed) + 1;
     if (set_add(set, val, 0))
       i++;
   }
   size = set_size(set);
-  printf("Set size     : %d\n", size);
+  if (!bench.numa_init)
+    printf("Set size     : %d\n", size);
 
   /* Access set from all threads */
+  threads_data = data;
+  threads_nb = nb_threads;
   barrier_init(&barrier, nb_threads + 1);
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
   for (i = 0; i < nb_threads; i++) {
     printf("Creating thread %d\n", i);
+    data[i].id = i;
+    /* Added elements are accounted for in diff */
+    data[i].initial = (bench.numa_init ? initial / nb_threads + (i == 0 ? initial % nb_threads : 0) : 0);
     data[i].range = range;
     data[i].update = update;
     data[i].alternate = alternate;
 #ifdef USE_LINKEDLIST
     data[i].unit_tx = unit_tx;
 #endif /* LINKEDLIST */
+#if defined(USE_LINKEDLIST) || defined(USE_SKIPLIST)
+    data[i].elastic = elastic;
+#endif /* defined(USE_LINKEDLIST) || defined(USE_SKIPLIST) */
     data[i].nb_add = 0;
     data[i].nb_remove = 0;
     data[i].nb_contains = 0;
@@ -1565,6 +1852,7 @@ int main(int argc, char **argv)
     data[i].locked_reads_ok = 0;
     data[i].locked_reads_failed = 0;
     data[i].max_retries = 0;
+    memset(&data[i].base, 0, sizeof(data[i].base));
 #endif /* ! TM_COMPILER */
     data[i].diff = 0;
     rand_init(data[i].seed);
@@ -1579,17 +1867,13 @@ int main(int argc, char **argv)
 
   /* Start threads */
   barrier_cross(&barrier);
+  if (bench.numa_init)
+    printf("Set size     : %d\n", initial);
+  bench_warmup(nb_threads, &stop);
 
   printf("STARTING...\n");
-  gettimeofday(&start, NULL);
-  if (duration > 0) {
-    nanosleep(&timeout, NULL);
-  } else {
-    sigemptyset(&block_set);
-    sigsuspend(&block_set);
-  }
+  bench_trials(duration, count_txs, &start, &end);
   stop = 1;
-  gettimeofday(&end, NULL);
   printf("STOPPING...\n");
 
   /* Wait for thread completion */
@@ -1691,8 +1975,13 @@ int main(int argc, char **argv)
   }
 #endif /* ! TM_COMPILER */
 
+  bench_report();
+
   /* Delete set */
   set_delete(set);
+#ifdef USE_DS
+  TM_EXIT_THREAD;
+#endif /* USE_DS */
 
   /* Cleanup STM */
   TM_EXIT;
@@ -0,0 +1,1115 @@
+/*
+ * File:
+ *   kvstore.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Key-value store benchmark: YCSB-like workloads on a transactional
+ *   hash map with string keys, variable-size values and incremental
+ *   resize.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "stm.h"
+#include "mod_batch.h"
+#include "mod_mem.h"
+#include "wrappers.h"
+
+/*
+ * Useful macros to work with transactions. Note that, to use nested
+ * transactions, one should check the environment returned by
+ * stm_get_env() and only call sigsetjmp() if it is not null.
+ */
+
+#define RO                              1
+#define RW                              0
+
+#define TM_START(tid, ro)               { stm_tx_attr_t _a = {{.id = tid, .read_only = ro}}; sigjmp_buf *_e = stm_start(_a); if (_e != NULL) sigsetjmp(*_e, 0)
+#define TM_LOAD(addr)                   stm_load((stm_word_t *)addr)
+#define TM_STORE(addr, value)           stm_store((stm_word_t *)addr, (stm_word_t)value)
+#define TM_LOAD_BYTES(addr, buf, size)  stm_load_bytes((volatile uint8_t *)(addr), (uint8_t *)(buf), size)
+#define TM_STORE_BYTES(addr, buf, size) stm_store_bytes((volatile uint8_t *)(addr), (uint8_t *)(buf), size)
+#define TM_COMMIT                       stm_commit(); }
+#define TM_MALLOC(size)                 stm_malloc(size)
+#define TM_CALLOC(nm, size)             stm_calloc(nm, size)
+#define TM_FREE2(addr, size)            stm_free(addr, size)
+
+#define TM_INIT_THREAD                  stm_init_thread()
+#define TM_EXIT_THREAD                  stm_exit_thread()
+
+#define DEFAULT_DURATION                10000
+#define DEFAULT_NB_KEYS                 16384
+#define DEFAULT_NB_BUCKETS              64
+#define DEFAULT_NB_THREADS              1
+#define DEFAULT_SEED                    0
+#define DEFAULT_WORKLOAD                "A"
+#define DEFAULT_INSERT                  0
+#define DEFAULT_VALUE_MIN               16
+#define DEFAULT_VALUE_MAX               256
+#define DEFAULT_ZIPF_THETA              0
+#define DEFAULT_BATCH                   0
+
+/* Stripes of the element counter (avoids a single hot word) */
+#define KV_STRIPES                      64
+/* Average number of elements per bucket that triggers a resize */
+#define KV_LOAD                         2
+/* Buckets migrated by each update transaction during a resize */
+#define KV_MIGRATE                      4
+/* Granularity of value buffers (values are updated in place when they fit) */
+#define KV_VALUE_ALIGN                  32
+#define KV_KEY_MAX                      32
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+/* ################################################################### *
+ * GLOBALS
+ * ################################################################### */
+
+static volatile int stop;
+
+/* ################################################################### *
+ * HASH MAP
+ * ################################################################### */
+
+/*
+ * Chained hash map.  When the number of elements exceeds KV_LOAD per
+ * bucket, a table with twice as many buckets is installed and the old
+ * table is migrated incrementally: each update transaction moves the
+ * next KV_MIGRATE buckets and replaces them by KV_MOVED.  Until then,
+ * keys of buckets that have not moved yet are looked up (and inserted)
+ * in the old table.  Readers do not access the migration cursor.  Old
+ * tables are only freed with the map: without epoch-based GC, readers
+ * could otherwise access freed buckets.  Keys are immutable and written
+ * before nodes are published; values are copied with stm_load_bytes()
+ * and stm_store_bytes().
+ */
+
+typedef struct kv_node {
+  struct kv_node *next;
+  stm_word_t hash;
+  stm_word_t klen;
+  stm_word_t vlen;
+  stm_word_t vcap;
+  uint8_t *value;
+  char key[];
+} kv_node_t;
+
+typedef struct kv_table {
+  stm_word_t size;                      /* Power of 2 (immutable) */
+  kv_node_t **buckets;                  /* (immutable) */
+  struct kv_table *prev;                /* Previous (retired) table */
+} kv_table_t;
+
+typedef struct kv_map {
+  kv_table_t *table;                    /* Current table */
+  kv_table_t *old;                      /* Table being migrated (or NULL) */
+  stm_word_t migrated;                  /* Buckets of old table already moved */
+  stm_word_t resizes;
+  stm_word_t count[KV_STRIPES];
+} kv_map_t;
+
+static kv_node_t kv_moved;
+#define KV_MOVED                        (&kv_moved)
+
+/* FNV-1a */
+static stm_word_t kv_hash(const char *key, size_t klen)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  while (klen-- > 0) {
+    h ^= (unsigned char)*key++;
+    h *= 1099511628211ULL;
+  }
+  return (stm_word_t)h;
+}
+
+static kv_table_t *kv_table_new(stm_word_t size, kv_table_t *prev)
+{
+  kv_table_t *t;
+
+  if ((t = (kv_table_t *)malloc(sizeof(kv_table_t))) == NULL ||
+      (t->buckets = (kv_node_t **)calloc(size, sizeof(kv_node_t *))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  t->size = size;
+  t->prev = prev;
+  return t;
+}
+
+static kv_map_t *kv_new(stm_word_t size)
+{
+  kv_map_t *map;
+
+  if ((map = (kv_map_t *)calloc(1, sizeof(kv_map_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  map->table = kv_table_new(size, NULL);
+  return map;
+}
+
+/* Called outside of transactions */
+static void kv_delete(kv_map_t *map)
+{
+  kv_table_t *t, *prev;
+  kv_node_t *n, *next;
+  stm_word_t i;
+
+  for (t = map->table; t != NULL; t = prev) {
+    for (i = 0; i < t->size; i++) {
+      for (n = t->buckets[i]; n != NULL && n != KV_MOVED; n = next) {
+        next = n->next;
+        mod_mem_free(n->value);
+        mod_mem_free(n);
+      }
+    }
+    prev = t->prev;
+    /* Larger tables have been allocated by transactions */
+    mod_mem_free(t->buckets);
+    mod_mem_free(t);
+  }
+  free(map);
+}
+
+/* Bucket of key: in old table if it has not moved yet */
+static kv_node_t **kv_bucket(kv_map_t *map, stm_word_t hash)
+{
+  kv_table_t *t;
+  kv_node_t **b;
+
+  t = (kv_table_t *)TM_LOAD(&map->old);
+  if (t != NULL) {
+    b = &t->buckets[hash & (t->size - 1)];
+    if ((kv_node_t *)TM_LOAD(b) != KV_MOVED)
+      return b;
+  }
+  t = (kv_table_t *)TM_LOAD(&map->table);
+  return &t->buckets[hash & (t->size - 1)];
+}
+
+/* Node with key (or NULL) */
+static kv_node_t *kv_find(kv_node_t **b, stm_word_t hash, const char *key, size_t klen)
+{
+  kv_node_t *n;
+  char buf[KV_KEY_MAX];
+
+  for (n = (kv_node_t *)TM_LOAD(b); n != NULL; n = (kv_node_t *)TM_LOAD(&n->next)) {
+    if ((stm_word_t)TM_LOAD(&n->hash) == hash && (size_t)TM_LOAD(&n->klen) == klen) {
+      TM_LOAD_BYTES(n->key, buf, klen);
+      if (memcmp(buf, key, klen) == 0)
+        return n;
+    }
+  }
+  return NULL;
+}
+
+/* Move some buckets of the old table (in update transactions) */
+static void kv_migrate(kv_map_t *map)
+{
+  kv_table_t *old, *t;
+  kv_node_t *n, *next, **b;
+  stm_word_t m;
+  int i;
+
+  if ((old = (kv_table_t *)TM_LOAD(&map->old)) == NULL)
+    return;
+  t = (kv_table_t *)TM_LOAD(&map->table);
+  m = (stm_word_t)TM_LOAD(&map->migrated);
+  for (i = 0; i < KV_MIGRATE && m < old->size; i++, m++) {
+    for (n = (kv_node_t *)TM_LOAD(&old->buckets[m]); n != NULL; n = next) {
+      next = (kv_node_t *)TM_LOAD(&n->next);
+      b = &t->buckets[(stm_word_t)TM_LOAD(&n->hash) & (t->size - 1)];
+      TM_STORE(&n->next, TM_LOAD(b));
+      TM_STORE(b, n);
+    }
+    TM_STORE(&old->buckets[m], KV_MOVED);
+  }
+  if (m == old->size) {
+    TM_STORE(&map->old, NULL);
+    m = 0;
+  }
+  TM_STORE(&map->migrated, m);
+}
+
+/* Install a larger table (in update transactions) */
+static void kv_grow(kv_map_t *map)
+{
+  kv_table_t *t, *nt;
+
+  if ((kv_table_t *)TM_LOAD(&map->old) != NULL)
+    return;
+  t = (kv_table_t *)TM_LOAD(&map->table);
+  nt = (kv_table_t *)TM_MALLOC(sizeof(kv_table_t));
+  nt->size = t->size * 2;
+  nt->buckets = (kv_node_t **)TM_CALLOC(nt->size, sizeof(kv_node_t *));
+  nt->prev = t;
+  TM_STORE(&map->old, t);
+  TM_STORE(&map->table, nt);
+  TM_STORE(&map->resizes, TM_LOAD(&map->resizes) + 1);
+}
+
+/* Copy value into node (reallocate buffer if too small) */
+static void kv_set_value(kv_node_t *n, uint8_t *value, size_t vlen)
+{
+  uint8_t *v;
+  size_t vcap;
+
+  vcap = (size_t)TM_LOAD(&n->vcap);
+  if (vlen > vcap) {
+    v = (uint8_t *)TM_LOAD(&n->value);
+    if (v != NULL)
+      TM_FREE2(v, vcap);
+    vcap = (vlen + KV_VALUE_ALIGN - 1) & ~(size_t)(KV_VALUE_ALIGN - 1);
+    v = (uint8_t *)TM_MALLOC(vcap);
+    TM_STORE(&n->value, v);
+    TM_STORE(&n->vcap, vcap);
+  } else
+    v = (uint8_t *)TM_LOAD(&n->value);
+  TM_STORE_BYTES(v, value, vlen);
+  TM_STORE(&n->vlen, vlen);
+}
+
+/* Returns the length of the value (0 if not found) */
+static size_t kv_get(kv_map_t *map, const char *key, size_t klen, stm_word_t hash, uint8_t *value)
+{
+  kv_node_t *n;
+  size_t vlen;
+
+  TM_START(0, RO);
+  vlen = 0;
+  if ((n = kv_find(kv_bucket(map, hash), hash, key, klen)) != NULL) {
+    vlen = (size_t)TM_LOAD(&n->vlen);
+    TM_LOAD_BYTES((uint8_t *)TM_LOAD(&n->value), value, vlen);
+  }
+  TM_COMMIT;
+
+  return vlen;
+}
+
+/* Returns 1 if found */
+static int kv_update(kv_map_t *map, const char *key, size_t klen, stm_word_t hash, uint8_t *value, size_t vlen)
+{
+  kv_node_t *n;
+
+  TM_START(1, RW);
+  kv_migrate(map);
+  if ((n = kv_find(kv_bucket(map, hash), hash, key, klen)) != NULL)
+    kv_set_value(n, value, vlen);
+  TM_COMMIT;
+
+  return n != NULL;
+}
+
+/*
+ * Update buffered in a batch (see mod_batch.h).  Records are indexed by
+ * their position in the batch: the previous update of a record has
+ * committed when the record is reused.
+ */
+typedef struct kv_batch_rec {
+  kv_map_t *map;
+  char key[KV_KEY_MAX];
+  size_t klen;
+  stm_word_t hash;
+  uint8_t *value;
+  size_t vlen;
+  int found;
+  int valid;
+} kv_batch_rec_t;
+
+static void kv_batch_update(void *arg)
+{
+  kv_batch_rec_t *r = (kv_batch_rec_t *)arg;
+
+  r->found = kv_update(r->map, r->key, r->klen, r->hash, r->value, r->vlen);
+}
+
+/* Read-modify-write: new value has the next byte of the old one (returns old length) */
+static size_t kv_rmw(kv_map_t *map, const char *key, size_t klen, stm_word_t hash, uint8_t *value, size_t vlen, uint8_t *old)
+{
+  kv_node_t *n;
+  size_t olen;
+
+  TM_START(2, RW);
+  olen = 0;
+  kv_migrate(map);
+  if ((n = kv_find(kv_bucket(map, hash), hash, key, klen)) != NULL) {
+    olen = (size_t)TM_LOAD(&n->vlen);
+    TM_LOAD_BYTES((uint8_t *)TM_LOAD(&n->value), old, olen);
+    memset(value, (uint8_t)(old[0] + 1), vlen);
+    kv_set_value(n, value, vlen);
+  }
+  TM_COMMIT;
+
+  return olen;
+}
+
+/* Returns 1 if inserted */
+static int kv_insert(kv_map_t *map, const char *key, size_t klen, stm_word_t hash, uint8_t *value, size_t vlen)
+{
+  kv_table_t *t;
+  kv_node_t *n, **b;
+  stm_word_t c;
+  int s, ret;
+
+  TM_START(3, RW);
+  ret = 0;
+  kv_migrate(map);
+  b = kv_bucket(map, hash);
+  if ((n = kv_find(b, hash, key, klen)) == NULL) {
+    /* Not visible to other transactions before commit */
+    n = (kv_node_t *)TM_MALLOC(sizeof(kv_node_t) + klen);
+    n->hash = hash;
+    n->klen = klen;
+    n->vlen = 0;
+    n->vcap = 0;
+    n->value = NULL;
+    memcpy(n->key, key, klen);
+    kv_set_value(n, value, vlen);
+    TM_STORE(&n->next, TM_LOAD(b));
+    TM_STORE(b, n);
+    s = hash % KV_STRIPES;
+    c = (stm_word_t)TM_LOAD(&map->count[s]) + 1;
+    TM_STORE(&map->count[s], c);
+    t = (kv_table_t *)TM_LOAD(&map->table);
+    if (c * KV_STRIPES > t->size * KV_LOAD)
+      kv_grow(map);
+    ret = 1;
+  }
+  TM_COMMIT;
+
+  return ret;
+}
+
+/* Check values and count elements (called outside of transactions) */
+static long kv_check(kv_map_t *map, size_t vmin, size_t vmax)
+{
+  kv_table_t *t;
+  kv_node_t *n;
+  stm_word_t i, j;
+  long nb;
+
+  nb = 0;
+  for (t = map->table; t != NULL; t = (t == map->table ? map->old : NULL)) {
+    for (i = 0; i < t->size; i++) {
+      for (n = t->buckets[i]; n != NULL && n != KV_MOVED; n = n->next) {
+        if (n->vlen < vmin || n->vlen > vmax || n->vlen > n->vcap)
+          return -1;
+        for (j = 1; j < n->vlen; j++) {
+          if (n->value[j] != n->value[0])
+            return -1;
+        }
+        nb++;
+      }
+    }
+  }
+  return nb;
+}
+
+/* ################################################################### *
+ * KEY DISTRIBUTION
+ * ################################################################### */
+
+typedef struct dist {
+  long range;
+  double theta;
+  double *cdf;                          /* Zipf (rank 0 is the most popular) */
+} dist_t;
+
+static void dist_init(dist_t *d, long range, double theta)
+{
+  long i;
+  double sum;
+
+  d->range = range;
+  d->theta = theta;
+  d->cdf = NULL;
+  if (theta > 0) {
+    if ((d->cdf = (double *)malloc(range * sizeof(double))) == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    sum = 0;
+    for (i = 0; i < range; i++) {
+      sum += 1.0 / pow((double)(i + 1), theta);
+      d->cdf[i] = sum;
+    }
+    for (i = 0; i < range; i++)
+      d->cdf[i] /= sum;
+  }
+}
+
+static long dist_next(dist_t *d, unsigned short *seed)
+{
+  long lo, hi, mid;
+  double u;
+
+  u = erand48(seed);
+  if (d->cdf == NULL)
+    return (long)(u * d->range);
+  lo = 0;
+  hi = d->range - 1;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (d->cdf[mid] <= u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* ################################################################### *
+ * BARRIER
+ * ################################################################### */
+
+typedef struct barrier {
+  pthread_cond_t complete;
+  pthread_mutex_t mutex;
+  int count;
+  int crossing;
+} barrier_t;
+
+static void barrier_init(barrier_t *b, int n)
+{
+  pthread_cond_init(&b->complete, NULL);
+  pthread_mutex_init(&b->mutex, NULL);
+  b->count = n;
+  b->crossing = 0;
+}
+
+static void barrier_cross(barrier_t *b)
+{
+  pthread_mutex_lock(&b->mutex);
+  /* One more thread through */
+  b->crossing++;
+  /* If not all here, wait */
+  if (b->crossing < b->count) {
+    pthread_cond_wait(&b->complete, &b->mutex);
+  } else {
+    pthread_cond_broadcast(&b->complete);
+    /* Reset for next time */
+    b->crossing = 0;
+  }
+  pthread_mutex_unlock(&b->mutex);
+}
+
+/* ################################################################### *
+ * STRESS TEST
+ * ################################################################### */
+
+typedef struct thread_data {
+  kv_map_t *map;
+  dist_t *dist;
+  barrier_t *barrier;
+  unsigned long nb_read;
+  unsigned long nb_found;
+  unsigned long nb_update;
+  unsigned long nb_rmw;
+  unsigned long nb_insert;
+  unsigned long nb_errors;
+  unsigned long nb_aborts;
+  unsigned long nb_aborts_1;
+  unsigned long nb_aborts_2;
+  unsigned long nb_aborts_locked_read;
+  unsigned long nb_aborts_locked_write;
+  unsigned long nb_aborts_validate_read;
+  unsigned long nb_aborts_validate_write;
+  unsigned long nb_aborts_validate_commit;
+  unsigned long nb_aborts_invalid_memory;
+  unsigned long nb_aborts_killed;
+  unsigned long max_retries;
+  unsigned int seed;
+  int id;
+  int nb_threads;
+  long next_key;
+  int read;
+  int update;
+  int insert;
+  int vmin;
+  int vmax;
+  int batch;
+  char padding[64];
+} thread_data_t;
+
+static size_t make_key(char *key, long k)
+{
+  return (size_t)snprintf(key, KV_KEY_MAX, "user%ld", k);
+}
+
+static void *test(void *data)
+{
+  thread_data_t *d = (thread_data_t *)data;
+  unsigned short seed[3];
+  char key[KV_KEY_MAX];
+  uint8_t *value, *buf;
+  size_t klen, vlen, len;
+  stm_word_t hash;
+  kv_batch_rec_t *recs, *r;
+  int i, op;
+
+  /* Initialize seed (use rand48 as rand is poor) */
+  seed[0] = (unsigned short)rand_r(&d->seed);
+  seed[1] = (unsigned short)rand_r(&d->seed);
+  seed[2] = (unsigned short)rand_r(&d->seed);
+
+  if ((value = (uint8_t *)malloc(2 * d->vmax)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  buf = value + d->vmax;
+  recs = NULL;
+  if (d->batch > 0) {
+    if ((recs = (kv_batch_rec_t *)calloc(d->batch, sizeof(kv_batch_rec_t))) == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    for (i = 0; i < d->batch; i++) {
+      if ((recs[i].value = (uint8_t *)malloc(d->vmax)) == NULL) {
+        perror("malloc");
+        exit(1);
+      }
+      recs[i].map = d->map;
+    }
+  }
+
+  /* Create transaction */
+  TM_INIT_THREAD;
+  if (d->batch > 0)
+    stm_batch_begin();
+  /* Wait on barrier */
+  barrier_cross(d->barrier);
+
+  while (stop == 0) {
+    op = (int)(erand48(seed) * 100);
+    /* Value to write */
+    vlen = d->vmin + (size_t)(erand48(seed) * (d->vmax - d->vmin + 1));
+    memset(value, (int)(erand48(seed) * 256), vlen);
+    if (op < d->insert) {
+      /* Keys of threads are disjoint */
+      klen = make_key(key, d->next_key);
+      d->next_key += d->nb_threads;
+      if (kv_insert(d->map, key, klen, kv_hash(key, klen), value, vlen))
+        d->nb_insert++;
+      continue;
+    }
+    klen = make_key(key, dist_next(d->dist, seed));
+    hash = kv_hash(key, klen);
+    op = (int)(erand48(seed) * 100);
+    if (op < d->read + d->update && op >= d->read && d->batch > 0) {
+      r = &recs[stm_batch_pending()];
+      if (r->valid && r->found)
+        d->nb_found++;
+      memcpy(r->key, key, klen);
+      r->klen = klen;
+      r->hash = hash;
+      memcpy(r->value, value, vlen);
+      r->vlen = vlen;
+      r->valid = 1;
+      stm_batch_op(kv_batch_update, r);
+      d->nb_update++;
+      continue;
+    }
+    if (op < d->read + d->update && op >= d->read) {
+      if (kv_update(d->map, key, klen, hash, value, vlen))
+        d->nb_found++;
+      d->nb_update++;
+      continue;
+    }
+    if (op < d->read) {
+      len = kv_get(d->map, key, klen, hash, buf);
+      d->nb_read++;
+    } else {
+      len = kv_rmw(d->map, key, klen, hash, value, vlen, buf);
+      d->nb_rmw++;
+    }
+    if (len != 0) {
+      d->nb_found++;
+      /* Values are sequences of identical bytes */
+      for (vlen = 1; vlen < len && buf[vlen] == buf[0]; vlen++)
+        ;
+      if (len < (size_t)d->vmin || len > (size_t)d->vmax || vlen != len)
+        d->nb_errors++;
+    }
+  }
+  if (d->batch > 0) {
+    stm_batch_flush();
+    for (i = 0; i < d->batch; i++) {
+      if (recs[i].valid && recs[i].found)
+        d->nb_found++;
+      free(recs[i].value);
+    }
+    free(recs);
+  }
+  stm_get_stats("nb_aborts", &d->nb_aborts);
+  stm_get_stats("nb_aborts_1", &d->nb_aborts_1);
+  stm_get_stats("nb_aborts_2", &d->nb_aborts_2);
+  stm_get_stats("nb_aborts_locked_read", &d->nb_aborts_locked_read);
+  stm_get_stats("nb_aborts_locked_write", &d->nb_aborts_locked_write);
+  stm_get_stats("nb_aborts_validate_read", &d->nb_aborts_validate_read);
+  stm_get_stats("nb_aborts_validate_write", &d->nb_aborts_validate_write);
+  stm_get_stats("nb_aborts_validate_commit", &d->nb_aborts_validate_commit);
+  stm_get_stats("nb_aborts_invalid_memory", &d->nb_aborts_invalid_memory);
+  stm_get_stats("nb_aborts_killed", &d->nb_aborts_killed);
+  stm_get_stats("max_retries", &d->max_retries);
+  /* Free transaction */
+  TM_EXIT_THREAD;
+
+  free(value);
+
+  return NULL;
+}
+
+static void catcher(int sig)
+{
+  static int nb = 0;
+  printf("CAUGHT SIGNAL %d\n", sig);
+  if (++nb >= 3)
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"buckets",                   required_argument, NULL, 'b'},
+    {"batch",                     required_argument, NULL, 'B'},
+    {"contention-manager",        required_argument, NULL, 'c'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"insert-rate",               required_argument, NULL, 'i'},
+    {"keys",                      required_argument, NULL, 'k'},
+    {"memory",                    required_argument, NULL, 'm'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {"seed",                      required_argument, NULL, 's'},
+    {"values",                    required_argument, NULL, 'v'},
+    {"workload",                  required_argument, NULL, 'w'},
+    {"zipf",                      required_argument, NULL, 'z'},
+    {NULL, 0, NULL, 0}
+  };
+
+  kv_map_t *map;
+  dist_t dist;
+  int i, c, ret;
+  long k, nb, expected;
+  unsigned long reads, found, updates, rmws, inserts, errors, txs;
+  char *s;
+  unsigned long aborts, aborts_1, aborts_2,
+    aborts_locked_read, aborts_locked_write,
+    aborts_validate_read, aborts_validate_write, aborts_validate_commit,
+    aborts_invalid_memory, aborts_killed, max_retries;
+  char key[KV_KEY_MAX];
+  uint8_t *value;
+  size_t klen, vlen;
+  char *cm = NULL;
+  char *mem = NULL;
+  thread_data_t *data;
+  pthread_t *threads;
+  pthread_attr_t attr;
+  barrier_t barrier;
+  struct timeval start, end;
+  struct timespec timeout;
+  unsigned short seed48[3];
+  int duration = DEFAULT_DURATION;
+  long nb_keys = DEFAULT_NB_KEYS;
+  long nb_buckets = DEFAULT_NB_BUCKETS;
+  int nb_threads = DEFAULT_NB_THREADS;
+  int seed = DEFAULT_SEED;
+  const char *workload = DEFAULT_WORKLOAD;
+  int insert = DEFAULT_INSERT;
+  int vmin = DEFAULT_VALUE_MIN;
+  int vmax = DEFAULT_VALUE_MAX;
+  double theta = DEFAULT_ZIPF_THETA;
+  int batch = DEFAULT_BATCH;
+  stm_batch_stats_t bstats;
+  int read, update;
+  sigset_t block_set;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hb:B:c:d:i:k:m:n:s:v:w:z:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("kvstore -- STM key-value store benchmark\n"
+              "\n"
+              "Usage:\n"
+              "  kvstore [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -b, --buckets <int>\n"
+              "        Initial number of buckets, rounded up to a power of 2 (default=" XSTR(DEFAULT_NB_BUCKETS) ")\n"
+              "  -B, --batch <int>\n"
+              "        Maximum number of updates executed in one transaction (0=no batching, default=" XSTR(DEFAULT_BATCH) ")\n"
+              "  -c, --contention-manager <string>\n"
+              "        Contention manager for resolving conflicts (default=suicide)\n"
+              "  -d, --duration <int>\n"
+              "        Test duration in milliseconds (0=infinite, default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -i, --insert-rate <int>\n"
+              "        Percentage of operations inserting new keys (default=" XSTR(DEFAULT_INSERT) ")\n"
+              "  -k, --keys <int>\n"
+              "        Number of keys loaded initially and accessed by operations (default=" XSTR(DEFAULT_NB_KEYS) ")\n"
+              "  -m, --memory <string>\n"
+              "        Memory allocation: malloc or arena (default=malloc)\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -s, --seed <int>\n"
+              "        RNG seed (0=time-based, default=" XSTR(DEFAULT_SEED) ")\n"
+              "  -v, --values <int>[:<int>]\n"
+              "        Minimum and maximum size of values in bytes (default=" XSTR(DEFAULT_VALUE_MIN) ":" XSTR(DEFAULT_VALUE_MAX) ")\n"
+              "  -w, --workload <string>\n"
+              "        YCSB workload (default=" DEFAULT_WORKLOAD ")\n"
+              "          A: 50%% reads, 50%% updates\n"
+              "          B: 95%% reads, 5%% updates\n"
+              "          C: 100%% reads\n"
+              "          F: 50%% reads, 50%% read-modify-writes\n"
+              "  -z, --zipf <double>\n"
+              "        Zipf parameter of key popularity (0=uniform, default=" XSTR(DEFAULT_ZIPF_THETA) ")\n"
+         );
+       exit(0);
+     case 'b':
+       nb_buckets = atol(optarg);
+       break;
+     case 'B':
+       batch = atoi(optarg);
+       break;
+     case 'c':
+       cm = optarg;
+       break;
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'i':
+       insert = atoi(optarg);
+       break;
+     case 'k':
+       nb_keys = atol(optarg);
+       break;
+     case 'm':
+       mem = optarg;
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case 's':
+       seed = atoi(optarg);
+       break;
+     case 'v':
+       vmin = vmax = (int)strtol(optarg, &s, 10);
+       if (*s == ':')
+         vmax = atoi(s + 1);
+       break;
+     case 'w':
+       workload = optarg;
+       break;
+     case 'z':
+       theta = atof(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  switch (workload[0] == '\0' || workload[1] == '\0' ? workload[0] : 0) {
+   case 'A': case 'a': read = 50; update = 50; break;
+   case 'B': case 'b': read = 95; update = 5; break;
+   case 'C': case 'c': read = 100; update = 0; break;
+   case 'F': case 'f': read = 50; update = 0; break;
+   default:
+     fprintf(stderr, "Invalid workload \"%s\"\n", workload);
+     exit(1);
+  }
+
+  assert(duration >= 0);
+  assert(nb_keys > 0);
+  assert(nb_buckets > 0);
+  assert(nb_threads > 0);
+  assert(batch >= 0);
+  assert(insert >= 0 && insert <= 100);
+  assert(vmin > 0 && vmin <= vmax);
+  assert(theta >= 0);
+  assert(mem == NULL || strcmp(mem, "malloc") == 0 || strcmp(mem, "arena") == 0);
+
+  for (c = 1; c < nb_buckets; c *= 2)
+    ;
+  nb_buckets = c;
+
+  printf("Nb keys        : %ld\n", nb_keys);
+  printf("Nb buckets     : %ld\n", nb_buckets);
+  printf("Batch          : %d\n", batch);
+  printf("CM             : %s\n", (cm == NULL ? "DEFAULT" : cm));
+  printf("Duration       : %d\n", duration);
+  printf("Insert rate    : %d\n", insert);
+  printf("Memory         : %s\n", (mem == NULL ? "malloc" : mem));
+  printf("Nb threads     : %d\n", nb_threads);
+  printf("Seed           : %d\n", seed);
+  printf("Values         : %d-%d bytes\n", vmin, vmax);
+  printf("Workload       : %s\n", workload);
+  printf("Zipf           : %g\n", theta);
+
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+
+  if ((data = (thread_data_t *)malloc(nb_threads * sizeof(thread_data_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  if ((threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  if (seed == 0)
+    srand((int)time(NULL));
+  else
+    srand(seed);
+
+  dist_init(&dist, nb_keys, theta);
+  map = kv_new(nb_buckets);
+  stop = 0;
+
+  /* Init STM */
+  printf("Initializing STM\n");
+  stm_init();
+  /* Epoch-based GC (if available) prevents freed values from being reused while being read */
+  if (mem != NULL && strcmp(mem, "arena") == 0)
+    mod_mem_init_arena(1);
+  else
+    mod_mem_init(1);
+  if (batch > 0)
+    mod_batch_init(batch);
+
+  if (stm_get_parameter("compile_flags", &s))
+    printf("STM flags      : %s\n", s);
+
+  if (cm != NULL) {
+    if (stm_set_parameter("cm_policy", cm) == 0)
+      printf("WARNING: cannot set contention manager \"%s\"\n", cm);
+  }
+
+  /* Populate map (with resizes) */
+  TM_INIT_THREAD;
+  if ((value = (uint8_t *)malloc(vmax)) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  seed48[0] = (unsigned short)rand();
+  seed48[1] = (unsigned short)rand();
+  seed48[2] = (unsigned short)rand();
+  for (k = 0; k < nb_keys; k++) {
+    klen = make_key(key, k);
+    vlen = vmin + (size_t)(erand48(seed48) * (vmax - vmin + 1));
+    memset(value, (int)(erand48(seed48) * 256), vlen);
+    kv_insert(map, key, klen, kv_hash(key, klen), value, vlen);
+  }
+  free(value);
+  printf("Resizes        : %lu (%lu buckets)\n", (unsigned long)map->resizes, (unsigned long)map->table->size);
+
+  /* Access set from all threads */
+  barrier_init(&barrier, nb_threads + 1);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < nb_threads; i++) {
+    printf("Creating thread %d\n", i);
+    memset(&data[i], 0, sizeof(data[i]));
+    data[i].id = i;
+    data[i].nb_threads = nb_threads;
+    data[i].next_key = nb_keys + i;
+    data[i].read = read;
+    data[i].update = update;
+    data[i].insert = insert;
+    data[i].vmin = vmin;
+    data[i].vmax = vmax;
+    data[i].batch = batch;
+    data[i].seed = rand();
+    data[i].map = map;
+    data[i].dist = &dist;
+    data[i].barrier = &barrier;
+    if (pthread_create(&threads[i], &attr, test, (void *)(&data[i])) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+
+  /* Catch some signals */
+  if (signal(SIGHUP, catcher) == SIG_ERR ||
+      signal(SIGINT, catcher) == SIG_ERR ||
+      signal(SIGTERM, catcher) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  /* Start threads */
+  barrier_cross(&barrier);
+
+  printf("STARTING...\n");
+  gettimeofday(&start, NULL);
+  if (duration > 0) {
+    nanosleep(&timeout, NULL);
+  } else {
+    sigemptyset(&block_set);
+    sigsuspend(&block_set);
+  }
+  stop = 1;
+  gettimeofday(&end, NULL);
+  printf("STOPPING...\n");
+
+  /* Wait for thread completion */
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+
+  duration = (end.tv_sec * 1000 + end.tv_usec / 1000) - (start.tv_sec * 1000 + start.tv_usec / 1000);
+  aborts = 0;
+  aborts_1 = 0;
+  aborts_2 = 0;
+  aborts_locked_read = 0;
+  aborts_locked_write = 0;
+  aborts_validate_read = 0;
+  aborts_validate_write = 0;
+  aborts_validate_commit = 0;
+  aborts_invalid_memory = 0;
+  aborts_killed = 0;
+  max_retries = 0;
+  reads = 0;
+  found = 0;
+  updates = 0;
+  rmws = 0;
+  inserts = 0;
+  errors = 0;
+  for (i = 0; i < nb_threads; i++) {
+    printf("Thread %d\n", i);
+    printf("  #read       : %lu\n", data[i].nb_read);
+    printf("  #update     : %lu\n", data[i].nb_update);
+    printf("  #rmw        : %lu\n", data[i].nb_rmw);
+    printf("  #insert     : %lu\n", data[i].nb_insert);
+    printf("  #aborts     : %lu\n", data[i].nb_aborts);
+    printf("    #lock-r   : %lu\n", data[i].nb_aborts_locked_read);
+    printf("    #lock-w   : %lu\n", data[i].nb_aborts_locked_write);
+    printf("    #val-r    : %lu\n", data[i].nb_aborts_validate_read);
+    printf("    #val-w    : %lu\n", data[i].nb_aborts_validate_write);
+    printf("    #val-c    : %lu\n", data[i].nb_aborts_validate_commit);
+    printf("    #inv-mem  : %lu\n", data[i].nb_aborts_invalid_memory);
+    printf("    #killed   : %lu\n", data[i].nb_aborts_killed);
+    printf("  #aborts>=1  : %lu\n", data[i].nb_aborts_1);
+    printf("  #aborts>=2  : %lu\n", data[i].nb_aborts_2);
+    printf("  Max retries : %lu\n", data[i].max_retries);
+    aborts += data[i].nb_aborts;
+    aborts_1 += data[i].nb_aborts_1;
+    aborts_2 += data[i].nb_aborts_2;
+    aborts_locked_read += data[i].nb_aborts_locked_read;
+    aborts_locked_write += data[i].nb_aborts_locked_write;
+    aborts_validate_read += data[i].nb_aborts_validate_read;
+    aborts_validate_write += data[i].nb_aborts_validate_write;
+    aborts_validate_commit += data[i].nb_aborts_validate_commit;
+    aborts_invalid_memory += data[i].nb_aborts_invalid_memory;
+    aborts_killed += data[i].nb_aborts_killed;
+    if (max_retries < data[i].max_retries)
+      max_retries = data[i].max_retries;
+    reads += data[i].nb_read;
+    found += data[i].nb_found;
+    updates += data[i].nb_update;
+    rmws += data[i].nb_rmw;
+    inserts += data[i].nb_insert;
+    errors += data[i].nb_errors;
+  }
+  txs = reads + updates + rmws + inserts;
+  /* Sanity check */
+  nb = kv_check(map, vmin, vmax);
+  expected = nb_keys + (long)inserts;
+  ret = (nb != expected || errors != 0 || found != reads + updates + rmws);
+  printf("Map size      : %ld (expected: %ld)\n", nb, expected);
+  printf("Buckets       : %lu\n", (unsigned long)map->table->size);
+  printf("Resizes       : %lu%s\n", (unsigned long)map->resizes, map->old != NULL ? " (in progress)" : "");
+  printf("#errors       : %lu\n", errors);
+  printf("#not found    : %lu\n", reads + updates + rmws - found);
+  printf("Duration      : %d (ms)\n", duration);
+  printf("#txs          : %lu (%f / s)\n", txs, txs * 1000.0 / duration);
+  printf("#read txs     : %lu (%f / s)\n", reads, reads * 1000.0 / duration);
+  printf("#update txs   : %lu (%f / s)\n", updates, updates * 1000.0 / duration);
+  printf("#rmw txs      : %lu (%f / s)\n", rmws, rmws * 1000.0 / duration);
+  printf("#insert txs   : %lu (%f / s)\n", inserts, inserts * 1000.0 / duration);
+  printf("#aborts       : %lu (%f / s)\n", aborts, aborts * 1000.0 / duration);
+  printf("  #lock-r     : %lu (%f / s)\n", aborts_locked_read, aborts_locked_read * 1000.0 / duration);
+  printf("  #lock-w     : %lu (%f / s)\n", aborts_locked_write, aborts_locked_write * 1000.0 / duration);
+  printf("  #val-r      : %lu (%f / s)\n", aborts_validate_read, aborts_validate_read * 1000.0 / duration);
+  printf("  #val-w      : %lu (%f / s)\n", aborts_validate_write, aborts_validate_write * 1000.0 / duration);
+  printf("  #val-c      : %lu (%f / s)\n", aborts_validate_commit, aborts_validate_commit * 1000.0 / duration);
+  printf("  #inv-mem    : %lu (%f / s)\n", aborts_invalid_memory, aborts_invalid_memory * 1000.0 / duration);
+  printf("  #killed     : %lu (%f / s)\n", aborts_killed, aborts_killed * 1000.0 / duration);
+  printf("#aborts>=1    : %lu (%f / s)\n", aborts_1, aborts_1 * 1000.0 / duration);
+  printf("#aborts>=2    : %lu (%f / s)\n", aborts_2, aborts_2 * 1000.0 / duration);
+  printf("Max retries   : %lu\n", max_retries);
+  if (batch > 0) {
+    stm_batch_stats(&bstats);
+    printf("#batches      : %lu (%f / s)\n", bstats.batches, bstats.batches * 1000.0 / duration);
+    printf("  #ops        : %lu (%f / s)\n", bstats.ops, bstats.ops * 1000.0 / duration);
+    printf("  #aborts     : %lu\n", bstats.aborts);
+    printf("  #splits     : %lu\n", bstats.splits);
+    printf("  Avg size    : %f\n", bstats.batches == 0 ? 0.0 : (double)bstats.ops / bstats.batches);
+    for (i = 1; i < STM_BATCH_HIST_SIZE; i++) {
+      if (bstats.size_hist[i] != 0)
+        printf("  Size %5lu+ : %lu\n", 1UL << (i - 1), bstats.size_hist[i]);
+    }
+  }
+
+  /* Delete map */
+  kv_delete(map);
+  free(dist.cdf);
+
+  /* Cleanup STM */
+  TM_EXIT_THREAD;
+  stm_exit();
+
+  free(threads);
+  free(data);
+
+  return ret;
+}
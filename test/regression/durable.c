@@ -0,0 +1,244 @@
+/*
+ * File:
+ *   durable.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for recovery of durable transactions (requires
+ *   DURABLE_TX).  Child processes update all words of a file in large
+ *   transactions and are killed at random times; recovery must leave
+ *   all words with the same value.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "stm.h"
+
+#define DEFAULT_NB_ROUNDS               16
+/* More than the default DURABLE_LOG_SIZE (logs are extended) */
+#define DEFAULT_NB_WORDS                10000
+#define DATA_ADDR                       ((void *)0x200000000000UL)
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static int nb_words = DEFAULT_NB_WORDS;
+static char data_path[64];
+
+/*
+ * Map persistent data (at the same address in all processes) and
+ * recover interrupted transactions.
+ */
+static stm_word_t *open_data(void)
+{
+  stm_word_t *data;
+  int fd;
+
+  if ((fd = open(data_path, O_RDWR)) < 0) {
+    perror("open");
+    exit(1);
+  }
+  data = (stm_word_t *)mmap(DATA_ADDR, nb_words * sizeof(stm_word_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data != DATA_ADDR) {
+    fprintf(stderr, "Cannot map data at %p\n", DATA_ADDR);
+    exit(1);
+  }
+  stm_init();
+  return data;
+}
+
+/*
+ * Return value of all words (exit if they differ).
+ */
+static stm_word_t check_data(stm_word_t *data)
+{
+  int i;
+
+  for (i = 1; i < nb_words; i++) {
+    if (data[i] != data[0]) {
+      fprintf(stderr, "Inconsistent data: word %d is %lu, word 0 is %lu\n", i, (unsigned long)data[i], (unsigned long)data[0]);
+      exit(2);
+    }
+  }
+  return data[0];
+}
+
+/*
+ * Update all words until killed.
+ */
+static void update(int fd)
+{
+  stm_word_t *data, v;
+  unsigned long recovered;
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  int i;
+
+  data = open_data();
+  v = check_data(data);
+  if (!stm_get_parameter("durable_recovered", &recovered))
+    recovered = 0;
+  /* Tell parent that recovery succeeded */
+  if (write(fd, &recovered, sizeof(recovered)) != sizeof(recovered))
+    exit(1);
+  stm_init_thread();
+  memset(&attr, 0, sizeof(attr));
+  while (1) {
+    v++;
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    for (i = 0; i < nb_words; i++)
+      stm_store(&data[i], v);
+    stm_commit();
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"rounds",                    required_argument, NULL, 'r'},
+    {"words",                     required_argument, NULL, 'w'},
+    {NULL, 0, NULL, 0}
+  };
+
+  char dir[] = "/tmp/durable-XXXXXX";
+  char log_path[64];
+  const char *flags;
+  unsigned long recovered, total;
+  struct timespec delay;
+  stm_word_t *data;
+  int i, c, fd, nb_rounds, status, p[2];
+  pid_t pid;
+
+  nb_rounds = DEFAULT_NB_ROUNDS;
+
+  while (1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hr:w:", long_options, &i);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+     case 'h':
+       printf("durable -- test of recovery of durable transactions\n"
+              "\n"
+              "Usage:\n"
+              "  durable [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -r, --rounds <int>\n"
+              "        Number of crashes (default=" XSTR(DEFAULT_NB_ROUNDS) ")\n"
+              "  -w, --words <int>\n"
+              "        Number of words written by transactions (default=" XSTR(DEFAULT_NB_WORDS) ")\n"
+         );
+       exit(0);
+     case 'r':
+       nb_rounds = atoi(optarg);
+       break;
+     case 'w':
+       nb_words = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  stm_init();
+  if (!stm_get_parameter("compile_flags", &flags) || strstr(flags, "-DDURABLE_TX") == NULL) {
+    printf("Durable transactions are not enabled\n");
+    stm_exit();
+    return 0;
+  }
+  stm_exit();
+
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  snprintf(data_path, sizeof(data_path), "%s/data", dir);
+  snprintf(log_path, sizeof(log_path), "%s/log", dir);
+  if ((fd = open(data_path, O_RDWR | O_CREAT, 0600)) < 0 || ftruncate(fd, nb_words * sizeof(stm_word_t)) != 0) {
+    perror("open");
+    exit(1);
+  }
+  close(fd);
+  setenv("STM_DURABLE_LOG", log_path, 1);
+
+  srand(time(NULL));
+  total = 0;
+  for (i = 0; i < nb_rounds; i++) {
+    if (pipe(p) != 0 || (pid = fork()) < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      close(p[0]);
+      update(p[1]);
+    }
+    close(p[1]);
+    if (read(p[0], &recovered, sizeof(recovered)) != sizeof(recovered)) {
+      /* Child failed upon recovery */
+      waitpid(pid, &status, 0);
+      printf("Round %d: FAILED\n", i);
+      exit(1);
+    }
+    close(p[0]);
+    total += recovered;
+    /* Crash at some point of an update */
+    delay.tv_sec = 0;
+    delay.tv_nsec = (10 + rand() % 90) * 1000000L;
+    nanosleep(&delay, NULL);
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+  }
+
+  /* Recover last crash */
+  data = open_data();
+  check_data(data);
+  if (stm_get_parameter("durable_recovered", &recovered))
+    total += recovered;
+  stm_exit();
+  munmap(data, nb_words * sizeof(stm_word_t));
+  printf("Recovery     : OK (%lu interrupted transactions rolled back)\n", total);
+
+  unlink(data_path);
+  unlink(log_path);
+  rmdir(dir);
+
+  return 0;
+}
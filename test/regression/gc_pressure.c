@@ -0,0 +1,135 @@
+/*
+ * File:
+ *   gc_pressure.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for GC pressure (requires EPOCH_GC).  A transaction
+ *   that keeps reading with inlined loads (stm_inline.h) must stop
+ *   holding back the reclamation of memory freed by another thread once
+ *   the backlog of that thread exceeds its limit.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stm.h"
+#include "stm_inline.h"
+#include "mod_mem.h"
+
+#define BACKLOG_THREAD                  64
+/* Blocks freed while the reader is stalled */
+#define NB_FREES                        100000
+/* Reads of the stalled transaction (less than the size of the read set) */
+#define MAX_READS                       1000
+
+static stm_word_t shared;
+static volatile int started;
+static volatile int stop;
+
+/*
+ * Run a long transaction that only reads with inlined loads.
+ */
+static void *reader(void *arg)
+{
+  struct stm_tx *tx;
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  struct timespec delay;
+  int i;
+
+  stm_init_thread();
+  tx = stm_current_tx();
+  memset(&attr, 0, sizeof(attr));
+  delay.tv_sec = 0;
+  delay.tv_nsec = 1000000;
+  e = stm_start(attr);
+  if (e != NULL)
+    sigsetjmp(*e, 0);
+  for (i = 0; i < MAX_READS && !stop; i++) {
+    stm_load_inline(tx, &shared);
+    started = 1;
+    nanosleep(&delay, NULL);
+  }
+  stm_commit();
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t thread;
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  const char *flags;
+  unsigned long backlog;
+  void *p;
+  int i;
+
+  stm_init();
+  if (!stm_get_parameter("compile_flags", &flags) || strstr(flags, "-DEPOCH_GC") == NULL) {
+    printf("Epoch-based GC is not enabled\n");
+    stm_exit();
+    return 0;
+  }
+  mod_mem_init(1);
+  backlog = BACKLOG_THREAD;
+  stm_set_parameter("gc_backlog_thread", &backlog);
+  stm_init_thread();
+
+  if (pthread_create(&thread, NULL, reader, NULL) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    exit(1);
+  }
+  while (!started)
+    sched_yield();
+
+  memset(&attr, 0, sizeof(attr));
+  for (i = 0; i < NB_FREES; i++) {
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    p = stm_malloc(32);
+    stm_commit();
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    stm_free(p, 32);
+    stm_commit();
+  }
+  /* Reader is still running its transaction */
+  stm_get_parameter("gc_backlog", &backlog);
+  stop = 1;
+  pthread_join(thread, NULL);
+
+  printf("Backlog      : %lu blocks (limit %d)\n", backlog, BACKLOG_THREAD);
+  stm_exit_thread();
+  stm_exit();
+
+  /* Backlog is bounded by the limit (plus blocks freed before the reader reacts) */
+  if (backlog > NB_FREES / 4) {
+    printf("Backlog      : FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -42,6 +42,7 @@
 
 #define NB_ELEMENTS                     64
 #define NB_SHUFFLES                     16
+#define NB_LARGE                        16384
 
 #define XSTR(s)                         STR(s)
 #define STR(s)                          #s
@@ -49,6 +50,7 @@
 static volatile int stop;
 
 long data[64];
+long large[NB_LARGE];
 
 volatile long nb_irrevocable_serial = 0;
 volatile long nb_irrevocable_parallel = 0;
@@ -72,6 +74,44 @@ typedef struct thread_data {
   char padding[64];
 } thread_data_t;
 
+/* Irrevocable transaction with more reads and writes than the initial
+ * size of the write set (which cannot be extended by aborting) */
+static void test_large(void)
+{
+  int i;
+  volatile int irrevocable;
+  long l;
+  sigjmp_buf *e;
+
+  stm_init_thread();
+  irrevocable = 0;
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  if (irrevocable) {
+    fprintf(stderr, "ERROR: aborted while in irrevocable mode\n");
+    exit(1);
+  }
+  if (!stm_set_irrevocable(0)) {
+    fprintf(stderr, "ERROR: cannot enter irrevocable mode\n");
+    exit(1);
+  }
+  irrevocable = 1;
+  for (i = 0, l = 0; i < NB_LARGE; i++)
+    l += stm_load_long(&large[i]);
+  for (i = 0; i < NB_LARGE; i++)
+    stm_store_long(&large[i], i);
+  for (i = 0; i < NB_LARGE; i++)
+    l += stm_load_long(&large[i]) - i;
+  stm_commit();
+  for (i = 0; i < NB_LARGE; i++)
+    l += large[i] - i;
+  if (l != 0) {
+    fprintf(stderr, "ERROR: inconsistent values after irrevocable transaction\n");
+    exit(1);
+  }
+  stm_exit_thread();
+}
+
 static void *test(void *v)
 {
   unsigned int seed;
@@ -146,6 +186,8 @@ static void *test(void *v)
     } else {
       for (i = 0, l = 0; i < NB_ELEMENTS; i++)
         l += stm_load_long(&data[i]);
+      /* Snapshot may not be consistent yet with sandboxing */
+      stm_validate();
     }
     assert(l == 0);
     stm_commit();
@@ -278,6 +320,9 @@ int main(int argc, char **argv)
          (int)sizeof(void *),
          (int)sizeof(stm_word_t));
 
+  printf("TESTING LARGE IRREVOCABLE TRANSACTION...\n");
+  test_large();
+
   stop = 0;
 
   printf("TESTING CONCURRENT UPDATES...\n");
@@ -0,0 +1,237 @@
+/*
+ * File:
+ *   nested.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for closed nesting.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#ifdef NDEBUG
+# undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stm.h"
+#include "mod_log.h"
+#include "mod_mem.h"
+
+#define NB_THREADS                      4
+#define NB_ITERATIONS                   10000
+#define NB_COUNTERS                     16
+
+static stm_word_t x, y;
+static stm_word_t counters[NB_COUNTERS];
+static stm_word_t total;
+static int logged;
+
+static stm_tx_attr_t closed = { .closed_nesting = 1 };
+
+/*
+ * Explicit abort of nested transaction: only the nested one restarts.
+ */
+static void test_retry(void)
+{
+  sigjmp_buf *e;
+  volatile int outer = 0, inner = 0;
+
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  outer++;
+  stm_store(&x, 1);
+  e = stm_start(closed);
+  assert(e != NULL);
+  sigsetjmp(*e, 0);
+  inner++;
+  /* Changes of first attempt must have been undone */
+  assert(stm_load(&x) == 1);
+  assert(stm_load(&y) == 0);
+  assert(logged == 0);
+  if (inner == 1) {
+    stm_log_int(&logged);
+    logged = 1;
+    stm_store(&x, 2);
+    stm_store(&y, 2);
+    stm_abort(STM_ABORT_EXPLICIT);
+  }
+  stm_store(&x, 3);
+  stm_commit();
+  assert(stm_load(&x) == 3);
+  stm_commit();
+
+  assert(outer == 1 && inner == 2);
+  assert(x == 3 && y == 0);
+}
+
+/*
+ * Abort without retry of nested transaction: execution continues in parent.
+ */
+static void test_cancel(void)
+{
+  sigjmp_buf *e;
+  stm_word_t *p;
+
+  x = y = 0;
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  stm_store(&x, 1);
+  e = stm_start(closed);
+  assert(e != NULL);
+  sigsetjmp(*e, 0);
+  p = (stm_word_t *)stm_malloc(sizeof(stm_word_t));
+  stm_store(&y, (stm_word_t)p);
+  stm_store(&x, 2);
+  stm_abort(STM_ABORT_NO_RETRY);
+  /* Still in parent */
+  assert(stm_active());
+  assert(stm_load(&x) == 1);
+  assert(stm_load(&y) == 0);
+  stm_commit();
+
+  assert(!stm_active());
+  assert(x == 1 && y == 0);
+}
+
+/*
+ * Rollback to savepoint: the prefix is kept, only the tail restarts.
+ */
+static void test_savepoint(void)
+{
+  sigjmp_buf *e, *sp;
+  volatile int outer = 0, tail = 0;
+
+  x = y = 0;
+  logged = 0;
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  outer++;
+  stm_store(&x, 1);
+  sp = stm_savepoint();
+  assert(sp != NULL);
+  sigsetjmp(*sp, 0);
+  tail++;
+  /* Changes made after the savepoint must have been undone */
+  assert(stm_load(&x) == 1);
+  assert(stm_load(&y) == 0);
+  assert(logged == 0);
+  if (tail == 1) {
+    stm_log_int(&logged);
+    logged = 1;
+    stm_store(&x, 2);
+    stm_store(&y, 2);
+    stm_rollback_to(sp);
+  }
+  stm_store(&y, 3);
+  /* Savepoint of a nested transaction is dropped upon its commit */
+  e = stm_start(closed);
+  assert(e != NULL);
+  sigsetjmp(*e, 0);
+  assert(stm_savepoint() != NULL);
+  stm_commit();
+  stm_commit();
+
+  assert(outer == 1 && tail == 2);
+  assert(x == 1 && y == 3);
+}
+
+/*
+ * Concurrent increments in nested transactions and after savepoints.
+ */
+static void *test_concurrent(void *arg)
+{
+  sigjmp_buf *e;
+  unsigned int seed = (unsigned int)(unsigned long)arg;
+  int i, j;
+
+  stm_init_thread();
+  for (i = 0; i < NB_ITERATIONS; i++) {
+    j = rand_r(&seed) % NB_COUNTERS;
+    e = stm_start((stm_tx_attr_t)0);
+    sigsetjmp(*e, 0);
+    stm_store(&total, stm_load(&total) + 1);
+    if (i % 2 == 0) {
+      e = stm_start(closed);
+      if (e != NULL)
+        sigsetjmp(*e, 0);
+      stm_store(&counters[j], stm_load(&counters[j]) + 1);
+      stm_commit();
+    } else {
+      /* Conflicts on counters restart from the savepoint */
+      e = stm_savepoint();
+      if (e != NULL)
+        sigsetjmp(*e, 0);
+      stm_store(&counters[j], stm_load(&counters[j]) + 1);
+    }
+    stm_commit();
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t threads[NB_THREADS];
+  stm_word_t sum;
+  const char *flags;
+  int i;
+
+  stm_init();
+  if (!stm_get_parameter("compile_flags", &flags) || strstr(flags, "-DCLOSED_NESTING") == NULL) {
+    printf("Closed nesting is not enabled\n");
+    stm_exit();
+    return 0;
+  }
+  mod_log_init();
+  mod_mem_init(0);
+  stm_init_thread();
+
+  printf("Testing retry of nested transaction...\n");
+  test_retry();
+  printf("Testing cancel of nested transaction...\n");
+  test_cancel();
+  printf("Testing rollback to savepoint...\n");
+  test_savepoint();
+
+  printf("Testing concurrent nested transactions...\n");
+  for (i = 0; i < NB_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, test_concurrent, (void *)(unsigned long)(i + 1)) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < NB_THREADS; i++)
+    pthread_join(threads[i], NULL);
+  for (i = 0, sum = 0; i < NB_COUNTERS; i++)
+    sum += counters[i];
+  assert(sum == NB_THREADS * NB_ITERATIONS);
+  assert(total == NB_THREADS * NB_ITERATIONS);
+
+  stm_exit_thread();
+  stm_exit();
+
+  printf("All tests passed\n");
+
+  return 0;
+}
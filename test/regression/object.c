@@ -0,0 +1,167 @@
+/*
+ * File:
+ *   object.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for objects allocated with stm_malloc_obj() and
+ *   accessed with the object barriers (protected by their own lock with
+ *   OBJECT_LOCKS).  Objects must keep the alignment of malloc() and
+ *   concurrent transfers between objects and a global counter must
+ *   preserve the total.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stm.h"
+#include "mod_mem.h"
+
+#define NB_THREADS                      4
+#define NB_ITERATIONS                   20000
+#define NB_OBJECTS                      16
+
+typedef struct account {
+  stm_word_t balance;
+  stm_word_t nb_transfers;
+} account_t;
+
+static account_t *accounts[NB_OBJECTS];
+/* Protected by the lock array */
+static stm_word_t nb_transfers;
+
+/*
+ * Allocate objects (and replace them once to exercise stm_free_obj()).
+ */
+static int create_objects(void)
+{
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  account_t *a, *old;
+  int i, j;
+
+  memset(&attr, 0, sizeof(attr));
+  for (j = 0; j < 2; j++) {
+    for (i = 0; i < NB_OBJECTS; i++) {
+      e = stm_start(attr);
+      if (e != NULL)
+        sigsetjmp(*e, 0);
+      old = accounts[i];
+      a = (account_t *)stm_malloc_obj(sizeof(account_t));
+      stm_store_obj(a, &a->balance, old == NULL ? 0 : stm_load_obj(old, &old->balance));
+      stm_store_obj(a, &a->nb_transfers, 0);
+      if (old != NULL)
+        stm_free_obj(old, sizeof(account_t));
+      stm_commit();
+      accounts[i] = a;
+      if ((uintptr_t)a % _Alignof(max_align_t) != 0) {
+        fprintf(stderr, "Object %p is misaligned\n", (void *)a);
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Transfer between random objects.
+ */
+static void *transfer(void *arg)
+{
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  account_t *src, *dst;
+  unsigned int seed;
+  int i, n;
+
+  stm_init_thread();
+  memset(&attr, 0, sizeof(attr));
+  seed = (unsigned int)(uintptr_t)arg;
+  for (i = 0; i < NB_ITERATIONS; i++) {
+    src = accounts[rand_r(&seed) % NB_OBJECTS];
+    dst = accounts[rand_r(&seed) % NB_OBJECTS];
+    n = rand_r(&seed) % 100;
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    stm_store_obj(src, &src->balance, stm_load_obj(src, &src->balance) - n);
+    stm_store_obj(dst, &dst->balance, stm_load_obj(dst, &dst->balance) + n);
+    stm_store_obj(src, &src->nb_transfers, stm_load_obj(src, &src->nb_transfers) + 1);
+    stm_store(&nb_transfers, stm_load(&nb_transfers) + 1);
+    stm_commit();
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t threads[NB_THREADS];
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  stm_word_t total, transfers;
+  int i;
+
+  stm_init();
+  mod_mem_init(0);
+  stm_init_thread();
+
+  if (!create_objects()) {
+    printf("Alignment    : FAILED\n");
+    return 1;
+  }
+  printf("Alignment    : OK\n");
+
+  for (i = 0; i < NB_THREADS; i++) {
+    if (pthread_create(&threads[i], NULL, transfer, (void *)(uintptr_t)(i + 1)) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < NB_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  memset(&attr, 0, sizeof(attr));
+  attr.read_only = 1;
+  e = stm_start(attr);
+  if (e != NULL)
+    sigsetjmp(*e, 0);
+  total = transfers = 0;
+  for (i = 0; i < NB_OBJECTS; i++) {
+    total += stm_load_obj(accounts[i], &accounts[i]->balance);
+    transfers += stm_load_obj(accounts[i], &accounts[i]->nb_transfers);
+  }
+  stm_commit();
+
+  stm_exit_thread();
+  stm_exit();
+
+  if (total != 0 || transfers != NB_THREADS * NB_ITERATIONS || nb_transfers != transfers) {
+    printf("Transfers    : FAILED (total %ld, %lu/%lu transfers)\n", (long)total, (unsigned long)transfers, (unsigned long)nb_transfers);
+    return 1;
+  }
+  printf("Transfers    : OK\n");
+
+  return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ * File:
+ *   order.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Benchmark for ordered commits (strict vs. pipelined mod_order).
+ *   Update transactions append their ticket to a shared log, which must
+ *   be strictly increasing (requires CM_MODULAR).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "stm.h"
+#include "mod_order.h"
+
+#define DEFAULT_DURATION                1000
+#define DEFAULT_NB_THREADS              1
+#define DEFAULT_SIZE                    4096
+#define DEFAULT_READS                   8
+#define DEFAULT_WRITES                  2
+#define DEFAULT_READ_ONLY               20
+#define DEFAULT_LOG_SIZE                (1 << 20)
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static volatile int stop;
+static stm_word_t *counters;
+static int size = DEFAULT_SIZE;
+static int nb_reads = DEFAULT_READS;
+static int nb_writes = DEFAULT_WRITES;
+static int read_only = DEFAULT_READ_ONLY;
+/* Tickets of update transactions in commit order (appended until full) */
+static stm_word_t *tickets;
+static stm_word_t nb_tickets;
+static int log_size = DEFAULT_LOG_SIZE;
+
+typedef struct thread_data {
+  pthread_barrier_t *barrier;
+  unsigned long nb_commits;
+  unsigned long nb_updates;
+  unsigned long nb_aborts;
+  unsigned int seed;
+  char padding[64];
+} thread_data_t;
+
+static void *test(void *data)
+{
+  thread_data_t *d = (thread_data_t *)data;
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  unsigned long aborts;
+  stm_word_t n;
+  int i, ro, idx;
+
+  stm_init_thread();
+  pthread_barrier_wait(d->barrier);
+
+  memset(&attr, 0, sizeof(attr));
+  while (stop == 0) {
+    ro = (int)(rand_r(&d->seed) % 100) < read_only;
+    attr.read_only = ro;
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    for (i = 0; i < nb_reads; i++)
+      stm_load(&counters[rand_r(&d->seed) % size]);
+    if (!ro) {
+      for (i = 0; i < nb_writes; i++) {
+        idx = rand_r(&d->seed) % size;
+        stm_store(&counters[idx], stm_load(&counters[idx]) + 1);
+      }
+      if ((n = stm_load(&nb_tickets)) < (stm_word_t)log_size) {
+        stm_store(&tickets[n], mod_order_ticket());
+        stm_store(&nb_tickets, n + 1);
+      }
+    }
+    stm_commit();
+    d->nb_commits++;
+    if (!ro)
+      d->nb_updates++;
+  }
+
+  /* Only available with statistics */
+  if (stm_get_stats("nb_aborts", &aborts) == 0)
+    aborts = 0;
+  d->nb_aborts = aborts;
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"log-size",                  required_argument, NULL, 'l'},
+    {"mode",                      required_argument, NULL, 'm'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {"reads",                     required_argument, NULL, 'r'},
+    {"read-only-rate",            required_argument, NULL, 'o'},
+    {"size",                      required_argument, NULL, 's'},
+    {"writes",                    required_argument, NULL, 'w'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, c, duration, nb_threads, mode, ordered;
+  unsigned long commits, updates, aborts, sum;
+  const char *cm;
+  thread_data_t *data;
+  pthread_t *threads;
+  pthread_barrier_t barrier;
+  struct timeval start, end;
+  struct timespec timeout;
+
+  duration = DEFAULT_DURATION;
+  nb_threads = DEFAULT_NB_THREADS;
+  mode = MOD_ORDER_PIPELINED;
+
+  while (1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hd:l:m:n:r:o:s:w:", long_options, &i);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+     case 'h':
+       printf("order -- benchmark for ordered commits\n"
+              "\n"
+              "Usage:\n"
+              "  order [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -d, --duration <int>\n"
+              "        Test duration in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -l, --log-size <int>\n"
+              "        Number of tickets of update transactions checked (default=" XSTR(DEFAULT_LOG_SIZE) ")\n"
+              "  -m, --mode <string>\n"
+              "        Ordering mode: strict or pipelined (default=pipelined)\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -r, --reads <int>\n"
+              "        Number of reads per transaction (default=" XSTR(DEFAULT_READS) ")\n"
+              "  -o, --read-only-rate <int>\n"
+              "        Percentage of read-only transactions (default=" XSTR(DEFAULT_READ_ONLY) ")\n"
+              "  -s, --size <int>\n"
+              "        Number of shared counters (default=" XSTR(DEFAULT_SIZE) ")\n"
+              "  -w, --writes <int>\n"
+              "        Number of increments per update transaction (default=" XSTR(DEFAULT_WRITES) ")\n"
+         );
+       exit(0);
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'l':
+       log_size = atoi(optarg);
+       break;
+     case 'm':
+       if (strcmp(optarg, "strict") == 0)
+         mode = MOD_ORDER_STRICT;
+       else if (strcmp(optarg, "pipelined") == 0)
+         mode = MOD_ORDER_PIPELINED;
+       else {
+         fprintf(stderr, "Unknown mode: %s\n", optarg);
+         exit(1);
+       }
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case 'r':
+       nb_reads = atoi(optarg);
+       break;
+     case 'o':
+       read_only = atoi(optarg);
+       break;
+     case 's':
+       size = atoi(optarg);
+       break;
+     case 'w':
+       nb_writes = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(duration > 0);
+  assert(nb_threads > 0);
+  assert(size > 0);
+  assert(log_size >= 0);
+
+  stm_init();
+  if (!stm_get_parameter("contention_manager", &cm) || strcmp(cm, "MODULAR") != 0) {
+    printf("Modular contention manager is not enabled\n");
+    stm_exit();
+    return 0;
+  }
+
+  printf("Mode         : %s\n", mode == MOD_ORDER_STRICT ? "strict" : "pipelined");
+  printf("Duration     : %d\n", duration);
+  printf("Nb threads   : %d\n", nb_threads);
+  printf("Size         : %d\n", size);
+  printf("Reads        : %d\n", nb_reads);
+  printf("Writes       : %d\n", nb_writes);
+  printf("Read-only    : %d\n", read_only);
+
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+
+  counters = (stm_word_t *)calloc(size, sizeof(stm_word_t));
+  tickets = (stm_word_t *)calloc(log_size + 1, sizeof(stm_word_t));
+  data = (thread_data_t *)calloc(nb_threads, sizeof(thread_data_t));
+  threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t));
+  if (counters == NULL || tickets == NULL || data == NULL || threads == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  mod_order_init_mode(mode);
+
+  pthread_barrier_init(&barrier, NULL, nb_threads + 1);
+  for (i = 0; i < nb_threads; i++) {
+    data[i].barrier = &barrier;
+    data[i].seed = i + 1;
+    if (pthread_create(&threads[i], NULL, test, (void *)(&data[i])) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_barrier_wait(&barrier);
+
+  gettimeofday(&start, NULL);
+  nanosleep(&timeout, NULL);
+  stop = 1;
+  gettimeofday(&end, NULL);
+
+  for (i = 0; i < nb_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  duration = (end.tv_sec * 1000 + end.tv_usec / 1000) - (start.tv_sec * 1000 + start.tv_usec / 1000);
+  commits = updates = aborts = 0;
+  for (i = 0; i < nb_threads; i++) {
+    commits += data[i].nb_commits;
+    updates += data[i].nb_updates;
+    aborts += data[i].nb_aborts;
+  }
+  sum = 0;
+  for (i = 0; i < size; i++)
+    sum += counters[i];
+  /* Updates commit in the order of their tickets */
+  ordered = (nb_tickets == (updates < (unsigned long)log_size ? updates : (unsigned long)log_size));
+  for (i = 1; i < (int)nb_tickets; i++) {
+    if (tickets[i - 1] >= tickets[i])
+      ordered = 0;
+  }
+
+  printf("Duration     : %d (ms)\n", duration);
+  printf("#commits     : %lu (%f / s)\n", commits, commits * 1000.0 / duration);
+  printf("#aborts      : %lu (%f / s)\n", aborts, aborts * 1000.0 / duration);
+  printf("Sum check    : %s\n", sum == updates * nb_writes ? "OK" : "FAILED");
+  printf("Order check  : %s (%lu tickets)\n", ordered ? "OK" : "FAILED", (unsigned long)nb_tickets);
+
+  pthread_barrier_destroy(&barrier);
+  stm_exit();
+
+  free(threads);
+  free(data);
+  free(tickets);
+  free(counters);
+
+  return sum == updates * nb_writes && ordered ? 0 : 1;
+}
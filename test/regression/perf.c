@@ -5,7 +5,7 @@
  *   Pascal Felber <pascal.felber@unine.ch>
  *   Patrick Marlier <patrick.marlier@unine.ch>
  * Description:
- *   Performance regression test.
+ *   Microbenchmarks of transactional operations (cycles per operation).
  *
  * Copyright (c) 2007-2014.
  *
@@ -23,325 +23,635 @@
  * under the terms of the MIT license.
  */
 
+#include <getopt.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+#endif /* __linux__ */
 
 #include "stm.h"
+#include "stm_inline.h"
 #include "mod_mem.h"
 
 /* Increment the value of the global clock (used for timestamps).
  * Hidden to tinySTM users. */
 void stm_inc_clock(void);
 
+#define DEFAULT_MEASURES                1000
+#define DEFAULT_SIZES                   "1,4,16,64,256,1024"
+#define ROW_SIZE                        64
+
+#define MAX_SIZE                        4096
+#define MAX_SIZES                       32
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+__attribute__((aligned(64)))
+stm_word_t global_ctr[MAX_SIZE] = {0};
+
 __attribute__((aligned(64)))
-stm_word_t global_ctr[1000] = {0};
+stm_word_t validate_ctr = 0;
 
-#define MEASURE_NB 1000
+/* ################################################################### *
+ * CYCLE COUNTERS
+ * ################################################################### */
 
-static inline uint64_t
-rdtsc(void)
+static const char *counter_name;
+static uint64_t (*counter)(void);
+static uint64_t overhead;
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64_t rdtsc(void)
 {
   uint32_t a, d;
   asm volatile( "rdtsc\n\t" : "=a" (a), "=d" (d));
   return (((uint64_t)d) << 32) | (((uint64_t)a) & 0xffffffff);
 }
+#endif /* defined(__x86_64__) || defined(__i386__) */
 
-static int compar(const void *a, const void *b)
+#ifdef __linux__
+static int perf_fd = -1;
+
+/* Cycles spent in user mode by the calling thread */
+static uint64_t perf_cycles(void)
 {
-  return *((uint64_t *)a) - *((uint64_t *)b);
+  uint64_t v;
+
+  if (read(perf_fd, &v, sizeof(v)) != sizeof(v))
+    return 0;
+  return v;
 }
 
-static void remove_cst_cost(uint64_t *m, size_t size, uint64_t cost)
+static int perf_open(void)
 {
-  size_t i;
-  for (i = 0; i < size; i++) {
-    m[i] -= cost;
-  }
+  struct perf_event_attr pe;
+
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CPU_CYCLES;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  perf_fd = (int)syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+  return perf_fd >= 0;
 }
+#endif /* __linux__ */
 
-static void stats(uint64_t *m, size_t size, uint64_t *min, double *avg, uint64_t *median)
+/* Nanoseconds (when no cycle counter is available) */
+static uint64_t clock_ns(void)
 {
-  size_t i;
-  /* Find median value */
-  qsort(m, size, sizeof(uint64_t), compar);
-  *median = m[(size/2)-1];
-  /* Find minimal and calculate average */
-  *min = ~0UL;
-  *avg = 0.0;
-  for (i = 0; i < size; i++) {
-    *avg += m[i];
-    if (m[i] < *min)
-      *min = m[i];
-  }
-  *avg = *avg / size;
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-static void test1load(int ro)
+/* Select counter: "tsc", "perf" or "ns" (NULL for the best available) */
+static void counter_init(const char *name)
 {
-  uint64_t m_s[MEASURE_NB];
-  uint64_t m_r[MEASURE_NB];
-  uint64_t m_c[MEASURE_NB];
-  uint64_t m_rdtsc;
-  uint64_t start;
+  uint64_t t;
+  int i;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if (name == NULL || strcmp(name, "tsc") == 0) {
+    counter_name = "tsc";
+    counter = rdtsc;
+  }
+#endif /* defined(__x86_64__) || defined(__i386__) */
+#ifdef __linux__
+  if (counter == NULL && (name == NULL || strcmp(name, "perf") == 0)) {
+    if (perf_open()) {
+      counter_name = "perf";
+      counter = perf_cycles;
+    } else if (name != NULL) {
+      perror("perf_event_open");
+    }
+  }
+#endif /* __linux__ */
+  if (counter == NULL) {
+    if (name != NULL && strcmp(name, "ns") != 0)
+      fprintf(stderr, "WARNING: counter \"%s\" is not available, using ns\n", name);
+    counter_name = "ns";
+    counter = clock_ns;
+  }
+  /* Cost of reading the counter, subtracted from all measurements */
+  overhead = ~0UL;
+  for (i = 0; i < DEFAULT_MEASURES; i++) {
+    t = counter();
+    t = counter() - t;
+    if (t < overhead)
+      overhead = t;
+  }
+}
+
+/* ################################################################### *
+ * RESULTS
+ * ################################################################### */
+
+typedef struct result {
   uint64_t min;
   double avg;
   uint64_t med;
-  unsigned long i;
-  stm_tx_attr_t _a = {{.read_only = ro}};
+} result_t;
 
-  m_rdtsc = ~0UL;
-  for (i = 0; i < MEASURE_NB; i++) {
-    start = rdtsc();
-    start = rdtsc() - start;
-    if (start < m_rdtsc)
-      m_rdtsc = start;
-  } 
-
-  for (i = 0; i < MEASURE_NB; i++) {
-    sigjmp_buf *_e;
-    start = rdtsc();
-    _e = stm_start(_a);
-    m_s[i] = rdtsc() - start;
-    sigsetjmp(*_e, 0); 
-    stm_load(&global_ctr[0]);
-    stm_inc_clock();
-    stm_commit();
+static uint64_t *m;                     /* Samples */
+static int nb_measures = DEFAULT_MEASURES;
+static int row;                         /* Only print medians for the matrix */
+
+static int compar(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* Statistics of samples, divided by the number of operations */
+static result_t stats(size_t per)
+{
+  result_t r;
+  int i;
+
+  r.min = ~0UL;
+  r.avg = 0.0;
+  for (i = 0; i < nb_measures; i++) {
+    m[i] = (m[i] > overhead ? m[i] - overhead : 0);
+    r.avg += m[i];
+    if (m[i] < r.min)
+      r.min = m[i];
   }
+  qsort(m, nb_measures, sizeof(uint64_t), compar);
+  r.med = m[nb_measures / 2];
+  if (per == 0)
+    per = 1;
+  r.min /= per;
+  r.avg = r.avg / nb_measures / per;
+  r.med /= per;
+  return r;
+}
 
-  for (i = 0; i < MEASURE_NB; i++) {
+static void print_header(const char *title)
+{
+  if (row)
+    return;
+  printf("%s\n", title);
+  printf("%16s %8s %12s %12s %12s\n", "", "size", "min", "avg", "med");
+}
+
+static void print_result(const char *op, size_t size, result_t r)
+{
+  if (row)
+    return;
+  printf("%16s %8lu %12lu %12.2f %12lu\n", op, (unsigned long)size, (unsigned long)r.min, r.avg, (unsigned long)r.med);
+}
+
+/* ################################################################### *
+ * OPERATIONS
+ * ################################################################### */
+
+/* Transactional loads of n distinct words (per load) */
+static result_t measure_load(int ro, size_t n)
+{
+  stm_tx_attr_t _a = {{.read_only = ro}};
+  uint64_t start;
+  size_t j;
+  int i;
+
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    start = rdtsc();
-    stm_load(&global_ctr[0]);
-    m_r[i] = rdtsc() - start;
+    sigsetjmp(*_e, 0);
+    start = counter();
+    for (j = 0; j < n; j++)
+      stm_load(&global_ctr[j]);
+    m[i] = counter() - start;
     stm_inc_clock();
     stm_commit();
   }
-  
-  for (i = 0; i < MEASURE_NB; i++) {
+  return stats(n);
+}
+
+/* Transactional loads with inlined fast path (per load) */
+static result_t measure_load_inline(size_t n)
+{
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  struct stm_tx *tx = stm_current_tx();
+  uint64_t start;
+  size_t j;
+  int i;
+
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    stm_load(&global_ctr[0]);
+    sigsetjmp(*_e, 0);
+    start = counter();
+    for (j = 0; j < n; j++)
+      stm_load_inline(tx, &global_ctr[j]);
+    m[i] = counter() - start;
     stm_inc_clock();
-    start = rdtsc();
     stm_commit();
-    m_c[i] = rdtsc() - start;
   }
- 
-  remove_cst_cost(m_s, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_r, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_c, MEASURE_NB, m_rdtsc);
-
-  if (ro) 
-    printf("RO transaction - 1 load\n");
-  else
-    printf("RW transaction - 1 load\n");
-
-  printf("%12s %12s %12s %12s\n", "", "min", "avg", "med");
-  stats(m_s, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "start", (unsigned long)min, avg, (unsigned long)med);
-  stats(m_r, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "load", (unsigned long)min, avg, (unsigned long)med);
-  stats(m_c, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "commit", (unsigned long)min, avg, (unsigned long)med);
+  return stats(n);
 }
 
-static void testnload(int ro, size_t load_nb)
+/* First transactional stores to n distinct words (per store) */
+static result_t measure_store(size_t n)
 {
-  uint64_t m_s[MEASURE_NB];
-  uint64_t m_r[MEASURE_NB];
-  uint64_t m_c[MEASURE_NB];
-  uint64_t m_rdtsc;
+  stm_tx_attr_t _a = {{.read_only = 0}};
   uint64_t start;
-  uint64_t min;
-  double avg;
-  uint64_t med;
-  unsigned long i;
   size_t j;
-  stm_tx_attr_t _a = {{.read_only = ro}};
+  int i;
 
-  m_rdtsc = ~0UL;
-  for (i = 0; i < MEASURE_NB; i++) {
-    start = rdtsc();
-    start = rdtsc() - start;
-    if (start < m_rdtsc)
-      m_rdtsc = start;
-  } 
-
-  for (i = 0; i < MEASURE_NB; i++) {
-    sigjmp_buf *_e;
-    start = rdtsc();
-    _e = stm_start(_a);
-    m_s[i] = rdtsc() - start;
-    sigsetjmp(*_e, 0); 
-    for (j = 0; j < load_nb; j++)
-      stm_load(&global_ctr[j]);
+  for (i = 0; i < nb_measures; i++) {
+    sigjmp_buf *_e = stm_start(_a);
+    sigsetjmp(*_e, 0);
+    start = counter();
+    for (j = 0; j < n; j++)
+      stm_store(&global_ctr[j], (stm_word_t)i);
+    m[i] = counter() - start;
     stm_inc_clock();
     stm_commit();
   }
+  return stats(n);
+}
+
+/* Loads of n words written by the transaction (per load) */
+static result_t measure_raw(size_t n)
+{
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  uint64_t start;
+  size_t j;
+  int i;
 
-  for (i = 0; i < MEASURE_NB; i++) {
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    start = rdtsc();
-    for (j = 0; j < load_nb; j++)
+    sigsetjmp(*_e, 0);
+    for (j = 0; j < n; j++)
+      stm_store(&global_ctr[j], (stm_word_t)i);
+    start = counter();
+    for (j = 0; j < n; j++)
       stm_load(&global_ctr[j]);
-    m_r[i] = rdtsc() - start;
+    m[i] = counter() - start;
     stm_inc_clock();
     stm_commit();
   }
-  
-  for (i = 0; i < MEASURE_NB; i++) {
+  return stats(n);
+}
+
+/* Commit of a transaction that wrote n words (whole commit) */
+static result_t measure_commit(size_t n)
+{
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  uint64_t start;
+  size_t j;
+  int i;
+
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    for (j = 0; j < load_nb; j++)
-      stm_load(&global_ctr[j]);
+    sigsetjmp(*_e, 0);
+    for (j = 0; j < n; j++)
+      stm_store(&global_ctr[j], (stm_word_t)i);
     stm_inc_clock();
-    start = rdtsc();
+    start = counter();
     stm_commit();
-    m_c[i] = rdtsc() - start;
+    m[i] = counter() - start;
   }
- 
-  remove_cst_cost(m_s, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_r, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_c, MEASURE_NB, m_rdtsc);
-
-  if (ro) 
-    printf("RO transaction - %lu load\n", (unsigned long)load_nb);
-  else
-    printf("RW transaction - %lu load\n", (unsigned long)load_nb);
-
-  printf("%12s %12s %12s %12s\n", "", "min", "avg", "med");
-  stats(m_s, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "start", (unsigned long)min, avg, (unsigned long)med);
-  stats(m_r, MEASURE_NB, &min, &avg, &med); 
-  if (load_nb)
-    printf("%12s %12lu %12.2f %12lu\n", "load", (unsigned long)min/load_nb, avg/load_nb, (unsigned long)med/load_nb);
-  stats(m_c, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "commit", (unsigned long)min, avg, (unsigned long)med);
+  return stats(1);
 }
 
-static void testnloadnstore(size_t load_nb, size_t store_nb)
+/* Commit of a transaction that read n words and wrote one, after the
+ * clock has changed so that the read set must be validated (whole
+ * commit). */
+static result_t measure_validate(size_t n)
 {
-  uint64_t m_s[MEASURE_NB];
-  uint64_t m_r[MEASURE_NB];
-  uint64_t m_w[MEASURE_NB];
-  uint64_t m_c[MEASURE_NB];
-  uint64_t m_rdtsc;
+  stm_tx_attr_t _a = {{.read_only = 0}};
   uint64_t start;
-  uint64_t min;
-  double avg;
-  uint64_t med;
-  unsigned long i;
   size_t j;
-  stm_tx_attr_t _a = {{.read_only = 0}};
+  int i;
 
-  m_rdtsc = ~0UL;
-  for (i = 0; i < MEASURE_NB; i++) {
-    start = rdtsc();
-    start = rdtsc() - start;
-    if (start < m_rdtsc)
-      m_rdtsc = start;
-  } 
-
-  for (i = 0; i < MEASURE_NB; i++) {
-    sigjmp_buf *_e;
-    start = rdtsc();
-    _e = stm_start(_a);
-    m_s[i] = rdtsc() - start;
-    sigsetjmp(*_e, 0); 
-    for (j = 0; j < load_nb; j++)
+  for (i = 0; i < nb_measures; i++) {
+    sigjmp_buf *_e = stm_start(_a);
+    sigsetjmp(*_e, 0);
+    for (j = 0; j < n; j++)
       stm_load(&global_ctr[j]);
-    for (j = 0; j < store_nb; j++)
-      stm_store(&global_ctr[j], (stm_word_t)0);
+    stm_store(&validate_ctr, (stm_word_t)i);
     stm_inc_clock();
+    start = counter();
     stm_commit();
+    m[i] = counter() - start;
   }
+  return stats(1);
+}
+
+/* Cost of n entries, given the cost without entries */
+static result_t per_entry(result_t r, result_t r0, size_t n)
+{
+  r.min = (r.min > r0.min ? r.min - r0.min : 0) / n;
+  r.avg = (r.avg > r0.avg ? r.avg - r0.avg : 0) / n;
+  r.med = (r.med > r0.med ? r.med - r0.med : 0) / n;
+  return r;
+}
+
+/* Switch to (parallel) irrevocable mode after reading n words */
+static result_t measure_irrevocable(size_t n)
+{
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  uint64_t start;
+  size_t j;
+  int i;
 
-  for (i = 0; i < MEASURE_NB; i++) {
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    start = rdtsc();
-    for (j = 0; j < load_nb; j++)
+    sigsetjmp(*_e, 0);
+    for (j = 0; j < n; j++)
       stm_load(&global_ctr[j]);
-    m_r[i] = rdtsc() - start;
-    for (j = 0; j < store_nb; j++)
-      stm_store(&global_ctr[j], (stm_word_t)0);
     stm_inc_clock();
+    start = counter();
+    stm_set_irrevocable(0);
+    m[i] = counter() - start;
     stm_commit();
   }
-  
-  for (i = 0; i < MEASURE_NB; i++) {
-    sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    for (j = 0; j < load_nb; j++)
-      stm_load(&global_ctr[j]);
-    start = rdtsc();
-    for (j = 0; j < store_nb; j++)
-      stm_store(&global_ctr[j], (stm_word_t)0);
-    m_w[i] = rdtsc() - start;
-    stm_inc_clock();
-    stm_commit();
+  return stats(1);
+}
+
+/* Allocation and release of a block by a transaction (the block freed
+ * is allocated by the previous transaction) */
+static void measure_mem(size_t size, result_t *rm, result_t *rf)
+{
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  uint64_t *f;
+  uint64_t start;
+  void *p;
+  int i;
+
+  if ((f = (uint64_t *)malloc(nb_measures * sizeof(uint64_t))) == NULL) {
+    perror("malloc");
+    exit(1);
   }
-  
-  for (i = 0; i < MEASURE_NB; i++) {
+  for (i = 0; i < nb_measures; i++) {
     sigjmp_buf *_e = stm_start(_a);
-    sigsetjmp(*_e, 0); 
-    for (j = 0; j < load_nb; j++)
-      stm_load(&global_ctr[j]);
-    for (j = 0; j < store_nb; j++)
-      stm_store(&global_ctr[j], (stm_word_t)0);
-    stm_inc_clock();
-    start = rdtsc();
+    sigsetjmp(*_e, 0);
+    start = counter();
+    p = stm_malloc(size);
+    m[i] = counter() - start;
+    stm_commit();
+    _e = stm_start(_a);
+    sigsetjmp(*_e, 0);
+    start = counter();
+    stm_free(p, size);
+    f[i] = counter() - start;
     stm_commit();
-    m_c[i] = rdtsc() - start;
   }
- 
-  remove_cst_cost(m_s, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_r, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_w, MEASURE_NB, m_rdtsc);
-  remove_cst_cost(m_c, MEASURE_NB, m_rdtsc);
-
-  printf("RW transaction - %lu load - %lu store\n", (unsigned long)load_nb, (unsigned long)store_nb);
-
-  printf("%12s %12s %12s %12s\n", "", "min", "avg", "med");
-  stats(m_s, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "start", (unsigned long)min, avg, (unsigned long)med);
-  stats(m_r, MEASURE_NB, &min, &avg, &med); 
-  if (load_nb)
-    printf("%12s %12lu %12.2f %12lu\n", "load", (unsigned long)min/load_nb, avg/load_nb, (unsigned long)med/load_nb);
-  stats(m_w, MEASURE_NB, &min, &avg, &med); 
-  if (store_nb)
-    printf("%12s %12lu %12.2f %12lu\n", "store", (unsigned long)min/store_nb, avg/store_nb, (unsigned long)med/store_nb);
-  stats(m_c, MEASURE_NB, &min, &avg, &med); 
-  printf("%12s %12lu %12.2f %12lu\n", "commit", (unsigned long)min, avg, (unsigned long)med);
+  *rm = stats(1);
+  memcpy(m, f, nb_measures * sizeof(uint64_t));
+  *rf = stats(1);
+  free(f);
 }
 
-/* TODO
- *  Add clock perturbation to avoid fast commit
- *  Add write after write / load after write measurements
- *  Add stm_malloc/stm_free measurements
- */
+/* Start of a transaction and saving of its context, and restart after
+ * an explicit abort, for the checkpoint START ('e' is the value
+ * returned, non-zero upon restart). */
+#define MEASURE_START(RS, RA, START) \
+  do { \
+    volatile uint64_t start; \
+    volatile int n; \
+    int i, e; \
+    for (i = 0; i < nb_measures; i++) { \
+      start = counter(); \
+      e = START; \
+      m[i] = counter() - start; \
+      (void)e; \
+      stm_load(&global_ctr[0]); \
+      stm_commit(); \
+    } \
+    RS = stats(1); \
+    for (i = 0; i < nb_measures; i++) { \
+      n = 0; \
+      e = START; \
+      if (e != 0) \
+        m[i] = counter() - start; \
+      stm_load(&global_ctr[0]); \
+      if (n++ == 0) { \
+        start = counter(); \
+        stm_abort(0); \
+      } \
+      stm_commit(); \
+    } \
+    RA = stats(1); \
+  } while (0)
+
+/* ################################################################### *
+ * SUITE
+ * ################################################################### */
 
 int main(int argc, char **argv)
 {
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"counter",                   required_argument, NULL, 'c'},
+    {"label",                     required_argument, NULL, 'l'},
+    {"measures",                  required_argument, NULL, 'n'},
+    {"row",                       no_argument,       NULL, 'r'},
+    {"header",                    no_argument,       NULL, 'H'},
+    {"sizes",                     required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+  };
+
+  stm_tx_attr_t _a = {{.read_only = 0}};
+  size_t sizes[MAX_SIZES];
+  result_t r, rs, ra, rf, v0;
+  result_t row_r[10];
+  const char *counter_opt = NULL;
+  const char *label = NULL;
+  const char *list = DEFAULT_SIZES;
+  const char *s;
+  char *e;
+  int i, c, nb_sizes, irrevocable, ckpt;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hc:l:n:rHs:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("perf -- microbenchmarks of transactional operations\n"
+              "\n"
+              "Usage:\n"
+              "  perf [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -c, --counter <string>\n"
+              "        Counter: tsc, perf (cycles from perf_event) or ns (default=tsc on x86, perf otherwise)\n"
+              "  -l, --label <string>\n"
+              "        Label of the row (default=STM design)\n"
+              "  -n, --measures <int>\n"
+              "        Number of measurements per operation (default=" XSTR(DEFAULT_MEASURES) ")\n"
+              "  -r, --row\n"
+              "        Only print one row of medians (n=" XSTR(ROW_SIZE) " for sets)\n"
+              "  -H, --header\n"
+              "        Print the header of rows and exit\n"
+              "  -s, --sizes <list>\n"
+              "        Sizes of read and write sets (default=" DEFAULT_SIZES ")\n"
+         );
+       exit(0);
+     case 'c':
+       counter_opt = optarg;
+       break;
+     case 'l':
+       label = optarg;
+       break;
+     case 'n':
+       nb_measures = atoi(optarg);
+       break;
+     case 'r':
+       row = 1;
+       break;
+     case 'H':
+       printf("%-40s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "# config (median)",
+              "start", "restart", "load-ro", "load-rw", "store", "raw", "commit", "commit-n", "valid-n", "irrev", "malloc", "free");
+       exit(0);
+     case 's':
+       list = optarg;
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  if (nb_measures <= 0) {
+    fprintf(stderr, "Invalid number of measurements\n");
+    exit(1);
+  }
+  nb_sizes = 0;
+  for (s = list; *s != '\0' && nb_sizes < MAX_SIZES; s = (*e == ',' ? e + 1 : e)) {
+    sizes[nb_sizes] = strtoul(s, &e, 10);
+    if (e == s || sizes[nb_sizes] == 0 || sizes[nb_sizes] > MAX_SIZE) {
+      fprintf(stderr, "Invalid sizes \"%s\" (1 to " XSTR(MAX_SIZE) ")\n", list);
+      exit(1);
+    }
+    nb_sizes++;
+  }
+  if ((m = (uint64_t *)malloc(nb_measures * sizeof(uint64_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  counter_init(counter_opt);
+
   /* Init STM */
   stm_init();
   mod_mem_init(0);
   /* Create transaction */
   stm_init_thread();
 
-  /* Testing */
-  test1load(1);
-  test1load(0);
-  testnload(1, 100);
-  testnload(0, 100);
-  testnloadnstore(100, 20);
-  testnloadnstore(100, 20);
+  irrevocable = (stm_get_parameter("compile_flags", &s) && strstr(s, "-DIRREVOCABLE_ENABLED") != NULL);
+  ckpt = 0;
+  stm_get_parameter("checkpoint", &ckpt);
+  if (label == NULL && !stm_get_parameter("design", &label))
+    label = "-";
+
+  if (!row) {
+    printf("Counter        : %s (overhead %lu)\n", counter_name, (unsigned long)overhead);
+    printf("Measurements   : %d\n", nb_measures);
+    if (stm_get_parameter("design", &s))
+      printf("Design         : %s\n", s);
+    if (stm_get_parameter("contention_manager", &s))
+      printf("CM             : %s\n", s);
+    if (stm_get_parameter("compile_flags", &s))
+      printf("STM flags      : %s\n", s);
+  }
+
+  /* Start and restart */
+  print_header("Start and restart after abort (per transaction)");
+  MEASURE_START(rs, ra, ({ sigjmp_buf *_e = stm_start(_a); sigsetjmp(*_e, 0); }));
+  print_result("start", 1, rs);
+  print_result("restart", 1, ra);
+  row_r[0] = rs;
+  row_r[1] = ra;
+  if (ckpt) {
+    MEASURE_START(r, ra, stm_start_ckpt(_a));
+    print_result("start (ckpt)", 1, r);
+    print_result("restart (ckpt)", 1, ra);
+  }
+
+  /* Accesses */
+  print_header("Accesses (per access)");
+  for (i = 0; i < nb_sizes; i++)
+    print_result("load (RO)", sizes[i], measure_load(1, sizes[i]));
+  for (i = 0; i < nb_sizes; i++)
+    print_result("load (RW)", sizes[i], measure_load(0, sizes[i]));
+  for (i = 0; i < nb_sizes; i++)
+    print_result("load (inline)", sizes[i], measure_load_inline(sizes[i]));
+  for (i = 0; i < nb_sizes; i++)
+    print_result("store", sizes[i], measure_store(sizes[i]));
+  for (i = 0; i < nb_sizes; i++)
+    print_result("load after store", sizes[i], measure_raw(sizes[i]));
+  row_r[2] = measure_load(1, ROW_SIZE);
+  row_r[3] = measure_load(0, ROW_SIZE);
+  row_r[4] = measure_store(ROW_SIZE);
+  row_r[5] = measure_raw(ROW_SIZE);
+
+  /* Commit */
+  print_header("Commit with stores (per commit)");
+  for (i = 0; i < nb_sizes; i++)
+    print_result("commit", sizes[i], measure_commit(sizes[i]));
+  row_r[6] = measure_commit(1);
+  row_r[7] = measure_commit(ROW_SIZE);
+
+  /* Validation */
+  print_header("Validation of loads at commit (per entry)");
+  v0 = measure_validate(0);
+  for (i = 0; i < nb_sizes; i++)
+    print_result("validate", sizes[i], per_entry(measure_validate(sizes[i]), v0, sizes[i]));
+  row_r[8] = per_entry(measure_validate(ROW_SIZE), v0, 1);
+
+  /* Irrevocability */
+  memset(&row_r[9], 0, sizeof(row_r[9]));
+  if (irrevocable) {
+    print_header("Switch to irrevocable mode after loads (per switch)");
+    for (i = 0; i < nb_sizes; i++)
+      print_result("irrevocable", sizes[i], measure_irrevocable(sizes[i]));
+    row_r[9] = measure_irrevocable(ROW_SIZE);
+  }
+
+  /* Memory management */
+  print_header("Memory management (per call)");
+  measure_mem(64, &r, &rf);
+  print_result("malloc", 64, r);
+  print_result("free", 64, rf);
+
+  if (row) {
+    printf("%-40s", label);
+    for (i = 0; i < 10; i++) {
+      if (i == 9 && !irrevocable)
+        printf(" %8s", "-");
+      else
+        printf(" %8lu", (unsigned long)row_r[i].med);
+    }
+    printf(" %8lu %8lu\n", (unsigned long)r.med, (unsigned long)rf.med);
+  }
 
   /* Free transaction */
   stm_exit_thread();
   /* Cleanup STM */
   stm_exit();
+  free(m);
   return 0;
 }
@@ -0,0 +1,170 @@
+/*
+ * File:
+ *   priority.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for the "priority" policy of the MODULAR contention
+ *   manager (requires CM_MODULAR).  A long transaction with the lowest
+ *   priority conflicts with short transactions with the highest
+ *   priority and must eventually commit thanks to aging.  Statistics
+ *   indexed by priority are checked if TM_STATISTICS is enabled.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stm.h"
+
+#define NB_TXS                          5
+/* Duration of low-priority transactions (ns) */
+#define DURATION                        1000000
+/* Time after which low-priority transactions are considered starved (s) */
+#define DEADLINE                        20
+#define SENTINEL                        0xDEADBEEF
+
+static stm_word_t x;
+static volatile int done;
+static volatile int started;
+static int failed;
+
+/*
+ * Check statistics indexed by priority (arrays must not overflow).
+ */
+static void check_stats(int prio, int aborted)
+{
+  unsigned int commits[STM_PRIO_LEVELS + 1], aborts[STM_PRIO_LEVELS + 1];
+  uint64_t cycles[STM_PRIO_LEVELS + 1];
+
+  commits[STM_PRIO_LEVELS] = aborts[STM_PRIO_LEVELS] = SENTINEL;
+  cycles[STM_PRIO_LEVELS] = SENTINEL;
+  /* Statistics are only kept with TM_STATISTICS */
+  if (!stm_get_stats("nb_commits_prio", commits))
+    return;
+  if (!stm_get_stats("nb_aborts_prio", aborts) || !stm_get_stats("cycles_prio", cycles)) {
+    fprintf(stderr, "Priority %d: cannot get statistics\n", prio);
+    failed = 1;
+    return;
+  }
+  if (commits[STM_PRIO_LEVELS] != SENTINEL || aborts[STM_PRIO_LEVELS] != SENTINEL || cycles[STM_PRIO_LEVELS] != SENTINEL) {
+    fprintf(stderr, "Priority %d: statistics overflow\n", prio);
+    failed = 1;
+    return;
+  }
+  printf("Priority %d   : %u commits, %u aborts, %lu cycles\n", prio, commits[prio], aborts[prio], (unsigned long)cycles[prio]);
+  if (commits[prio] == 0 || cycles[prio] == 0 || (aborted && aborts[prio] == 0)) {
+    fprintf(stderr, "Priority %d: wrong statistics\n", prio);
+    failed = 1;
+  }
+}
+
+/*
+ * Run long transactions with the lowest priority.
+ */
+static void *low(void *arg)
+{
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  struct timespec delay;
+  int i;
+
+  stm_init_thread();
+  memset(&attr, 0, sizeof(attr));
+  attr.priority = 0;
+  delay.tv_sec = 0;
+  delay.tv_nsec = DURATION;
+  for (i = 0; i < NB_TXS; i++) {
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    stm_store(&x, stm_load(&x) + 1);
+    started = 1;
+    /* Let high-priority transactions conflict */
+    nanosleep(&delay, NULL);
+    stm_commit();
+  }
+  check_stats(0, 1);
+  done = 1;
+  stm_exit_thread();
+
+  return NULL;
+}
+
+/*
+ * Run short transactions with the highest priority until the other
+ * thread is done.
+ */
+static void *high(void *arg)
+{
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  time_t deadline;
+
+  stm_init_thread();
+  memset(&attr, 0, sizeof(attr));
+  attr.priority = STM_PRIO_LEVELS - 1;
+  deadline = time(NULL) + DEADLINE;
+  while (!started)
+    sched_yield();
+  while (!done) {
+    if (time(NULL) > deadline) {
+      fprintf(stderr, "Low-priority transactions starve\n");
+      exit(1);
+    }
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    stm_store(&x, stm_load(&x) + 1);
+    stm_commit();
+  }
+  check_stats(STM_PRIO_LEVELS - 1, 0);
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t threads[2];
+
+  stm_init();
+  /* Policies can only be selected with CM_MODULAR */
+  if (!stm_set_parameter("cm_policy", "priority")) {
+    printf("Modular contention manager is not enabled\n");
+    stm_exit();
+    return 0;
+  }
+
+  if (pthread_create(&threads[0], NULL, low, NULL) != 0 ||
+      pthread_create(&threads[1], NULL, high, NULL) != 0) {
+    fprintf(stderr, "Error creating thread\n");
+    exit(1);
+  }
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+
+  printf("Aging        : OK (%lu updates)\n", (unsigned long)x);
+  stm_exit();
+
+  return failed;
+}
@@ -0,0 +1,96 @@
+/*
+ * File:
+ *   shm.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for the shared segment of processes (requires
+ *   PROCESS_SHARED).  Processes repeatedly attach to and detach from the
+ *   segment, which is created and removed many times; attaching must
+ *   never fail and the last process must remove the segment.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "stm.h"
+
+#define NB_PROCESSES                    16
+#define NB_ATTACHES                     2000
+
+int main(int argc, char **argv)
+{
+  char name[64];
+  const char *flags;
+  int i, j, fd, status, failed;
+  pid_t pid;
+
+  snprintf(name, sizeof(name), "/tinystm-shm-%d", (int)getpid());
+  setenv("STM_SHM_NAME", name, 1);
+  stm_init();
+  if (!stm_get_parameter("compile_flags", &flags) || strstr(flags, "-DPROCESS_SHARED") == NULL) {
+    printf("Process-shared transactions are not enabled\n");
+    stm_exit();
+    return 0;
+  }
+  stm_exit();
+
+  for (i = 0; i < NB_PROCESSES; i++) {
+    if ((pid = fork()) < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      /* Exits upon failure to attach */
+      for (j = 0; j < NB_ATTACHES; j++) {
+        stm_init();
+        stm_exit();
+      }
+      exit(0);
+    }
+  }
+  failed = 0;
+  for (i = 0; i < NB_PROCESSES; i++) {
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      failed++;
+  }
+  if (failed != 0) {
+    printf("Attach       : FAILED (%d processes)\n", failed);
+    return 1;
+  }
+  printf("Attach       : OK\n");
+
+  if ((fd = shm_open(name, O_RDWR, 0)) >= 0 || errno != ENOENT) {
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(name);
+    }
+    printf("Detach       : FAILED (segment not removed)\n");
+    return 1;
+  }
+  printf("Detach       : OK\n");
+
+  return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * File:
+ *   typed.cpp
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test for the typed C++ interface.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+
+#include "stm.hpp"
+
+#define NB_THREADS                      4
+#define NB_ITERATIONS                   20000
+
+#define CHECK(c) \
+  do { \
+    if (!(c)) { \
+      fprintf(stderr, "FAILED line %d: %s\n", __LINE__, #c); \
+      exit(1); \
+    } \
+  } while (0)
+
+struct point {
+  int x, y, z;                          /* Not a multiple of a word */
+};
+
+struct pair {
+  stm_word_t a, b;                      /* Whole words */
+};
+
+/* Sub-word variables sharing words, and a struct spanning two words */
+static struct {
+  stm::tvar<uint32_t> u32;
+  stm::tvar<point> p;
+  stm::tvar<uint8_t> u8[3];
+  stm::tvar<uint16_t> u16;
+  stm::tvar<double> d;
+  stm::tvar<pair> q;
+} shared;
+
+static stm::tvar<long> total;
+
+static void *test(void *data)
+{
+  int i;
+
+  stm_init_thread();
+  for (i = 0; i < NB_ITERATIONS; i++) {
+    /* Objects with destructors are safe within transactions */
+    stm::atomically([&](stm::transaction &t) {
+      std::string s("increment");
+      point p = shared.p.load(t);
+      pair q = shared.q.load(t);
+      p.x++;
+      p.y += 2;
+      p.z += 3;
+      q.a++;
+      q.b--;
+      shared.p.store(t, p);
+      shared.q.store(t, q);
+      shared.u8[i % 3].store(t, shared.u8[i % 3].load(t) + 1);
+      shared.u16.store(t, shared.u16.load(t) + 1);
+      shared.u32.store(t, shared.u32.load(t) + 1);
+      shared.d.store(t, shared.d.load(t) + 0.5);
+      total.store(t, total.load(t) + (long)s.size());
+    });
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  pthread_t threads[NB_THREADS];
+  long n;
+  int i;
+
+  stm_init();
+  stm_init_thread();
+
+  /* An exception aborts the transaction and is propagated */
+  shared.u16.unsafe() = 0;
+  try {
+    stm::atomically([&] {
+      shared.u16.store(7);
+      throw std::runtime_error("failure");
+    });
+    CHECK(0);
+  } catch (const std::runtime_error &) {
+  }
+  CHECK(shared.u16.unsafe() == 0 && !stm_active());
+
+  /* Results and nested transactions */
+  n = stm::atomically([&](stm::transaction &t) {
+    total.store(t, 1);
+    return stm::atomically([&] { return total.load() + 1; });
+  });
+  CHECK(n == 2 && total.unsafe() == 1);
+  total.unsafe() = 0;
+
+  for (i = 0; i < NB_THREADS; i++)
+    pthread_create(&threads[i], NULL, test, NULL);
+  for (i = 0; i < NB_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  n = (long)NB_THREADS * NB_ITERATIONS;
+  CHECK(shared.p.unsafe().x == n && shared.p.unsafe().y == 2 * n && shared.p.unsafe().z == 3 * n);
+  CHECK(shared.q.unsafe().a == (stm_word_t)n && shared.q.unsafe().b == (stm_word_t)-n);
+  for (i = 0; i < 3; i++)
+    CHECK(shared.u8[i].unsafe() == (uint8_t)(NB_THREADS * ((NB_ITERATIONS + 2 - i) / 3)));
+  CHECK(shared.u16.unsafe() == (uint16_t)n && shared.u32.unsafe() == (uint32_t)n);
+  CHECK(shared.d.unsafe() == 0.5 * n);
+  CHECK(total.unsafe() == 9 * n);
+
+  stm_exit_thread();
+  stm_exit();
+
+  printf("Typed C++ interface: OK\n");
+  return 0;
+}
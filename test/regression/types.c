@@ -497,6 +497,39 @@ static void test_stores()
   stm_commit();
 }
 
+static void test_descriptor()
+{
+  struct stm_tx *tx;
+  sigjmp_buf *e;
+  void *p;
+  int i;
+
+  tx = stm_current_tx();
+  e = stm_start_tx(tx, (stm_tx_attr_t)0);
+  if (e != NULL)
+    sigsetjmp(*e, 0);
+
+  if (verbose)
+    printf("- Testing loads and stores with descriptor\n");
+  for (i = 0; i < 256 / sizeof(uint32_t); i++)
+    assert(stm_load_u32_tx(tx, &tab.u32[i]) == tab_ro.u32[i]);
+  for (i = 1; i < 256 - sizeof(long); i += sizeof(long)) {
+    /* Inline word-sized accessors, misaligned */
+    assert(stm_load_ulong_tx(tx, (volatile unsigned long *)&tab.u8[i]) == *(unsigned long *)&tab_ro.u8[i]);
+    stm_store_long_tx(tx, (volatile long *)&tab.u8[i], *(long *)&tab_ro.u8[i]);
+  }
+  stm_store_u16_tx(tx, &tab.u16[3], tab_ro.u16[3]);
+  stm_store_double_tx(tx, &tab.d[5], tab_ro.d[5]);
+  p = stm_load_ptr_tx(tx, (volatile void **)&tab.u64[2]);
+  stm_store_ptr_tx(tx, (volatile void **)&tab.u64[2], p);
+  stm_move_bytes_tx(tx, &tab.u8[1], &tab.u8[1], 100);
+  assert(stm_load_u8_tx(tx, &tab.u8[77]) == tab_ro.u8[77]);
+
+  stm_commit_tx(tx);
+  for (i = 0; i < 256; i++)
+    assert(tab.u8[i] == tab_ro.u8[i]);
+}
+
 static void *test(void *v)
 {
   unsigned int seed;
@@ -559,6 +592,10 @@ int main(int argc, char **argv)
   test_stores();
   printf("PASSED\n");
 
+  printf("TESTING EXPLICIT DESCRIPTOR...\n");
+  test_descriptor();
+  printf("PASSED\n");
+
   stm_exit_thread();
 
   printf("TESTING CONCURRENT LOADS AND STORES...\n");
@@ -0,0 +1,371 @@
+/*
+ * File:
+ *   unit_cas.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Regression test and microbenchmark for multi-word unit CAS (requires
+ *   UNIT_TX).
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "stm.h"
+
+#define DEFAULT_DURATION                1000
+#define DEFAULT_NB_THREADS              4
+#define DEFAULT_NB_ACCOUNTS             64
+#define BENCH_NB                        1000000
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static volatile int stop;
+static stm_word_t *accounts;
+static int nb_accounts = DEFAULT_NB_ACCOUNTS;
+static volatile int failed;
+
+#define CHECK(c)                        do { if (!(c)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); exit(1); } } while (0)
+
+/*
+ * Sequential tests of the semantics.
+ */
+static void test_semantics(void)
+{
+  static stm_word_t a[32];
+  volatile stm_word_t *addrs[3];
+  stm_word_t expected[3], desired[3], ts, ts2;
+
+  /* Different stripes */
+  addrs[0] = &a[0];
+  addrs[1] = &a[8];
+  addrs[2] = &a[16];
+  expected[0] = expected[1] = expected[2] = 0;
+  desired[0] = 1;
+  desired[1] = 2;
+  desired[2] = 3;
+  CHECK(stm_unit_cas(3, addrs, expected, desired, NULL) == 1);
+  CHECK(a[0] == 1 && a[8] == 2 && a[16] == 3);
+
+  /* Mismatch: nothing is written */
+  expected[0] = 1;
+  expected[1] = 2;
+  expected[2] = 4;
+  desired[0] = desired[1] = desired[2] = 5;
+  CHECK(stm_unit_cas(3, addrs, expected, desired, NULL) == 0);
+  CHECK(a[0] == 1 && a[8] == 2 && a[16] == 3);
+
+  /* Timestamps: new timestamp upon success, rejected if older */
+  expected[2] = 3;
+  ts = stm_get_clock();
+  CHECK(stm_unit_cas(3, addrs, expected, desired, &ts) == 1);
+  CHECK(a[0] == 5 && a[8] == 5 && a[16] == 5);
+  CHECK(stm_unit_load(&a[8], &ts2) == 5 && ts2 == ts);
+  ts2 = ts - 1;
+  expected[0] = expected[1] = expected[2] = 5;
+  desired[0] = desired[1] = desired[2] = 6;
+  CHECK(stm_unit_cas(3, addrs, expected, desired, &ts2) == 0);
+  CHECK(ts2 == ts && a[0] == 5);
+
+  /* Adjacent words (possibly the same stripe) */
+  addrs[0] = &a[25];
+  addrs[1] = &a[24];
+  expected[0] = expected[1] = 0;
+  desired[0] = 7;
+  desired[1] = 8;
+  CHECK(stm_unit_cas(2, addrs, expected, desired, NULL) == 1);
+  CHECK(a[25] == 7 && a[24] == 8);
+
+  /* Interoperability with transactions */
+  {
+    stm_tx_attr_t attr;
+    sigjmp_buf *e;
+    memset(&attr, 0, sizeof(attr));
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    CHECK(stm_load(&a[24]) == 8);
+    stm_store(&a[24], 9);
+    stm_commit();
+  }
+  expected[0] = 7;
+  expected[1] = 9;
+  desired[0] = desired[1] = 0;
+  CHECK(stm_unit_cas(2, addrs, expected, desired, NULL) == 1);
+  CHECK(a[25] == 0 && a[24] == 0);
+
+  /* More locations than STM_UNIT_CAS_MAX */
+  {
+    static stm_word_t b[4 * STM_UNIT_CAS_MAX];
+    volatile stm_word_t *baddrs[2 * STM_UNIT_CAS_MAX];
+    stm_word_t bexpected[2 * STM_UNIT_CAS_MAX], bdesired[2 * STM_UNIT_CAS_MAX];
+    int i;
+    for (i = 0; i < 2 * STM_UNIT_CAS_MAX; i++) {
+      baddrs[i] = &b[2 * i];
+      bexpected[i] = 0;
+      bdesired[i] = i + 1;
+    }
+    CHECK(stm_unit_cas(2 * STM_UNIT_CAS_MAX, baddrs, bexpected, bdesired, NULL) == 1);
+    for (i = 0; i < 2 * STM_UNIT_CAS_MAX; i++)
+      CHECK(b[2 * i] == i + 1);
+    CHECK(stm_unit_cas(2 * STM_UNIT_CAS_MAX, baddrs, bexpected, bexpected, NULL) == 0);
+    CHECK(b[0] == 1);
+  }
+
+  printf("Semantics    : OK\n");
+}
+
+/*
+ * Concurrent transfers between 3 accounts with unit CASes and with transactions.
+ */
+static void *test(void *data)
+{
+  unsigned int seed = (unsigned int)(long)data;
+  volatile stm_word_t *addrs[3];
+  stm_word_t expected[3], desired[3], sum;
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  int i, j, k, t;
+
+  stm_init_thread();
+  memset(&attr, 0, sizeof(attr));
+  t = 0;
+  while (stop == 0) {
+    i = rand_r(&seed) % nb_accounts;
+    do { j = rand_r(&seed) % nb_accounts; } while (j == i);
+    do { k = rand_r(&seed) % nb_accounts; } while (k == i || k == j);
+    switch (t++ % 3) {
+     case 0:
+       /* Unit CAS */
+       addrs[0] = &accounts[i];
+       addrs[1] = &accounts[j];
+       addrs[2] = &accounts[k];
+       do {
+         expected[0] = stm_unit_load(addrs[0], NULL);
+         expected[1] = stm_unit_load(addrs[1], NULL);
+         expected[2] = stm_unit_load(addrs[2], NULL);
+         desired[0] = expected[0] - 2;
+         desired[1] = expected[1] + 1;
+         desired[2] = expected[2] + 1;
+       } while (stm_unit_cas(3, addrs, expected, desired, NULL) == 0);
+       break;
+     case 1:
+       /* Transaction */
+       e = stm_start(attr);
+       if (e != NULL)
+         sigsetjmp(*e, 0);
+       stm_store(&accounts[i], stm_load(&accounts[i]) + 2);
+       stm_store(&accounts[j], stm_load(&accounts[j]) - 1);
+       stm_store(&accounts[k], stm_load(&accounts[k]) - 1);
+       stm_commit();
+       break;
+     default:
+       /* Consistency check */
+       attr.read_only = 1;
+       e = stm_start(attr);
+       if (e != NULL)
+         sigsetjmp(*e, 0);
+       sum = 0;
+       for (i = 0; i < nb_accounts; i++)
+         sum += stm_load(&accounts[i]);
+       stm_commit();
+       attr.read_only = 0;
+       if (sum != 0)
+         failed = 1;
+       break;
+    }
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+static double now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e9 + tv.tv_usec * 1e3;
+}
+
+/*
+ * Compare the cost of a 3-word update with a unit CAS and a transaction.
+ */
+static void bench(void)
+{
+  static stm_word_t a[64];
+  volatile stm_word_t *addrs[3] = { &a[0], &a[16], &a[32] };
+  stm_word_t expected[3], desired[3];
+  stm_tx_attr_t attr;
+  sigjmp_buf *e;
+  double start;
+  long i;
+
+  start = now();
+  for (i = 0; i < BENCH_NB; i++) {
+    expected[0] = stm_unit_load(addrs[0], NULL);
+    expected[1] = stm_unit_load(addrs[1], NULL);
+    expected[2] = stm_unit_load(addrs[2], NULL);
+    desired[0] = expected[0] + 1;
+    desired[1] = expected[1] + 1;
+    desired[2] = expected[2] + 1;
+    stm_unit_cas(3, addrs, expected, desired, NULL);
+  }
+  printf("Unit CAS     : %.1f ns / 3-word update\n", (now() - start) / BENCH_NB);
+
+  memset(&attr, 0, sizeof(attr));
+  start = now();
+  for (i = 0; i < BENCH_NB; i++) {
+    e = stm_start(attr);
+    if (e != NULL)
+      sigsetjmp(*e, 0);
+    stm_store(addrs[0], stm_load(addrs[0]) + 1);
+    stm_store(addrs[1], stm_load(addrs[1]) + 1);
+    stm_store(addrs[2], stm_load(addrs[2]) + 1);
+    stm_commit();
+  }
+  printf("Transaction  : %.1f ns / 3-word update\n", (now() - start) / BENCH_NB);
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"accounts",                  required_argument, NULL, 'a'},
+    {"bench",                     no_argument,       NULL, 'b'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, c, duration, nb_threads, do_bench;
+  const char *flags;
+  pthread_t *threads;
+  struct timespec timeout;
+  stm_word_t sum;
+
+  duration = DEFAULT_DURATION;
+  nb_threads = DEFAULT_NB_THREADS;
+  do_bench = 0;
+
+  while (1) {
+    i = 0;
+    c = getopt_long(argc, argv, "ha:bd:n:", long_options, &i);
+
+    if (c == -1)
+      break;
+
+    switch (c) {
+     case 'h':
+       printf("unit_cas -- test of multi-word unit CAS\n"
+              "\n"
+              "Usage:\n"
+              "  unit_cas [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -a, --accounts <int>\n"
+              "        Number of accounts (default=" XSTR(DEFAULT_NB_ACCOUNTS) ")\n"
+              "  -b, --bench\n"
+              "        Run microbenchmark instead of test\n"
+              "  -d, --duration <int>\n"
+              "        Test duration in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+         );
+       exit(0);
+     case 'a':
+       nb_accounts = atoi(optarg);
+       break;
+     case 'b':
+       do_bench = 1;
+       break;
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(nb_accounts >= 3);
+  assert(nb_threads > 0);
+
+  stm_init();
+  if (!stm_get_parameter("compile_flags", &flags) || strstr(flags, "-DUNIT_TX") == NULL) {
+    printf("Unit transactions are not enabled\n");
+    stm_exit();
+    return 0;
+  }
+  stm_init_thread();
+
+  if (do_bench) {
+    bench();
+    stm_exit_thread();
+    stm_exit();
+    return 0;
+  }
+
+  test_semantics();
+
+  accounts = (stm_word_t *)calloc(nb_accounts, sizeof(stm_word_t));
+  threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t));
+  if (accounts == NULL || threads == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_create(&threads[i], NULL, test, (void *)(long)(i + 1)) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+  nanosleep(&timeout, NULL);
+  stop = 1;
+  for (i = 0; i < nb_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  sum = 0;
+  for (i = 0; i < nb_accounts; i++)
+    sum += accounts[i];
+  printf("Concurrency  : %s\n", (sum == 0 && !failed) ? "OK" : "FAILED");
+
+  free(threads);
+  free(accounts);
+  stm_exit_thread();
+  stm_exit();
+
+  return (sum == 0 && !failed) ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+/*
+ * File:
+ *   trace2json.c
+ * Author(s):
+ *   Pascal Felber <pascal.felber@unine.ch>
+ *   Patrick Marlier <patrick.marlier@unine.ch>
+ * Description:
+ *   Convert trace files of mod_trace to the Chrome trace format.
+ *
+ * Copyright (c) 2007-2014.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This program has a dual license and can also be distributed
+ * under the terms of the MIT license.
+ */
+
+/*
+ * Usage: trace2json <trace file> [<json file>]
+ *
+ * Every attempt of a transaction becomes a complete event ("X") named
+ * after its atomic block, in category "commit" or "abort", if its start
+ * is known (see STM_TRACE_FLAG_START), and an instant event at its end
+ * otherwise.  Snapshot extensions and irrevocability are instant
+ * events.  The output can be
+ * loaded in chrome://tracing or https://ui.perfetto.dev.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mod_trace.h"
+
+static const char *reasons[16] = {
+  "other", "rr", "rw", "wr", "ww", "val-r", "val-w", "val-c",
+  "?", "irrevocable", "killed", "signal", "extend-ws", "?", "?", "other"
+};
+
+static double ticks_per_us;
+static uint64_t ts_origin;
+
+static double to_us(uint64_t ts)
+{
+  return (double)(int64_t)(ts - ts_origin) / ticks_per_us;
+}
+
+static const char *reason_name(uint32_t reason)
+{
+  if ((reason & STM_ABORT_EXPLICIT) != 0)
+    return ((reason & STM_ABORT_NO_RETRY) == STM_ABORT_NO_RETRY ? "explicit-no-retry" : "explicit");
+  return reasons[(reason >> 8) & 0x0F];
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in, *out;
+  stm_trace_header_t h;
+  stm_trace_record_t r;
+  unsigned long n;
+  int first = 1;
+
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <trace file> [<json file>]\n", argv[0]);
+    return 1;
+  }
+  if ((in = fopen(argv[1], "rb")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  out = stdout;
+  if (argc == 3 && (out = fopen(argv[2], "w")) == NULL) {
+    perror(argv[2]);
+    return 1;
+  }
+  if (fread(&h, sizeof(h), 1, in) != 1 || h.magic != STM_TRACE_MAGIC) {
+    fprintf(stderr, "%s: not a trace file\n", argv[1]);
+    return 1;
+  }
+  if (h.version != STM_TRACE_VERSION || h.record_size != sizeof(stm_trace_record_t)) {
+    fprintf(stderr, "%s: unsupported version %u\n", argv[1], h.version);
+    return 1;
+  }
+  if (h.ts_end > h.ts_start && h.ns_end > h.ns_start) {
+    ticks_per_us = (double)(h.ts_end - h.ts_start) * 1000.0 / (double)(h.ns_end - h.ns_start);
+  } else {
+    fprintf(stderr, "%s: trace was not closed (assuming 1 tick per ns)\n", argv[1]);
+    ticks_per_us = 1000.0;
+  }
+  ts_origin = h.ts_start;
+  if (h.nb_dropped > 0)
+    fprintf(stderr, "%s: %lu records were dropped\n", argv[1], (unsigned long)h.nb_dropped);
+
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (n = 0; n < h.nb_records && fread(&r, sizeof(r), 1, in) == 1; n++) {
+    switch (r.event) {
+     case STM_TRACE_THREAD_INIT:
+       fprintf(out, "%s{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"thread %u\"}}",
+               first ? "" : ",\n", r.thread, r.thread);
+       break;
+     case STM_TRACE_COMMIT:
+     case STM_TRACE_ABORT:
+       if ((r.flags & STM_TRACE_FLAG_START) != 0)
+         fprintf(out, "%s{\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"name\":\"tx %u\",\"cat\":\"%s\",\"ts\":%.3f,\"dur\":%.3f,",
+                 first ? "" : ",\n", r.thread, r.id, r.event == STM_TRACE_COMMIT ? "commit" : "abort",
+                 to_us(r.ts - r.duration), r.duration / ticks_per_us);
+       else
+         fprintf(out, "%s{\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"name\":\"tx %u\",\"cat\":\"%s\",\"ts\":%.3f,",
+                 first ? "" : ",\n", r.thread, r.id, r.event == STM_TRACE_COMMIT ? "commit" : "abort", to_us(r.ts));
+       fprintf(out, "\"args\":{\"rs\":%u,\"ws\":%u,\"extensions\":%u", r.rs, r.ws, r.extensions);
+       if (r.event == STM_TRACE_ABORT)
+         fprintf(out, ",\"reason\":\"%s\"", reason_name(r.reason));
+       fprintf(out, "}}");
+       break;
+     case STM_TRACE_EXTEND:
+     case STM_TRACE_IRREVOCABLE:
+       fprintf(out, "%s{\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"args\":{\"id\":%u,\"rs\":%u}}",
+               first ? "" : ",\n", r.thread, r.event == STM_TRACE_EXTEND ? "extend" : "irrevocable",
+               to_us(r.ts), r.id, r.rs);
+       break;
+     default:
+       continue;
+    }
+    first = 0;
+  }
+  fprintf(out, "\n]}\n");
+
+  fclose(in);
+  if (out != stdout)
+    fclose(out);
+
+  return 0;
+}